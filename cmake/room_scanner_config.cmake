@@ -9,8 +9,28 @@ if(NOT DEFINED ROOM_SCANNER_ROOT)
 endif()
 
 file(GLOB_RECURSE ROOM_SCANNER_SRC "src/*.hpp" "src/*.h" "src/*.cpp")
+list(FILTER ROOM_SCANNER_SRC EXCLUDE REGEX ".*/src/batch/main\\.cpp$")
+list(FILTER ROOM_SCANNER_SRC EXCLUDE REGEX ".*/src/benchmark/main\\.cpp$")
+if(ROOM_SCANNER_CUDA)
+  file(GLOB_RECURSE ROOM_SCANNER_CUDA_SRC "src/*.cu")
+  list(APPEND ROOM_SCANNER_SRC ${ROOM_SCANNER_CUDA_SRC})
+endif()
 source_group(TREE ${CMAKE_CURRENT_SOURCE_DIR} FILES ${ROOM_SCANNER_SRC})
 
+# Headless batch reconstruction: no widgets and no reconstruction interface
+set(ROOM_SCANNER_BATCH_SRC ${ROOM_SCANNER_SRC})
+list(FILTER ROOM_SCANNER_BATCH_SRC EXCLUDE REGEX ".*/src/main\\.cpp$")
+list(FILTER ROOM_SCANNER_BATCH_SRC EXCLUDE REGEX ".*/src/gui/(imp/)?(scannerwidget|imagesviewerwidget)\\.(h|cpp)$")
+list(FILTER ROOM_SCANNER_BATCH_SRC EXCLUDE REGEX ".*/src/core/reconstruction/(imp/)?reconstructioninterface\\.(h|cpp)$")
+
+# Micro benchmarks of the core kernels: the batch sources without its entry point
+set(ROOM_SCANNER_BENCHMARK_SRC ${ROOM_SCANNER_BATCH_SRC})
+list(APPEND ROOM_SCANNER_BENCHMARK_SRC "${CMAKE_CURRENT_SOURCE_DIR}/src/benchmark/main.cpp")
+source_group(TREE ${CMAKE_CURRENT_SOURCE_DIR} FILES ${ROOM_SCANNER_BENCHMARK_SRC})
+
+list(APPEND ROOM_SCANNER_BATCH_SRC "${CMAKE_CURRENT_SOURCE_DIR}/src/batch/main.cpp")
+source_group(TREE ${CMAKE_CURRENT_SOURCE_DIR} FILES ${ROOM_SCANNER_BATCH_SRC})
+
 if(MSVC)
   add_compile_options(/MP /bigobj)
 endif()
@@ -14,6 +14,10 @@ set(VCPKG_PACKAGES
     opencv2
     pcl[opengl,openni2,qt,vtk])
 
+if(ROOM_SCANNER_BENCHMARKS)
+  list(APPEND VCPKG_PACKAGES benchmark)
+endif()
+
 set(CMAKE_TOOLCHAIN_FILE
     "$ENV{VCPKG_ROOT}/scripts/buildsystems/vcpkg.cmake"
     CACHE STRING "")
@@ -0,0 +1,91 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <QJsonArray>
+#include <QObject>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+
+#include "core/base/scannerbase.h"
+
+#include <map>
+#include <vector>
+
+/** \brief Search of the configs.ini AUTOTUNE_SETTINGS parameters for the fastest values whose run on a sample
+  * of the session meets the trajectory and loop seam error targets. Every trial is a BatchReconstruction
+  * benchmark on copies of configs.ini and project.ini holding the trial values, configs.ini is published
+  * to the objects of the trial with ScannerConfig::reload() and restored after the search.
+  */
+class Autotuner : public ScannerBase {
+    Q_OBJECT
+
+public:
+    Autotuner(QObject* parent, QSettings* parent_settings);
+
+    /** \brief Coordinate search from the current values: every pass tries the faster values of each parameter,
+      * fastest first, and keeps the first one meeting the targets, until a pass changes nothing or MAX_TRIALS
+      * runs are made. A value first runs on SCREEN_FRACTION of the sample and only runs on all of it when
+      * it meets the targets and is still faster than the best. Without a reference the run of the slowest
+      * values becomes the reference. Writes every trial and the best values to output_filename as JSON, the
+      * tuned configs.ini next to it and the tuned project next to the project as <name>_tuned.ini.
+      * Returns a process exit code, 1 when no values meet the targets.
+      */
+    int run(const QString& output_filename, const QString& reference_filename);
+
+private:
+    /** \brief AUTOTUNE_SETTINGS key of the values, fastest first, and the key it sets. */
+    struct Parameter {
+        QString name;
+        QString key;
+        bool in_project;
+        QStringList values;
+    };
+
+    /** \brief Index of the value of every parameter, -1 keeps the value of the session. */
+    typedef std::vector<int> Choice;
+
+    struct Result {
+        bool valid;
+        double seconds;
+        size_t frames;
+        size_t trajectory_count;
+        double trajectory_rmse;
+        size_t seam_count;
+        double seam_rmse;
+    };
+
+    const QString algorithm;
+    const int sample_frames;
+    const double screen_fraction;
+    const int max_trials;
+    const double max_trajectory_rmse;
+    const double max_seam_rmse;
+    std::vector<Parameter> parameters;
+
+    QString output_filename;
+    QString reference_filename;
+    int trials_count;
+    std::map<std::pair<Choice, double>, Result> results;
+    QJsonArray trials_json;
+
+    /** \brief Cached per choice and fraction of the sample. */
+    Result evaluate(const Choice& choice, const double& fraction);
+
+    bool meets_targets(const Result& result) const;
+
+    /** \brief A trial samples fraction of SAMPLE_FRAMES and saves nothing but the benchmark report. */
+    bool write_settings(const Choice& choice, const bool& trial, const double& fraction,
+        const QString& configs_filename, const QString& project_filename) const;
+
+    QString session_value(const Parameter& parameter) const;
+
+    QString value_of(const Choice& choice, const size_t& index) const;
+
+    /** \brief NAME=value of every parameter. */
+    QString describe(const Choice& choice) const;
+
+    QString sibling(const QString& filename, const QString& suffix) const;
+};
+
+#endif // AUTOTUNER_H
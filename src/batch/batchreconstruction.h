@@ -0,0 +1,58 @@
+#ifndef BATCH_RECONSTRUCTION_H
+#define BATCH_RECONSTRUCTION_H
+
+#include <QObject>
+#include <QSettings>
+#include <QStringList>
+
+#include "batch/trajectory.h"
+#include "core/base/scannerbase.h"
+#include "core/reconstruction/volumereconstruction.h"
+
+#include <string>
+
+/** \brief Runs the registration algorithm selected in project.ini and the TSDF
+  * meshing without any widget or visualizer window.
+  */
+class BatchReconstruction : public ScannerBase {
+    Q_OBJECT
+
+public:
+    BatchReconstruction(QObject* parent, QSettings* parent_settings);
+
+    /** \brief Returns a process exit code. */
+    int run();
+
+    /** \brief Runs the algorithms, LinearBased, MiddleBased and EdgeBased when empty, one after the other
+      * on a new volume each and writes frames per second, peak RSS, stage times, mesh size, the memory
+      * figures and the trajectory and loop seam errors against the reference poses to output_filename as JSON.
+      * Every estimated trajectory is written next to it, so a run can become the reference.
+      * Peak RSS is of the process so far, benchmark one algorithm per process to tell their peaks apart.
+      */
+    int benchmark(const QString& output_filename, const QString& reference_filename, const QStringList& algorithms);
+
+    /** \brief Processes the edge based loop jobs of DISTRIBUTED_SETTINGS/JOBS_FOLDER written by the run
+      * of another process on the same project, until none is left. Returns a process exit code.
+      */
+    int work();
+
+    /** \brief Edge based reconstruction of the whole session with the configs.ini PREVIEW_SETTINGS values
+      * replacing those of configs.ini and the project: downsampled frames, ORB keypoints, a coarse volume and
+      * no ELCH/LUM or edge balancing. The mesh grows in the visualizer, which is kept open until it is closed.
+      * The copies it runs on are written next to the project and configs.ini and removed afterwards.
+      * Returns a process exit code.
+      */
+    int preview();
+
+private:
+    VolumeReconstruction::Ptr volumeReconstruction;
+
+    template <class Algorithm>
+    void reconstruct();
+
+    /** \brief JSON object of one run. */
+    template <class Algorithm>
+    std::string benchmark_run(const char* name, const trajectory::Poses& reference, const QString& output_filename);
+};
+
+#endif // BATCH_RECONSTRUCTION_H
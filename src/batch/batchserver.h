@@ -0,0 +1,39 @@
+#ifndef BATCH_SERVER_H
+#define BATCH_SERVER_H
+
+#include <QString>
+
+#include <atomic>
+#include <mutex>
+
+/** \brief Long-running batch reconstruction of the projects queued in a folder, configs.ini SERVER_SETTINGS.
+  * A <name>.job file holds the path of a project.ini, it is renamed to <name>.running while the project
+  * is reconstructed and to <name>.done or <name>.failed after. A stop file in the folder ends the server
+  * once the running projects finish.
+  *
+  * Up to CONCURRENT_PROJECTS projects run at once in one process, so they share the thread pool, the
+  * frame cache, the calibration models and the project-independent setup, each within its job_limits.
+  */
+class BatchServer {
+public:
+    explicit BatchServer(const QString& queue_folder);
+
+    /** \brief Returns a process exit code once stopped. */
+    int serve();
+
+private:
+    const QString queue_folder;
+
+    std::mutex claim_mutex;
+    std::atomic<size_t> done_count;
+    std::atomic<size_t> failed_count;
+
+    void work();
+
+    /** \brief Renames the oldest job to running, false when the queue is empty. */
+    bool claim_job(QString& name, QString& project_filename);
+
+    bool stopping() const;
+};
+
+#endif // BATCH_SERVER_H
@@ -0,0 +1,312 @@
+#include "batch/autotuner.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <cmath>
+
+#include "batch/batchreconstruction.h"
+#include "io/settingsoverlay.h"
+
+namespace {
+
+struct ParameterKey {
+    const char* name;
+    const char* key;
+    bool in_project;
+};
+
+//The TSDF resolution is the voxel size of the VOXEL_HASH backend
+const ParameterKey PARAMETER_KEYS[] = {
+    { "SAC_MAX_ITERATIONS", "SAC_SETTINGS/MAX_ITERATIONS", false },
+    { "ICP_MAX_ITERATIONS", "ICP_SETTINGS/MAX_ITERATIONS", false },
+    { "MIN_HISS", "OPENCV_KEYPOINT_DETECTION_SETTINGS/MIN_HISS", false },
+    { "FIXED_STEP", "ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_FIXED_STEP", true },
+    { "READING_STEP", "READING_SETTING/STEP", true },
+    { "VOXEL_SIZE", "CPU_TSDF_SETTINGS/VOXEL_SIZE", false },
+};
+
+/** \brief The one run of a BatchReconstruction::benchmark report. */
+bool read_report(const QString& filename, size_t& frames, double& seconds, size_t& trajectory_count,
+    double& trajectory_rmse, size_t& seam_count, double& seam_rmse)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QJsonObject run = QJsonDocument::fromJson(file.readAll()).object().value("runs").toArray().at(0).toObject();
+    if (run.isEmpty()) {
+        return false;
+    }
+
+    const QJsonObject trajectory_error = run.value("trajectory_error").toObject();
+    const QJsonObject seam_error = run.value("loop_seam_error").toObject();
+    frames = size_t(run.value("frames").toDouble());
+    seconds = run.value("seconds").toDouble();
+    trajectory_count = size_t(trajectory_error.value("count").toDouble());
+    trajectory_rmse = trajectory_error.value("translation_rmse_m").toDouble();
+    seam_count = size_t(seam_error.value("count").toDouble());
+    seam_rmse = seam_error.value("translation_rmse_m").toDouble();
+    return true;
+}
+
+} // namespace
+
+Autotuner::Autotuner(QObject* parent, QSettings* parent_settings)
+    : ScannerBase(parent, parent_settings)
+    , algorithm(configs.value("AUTOTUNE_SETTINGS/ALGORITHM").toString())
+    , sample_frames(std::max(1, configs.value("AUTOTUNE_SETTINGS/SAMPLE_FRAMES").toInt()))
+    , screen_fraction(std::min(1.0, std::max(0.0, configs.value("AUTOTUNE_SETTINGS/SCREEN_FRACTION").toDouble())))
+    , max_trials(std::max(1, configs.value("AUTOTUNE_SETTINGS/MAX_TRIALS").toInt()))
+    , max_trajectory_rmse(configs.value("AUTOTUNE_SETTINGS/MAX_TRAJECTORY_RMSE").toDouble())
+    , max_seam_rmse(configs.value("AUTOTUNE_SETTINGS/MAX_SEAM_RMSE").toDouble())
+    , trials_count(0)
+{
+    for (const ParameterKey& key : PARAMETER_KEYS) {
+        Parameter parameter = { key.name, key.key, key.in_project, QStringList() };
+        for (const QString& value : configs.value(QString("AUTOTUNE_SETTINGS/") + key.name).toStringList()) {
+            if (!value.trimmed().isEmpty()) {
+                parameter.values.push_back(value.trimmed());
+            }
+        }
+        if (!parameter.values.isEmpty()) {
+            parameters.push_back(parameter);
+        }
+    }
+}
+
+int Autotuner::run(const QString& output_filename_, const QString& reference_filename_)
+{
+    output_filename = output_filename_;
+    reference_filename = reference_filename_;
+    trials_count = 0;
+    results.clear();
+    trials_json = QJsonArray();
+
+    if (parameters.empty()) {
+        qDebug() << "AUTOTUNE_SETTINGS has no parameter values to search";
+        return 1;
+    }
+
+    Choice session;
+    Choice slowest;
+    for (const Parameter& parameter : parameters) {
+        const QString current = session_value(parameter);
+        int index = -1;
+        for (int i = 0; i < parameter.values.size() && index < 0; ++i) {
+            if (parameter.values[i].toDouble() == current.toDouble()) {
+                index = i;
+            }
+        }
+        session.push_back(index);
+        slowest.push_back(parameter.values.size() - 1);
+    }
+
+    if (reference_filename.isEmpty()) {
+        //The trajectory of the slowest values is the reference of all the others
+        const QString label = QString("trial%1").arg(trials_count + 1);
+        if (!evaluate(slowest, 1.0).valid) {
+            qDebug() << "The reference run of the slowest values failed";
+            return 1;
+        }
+        reference_filename = sibling(output_filename, "_" + label + "_" + algorithm + ".txt");
+        results.clear();
+        qDebug() << "Reference trajectory" << reference_filename;
+    }
+
+    Choice best = session;
+    Result best_result = evaluate(best, 1.0);
+    if (!meets_targets(best_result)) {
+        qDebug() << "The session values miss the targets, searching from the slowest values";
+        best = slowest;
+        best_result = evaluate(best, 1.0);
+    }
+
+    const bool found = meets_targets(best_result);
+    bool improved = found;
+    while (improved && trials_count < max_trials) {
+        improved = false;
+        for (size_t p = 0; p < parameters.size() && trials_count < max_trials; ++p) {
+            //Only the values before the current one are faster, all of them without a current one
+            const int faster_count = best[p] < 0 ? parameters[p].values.size() : best[p];
+            for (int v = 0; v < faster_count && trials_count < max_trials && !improved; ++v) {
+                Choice candidate = best;
+                candidate[p] = v;
+
+                //A value missing the targets or slower than the best on part of the sample is not run on all of it
+                if (screen_fraction > 0.0 && screen_fraction < 1.0) {
+                    const Result best_screen = evaluate(best, screen_fraction);
+                    const Result screen = evaluate(candidate, screen_fraction);
+                    if (!meets_targets(screen) || (best_screen.valid && screen.seconds >= best_screen.seconds)
+                        || trials_count >= max_trials) {
+                        continue;
+                    }
+                }
+
+                const Result full = evaluate(candidate, 1.0);
+                if (meets_targets(full) && full.seconds < best_result.seconds) {
+                    best = candidate;
+                    best_result = full;
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    QJsonObject report;
+    report.insert("algorithm", algorithm);
+    report.insert("reference", reference_filename);
+    report.insert("max_trajectory_rmse_m", max_trajectory_rmse);
+    report.insert("max_seam_rmse_m", max_seam_rmse);
+    report.insert("trials", trials_json);
+    if (found) {
+        QJsonObject values;
+        for (size_t p = 0; p < parameters.size(); ++p) {
+            values.insert(parameters[p].key, value_of(best, p));
+        }
+
+        QJsonObject best_json;
+        best_json.insert("values", values);
+        best_json.insert("seconds", best_result.seconds);
+        best_json.insert("trajectory_rmse_m", best_result.trajectory_rmse);
+        best_json.insert("seam_rmse_m", best_result.seam_rmse);
+        report.insert("best", best_json);
+
+        const QString configs_filename = sibling(output_filename, "_configs.ini");
+        const QString project_filename = sibling(settings->fileName(), "_tuned.ini");
+        if (!write_settings(best, false, 1.0, configs_filename, project_filename)) {
+            qDebug() << "Can't write" << configs_filename << "or" << project_filename;
+        }
+        qDebug() << "Fastest values meeting the targets:" << describe(best) << "," << best_result.seconds << "s";
+    } else {
+        qDebug() << "No values meet the targets";
+    }
+
+    QFile::remove(sibling(output_filename, "_trial_configs.ini"));
+    QFile::remove(sibling(settings->fileName(), "_autotune.ini"));
+
+    QFile file(output_filename);
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+        qDebug() << "Can't write" << output_filename;
+        return 1;
+    }
+
+    return found ? 0 : 1;
+}
+
+/** \brief The trial's configs.ini is published for the benchmark and the session's one is published back. */
+Autotuner::Result Autotuner::evaluate(const Choice& choice, const double& fraction)
+{
+    const auto key = std::make_pair(choice, fraction);
+    const auto found = results.find(key);
+    if (found != results.end()) {
+        return found->second;
+    }
+
+    const QString label = QString("trial%1").arg(++trials_count);
+    const QString report_filename = sibling(output_filename, "_" + label + ".json");
+    const QString configs_filename = sibling(output_filename, "_trial_configs.ini");
+    //Next to the project, so its folders are found as they are
+    const QString project_filename = sibling(settings->fileName(), "_autotune.ini");
+
+    Result result = { false, 0.0, 0, 0, 0.0, 0, 0.0 };
+    if (write_settings(choice, true, fraction, configs_filename, project_filename)) {
+        ScannerConfig::reload(configs_filename);
+        {
+            QSettings trial_settings(project_filename, QSettings::IniFormat);
+            BatchReconstruction batch(nullptr, &trial_settings);
+            result.valid = batch.benchmark(report_filename, reference_filename, QStringList(algorithm)) == 0
+                && read_report(report_filename, result.frames, result.seconds, result.trajectory_count,
+                       result.trajectory_rmse, result.seam_count, result.seam_rmse);
+        }
+        ScannerConfig::reload(configs.fileName());
+    }
+
+    const bool passed = meets_targets(result);
+    qDebug() << label << describe(choice) << "on" << fraction << "of the sample:"
+             << (result.valid ? QString::number(result.seconds) + " s" : QString("failed"))
+             << (passed ? "meets the targets" : "misses the targets");
+
+    QJsonObject trial;
+    trial.insert("label", label);
+    trial.insert("values", describe(choice));
+    trial.insert("sample_fraction", fraction);
+    trial.insert("valid", result.valid);
+    trial.insert("passed", passed);
+    trial.insert("seconds", result.seconds);
+    trial.insert("frames", double(result.frames));
+    trial.insert("trajectory_rmse_m", result.trajectory_rmse);
+    trial.insert("seam_rmse_m", result.seam_rmse);
+    trials_json.append(trial);
+
+    results[key] = result;
+    return result;
+}
+
+/** \brief Seams are only checked when the algorithm has any. */
+bool Autotuner::meets_targets(const Result& result) const
+{
+    return result.valid
+        && result.trajectory_count > 0 && result.trajectory_rmse <= max_trajectory_rmse
+        && (result.seam_count == 0 || result.seam_rmse <= max_seam_rmse);
+}
+
+bool Autotuner::write_settings(const Choice& choice, const bool& trial, const double& fraction,
+    const QString& configs_filename, const QString& project_filename) const
+{
+    settings_overlay::Values configs_values;
+    settings_overlay::Values project_values;
+    for (size_t p = 0; p < parameters.size(); ++p) {
+        (parameters[p].in_project ? project_values : configs_values).insert(parameters[p].key, value_of(choice, p));
+    }
+
+    if (trial) {
+        //A resumed run would skip loops, and the meshes of the trials are of no use
+        configs_values.insert("CHECKPOINT_SETTINGS/ENABLE", false);
+        configs_values.insert("DISTRIBUTED_SETTINGS/ENABLE", false);
+        configs_values.insert("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_PLY", false);
+        configs_values.insert("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_PCD", false);
+        configs_values.insert("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_VOL", false);
+
+        const int from = settings->value("READING_SETTING/FROM").toInt();
+        const int to = settings->value("READING_SETTING/TO").toInt();
+        const int sample = std::max(1, int(std::lround(sample_frames * fraction)));
+        project_values.insert("READING_SETTING/TO", std::min(to, from + sample));
+    }
+
+    QSettings source_configs(configs.fileName(), QSettings::IniFormat);
+    return settings_overlay::write(source_configs, configs_filename, configs_values)
+        && settings_overlay::write(*settings, project_filename, project_values);
+}
+
+QString Autotuner::session_value(const Parameter& parameter) const
+{
+    return parameter.in_project ? settings->value(parameter.key).toString() : configs.value(parameter.key).toString();
+}
+
+QString Autotuner::value_of(const Choice& choice, const size_t& index) const
+{
+    const Parameter& parameter = parameters[index];
+    return choice[index] < 0 ? session_value(parameter) : parameter.values[choice[index]];
+}
+
+QString Autotuner::describe(const Choice& choice) const
+{
+    QStringList values;
+    for (size_t p = 0; p < parameters.size(); ++p) {
+        values.push_back(parameters[p].name + "=" + value_of(choice, p));
+    }
+    return values.join(" ");
+}
+
+QString Autotuner::sibling(const QString& filename, const QString& suffix) const
+{
+    const QFileInfo info(filename);
+    return info.absolutePath() + "/" + info.completeBaseName() + suffix;
+}
@@ -0,0 +1,267 @@
+#include "batch/batchreconstruction.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <limits>
+
+#include "core/registration/edgebasedregistration.hpp"
+#include "core/registration/linearbasedregistration.hpp"
+#include "core/registration/middlebasedregistration.hpp"
+#include "core/registration/modelbasedregistration.hpp"
+#include "gui/vizualizer.h"
+#include "io/pcdinputiterator.hpp"
+#include "io/reconstructioncheckpoint.h"
+#include "io/settingsoverlay.h"
+#include "utility/processmemory.h"
+
+namespace {
+
+std::string error_json(const trajectory::Error& error)
+{
+    char line[256];
+    std::snprintf(line, sizeof(line),
+        "{ \"count\": %zu, \"translation_rmse_m\": %.6f, \"translation_max_m\": %.6f, \"rotation_rmse_deg\": %.4f }",
+        error.count, error.translation_rmse, error.translation_max, error.rotation_rmse_degrees);
+    return line;
+}
+
+} // namespace
+
+BatchReconstruction::BatchReconstruction(QObject* parent, QSettings* parent_settings)
+    : ScannerBase(parent, parent_settings)
+    , volumeReconstruction(new VolumeReconstruction(this, settings))
+{
+}
+
+int BatchReconstruction::run()
+{
+    if (!settings->value("VISUALIZATION/CPU_TSDF").toBool()) {
+        qDebug() << "VISUALIZATION/CPU_TSDF is disabled, the mesh will not be calculated";
+    }
+
+    try {
+        if (settings->value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_WITH_LOOPS").toBool()) {
+            reconstruct<LinearBasedRegistration>();
+        } else if (settings->value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION").toBool()) {
+            reconstruct<MiddleBasedRegistration>();
+        } else if (settings->value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_ENABLE").toBool()) {
+            reconstruct<EdgeBasedRegistration>();
+        } else if (settings->value("ALGORITHM_SETTINGS/MODEL_BASED_RECONSTRUCTION").toBool()) {
+            reconstruct<ModelBasedRegistration>();
+        } else {
+            qDebug() << "No batch reconstruction algorithm is enabled in" << settings->fileName();
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        qDebug() << "Batch reconstruction failed:" << e.what();
+        return 1;
+    }
+
+    return 0;
+}
+
+int BatchReconstruction::work()
+{
+    try {
+        EdgeBasedRegistration algorithm(this, settings);
+        algorithm.setVolumeReconstructor(volumeReconstruction);
+        qDebug() << "Loop jobs completed:" << algorithm.runLoopJobs();
+    } catch (const std::exception& e) {
+        qDebug() << "Loop jobs failed:" << e.what();
+        return 1;
+    }
+
+    return 0;
+}
+
+int BatchReconstruction::preview()
+{
+    settings_overlay::Values configs_values;
+    settings_overlay::Values project_values;
+    settings_overlay::section(configs, "PREVIEW_SETTINGS", configs_values, project_values);
+
+    //The whole session, as READING_SETTING/AUTO_SET_RANGE
+    PcdInputIterator it(project, 0, std::numeric_limits<uint>::max(), 1);
+    project_values.insert("READING_SETTING/FROM", it.getLowerBound());
+    project_values.insert("READING_SETTING/TO", it.getUpperBound());
+
+    const QFileInfo project_file(settings->fileName());
+    const QFileInfo source_configs_file(configs.fileName());
+    const QString project_filename
+        = project_file.absolutePath() + "/" + project_file.completeBaseName() + "_preview.ini";
+    const QString configs_filename
+        = source_configs_file.absolutePath() + "/" + source_configs_file.completeBaseName() + "_preview.ini";
+
+    QSettings source_configs(configs.fileName(), QSettings::IniFormat);
+    if (!settings_overlay::write(source_configs, configs_filename, configs_values)
+        || !settings_overlay::write(*settings, project_filename, project_values)) {
+        qDebug() << "Can't write" << configs_filename << "or" << project_filename;
+        return 1;
+    }
+
+    int result = 0;
+    ScannerConfig::reload(configs_filename);
+    try {
+        QSettings preview_settings(project_filename, QSettings::IniFormat);
+        EdgeBasedRegistration algorithm(this, &preview_settings);
+        VolumeReconstruction::Ptr volume(new VolumeReconstruction(this, &preview_settings));
+        const Vizualizer::Ptr vizualizer = Vizualizer::create(this, &preview_settings, ScannerConfig());
+        algorithm.setVolumeReconstructor(volume);
+        algorithm.setVisualizer(vizualizer);
+
+        const auto start = std::chrono::steady_clock::now();
+        algorithm.reconstruct();
+        qDebug() << "Preview of frames" << it.getLowerBound() << "-" << it.getUpperBound() << "in"
+                 << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s";
+
+        while (vizualizer->enabled() && !vizualizer->wasStopped()) {
+            vizualizer->spin(100);
+        }
+    } catch (const std::exception& e) {
+        qDebug() << "Preview failed:" << e.what();
+        result = 1;
+    }
+
+    ScannerConfig::reload(source_configs_file.filePath());
+    QFile::remove(configs_filename);
+    QFile::remove(project_filename);
+    return result;
+}
+
+template <class Algorithm>
+void BatchReconstruction::reconstruct()
+{
+    Algorithm algorithm(this, settings);
+    algorithm.setVolumeReconstructor(volumeReconstruction);
+    algorithm.reconstruct();
+}
+
+int BatchReconstruction::benchmark(
+    const QString& output_filename, const QString& reference_filename, const QStringList& algorithms)
+{
+    //A resumed run would skip the completed loops
+    if (configs.value("CHECKPOINT_SETTINGS/ENABLE").toBool()) {
+        qDebug() << "CHECKPOINT_SETTINGS/ENABLE must be disabled to benchmark";
+        return 1;
+    }
+
+    trajectory::Poses reference;
+    if (!reference_filename.isEmpty() && !trajectory::load(reference_filename, reference)) {
+        qDebug() << "Can't read the reference poses" << reference_filename;
+        return 1;
+    }
+
+    const QStringList names = algorithms.isEmpty()
+        ? QStringList({ "LinearBased", "MiddleBased", "EdgeBased" })
+        : algorithms;
+
+    char hash[32];
+    std::snprintf(hash, sizeof(hash), "%016llx",
+        static_cast<unsigned long long>(reconstruction_checkpoint::parameters_hash(project, configs)));
+    std::string report = std::string("{\n  \"parameters_hash\": \"") + hash + "\",\n  \"runs\": [";
+
+    try {
+        for (int i = 0; i < names.size(); ++i) {
+            std::string run;
+            if (names[i] == "LinearBased") {
+                run = benchmark_run<LinearBasedRegistration>("LinearBased", reference, output_filename);
+            } else if (names[i] == "MiddleBased") {
+                run = benchmark_run<MiddleBasedRegistration>("MiddleBased", reference, output_filename);
+            } else if (names[i] == "EdgeBased") {
+                run = benchmark_run<EdgeBasedRegistration>("EdgeBased", reference, output_filename);
+            } else {
+                qDebug() << "Unknown algorithm" << names[i] << ", expected LinearBased, MiddleBased or EdgeBased";
+                return 1;
+            }
+            report += std::string(i == 0 ? "\n" : ",\n") + run;
+        }
+    } catch (const std::exception& e) {
+        qDebug() << "Benchmark failed:" << e.what();
+        return 1;
+    }
+    report += "\n  ]\n}\n";
+
+    QFile file(output_filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(report.data(), qint64(report.size())) != qint64(report.size())) {
+        qDebug() << "Can't write" << output_filename;
+        return 1;
+    }
+
+    return 0;
+}
+
+template <class Algorithm>
+std::string BatchReconstruction::benchmark_run(
+    const char* name, const trajectory::Poses& reference, const QString& output_filename)
+{
+    Algorithm algorithm(this, settings);
+    VolumeReconstruction::Ptr volume(new VolumeReconstruction(this, settings));
+    algorithm.setVolumeReconstructor(volume);
+    algorithm.setProfiling(true);
+
+    const auto start = std::chrono::steady_clock::now();
+    algorithm.reconstruct();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t peak_rss = process_memory::peakResidentBytes();
+
+    //A frame shared by two loops keeps its pose of the first one, the loops are compared at their seams,
+    //last frame of a loop to the first frame of the next one
+    trajectory::Poses poses;
+    trajectory::Error seams = { 0, 0, 0, 0 };
+    const std::vector<const RegistrationAlgorithm::Loop*> loops = algorithm.resultLoops();
+    for (size_t i = 0; i < loops.size(); ++i) {
+        const RegistrationAlgorithm::Loop& loop = *loops[i];
+        const size_t count = std::min(loop.inner_frame_indexes.size(), loop.inner_transformations.size());
+        for (size_t j = 0; j < count; ++j) {
+            poses.insert(std::make_pair(loop.inner_frame_indexes[j], loop.inner_transformations[j]));
+        }
+
+        const RegistrationAlgorithm::Loop* previous = i > 0 ? loops[i - 1] : nullptr;
+        const size_t previous_count = previous
+            ? std::min(previous->inner_frame_indexes.size(), previous->inner_transformations.size())
+            : 0;
+        if (previous_count == 0 || count == 0) {
+            continue;
+        }
+
+        const int last = previous->inner_frame_indexes[previous_count - 1];
+        const int first = loop.inner_frame_indexes.front();
+        const Eigen::Matrix4f relative
+            = previous->inner_transformations[previous_count - 1].inverse() * loop.inner_transformations.front();
+        if (last == first) {
+            trajectory::addRelativeError(seams, Eigen::Matrix4f::Identity(), relative);
+        } else if (reference.count(last) && reference.count(first)) {
+            trajectory::addRelativeError(seams, reference.at(last).inverse() * reference.at(first), relative);
+        }
+    }
+
+    const QFileInfo output(output_filename);
+    const QString poses_filename = output.absolutePath() + "/" + output.completeBaseName() + "_" + name + ".txt";
+    if (!trajectory::save(poses_filename, poses)) {
+        qDebug() << "Can't write" << poses_filename;
+    }
+
+    pcl::PolygonMesh mesh;
+    if (settings->value("VISUALIZATION/CPU_TSDF").toBool()) {
+        volume->getPoligonMesh(mesh);
+    }
+
+    char line[512];
+    std::snprintf(line, sizeof(line),
+        "    { \"algorithm\": \"%s\", \"frames\": %zu, \"seconds\": %.3f, \"fps\": %.3f, \"peak_rss_mb\": %.1f,\n"
+        "      \"mesh\": { \"vertices\": %zu, \"polygons\": %zu },\n",
+        name, poses.size(), seconds, seconds > 0 ? poses.size() / seconds : 0.0, peak_rss / (1024.0 * 1024.0),
+        size_t(mesh.cloud.width) * size_t(mesh.cloud.height), mesh.polygons.size());
+
+    return std::string(line)
+        + "      \"trajectory_error\": " + error_json(trajectory::absoluteError(reference, poses)) + ",\n"
+        + "      \"loop_seam_error\": " + error_json(seams) + ",\n"
+        + "      \"stages\": " + RegistrationAlgorithm::stageReport() + " }";
+}
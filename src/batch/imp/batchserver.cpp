@@ -0,0 +1,128 @@
+#include "batch/batchserver.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QTextStream>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "batch/batchreconstruction.h"
+#include "core/base/scannerconfig.h"
+#include "utility/joblimits.h"
+#include "utility/log.h"
+
+namespace {
+
+const ScannerConfig& server_configs()
+{
+    static const ScannerConfig config;
+    return config;
+}
+
+} // namespace
+
+BatchServer::BatchServer(const QString& queue_folder_)
+    : queue_folder(QDir(queue_folder_).absolutePath())
+    , done_count(0)
+    , failed_count(0)
+{
+}
+
+int BatchServer::serve()
+{
+    if (!QDir().mkpath(queue_folder)) {
+        qDebug() << "Cannot create the queue folder" << queue_folder;
+        return 1;
+    }
+
+    const int projects_count = std::max(1, server_configs().value("SERVER_SETTINGS/CONCURRENT_PROJECTS").toInt());
+    LOG_INFO("server") << "Serving" << queue_folder << "with" << projects_count << "concurrent projects";
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < projects_count; ++i) {
+        workers.emplace_back([this]() { work(); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    LOG_INFO("server") << "Stopped," << done_count.load() << "projects done," << failed_count.load() << "failed";
+    logging::flush();
+    return 0;
+}
+
+void BatchServer::work()
+{
+    job_limits::Limits limits;
+    limits.loop_lanes = server_configs().value("SERVER_SETTINGS/JOB_LOOP_LANES").toUInt();
+    limits.loops_memory = size_t(server_configs().value("SERVER_SETTINGS/JOB_LOOPS_MEMORY_MB").toULongLong()) << 20;
+    const job_limits::Scope scope(limits);
+
+    const int poll_interval = std::max(10, server_configs().value("SERVER_SETTINGS/POLL_INTERVAL_MS").toInt());
+    while (!stopping()) {
+        QString name;
+        QString project_filename;
+        if (!claim_job(name, project_filename)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval));
+            continue;
+        }
+
+        LOG_INFO("server") << "Project" << name << "started," << project_filename;
+        const auto start = std::chrono::steady_clock::now();
+        int exit_code = 1;
+        if (QFileInfo(project_filename).exists()) {
+            QSettings settings(project_filename, QSettings::IniFormat);
+            BatchReconstruction batch(nullptr, &settings);
+            exit_code = batch.run();
+        } else {
+            LOG_ERROR("server") << "Project" << name << "has no" << project_filename;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const QString running = QDir(queue_folder).absoluteFilePath(name + ".running");
+        const QString finished = QDir(queue_folder).absoluteFilePath(name + (exit_code == 0 ? ".done" : ".failed"));
+        QFile::remove(finished);
+        QFile::rename(running, finished);
+
+        (exit_code == 0 ? done_count : failed_count).fetch_add(1);
+        LOG_INFO("server") << "Project" << name << (exit_code == 0 ? "done" : "failed") << "in" << seconds << "s";
+    }
+}
+
+bool BatchServer::claim_job(QString& name, QString& project_filename)
+{
+    //Workers of this process claim one at a time, another server on the folder loses the rename
+    std::lock_guard<std::mutex> lock(claim_mutex);
+    const QDir dir(queue_folder);
+    const QFileInfoList jobs = dir.entryInfoList(QStringList("*.job"), QDir::Files, QDir::Time | QDir::Reversed);
+    for (const QFileInfo& job : jobs) {
+        QFile file(job.absoluteFilePath());
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            continue;
+        }
+        const QString path = QTextStream(&file).readLine().trimmed();
+        file.close();
+
+        const QString running = dir.absoluteFilePath(job.completeBaseName() + ".running");
+        if (!QFile::rename(job.absoluteFilePath(), running)) {
+            continue;
+        }
+
+        name = job.completeBaseName();
+        project_filename = dir.absoluteFilePath(path);
+        return true;
+    }
+
+    return false;
+}
+
+bool BatchServer::stopping() const
+{
+    return QFileInfo(QDir(queue_folder).absoluteFilePath("stop")).exists();
+}
@@ -0,0 +1,116 @@
+#include "batch/trajectory.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <Eigen/Geometry>
+#include <Eigen/LU>
+
+#include <algorithm>
+#include <cmath>
+
+namespace trajectory
+{
+
+bool load(const QString& filename, Poses& poses)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    poses.clear();
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        const QStringList values = line.split(' ', QString::SkipEmptyParts);
+        if (values.size() != 8) {
+            return false;
+        }
+
+        bool ok = true;
+        float numbers[7];
+        const int frame = values[0].toInt(&ok);
+        for (int i = 0; i < 7 && ok; ++i) {
+            numbers[i] = values[i + 1].toFloat(&ok);
+        }
+        if (!ok) {
+            return false;
+        }
+
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        pose.block<3, 3>(0, 0) = Eigen::Quaternionf(numbers[6], numbers[3], numbers[4], numbers[5]).normalized().toRotationMatrix();
+        pose.block<3, 1>(0, 3) = Eigen::Vector3f(numbers[0], numbers[1], numbers[2]);
+        poses[frame] = pose;
+    }
+
+    return true;
+}
+
+bool save(const QString& filename, const Poses& poses)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream.setRealNumberPrecision(9);
+    stream << "# frame tx ty tz qx qy qz qw\n";
+    for (const auto& pose : poses) {
+        const Eigen::Quaternionf rotation(Eigen::Matrix3f(pose.second.block<3, 3>(0, 0)));
+        const Eigen::Vector3f translation = pose.second.block<3, 1>(0, 3);
+        stream << pose.first << ' ' << translation.x() << ' ' << translation.y() << ' ' << translation.z() << ' '
+               << rotation.x() << ' ' << rotation.y() << ' ' << rotation.z() << ' ' << rotation.w() << '\n';
+    }
+
+    return stream.status() == QTextStream::Ok;
+}
+
+void addRelativeError(Error& error, const Eigen::Matrix4f& reference, const Eigen::Matrix4f& relative)
+{
+    const Eigen::Matrix4f difference = reference.inverse() * relative;
+    const double translation = difference.block<3, 1>(0, 3).norm();
+    const double cosine = std::max(-1.0, std::min(1.0, (double(difference.block<3, 3>(0, 0).trace()) - 1) / 2));
+    const double rotation = std::acos(cosine) * 180.0 / M_PI;
+
+    //Running root mean squares, valid after every pose added
+    const double rmse = error.translation_rmse;
+    const double rotation_rmse = error.rotation_rmse_degrees;
+    error.translation_rmse = std::sqrt((rmse * rmse * error.count + translation * translation) / (error.count + 1));
+    error.rotation_rmse_degrees = std::sqrt(
+        (rotation_rmse * rotation_rmse * error.count + rotation * rotation) / (error.count + 1));
+    error.translation_max = std::max(error.translation_max, translation);
+    ++error.count;
+}
+
+Error absoluteError(const Poses& reference, const Poses& poses)
+{
+    Error error = { 0, 0, 0, 0 };
+
+    auto first = poses.begin();
+    while (first != poses.end() && reference.find(first->first) == reference.end()) {
+        ++first;
+    }
+    if (first == poses.end()) {
+        return error;
+    }
+
+    const Eigen::Matrix4f reference_origin = reference.find(first->first)->second.inverse();
+    const Eigen::Matrix4f origin = first->second.inverse();
+    for (auto pose = first; pose != poses.end(); ++pose) {
+        const auto reference_pose = reference.find(pose->first);
+        if (reference_pose != reference.end()) {
+            addRelativeError(error, reference_origin * reference_pose->second, origin * pose->second);
+        }
+    }
+
+    return error;
+}
+
+} // namespace trajectory
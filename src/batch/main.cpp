@@ -0,0 +1,64 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSettings>
+
+#include "batch/autotuner.h"
+#include "batch/batchreconstruction.h"
+#include "batch/batchserver.h"
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const QStringList arguments = a.arguments();
+    if (arguments.size() == 3 && arguments[1] == "--serve") {
+        return BatchServer(arguments[2]).serve();
+    }
+
+    const bool benchmark = arguments.size() >= 4 && arguments[2] == "--benchmark";
+    const bool autotune = arguments.size() >= 4 && arguments[2] == "--autotune";
+    const bool worker = arguments.size() == 3 && arguments[2] == "--worker";
+    const bool preview = arguments.size() == 3 && arguments[2] == "--preview";
+    if ((arguments.size() != 2 && !benchmark && !autotune && !worker && !preview) || !QFileInfo(arguments[1]).exists()) {
+        const std::string name = QFileInfo(arguments[0]).fileName().toStdString();
+        qDebug() << "Usage:" << name.c_str() << "<project.ini>";
+        qDebug() << "      " << name.c_str()
+                 << "<project.ini> --benchmark <report.json> [--reference <poses.txt>] [LinearBased|MiddleBased|EdgeBased ...]";
+        qDebug() << "      " << name.c_str() << "<project.ini> --autotune <report.json> [--reference <poses.txt>]";
+        qDebug() << "      " << name.c_str() << "<project.ini> --worker";
+        qDebug() << "      " << name.c_str() << "<project.ini> --preview";
+        qDebug() << "      " << name.c_str() << "--serve <queue folder>";
+        return 1;
+    }
+
+    QSettings settings(arguments[1], QSettings::IniFormat);
+    if (autotune) {
+        const QString reference_filename = arguments.size() == 6 && arguments[4] == "--reference" ? arguments[5] : QString();
+        return Autotuner(nullptr, &settings).run(arguments[3], reference_filename);
+    }
+
+    BatchReconstruction batch(nullptr, &settings);
+
+    if (worker) {
+        return batch.work();
+    }
+    if (preview) {
+        return batch.preview();
+    }
+    if (!benchmark) {
+        return batch.run();
+    }
+
+    QString reference_filename;
+    QStringList algorithms;
+    for (int i = 4; i < arguments.size(); ++i) {
+        if (arguments[i] == "--reference" && i + 1 < arguments.size()) {
+            reference_filename = arguments[++i];
+        } else {
+            algorithms.push_back(arguments[i]);
+        }
+    }
+
+    return batch.benchmark(arguments[3], reference_filename, algorithms);
+}
@@ -0,0 +1,44 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <QString>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <cstddef>
+#include <functional>
+#include <map>
+
+/** \brief Camera to world poses by project frame number, read and written as text lines
+  * "frame tx ty tz qx qy qz qw", lines starting with # are skipped.
+  */
+namespace trajectory
+{
+
+typedef std::map<int, Eigen::Matrix4f, std::less<int>,
+    Eigen::aligned_allocator<std::pair<const int, Eigen::Matrix4f> > >
+    Poses;
+
+struct Error {
+    size_t count;
+    double translation_rmse;
+    double translation_max;
+    double rotation_rmse_degrees;
+};
+
+bool load(const QString& filename, Poses& poses);
+
+bool save(const QString& filename, const Poses& poses);
+
+/** \brief Error of the poses of the frames in both trajectories, each trajectory taken relative to
+  * its pose of the first common frame, so the two don't need to share a world frame.
+  */
+Error absoluteError(const Poses& reference, const Poses& poses);
+
+/** \brief Accumulates the error of relative poses, translation in meters and rotation in degrees. */
+void addRelativeError(Error& error, const Eigen::Matrix4f& reference, const Eigen::Matrix4f& relative);
+
+} // namespace trajectory
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,267 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QTemporaryFile>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+
+#include "core/base/scannertypes.h"
+#include "core/keypoints/keypointsdetector.hpp"
+#include "core/keypoints/keypointsrejection.h"
+#include "core/keypoints/surfkeypointdetector.h"
+#include "core/reconstruction/volumereconstruction.h"
+#include "core/registration/icpregistration.h"
+#include "core/registration/sacregistration.h"
+#include "io/calibrationinterface.h"
+#include "utility/pcdfilters.h"
+#include "utility/pointtransform.h"
+
+namespace {
+
+const char* FILTER_STAGES[] = {
+    "UNDISTORTION",
+    "OPENCV_BILATERAL_FILTER",
+    "STATISTICAL_OUTLIER_REMOVAL_FILTER",
+    "ORGANIZED_OUTLIER_REMOVAL_FILTER",
+    "MOVING_LEAST_SQUARES_FILTER",
+    "NORMAL_ESTIMATION",
+    "VOXEL_GRID_REDUCTION",
+};
+const int FILTER_STAGES_COUNT = int(sizeof(FILTER_STAGES) / sizeof(FILTER_STAGES[0]));
+
+/** \brief Two consecutive calibration frames of the project and the results every kernel is fed with,
+  * built once on first use. The frames are read directly, so no FeatureStore or FrameCache is involved.
+  */
+struct Fixtures {
+    std::unique_ptr<QSettings> settings;
+    Frame frame1;
+    Frame frame2;
+    KeypointsFrame keypoints;
+    KeypointsFrame rejected;
+
+    static Fixtures& instance()
+    {
+        static Fixtures fixtures;
+        return fixtures;
+    }
+
+    QString calibrationPath(const int& index) const
+    {
+        return QFileInfo(settings->fileName()).absolutePath() + "/"
+            + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString()
+            + "/point_cloud_" + QString::number(index);
+    }
+
+    /** \brief Copy of the project next to it with only the stage enabled of the filter pipeline,
+      * so the relative data folders still resolve. Removed with the returned file.
+      */
+    std::unique_ptr<QTemporaryFile> stageProject(const QString& stage) const
+    {
+        std::unique_ptr<QTemporaryFile> file(
+            new QTemporaryFile(QFileInfo(settings->fileName()).absolutePath() + "/benchmark_XXXXXX.ini"));
+        if (!file->open()) {
+            throw std::invalid_argument("Fixtures::stageProject !file->open()");
+        }
+        file->close();
+
+        QFile::remove(file->fileName());
+        QFile::copy(settings->fileName(), file->fileName());
+
+        QSettings stage_settings(file->fileName(), QSettings::IniFormat);
+        for (int i = 0; i < FILTER_STAGES_COUNT; ++i) {
+            stage_settings.setValue(QString("PIPELINE_SETTINGS/") + FILTER_STAGES[i], stage == FILTER_STAGES[i]);
+        }
+        stage_settings.sync();
+
+        return file;
+    }
+
+private:
+    Fixtures()
+    {
+        const char* project = std::getenv("ROOM_SCANNER_PROJECT");
+        settings.reset(new QSettings(project ? project : "default_project/project.ini", QSettings::IniFormat));
+        if (!QFileInfo(settings->fileName()).exists()) {
+            throw std::invalid_argument("Fixtures::Fixtures project file does not exist");
+        }
+
+        if (!frame1.load(calibrationPath(0) + ".pcd", calibrationPath(0) + ".bmp")
+            || !frame2.load(calibrationPath(1) + ".pcd", calibrationPath(1) + ".bmp")) {
+            throw std::invalid_argument("Fixtures::Fixtures calibration frames can't be loaded");
+        }
+
+        KeypointsDetector<SurfKeypointDetector> detector(nullptr, settings.get());
+        detector.setInput(frame1, frame2);
+        keypoints = detector.detect();
+
+        KeypointsFrame copy = keypoints;
+        rejected = KeypointsRejection(nullptr, settings.get()).rejection(copy);
+    }
+};
+
+void BM_FrameLoad(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    const QString path = fixtures.calibrationPath(0);
+    for (auto _ : state) {
+        Frame frame;
+        benchmark::DoNotOptimize(frame.load(path + ".pcd", path + ".bmp"));
+    }
+}
+BENCHMARK(BM_FrameLoad)->Unit(benchmark::kMillisecond);
+
+void BM_FrameTransform(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    const Eigen::Matrix4f transformation = Eigen::Affine3f(Eigen::Translation3f(0.1f, 0, 0)).matrix();
+    for (auto _ : state) {
+        //The pose is composed lazily, the world cloud is what the consumers pay for
+        benchmark::DoNotOptimize(fixtures.frame1.transform(transformation).worldPointCloud());
+    }
+}
+BENCHMARK(BM_FrameTransform)->Unit(benchmark::kMillisecond);
+
+void BM_TransformInPlace(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    Pcd cloud(*fixtures.frame1.pointCloudPtr);
+    NormalPcd normals(*fixtures.frame1.pointCloudNormalPcdPtr);
+    //A rotation and its inverse, so the clouds stay where they are over the iterations
+    const Eigen::Matrix4f rotation = Eigen::Affine3f(Eigen::AngleAxisf(0.1f, Eigen::Vector3f::UnitY())).matrix();
+    const Eigen::Matrix4f inverse = rotation.inverse();
+    bool forward = true;
+    for (auto _ : state) {
+        point_transform::transform_in_place(forward ? rotation : inverse, cloud, normals);
+        forward = !forward;
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(point_transform::implementation());
+}
+BENCHMARK(BM_TransformInPlace)->Unit(benchmark::kMillisecond);
+
+void BM_FilterStage(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    const QString stage = FILTER_STAGES[state.range(0)];
+    state.SetLabel(stage.toStdString());
+
+    const auto project = fixtures.stageProject(stage);
+    QSettings settings(project->fileName(), QSettings::IniFormat);
+    PcdFilters filters(nullptr, &settings);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Frame frame = fixtures.frame1;
+        frame.detach();
+        Frames frames = { frame };
+        state.ResumeTiming();
+
+        filters.setInput(frames);
+        filters.filter(frames);
+        benchmark::DoNotOptimize(frames);
+    }
+}
+BENCHMARK(BM_FilterStage)->DenseRange(0, FILTER_STAGES_COUNT - 1)->Unit(benchmark::kMillisecond);
+
+void BM_Undistort(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    CalibrationInterface calibration(nullptr, fixtures.settings.get());
+
+    //The undistortion table is built by the first call
+    Frames warm_up = { fixtures.frame1 };
+    warm_up.front().detach();
+    calibration.undistort(warm_up);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Frame frame = fixtures.frame1;
+        frame.detach();
+        Frames frames = { frame };
+        state.ResumeTiming();
+
+        calibration.undistort(frames);
+        benchmark::DoNotOptimize(frames);
+    }
+}
+BENCHMARK(BM_Undistort)->Unit(benchmark::kMillisecond);
+
+void BM_SurfDetect(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    KeypointsDetector<SurfKeypointDetector> detector(nullptr, fixtures.settings.get());
+    for (auto _ : state) {
+        detector.setInput(fixtures.frame1, fixtures.frame2);
+        benchmark::DoNotOptimize(detector.detect());
+    }
+}
+BENCHMARK(BM_SurfDetect)->Unit(benchmark::kMillisecond);
+
+void BM_KeypointsRejection(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    KeypointsRejection rejection(nullptr, fixtures.settings.get());
+    for (auto _ : state) {
+        state.PauseTiming();
+        KeypointsFrame keypoints = fixtures.keypoints;
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(rejection.rejection(keypoints));
+    }
+}
+BENCHMARK(BM_KeypointsRejection)->Unit(benchmark::kMillisecond);
+
+void BM_SaCAlign(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    SaCRegistration sac(nullptr, fixtures.settings.get());
+    for (auto _ : state) {
+        sac.setInput(fixtures.rejected, Eigen::Matrix4f::Identity());
+        benchmark::DoNotOptimize(sac.align());
+    }
+}
+BENCHMARK(BM_SaCAlign)->Unit(benchmark::kMillisecond);
+
+void BM_ICPAlign(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    ICPRegistration icp(nullptr, fixtures.settings.get());
+    for (auto _ : state) {
+        icp.setInput(fixtures.rejected, Eigen::Matrix4f::Identity());
+        benchmark::DoNotOptimize(icp.align());
+    }
+}
+BENCHMARK(BM_ICPAlign)->Unit(benchmark::kMillisecond);
+
+void BM_VolumeAddPointCloud(benchmark::State& state)
+{
+    const Fixtures& fixtures = Fixtures::instance();
+    VolumeReconstruction volume(nullptr, fixtures.settings.get());
+    for (auto _ : state) {
+        //With ASYNC_INTEGRATION the call only queues the cloud, the integration itself is timed too
+        volume.addPointCloud(fixtures.frame1.pointCloudPtr, Eigen::Matrix4f::Identity());
+        volume.waitIntegration();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(fixtures.frame1.pointCloudPtr->size()));
+}
+BENCHMARK(BM_VolumeAddPointCloud)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
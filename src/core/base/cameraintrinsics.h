@@ -0,0 +1,113 @@
+#ifndef CAMERA_INTRINSICS_H
+#define CAMERA_INTRINSICS_H
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include <cmath>
+
+/** \brief Pinhole model of the depth camera. OpenNI world coordinates have the
+  * y axis pointing up, so fy is negative for clouds produced by OpenNI.
+  */
+struct CameraIntrinsics
+{
+    unsigned int width;
+    unsigned int height;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+
+    CameraIntrinsics()
+        : width(0)
+        , height(0)
+        , fx(0.0f)
+        , fy(0.0f)
+        , cx(0.0f)
+        , cy(0.0f)
+    {
+    }
+
+    /** \brief Same model as openni::CoordinateConverter::convertDepthToWorld. */
+    static CameraIntrinsics fromFieldOfView(
+        const unsigned int& width, const unsigned int& height,
+        const float& horizontal_fov, const float& vertical_fov)
+    {
+        CameraIntrinsics intrinsics;
+        intrinsics.width = width;
+        intrinsics.height = height;
+        intrinsics.fx = float(width) / (2.0f * std::tan(horizontal_fov / 2.0f));
+        intrinsics.fy = -float(height) / (2.0f * std::tan(vertical_fov / 2.0f));
+        intrinsics.cx = float(width) / 2.0f;
+        intrinsics.cy = float(height) / 2.0f;
+
+        return intrinsics;
+    }
+
+    /** \brief Least squares fit of the model to the pixel grid of an organized cloud. */
+    template <typename CloudType>
+    static CameraIntrinsics fromOrganizedCloud(const CloudType& cloud, const unsigned int& sampling_step = 4)
+    {
+        CameraIntrinsics intrinsics;
+        if (cloud.height <= 1) {
+            return intrinsics;
+        }
+
+        Eigen::Matrix2d ata_u = Eigen::Matrix2d::Zero(), ata_v = Eigen::Matrix2d::Zero();
+        Eigen::Vector2d atb_u = Eigen::Vector2d::Zero(), atb_v = Eigen::Vector2d::Zero();
+        for (unsigned int v = 0; v < cloud.height; v += sampling_step) {
+            for (unsigned int u = 0; u < cloud.width; u += sampling_step) {
+                const auto& point = cloud.at(u, v);
+                if (!std::isfinite(point.z) || point.z <= 0.0f) {
+                    continue;
+                }
+
+                const Eigen::Vector2d a_u(point.x / point.z, 1.0);
+                const Eigen::Vector2d a_v(point.y / point.z, 1.0);
+                ata_u += a_u * a_u.transpose();
+                ata_v += a_v * a_v.transpose();
+                atb_u += a_u * double(u);
+                atb_v += a_v * double(v);
+            }
+        }
+
+        if (std::abs(ata_u.determinant()) < 1e-12 || std::abs(ata_v.determinant()) < 1e-12) {
+            return intrinsics;
+        }
+
+        const Eigen::Vector2d solution_u = ata_u.ldlt().solve(atb_u);
+        const Eigen::Vector2d solution_v = ata_v.ldlt().solve(atb_v);
+        intrinsics.width = cloud.width;
+        intrinsics.height = cloud.height;
+        intrinsics.fx = float(solution_u[0]);
+        intrinsics.cx = float(solution_u[1]);
+        intrinsics.fy = float(solution_v[0]);
+        intrinsics.cy = float(solution_v[1]);
+
+        return intrinsics;
+    }
+
+    inline bool isValid() const
+    {
+        return width > 0 && height > 0 && fx != 0.0f && fy != 0.0f;
+    }
+
+    inline Eigen::Vector3f backproject(const float& u, const float& v, const float& z) const
+    {
+        return Eigen::Vector3f((u - cx) * z / fx, (v - cy) * z / fy, z);
+    }
+
+    inline bool project(const Eigen::Vector3f& point, float& u, float& v) const
+    {
+        if (!(point.z() > 0.0f)) {
+            return false;
+        }
+
+        u = fx * point.x() / point.z() + cx;
+        v = fy * point.y() / point.z() + cy;
+
+        return u >= 0.0f && v >= 0.0f && u < float(width) && v < float(height);
+    }
+};
+
+#endif // CAMERA_INTRINSICS_H
@@ -0,0 +1,45 @@
+#ifndef FRAMENORMALS_H
+#define FRAMENORMALS_H
+
+#include <QString>
+
+#include "core/base/scannerconfig.h"
+#include "core/base/scannertypes.h"
+
+/** \brief Organized normals of a frame cloud from integral images, no neighbour search is run.
+  * Points keep their pixels, pixels without a point or normal are NaN.
+  */
+struct FrameNormals {
+    struct Parameters {
+        int method;
+        float max_depth_change_factor;
+        float smoothing_size;
+        bool depth_dependent_smoothing;
+
+        /** \brief NORMAL_ESTIMATION_SETTINGS of configs. */
+        static Parameters fromConfigs(const ScannerConfig& configs);
+
+        bool operator==(const Parameters& other) const;
+    };
+
+    static NormalPcdPtr build(const Pcd::ConstPtr& cloud, const Parameters& parameters);
+
+    /** \brief Whether normals hold one point per pixel of the organized cloud. */
+    static bool matches(const NormalPcd& normals, const Pcd& cloud);
+
+    /** \brief The frame's own normals when they match its cloud, otherwise built once and kept in
+      * the frame's derived data. Safe to call for the same frame from several threads.
+      */
+    static NormalPcdPtr ofFrame(const Frame& frame, const Parameters& parameters);
+
+    /** \brief Copies the points of the cloud, so normals of points filtered away become NaN. */
+    static void syncPoints(NormalPcd& normals, const Pcd& cloud);
+};
+
+/** \brief Normals kept in the frame's derived data with the parameters they were built with. */
+struct FrameNormalsData {
+    FrameNormals::Parameters parameters;
+    NormalPcdPtr normals;
+};
+
+#endif // FRAMENORMALS_H
@@ -0,0 +1,129 @@
+#include "core/base/framenormals.h"
+
+#include <pcl/features/integral_image_normal.h>
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+typedef pcl::IntegralImageNormalEstimation<PointType, pcl::Normal> IntegralImageNormalEstimation;
+
+FrameNormals::Parameters FrameNormals::Parameters::fromConfigs(const ScannerConfig& configs)
+{
+    const QString method = configs.value("NORMAL_ESTIMATION_SETTINGS/METHOD").toString();
+
+    Parameters parameters;
+    if (method == "COVARIANCE_MATRIX") {
+        parameters.method = IntegralImageNormalEstimation::COVARIANCE_MATRIX;
+    } else if (method == "AVERAGE_DEPTH_CHANGE") {
+        parameters.method = IntegralImageNormalEstimation::AVERAGE_DEPTH_CHANGE;
+    } else if (method == "SIMPLE_3D_GRADIENT") {
+        parameters.method = IntegralImageNormalEstimation::SIMPLE_3D_GRADIENT;
+    } else {
+        parameters.method = IntegralImageNormalEstimation::AVERAGE_3D_GRADIENT;
+    }
+    parameters.max_depth_change_factor = configs.value("NORMAL_ESTIMATION_SETTINGS/MAX_DEPTH_CHANGE_FACTOR").toFloat();
+    parameters.smoothing_size = configs.value("NORMAL_ESTIMATION_SETTINGS/NORMAL_SMOOTHING_SIZE").toFloat();
+    parameters.depth_dependent_smoothing = configs.value("NORMAL_ESTIMATION_SETTINGS/DEPTH_DEPENDENT_SMOOTHING").toBool();
+
+    return parameters;
+}
+
+bool FrameNormals::Parameters::operator==(const Parameters& other) const
+{
+    return method == other.method
+        && max_depth_change_factor == other.max_depth_change_factor
+        && smoothing_size == other.smoothing_size
+        && depth_dependent_smoothing == other.depth_dependent_smoothing;
+}
+
+NormalPcdPtr FrameNormals::build(const Pcd::ConstPtr& cloud, const Parameters& parameters)
+{
+    if (!cloud || !cloud->isOrganized()) {
+        throw std::invalid_argument("FrameNormals::build cloud is not organized");
+    }
+
+    pcl::PointCloud<pcl::Normal> normals;
+    IntegralImageNormalEstimation estimation;
+    estimation.setNormalEstimationMethod(IntegralImageNormalEstimation::NormalEstimationMethod(parameters.method));
+    estimation.setMaxDepthChangeFactor(parameters.max_depth_change_factor);
+    estimation.setNormalSmoothingSize(parameters.smoothing_size);
+    estimation.setDepthDependentSmoothing(parameters.depth_dependent_smoothing);
+    estimation.setInputCloud(cloud);
+    estimation.compute(normals);
+
+    auto result = std::make_shared<NormalPcd>();
+    result->resize(cloud->size());
+    result->width = cloud->width;
+    result->height = cloud->height;
+    result->is_dense = false;
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < cloud->size(); ++i) {
+        const PointType& point = (*cloud)[i];
+        const pcl::Normal& normal = normals[i];
+        NormalType& target = (*result)[i];
+        target.x = point.x;
+        target.y = point.y;
+        target.z = point.z;
+
+        const bool valid = std::isfinite(point.z) && std::isfinite(normal.normal_x);
+        target.normal_x = valid ? normal.normal_x : nan;
+        target.normal_y = valid ? normal.normal_y : nan;
+        target.normal_z = valid ? normal.normal_z : nan;
+        target.curvature = valid ? normal.curvature : nan;
+    }
+
+    return result;
+}
+
+bool FrameNormals::matches(const NormalPcd& normals, const Pcd& cloud)
+{
+    return cloud.isOrganized() && normals.width == cloud.width && normals.height == cloud.height;
+}
+
+NormalPcdPtr FrameNormals::ofFrame(const Frame& frame, const Parameters& parameters)
+{
+    if (!frame.pointCloudPtr) {
+        throw std::invalid_argument("FrameNormals::ofFrame !frame.pointCloudPtr");
+    }
+    if (frame.pointCloudNormalPcdPtr && matches(*frame.pointCloudNormalPcdPtr, *frame.pointCloudPtr)) {
+        return frame.pointCloudNormalPcdPtr;
+    }
+    if (!frame.derivedDataPtr) {
+        return build(frame.pointCloudPtr, parameters);
+    }
+
+    FrameDerivedData& data = *frame.derivedDataPtr;
+    std::lock_guard<std::mutex> lock(data.mutex);
+
+    const std::shared_ptr<const Pcd> cloud = frame.pointCloudPtr;
+    if (!FrameDerivedData::isBuiltFrom(data.normalsSource, cloud) || !data.normals
+        || !(data.normals->parameters == parameters)) {
+        auto normals = std::make_shared<FrameNormalsData>();
+        normals->parameters = parameters;
+        normals->normals = build(cloud, parameters);
+        data.normals = normals;
+        data.normalsSource = cloud;
+    }
+
+    return data.normals->normals;
+}
+
+void FrameNormals::syncPoints(NormalPcd& normals, const Pcd& cloud)
+{
+    if (!matches(normals, cloud)) {
+        throw std::invalid_argument("FrameNormals::syncPoints normals do not match the cloud");
+    }
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < cloud.size(); ++i) {
+        NormalType& target = normals[i];
+        target.x = cloud[i].x;
+        target.y = cloud[i].y;
+        target.z = cloud[i].z;
+        if (!std::isfinite(cloud[i].z)) {
+            target.normal_x = target.normal_y = target.normal_z = target.curvature = nan;
+        }
+    }
+}
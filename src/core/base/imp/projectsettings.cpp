@@ -0,0 +1,65 @@
+#include "core/base/projectsettings.h"
+
+#include <QSettings>
+
+ProjectSettings::ProjectSettings()
+    : data(std::make_shared<Data>())
+{
+}
+
+ProjectSettings::ProjectSettings(const QSettings& settings)
+{
+    std::shared_ptr<Data> read = std::make_shared<Data>();
+
+    read->filename = settings.fileName();
+    for (const QString& key : settings.allKeys()) {
+        read->values.insert(key, settings.value(key));
+    }
+
+    data = read;
+}
+
+QVariant ProjectSettings::value(const QString& key, const QVariant& default_value) const
+{
+    return data->values.value(key, default_value);
+}
+
+bool ProjectSettings::contains(const QString& key) const
+{
+    return data->values.contains(key);
+}
+
+QString ProjectSettings::fileName() const
+{
+    return data->filename;
+}
+
+QStringList ProjectSettings::childKeys(const QString& group) const
+{
+    const QString prefix = group + "/";
+
+    QStringList keys;
+    for (auto it = data->values.constBegin(); it != data->values.constEnd(); ++it) {
+        if (it.key().startsWith(prefix) && !it.key().mid(prefix.size()).contains('/')) {
+            keys.push_back(it.key().mid(prefix.size()));
+        }
+    }
+    keys.sort();
+
+    return keys;
+}
+
+QStringList ProjectSettings::childGroups() const
+{
+    QStringList groups;
+    for (auto it = data->values.constBegin(); it != data->values.constEnd(); ++it) {
+        const int separator = it.key().indexOf('/');
+        if (separator > 0) {
+            groups.push_back(it.key().left(separator));
+        }
+    }
+    groups.removeDuplicates();
+    groups.sort();
+
+    return groups;
+}
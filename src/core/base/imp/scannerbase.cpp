@@ -1,13 +1,28 @@
 #include "core/base/scannerbase.h"
 
+#include <QThread>
+
+#include <stdexcept>
+
 ScannerBase::ScannerBase(QObject* parent, QSettings* parent_settings)
-    : QObject(parent)
-    , configs("configs.ini", QSettings::IniFormat)
+    : QObject(parent && parent->thread() == QThread::currentThread() ? parent : nullptr)
 {
     settings = parent_settings;
+
+    if (!settings || settings->thread() == QThread::currentThread()) {
+        project = settings ? ProjectSettings(*settings) : ProjectSettings();
+        return;
+    }
+
+    const ScannerBase* scanner_parent = dynamic_cast<const ScannerBase*>(parent);
+    if (!scanner_parent || scanner_parent->settings != settings) {
+        throw std::invalid_argument("ScannerBase::ScannerBase settings of another thread without their ScannerBase parent");
+    }
+    project = scanner_parent->project;
 }
 
 void ScannerBase::setSettings(QSettings* settings_in)
 {
     settings = settings_in;
+    project = settings ? ProjectSettings(*settings) : ProjectSettings();
 }
@@ -0,0 +1,125 @@
+#include "core/base/scannerconfig.h"
+
+#include <QSettings>
+#include <QStringList>
+
+#include "utility/hash.h"
+
+std::mutex ScannerConfig::mutex;
+std::shared_ptr<const ScannerConfig::Data> ScannerConfig::current;
+std::atomic<uint64_t> ScannerConfig::current_generation(0);
+
+ScannerConfig::ScannerConfig()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!current) {
+        current = parse("configs.ini", current_generation + 1);
+        current_generation = current->generation;
+    }
+    data = current;
+}
+
+QVariant ScannerConfig::value(const QString& key, const QVariant& default_value) const
+{
+    return data->values.value(key, default_value);
+}
+
+bool ScannerConfig::contains(const QString& key) const
+{
+    return data->values.contains(key);
+}
+
+QString ScannerConfig::fileName() const
+{
+    return data->filename;
+}
+
+const ScannerConfig::FlatKeypointFilterSettings& ScannerConfig::flatKeypointFilter() const
+{
+    return data->flat_keypoint_filter;
+}
+
+const ScannerConfig::IcpSettings& ScannerConfig::icp() const
+{
+    return data->icp;
+}
+
+uint64_t ScannerConfig::sectionHash(const QString& section) const
+{
+    const QString prefix = section + "/";
+
+    QStringList keys;
+    for (auto it = data->values.constBegin(); it != data->values.constEnd(); ++it) {
+        if (it.key().startsWith(prefix) && it.key() != prefix + "ENABLE_IN_VISUALIZATION") {
+            keys.push_back(it.key());
+        }
+    }
+    keys.sort();
+
+    uint64_t result = hash::FNV_OFFSET_BASIS;
+    for (const QString& key : keys) {
+        const QByteArray entry = (key + "=" + data->values.value(key).toString()).toUtf8();
+        result = hash::fnv1a(entry.constData(), size_t(entry.size()) + 1, result);
+    }
+
+    return result;
+}
+
+uint64_t ScannerConfig::generation() const
+{
+    return data->generation;
+}
+
+uint64_t ScannerConfig::currentGeneration()
+{
+    return current_generation;
+}
+
+void ScannerConfig::reload(const QString& filename)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    current = parse(filename, current_generation + 1);
+    current_generation = current->generation;
+}
+
+std::shared_ptr<const ScannerConfig::Data> ScannerConfig::parse(const QString& filename, const uint64_t& generation)
+{
+    std::shared_ptr<Data> parsed = std::make_shared<Data>();
+    parsed->generation = generation;
+
+    QSettings ini(filename, QSettings::IniFormat);
+    parsed->filename = ini.fileName();
+    for (const QString& key : ini.allKeys()) {
+        parsed->values.insert(key, ini.value(key));
+    }
+
+    FlatKeypointFilterSettings& flat = parsed->flat_keypoint_filter;
+    flat.square_side_length = parsed->values.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_SQUARE_SIDE_LENGTH").toInt();
+    flat.square_side_min_length = parsed->values.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_SQUARE_SIDE_MIN_LENGTH").toInt();
+    flat.threshold = parsed->values.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_THRESHOLD").toDouble();
+    flat.max_iterations = parsed->values.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_MAX_ITERATIONS").toInt();
+    flat.min_matches = parsed->values.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_MIN_MATCHES").toInt();
+
+    IcpSettings& icp = parsed->icp;
+    icp.gicp = parsed->values.value("ICP_SETTINGS/GICP").toBool();
+    icp.point_to_plane = parsed->values.value("ICP_SETTINGS/POINT_TO_PLANE").toBool();
+    icp.closed_form = parsed->values.value("ICP_SETTINGS/CLOSED_FORM").toBool();
+    icp.enable_log = parsed->values.value("ICP_SETTINGS/ENABLE_LOG").toBool();
+    icp.max_iterations = parsed->values.value("ICP_SETTINGS/MAX_ITERATIONS").toInt();
+    icp.iteration_block = parsed->values.value("ICP_SETTINGS/ITERATION_BLOCK").toInt();
+    icp.translation_threshold = parsed->values.value("ICP_SETTINGS/TRANSLATION_THRESHOLD").toDouble();
+    icp.rotation_threshold = parsed->values.value("ICP_SETTINGS/ROTATION_THRESHOLD").toDouble();
+    icp.relative_fitness_epsilon = parsed->values.value("ICP_SETTINGS/RELATIVE_FITNESS_EPSILON").toDouble();
+    icp.time_budget = parsed->values.value("ICP_SETTINGS/TIME_BUDGET_MS").toDouble();
+    icp.gicp_pixel_step = parsed->values.value("ICP_SETTINGS/GICP_PIXEL_STEP").toInt();
+    icp.gicp_k_correspondences = parsed->values.value("ICP_SETTINGS/GICP_K_CORRESPONDENCES").toInt();
+    icp.gicp_epsilon = parsed->values.value("ICP_SETTINGS/GICP_EPSILON").toDouble();
+    icp.closed_form_iterations = parsed->values.value("ICP_SETTINGS/CLOSED_FORM_ITERATIONS").toInt();
+    icp.closed_form_min_scale = parsed->values.value("ICP_SETTINGS/CLOSED_FORM_MIN_SCALE").toDouble();
+    icp.closed_form_max_rms = parsed->values.value("ICP_SETTINGS/CLOSED_FORM_MAX_RMS").toDouble();
+    icp.full_fitness = parsed->values.value("ICP_SETTINGS/FULL_FITNESS").toBool();
+    icp.inlier_distance = parsed->values.value("ICP_SETTINGS/INLIER_DISTANCE").toDouble();
+
+    return parsed;
+}
@@ -0,0 +1,46 @@
+#ifndef PROJECT_SETTINGS_H
+#define PROJECT_SETTINGS_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+#include <memory>
+
+class QSettings;
+
+/** \brief Immutable snapshot of a project file read once on the thread owning its QSettings.
+  * Copies are cheap and share the snapshot, so pool tasks and stage threads read the project
+  * through it instead of the QSettings, which may only be used by the thread it lives in.
+  */
+class ProjectSettings {
+public:
+    struct Data {
+        QString filename;
+        QHash<QString, QVariant> values;
+    };
+
+    /** \brief Empty snapshot without a file. */
+    ProjectSettings();
+
+    /** \brief Reads every key of settings, on the thread settings live in. */
+    explicit ProjectSettings(const QSettings& settings);
+
+    QVariant value(const QString& key, const QVariant& default_value = QVariant()) const;
+
+    bool contains(const QString& key) const;
+
+    QString fileName() const;
+
+    /** \brief Keys of the group without the group prefix, sorted as QSettings::childKeys. */
+    QStringList childKeys(const QString& group) const;
+
+    /** \brief Top level groups, sorted as QSettings::childGroups. */
+    QStringList childGroups() const;
+
+private:
+    std::shared_ptr<const Data> data;
+};
+
+#endif // PROJECT_SETTINGS_H
@@ -0,0 +1,51 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <type_traits>
+
+#include "core/base/scannerconfig.h"
+
+/** \brief Sensor resolutions. Frames and the capture stream carry their own, the default mode and the
+  * 320x240 preview mode get kernels with constant bounds and strides through dispatch().
+  */
+namespace resolution
+{
+
+const int DEFAULT_WIDTH = 640;
+const int DEFAULT_HEIGHT = 480;
+
+const int PREVIEW_WIDTH = 320;
+const int PREVIEW_HEIGHT = 240;
+
+/** \brief OPENNI_SETTINGS/WIDTH and HEIGHT, the mode the sensor streams and projects are captured in. */
+inline int sensorWidth(const ScannerConfig& configs)
+{
+    return configs.value("OPENNI_SETTINGS/WIDTH", DEFAULT_WIDTH).toInt();
+}
+
+inline int sensorHeight(const ScannerConfig& configs)
+{
+    return configs.value("OPENNI_SETTINGS/HEIGHT", DEFAULT_HEIGHT).toInt();
+}
+
+template <int Value>
+using Constant = std::integral_constant<int, Value>;
+
+/** \brief Calls kernel(width, height), a generic lambda, with Constant arguments for the default and the
+  * preview resolution and with the ints for any other one.
+  */
+template <typename Kernel>
+inline void dispatch(const int& width, const int& height, Kernel&& kernel)
+{
+    if (width == DEFAULT_WIDTH && height == DEFAULT_HEIGHT) {
+        kernel(Constant<DEFAULT_WIDTH>(), Constant<DEFAULT_HEIGHT>());
+    } else if (width == PREVIEW_WIDTH && height == PREVIEW_HEIGHT) {
+        kernel(Constant<PREVIEW_WIDTH>(), Constant<PREVIEW_HEIGHT>());
+    } else {
+        kernel(width, height);
+    }
+}
+
+} // namespace resolution
+
+#endif // RESOLUTION_H
@@ -4,16 +4,25 @@
 #include <QObject>
 #include <QSettings>
 
+#include "core/base/projectsettings.h"
+#include "core/base/scannerconfig.h"
+
 class ScannerBase : public QObject {
     Q_OBJECT
 
 public:
+    /** \brief A parent living in another thread is not adopted, so stages may be built on pool threads.
+      * On the thread owning parent_settings the project snapshot is read from them, on any other
+      * thread it is taken from the parent, which must then be a ScannerBase with the same settings.
+      */
     ScannerBase(QObject* parent, QSettings* parent_settings);
     void setSettings(QSettings* settings_in);
 
 protected:
+    /** \brief Only used on the thread owning it, everything else reads project. */
     QSettings* settings;
-    QSettings configs;
+    ProjectSettings project;
+    ScannerConfig configs;
 };
 
 #endif // BASESCANNER_H
@@ -0,0 +1,95 @@
+#ifndef SCANNER_CONFIG_H
+#define SCANNER_CONFIG_H
+
+#include <QHash>
+#include <QString>
+#include <QVariant>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/** \brief Immutable snapshot of configs.ini parsed once and shared by pointer.
+  * Copies are cheap and keep the snapshot they were made from until reload()
+  * publishes a new one, which is picked up by objects constructed afterwards.
+  * Process wide objects that keep settings for their lifetime compare generation() with
+  * currentGeneration() and read them again once a reload published a new snapshot.
+  */
+class ScannerConfig {
+public:
+    struct FlatKeypointFilterSettings {
+        int square_side_length;
+        int square_side_min_length;
+        double threshold;
+        int max_iterations;
+        int min_matches;
+    };
+
+    /** \brief ICP_SETTINGS of every registered pair. */
+    struct IcpSettings {
+        bool gicp;
+        bool point_to_plane;
+        bool closed_form;
+        bool enable_log;
+        int max_iterations;
+        int iteration_block;
+        double translation_threshold;
+        double rotation_threshold;
+        double relative_fitness_epsilon;
+        double time_budget;
+        int gicp_pixel_step;
+        int gicp_k_correspondences;
+        double gicp_epsilon;
+        int closed_form_iterations;
+        double closed_form_min_scale;
+        double closed_form_max_rms;
+        bool full_fitness;
+        double inlier_distance;
+    };
+
+    struct Data {
+        uint64_t generation;
+        QString filename;
+        QHash<QString, QVariant> values;
+
+        FlatKeypointFilterSettings flat_keypoint_filter;
+        IcpSettings icp;
+    };
+
+    /** \brief Takes the current snapshot, parses configs.ini on first use. */
+    ScannerConfig();
+
+    QVariant value(const QString& key, const QVariant& default_value = QVariant()) const;
+
+    bool contains(const QString& key) const;
+
+    QString fileName() const;
+
+    const FlatKeypointFilterSettings& flatKeypointFilter() const;
+
+    const IcpSettings& icp() const;
+
+    /** \brief Stable hash of every key and value of the section, for invalidating derived data. */
+    uint64_t sectionHash(const QString& section) const;
+
+    /** \brief Of the snapshot, counting from 1 for the first one published. */
+    uint64_t generation() const;
+
+    /** \brief Of the current snapshot without taking it, 0 before the first one. */
+    static uint64_t currentGeneration();
+
+    /** \brief Parses the file again and publishes the result as the current snapshot. */
+    static void reload(const QString& filename = "configs.ini");
+
+private:
+    std::shared_ptr<const Data> data;
+
+    static std::mutex mutex;
+    static std::shared_ptr<const Data> current;
+    static std::atomic<uint64_t> current_generation;
+
+    static std::shared_ptr<const Data> parse(const QString& filename, const uint64_t& generation);
+};
+
+#endif // SCANNER_CONFIG_H
@@ -1,8 +1,5 @@
 #pragma once
 
-#define WIDTH 640
-#define HEIGHT 480
-
 #define DISABLED_INLIER_THRESHOLD 999999999.0f
 
 #include <QObject>
@@ -16,8 +13,17 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include "core/base/resolution.h"
 #include "core/base/scannerbase.h"
+#include "io/framecontainer.h"
 #include "io/pclio.h"
+#include "utility/memoryaccounting.h"
+#include "utility/pointtransform.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 
 typedef std::vector<int> DepthMap;
 
@@ -35,35 +41,113 @@ typedef std::pair<NormalPcdPtr, NormalPcdPtr> KeypointsNormalPcdPair;
 
 typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > Matrix4fVector;
 
+/** \brief Unaligned so that frames stay storable in plain std::vector. */
+typedef Eigen::Matrix<float, 4, 4, Eigen::DontAlign> FramePose;
+
+class DensePyramid;
+struct GICPFrameData;
+struct FrameNormalsData;
+struct FrameFeaturesData;
+
+/** \brief Data derived from the camera space cloud of a frame, shared by the frame copies.
+  * Entries remember the cloud they were built from and are rebuilt once it is replaced.
+  */
+struct FrameDerivedData
+{
+    std::mutex mutex;
+    std::weak_ptr<const Pcd> densePyramidSource;
+    std::shared_ptr<const DensePyramid> densePyramid;
+    std::weak_ptr<const Pcd> gicpSource;
+    std::shared_ptr<const GICPFrameData> gicp;
+    std::weak_ptr<const Pcd> normalsSource;
+    std::shared_ptr<const FrameNormalsData> normals;
+    /** \brief Image features by detector, of frames without a source the FeatureStore does not keep. */
+    std::weak_ptr<const Pcd> featuresSource;
+    std::map<QString, std::shared_ptr<const FrameFeaturesData> > features;
+
+    static inline bool isBuiltFrom(const std::weak_ptr<const Pcd>& source, const std::shared_ptr<const Pcd>& cloud)
+    {
+        return !source.expired() && !source.owner_before(cloud) && !cloud.owner_before(source);
+    }
+};
+typedef std::shared_ptr<FrameDerivedData> FrameDerivedDataPtr;
+
+/** \brief Copies share the clouds, call detach() before modifying them in place.
+  * The clouds stay in camera coordinates, transform() only composes the pose,
+  * use worldPointCloud() or toWorld() where world coordinates are needed.
+  */
 struct Frame 
 {
     PcdPtr pointCloudPtr;
     NormalPcdPtr pointCloudNormalPcdPtr;
     cv::Mat pointCloudImage;
     std::vector<int> pointCloudIndexes;
+    FramePose pose;
+    /** \brief Where the frame was read from, empty and -1 for frames not read from a project. */
+    QString sourceId;
+    int frameIndex;
+    FrameDerivedDataPtr derivedDataPtr;
+    /** \brief Sensor resolution, of the organized cloud and of the image. Filtering keeps it, so a
+      * compacted cloud can be organized again.
+      */
+    int width;
+    int height;
 
     Frame()
         : pointCloudPtr(std::make_shared<Pcd>())
         , pointCloudNormalPcdPtr(std::make_shared<NormalPcd>())
+        , pose(FramePose::Identity())
+        , frameIndex(-1)
+        , derivedDataPtr(std::make_shared<FrameDerivedData>())
+        , width(resolution::DEFAULT_WIDTH)
+        , height(resolution::DEFAULT_HEIGHT)
     {
     }
 
-    Frame& operator=(const Frame& other)
+    Frame(const Frame& other) = default;
+    Frame(Frame&& other) = default;
+    Frame& operator=(const Frame& other) = default;
+    Frame& operator=(Frame&& other) = default;
+
+    /** \brief Makes the clouds owned by this frame only. */
+    inline void detach()
     {
-        if (this != &other) {
-            if (other.pointCloudPtr) {
-                pointCloudPtr = std::make_shared<Pcd>(*other.pointCloudPtr);
-            }
+        if (pointCloudPtr && pointCloudPtr.use_count() > 1) {
+            pointCloudPtr = memory_accounting::track(std::make_shared<Pcd>(*pointCloudPtr),
+                memory_accounting::FRAMES, pointCloudPtr->size() * sizeof(PointType));
+            derivedDataPtr = std::make_shared<FrameDerivedData>();
+        }
+        if (pointCloudNormalPcdPtr && pointCloudNormalPcdPtr.use_count() > 1) {
+            pointCloudNormalPcdPtr = memory_accounting::track(std::make_shared<NormalPcd>(*pointCloudNormalPcdPtr),
+                memory_accounting::FRAMES, pointCloudNormalPcdPtr->size() * sizeof(NormalType));
+        }
+    }
 
-            if (other.pointCloudNormalPcdPtr) {
-                pointCloudNormalPcdPtr = std::make_shared<NormalPcd>(*other.pointCloudNormalPcdPtr);
-            }
+    inline size_t pixelsCount() const
+    {
+        return size_t(width) * size_t(height);
+    }
 
-            pointCloudImage = other.pointCloudImage;
-            pointCloudIndexes = other.pointCloudIndexes;
+    /** \brief Takes the resolution of an organized cloud, else of the image, else keeps the current one. */
+    inline void setResolution(const Pcd& cloud, const cv::Mat& image)
+    {
+        if (cloud.height > 1) {
+            width = int(cloud.width);
+            height = int(cloud.height);
+        } else if (!image.empty()) {
+            width = image.cols;
+            height = image.rows;
         }
+    }
 
-        return *this;
+    /** \brief Counts the clouds of a frame just read in memory_accounting, the image with the point cloud. */
+    inline void track()
+    {
+        const size_t image_bytes = pointCloudImage.total() * pointCloudImage.elemSize();
+        pointCloudPtr = memory_accounting::track(pointCloudPtr, memory_accounting::FRAMES,
+            pointCloudPtr ? pointCloudPtr->size() * sizeof(PointType) + image_bytes : 0);
+        pointCloudNormalPcdPtr = memory_accounting::track(pointCloudNormalPcdPtr, memory_accounting::FRAMES,
+            pointCloudNormalPcdPtr ? pointCloudNormalPcdPtr->size() * sizeof(NormalType) : 0);
     }
 
     inline bool load(const QString& cloud_path, const QString& image_path)
@@ -80,8 +164,33 @@ struct Frame
             if (!cloud->empty() && !image.empty()) {
                 pointCloudImage = image;
                 pointCloudPtr = cloud;
+                setResolution(*cloud, image);
+                pointCloudIndexes.clear();
+                pointCloudNormalPcdPtr = std::make_shared<NormalPcd>();
+                derivedDataPtr = std::make_shared<FrameDerivedData>();
+                pose.setIdentity();
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline bool load(const QString& container_path)
+    {
+        if (boost::filesystem::exists(container_path.toStdString())) {
+            auto cloud = std::make_shared<Pcd>();
+            cv::Mat image;
+
+            if (frame_container::load(container_path, *cloud, image) && !cloud->empty()) {
+                pointCloudImage = image;
+                pointCloudPtr = cloud;
+                setResolution(*cloud, image);
                 pointCloudIndexes.clear();
-                pointCloudNormalPcdPtr->clear();
+                pointCloudNormalPcdPtr = std::make_shared<NormalPcd>();
+                derivedDataPtr = std::make_shared<FrameDerivedData>();
+                pose.setIdentity();
 
                 return true;
             }
@@ -90,29 +199,73 @@ struct Frame
         return false;
     }
 
+    /** \brief Returns a frame sharing the clouds, with the transformation applied after the current pose. */
     inline Frame transform(const Eigen::Matrix4f& transformation) const
     {
         if (!pointCloudPtr || !pointCloudNormalPcdPtr) {
             throw std::invalid_argument("Frame::transform !pointCloudPtr || !pointCloudNormalPcdPtr");
         }
 
-        Frame result;
-        result.pointCloudImage = pointCloudImage;
-        result.pointCloudIndexes = pointCloudIndexes;
+        Frame result(*this);
+        result.pose = transformation * Eigen::Matrix4f(pose);
+
+        return result;
+    }
+
+    inline bool hasPose() const
+    {
+        return !pose.isIdentity();
+    }
+
+    inline PcdPtr worldPointCloud() const
+    {
+        if (!pointCloudPtr) {
+            throw std::invalid_argument("Frame::worldPointCloud !pointCloudPtr");
+        }
+        if (!hasPose() || pointCloudPtr->empty()) {
+            return pointCloudPtr;
+        }
+
+        auto result = std::make_shared<Pcd>(*pointCloudPtr);
+        point_transform::transform_in_place(Eigen::Matrix4f(pose), *result);
 
-        if (!pointCloudPtr->empty()) {
-            pcl::transformPointCloud(*pointCloudPtr, *result.pointCloudPtr, transformation);
+        return result;
+    }
+
+    inline NormalPcdPtr worldPointCloudNormal() const
+    {
+        if (!pointCloudNormalPcdPtr) {
+            throw std::invalid_argument("Frame::worldPointCloudNormal !pointCloudNormalPcdPtr");
         }
-        if (!pointCloudNormalPcdPtr->empty()) {
-            pcl::transformPointCloud(*pointCloudNormalPcdPtr, *result.pointCloudNormalPcdPtr, transformation);
+        if (!hasPose() || pointCloudNormalPcdPtr->empty()) {
+            return pointCloudNormalPcdPtr;
         }
 
+        auto result = std::make_shared<NormalPcd>(*pointCloudNormalPcdPtr);
+        point_transform::transform_in_place(Eigen::Matrix4f(pose), *result);
+
+        return result;
+    }
+
+    /** \brief Returns the frame with the pose baked into the clouds. */
+    inline Frame toWorld() const
+    {
+        if (!hasPose()) {
+            return *this;
+        }
+
+        Frame result(*this);
+        result.pointCloudPtr = worldPointCloud();
+        result.pointCloudNormalPcdPtr = worldPointCloudNormal();
+        result.derivedDataPtr = std::make_shared<FrameDerivedData>();
+        result.pose.setIdentity();
+
         return result;
     }
 };
 typedef std::vector<Frame> Frames;
 
-/** \brief Main key point clouds storage unit. */
+/** \brief Main key point clouds storage unit. Copies share the clouds, call detach() before modifying them in place. */
 struct KeypointsFrame 
 {
     pcl::Correspondences keypointsPcdCorrespondences;
@@ -127,30 +280,27 @@ struct KeypointsFrame
     {
     }
 
-    KeypointsFrame& operator=(const KeypointsFrame& other)
+    KeypointsFrame(const KeypointsFrame& other) = default;
+    KeypointsFrame(KeypointsFrame&& other) = default;
+    KeypointsFrame& operator=(const KeypointsFrame& other) = default;
+    KeypointsFrame& operator=(KeypointsFrame&& other) = default;
+
+    /** \brief Makes the clouds owned by this frame only. */
+    inline void detach()
     {
-        if (!other.keypointsPcdPair.first || !other.keypointsPcdPair.second) {
+        if (!keypointsPcdPair.first || !keypointsPcdPair.second) {
             throw std::invalid_argument(
-                "KeypointsFrame::operator= !other.keypointsPcdPair.first || !other.keypointsPcdPair.second");
+                "KeypointsFrame::detach !keypointsPcdPair.first || !keypointsPcdPair.second");
         }
-        if (!other.keypointsNormalPcdPair.first || !other.keypointsNormalPcdPair.second) {
+        if (!keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second) {
             throw std::invalid_argument(
-                "KeypointsFrame::operator= !other.keypointsNormalPcdPair.first || !other.keypointsNormalPcdPair.second");
-        }
-
-        if (this != &other) {
-            keypointsPcdCorrespondences = other.keypointsPcdCorrespondences;
-
-            keypointsPcdPair = std::make_pair(
-                std::make_shared<Pcd>(*other.keypointsPcdPair.first),
-                std::make_shared<Pcd>(*other.keypointsPcdPair.second));
-
-            keypointsNormalPcdPair = std::make_pair(
-                std::make_shared<NormalPcd>(*other.keypointsNormalPcdPair.first),
-                std::make_shared<NormalPcd>(*other.keypointsNormalPcdPair.second));
+                "KeypointsFrame::detach !keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second");
         }
 
-        return *this;
+        detach_one(keypointsPcdPair.first);
+        detach_one(keypointsPcdPair.second);
+        detach_one(keypointsNormalPcdPair.first);
+        detach_one(keypointsNormalPcdPair.second);
     }
 
     KeypointsFrame& operator+=(const KeypointsFrame& other)
@@ -165,90 +315,130 @@ struct KeypointsFrame
                 "KeypointsFrame::operator+= !other.keypointsNormalPcdPair.first || !other.keypointsNormalPcdPair.second");
         }
 
-        std::copy(other.keypointsPcdCorrespondences.begin(), other.keypointsPcdCorrespondences.end(),
-            std::back_inserter(keypointsPcdCorrespondences));
+        check_clouds("KeypointsFrame::operator+=");
 
-        std::copy(other.keypointsPcdPair.first->begin(), other.keypointsPcdPair.first->end(),
-            std::back_inserter(keypointsPcdPair.first->points));
-        keypointsPcdPair.first->resize(keypointsPcdPair.first->size());
-        std::copy(other.keypointsPcdPair.second->begin(), other.keypointsPcdPair.second->end(),
-            std::back_inserter(keypointsPcdPair.second->points));
-        keypointsPcdPair.second->resize(keypointsPcdPair.second->size());
+        keypointsPcdCorrespondences.insert(keypointsPcdCorrespondences.end(),
+            other.keypointsPcdCorrespondences.begin(), other.keypointsPcdCorrespondences.end());
 
-        std::copy(other.keypointsNormalPcdPair.first->begin(), other.keypointsNormalPcdPair.first->end(),
-            std::back_inserter(keypointsNormalPcdPair.first->points));
-        keypointsNormalPcdPair.first->resize(keypointsNormalPcdPair.first->size());
-        std::copy(other.keypointsNormalPcdPair.second->begin(), other.keypointsNormalPcdPair.second->end(),
-            std::back_inserter(keypointsNormalPcdPair.second->points));
-        keypointsNormalPcdPair.second->resize(keypointsNormalPcdPair.second->size());
+        append_one(keypointsPcdPair.first, *other.keypointsPcdPair.first);
+        append_one(keypointsPcdPair.second, *other.keypointsPcdPair.second);
+        append_one(keypointsNormalPcdPair.first, *other.keypointsNormalPcdPair.first);
+        append_one(keypointsNormalPcdPair.second, *other.keypointsNormalPcdPair.second);
 
         return *this;
     }
 
-    inline KeypointsFrame transformFirst(const Eigen::Matrix4f& transformation)
+    /** \brief Transforms the first clouds in place, detaching them if they are shared. */
+    inline void transformFirstInPlace(const Eigen::Matrix4f& transformation)
     {
-        if (!keypointsPcdPair.first || !keypointsPcdPair.second) {
-            throw std::invalid_argument(
-                "KeypointsFrame::transform !keypointsPcdPair.first || !keypointsPcdPair.second");
-        }
+        check_clouds("KeypointsFrame::transformFirstInPlace");
 
-        if (!keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second) {
-            throw std::invalid_argument(
-                "KeypointsFrame::transform !keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second");
-        }
+        detach_one(keypointsPcdPair.first);
+        detach_one(keypointsNormalPcdPair.first);
+        point_transform::transform_in_place(transformation, *keypointsPcdPair.first, *keypointsNormalPcdPair.first);
+    }
 
-        KeypointsFrame result;
-        result.keypointsPcdCorrespondences = keypointsPcdCorrespondences;
-        *result.keypointsPcdPair.second = *keypointsPcdPair.second;
-        *result.keypointsNormalPcdPair.second = *keypointsNormalPcdPair.second;
+    inline void transformSecondInPlace(const Eigen::Matrix4f& transformation)
+    {
+        check_clouds("KeypointsFrame::transformSecondInPlace");
 
-        if (!keypointsPcdPair.first->empty()) {
-            pcl::transformPointCloud(
-                *keypointsPcdPair.first, *result.keypointsPcdPair.first, transformation);
-        }
+        detach_one(keypointsPcdPair.second);
+        detach_one(keypointsNormalPcdPair.second);
+        point_transform::transform_in_place(transformation, *keypointsPcdPair.second, *keypointsNormalPcdPair.second);
+    }
 
-        if (!keypointsNormalPcdPair.first->empty()) {
-            pcl::transformPointCloud(
-                *keypointsNormalPcdPair.first, *result.keypointsNormalPcdPair.first, transformation);
-        }
+    inline void transformInPlace(const Eigen::Matrix4f& transformation)
+    {
+        check_clouds("KeypointsFrame::transformInPlace");
+
+        detach();
+        point_transform::transform_in_place(transformation, *keypointsPcdPair.first, *keypointsNormalPcdPair.first,
+            *keypointsPcdPair.second, *keypointsNormalPcdPair.second);
+    }
 
+    /** \brief Returns a frame sharing the second clouds, with copies of the first ones transformed. */
+    inline KeypointsFrame transformFirst(const Eigen::Matrix4f& transformation) const
+    {
+        KeypointsFrame result(*this);
+        result.transformFirstInPlace(transformation);
+        return result;
+    }
+
+    inline KeypointsFrame transformSecond(const Eigen::Matrix4f& transformation) const
+    {
+        KeypointsFrame result(*this);
+        result.transformSecondInPlace(transformation);
+        return result;
+    }
+
+    inline KeypointsFrame transform(const Eigen::Matrix4f& transformation) const
+    {
+        KeypointsFrame result(*this);
+        result.transformInPlace(transformation);
         return result;
     }
 
-    inline KeypointsFrame transformSecond(const Eigen::Matrix4f& transformation)
+    /** \brief Counts the clouds of freshly detected keypoints in memory_accounting. */
+    inline void track()
+    {
+        keypointsPcdPair.first = track_one(keypointsPcdPair.first);
+        keypointsPcdPair.second = track_one(keypointsPcdPair.second);
+        keypointsNormalPcdPair.first = track_one(keypointsNormalPcdPair.first);
+        keypointsNormalPcdPair.second = track_one(keypointsNormalPcdPair.second);
+    }
+
+private:
+    inline void check_clouds(const std::string& function) const
     {
         if (!keypointsPcdPair.first || !keypointsPcdPair.second) {
-            throw std::invalid_argument(
-                "KeypointsFrame::transform !keypointsPcdPair.first || !keypointsPcdPair.second");
+            throw std::invalid_argument(function + " !keypointsPcdPair.first || !keypointsPcdPair.second");
         }
-
         if (!keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second) {
-            throw std::invalid_argument(
-                "KeypointsFrame::transform !keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second");
+            throw std::invalid_argument(function + " !keypointsNormalPcdPair.first || !keypointsNormalPcdPair.second");
         }
+    }
 
-        KeypointsFrame result;
-        result.keypointsPcdCorrespondences = keypointsPcdCorrespondences;
-        *result.keypointsPcdPair.first = *keypointsPcdPair.first;
-        *result.keypointsNormalPcdPair.first = *keypointsNormalPcdPair.first;
-
-        if (!keypointsPcdPair.second->empty()) {
-            pcl::transformPointCloud(
-                *keypointsPcdPair.second, *result.keypointsPcdPair.second, transformation);
+    template <typename CloudPtr>
+    static void detach_one(CloudPtr& cloud)
+    {
+        if (cloud.use_count() > 1) {
+            cloud = track_one(std::make_shared<typename CloudPtr::element_type>(*cloud));
         }
+    }
 
-        if (!keypointsPcdPair.second->empty()) {
-            pcl::transformPointCloud(
-                *keypointsNormalPcdPair.second, *result.keypointsNormalPcdPair.second, transformation);
+    /** \brief Grows the cloud once to its final size. A shared one is copied straight into a cloud sized
+      * for both, rather than detached and grown.
+      */
+    template <typename CloudPtr>
+    static void append_one(CloudPtr& cloud, const typename CloudPtr::element_type& other)
+    {
+        typedef typename CloudPtr::element_type Cloud;
+
+        const size_t size = cloud->size() + other.size();
+        if (cloud.use_count() > 1) {
+            auto result = std::make_shared<Cloud>();
+            result->header = cloud->header;
+            result->is_dense = cloud->is_dense;
+            result->points.reserve(size);
+            result->points.insert(result->points.end(), cloud->points.begin(), cloud->points.end());
+            result->points.insert(result->points.end(), other.points.begin(), other.points.end());
+            result->width = uint32_t(size);
+            result->height = 1;
+            cloud = track_one(result);
+            return;
         }
 
-        return result;
+        //A range insert grows the vector once and keeps its geometric growth over repeated merges
+        cloud->points.insert(cloud->points.end(), other.points.begin(), other.points.end());
+        cloud->width = uint32_t(size);
+        cloud->height = 1;
     }
 
-    inline KeypointsFrame transform(const Eigen::Matrix4f& transformation)
+    template <typename CloudPtr>
+    static CloudPtr track_one(const CloudPtr& cloud)
     {
-        KeypointsFrame result = transformFirst(transformation);
-        return result.transformSecond(transformation);
+        return memory_accounting::track(cloud, memory_accounting::KEYPOINTS_FRAMES,
+            cloud ? cloud->size() * sizeof(typename CloudPtr::element_type::PointType) : 0);
     }
 };
 typedef std::vector<KeypointsFrame> KeypointsFrames;
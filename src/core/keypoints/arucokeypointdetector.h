@@ -29,12 +29,38 @@ public:
         cv::Mat img2,
         PcdPtr keypoint_cloud_ptr1,
         PcdPtr keypoint_cloud_ptr2);
+    ArUcoKeypointDetector(
+        QObject* parent,
+        QSettings* parent_settings,
+        const Frame& frame1,
+        const Frame& frame2,
+        PcdPtr keypoint_cloud_ptr1,
+        PcdPtr keypoint_cloud_ptr2);
 
     void detect();
     void getMarkersVector(
         cv::Mat InImage,
         std::vector<aruco::Marker>* Markers);
 
+protected:
+    aruco::CameraParameters CamParam;
+    aruco::Dictionary D;
+    std::string dictionary_file;
+
+    /** \brief Copy of the image with the GREEN_MARKER colour thresholding applied. */
+    cv::Mat prepare_image(const cv::Mat& img) const;
+
+    void setup_marker_detector(aruco::MarkerDetector& MDetector);
+
+    /** \brief Loads D into the static HighlyReliableMarkers state unless it is loaded already. */
+    void use_dictionary();
+
+    /** \brief Full frame detection, with THRESHOLD_SWEEP every block size is tried concurrently. */
+    void detect_markers(
+        aruco::MarkerDetector& MDetector,
+        const cv::Mat& img,
+        std::vector<aruco::Marker>& Markers);
+
 private:
     PcdPtr point_cloud_ptr1;
     PcdPtr point_cloud_ptr2;
@@ -43,9 +69,6 @@ private:
     PcdPtr keypoint_point_cloud_ptr1;
     PcdPtr keypoint_point_cloud_ptr2;
 
-    aruco::CameraParameters CamParam;
-    aruco::Dictionary D;
-
     void recognize_markers(
         cv::Mat InImage,
         std::vector<aruco::Marker>* Markers);
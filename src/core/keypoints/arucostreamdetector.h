@@ -0,0 +1,40 @@
+#ifndef ARUCOSTREAMDETECTOR_H
+#define ARUCOSTREAMDETECTOR_H
+
+#include "core/keypoints/arucokeypointdetector.h"
+
+/** \brief Long lived marker detector for the sensor stream. Camera parameters,
+  * dictionary and detector are set up once, markers of the previous frame are
+  * searched in windows around their last position and the whole frame is only
+  * searched when one of them is lost or every FULL_FRAME_INTERVAL frames.
+  */
+class ArUcoStreamDetector : public ArUcoKeypointDetector {
+    Q_OBJECT
+
+public:
+    ArUcoStreamDetector(QObject* parent, QSettings* parent_settings);
+
+    std::vector<aruco::Marker> detectMarkers(const cv::Mat& image);
+
+private:
+    aruco::MarkerDetector marker_detector;
+    std::vector<aruco::Marker> tracked_markers;
+    uint frames_since_full_search;
+
+    const bool tracking;
+    const float marker_size;
+    const float min_marker_size;
+    const float max_marker_size;
+    const float roi_margin;
+    const uint full_frame_interval;
+
+    bool track_markers(const cv::Mat& image, std::vector<aruco::Marker>& markers);
+
+    void search_full_frame(const cv::Mat& image, std::vector<aruco::Marker>& markers);
+
+    std::vector<cv::Rect> tracking_windows(const cv::Size& image_size) const;
+
+    void draw_markers(const cv::Mat& image, const std::vector<aruco::Marker>& markers);
+};
+
+#endif // ARUCOSTREAMDETECTOR_H
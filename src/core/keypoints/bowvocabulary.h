@@ -0,0 +1,61 @@
+#ifndef BOW_VOCABULARY_H
+#define BOW_VOCABULARY_H
+
+#include <opencv2/opencv.hpp>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+/** \brief Vocabulary tree of visual words over float (SURF) or binary (ORB) descriptors.
+  * Hierarchical k-means with branching clusters per node, so finding the word of a descriptor
+  * takes branching * depth distance computations. Binary centers are bitwise majorities.
+  * Word weights are tf-idf with the idf of the training documents.
+  */
+class BowVocabulary {
+public:
+    typedef std::shared_ptr<const BowVocabulary> Ptr;
+    /** \brief Word to weight, L1 normalized. */
+    typedef std::map<int, double> BowVector;
+
+    BowVocabulary(const int& branching, const int& depth);
+
+    /** \brief Each document holds the descriptors of one frame, all of one type. At most
+      * max_descriptors rows, sampled evenly over the documents, are clustered.
+      */
+    void train(const std::vector<cv::Mat>& documents, const int& max_descriptors, const int& iterations);
+
+    int word(const cv::Mat& descriptor) const;
+
+    BowVector transform(const cv::Mat& descriptors) const;
+
+    int size() const;
+
+    bool empty() const;
+
+private:
+    struct Node {
+        cv::Mat center;
+        std::vector<int> children;
+        int word;
+    };
+
+    const int branching;
+    const int depth;
+    int descriptor_type;
+    int words_count;
+    std::vector<Node> nodes;
+    std::vector<double> idf;
+
+    double distance(const cv::Mat& a, const cv::Mat& b) const;
+
+    void build(const cv::Mat& descriptors, const std::vector<int>& rows, const int& node, const int& level,
+        const int& iterations, cv::RNG& rng);
+
+    std::vector<int> cluster(const cv::Mat& descriptors, const std::vector<int>& rows, const int& iterations,
+        cv::RNG& rng, std::vector<cv::Mat>& centers) const;
+
+    cv::Mat mean(const cv::Mat& descriptors, const std::vector<int>& rows) const;
+};
+
+#endif // BOW_VOCABULARY_H
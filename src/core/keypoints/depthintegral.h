@@ -0,0 +1,36 @@
+#ifndef DEPTH_INTEGRAL_H
+#define DEPTH_INTEGRAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Summed area tables of the valid depth and of the valid points count
+  * of an organized cloud, any window sum is then four lookups.
+  */
+class DepthIntegral {
+public:
+    explicit DepthIntegral(const Pcd& cloud);
+
+    /** \brief Sums over columns [x0; x1) and rows [y0; y1), the window is clamped to the cloud. */
+    void query(int x0, int y0, int x1, int y1, double& depth_sum, double& count) const;
+
+    int getWidth() const;
+
+    int getHeight() const;
+
+private:
+    int width;
+    int height;
+    std::vector<double> depth_sums;
+    std::vector<uint32_t> counts;
+
+    inline size_t at(const int& x, const int& y) const
+    {
+        return size_t(y) * size_t(width + 1) + size_t(x);
+    }
+};
+
+#endif // DEPTH_INTEGRAL_H
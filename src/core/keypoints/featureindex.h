@@ -0,0 +1,39 @@
+#ifndef FEATURE_INDEX_H
+#define FEATURE_INDEX_H
+
+#include <opencv2/opencv.hpp>
+
+#include <memory>
+#include <mutex>
+
+/** \brief FLANN kd-tree over the float descriptors of one frame, built on the first
+  * search and then shared by every pair the frame takes part in. Searches are thread safe.
+  */
+class FeatureIndex {
+public:
+    typedef std::shared_ptr<FeatureIndex> Ptr;
+
+    FeatureIndex(const cv::Mat& descriptors, const int& trees_count);
+
+    FeatureIndex(const FeatureIndex&) = delete;
+    FeatureIndex& operator=(const FeatureIndex&) = delete;
+
+    /** \brief For every query row returns the k nearest descriptors and their squared L2 distances. */
+    void knnSearch(
+        const cv::Mat& queries,
+        const int& k,
+        const int& checks,
+        cv::Mat& indices,
+        cv::Mat& distances);
+
+    int size() const;
+
+private:
+    const cv::Mat descriptors;
+    const int trees_count;
+
+    std::once_flag built;
+    std::unique_ptr<cv::flann::Index> index;
+};
+
+#endif // FEATURE_INDEX_H
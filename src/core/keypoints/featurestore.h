@@ -0,0 +1,88 @@
+#ifndef FEATURE_STORE_H
+#define FEATURE_STORE_H
+
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+
+#include "core/keypoints/featureindex.h"
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+/** \brief Process wide LRU store of per frame image features keyed by detector, frame source and index.
+  * Lets every pair a frame takes part in reuse one detection and description pass.
+  */
+class FeatureStore {
+public:
+    struct Features {
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        /** \brief Optional, detectors with float descriptors attach it for k-NN matching. */
+        FeatureIndex::Ptr index;
+    };
+
+    typedef std::function<Features()> Extractor;
+
+    static FeatureStore& instance();
+
+    /** \brief Frames without a source are not stored, the extractor runs every time.
+      * Concurrent requests for the same frame wait for the one extraction in flight.
+      */
+    Features get(
+        const QString& detector,
+        const QString& source,
+        const int& frame_index,
+        const uint64_t& parameters_hash,
+        const Extractor& extractor);
+
+    /** \brief Drops the features whose source pattern lies directly in the data folder. */
+    void invalidate(const QString& source);
+
+    void clear();
+
+    size_t size();
+
+private:
+    typedef std::tuple<QString, QString, int> Key;
+
+    struct Entry {
+        Features features;
+        uint64_t parameters_hash;
+        std::list<Key>::iterator lru_it;
+    };
+
+    struct Pending {
+        uint64_t parameters_hash;
+        std::shared_future<Features> features;
+    };
+
+    FeatureStore();
+
+    size_t capacity;
+    uint64_t settings_generation;
+
+    std::mutex mutex;
+    std::map<Key, Entry> entries;
+    std::map<Key, Pending> pending;
+    std::list<Key> lru;
+
+    /** \brief Reads the capacity again after a config reload, under the mutex. */
+    void refresh_settings();
+
+    void evict();
+};
+
+/** \brief Features kept in the FrameDerivedData of a frame, with the parameters they were extracted with. */
+struct FrameFeaturesData {
+    uint64_t parameters_hash;
+    FeatureStore::Features features;
+};
+
+#endif // FEATURE_STORE_H
@@ -0,0 +1,62 @@
+#ifndef HAMMING_MATCHER_H
+#define HAMMING_MATCHER_H
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/** \brief Brute force nearest neighbour matching of binary descriptors,
+  * distances are counted 64 bits at a time with the hardware popcount.
+  */
+namespace hamming_matcher
+{
+
+inline uint32_t popcount64(const uint64_t& value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return uint32_t(__popcnt64(value));
+#elif defined(__GNUC__)
+    return uint32_t(__builtin_popcountll(value));
+#else
+    uint64_t v = value - ((value >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return uint32_t((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+inline uint32_t distance(const uchar* a, const uchar* b, const size_t& size)
+{
+    uint32_t result = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word_a, word_b;
+        std::memcpy(&word_a, a + i, sizeof(uint64_t));
+        std::memcpy(&word_b, b + i, sizeof(uint64_t));
+        result += popcount64(word_a ^ word_b);
+    }
+    for (; i < size; ++i) {
+        result += popcount64(uint64_t(a[i] ^ b[i]));
+    }
+
+    return result;
+}
+
+/** \brief For every query row finds the closest train row, with cross_check
+  * only keeps the pairs that are each other's closest descriptor.
+  */
+void match(
+    const cv::Mat& query_descriptors,
+    const cv::Mat& train_descriptors,
+    std::vector<cv::DMatch>& matches,
+    const bool& cross_check);
+
+} // namespace hamming_matcher
+
+#endif // HAMMING_MATCHER_H
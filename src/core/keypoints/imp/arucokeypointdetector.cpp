@@ -1,22 +1,25 @@
 #include "core/keypoints/arucokeypointdetector.h"
 
-#define WIDTH 640
-#define HEIGHT 480
+#include <algorithm>
+#include <mutex>
+
+#include "utility/profiler.h"
+#include "utility/threadpool.h"
 
 ArUcoKeypointDetector::ArUcoKeypointDetector(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
 {
     CamParam.readFromXMLFile(
-        (QFileInfo(settings->fileName()).absolutePath() + "/"
-            + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+        (QFileInfo(project.fileName()).absolutePath() + "/"
+            + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
             + configs.value("ARUCO_SETTINGS/CAMERA_PARAMS_FILE_NAME").toString())
             .toStdString());
 
-    D.fromFile(
-        (QFileInfo(settings->fileName()).absolutePath() + "/"
-            + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
-            + configs.value("ARUCO_SETTINGS/MARKERS_DICT_FILE_NAME").toString())
-            .toStdString());
+    dictionary_file = (QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+        + configs.value("ARUCO_SETTINGS/MARKERS_DICT_FILE_NAME").toString())
+                          .toStdString();
+    D.fromFile(dictionary_file);
 }
 
 ArUcoKeypointDetector::ArUcoKeypointDetector(
@@ -38,16 +41,31 @@ ArUcoKeypointDetector::ArUcoKeypointDetector(
     keypoint_point_cloud_ptr2 = keypoint_cloud_ptr2;
 
     CamParam.readFromXMLFile(
-        (QFileInfo(settings->fileName()).absolutePath() + "/"
-            + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+        (QFileInfo(project.fileName()).absolutePath() + "/"
+            + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
             + configs.value("ARUCO_SETTINGS/CAMERA_PARAMS_FILE_NAME").toString())
             .toStdString());
 
-    D.fromFile(
-        (QFileInfo(settings->fileName()).absolutePath() + "/"
-            + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
-            + configs.value("ARUCO_SETTINGS/MARKERS_DICT_FILE_NAME").toString())
-            .toStdString());
+    dictionary_file = (QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+        + configs.value("ARUCO_SETTINGS/MARKERS_DICT_FILE_NAME").toString())
+                          .toStdString();
+    D.fromFile(dictionary_file);
+}
+
+ArUcoKeypointDetector::ArUcoKeypointDetector(
+    QObject* parent,
+    QSettings* parent_settings,
+    const Frame& frame1,
+    const Frame& frame2,
+    PcdPtr keypoint_cloud_ptr1,
+    PcdPtr keypoint_cloud_ptr2)
+    : ArUcoKeypointDetector(
+          parent, parent_settings,
+          frame1.pointCloudPtr, frame2.pointCloudPtr,
+          frame1.pointCloudImage, frame2.pointCloudImage,
+          keypoint_cloud_ptr1, keypoint_cloud_ptr2)
+{
 }
 
 void ArUcoKeypointDetector::detect()
@@ -70,6 +88,42 @@ void ArUcoKeypointDetector::recognize_markers(
 
     freopen("nul", "w", stdout);
 
+    cv::Mat InImage = prepare_image(img);
+
+    CamParam.resize(InImage.size());
+
+    MarkerDetector MDetector;
+
+    use_dictionary();
+    setup_marker_detector(MDetector);
+
+    detect_markers(MDetector, InImage, *Markers);
+
+    if (configs.value("ARUCO_SETTINGS/DRAW_EACH_MARKER").toBool()
+        || configs.value("ARUCO_SETTINGS/DRAW_STREAM_MARKER").toBool()) {
+        for (int i = 0; i < Markers->size(); i++) {
+            Markers->at(i).draw(InImage, cv::Scalar(0, 0, 255), 2);
+            if (configs.value("ARUCO_SETTINGS/DRAW_CUBES").toBool()) {
+                CvDrawingUtils::draw3dCube(InImage, Markers->at(i), CamParam);
+            }
+        }
+
+        if (configs.value("ARUCO_SETTINGS/DRAW_EACH_MARKER").toBool()) {
+            cv::imshow(QString("marker %1").arg(rand()).toStdString(), InImage);
+        }
+        if (configs.value("ARUCO_SETTINGS/DRAW_STREAM_MARKER").toBool()) {
+            cv::imshow("markers", InImage);
+        }
+        if (configs.value("ARUCO_SETTINGS/DRAW_STREAM_THRESH").toBool()) {
+            cv::imshow("thresh", MDetector.getThresholdedImage());
+        }
+    }
+
+    fclose(stdout);
+}
+
+cv::Mat ArUcoKeypointDetector::prepare_image(const cv::Mat& img) const
+{
     cv::Mat InImage(img.size(), img.type());
     img.copyTo(InImage);
 
@@ -83,8 +137,8 @@ void ArUcoKeypointDetector::recognize_markers(
         int g_from = configs.value("ARUCO_SETTINGS/H_G_FROM").toInt();
         int g_to = configs.value("ARUCO_SETTINGS/H_G_TO").toInt();
 
-        for (int y = 0; y < HEIGHT; y++) {
-            for (int x = 0; x < WIDTH; x++) {
+        for (int y = 0; y < InImage_HSV.rows; y++) {
+            for (int x = 0; x < InImage_HSV.cols; x++) {
                 if (InImage_HSV.at<cv::Vec3b>(y, x)[0] > g_from
                     && InImage_HSV.at<cv::Vec3b>(y, x)[0] < g_to) {
                     InImage_GRAY.at<uchar>(y, x) = 0;
@@ -99,11 +153,76 @@ void ArUcoKeypointDetector::recognize_markers(
         cvtColor(InImage_GRAY, InImage, CV_GRAY2BGR);
     }
 
-    CamParam.resize(InImage.size());
+    return InImage;
+}
 
-    MarkerDetector MDetector;
+void ArUcoKeypointDetector::use_dictionary()
+{
+    static std::mutex dictionary_mutex;
+    static std::string loaded_dictionary_file;
+
+    std::lock_guard<std::mutex> lock(dictionary_mutex);
+    if (loaded_dictionary_file != dictionary_file) {
+        aruco::HighlyReliableMarkers::loadDictionary(D);
+        loaded_dictionary_file = dictionary_file;
+    }
+}
+
+void ArUcoKeypointDetector::detect_markers(
+    aruco::MarkerDetector& MDetector,
+    const cv::Mat& img,
+    std::vector<aruco::Marker>& Markers)
+{
+    PROFILE_ZONE("aruco_detect");
+    //MarkerDetector::detect runs OpenMP loops of its own
+    const OpenMPLimit openmp_limit;
+    const float MarkerSize = configs.value("ARUCO_SETTINGS/MARKER_SIZE").toFloat();
+    const QStringList sweep = configs.value("ARUCO_SETTINGS/THRESHOLD_SWEEP_BLOCK_SIZES").toStringList();
+
+    if (!configs.value("ARUCO_SETTINGS/THRESHOLD_SWEEP").toBool() || sweep.empty()) {
+        MDetector.detect(img, Markers, CamParam, MarkerSize);
+        return;
+    }
+
+    //Every candidate gets its own detector, the first one is the configured detector
+    //so that its thresholded image stays available for drawing
+    const double threshold_c = configs.value("ARUCO_SETTINGS/THRESHOLD_TO").toDouble();
+    std::vector<std::vector<aruco::Marker> > candidates(sweep.size() + 1);
+    ThreadPool::instance().parallel_for(0, candidates.size(), [&](size_t i) {
+        if (i == 0) {
+            MDetector.detect(img, candidates[i]);
+            return;
+        }
+        aruco::MarkerDetector sweep_detector;
+        setup_marker_detector(sweep_detector);
+        sweep_detector.setThresholdParams(sweep[int(i) - 1].toDouble(), threshold_c);
+        sweep_detector.detect(img, candidates[i]);
+    });
 
-    HighlyReliableMarkers::loadDictionary(D);
+    //Keep the largest instance of every marker id over all thresholds
+    Markers.clear();
+    for (const auto& found : candidates) {
+        for (const auto& marker : found) {
+            auto same_id = std::find_if(Markers.begin(), Markers.end(),
+                [&marker](const aruco::Marker& other) { return other.id == marker.id; });
+            if (same_id == Markers.end()) {
+                Markers.push_back(marker);
+            } else if (same_id->getPerimeter() < marker.getPerimeter()) {
+                *same_id = marker;
+            }
+        }
+    }
+
+    if (CamParam.isValid() && MarkerSize > 0) {
+        for (auto& marker : Markers) {
+            marker.calculateExtrinsics(MarkerSize, CamParam);
+        }
+    }
+    std::sort(Markers.begin(), Markers.end());
+}
+
+void ArUcoKeypointDetector::setup_marker_detector(aruco::MarkerDetector& MDetector)
+{
     MDetector.setMakerDetectorFunction(aruco::HighlyReliableMarkers::detect);
     MDetector.setThresholdParams(
         configs.value("ARUCO_SETTINGS/THRESHOLD_FROM").toInt(),
@@ -115,31 +234,7 @@ void ArUcoKeypointDetector::recognize_markers(
     MDetector.setMinMaxSize(
         configs.value("ARUCO_SETTINGS/MINIMUM_MARKER_SIZE").toFloat(),
         configs.value("ARUCO_SETTINGS/MAXIMUM_MARKER_SIZE").toFloat());
-
-    float MarkerSize = configs.value("ARUCO_SETTINGS/MARKER_SIZE").toFloat();
-    MDetector.detect(InImage, *Markers, CamParam, MarkerSize);
-
-    if (configs.value("ARUCO_SETTINGS/DRAW_EACH_MARKER").toBool()
-        || configs.value("ARUCO_SETTINGS/DRAW_STREAM_MARKER").toBool()) {
-        for (int i = 0; i < Markers->size(); i++) {
-            Markers->at(i).draw(InImage, cv::Scalar(0, 0, 255), 2);
-            if (configs.value("ARUCO_SETTINGS/DRAW_CUBES").toBool()) {
-                CvDrawingUtils::draw3dCube(InImage, Markers->at(i), CamParam);
-            }
-        }
-
-        if (configs.value("ARUCO_SETTINGS/DRAW_EACH_MARKER").toBool()) {
-            cv::imshow(QString("marker %1").arg(rand()).toStdString(), InImage);
-        }
-        if (configs.value("ARUCO_SETTINGS/DRAW_STREAM_MARKER").toBool()) {
-            cv::imshow("markers", InImage);
-        }
-        if (configs.value("ARUCO_SETTINGS/DRAW_STREAM_THRESH").toBool()) {
-            cv::imshow("thresh", MDetector.getThresholdedImage());
-        }
-    }
-
-    fclose(stdout);
+    MDetector.pyrDown(configs.value("ARUCO_SETTINGS/PYRDOWN_LEVEL").toUInt());
 }
 
 void ArUcoKeypointDetector::find_keypoints()
@@ -0,0 +1,142 @@
+#include "core/keypoints/arucostreamdetector.h"
+
+#include <algorithm>
+
+#include "utility/threadpool.h"
+
+ArUcoStreamDetector::ArUcoStreamDetector(QObject* parent, QSettings* parent_settings)
+    : ArUcoKeypointDetector(parent, parent_settings)
+    , frames_since_full_search(0)
+    , tracking(configs.value("ARUCO_SETTINGS/STREAM_TRACKING").toBool())
+    , marker_size(configs.value("ARUCO_SETTINGS/MARKER_SIZE").toFloat())
+    , min_marker_size(configs.value("ARUCO_SETTINGS/MINIMUM_MARKER_SIZE").toFloat())
+    , max_marker_size(configs.value("ARUCO_SETTINGS/MAXIMUM_MARKER_SIZE").toFloat())
+    , roi_margin(configs.value("ARUCO_SETTINGS/STREAM_ROI_MARGIN").toFloat())
+    , full_frame_interval(configs.value("ARUCO_SETTINGS/STREAM_FULL_FRAME_INTERVAL").toUInt())
+{
+    use_dictionary();
+    setup_marker_detector(marker_detector);
+}
+
+std::vector<aruco::Marker> ArUcoStreamDetector::detectMarkers(const cv::Mat& image)
+{
+    //MarkerDetector::detect runs OpenMP loops of its own
+    const OpenMPLimit openmp_limit;
+    const cv::Mat prepared_image = prepare_image(image);
+    if (CamParam.CamSize != prepared_image.size()) {
+        CamParam.resize(prepared_image.size());
+    }
+
+    std::vector<aruco::Marker> markers;
+    const bool full_search_due = full_frame_interval > 0 && ++frames_since_full_search >= full_frame_interval;
+    if (!tracking || full_search_due || !track_markers(prepared_image, markers)) {
+        search_full_frame(prepared_image, markers);
+    }
+    tracked_markers = markers;
+
+    if (configs.value("ARUCO_SETTINGS/DRAW_STREAM_MARKER").toBool()) {
+        draw_markers(prepared_image, markers);
+    }
+
+    return markers;
+}
+
+bool ArUcoStreamDetector::track_markers(const cv::Mat& image, std::vector<aruco::Marker>& markers)
+{
+    if (tracked_markers.empty()) {
+        return false;
+    }
+
+    const float image_perimeter = 2.0f * (image.cols + image.rows);
+    for (const cv::Rect& window : tracking_windows(image.size())) {
+        const float scale = image_perimeter / (2.0f * (window.width + window.height));
+        const float window_max_size = std::min(1.0f, max_marker_size * scale);
+        marker_detector.setMinMaxSize(std::min(window_max_size, min_marker_size * scale), window_max_size);
+
+        std::vector<aruco::Marker> window_markers;
+        marker_detector.detect(image(window), window_markers);
+
+        for (aruco::Marker& marker : window_markers) {
+            const bool duplicate = std::any_of(markers.begin(), markers.end(),
+                [&marker](const aruco::Marker& other) { return other.id == marker.id; });
+            if (duplicate) {
+                continue;
+            }
+
+            for (cv::Point2f& corner : marker) {
+                corner.x += window.x;
+                corner.y += window.y;
+            }
+            if (CamParam.isValid() && marker_size > 0) {
+                marker.calculateExtrinsics(marker_size, CamParam);
+            }
+            markers.push_back(marker);
+        }
+    }
+    marker_detector.setMinMaxSize(min_marker_size, max_marker_size);
+
+    for (const aruco::Marker& tracked : tracked_markers) {
+        const bool found = std::any_of(markers.begin(), markers.end(),
+            [&tracked](const aruco::Marker& marker) { return marker.id == tracked.id; });
+        if (!found) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ArUcoStreamDetector::search_full_frame(const cv::Mat& image, std::vector<aruco::Marker>& markers)
+{
+    markers.clear();
+    detect_markers(marker_detector, image, markers);
+    frames_since_full_search = 0;
+}
+
+/** \brief Marker bounding boxes grown by roi_margin of their size, overlapping windows are merged. */
+std::vector<cv::Rect> ArUcoStreamDetector::tracking_windows(const cv::Size& image_size) const
+{
+    const cv::Rect image_rect(cv::Point(0, 0), image_size);
+
+    std::vector<cv::Rect> windows;
+    for (const aruco::Marker& marker : tracked_markers) {
+        cv::Rect box = cv::boundingRect(cv::Mat(static_cast<const std::vector<cv::Point2f>&>(marker)));
+        const int margin_x = int(box.width * roi_margin);
+        const int margin_y = int(box.height * roi_margin);
+        box = cv::Rect(box.x - margin_x, box.y - margin_y, box.width + 2 * margin_x, box.height + 2 * margin_y) & image_rect;
+        if (box.area() > 0) {
+            windows.push_back(box);
+        }
+    }
+
+    for (bool merged = true; merged;) {
+        merged = false;
+        for (size_t i = 0; i < windows.size() && !merged; ++i) {
+            for (size_t j = i + 1; j < windows.size() && !merged; ++j) {
+                if ((windows[i] & windows[j]).area() > 0) {
+                    windows[i] = windows[i] | windows[j];
+                    windows.erase(windows.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    return windows;
+}
+
+void ArUcoStreamDetector::draw_markers(const cv::Mat& image, const std::vector<aruco::Marker>& markers)
+{
+    cv::Mat canvas = image.clone();
+    for (const aruco::Marker& marker : markers) {
+        marker.draw(canvas, cv::Scalar(0, 0, 255), 2);
+        if (configs.value("ARUCO_SETTINGS/DRAW_CUBES").toBool() && marker.isValid()) {
+            aruco::CvDrawingUtils::draw3dCube(canvas, const_cast<aruco::Marker&>(marker), CamParam);
+        }
+    }
+
+    cv::imshow("markers", canvas);
+    if (configs.value("ARUCO_SETTINGS/DRAW_STREAM_THRESH").toBool()) {
+        cv::imshow("thresh", marker_detector.getThresholdedImage());
+    }
+}
@@ -0,0 +1,293 @@
+#include "core/keypoints/bowvocabulary.h"
+#include "core/keypoints/hammingmatcher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+namespace {
+const uint64 TRAINING_SEED = 0x9E3779B97F4A7C15ULL;
+}
+
+BowVocabulary::BowVocabulary(const int& branching_, const int& depth_)
+    : branching(std::max(2, branching_))
+    , depth(std::max(1, depth_))
+    , descriptor_type(-1)
+    , words_count(0)
+{
+}
+
+void BowVocabulary::train(const std::vector<cv::Mat>& documents, const int& max_descriptors, const int& iterations)
+{
+    nodes.clear();
+    idf.clear();
+    descriptor_type = -1;
+    words_count = 0;
+
+    int total_rows = 0;
+    for (const cv::Mat& document : documents) {
+        if (document.empty()) {
+            continue;
+        }
+        if (descriptor_type >= 0 && document.type() != descriptor_type) {
+            throw std::invalid_argument("BowVocabulary::train documents of different descriptor types");
+        }
+        descriptor_type = document.type();
+        total_rows += document.rows;
+    }
+    if (total_rows == 0) {
+        return;
+    }
+
+    //Evenly spaced rows of every document, so no frame dominates the vocabulary
+    const double keep = std::min(1.0, double(std::max(1, max_descriptors)) / total_rows);
+    cv::Mat samples;
+    for (const cv::Mat& document : documents) {
+        const int count = int(std::ceil(document.rows * keep));
+        for (int i = 0; i < count; ++i) {
+            samples.push_back(document.row(int(double(i) * document.rows / count)));
+        }
+    }
+
+    std::vector<int> rows(samples.rows);
+    for (int i = 0; i < samples.rows; ++i) {
+        rows[i] = i;
+    }
+
+    cv::RNG rng(TRAINING_SEED);
+    nodes.push_back(Node());
+    nodes[0].word = -1;
+    build(samples, rows, 0, 0, iterations, rng);
+
+    //Inverse document frequency of every word over the training documents
+    std::vector<int> document_counts(words_count, 0);
+    int documents_count = 0;
+    for (const cv::Mat& document : documents) {
+        if (document.empty()) {
+            continue;
+        }
+        ++documents_count;
+        std::set<int> document_words;
+        for (int i = 0; i < document.rows; ++i) {
+            document_words.insert(word(document.row(i)));
+        }
+        for (const int& document_word : document_words) {
+            ++document_counts[document_word];
+        }
+    }
+
+    idf.resize(words_count);
+    for (int i = 0; i < words_count; ++i) {
+        idf[i] = std::log(double(documents_count) / std::max(1, document_counts[i]));
+    }
+}
+
+int BowVocabulary::word(const cv::Mat& descriptor) const
+{
+    if (nodes.empty()) {
+        throw std::runtime_error("BowVocabulary::word vocabulary is not trained");
+    }
+
+    int node = 0;
+    while (!nodes[node].children.empty()) {
+        int closest = nodes[node].children.front();
+        double closest_distance = std::numeric_limits<double>::max();
+        for (const int& child : nodes[node].children) {
+            const double child_distance = distance(descriptor, nodes[child].center);
+            if (child_distance < closest_distance) {
+                closest_distance = child_distance;
+                closest = child;
+            }
+        }
+        node = closest;
+    }
+
+    return nodes[node].word;
+}
+
+BowVocabulary::BowVector BowVocabulary::transform(const cv::Mat& descriptors) const
+{
+    BowVector result;
+    if (descriptors.empty() || nodes.empty()) {
+        return result;
+    }
+    if (descriptors.type() != descriptor_type) {
+        throw std::invalid_argument("BowVocabulary::transform descriptors.type() != descriptor_type");
+    }
+
+    for (int i = 0; i < descriptors.rows; ++i) {
+        result[word(descriptors.row(i))] += 1.0;
+    }
+
+    double sum = 0;
+    for (auto& entry : result) {
+        entry.second *= idf[entry.first];
+        sum += entry.second;
+    }
+    if (sum > 0) {
+        for (auto& entry : result) {
+            entry.second /= sum;
+        }
+    }
+
+    return result;
+}
+
+int BowVocabulary::size() const
+{
+    return words_count;
+}
+
+bool BowVocabulary::empty() const
+{
+    return nodes.empty();
+}
+
+//----------------------------------------------------
+
+double BowVocabulary::distance(const cv::Mat& a, const cv::Mat& b) const
+{
+    if (descriptor_type == CV_8U) {
+        return hamming_matcher::distance(a.ptr<uchar>(), b.ptr<uchar>(), a.cols);
+    }
+
+    return cv::norm(a, b, cv::NORM_L2SQR);
+}
+
+void BowVocabulary::build(const cv::Mat& descriptors, const std::vector<int>& rows, const int& node, const int& level,
+    const int& iterations, cv::RNG& rng)
+{
+    if (level == depth || int(rows.size()) <= branching) {
+        nodes[node].word = words_count++;
+        return;
+    }
+
+    std::vector<cv::Mat> centers;
+    const std::vector<int> labels = cluster(descriptors, rows, iterations, rng, centers);
+
+    for (int i = 0; i < int(centers.size()); ++i) {
+        std::vector<int> child_rows;
+        for (size_t j = 0; j < rows.size(); ++j) {
+            if (labels[j] == i) {
+                child_rows.push_back(rows[j]);
+            }
+        }
+        if (child_rows.empty()) {
+            continue;
+        }
+
+        Node child;
+        child.center = centers[i];
+        child.word = -1;
+        nodes.push_back(child);
+        const int child_node = int(nodes.size()) - 1;
+        nodes[node].children.push_back(child_node);
+
+        build(descriptors, child_rows, child_node, level + 1, iterations, rng);
+    }
+}
+
+/** \brief k-means++ seeding, then Lloyd iterations until the labels stop changing. */
+std::vector<int> BowVocabulary::cluster(const cv::Mat& descriptors, const std::vector<int>& rows,
+    const int& iterations, cv::RNG& rng, std::vector<cv::Mat>& centers) const
+{
+    centers.clear();
+    centers.push_back(descriptors.row(rows[rng.uniform(0, int(rows.size()))]).clone());
+
+    std::vector<double> closest_distances(rows.size(), std::numeric_limits<double>::max());
+    while (int(centers.size()) < branching) {
+        double sum = 0;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            //Squared distances, the float distance already is one
+            const double d = distance(descriptors.row(rows[i]), centers.back());
+            closest_distances[i] = std::min(closest_distances[i], descriptor_type == CV_8U ? d * d : d);
+            sum += closest_distances[i];
+        }
+        if (sum <= 0) {
+            break;
+        }
+
+        double target = rng.uniform(0.0, sum);
+        size_t chosen = rows.size() - 1;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            target -= closest_distances[i];
+            if (target <= 0) {
+                chosen = i;
+                break;
+            }
+        }
+        centers.push_back(descriptors.row(rows[chosen]).clone());
+    }
+
+    std::vector<int> labels(rows.size(), -1);
+    for (int iteration = 0; iteration < std::max(1, iterations); ++iteration) {
+        bool changed = false;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            int closest = 0;
+            double closest_distance = std::numeric_limits<double>::max();
+            for (int c = 0; c < int(centers.size()); ++c) {
+                const double d = distance(descriptors.row(rows[i]), centers[c]);
+                if (d < closest_distance) {
+                    closest_distance = d;
+                    closest = c;
+                }
+            }
+            changed = changed || labels[i] != closest;
+            labels[i] = closest;
+        }
+        if (!changed) {
+            break;
+        }
+
+        for (int c = 0; c < int(centers.size()); ++c) {
+            std::vector<int> members;
+            for (size_t i = 0; i < rows.size(); ++i) {
+                if (labels[i] == c) {
+                    members.push_back(rows[i]);
+                }
+            }
+            if (!members.empty()) {
+                centers[c] = mean(descriptors, members);
+            }
+        }
+    }
+
+    return labels;
+}
+
+cv::Mat BowVocabulary::mean(const cv::Mat& descriptors, const std::vector<int>& rows) const
+{
+    if (descriptor_type != CV_8U) {
+        cv::Mat sum = cv::Mat::zeros(1, descriptors.cols, CV_64F);
+        for (const int& row : rows) {
+            cv::Mat row_64f;
+            descriptors.row(row).convertTo(row_64f, CV_64F);
+            sum += row_64f;
+        }
+
+        cv::Mat result;
+        sum.convertTo(result, descriptors.type(), 1.0 / rows.size());
+        return result;
+    }
+
+    //Bitwise majority of the binary descriptors
+    std::vector<int> ones(descriptors.cols * 8, 0);
+    for (const int& row : rows) {
+        const uchar* data = descriptors.ptr<uchar>(row);
+        for (int bit = 0; bit < descriptors.cols * 8; ++bit) {
+            ones[bit] += (data[bit >> 3] >> (bit & 7)) & 1;
+        }
+    }
+
+    cv::Mat result = cv::Mat::zeros(1, descriptors.cols, CV_8U);
+    uchar* data = result.ptr<uchar>();
+    for (int bit = 0; bit < descriptors.cols * 8; ++bit) {
+        if (2 * ones[bit] > int(rows.size())) {
+            data[bit >> 3] |= uchar(1 << (bit & 7));
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,48 @@
+#include "core/keypoints/depthintegral.h"
+
+#include <algorithm>
+#include <cmath>
+
+DepthIntegral::DepthIntegral(const Pcd& cloud)
+    : width(int(cloud.width))
+    , height(int(cloud.height))
+    , depth_sums(size_t(cloud.width + 1) * size_t(cloud.height + 1), 0.0)
+    , counts(size_t(cloud.width + 1) * size_t(cloud.height + 1), 0)
+{
+    for (int y = 0; y < height; ++y) {
+        double row_depth_sum = 0.0;
+        uint32_t row_count = 0;
+
+        for (int x = 0; x < width; ++x) {
+            const float z = cloud.points[size_t(y) * size_t(width) + size_t(x)].z;
+            if (!std::isnan(z)) {
+                row_depth_sum += z;
+                ++row_count;
+            }
+
+            depth_sums[at(x + 1, y + 1)] = depth_sums[at(x + 1, y)] + row_depth_sum;
+            counts[at(x + 1, y + 1)] = counts[at(x + 1, y)] + row_count;
+        }
+    }
+}
+
+void DepthIntegral::query(int x0, int y0, int x1, int y1, double& depth_sum, double& count) const
+{
+    x0 = std::max(0, std::min(x0, width));
+    x1 = std::max(x0, std::min(x1, width));
+    y0 = std::max(0, std::min(y0, height));
+    y1 = std::max(y0, std::min(y1, height));
+
+    depth_sum = depth_sums[at(x1, y1)] - depth_sums[at(x0, y1)] - depth_sums[at(x1, y0)] + depth_sums[at(x0, y0)];
+    count = double(counts[at(x1, y1)]) - counts[at(x0, y1)] - counts[at(x1, y0)] + counts[at(x0, y0)];
+}
+
+int DepthIntegral::getWidth() const
+{
+    return width;
+}
+
+int DepthIntegral::getHeight() const
+{
+    return height;
+}
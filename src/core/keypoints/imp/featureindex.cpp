@@ -0,0 +1,37 @@
+#include "core/keypoints/featureindex.h"
+
+#include <stdexcept>
+
+FeatureIndex::FeatureIndex(const cv::Mat& descriptors_, const int& trees_count_)
+    : descriptors(descriptors_)
+    , trees_count(trees_count_ > 0 ? trees_count_ : 1)
+{
+    if (!descriptors.empty() && descriptors.type() != CV_32F) {
+        throw std::invalid_argument("FeatureIndex descriptors.type() != CV_32F");
+    }
+}
+
+void FeatureIndex::knnSearch(
+    const cv::Mat& queries,
+    const int& k,
+    const int& checks,
+    cv::Mat& indices,
+    cv::Mat& distances)
+{
+    if (descriptors.rows < k || queries.empty()) {
+        indices.release();
+        distances.release();
+        return;
+    }
+
+    std::call_once(built, [this]() {
+        index.reset(new cv::flann::Index(descriptors, cv::flann::KDTreeIndexParams(trees_count)));
+    });
+
+    index->knnSearch(queries, indices, distances, k, cv::flann::SearchParams(checks));
+}
+
+int FeatureIndex::size() const
+{
+    return descriptors.rows;
+}
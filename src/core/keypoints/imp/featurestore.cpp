@@ -0,0 +1,139 @@
+#include "core/keypoints/featurestore.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include "core/base/scannerconfig.h"
+
+FeatureStore::FeatureStore()
+    : capacity(0)
+    , settings_generation(0)
+{
+    refresh_settings();
+}
+
+FeatureStore& FeatureStore::instance()
+{
+    static FeatureStore store;
+    return store;
+}
+
+FeatureStore::Features FeatureStore::get(
+    const QString& detector,
+    const QString& source,
+    const int& frame_index,
+    const uint64_t& parameters_hash,
+    const Extractor& extractor)
+{
+    if (source.isEmpty() || frame_index < 0) {
+        return extractor();
+    }
+
+    const Key key(detector, source, frame_index);
+    std::promise<Features> promise;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        refresh_settings();
+        if (capacity == 0) {
+            lock.unlock();
+            return extractor();
+        }
+
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.parameters_hash == parameters_hash) {
+            lru.splice(lru.begin(), lru, it->second.lru_it);
+            return it->second.features;
+        }
+
+        auto pending_it = pending.find(key);
+        if (pending_it != pending.end() && pending_it->second.parameters_hash == parameters_hash) {
+            std::shared_future<Features> in_flight = pending_it->second.features;
+            lock.unlock();
+            return in_flight.get();
+        }
+
+        Pending& extraction = pending[key];
+        extraction.parameters_hash = parameters_hash;
+        extraction.features = promise.get_future().share();
+    }
+
+    Features features;
+    try {
+        features = extractor();
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.erase(key);
+        throw;
+    }
+    promise.set_value(features);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.erase(key);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        lru.push_front(key);
+        Entry& entry = entries[key];
+        entry.features = features;
+        entry.parameters_hash = parameters_hash;
+        entry.lru_it = lru.begin();
+        evict();
+    } else {
+        it->second.features = features;
+        it->second.parameters_hash = parameters_hash;
+        lru.splice(lru.begin(), lru, it->second.lru_it);
+    }
+
+    return features;
+}
+
+void FeatureStore::invalidate(const QString& source)
+{
+    const QString folder = QDir::cleanPath(source);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (QDir::cleanPath(QFileInfo(std::get<1>(it->first)).path()) == folder) {
+            lru.erase(it->second.lru_it);
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FeatureStore::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+}
+
+size_t FeatureStore::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+void FeatureStore::refresh_settings()
+{
+    if (settings_generation == ScannerConfig::currentGeneration()) {
+        return;
+    }
+
+    ScannerConfig configs;
+    settings_generation = configs.generation();
+    capacity = configs.value("FEATURE_STORE_SETTINGS/ENABLE").toBool()
+        ? configs.value("FEATURE_STORE_SETTINGS/MAX_FRAMES").toUInt()
+        : 0;
+    evict();
+}
+
+void FeatureStore::evict()
+{
+    while (entries.size() > capacity && !lru.empty()) {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+}
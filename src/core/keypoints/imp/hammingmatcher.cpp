@@ -0,0 +1,53 @@
+#include "core/keypoints/hammingmatcher.h"
+
+#include <limits>
+#include <stdexcept>
+
+void hamming_matcher::match(
+    const cv::Mat& query_descriptors,
+    const cv::Mat& train_descriptors,
+    std::vector<cv::DMatch>& matches,
+    const bool& cross_check)
+{
+    matches.clear();
+    if (query_descriptors.empty() || train_descriptors.empty()) {
+        return;
+    }
+    if (query_descriptors.type() != CV_8U || train_descriptors.type() != CV_8U
+        || query_descriptors.cols != train_descriptors.cols) {
+        throw std::invalid_argument("hamming_matcher::match descriptors are not binary or differ in length");
+    }
+
+    const size_t size = size_t(query_descriptors.cols);
+    const int query_count = query_descriptors.rows;
+    const int train_count = train_descriptors.rows;
+
+    std::vector<int> best_train(query_count, -1);
+    std::vector<uint32_t> best_train_distance(query_count, std::numeric_limits<uint32_t>::max());
+    std::vector<int> best_query(train_count, -1);
+    std::vector<uint32_t> best_query_distance(train_count, std::numeric_limits<uint32_t>::max());
+
+    for (int q = 0; q < query_count; ++q) {
+        const uchar* query = query_descriptors.ptr<uchar>(q);
+        for (int t = 0; t < train_count; ++t) {
+            const uint32_t d = distance(query, train_descriptors.ptr<uchar>(t), size);
+            if (d < best_train_distance[q]) {
+                best_train_distance[q] = d;
+                best_train[q] = t;
+            }
+            if (d < best_query_distance[t]) {
+                best_query_distance[t] = d;
+                best_query[t] = q;
+            }
+        }
+    }
+
+    matches.reserve(query_count);
+    for (int q = 0; q < query_count; ++q) {
+        const int t = best_train[q];
+        if (t < 0 || (cross_check && best_query[t] != q)) {
+            continue;
+        }
+        matches.push_back(cv::DMatch(q, t, float(best_train_distance[q])));
+    }
+}
@@ -0,0 +1,177 @@
+#include "core/keypoints/inlierkernel.h"
+
+#include "utility/cpufeatures.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+
+namespace {
+
+typedef size_t (*CountFunction)(
+    const inlier_kernel::Points&, const inlier_kernel::Points&,
+    size_t, size_t, const float*, float);
+
+/** \brief Row major rotation followed by the translation. */
+struct Transform {
+    float m[12];
+
+    explicit Transform(const Eigen::Matrix4f& transformation)
+    {
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < 3; ++col) {
+                m[row * 3 + col] = transformation(row, col);
+            }
+            m[9 + row] = transformation(row, 3);
+        }
+    }
+};
+
+inline bool is_inlier(
+    const inlier_kernel::Points& s, const inlier_kernel::Points& d,
+    const size_t& i, const float* m, const float& squared_threshold)
+{
+    const float dx = m[0] * s.x[i] + m[1] * s.y[i] + m[2] * s.z[i] + m[9] - d.x[i];
+    const float dy = m[3] * s.x[i] + m[4] * s.y[i] + m[5] * s.z[i] + m[10] - d.y[i];
+    const float dz = m[6] * s.x[i] + m[7] * s.y[i] + m[8] * s.z[i] + m[11] - d.z[i];
+    return dx * dx + dy * dy + dz * dz < squared_threshold;
+}
+
+size_t count_scalar(
+    const inlier_kernel::Points& s, const inlier_kernel::Points& d,
+    size_t begin, size_t end, const float* m, float squared_threshold)
+{
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        count += is_inlier(s, d, i, m, squared_threshold);
+    }
+    return count;
+}
+
+CPU_TARGET("avx2,popcnt")
+size_t count_avx2(
+    const inlier_kernel::Points& s, const inlier_kernel::Points& d,
+    size_t begin, size_t end, const float* m, float squared_threshold)
+{
+    __m256 r[12];
+    for (int i = 0; i < 12; ++i) {
+        r[i] = _mm256_set1_ps(m[i]);
+    }
+    const __m256 threshold = _mm256_set1_ps(squared_threshold);
+
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(&s.x[i]);
+        const __m256 y = _mm256_loadu_ps(&s.y[i]);
+        const __m256 z = _mm256_loadu_ps(&s.z[i]);
+
+        __m256 dx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[0], x), _mm256_mul_ps(r[1], y)), _mm256_mul_ps(r[2], z));
+        __m256 dy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[3], x), _mm256_mul_ps(r[4], y)), _mm256_mul_ps(r[5], z));
+        __m256 dz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[6], x), _mm256_mul_ps(r[7], y)), _mm256_mul_ps(r[8], z));
+        dx = _mm256_sub_ps(_mm256_add_ps(dx, r[9]), _mm256_loadu_ps(&d.x[i]));
+        dy = _mm256_sub_ps(_mm256_add_ps(dy, r[10]), _mm256_loadu_ps(&d.y[i]));
+        dz = _mm256_sub_ps(_mm256_add_ps(dz, r[11]), _mm256_loadu_ps(&d.z[i]));
+
+        const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        const int mask = _mm256_movemask_ps(_mm256_cmp_ps(distance, threshold, _CMP_LT_OQ));
+        count += size_t(_mm_popcnt_u32(unsigned(mask)));
+    }
+
+    return count + count_scalar(s, d, i, end, m, squared_threshold);
+}
+
+CPU_TARGET("avx512f,popcnt")
+size_t count_avx512(
+    const inlier_kernel::Points& s, const inlier_kernel::Points& d,
+    size_t begin, size_t end, const float* m, float squared_threshold)
+{
+    __m512 r[12];
+    for (int i = 0; i < 12; ++i) {
+        r[i] = _mm512_set1_ps(m[i]);
+    }
+    const __m512 threshold = _mm512_set1_ps(squared_threshold);
+
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        const __m512 x = _mm512_loadu_ps(&s.x[i]);
+        const __m512 y = _mm512_loadu_ps(&s.y[i]);
+        const __m512 z = _mm512_loadu_ps(&s.z[i]);
+
+        __m512 dx = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(r[0], x), _mm512_mul_ps(r[1], y)), _mm512_mul_ps(r[2], z));
+        __m512 dy = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(r[3], x), _mm512_mul_ps(r[4], y)), _mm512_mul_ps(r[5], z));
+        __m512 dz = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(r[6], x), _mm512_mul_ps(r[7], y)), _mm512_mul_ps(r[8], z));
+        dx = _mm512_sub_ps(_mm512_add_ps(dx, r[9]), _mm512_loadu_ps(&d.x[i]));
+        dy = _mm512_sub_ps(_mm512_add_ps(dy, r[10]), _mm512_loadu_ps(&d.y[i]));
+        dz = _mm512_sub_ps(_mm512_add_ps(dz, r[11]), _mm512_loadu_ps(&d.z[i]));
+
+        const __m512 distance = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+        const __mmask16 mask = _mm512_cmp_ps_mask(distance, threshold, _CMP_LT_OQ);
+        count += size_t(_mm_popcnt_u32(unsigned(mask)));
+    }
+
+    return count + count_scalar(s, d, i, end, m, squared_threshold);
+}
+
+struct Implementation {
+    CountFunction count;
+    const char* name;
+};
+
+const Implementation& selected_implementation()
+{
+    static const Implementation selected = cpu_features::hasAvx512()
+        ? Implementation{ count_avx512, "avx512" }
+        : cpu_features::hasAvx2()
+            ? Implementation{ count_avx2, "avx2" }
+            : Implementation{ count_scalar, "scalar" };
+    return selected;
+}
+
+} // namespace
+
+inlier_kernel::Points::Points(const std::vector<Eigen::Vector3f>& points)
+    : x(points.size())
+    , y(points.size())
+    , z(points.size())
+{
+    for (size_t i = 0; i < points.size(); ++i) {
+        x[i] = points[i].x();
+        y[i] = points[i].y();
+        z[i] = points[i].z();
+    }
+}
+
+size_t inlier_kernel::count(
+    const Points& source,
+    const Points& target,
+    const size_t& begin,
+    const size_t& end,
+    const Eigen::Matrix4f& transformation,
+    const float& squared_threshold)
+{
+    const Transform transform(transformation);
+    return selected_implementation().count(source, target, begin, end, transform.m, squared_threshold);
+}
+
+void inlier_kernel::select(
+    const Points& source,
+    const Points& target,
+    const Eigen::Matrix4f& transformation,
+    const float& squared_threshold,
+    std::vector<int>& inliers)
+{
+    const Transform transform(transformation);
+    const size_t points_count = std::min(source.size(), target.size());
+    for (size_t i = 0; i < points_count; ++i) {
+        if (is_inlier(source, target, i, transform.m, squared_threshold)) {
+            inliers.push_back(int(i));
+        }
+    }
+}
+
+const char* inlier_kernel::implementation()
+{
+    return selected_implementation().name;
+}
@@ -0,0 +1,127 @@
+#include "core/keypoints/keypointbudget.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "core/base/scannerconfig.h"
+
+namespace {
+
+struct Parameters {
+    uint64_t generation;
+    bool enabled;
+    float min_size;
+    float max_size;
+    float target_inliers;
+    float adaptation;
+
+    Parameters()
+    {
+        ScannerConfig configs;
+        generation = configs.generation();
+        enabled = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BUDGET_ENABLE").toBool();
+        min_size = std::max(3.f, configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BUDGET_MIN").toFloat());
+        max_size = std::max(min_size, configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BUDGET_MAX").toFloat());
+        target_inliers = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BUDGET_TARGET_INLIERS").toFloat();
+        adaptation = std::min(1.f, std::max(0.f, configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BUDGET_ADAPTATION").toFloat()));
+    }
+};
+
+//Read again once ScannerConfig::reload() published a new snapshot, the autotuner trials reload it
+std::shared_ptr<const Parameters> parameters()
+{
+    static std::mutex mutex;
+    static std::shared_ptr<const Parameters> instance;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!instance || instance->generation != ScannerConfig::currentGeneration()) {
+        instance = std::make_shared<const Parameters>();
+    }
+    return instance;
+}
+
+size_t rounded(const float& size)
+{
+    return size_t(size + 0.5f);
+}
+
+thread_local size_t thread_size = 0;
+
+//A pair with almost no inliers would ask for an unbounded budget
+const float MIN_INLIER_RATIO = 0.05f;
+
+} // namespace
+
+namespace keypoint_budget
+{
+
+bool enabled()
+{
+    return parameters()->enabled;
+}
+
+Chain::Chain()
+    : current_size(parameters()->max_size)
+    , next_pair(0)
+{
+}
+
+size_t Chain::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return rounded(current_size);
+}
+
+void Chain::report(const size_t& pair_index, const Report& pair_report)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pair_index < next_pair) {
+        return;
+    }
+
+    pending[pair_index] = std::make_pair(pair_report.budgeted, pair_report.inliers);
+    for (auto it = pending.begin(); it != pending.end() && it->first == next_pair; it = pending.erase(it)) {
+        apply(it->second.first, it->second.second);
+        ++next_pair;
+    }
+}
+
+void Chain::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    current_size = parameters()->max_size;
+    next_pair = 0;
+    pending.clear();
+}
+
+void Chain::apply(const size_t& budgeted, const size_t& inliers)
+{
+    if (budgeted == 0) {
+        return;
+    }
+
+    const std::shared_ptr<const Parameters> parameters_ptr = parameters();
+    const Parameters& p = *parameters_ptr;
+    const float ratio = std::max(MIN_INLIER_RATIO, std::min(1.f, float(inliers) / float(budgeted)));
+    const float needed = p.target_inliers / ratio;
+    current_size = std::min(p.max_size, std::max(p.min_size, current_size + p.adaptation * (needed - current_size)));
+}
+
+size_t size()
+{
+    return thread_size > 0 ? thread_size : rounded(parameters()->max_size);
+}
+
+Scope::Scope(const size_t& size)
+    : previous(thread_size)
+{
+    thread_size = size;
+}
+
+Scope::~Scope()
+{
+    thread_size = previous;
+}
+
+} // namespace keypoint_budget
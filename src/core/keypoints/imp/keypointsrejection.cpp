@@ -1,11 +1,19 @@
 #include "core/keypoints/keypointsrejection.h"
 
+#include "core/keypoints/rigidfit.h"
+#include "core/keypoints/rigidsampleconsensus.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+
+#include <numeric>
+
 KeypointsRejection::KeypointsRejection(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
 {
     inlier_threshold = configs.value("SAC_SETTINGS/INLIER_THRESHOLD").toDouble();
     max_iter = configs.value("SAC_SETTINGS/MAX_ITERATIONS").toInt();
     min_idsac_threshold = configs.value("SAC_SETTINGS/IDSAC_MINIMUM").toInt();
+    rigid_sac = configs.value("SAC_SETTINGS/RIGID_SAC_ENABLE").toBool();
 }
 
 KeypointsFrames KeypointsRejection::rejection(
@@ -43,6 +51,8 @@ void KeypointsRejection::perform_rejection(
     KeypointsFrame& in_keypointsFrame,
     KeypointsFrame& out_keypointsFrame)
 {
+    PROFILE_ZONE("keypoints_rejection");
+    in_keypointsFrame.detach();
     KeypointsFrame buffer_keypointsFrame;
     copyKeypointsFrame(in_keypointsFrame, buffer_keypointsFrame);
 
@@ -83,7 +93,7 @@ void KeypointsRejection::perform_rejection(
     pcl::copyPointCloud(*inliers_target_cloud, *target_cloud);
     inliers = inliers_correspondences;
 
-    qDebug() << QString("  SuC   rejection: %1 / %2").arg(correspondences.size()).arg(inliers.size()).toStdString().c_str();
+    LOG_DEBUG("keypoints") << QString("SuC rejection: %1 / %2").arg(correspondences.size()).arg(inliers.size());
     correspondences = inliers;
 
     //###########################################################
@@ -100,7 +110,7 @@ void KeypointsRejection::perform_rejection(
         input_cloud, target_cloud, correspondences,
         DISABLED_INLIER_THRESHOLD, max_iter,
         correspondences, best_transformation_matrix);
-    pcl::transformPointCloud(*input_cloud, *input_cloud, best_transformation_matrix);
+    point_transform::transform_in_place(best_transformation_matrix, *input_cloud);
 
     //###########################################################
     //Iterative decrementive Sample Consensus rejection
@@ -117,17 +127,22 @@ void KeypointsRejection::perform_rejection(
     PcdPtr result_target_cloud = result_KeypointsFrame.keypointsPcdPair.first;
     pcl::Correspondences& result_inliers = result_KeypointsFrame.keypointsPcdCorrespondences;
 
-    for (int i = 0; i < exclude_indexes.size(); i++) {
-        PcdPtr _result_input_cloud(new Pcd);
-        PcdPtr _result_target_cloud(new Pcd);
-        pcl::Correspondences _result_inliers;
+    if (!exclude_indexes.empty()) {
+        //Exclude indexes refer to the inliers left after the previous exclusions
+        std::vector<int> remaining(result_inliers.size());
+        std::iota(remaining.begin(), remaining.end(), 0);
+        for (const int& index : exclude_indexes) {
+            remaining.erase(remaining.begin() + index);
+        }
 
-        for (int j = 0; j < result_inliers.size(); j++) {
-            if (j != exclude_indexes[i]) {
-                _result_inliers.push_back(result_inliers[j]);
-            }
+        pcl::Correspondences _result_inliers;
+        _result_inliers.reserve(remaining.size());
+        for (const int& index : remaining) {
+            _result_inliers.push_back(result_inliers[index]);
         }
 
+        PcdPtr _result_input_cloud(new Pcd);
+        PcdPtr _result_target_cloud(new Pcd);
         pcl::Correspondences buffer_correspondeces;
         update_clouds(
             result_input_cloud, result_target_cloud, _result_inliers,
@@ -146,6 +161,11 @@ void KeypointsRejection::iterative_decrementive_sample_consensus_rejection(
     KeypointsFrame& keypointsFrame,
     std::vector<int>& exclude_indexes)
 {
+    if (rigid_sac) {
+        incremental_idsac_rejection(keypointsFrame, exclude_indexes);
+        return;
+    }
+
     PcdPtr result_input_point_cloud_ptr(new Pcd(*keypointsFrame.keypointsPcdPair.second));
     PcdPtr result_target_point_cloud_ptr(new Pcd(*keypointsFrame.keypointsPcdPair.first));
     pcl::Correspondences result_inliers(keypointsFrame.keypointsPcdCorrespondences);
@@ -184,8 +204,7 @@ void KeypointsRejection::iterative_decrementive_sample_consensus_rejection(
                 DISABLED_INLIER_THRESHOLD, max_iter,
                 _result_inliers, best_transformation_matrix);
 
-            pcl::transformPointCloud(
-                *_result_input_point_cloud_ptr, *_result_input_point_cloud_ptr, best_transformation_matrix);
+            point_transform::transform_in_place(best_transformation_matrix, *_result_input_point_cloud_ptr);
 
             //Comparing camera distances knowing - camera is the last point of the cloud
             const PointType& a = _result_input_point_cloud_ptr->back();
@@ -227,7 +246,79 @@ void KeypointsRejection::iterative_decrementive_sample_consensus_rejection(
 
     pcl::copyPointCloud(*result_input_point_cloud_ptr.get(), *keypointsFrame.keypointsPcdPair.second.get());
     pcl::copyPointCloud(*result_target_point_cloud_ptr.get(), *keypointsFrame.keypointsPcdPair.first.get());
-    qDebug() << "  IDSaC rejection:" << keypointsFrame.keypointsPcdCorrespondences.size() << "/" << result_inliers.size();
+    LOG_DEBUG("keypoints") << "IDSaC rejection:" << keypointsFrame.keypointsPcdCorrespondences.size() << "/" << result_inliers.size();
+    keypointsFrame.keypointsPcdCorrespondences = result_inliers;
+}
+
+/** \brief IDSaC on an index list, the least squares fit without one pair is a RigidFit update
+  * instead of a new SaC run and the clouds are compacted once at the end.
+  */
+void KeypointsRejection::incremental_idsac_rejection(
+    KeypointsFrame& keypointsFrame,
+    std::vector<int>& exclude_indexes)
+{
+    const PcdPtr& input_point_cloud_ptr = keypointsFrame.keypointsPcdPair.second;
+    const PcdPtr& target_point_cloud_ptr = keypointsFrame.keypointsPcdPair.first;
+    const pcl::Correspondences& correspondences = keypointsFrame.keypointsPcdCorrespondences;
+
+    std::vector<Eigen::Vector3f> source(correspondences.size());
+    std::vector<Eigen::Vector3f> target(correspondences.size());
+    RigidFit fit;
+    for (size_t i = 0; i < correspondences.size(); i++) {
+        source[i] = (*input_point_cloud_ptr)[correspondences[i].index_query].getVector3fMap();
+        target[i] = (*target_point_cloud_ptr)[correspondences[i].index_match].getVector3fMap();
+        fit.add(source[i], target[i]);
+    }
+
+    std::vector<int> active(correspondences.size());
+    std::iota(active.begin(), active.end(), 0);
+
+    while (active.size() > min_idsac_threshold) {
+        //Camera is the last pair
+        const Eigen::Vector3f& camera_source = source[active.back()];
+        const Eigen::Vector3f& camera_target = target[active.back()];
+        float current_distance = (camera_source - camera_target).norm();
+
+        int exclude_index = -1;
+        for (size_t i = 0; i < active.size() - 1; i++) {
+            RigidFit candidate_fit(fit);
+            candidate_fit.remove(source[active[i]], target[active[i]]);
+            const Eigen::Matrix4f transformation = candidate_fit.transformation();
+
+            const Eigen::Vector3f moved_camera = transformation.topLeftCorner<3, 3>() * camera_source + transformation.topRightCorner<3, 1>();
+            const float new_distance = (moved_camera - camera_target).norm();
+
+            if (new_distance < current_distance) {
+                current_distance = new_distance;
+                exclude_index = int(i);
+            }
+        }
+
+        if (exclude_index < 0) {
+            break;
+        }
+
+        fit.remove(source[active[exclude_index]], target[active[exclude_index]]);
+        active.erase(active.begin() + exclude_index);
+        exclude_indexes.push_back(exclude_index);
+    }
+
+    pcl::Correspondences remaining;
+    remaining.reserve(active.size());
+    for (const int& index : active) {
+        remaining.push_back(correspondences[index]);
+    }
+
+    PcdPtr result_input_point_cloud_ptr(new Pcd);
+    PcdPtr result_target_point_cloud_ptr(new Pcd);
+    pcl::Correspondences result_inliers;
+    update_clouds(
+        input_point_cloud_ptr, target_point_cloud_ptr, remaining,
+        result_input_point_cloud_ptr, result_target_point_cloud_ptr, result_inliers);
+
+    LOG_DEBUG("keypoints") << "IDSaC rejection:" << correspondences.size() << "/" << result_inliers.size();
+    keypointsFrame.keypointsPcdPair.second = result_input_point_cloud_ptr;
+    keypointsFrame.keypointsPcdPair.first = result_target_point_cloud_ptr;
     keypointsFrame.keypointsPcdCorrespondences = result_inliers;
 }
 
@@ -239,6 +330,13 @@ void KeypointsRejection::calculate_sac(
     const double& inlier_threshold, const int& max_iter,
     pcl::Correspondences& out_inliers, Eigen::Matrix4f& out_transformation_matrix)
 {
+    if (rigid_sac) {
+        calculate_rigid_sac(
+            input_point_cloud_ptr, target_point_cloud_ptr, correspondences,
+            inlier_threshold, max_iter, out_inliers, out_transformation_matrix);
+        return;
+    }
+
     pcl::registration::CorrespondenceRejectorSampleConsensus<PointType> sac;
     sac.setInputSource(input_point_cloud_ptr);
     sac.setInputTarget(target_point_cloud_ptr);
@@ -254,6 +352,49 @@ void KeypointsRejection::calculate_sac(
     out_transformation_matrix = sac.getBestTransformation();
 }
 
+/** \brief Same as calculate_sac on RigidSampleConsensus, correspondences are expected best first. */
+void KeypointsRejection::calculate_rigid_sac(
+    const PcdPtr& input_point_cloud_ptr,
+    const PcdPtr& target_point_cloud_ptr,
+    const pcl::Correspondences& correspondences,
+    const double& inlier_threshold, const int& max_iter,
+    pcl::Correspondences& out_inliers, Eigen::Matrix4f& out_transformation_matrix)
+{
+    std::vector<Eigen::Vector3f> source(correspondences.size());
+    std::vector<Eigen::Vector3f> target(correspondences.size());
+    for (size_t i = 0; i < correspondences.size(); i++) {
+        source[i] = (*input_point_cloud_ptr)[correspondences[i].index_query].getVector3fMap();
+        target[i] = (*target_point_cloud_ptr)[correspondences[i].index_match].getVector3fMap();
+    }
+
+    RigidSampleConsensus::Parameters parameters;
+    parameters.inlier_threshold = inlier_threshold;
+    parameters.max_iterations = max_iter;
+    parameters.confidence = configs.value("SAC_SETTINGS/CONFIDENCE").toDouble();
+    parameters.preemption_block = configs.value("SAC_SETTINGS/PREEMPTION_BLOCK").toInt();
+    parameters.prosac = configs.value("SAC_SETTINGS/PROSAC").toBool();
+    parameters.refine = configs.value("SAC_SETTINGS/REFINE").toBool();
+    parameters.seed = configs.value("SAC_SETTINGS/SEED").toUInt();
+
+    RigidSampleConsensus sac(parameters);
+    std::vector<int> inliers;
+    if (!sac.estimate(source, target, inliers, out_transformation_matrix)) {
+        out_inliers = correspondences;
+        return;
+    }
+
+    pcl::Correspondences new_inliers;
+    new_inliers.reserve(inliers.size());
+    for (const int& index : inliers) {
+        new_inliers.push_back(correspondences[index]);
+    }
+    out_inliers = new_inliers;
+
+    if (configs.value("SAC_SETTINGS/ENABLE_LOG").toBool()) {
+        LOG_DEBUG("keypoints") << "SaC iterations:" << sac.getIterations();
+    }
+}
+
 /** \brief Updates in_point_clouds accroding to in_corrspondeces and copyes it into out clouds and correspondeces. */
 void KeypointsRejection::update_clouds(
     const PcdPtr& in_input_point_cloud_ptr1,
@@ -0,0 +1,64 @@
+#include "core/keypoints/loopclosureindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+LoopClosureIndex::LoopClosureIndex(const BowVocabulary::Ptr& vocabulary_)
+    : vocabulary(vocabulary_)
+{
+    if (!vocabulary || vocabulary->empty()) {
+        throw std::invalid_argument("LoopClosureIndex::LoopClosureIndex vocabulary is not trained");
+    }
+
+    inverted_file.resize(vocabulary->size());
+}
+
+void LoopClosureIndex::add(const int& frame_id, const cv::Mat& descriptors)
+{
+    const int document = int(frame_ids.size());
+    frame_ids.push_back(frame_id);
+
+    for (const auto& entry : vocabulary->transform(descriptors)) {
+        inverted_file[entry.first].push_back(std::make_pair(document, entry.second));
+    }
+}
+
+/** \brief For L1 normalized vectors |a - b| = 2 - sum over the common words of |a| + |b| - |a - b|,
+  * so the score only needs the words the query shares with a frame.
+  */
+LoopClosureIndex::Candidates LoopClosureIndex::query(const cv::Mat& descriptors, const int& max_frame_id,
+    const size_t& max_candidates, const double& min_score) const
+{
+    std::map<int, double> scores;
+    for (const auto& entry : vocabulary->transform(descriptors)) {
+        for (const auto& posting : inverted_file[entry.first]) {
+            if (frame_ids[posting.first] > max_frame_id) {
+                continue;
+            }
+            scores[posting.first] += 0.5 * (entry.second + posting.second - std::abs(entry.second - posting.second));
+        }
+    }
+
+    Candidates result;
+    for (const auto& score : scores) {
+        if (score.second >= min_score) {
+            result.push_back(std::make_pair(frame_ids[score.first], score.second));
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    if (result.size() > max_candidates) {
+        result.resize(max_candidates);
+    }
+
+    return result;
+}
+
+size_t LoopClosureIndex::size() const
+{
+    return frame_ids.size();
+}
@@ -0,0 +1,69 @@
+#include "core/keypoints/orbkeypointdetector.h"
+#include "core/keypoints/hammingmatcher.h"
+
+OrbKeypointDetector::OrbKeypointDetector(
+    QObject* parent,
+    QSettings* parent_settings,
+    const Frame& frame1,
+    const Frame& frame2,
+    PcdPtr keypoint_cloud_ptr1,
+    PcdPtr keypoint_cloud_ptr2)
+    : SurfKeypointDetector(parent, parent_settings, frame1, frame2, keypoint_cloud_ptr1, keypoint_cloud_ptr2)
+{
+}
+
+QString OrbKeypointDetector::feature_name() const
+{
+    return "orb";
+}
+
+uint64_t OrbKeypointDetector::feature_parameters_hash() const
+{
+    return configs.sectionHash("ORB_KEYPOINT_DETECTION_SETTINGS");
+}
+
+FeatureStore::Features OrbKeypointDetector::extract_features(const cv::Mat& image) const
+{
+    FeatureStore::Features features;
+
+    cv::ORB orb(
+        configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/MAX_FEATURES").toInt(),
+        configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/SCALE_FACTOR").toFloat(),
+        configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/LEVELS").toInt(),
+        configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/EDGE_THRESHOLD").toInt(),
+        0, 2, cv::ORB::HARRIS_SCORE,
+        configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/PATCH_SIZE").toInt());
+
+    cv::Mat gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, CV_BGR2GRAY);
+    } else {
+        gray = image;
+    }
+    orb(gray, cv::Mat(), features.keypoints, features.descriptors);
+
+    return features;
+}
+
+void OrbKeypointDetector::match_features(
+    const FeatureStore::Features& features1,
+    const FeatureStore::Features& features2,
+    std::vector<cv::DMatch>& matches) const
+{
+    hamming_matcher::match(
+        features1.descriptors, features2.descriptors, matches,
+        configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/CROSS_CHECK").toBool());
+}
+
+void OrbKeypointDetector::select_good_matches(
+    const std::vector<cv::DMatch>& matches,
+    std::vector<cv::DMatch>& good_matches) const
+{
+    const float max_distance = configs.value("ORB_KEYPOINT_DETECTION_SETTINGS/MAX_HAMMING_DISTANCE").toFloat();
+
+    for (const cv::DMatch& match : matches) {
+        if (match.distance <= max_distance) {
+            good_matches.push_back(match);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#include "core/keypoints/rigidfit.h"
+
+#include <Eigen/LU>
+#include <Eigen/SVD>
+
+RigidFit::RigidFit()
+    : count(0)
+    , weight_sum(0)
+    , source_sum(Eigen::Vector3d::Zero())
+    , target_sum(Eigen::Vector3d::Zero())
+    , cross_sum(Eigen::Matrix3d::Zero())
+{
+}
+
+void RigidFit::add(const Eigen::Vector3f& source, const Eigen::Vector3f& target, const double& weight)
+{
+    const Eigen::Vector3d p = source.cast<double>();
+    const Eigen::Vector3d q = target.cast<double>();
+
+    ++count;
+    weight_sum += weight;
+    source_sum += weight * p;
+    target_sum += weight * q;
+    cross_sum += weight * q * p.transpose();
+}
+
+void RigidFit::remove(const Eigen::Vector3f& source, const Eigen::Vector3f& target, const double& weight)
+{
+    const Eigen::Vector3d p = source.cast<double>();
+    const Eigen::Vector3d q = target.cast<double>();
+
+    --count;
+    weight_sum -= weight;
+    source_sum -= weight * p;
+    target_sum -= weight * q;
+    cross_sum -= weight * q * p.transpose();
+}
+
+Eigen::Matrix4f RigidFit::transformation() const
+{
+    Eigen::Matrix4f result = Eigen::Matrix4f::Identity();
+    if (count < 3 || !(weight_sum > 0)) {
+        return result;
+    }
+
+    const Eigen::Vector3d source_mean = source_sum / weight_sum;
+    const Eigen::Vector3d target_mean = target_sum / weight_sum;
+    const Eigen::Matrix3d covariance = cross_sum / weight_sum - target_mean * source_mean.transpose();
+
+    const Eigen::JacobiSVD<Eigen::Matrix3d> svd(covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Vector3d signs = Eigen::Vector3d::Ones();
+    if (svd.matrixU().determinant() * svd.matrixV().determinant() < 0) {
+        signs(2) = -1;
+    }
+
+    const Eigen::Matrix3d rotation = svd.matrixU() * signs.asDiagonal() * svd.matrixV().transpose();
+    result.topLeftCorner<3, 3>() = rotation.cast<float>();
+    result.topRightCorner<3, 1>() = (target_mean - rotation * source_mean).cast<float>();
+
+    return result;
+}
+
+size_t RigidFit::size() const
+{
+    return count;
+}
@@ -0,0 +1,172 @@
+#include "core/keypoints/rigidsampleconsensus.h"
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+const size_t SAMPLE_SIZE = 3;
+
+Eigen::Matrix4f fit_rigid_transform(
+    const std::vector<Eigen::Vector3f>& source,
+    const std::vector<Eigen::Vector3f>& target,
+    const std::vector<int>& indexes)
+{
+    Eigen::Matrix3Xf src(3, indexes.size());
+    Eigen::Matrix3Xf dst(3, indexes.size());
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        src.col(i) = source[indexes[i]];
+        dst.col(i) = target[indexes[i]];
+    }
+
+    return Eigen::umeyama(src, dst, false);
+}
+
+bool is_degenerate(const std::vector<Eigen::Vector3f>& points, const std::vector<int>& sample)
+{
+    const Eigen::Vector3f a = points[sample[1]] - points[sample[0]];
+    const Eigen::Vector3f b = points[sample[2]] - points[sample[0]];
+    return a.cross(b).squaredNorm() < 1e-12f;
+}
+
+} // namespace
+
+RigidSampleConsensus::RigidSampleConsensus(const Parameters& parameters_)
+    : parameters(parameters_)
+    , iterations(0)
+{
+}
+
+bool RigidSampleConsensus::estimate(
+    const std::vector<Eigen::Vector3f>& source,
+    const std::vector<Eigen::Vector3f>& target,
+    std::vector<int>& inliers,
+    Eigen::Matrix4f& transformation)
+{
+    iterations = 0;
+    inliers.clear();
+    transformation = Eigen::Matrix4f::Identity();
+
+    const size_t points_count = std::min(source.size(), target.size());
+    if (points_count < SAMPLE_SIZE) {
+        return false;
+    }
+
+    const inlier_kernel::Points source_points(source);
+    const inlier_kernel::Points target_points(target);
+    const float squared_threshold = float(parameters.inlier_threshold * parameters.inlier_threshold);
+
+    std::mt19937 generator(parameters.seed);
+
+    //PROSAC growth schedule: the sampled prefix grows from SAMPLE_SIZE to points_count
+    //over max_iterations, the newest prefix point is always part of the sample
+    const int max_iterations = std::max(1, parameters.max_iterations);
+    size_t prefix = parameters.prosac ? SAMPLE_SIZE : points_count;
+    double prefix_samples = double(max_iterations);
+    for (size_t i = 0; i < SAMPLE_SIZE; ++i) {
+        prefix_samples *= double(prefix - i) / double(points_count - i);
+    }
+    double prefix_iterations = 1.0;
+
+    Eigen::Matrix4f best_transformation = Eigen::Matrix4f::Identity();
+    size_t best_count = 0;
+    int iterations_limit = max_iterations;
+
+    std::vector<int> sample(SAMPLE_SIZE);
+    while (iterations < iterations_limit) {
+        ++iterations;
+
+        if (prefix < points_count && iterations > prefix_iterations) {
+            ++prefix;
+            const double next_samples = prefix_samples * double(prefix) / double(prefix - SAMPLE_SIZE);
+            prefix_iterations += std::ceil(next_samples - prefix_samples);
+            prefix_samples = next_samples;
+        }
+
+        const bool take_newest = prefix < points_count;
+        const size_t drawn_count = take_newest ? SAMPLE_SIZE - 1 : SAMPLE_SIZE;
+        const size_t pool_size = take_newest ? prefix - 1 : prefix;
+        for (size_t i = 0; i < drawn_count; ++i) {
+            std::uniform_int_distribution<int> distribution(0, int(pool_size - 1));
+            int index;
+            do {
+                index = distribution(generator);
+            } while (std::find(sample.begin(), sample.begin() + i, index) != sample.begin() + i);
+            sample[i] = index;
+        }
+        if (take_newest) {
+            sample[SAMPLE_SIZE - 1] = int(prefix - 1);
+        }
+
+        if (is_degenerate(source, sample) || is_degenerate(target, sample)) {
+            continue;
+        }
+
+        const Eigen::Matrix4f hypothesis = fit_rigid_transform(source, target, sample);
+        const size_t count = count_inliers(source_points, target_points, hypothesis, best_count);
+        if (count > best_count) {
+            best_count = count;
+            best_transformation = hypothesis;
+            iterations_limit = std::min(max_iterations, required_iterations(best_count, points_count));
+        }
+    }
+
+    if (best_count < SAMPLE_SIZE) {
+        return false;
+    }
+
+    inlier_kernel::select(source_points, target_points, best_transformation, squared_threshold, inliers);
+
+    transformation = parameters.refine ? fit_rigid_transform(source, target, inliers) : best_transformation;
+
+    return true;
+}
+
+int RigidSampleConsensus::getIterations() const
+{
+    return iterations;
+}
+
+/** \brief Scores in blocks of preemption_block points and gives up once best_count can't be exceeded. */
+size_t RigidSampleConsensus::count_inliers(
+    const inlier_kernel::Points& source,
+    const inlier_kernel::Points& target,
+    const Eigen::Matrix4f& transformation,
+    const size_t& best_count) const
+{
+    const size_t points_count = std::min(source.size(), target.size());
+    const size_t block = parameters.preemption_block > 0 ? size_t(parameters.preemption_block) : points_count;
+    const float squared_threshold = float(parameters.inlier_threshold * parameters.inlier_threshold);
+
+    size_t count = 0;
+    for (size_t begin = 0; begin < points_count; begin += block) {
+        const size_t end = std::min(points_count, begin + block);
+        count += inlier_kernel::count(source, target, begin, end, transformation, squared_threshold);
+        if (count + (points_count - end) <= best_count) {
+            return 0;
+        }
+    }
+
+    return count;
+}
+
+int RigidSampleConsensus::required_iterations(const size_t& inliers_count, const size_t& points_count) const
+{
+    const double inliers_ratio = double(inliers_count) / double(points_count);
+    const double all_inliers_probability = std::pow(inliers_ratio, double(SAMPLE_SIZE));
+    if (all_inliers_probability >= 1.0 - std::numeric_limits<double>::epsilon()) {
+        return 1;
+    }
+    if (all_inliers_probability <= std::numeric_limits<double>::epsilon()) {
+        return std::numeric_limits<int>::max();
+    }
+
+    const double confidence = std::min(std::max(parameters.confidence, 0.0), 1.0 - std::numeric_limits<double>::epsilon());
+    const double required = std::log(1.0 - confidence) / std::log(1.0 - all_inliers_probability);
+
+    return required < double(std::numeric_limits<int>::max()) ? int(std::ceil(required)) : std::numeric_limits<int>::max();
+}
@@ -0,0 +1,193 @@
+#include "core/keypoints/surfextractor.h"
+
+#include "opencv2/nonfree/features2d.hpp"
+
+#ifdef HAVE_OPENCV_GPU
+#include "opencv2/gpu/gpu.hpp"
+#include "opencv2/nonfree/gpu.hpp"
+#endif
+
+#include <algorithm>
+#include <mutex>
+
+#include "utility/log.h"
+
+namespace {
+
+cv::Mat to_gray(const cv::Mat& image)
+{
+    if (image.channels() == 1) {
+        return image;
+    }
+
+    cv::Mat gray;
+    cv::cvtColor(image, gray, CV_BGR2GRAY);
+    return gray;
+}
+
+} // namespace
+
+SurfExtractor::SurfExtractor(const Backend& backend_, const double& hessian_threshold_, const int& pyramid_levels_)
+    : backend(backend_)
+    , hessian_threshold(hessian_threshold_)
+    , pyramid_levels(std::max(0, pyramid_levels_))
+{
+}
+
+void SurfExtractor::extract(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const
+{
+    keypoints.clear();
+    descriptors.release();
+
+    switch (backend) {
+    case GPU:
+        if (gpuAvailable() && extract_gpu(image, keypoints, descriptors)) {
+            return;
+        }
+        extract_cpu(image, keypoints, descriptors);
+        return;
+    case PYRAMID:
+        extract_pyramid(image, keypoints, descriptors);
+        return;
+    default:
+        extract_cpu(image, keypoints, descriptors);
+        return;
+    }
+}
+
+SurfExtractor::Backend SurfExtractor::backendFromString(const std::string& backend)
+{
+    if (backend == "GPU") {
+        return GPU;
+    }
+    if (backend == "PYRAMID") {
+        return PYRAMID;
+    }
+    return CPU;
+}
+
+bool SurfExtractor::gpuAvailable()
+{
+#ifdef HAVE_OPENCV_GPU
+    static const bool available = cv::gpu::getCudaEnabledDeviceCount() > 0;
+    return available;
+#else
+    return false;
+#endif
+}
+
+void SurfExtractor::extract_cpu(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const
+{
+    cv::SurfFeatureDetector detector(hessian_threshold);
+    cv::SurfDescriptorExtractor extractor;
+    detector.detect(image, keypoints);
+    extractor.compute(image, keypoints, descriptors);
+}
+
+bool SurfExtractor::extract_gpu(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const
+{
+#ifdef HAVE_OPENCV_GPU
+    //Frames are extracted from the pool threads, the device runs one image at a time
+    static std::mutex gpu_mutex;
+    std::lock_guard<std::mutex> lock(gpu_mutex);
+
+    try {
+        cv::gpu::SURF_GPU surf(hessian_threshold);
+        cv::gpu::GpuMat gray(to_gray(image));
+        cv::gpu::GpuMat keypoints_gpu;
+        cv::gpu::GpuMat descriptors_gpu;
+        surf(gray, cv::gpu::GpuMat(), keypoints_gpu, descriptors_gpu);
+
+        surf.downloadKeypoints(keypoints_gpu, keypoints);
+        descriptors_gpu.download(descriptors);
+        return true;
+    } catch (const cv::Exception& exception) {
+        LOG_WARNING("keypoints") << "SurfExtractor: CUDA SURF failed," << exception.what();
+        keypoints.clear();
+        descriptors.release();
+        return false;
+    }
+#else
+    (void)image;
+    (void)keypoints;
+    (void)descriptors;
+    return false;
+#endif
+}
+
+void SurfExtractor::extract_pyramid(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const
+{
+    cv::Mat level = image;
+    int scale = 1;
+    for (int i = 0; i < pyramid_levels && level.cols >= 128 && level.rows >= 128; ++i) {
+        cv::Mat smaller;
+        cv::pyrDown(level, smaller);
+        level = smaller;
+        scale *= 2;
+    }
+
+    cv::SurfFeatureDetector detector(hessian_threshold);
+    detector.detect(level, keypoints);
+
+    //Pixel x of a pyrDown level is centred on pixel x * 2 of the one above it
+    for (cv::KeyPoint& keypoint : keypoints) {
+        keypoint.pt *= float(scale);
+        keypoint.size *= float(scale);
+    }
+    if (scale > 1) {
+        refine_locations(to_gray(image), scale, keypoints);
+    }
+
+    cv::SurfDescriptorExtractor extractor;
+    extractor.compute(image, keypoints, descriptors);
+}
+
+/** \brief The determinant comes from second derivatives of the image blurred by radius, the finest scale
+  * the coarse level could detect, so one full resolution pass serves all keypoints.
+  */
+void SurfExtractor::refine_locations(const cv::Mat& gray, const int& radius, std::vector<cv::KeyPoint>& keypoints)
+{
+    if (gray.cols < 3 || gray.rows < 3) {
+        return;
+    }
+
+    cv::Mat smoothed;
+    gray.convertTo(smoothed, CV_32F);
+    cv::GaussianBlur(smoothed, smoothed, cv::Size(0, 0), double(radius));
+
+    cv::Mat dxx, dyy, dxy;
+    cv::Sobel(smoothed, dxx, CV_32F, 2, 0);
+    cv::Sobel(smoothed, dyy, CV_32F, 0, 2);
+    cv::Sobel(smoothed, dxy, CV_32F, 1, 1);
+    const cv::Mat determinant = dxx.mul(dyy) - dxy.mul(dxy);
+
+    for (cv::KeyPoint& keypoint : keypoints) {
+        const int cx = std::min(std::max(cvRound(keypoint.pt.x), 1), gray.cols - 2);
+        const int cy = std::min(std::max(cvRound(keypoint.pt.y), 1), gray.rows - 2);
+
+        int best_x = cx;
+        int best_y = cy;
+        for (int y = std::max(1, cy - radius); y <= std::min(gray.rows - 2, cy + radius); ++y) {
+            const float* row = determinant.ptr<float>(y);
+            for (int x = std::max(1, cx - radius); x <= std::min(gray.cols - 2, cx + radius); ++x) {
+                if (row[x] > determinant.at<float>(best_y, best_x)) {
+                    best_x = x;
+                    best_y = y;
+                }
+            }
+        }
+
+        //Parabola through the maximum and its neighbours, per axis
+        const float center = determinant.at<float>(best_y, best_x);
+        const float left = determinant.at<float>(best_y, best_x - 1);
+        const float right = determinant.at<float>(best_y, best_x + 1);
+        const float up = determinant.at<float>(best_y - 1, best_x);
+        const float down = determinant.at<float>(best_y + 1, best_x);
+        const float curvature_x = left - 2.f * center + right;
+        const float curvature_y = up - 2.f * center + down;
+        const float offset_x = curvature_x < 0.f ? std::min(0.5f, std::max(-0.5f, 0.5f * (left - right) / curvature_x)) : 0.f;
+        const float offset_y = curvature_y < 0.f ? std::min(0.5f, std::max(-0.5f, 0.5f * (up - down) / curvature_y)) : 0.f;
+
+        keypoint.pt = cv::Point2f(float(best_x) + offset_x, float(best_y) + offset_y);
+    }
+}
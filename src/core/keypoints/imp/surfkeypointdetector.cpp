@@ -1,7 +1,94 @@
 #include "core/keypoints/surfkeypointdetector.h"
+#include "core/keypoints/keypointbudget.h"
+#include "core/keypoints/surfextractor.h"
+#include "io/featuresidecar.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+
+/** \brief Returns indexes of the two points spanning the axis aligned rectangle of the largest area,
+  * the same pair the exhaustive search over all point pairs picks first.
+  * A point of such a pair can't be weakly dominated towards its corner, so the points are binned
+  * by column, reduced to the four staircase fronts and only front pairs are compared.
+  */
+std::pair<int, int> widest_keypoints_pair(const std::vector<cv::Point2i>& points)
+{
+    struct Candidate {
+        int x;
+        int y;
+        int index;
+    };
+
+    if (points.empty()) {
+        return std::make_pair(0, 0);
+    }
+
+    int min_x = points[0].x, max_x = points[0].x;
+    for (const cv::Point2i& point : points) {
+        min_x = std::min(min_x, point.x);
+        max_x = std::max(max_x, point.x);
+    }
+
+    const int columns_count = max_x - min_x + 1;
+    std::vector<int> lowest(columns_count, -1);
+    std::vector<int> highest(columns_count, -1);
+    for (int i = 0; i < int(points.size()); ++i) {
+        const int column = points[i].x - min_x;
+        if (lowest[column] < 0 || points[i].y < points[lowest[column]].y) {
+            lowest[column] = i;
+        }
+        if (highest[column] < 0 || points[i].y > points[highest[column]].y) {
+            highest[column] = i;
+        }
+    }
+
+    std::vector<Candidate> lower_left, upper_left, lower_right, upper_right;
+    for (int column = 0; column < columns_count; ++column) {
+        if (lowest[column] >= 0 && (lower_left.empty() || points[lowest[column]].y < lower_left.back().y)) {
+            lower_left.push_back({ points[lowest[column]].x, points[lowest[column]].y, lowest[column] });
+        }
+        if (highest[column] >= 0 && (upper_left.empty() || points[highest[column]].y > upper_left.back().y)) {
+            upper_left.push_back({ points[highest[column]].x, points[highest[column]].y, highest[column] });
+        }
+    }
+    for (int column = columns_count - 1; column >= 0; --column) {
+        if (lowest[column] >= 0 && (lower_right.empty() || points[lowest[column]].y < lower_right.back().y)) {
+            lower_right.push_back({ points[lowest[column]].x, points[lowest[column]].y, lowest[column] });
+        }
+        if (highest[column] >= 0 && (upper_right.empty() || points[highest[column]].y > upper_right.back().y)) {
+            upper_right.push_back({ points[highest[column]].x, points[highest[column]].y, highest[column] });
+        }
+    }
+
+    long long max_area = 0;
+    std::pair<int, int> result(0, 0);
+    auto compare_fronts = [&max_area, &result](const std::vector<Candidate>& first, const std::vector<Candidate>& second) {
+        for (const Candidate& a : first) {
+            for (const Candidate& b : second) {
+                const long long area = (long long)std::abs(a.x - b.x) * std::abs(a.y - b.y);
+                const std::pair<int, int> pair(std::min(a.index, b.index), std::max(a.index, b.index));
+                if (area > max_area || (area == max_area && area > 0 && pair < result)) {
+                    max_area = area;
+                    result = pair;
+                }
+            }
+        }
+    };
+    compare_fronts(lower_left, upper_right);
+    compare_fronts(upper_left, lower_right);
 
-#define WIDTH 640
-#define HEIGHT 480
+    return result;
+}
+
+} // namespace
 
 SurfKeypointDetector::SurfKeypointDetector(
     QObject* parent,
@@ -13,6 +100,8 @@ SurfKeypointDetector::SurfKeypointDetector(
     PcdPtr keypoint_cloud_ptr1,
     PcdPtr keypoint_cloud_ptr2)
     : ScannerBase(parent, parent_settings)
+    , frame_index1(-1)
+    , frame_index2(-1)
 {
     _point_cloud_ptr1 = cloud_ptr1;
     _point_cloud_ptr2 = cloud_ptr2;
@@ -22,11 +111,37 @@ SurfKeypointDetector::SurfKeypointDetector(
     keypoint_point_cloud_ptr2 = keypoint_cloud_ptr2;
 }
 
+SurfKeypointDetector::SurfKeypointDetector(
+    QObject* parent,
+    QSettings* parent_settings,
+    const Frame& frame1,
+    const Frame& frame2,
+    PcdPtr keypoint_cloud_ptr1,
+    PcdPtr keypoint_cloud_ptr2)
+    : SurfKeypointDetector(
+          parent, parent_settings,
+          frame1.pointCloudPtr, frame2.pointCloudPtr,
+          frame1.pointCloudImage, frame2.pointCloudImage,
+          keypoint_cloud_ptr1, keypoint_cloud_ptr2)
+{
+    source_id1 = frame1.sourceId;
+    source_id2 = frame2.sourceId;
+    frame_index1 = frame1.frameIndex;
+    frame_index2 = frame2.frameIndex;
+    derived_data1 = frame1.derivedDataPtr;
+    derived_data2 = frame2.derivedDataPtr;
+}
+
 void SurfKeypointDetector::detect()
 {
     perform_detection();
 }
 
+FeatureStore::Features SurfKeypointDetector::getFirstFrameFeatures()
+{
+    return surf_frame_features(source_id1, frame_index1, image1, _point_cloud_ptr1, derived_data1);
+}
+
 void SurfKeypointDetector::getMatchImagesVector(std::vector<cv::Mat>* matchImagesVector)
 {
     for (int i = 0; i < afterThreshNanMatchesImagesVector.size(); i++)
@@ -36,37 +151,19 @@ void SurfKeypointDetector::getMatchImagesVector(std::vector<cv::Mat>* matchImage
 //-------------------------------------------------------
 
 bool SurfKeypointDetector::flat_area_keypoints_filter_threshold_check(
+    const DepthIntegral& depth_integral,
     PcdPtr point_cloud_ptr,
     int x, int y,
     int radius,
     double threshold)
 {
-    int left_x = x - radius, left_y = y - radius;
-    int right_x = x + radius, right_y = y + radius;
-    if (left_x < 0)
-        left_x = 0;
-    if (left_y < 0)
-        left_y = 0;
-    if (right_x >= WIDTH)
-        right_x = WIDTH;
-    if (right_y >= HEIGHT)
-        right_y = HEIGHT;
-
     double current = point_cloud_ptr->at(x, y).z;
     double averege = 0.0f;
     double counter = 0.0f;
-
-    for (int y = left_y; y < right_y; y++) {
-        for (int x = left_x; x < right_x; x++) {
-            if (!std::isnan(point_cloud_ptr->at(x, y).z)) {
-                averege += point_cloud_ptr->at(x, y).z;
-                counter++;
-            }
-        }
-    }
+    depth_integral.query(x - radius, y - radius, x + radius, y + radius, averege, counter);
 
     averege /= counter;
-    double value = abs(averege - current);
+    double value = std::abs(averege - current);
 
     if (value < threshold)
         return true;
@@ -86,11 +183,17 @@ void SurfKeypointDetector::flat_area_keypoints_filter(
 
     int iter_counter = 0;
 
-    int radius = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_SQUARE_SIDE_LENGTH").toInt();
-    int min_radius = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_SQUARE_SIDE_MIN_LENGTH").toInt();
-    double threshold = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_THRESHOLD").toDouble();
-    int max_iter = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_MAX_ITERATIONS").toInt();
-    int min_match = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLAT_KEYPOINT_FILTER_MIN_MATCHES").toInt();
+    const ScannerConfig::FlatKeypointFilterSettings& flat_filter = configs.flatKeypointFilter();
+    int radius = flat_filter.square_side_length;
+    int min_radius = flat_filter.square_side_min_length;
+    double threshold = flat_filter.threshold;
+    int max_iter = flat_filter.max_iterations;
+    int min_match = flat_filter.min_matches;
+
+    if (!depth_integral1) {
+        depth_integral1.reset(new DepthIntegral(*_point_cloud_ptr1));
+        depth_integral2.reset(new DepthIntegral(*_point_cloud_ptr2));
+    }
 
     while (matches_after_thresh.size() < min_match) {
         matches_after_thresh.clear();
@@ -107,12 +210,12 @@ void SurfKeypointDetector::flat_area_keypoints_filter(
             int x1 = int(round(keypoints1[i].x));
             int y1 = int(round(keypoints1[i].y));
             const bool pass_threshold1 = flat_area_keypoints_filter_threshold_check(
-                _point_cloud_ptr1, x1, y1, radius, threshold);
+                *depth_integral1, _point_cloud_ptr1, x1, y1, radius, threshold);
 
             int x2 = int(round(keypoints2[i].x));
             int y2 = int(round(keypoints2[i].y));
             const bool pass_threshold2 = flat_area_keypoints_filter_threshold_check(
-                _point_cloud_ptr2, x2, y2, radius, threshold);
+                *depth_integral2, _point_cloud_ptr2, x2, y2, radius, threshold);
 
             if (pass_threshold1 && pass_threshold2) {
                 matches_after_thresh.push_back(matches[i]);
@@ -135,8 +238,171 @@ void SurfKeypointDetector::flat_area_keypoints_filter(
 
 //-------------------------------------------------------
 
+FeatureStore::Features SurfKeypointDetector::surf_frame_features(const QString& source_id, const int& frame_index,
+    const cv::Mat& image, const PcdPtr& cloud, const FrameDerivedDataPtr& derived_data)
+{
+    const QString name = feature_name();
+    const uint64_t parameters_hash = feature_parameters_hash();
+
+    QString sidecar_filename;
+    if (configs.value("FEATURE_STORE_SETTINGS/SIDECAR_ENABLE").toBool() && !source_id.isEmpty() && frame_index >= 0) {
+        sidecar_filename = QFileInfo(source_id).absolutePath() + "/"
+            + configs.value("READING_PATTERNS_SETTINGS/FEATURE_SIDECAR_NAME").toString().arg(frame_index).arg(name);
+    }
+
+    const int trees_count = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLANN_TREES").toInt();
+
+    const auto extract = [&]() {
+        FeatureStore::Features features;
+        if (sidecar_filename.isEmpty()
+            || !feature_sidecar::load(sidecar_filename, parameters_hash, features.keypoints, features.descriptors)) {
+            PROFILE_ZONE("detect_compute");
+            features = extract_features(image);
+
+            if (!sidecar_filename.isEmpty()
+                && !feature_sidecar::save(sidecar_filename, parameters_hash, features.keypoints, features.descriptors)) {
+                qDebug() << "SurfKeypointDetector: can't write" << sidecar_filename;
+            }
+        }
+
+        if (features.descriptors.type() == CV_32F && !features.descriptors.empty()) {
+            features.index = std::make_shared<FeatureIndex>(features.descriptors, trees_count);
+        }
+
+        return features;
+    };
+
+    if (!source_id.isEmpty() || !derived_data || !cloud) {
+        return FeatureStore::instance().get(name, source_id, frame_index, parameters_hash, extract);
+    }
+
+    //The image is replaced together with the cloud, so the entries follow the cloud like the other derived data
+    FrameDerivedData& data = *derived_data;
+    std::lock_guard<std::mutex> lock(data.mutex);
+
+    const std::shared_ptr<const Pcd> source = cloud;
+    if (!FrameDerivedData::isBuiltFrom(data.featuresSource, source)) {
+        data.features.clear();
+        data.featuresSource = source;
+    }
+
+    std::shared_ptr<const FrameFeaturesData>& entry = data.features[name];
+    if (!entry || entry->parameters_hash != parameters_hash) {
+        auto features = std::make_shared<FrameFeaturesData>();
+        features->parameters_hash = parameters_hash;
+        features->features = extract();
+        entry = features;
+    }
+
+    return entry->features;
+}
+
+QString SurfKeypointDetector::feature_name() const
+{
+    return "surf";
+}
+
+uint64_t SurfKeypointDetector::feature_parameters_hash() const
+{
+    return configs.sectionHash("OPENCV_KEYPOINT_DETECTION_SETTINGS");
+}
+
+FeatureStore::Features SurfKeypointDetector::extract_features(const cv::Mat& image) const
+{
+    FeatureStore::Features features;
+
+    const SurfExtractor extractor(
+        SurfExtractor::backendFromString(configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BACKEND").toString().toStdString()),
+        configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/MIN_HISS").toInt(),
+        configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/PYRAMID_LEVELS").toInt());
+    extractor.extract(image, features.keypoints, features.descriptors);
+
+    return features;
+}
+
+void SurfKeypointDetector::match_features(
+    const FeatureStore::Features& features1,
+    const FeatureStore::Features& features2,
+    std::vector<cv::DMatch>& matches) const
+{
+    if (configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BF_MATCHER").toBool()) {
+        cv::BFMatcher matcher(cv::NORM_L2);
+        matcher.match(features1.descriptors, features2.descriptors, matches);
+    } else if (configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/KNN_RATIO_TEST").toBool() && features1.index) {
+        knn_ratio_match(features1, features2, matches);
+    } else {
+        cv::FlannBasedMatcher matcher;
+        matcher.match(features1.descriptors, features2.descriptors, matches);
+    }
+}
+
+/** \brief Queries the second frame against the index of the first one,
+  * so a frame paired with many others is indexed only once.
+  */
+void SurfKeypointDetector::knn_ratio_match(
+    const FeatureStore::Features& features1,
+    const FeatureStore::Features& features2,
+    std::vector<cv::DMatch>& matches) const
+{
+    const float ratio = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/KNN_RATIO").toFloat();
+    const int checks = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLANN_CHECKS").toInt();
+
+    cv::Mat indices, distances;
+    features1.index->knnSearch(features2.descriptors, 2, checks, indices, distances);
+    if (indices.empty()) {
+        return;
+    }
+
+    std::vector<int> best_match(features1.index->size(), -1);
+    for (int i = 0; i < indices.rows; ++i) {
+        const float nearest = distances.at<float>(i, 0);
+        const float second = distances.at<float>(i, 1);
+        if (nearest >= ratio * ratio * second) {
+            continue;
+        }
+
+        const cv::DMatch match(indices.at<int>(i, 0), i, std::sqrt(nearest));
+        int& best = best_match[match.queryIdx];
+        if (best < 0) {
+            best = int(matches.size());
+            matches.push_back(match);
+        } else if (match.distance < matches[best].distance) {
+            matches[best] = match;
+        }
+    }
+}
+
+void SurfKeypointDetector::select_good_matches(
+    const std::vector<cv::DMatch>& matches,
+    std::vector<cv::DMatch>& good_matches) const
+{
+    if (configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/KNN_RATIO_TEST").toBool()
+        && !configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BF_MATCHER").toBool()) {
+        good_matches = matches;
+        return;
+    }
+
+    double min_dist = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/MIN_DIST_INIT").toDouble();
+
+    for (int i = 0; i < matches.size(); i++) {
+        if (matches[i].distance < min_dist) {
+            min_dist = matches[i].distance;
+        }
+    }
+
+    double multy = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/GOOD_KEYPOINTS_DIST_COEF").toDouble();
+    double abs_min_dist = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/MINIMAL_GOOD_KEYPOINTS_DIST").toDouble();
+
+    for (int i = 0; i < matches.size(); i++) {
+        if (matches[i].distance <= std::max(multy * min_dist, abs_min_dist)) {
+            good_matches.push_back(matches[i]);
+        }
+    }
+}
+
 void SurfKeypointDetector::perform_detection()
 {
+    PROFILE_ZONE("keypoints");
     afterThreshNanMatchesImagesVector.clear();
 
     std::vector<cv::Point2f> keypoints1, keypoints2;
@@ -150,6 +416,10 @@ void SurfKeypointDetector::perform_detection()
         keypoints1, keypoints2, matches,
         inlier_keypoints1, inlier_keypoints2, inlier_matches);
 
+    if (keypoint_budget::enabled()) {
+        surf_budget_keypoints(_keypoints1, inlier_keypoints1, inlier_keypoints2, inlier_matches);
+    }
+
     if (configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/GRID_KEYPOINT_FILTER_ENABLE").toBool()) {
         std::vector<cv::Point2f> grid_keypoints1, grid_keypoints2;
         std::vector<cv::DMatch> grid_matches;
@@ -187,27 +457,16 @@ void SurfKeypointDetector::surf_detect_keypoints(
     std::vector<cv::DMatch>& result_matches)
 {
     using namespace cv;
-    Mat descriptors1, descriptors2;
-
-    SurfFeatureDetector detector(configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/MIN_HISS").toInt());
-    SurfDescriptorExtractor extractor;
     vector<DMatch> matches;
 
-    detector.detect(image1, _keypoints1);
-    detector.detect(image2, _keypoints2);
+    const FeatureStore::Features features1 = surf_frame_features(source_id1, frame_index1, image1, _point_cloud_ptr1, derived_data1);
+    const FeatureStore::Features features2 = surf_frame_features(source_id2, frame_index2, image2, _point_cloud_ptr2, derived_data2);
+    _keypoints1 = features1.keypoints;
+    _keypoints2 = features2.keypoints;
 
-    extractor.compute(image1, _keypoints1, descriptors1);
-    extractor.compute(image2, _keypoints2, descriptors2);
-
-    if (configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/BF_MATCHER").toBool()) {
-        BFMatcher matcher(NORM_L2);
-        matcher.match(descriptors1, descriptors2, matches);
-    } else if (configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/FLANN_MATCHER").toBool()) {
-        FlannBasedMatcher matcher;
-        matcher.match(descriptors1, descriptors2, matches);
-    } else {
-        FlannBasedMatcher matcher;
-        matcher.match(descriptors1, descriptors2, matches);
+    {
+        PROFILE_ZONE("match");
+        match_features(features1, features2, matches);
     }
 
     int y_threshold = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/Y_AMPLITUDE_KEYPOINTS_THRESHOLD").toInt();
@@ -222,22 +481,11 @@ void SurfKeypointDetector::surf_detect_keypoints(
         }
     }
 
-    double min_dist = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/MIN_DIST_INIT").toDouble();
-
-    for (int i = 0; i < y_thresh_matches.size(); i++) {
-        if (y_thresh_matches[i].distance < min_dist) {
-            min_dist = y_thresh_matches[i].distance;
-        }
-    }
-
-    double multy = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/GOOD_KEYPOINTS_DIST_COEF").toDouble();
-    double abs_min_dist = configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/MINIMAL_GOOD_KEYPOINTS_DIST").toDouble();
+    select_good_matches(y_thresh_matches, result_matches);
 
-    for (int i = 0; i < y_thresh_matches.size(); i++) {
-        if (y_thresh_matches[i].distance <= max(multy * min_dist, abs_min_dist)) {
-            result_matches.push_back(y_thresh_matches[i]);
-        }
-    }
+    //Best matches first, sample consensus draws its samples from the head of the list
+    std::stable_sort(result_matches.begin(), result_matches.end(),
+        [](const DMatch& a, const DMatch& b) { return a.distance < b.distance; });
 
     for (int i = 0; i < result_matches.size(); i++) {
         result_keypoints1.push_back(_keypoints1[result_matches[i].queryIdx].pt);
@@ -253,6 +501,7 @@ void SurfKeypointDetector::surf_reject_keypoints(
     std::vector<cv::Point2f>& out_keypoints2,
     std::vector<cv::DMatch>& out_matches)
 {
+    PROFILE_ZONE("reject");
     std::vector<cv::Point2f> no_nan_good_keypoints1;
     std::vector<cv::Point2f> no_nan_good_keypoints2;
     std::vector<cv::DMatch> good_matches_after_nan;
@@ -278,13 +527,74 @@ void SurfKeypointDetector::surf_reject_keypoints(
         good_matches_after_thresh_nan = good_matches_after_nan;
     }
 
-    qDebug() << "  SURF Keypoints found:" << good_matches_after_thresh_nan.size();
+    LOG_DEBUG("keypoints") << "Keypoints found:" << feature_name() << good_matches_after_thresh_nan.size();
 
     out_keypoints1 = no_nan_after_thresh_good_keypoints1;
     out_keypoints2 = no_nan_after_thresh_good_keypoints2;
     out_matches = good_matches_after_thresh_nan;
 }
 
+void SurfKeypointDetector::surf_budget_keypoints(
+    const std::vector<cv::KeyPoint>& _keypoints1,
+    std::vector<cv::Point2f>& keypoints1,
+    std::vector<cv::Point2f>& keypoints2,
+    std::vector<cv::DMatch>& matches)
+{
+    const size_t budget = keypoint_budget::size();
+    if (matches.size() <= budget) {
+        return;
+    }
+
+    PROFILE_ZONE("budget");
+    const int cell_height = std::max(1, configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/GRID_KEYPOINT_FILTER_VERT_RES").toInt());
+    const int cell_width = std::max(1, configs.value("OPENCV_KEYPOINT_DETECTION_SETTINGS/GRID_KEYPOINT_FILTER_HOR_RES").toInt());
+
+    float max_distance = 0;
+    float max_response = 0;
+    for (const cv::DMatch& match : matches) {
+        max_distance = std::max(max_distance, match.distance);
+        max_response = std::max(max_response, _keypoints1[match.queryIdx].response);
+    }
+
+    //Equal weights of the normalized descriptor distance and detector response
+    std::vector<float> scores(matches.size());
+    for (size_t i = 0; i < matches.size(); i++) {
+        const float distance = max_distance > 0 ? matches[i].distance / max_distance : 0.f;
+        const float response = max_response > 0 ? _keypoints1[matches[i].queryIdx].response / max_response : 0.f;
+        scores[i] = response - distance;
+    }
+
+    std::vector<size_t> order(matches.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](const size_t& a, const size_t& b) { return scores[a] > scores[b]; });
+
+    //Rank of every match within its cell, the best of every cell is kept before the second best of any
+    std::unordered_map<int64_t, int> cell_counts;
+    std::vector<int> ranks(matches.size());
+    for (const size_t& i : order) {
+        const int64_t cell = (int64_t(keypoints1[i].y) / cell_height) << 32 | (int64_t(keypoints1[i].x) / cell_width);
+        ranks[i] = cell_counts[cell]++;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](const size_t& a, const size_t& b) { return ranks[a] < ranks[b]; });
+
+    order.resize(budget);
+    std::sort(order.begin(), order.end());
+
+    std::vector<cv::Point2f> budget_keypoints1, budget_keypoints2;
+    std::vector<cv::DMatch> budget_matches;
+    for (const size_t& i : order) {
+        budget_keypoints1.push_back(keypoints1[i]);
+        budget_keypoints2.push_back(keypoints2[i]);
+        budget_matches.push_back(matches[i]);
+    }
+
+    LOG_DEBUG("keypoints") << "Keypoints budget:" << feature_name() << budget_matches.size() << "/" << matches.size();
+
+    keypoints1.swap(budget_keypoints1);
+    keypoints2.swap(budget_keypoints2);
+    matches.swap(budget_matches);
+}
+
 void SurfKeypointDetector::surf_remove_nan_from_keypoints(
     std::vector<cv::Point2f> keypoints1,
     std::vector<cv::Point2f> keypoints2,
@@ -340,37 +650,20 @@ void SurfKeypointDetector::surf_grid_keypoints_matcher(
     std::vector<cv::Point2f>& out_keypoints2,
     std::vector<cv::DMatch>& out_matches)
 {
-    int match_index1 = 0;
-    int match_index2 = 0;
+    if (in_keypoints1.empty()) {
+        return;
+    }
 
-    float max_area = 0.0f;
+    std::vector<cv::Point2i> rounded_keypoints1(in_keypoints1.size());
     for (size_t i = 0; i < in_keypoints1.size(); i++) {
-        cv::Point2i p1, p2, p3;
-        float area = 0;
-        p1.x = int(round(in_keypoints1[i].x));
-        p1.y = int(round(in_keypoints1[i].y));
-
-        for (size_t j = 0; j < in_keypoints1.size(); j++) {
-            p2.x = int(round(in_keypoints1[j].x));
-            p2.y = int(round(in_keypoints1[j].y));
-
-            if (p2.x > p1.x) {
-                p3.x = p2.x;
-                p3.y = p1.y;
-            } else {
-                p3.x = p1.x;
-                p3.y = p2.y;
-            }
-
-            area = std::sqrt(std::pow(p1.x - p3.x, 2.0f) + std::pow(p1.y - p3.y, 2.0f)) * std::sqrt(std::pow(p2.x - p3.x, 2.0f) + std::pow(p2.y - p3.y, 2.0f));
-            if (area > max_area) {
-                max_area = area;
-                match_index1 = i;
-                match_index2 = j;
-            }
-        }
+        rounded_keypoints1[i].x = int(round(in_keypoints1[i].x));
+        rounded_keypoints1[i].y = int(round(in_keypoints1[i].y));
     }
 
+    const std::pair<int, int> widest_pair = widest_keypoints_pair(rounded_keypoints1);
+    const int match_index1 = widest_pair.first;
+    const int match_index2 = widest_pair.second;
+
     cv::Point2i p1;
     p1.x = int(round(in_keypoints1[match_index1].x));
     p1.y = int(round(in_keypoints1[match_index1].y));
@@ -0,0 +1,81 @@
+#ifndef KEYPOINT_BUDGET_H
+#define KEYPOINT_BUDGET_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+
+/** \brief Number of SURF correspondences a pair keeps after the rejection filters,
+  * OPENCV_KEYPOINT_DETECTION_SETTINGS/BUDGET_*. Every rejected pair of a chain reports how many of its
+  * correspondences survived sample consensus, and the budget of the chain moves towards the size that leaves
+  * BUDGET_TARGET_INLIERS at the recent inlier ratio, so sample consensus and ICP cost stays bounded.
+  */
+namespace keypoint_budget
+{
+
+bool enabled();
+
+/** \brief What a pair reports to its chain, 0 budgeted when the budget is disabled. */
+struct Report {
+    size_t budgeted;
+    size_t inliers;
+
+    Report()
+        : budgeted(0)
+        , inliers(0)
+    {
+    }
+};
+
+/** \brief Budget of the pairs of one chain or loop. The pairs may run on any thread, their reports are
+  * applied in pair order once every pair before them has reported, so a pair is budgeted by the pairs before
+  * it in the chain and never by the pairs of another chain.
+  */
+class Chain {
+public:
+    Chain();
+
+    Chain(const Chain&) = delete;
+    Chain& operator=(const Chain&) = delete;
+
+    /** \brief Current budget, within [BUDGET_MIN; BUDGET_MAX], BUDGET_MAX before the first report. */
+    size_t size() const;
+
+    /** \brief budgeted correspondences of pair_index went into rejection, inliers came out. A pair read from the
+      * pair result cache reports the counts stored with it, so warm runs adapt as cold ones.
+      */
+    void report(const size_t& pair_index, const Report& pair_report);
+
+    /** \brief Back to BUDGET_MAX and to the first pair, at the start of a run. */
+    void reset();
+
+private:
+    mutable std::mutex mutex;
+    float current_size;
+    size_t next_pair;
+    /** \brief Reports of the pairs after next_pair, budgeted and inliers. */
+    std::map<size_t, std::pair<size_t, size_t> > pending;
+
+    void apply(const size_t& budgeted, const size_t& inliers);
+};
+
+/** \brief Budget of the pair the calling thread detects, BUDGET_MAX outside a Scope. */
+size_t size();
+
+/** \brief Sets the budget of the calling thread for its lifetime, scopes nest. */
+class Scope {
+public:
+    explicit Scope(const size_t& size);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const size_t previous;
+};
+
+} // namespace keypoint_budget
+
+#endif // KEYPOINT_BUDGET_H
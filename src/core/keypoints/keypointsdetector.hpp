@@ -24,9 +24,7 @@ public:
         KeypointsFrame result;
 
         DetectionMethod detector(
-            this, settings,
-            frame1.pointCloudPtr, frame2.pointCloudPtr,
-            frame1.pointCloudImage, frame2.pointCloudImage,
+            this, settings, frame1, frame2,
             result.keypointsPcdPair.first, result.keypointsPcdPair.second);
         detector.detect();
 
@@ -35,6 +33,7 @@ public:
                 i, i, pcl::euclideanDistance(
                           (*result.keypointsPcdPair.first)[i], (*result.keypointsPcdPair.second)[i])));
         }
+        result.track();
 
         return result;
     }
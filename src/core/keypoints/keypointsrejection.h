@@ -25,6 +25,7 @@ private:
     double inlier_threshold;
     int max_iter;
     int min_idsac_threshold;
+    bool rigid_sac;
 
     void perform_rejection(
         KeypointsFrames& in_keypointsFrames,
@@ -38,6 +39,10 @@ private:
         KeypointsFrame& keypointsFrame,
         std::vector<int>& exclude_indexes);
 
+    void incremental_idsac_rejection(
+        KeypointsFrame& keypointsFrame,
+        std::vector<int>& exclude_indexes);
+
     void calculate_sac(
         const PcdPtr& input_point_cloud_ptr,
         const PcdPtr& target_point_cloud_ptr,
@@ -47,6 +52,15 @@ private:
         pcl::Correspondences& out_inliers,
         Eigen::Matrix4f& out_transformation_matrix);
 
+    void calculate_rigid_sac(
+        const PcdPtr& input_point_cloud_ptr,
+        const PcdPtr& target_point_cloud_ptr,
+        const pcl::Correspondences& correspondences,
+        const double& inlier_threshold,
+        const int& max_iter,
+        pcl::Correspondences& out_inliers,
+        Eigen::Matrix4f& out_transformation_matrix);
+
     void update_clouds(
         const PcdPtr& in_input_point_cloud_ptr1,
         const PcdPtr& in_traget_point_cloud_ptr2,
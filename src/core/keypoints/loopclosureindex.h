@@ -0,0 +1,36 @@
+#ifndef LOOP_CLOSURE_INDEX_H
+#define LOOP_CLOSURE_INDEX_H
+
+#include "core/keypoints/bowvocabulary.h"
+
+#include <utility>
+#include <vector>
+
+/** \brief Place recognition over bag of words vectors. An inverted file lists the frames of every
+  * word, so a query only scores frames sharing a word with it instead of every frame added.
+  * Scores are the L1 similarity 1 - |a - b| / 2 of the normalized vectors, in [0, 1].
+  */
+class LoopClosureIndex {
+public:
+    /** \brief Frame id and score, best first. */
+    typedef std::vector<std::pair<int, double> > Candidates;
+
+    explicit LoopClosureIndex(const BowVocabulary::Ptr& vocabulary);
+
+    void add(const int& frame_id, const cv::Mat& descriptors);
+
+    /** \brief At most max_candidates frames scoring at least min_score, ids above max_frame_id are skipped. */
+    Candidates query(const cv::Mat& descriptors, const int& max_frame_id,
+        const size_t& max_candidates, const double& min_score) const;
+
+    size_t size() const;
+
+private:
+    const BowVocabulary::Ptr vocabulary;
+
+    std::vector<int> frame_ids;
+    /** \brief Per word, the frames holding it and the word's weight in them. */
+    std::vector<std::vector<std::pair<int, double> > > inverted_file;
+};
+
+#endif // LOOP_CLOSURE_INDEX_H
@@ -0,0 +1,31 @@
+#ifndef ORBKEYPOINTDETECTOR_H
+#define ORBKEYPOINTDETECTOR_H
+
+#include "core/keypoints/surfkeypointdetector.h"
+
+/** \brief ORB keypoints with binary descriptors matched by Hamming distance,
+  * the y amplitude, NaN, flat area and grid filters are shared with SURF.
+  */
+class OrbKeypointDetector : public SurfKeypointDetector {
+    Q_OBJECT
+
+public:
+    OrbKeypointDetector(
+        QObject* parent, QSettings* parent_settings,
+        const Frame& frame1, const Frame& frame2,
+        PcdPtr keypoint_cloud_ptr1, PcdPtr keypoint_cloud_ptr2);
+
+protected:
+    QString feature_name() const override;
+    uint64_t feature_parameters_hash() const override;
+    FeatureStore::Features extract_features(const cv::Mat& image) const override;
+    void match_features(
+        const FeatureStore::Features& features1,
+        const FeatureStore::Features& features2,
+        std::vector<cv::DMatch>& matches) const override;
+    void select_good_matches(
+        const std::vector<cv::DMatch>& matches,
+        std::vector<cv::DMatch>& good_matches) const override;
+};
+
+#endif // ORBKEYPOINTDETECTOR_H
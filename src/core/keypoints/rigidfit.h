@@ -0,0 +1,32 @@
+#ifndef RIGID_FIT_H
+#define RIGID_FIT_H
+
+#include <Eigen/Core>
+
+#include <cstddef>
+
+/** \brief Least squares rigid transform of point pairs kept as running sums, so pairs
+  * can be added and removed in constant time and the fit is one 3x3 SVD away.
+  */
+class RigidFit {
+public:
+    RigidFit();
+
+    void add(const Eigen::Vector3f& source, const Eigen::Vector3f& target, const double& weight = 1.0);
+
+    void remove(const Eigen::Vector3f& source, const Eigen::Vector3f& target, const double& weight = 1.0);
+
+    /** \brief Source to target transform, identity with less than three pairs or no weight. */
+    Eigen::Matrix4f transformation() const;
+
+    size_t size() const;
+
+private:
+    size_t count;
+    double weight_sum;
+    Eigen::Vector3d source_sum;
+    Eigen::Vector3d target_sum;
+    Eigen::Matrix3d cross_sum;
+};
+
+#endif // RIGID_FIT_H
@@ -0,0 +1,54 @@
+#ifndef RIGID_SAMPLE_CONSENSUS_H
+#define RIGID_SAMPLE_CONSENSUS_H
+
+#include <Eigen/Core>
+
+#include "core/keypoints/inlierkernel.h"
+
+#include <cstdint>
+#include <vector>
+
+/** \brief RANSAC for the rigid transform between two sets of corresponding 3d points.
+  * Samples are drawn PROSAC style from a growing prefix of the correspondences, so they
+  * are expected best first. The iteration count adapts to the best inlier ratio, hypotheses
+  * stop being scored once they can't beat the best one and a fixed seed gives a fixed result.
+  */
+class RigidSampleConsensus {
+public:
+    struct Parameters {
+        double inlier_threshold;
+        int max_iterations;
+        double confidence;
+        int preemption_block;
+        bool prosac;
+        bool refine;
+        uint32_t seed;
+    };
+
+    explicit RigidSampleConsensus(const Parameters& parameters);
+
+    /** \brief source[i] corresponds to target[i], returns inliers indexes and the source to target transform.
+      * Returns false with identity transform when no hypothesis could be built.
+      */
+    bool estimate(
+        const std::vector<Eigen::Vector3f>& source,
+        const std::vector<Eigen::Vector3f>& target,
+        std::vector<int>& inliers,
+        Eigen::Matrix4f& transformation);
+
+    int getIterations() const;
+
+private:
+    const Parameters parameters;
+    int iterations;
+
+    size_t count_inliers(
+        const inlier_kernel::Points& source,
+        const inlier_kernel::Points& target,
+        const Eigen::Matrix4f& transformation,
+        const size_t& best_count) const;
+
+    int required_iterations(const size_t& inliers_count, const size_t& points_count) const;
+};
+
+#endif // RIGID_SAMPLE_CONSENSUS_H
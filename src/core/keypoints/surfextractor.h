@@ -0,0 +1,44 @@
+#ifndef SURF_EXTRACTOR_H
+#define SURF_EXTRACTOR_H
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+
+/** \brief SURF keypoints and descriptors of a colour image, always in full resolution coordinates with
+  * 64 float descriptors, whichever backend computes them.
+  */
+class SurfExtractor {
+public:
+    enum Backend {
+        CPU,
+        //CUDA SURF, CPU when OpenCV has no gpu module or there is no CUDA device
+        GPU,
+        //Detection on a pyrDown level, locations refined and descriptors computed at full resolution
+        PYRAMID
+    };
+
+    SurfExtractor(const Backend& backend, const double& hessian_threshold, const int& pyramid_levels);
+
+    void extract(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const;
+
+    /** \brief CPU, GPU or PYRAMID, CPU for anything else. */
+    static Backend backendFromString(const std::string& backend);
+
+    static bool gpuAvailable();
+
+private:
+    const Backend backend;
+    const double hessian_threshold;
+    const int pyramid_levels;
+
+    void extract_cpu(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const;
+    bool extract_gpu(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const;
+    void extract_pyramid(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) const;
+
+    /** \brief Moves every keypoint to the sub pixel maximum of the Hessian determinant within radius. */
+    static void refine_locations(const cv::Mat& gray, const int& radius, std::vector<cv::KeyPoint>& keypoints);
+};
+
+#endif // SURF_EXTRACTOR_H
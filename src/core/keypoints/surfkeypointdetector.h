@@ -12,6 +12,10 @@
 #include "opencv2/stitching/stitcher.hpp"
 
 #include <core/base/scannertypes.h>
+#include "core/keypoints/depthintegral.h"
+#include "core/keypoints/featurestore.h"
+
+#include <memory>
 
 class SurfKeypointDetector : public ScannerBase {
     Q_OBJECT
@@ -22,10 +26,32 @@ public:
         PcdPtr cloud_ptr1, PcdPtr cloud_ptr2,
         cv::Mat img1, cv::Mat img2,
         PcdPtr keypoint_cloud_ptr1, PcdPtr keypoint_cloud_ptr2);
+    /** \brief Features of frames read from a project are taken from the FeatureStore. */
+    SurfKeypointDetector(
+        QObject* parent, QSettings* parent_settings,
+        const Frame& frame1, const Frame& frame2,
+        PcdPtr keypoint_cloud_ptr1, PcdPtr keypoint_cloud_ptr2);
 
     void detect();
+
+    /** \brief Features of the first frame only, through the FeatureStore like in detect(). */
+    FeatureStore::Features getFirstFrameFeatures();
+
     void getMatchImagesVector(std::vector<cv::Mat>* matchImagesVector);
 
+protected:
+    /** \brief Detector specific part, the matching and rejection around it is shared. */
+    virtual QString feature_name() const;
+    virtual uint64_t feature_parameters_hash() const;
+    virtual FeatureStore::Features extract_features(const cv::Mat& image) const;
+    virtual void match_features(
+        const FeatureStore::Features& features1,
+        const FeatureStore::Features& features2,
+        std::vector<cv::DMatch>& matches) const;
+    virtual void select_good_matches(
+        const std::vector<cv::DMatch>& matches,
+        std::vector<cv::DMatch>& good_matches) const;
+
 private:
     PcdPtr _point_cloud_ptr1;
     PcdPtr _point_cloud_ptr2;
@@ -33,12 +59,24 @@ private:
     cv::Mat image2;
     PcdPtr keypoint_point_cloud_ptr1;
     PcdPtr keypoint_point_cloud_ptr2;
+    QString source_id1;
+    QString source_id2;
+    int frame_index1;
+    int frame_index2;
+    /** \brief Of the frames given, null for the clouds and images given. */
+    FrameDerivedDataPtr derived_data1;
+    FrameDerivedDataPtr derived_data2;
 
     std::vector<cv::Mat> afterThreshNanMatchesImagesVector;
 
+    /** \brief Built on the first flat filter pass and shared by all its iterations. */
+    std::unique_ptr<DepthIntegral> depth_integral1;
+    std::unique_ptr<DepthIntegral> depth_integral2;
+
     //-------------------------------------------------------
 
     bool flat_area_keypoints_filter_threshold_check(
+        const DepthIntegral& depth_integral,
         PcdPtr point_cloud_ptr,
         int x, int y,
         int radius,
@@ -53,6 +91,17 @@ private:
 
     //-------------------------------------------------------
 
+    void knn_ratio_match(
+        const FeatureStore::Features& features1,
+        const FeatureStore::Features& features2,
+        std::vector<cv::DMatch>& matches) const;
+
+    /** \brief From the FeatureStore, or for a frame without a source from its derived data, so a frame
+      * matched again, as the streamed keyframe, is only extracted once.
+      */
+    FeatureStore::Features surf_frame_features(const QString& source_id, const int& frame_index,
+        const cv::Mat& image, const PcdPtr& cloud, const FrameDerivedDataPtr& derived_data);
+
     void perform_detection();
 
     void surf_detect_keypoints(
@@ -70,6 +119,16 @@ private:
         std::vector<cv::Point2f>& out_keypoints2,
         std::vector<cv::DMatch>& out_matches);
 
+    /** \brief Keeps keypoint_budget::size() of the matches, ranked by descriptor distance and response and taken
+      * round robin over the GRID_KEYPOINT_FILTER cells of the first image, so they stay spread over it.
+      * The budget is the one of the pair's chain, the kept matches keep their order.
+      */
+    void surf_budget_keypoints(
+        const std::vector<cv::KeyPoint>& _keypoints1,
+        std::vector<cv::Point2f>& keypoints1,
+        std::vector<cv::Point2f>& keypoints2,
+        std::vector<cv::DMatch>& matches);
+
     void surf_remove_nan_from_keypoints(
         std::vector<cv::Point2f> keypoints1,
         std::vector<cv::Point2f> keypoints2,
@@ -0,0 +1,98 @@
+#ifndef GPU_VOXEL_HASH_KERNELS_H
+#define GPU_VOXEL_HASH_KERNELS_H
+
+#include <cstdint>
+#include <vector>
+
+#ifdef __CUDACC__
+#define GPU_VOXEL_HASH_FUNCTION __host__ __device__
+#else
+#define GPU_VOXEL_HASH_FUNCTION
+#endif
+
+/** \brief CUDA kernels of GpuVoxelHashVolume, in plain types so the kernels build without PCL, OpenCV
+  * and Eigen. Blocks and voxels have the layout of VoxelHashVolume, the blocks are one flat array in
+  * block index order and found through an open addressing table of their block keys.
+  */
+namespace gpu_voxel_hash
+{
+
+const int BLOCK_SIZE = 8;
+const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+const unsigned long long EMPTY_KEY = ~0ull;
+
+#pragma pack(push, 1)
+struct Voxel {
+    uint16_t tsdf;
+    uint8_t weight;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+#pragma pack(pop)
+
+struct Block {
+    Voxel voxels[BLOCK_VOXELS];
+};
+
+/** \brief Device pointers: voxels and x, y, z of every block, and the table of table_mask + 1 entries. */
+struct Volume {
+    Block* blocks;
+    const int* coordinates;
+    const unsigned long long* keys;
+    const uint32_t* values;
+    uint32_t table_mask;
+    float voxel_size;
+    float truncation_distance;
+    int max_weight;
+};
+
+/** \brief Row major rotation and translation of a rigid transformation, and the pinhole model. */
+struct Camera {
+    float rotation[9];
+    float translation[3];
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+    int width;
+    int height;
+};
+
+/** \brief Same key as VoxelHashVolume::block_key. */
+GPU_VOXEL_HASH_FUNCTION inline unsigned long long blockKey(const int& x, const int& y, const int& z)
+{
+    return (unsigned long long)((x + (1 << 20)) & 0x1FFFFF) | ((unsigned long long)((y + (1 << 20)) & 0x1FFFFF) << 21)
+        | ((unsigned long long)((z + (1 << 20)) & 0x1FFFFF) << 42);
+}
+
+/** \brief First entry probed for the key, linearly onwards. */
+GPU_VOXEL_HASH_FUNCTION inline uint32_t tableSlot(const unsigned long long& key, const uint32_t& table_mask)
+{
+    return uint32_t((key * 0x9E3779B97F4A7C15ull) >> 32) & table_mask;
+}
+
+/** \brief pcl::edgeTable and pcl::triTable, copied to constant memory once. */
+void setTables(const int* edge_table, const int (*tri_table)[16]);
+
+/** \brief Integrates the frame into the listed blocks, one thread per voxel, as VoxelHashVolume::integrate_block.
+  * depth is CV_32FC1 and color BGR bytes, both contiguous, camera is world to camera.
+  */
+void integrate(const Volume& volume, const uint32_t* blocks, const uint32_t& count, const float* depth,
+    const uint8_t* color, const Camera& camera, void* stream);
+
+/** \brief One thread per pixel, as VoxelHashVolume::raycast, camera is camera to world. Three floats per
+  * pixel of points and normals, NaN where no surface is found.
+  */
+void raycast(const Volume& volume, const Camera& camera, const float& max_depth, float* points, float* normals,
+    void* stream);
+
+/** \brief Marching cubes of the blocks [0, blocks_count), one thread per cube, as VoxelHashVolume::extract_block.
+  * Three corners per triangle in block and cube order: positions, RGB and the voxel edge key of every corner.
+  */
+void extractMesh(const Volume& volume, const uint32_t& blocks_count, const int& min_weight,
+    std::vector<float>& positions, std::vector<uint8_t>& colors, std::vector<unsigned long long>& edges, void* stream);
+
+} // namespace gpu_voxel_hash
+
+#endif // GPU_VOXEL_HASH_KERNELS_H
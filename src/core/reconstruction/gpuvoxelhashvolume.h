@@ -0,0 +1,63 @@
+#ifndef GPU_VOXEL_HASH_VOLUME_H
+#define GPU_VOXEL_HASH_VOLUME_H
+
+#include <memory>
+
+#include "core/reconstruction/voxelhashvolume.h"
+
+/** \brief VoxelHashVolume whose frames are integrated, raycast and meshed on a CUDA device. The blocks
+  * are allocated and indexed here as on the CPU, the device keeps a copy of the voxels in one flat array
+  * in block index order with a table of the block keys. Frames of a batch are uploaded through two pinned
+  * buffers on a copy stream, the next frame is copied while the previous one is integrated.
+  * Needs a build with ROOM_SCANNER_CUDA and no memory budget, the host voxels are only updated by
+  * downloadBlocks, and host writes reach the device through uploadBlocks.
+  */
+class GpuVoxelHashVolume : public VoxelHashVolume {
+public:
+    typedef std::shared_ptr<GpuVoxelHashVolume> Ptr;
+
+    /** \brief Throws std::runtime_error when !available(). */
+    GpuVoxelHashVolume(const float& voxel_size, const float& truncation_distance, const int& max_weight);
+
+    ~GpuVoxelHashVolume();
+
+    /** \brief Built with CUDA and a device is present. */
+    static bool available();
+
+    /** \brief integrateDepths on the device, the blocks of the frames are allocated on the host first. */
+    void integrateDepthsOnDevice(const std::vector<cv::Mat>& depths, const std::vector<cv::Mat>& colors,
+        const std::vector<CameraIntrinsics>& intrinsics, const Matrix4fVector& poses);
+
+    /** \brief raycast on the device. */
+    void raycastOnDevice(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose, const float& max_depth,
+        std::vector<Eigen::Vector3f>& points, std::vector<Eigen::Vector3f>& normals);
+
+    /** \brief extractMesh on the device, the vertices are merged on their voxel edges here. */
+    void extractMeshOnDevice(pcl::PolygonMesh& mesh, const int& min_weight);
+
+    /** \brief Copies the device voxels to the host blocks when they were integrated since the last copy,
+      * before the volume is saved, merged or meshed on the host.
+      */
+    void downloadBlocks();
+
+    /** \brief Copies every host block to the device, after the host volume was loaded or merged into. */
+    void uploadBlocks();
+
+    /** \brief Device voxels, block table and frame buffers. */
+    void deviceMemoryReport(MemoryReport& report) const;
+
+private:
+    struct DeviceState;
+    std::unique_ptr<DeviceState> device;
+
+    /** \brief Blocks whose voxels are on the device, in index order, and whether the host ones are older. */
+    size_t uploaded_blocks;
+    bool host_stale;
+
+    /** \brief Grows the device arrays to every allocated block and copies the new blocks and keys. */
+    void upload_new_blocks();
+
+    void upload_range(const size_t& begin, const size_t& end);
+};
+
+#endif // GPU_VOXEL_HASH_VOLUME_H
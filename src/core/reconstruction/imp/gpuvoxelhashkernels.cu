@@ -0,0 +1,550 @@
+#include "core/reconstruction/gpuvoxelhashkernels.h"
+
+#include <cuda_runtime.h>
+#include <thrust/device_ptr.h>
+#include <thrust/execution_policy.h>
+#include <thrust/scan.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace gpu_voxel_hash
+{
+
+namespace {
+
+__constant__ int edge_table[256];
+__constant__ int tri_table[256][16];
+
+//Cube layout of marching_cubes_tables
+__constant__ int corner_offsets[8][3] = {
+    { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 },
+    { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 }
+};
+__constant__ int edge_corners[12][2] = {
+    { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+    { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+};
+
+//Cubes of the marching cubes counts kept on the device at once
+const uint32_t CHUNK_BLOCKS = 16384;
+
+void check(const cudaError_t& error, const char* where)
+{
+    if (error != cudaSuccess) {
+        throw std::runtime_error(std::string(where) + " " + cudaGetErrorString(error));
+    }
+}
+
+/** \brief half_float::toFloat and half_float::fromFloat, so both backends store the same bits. */
+__device__ float to_float(const uint16_t& value)
+{
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        bits = sign;
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    return __uint_as_float(bits);
+}
+
+__device__ uint16_t from_float(const float& value)
+{
+    const uint32_t bits = __float_as_uint(value);
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t exponent = (bits >> 23) & 0xFF;
+    const uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) {
+        return uint16_t(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    }
+
+    const int half_exponent = int(exponent) - 127 + 15;
+    if (half_exponent >= 0x1F) {
+        return uint16_t(sign | 0x7C00);
+    }
+    if (half_exponent <= 0) {
+        return uint16_t(sign);
+    }
+
+    uint32_t half = sign | (uint32_t(half_exponent) << 10) | (mantissa >> 13);
+    const uint32_t dropped = mantissa & 0x1FFF;
+    if (dropped > 0x1000 || (dropped == 0x1000 && (half & 1))) {
+        ++half;
+    }
+
+    return uint16_t(half);
+}
+
+__device__ int floor_div(const int& value, const int& divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+__device__ float3 transform(const float* rotation, const float* translation, const float3& point)
+{
+    return make_float3(rotation[0] * point.x + rotation[1] * point.y + rotation[2] * point.z + translation[0],
+        rotation[3] * point.x + rotation[4] * point.y + rotation[5] * point.z + translation[1],
+        rotation[6] * point.x + rotation[7] * point.y + rotation[8] * point.z + translation[2]);
+}
+
+__device__ float3 along(const float3& origin, const float3& ray, const float& t)
+{
+    return make_float3(origin.x + ray.x * t, origin.y + ray.y * t, origin.z + ray.z * t);
+}
+
+/** \brief -1 when the block is not allocated. */
+__device__ int find_block(const Volume& volume, const int& x, const int& y, const int& z)
+{
+    const unsigned long long key = blockKey(x, y, z);
+    for (uint32_t slot = tableSlot(key, volume.table_mask);; slot = (slot + 1) & volume.table_mask) {
+        const unsigned long long found = volume.keys[slot];
+        if (found == key) {
+            return int(volume.values[slot]);
+        }
+        if (found == EMPTY_KEY) {
+            return -1;
+        }
+    }
+}
+
+__device__ const Voxel* find_voxel(const Volume& volume, const int& x, const int& y, const int& z)
+{
+    const int bx = floor_div(x, BLOCK_SIZE);
+    const int by = floor_div(y, BLOCK_SIZE);
+    const int bz = floor_div(z, BLOCK_SIZE);
+    const int index = find_block(volume, bx, by, bz);
+    if (index < 0) {
+        return nullptr;
+    }
+
+    const int lx = x - bx * BLOCK_SIZE;
+    const int ly = y - by * BLOCK_SIZE;
+    const int lz = z - bz * BLOCK_SIZE;
+    return &volume.blocks[index].voxels[lx + BLOCK_SIZE * (ly + BLOCK_SIZE * lz)];
+}
+
+__device__ bool interpolate_tsdf(const Volume& volume, const float3& point, float& tsdf)
+{
+    const float gx = point.x / volume.voxel_size - 0.5f;
+    const float gy = point.y / volume.voxel_size - 0.5f;
+    const float gz = point.z / volume.voxel_size - 0.5f;
+    const int bx = int(floorf(gx));
+    const int by = int(floorf(gy));
+    const int bz = int(floorf(gz));
+    const float fx = gx - float(bx);
+    const float fy = gy - float(by);
+    const float fz = gz - float(bz);
+
+    tsdf = 0;
+    for (int c = 0; c < 8; ++c) {
+        const int* offset = corner_offsets[c];
+        const Voxel* voxel = find_voxel(volume, bx + offset[0], by + offset[1], bz + offset[2]);
+        if (!voxel || voxel->weight == 0) {
+            return false;
+        }
+
+        const float weight = (offset[0] ? fx : 1.0f - fx) * (offset[1] ? fy : 1.0f - fy) * (offset[2] ? fz : 1.0f - fz);
+        tsdf += weight * to_float(voxel->tsdf);
+    }
+
+    return true;
+}
+
+/** \brief VoxelHashVolume::march_ray. */
+__device__ bool march_ray(const Volume& volume, const float3& origin, const float3& ray, const float& max_depth,
+    float& depth)
+{
+    const float length = sqrtf(ray.x * ray.x + ray.y * ray.y + ray.z * ray.z);
+    const float voxel_step = volume.voxel_size / length;
+    const float block_extent = float(BLOCK_SIZE) * volume.voxel_size;
+    const float origins[3] = { origin.x, origin.y, origin.z };
+    const float rays[3] = { ray.x, ray.y, ray.z };
+
+    float previous_depth = 0;
+    float previous_tsdf = 0;
+    bool has_previous = false;
+    for (float t = 0; t < max_depth;) {
+        const float3 point = along(origin, ray, t);
+        const int voxel[3] = { int(floorf(point.x / volume.voxel_size)), int(floorf(point.y / volume.voxel_size)),
+            int(floorf(point.z / volume.voxel_size)) };
+        const Voxel* found = find_voxel(volume, voxel[0], voxel[1], voxel[2]);
+        if (!found) {
+            float exit = 3.402823466e+38f;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (rays[axis] != 0) {
+                    const float low = float(floor_div(voxel[axis], BLOCK_SIZE)) * block_extent;
+                    const float side = rays[axis] > 0 ? low + block_extent : low;
+                    exit = fminf(exit, (side - origins[axis]) / rays[axis]);
+                }
+            }
+            t = fmaxf(t + 0.01f * voxel_step, exit + 0.01f * voxel_step);
+            has_previous = false;
+            continue;
+        }
+        if (found->weight == 0) {
+            t += voxel_step;
+            has_previous = false;
+            continue;
+        }
+
+        const float tsdf = to_float(found->tsdf);
+        if (has_previous && previous_tsdf > 0 && tsdf <= 0) {
+            float front, back;
+            if (interpolate_tsdf(volume, along(origin, ray, previous_depth), front)
+                && interpolate_tsdf(volume, point, back) && front > 0 && back <= 0) {
+                depth = previous_depth + (t - previous_depth) * front / (front - back);
+            } else {
+                depth = previous_depth + (t - previous_depth) * previous_tsdf / (previous_tsdf - tsdf);
+            }
+            return true;
+        }
+        if (has_previous && previous_tsdf < 0 && tsdf > 0) {
+            return false;
+        }
+
+        previous_depth = t;
+        previous_tsdf = tsdf;
+        has_previous = true;
+        t += fmaxf(voxel_step, 0.8f * tsdf * volume.truncation_distance / length);
+    }
+
+    return false;
+}
+
+__global__ void integrate_kernel(const Volume volume, const uint32_t* blocks, const float* depth, const uint8_t* color,
+    const Camera camera)
+{
+    const uint32_t index = blocks[blockIdx.x];
+    const int v = int(threadIdx.x);
+    const int* coordinates = volume.coordinates + 3 * index;
+    const float3 centre = make_float3(
+        (float(coordinates[0] * BLOCK_SIZE + v % BLOCK_SIZE) + 0.5f) * volume.voxel_size,
+        (float(coordinates[1] * BLOCK_SIZE + (v / BLOCK_SIZE) % BLOCK_SIZE) + 0.5f) * volume.voxel_size,
+        (float(coordinates[2] * BLOCK_SIZE + v / (BLOCK_SIZE * BLOCK_SIZE)) + 0.5f) * volume.voxel_size);
+    const float3 point = transform(camera.rotation, camera.translation, centre);
+
+    const float inverse_z = 1.0f / point.z;
+    const float u = camera.fx * point.x * inverse_z + camera.cx + 0.5f;
+    const float w = camera.fy * point.y * inverse_z + camera.cy + 0.5f;
+    if (!(point.z > 0) || !(u >= 0) || !(w >= 0) || u >= camera.width || w >= camera.height) {
+        return;
+    }
+    const int pixel = int(w) * camera.width + int(u);
+    const float measured = depth[pixel];
+    if (!(measured > 0)) {
+        return;
+    }
+
+    const float sdf = measured - point.z;
+    if (sdf < -volume.truncation_distance) {
+        return;
+    }
+    const float tsdf = fminf(1.0f, sdf / volume.truncation_distance);
+    const uint8_t* bgr = color + 3 * pixel;
+
+    Voxel& voxel = volume.blocks[index].voxels[v];
+    const float weight = voxel.weight;
+    const float updated_weight = weight + 1.0f;
+    voxel.tsdf = from_float((to_float(voxel.tsdf) * weight + tsdf) / updated_weight);
+    voxel.r = uint8_t((voxel.r * weight + bgr[2]) / updated_weight + 0.5f);
+    voxel.g = uint8_t((voxel.g * weight + bgr[1]) / updated_weight + 0.5f);
+    voxel.b = uint8_t((voxel.b * weight + bgr[0]) / updated_weight + 0.5f);
+    voxel.weight = uint8_t(min(volume.max_weight, voxel.weight + 1));
+}
+
+__global__ void raycast_kernel(const Volume volume, const Camera camera, const float max_depth, float* points,
+    float* normals)
+{
+    const int u = int(blockIdx.x * blockDim.x + threadIdx.x);
+    const int v = int(blockIdx.y * blockDim.y + threadIdx.y);
+    if (u >= camera.width || v >= camera.height) {
+        return;
+    }
+
+    const float nan = __int_as_float(0x7FC00000);
+    float* point_out = points + 3 * (size_t(v) * camera.width + u);
+    float* normal_out = normals + 3 * (size_t(v) * camera.width + u);
+    for (int i = 0; i < 3; ++i) {
+        point_out[i] = nan;
+        normal_out[i] = nan;
+    }
+
+    const float3 camera_ray = make_float3((float(u) - camera.cx) / camera.fx, (float(v) - camera.cy) / camera.fy, 1.0f);
+    const float zero[3] = { 0, 0, 0 };
+    const float3 ray = transform(camera.rotation, zero, camera_ray);
+    const float3 origin = make_float3(camera.translation[0], camera.translation[1], camera.translation[2]);
+    float depth;
+    if (!march_ray(volume, origin, ray, max_depth, depth)) {
+        return;
+    }
+
+    const float3 point = along(origin, ray, depth);
+    float gradient[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        float3 forward = point, backward = point;
+        (&forward.x)[axis] += volume.voxel_size;
+        (&backward.x)[axis] -= volume.voxel_size;
+        float front, back;
+        if (!interpolate_tsdf(volume, forward, front) || !interpolate_tsdf(volume, backward, back)) {
+            return;
+        }
+        gradient[axis] = front - back;
+    }
+
+    //Back to camera space through the transposed rotation
+    const float* r = camera.rotation;
+    const float normal[3] = { r[0] * gradient[0] + r[3] * gradient[1] + r[6] * gradient[2],
+        r[1] * gradient[0] + r[4] * gradient[1] + r[7] * gradient[2],
+        r[2] * gradient[0] + r[5] * gradient[1] + r[8] * gradient[2] };
+    const float norm = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (!(norm > 0)) {
+        return;
+    }
+
+    point_out[0] = camera_ray.x * depth;
+    point_out[1] = camera_ray.y * depth;
+    point_out[2] = camera_ray.z * depth;
+    for (int i = 0; i < 3; ++i) {
+        normal_out[i] = normal[i] / norm;
+    }
+}
+
+/** \brief Corners of the cube at voxel v of the block, false when a corner is missing, under min_weight
+  * or outside the truncation band, as VoxelHashVolume::extract_block.
+  */
+__device__ bool cube_corners(const Volume& volume, const uint32_t& index, const int& v, const int& min_weight,
+    const Voxel** corners, float* values, int& cube)
+{
+    const Block& block = volume.blocks[index];
+    const int* coordinates = volume.coordinates + 3 * index;
+    const int x = v % BLOCK_SIZE;
+    const int y = (v / BLOCK_SIZE) % BLOCK_SIZE;
+    const int z = v / (BLOCK_SIZE * BLOCK_SIZE);
+
+    cube = 0;
+    for (int c = 0; c < 8; ++c) {
+        const int cx = x + corner_offsets[c][0];
+        const int cy = y + corner_offsets[c][1];
+        const int cz = z + corner_offsets[c][2];
+        corners[c] = cx < BLOCK_SIZE && cy < BLOCK_SIZE && cz < BLOCK_SIZE
+            ? &block.voxels[cx + BLOCK_SIZE * (cy + BLOCK_SIZE * cz)]
+            : find_voxel(volume, coordinates[0] * BLOCK_SIZE + cx, coordinates[1] * BLOCK_SIZE + cy,
+                  coordinates[2] * BLOCK_SIZE + cz);
+        if (!corners[c] || corners[c]->weight < min_weight) {
+            return false;
+        }
+
+        values[c] = to_float(corners[c]->tsdf);
+        if (fabsf(values[c]) >= 1.0f) {
+            return false;
+        }
+        cube |= values[c] < 0 ? 1 << c : 0;
+    }
+
+    return edge_table[cube] != 0;
+}
+
+__global__ void count_kernel(const Volume volume, const uint32_t first_block, const uint32_t blocks_count,
+    const int min_weight, uint32_t* counts)
+{
+    const uint32_t cube_index = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cube_index >= blocks_count * BLOCK_VOXELS) {
+        return;
+    }
+
+    const Voxel* corners[8];
+    float values[8];
+    int cube;
+    uint32_t count = 0;
+    if (cube_corners(volume, first_block + cube_index / BLOCK_VOXELS, int(cube_index % BLOCK_VOXELS), min_weight,
+            corners, values, cube)) {
+        while (count < 16 && tri_table[cube][count] != -1) {
+            ++count;
+        }
+    }
+    counts[cube_index] = count;
+}
+
+/** \brief VoxelHashVolume::edge_key of the edge, origin the voxel of its lower corner. */
+__device__ unsigned long long edge_key(const int& x, const int& y, const int& z, const int& axis)
+{
+    return (unsigned long long)((x + (1 << 19)) & 0xFFFFF) | ((unsigned long long)((y + (1 << 19)) & 0xFFFFF) << 20)
+        | ((unsigned long long)((z + (1 << 19)) & 0xFFFFF) << 40) | ((unsigned long long)axis << 60);
+}
+
+__global__ void write_kernel(const Volume volume, const uint32_t first_block, const uint32_t blocks_count,
+    const int min_weight, const uint32_t* offsets, float* positions, uint8_t* colors, unsigned long long* edges)
+{
+    const uint32_t cube_index = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cube_index >= blocks_count * BLOCK_VOXELS) {
+        return;
+    }
+
+    const uint32_t index = first_block + cube_index / BLOCK_VOXELS;
+    const int v = int(cube_index % BLOCK_VOXELS);
+    const Voxel* corners[8];
+    float values[8];
+    int cube;
+    if (!cube_corners(volume, index, v, min_weight, corners, values, cube)) {
+        return;
+    }
+
+    const int* coordinates = volume.coordinates + 3 * index;
+    const int x = coordinates[0] * BLOCK_SIZE + v % BLOCK_SIZE;
+    const int y = coordinates[1] * BLOCK_SIZE + (v / BLOCK_SIZE) % BLOCK_SIZE;
+    const int z = coordinates[2] * BLOCK_SIZE + v / (BLOCK_SIZE * BLOCK_SIZE);
+    uint32_t out = offsets[cube_index];
+    for (int i = 0; i < 16 && tri_table[cube][i] != -1; ++i, ++out) {
+        const int e = tri_table[cube][i];
+        const int a = edge_corners[e][0];
+        const int b = edge_corners[e][1];
+        const float mu = values[a] == values[b] ? 0.5f : values[a] / (values[a] - values[b]);
+        const Voxel& nearest = *corners[mu < 0.5f ? a : b];
+
+        int axis = 0;
+        while (corner_offsets[a][axis] == corner_offsets[b][axis]) {
+            ++axis;
+        }
+        const int low = corner_offsets[a][axis] < corner_offsets[b][axis] ? a : b;
+        for (int k = 0; k < 3; ++k) {
+            const int base = (k == 0 ? x : k == 1 ? y : z);
+            const float from = (float(base + corner_offsets[a][k]) + 0.5f) * volume.voxel_size;
+            const float to = (float(base + corner_offsets[b][k]) + 0.5f) * volume.voxel_size;
+            positions[3 * out + k] = from + mu * (to - from);
+        }
+        colors[3 * out] = nearest.r;
+        colors[3 * out + 1] = nearest.g;
+        colors[3 * out + 2] = nearest.b;
+        edges[out] = edge_key(x + corner_offsets[low][0], y + corner_offsets[low][1], z + corner_offsets[low][2], axis);
+    }
+}
+
+} // namespace
+
+void setTables(const int* edge_table_, const int (*tri_table_)[16])
+{
+    check(cudaMemcpyToSymbol(edge_table, edge_table_, sizeof(edge_table)), "gpu_voxel_hash::setTables");
+    check(cudaMemcpyToSymbol(tri_table, tri_table_, sizeof(tri_table)), "gpu_voxel_hash::setTables");
+}
+
+void integrate(const Volume& volume, const uint32_t* blocks, const uint32_t& count, const float* depth,
+    const uint8_t* color, const Camera& camera, void* stream)
+{
+    if (count == 0) {
+        return;
+    }
+
+    integrate_kernel<<<count, BLOCK_VOXELS, 0, cudaStream_t(stream)>>>(volume, blocks, depth, color, camera);
+    check(cudaGetLastError(), "gpu_voxel_hash::integrate");
+}
+
+void raycast(const Volume& volume, const Camera& camera, const float& max_depth, float* points, float* normals,
+    void* stream)
+{
+    const dim3 threads(16, 16);
+    const dim3 grid((camera.width + threads.x - 1) / threads.x, (camera.height + threads.y - 1) / threads.y);
+    raycast_kernel<<<grid, threads, 0, cudaStream_t(stream)>>>(volume, camera, max_depth, points, normals);
+    check(cudaGetLastError(), "gpu_voxel_hash::raycast");
+}
+
+/** \brief In chunks of blocks: the triangle corners of every cube are counted, scanned into offsets and
+  * written, so the corners come out in the order of the CPU extraction.
+  */
+void extractMesh(const Volume& volume, const uint32_t& blocks_count, const int& min_weight,
+    std::vector<float>& positions, std::vector<uint8_t>& colors, std::vector<unsigned long long>& edges, void* stream_)
+{
+    const cudaStream_t stream = cudaStream_t(stream_);
+    positions.clear();
+    colors.clear();
+    edges.clear();
+    if (blocks_count == 0) {
+        return;
+    }
+
+    const uint32_t cubes = std::min(blocks_count, CHUNK_BLOCKS) * BLOCK_VOXELS;
+    uint32_t* counts = nullptr;
+    uint32_t* offsets = nullptr;
+    float* chunk_positions = nullptr;
+    uint8_t* chunk_colors = nullptr;
+    unsigned long long* chunk_edges = nullptr;
+    size_t capacity = 0;
+    try {
+        check(cudaMalloc(&counts, cubes * sizeof(uint32_t)), "gpu_voxel_hash::extractMesh");
+        check(cudaMalloc(&offsets, cubes * sizeof(uint32_t)), "gpu_voxel_hash::extractMesh");
+
+        for (uint32_t first = 0; first < blocks_count; first += CHUNK_BLOCKS) {
+            const uint32_t chunk = std::min(CHUNK_BLOCKS, blocks_count - first);
+            const uint32_t chunk_cubes = chunk * BLOCK_VOXELS;
+            const uint32_t threads = 256;
+            const uint32_t grid = (chunk_cubes + threads - 1) / threads;
+            count_kernel<<<grid, threads, 0, stream>>>(volume, first, chunk, min_weight, counts);
+            check(cudaGetLastError(), "gpu_voxel_hash::extractMesh");
+            thrust::exclusive_scan(thrust::cuda::par.on(stream), thrust::device_pointer_cast(counts),
+                thrust::device_pointer_cast(counts + chunk_cubes), thrust::device_pointer_cast(offsets));
+
+            uint32_t last_count = 0, last_offset = 0;
+            check(cudaMemcpyAsync(&last_count, counts + chunk_cubes - 1, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream),
+                "gpu_voxel_hash::extractMesh");
+            check(cudaMemcpyAsync(&last_offset, offsets + chunk_cubes - 1, sizeof(uint32_t), cudaMemcpyDeviceToHost, stream),
+                "gpu_voxel_hash::extractMesh");
+            check(cudaStreamSynchronize(stream), "gpu_voxel_hash::extractMesh");
+            const size_t total = size_t(last_count) + last_offset;
+            if (total == 0) {
+                continue;
+            }
+
+            if (total > capacity) {
+                cudaFree(chunk_positions);
+                cudaFree(chunk_colors);
+                cudaFree(chunk_edges);
+                chunk_positions = nullptr;
+                chunk_colors = nullptr;
+                chunk_edges = nullptr;
+                capacity = total;
+                check(cudaMalloc(&chunk_positions, 3 * capacity * sizeof(float)), "gpu_voxel_hash::extractMesh");
+                check(cudaMalloc(&chunk_colors, 3 * capacity), "gpu_voxel_hash::extractMesh");
+                check(cudaMalloc(&chunk_edges, capacity * sizeof(unsigned long long)), "gpu_voxel_hash::extractMesh");
+            }
+            write_kernel<<<grid, threads, 0, stream>>>(volume, first, chunk, min_weight, offsets, chunk_positions,
+                chunk_colors, chunk_edges);
+            check(cudaGetLastError(), "gpu_voxel_hash::extractMesh");
+
+            const size_t begin = edges.size();
+            positions.resize(3 * (begin + total));
+            colors.resize(3 * (begin + total));
+            edges.resize(begin + total);
+            check(cudaMemcpyAsync(positions.data() + 3 * begin, chunk_positions, 3 * total * sizeof(float),
+                      cudaMemcpyDeviceToHost, stream), "gpu_voxel_hash::extractMesh");
+            check(cudaMemcpyAsync(colors.data() + 3 * begin, chunk_colors, 3 * total, cudaMemcpyDeviceToHost, stream),
+                "gpu_voxel_hash::extractMesh");
+            check(cudaMemcpyAsync(edges.data() + begin, chunk_edges, total * sizeof(unsigned long long),
+                      cudaMemcpyDeviceToHost, stream), "gpu_voxel_hash::extractMesh");
+            check(cudaStreamSynchronize(stream), "gpu_voxel_hash::extractMesh");
+        }
+    } catch (...) {
+        cudaFree(counts);
+        cudaFree(offsets);
+        cudaFree(chunk_positions);
+        cudaFree(chunk_colors);
+        cudaFree(chunk_edges);
+        throw;
+    }
+
+    cudaFree(counts);
+    cudaFree(offsets);
+    cudaFree(chunk_positions);
+    cudaFree(chunk_colors);
+    cudaFree(chunk_edges);
+}
+
+} // namespace gpu_voxel_hash
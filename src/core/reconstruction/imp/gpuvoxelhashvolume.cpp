@@ -0,0 +1,563 @@
+#include "core/reconstruction/gpuvoxelhashvolume.h"
+
+#include <pcl/surface/marching_cubes.h>
+
+#ifdef HAVE_CUDA_TSDF
+#include <cuda_runtime.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "core/reconstruction/gpuvoxelhashkernels.h"
+#include "utility/threadpool.h"
+
+static_assert(sizeof(gpu_voxel_hash::Block) == sizeof(VoxelHashVolume::Block),
+    "gpu_voxel_hash::Block and VoxelHashVolume::Block layouts differ");
+
+#ifdef HAVE_CUDA_TSDF
+
+namespace {
+
+//Smallest block arrays and block table on the device
+const size_t MIN_DEVICE_BLOCKS = 1024;
+
+void check(const cudaError_t& error, const char* where)
+{
+    if (error != cudaSuccess) {
+        throw std::runtime_error(std::string(where) + " " + cudaGetErrorString(error));
+    }
+}
+
+float max_depth(const cv::Mat& depth)
+{
+    float result = 0;
+    for (int v = 0; v < depth.rows; ++v) {
+        const float* row = depth.ptr<float>(v);
+        for (int u = 0; u < depth.cols; ++u) {
+            result = row[u] > result ? row[u] : result;
+        }
+    }
+
+    return result;
+}
+
+gpu_voxel_hash::Camera to_camera(const Eigen::Matrix4f& transformation, const CameraIntrinsics& intrinsics)
+{
+    gpu_voxel_hash::Camera camera;
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            camera.rotation[3 * row + col] = transformation(row, col);
+        }
+        camera.translation[row] = transformation(row, 3);
+    }
+    camera.fx = intrinsics.fx;
+    camera.fy = intrinsics.fy;
+    camera.cx = intrinsics.cx;
+    camera.cy = intrinsics.cy;
+    camera.width = int(intrinsics.width);
+    camera.height = int(intrinsics.height);
+
+    return camera;
+}
+
+} // namespace
+
+/** \brief Device arrays with their capacities, the block table mirrored on the host, and the two
+  * frame buffers: pinned host copies, device images, and the events of their upload and of the
+  * integration reading them.
+  */
+struct GpuVoxelHashVolume::DeviceState {
+    struct FrameBuffer {
+        float* host_depth = nullptr;
+        uint8_t* host_color = nullptr;
+        float* depth = nullptr;
+        uint8_t* color = nullptr;
+        size_t pixels = 0;
+        cudaEvent_t uploaded = nullptr;
+        cudaEvent_t consumed = nullptr;
+    };
+
+    cudaStream_t copy_stream = nullptr;
+    cudaStream_t compute_stream = nullptr;
+
+    gpu_voxel_hash::Block* blocks = nullptr;
+    int* coordinates = nullptr;
+    size_t blocks_capacity = 0;
+
+    unsigned long long* keys = nullptr;
+    uint32_t* values = nullptr;
+    std::vector<unsigned long long> host_keys;
+    std::vector<uint32_t> host_values;
+
+    uint32_t* visible = nullptr;
+    size_t visible_capacity = 0;
+
+    FrameBuffer frames[2];
+
+    float* points = nullptr;
+    float* normals = nullptr;
+    size_t raycast_pixels = 0;
+
+    DeviceState()
+    {
+        check(cudaStreamCreateWithFlags(&copy_stream, cudaStreamNonBlocking), "GpuVoxelHashVolume::DeviceState");
+        check(cudaStreamCreateWithFlags(&compute_stream, cudaStreamNonBlocking), "GpuVoxelHashVolume::DeviceState");
+        for (FrameBuffer& frame : frames) {
+            check(cudaEventCreateWithFlags(&frame.uploaded, cudaEventDisableTiming), "GpuVoxelHashVolume::DeviceState");
+            check(cudaEventCreateWithFlags(&frame.consumed, cudaEventDisableTiming), "GpuVoxelHashVolume::DeviceState");
+        }
+    }
+
+    ~DeviceState()
+    {
+        cudaStreamSynchronize(compute_stream);
+        cudaStreamSynchronize(copy_stream);
+        for (FrameBuffer& frame : frames) {
+            cudaFreeHost(frame.host_depth);
+            cudaFreeHost(frame.host_color);
+            cudaFree(frame.depth);
+            cudaFree(frame.color);
+            cudaEventDestroy(frame.uploaded);
+            cudaEventDestroy(frame.consumed);
+        }
+        cudaFree(blocks);
+        cudaFree(coordinates);
+        cudaFree(keys);
+        cudaFree(values);
+        cudaFree(visible);
+        cudaFree(points);
+        cudaFree(normals);
+        cudaStreamDestroy(copy_stream);
+        cudaStreamDestroy(compute_stream);
+    }
+
+    gpu_voxel_hash::Volume volume(const float& voxel_size, const float& truncation_distance, const int& max_weight) const
+    {
+        gpu_voxel_hash::Volume result;
+        result.blocks = blocks;
+        result.coordinates = coordinates;
+        result.keys = keys;
+        result.values = values;
+        result.table_mask = uint32_t(host_keys.size() - 1);
+        result.voxel_size = voxel_size;
+        result.truncation_distance = truncation_distance;
+        result.max_weight = max_weight;
+        return result;
+    }
+
+    /** \brief Waits for the integration still reading the buffer before it is grown. */
+    void reserve_frame(FrameBuffer& frame, const size_t& pixels)
+    {
+        if (frame.pixels >= pixels) {
+            return;
+        }
+
+        check(cudaEventSynchronize(frame.consumed), "GpuVoxelHashVolume::reserve_frame");
+        cudaFreeHost(frame.host_depth);
+        cudaFreeHost(frame.host_color);
+        cudaFree(frame.depth);
+        cudaFree(frame.color);
+        frame = FrameBuffer { nullptr, nullptr, nullptr, nullptr, 0, frame.uploaded, frame.consumed };
+        check(cudaMallocHost(&frame.host_depth, pixels * sizeof(float)), "GpuVoxelHashVolume::reserve_frame");
+        check(cudaMallocHost(&frame.host_color, 3 * pixels), "GpuVoxelHashVolume::reserve_frame");
+        check(cudaMalloc(&frame.depth, pixels * sizeof(float)), "GpuVoxelHashVolume::reserve_frame");
+        check(cudaMalloc(&frame.color, 3 * pixels), "GpuVoxelHashVolume::reserve_frame");
+        frame.pixels = pixels;
+    }
+
+    void insert_key(const unsigned long long& key, const uint32_t& index)
+    {
+        const uint32_t mask = uint32_t(host_keys.size() - 1);
+        uint32_t slot = gpu_voxel_hash::tableSlot(key, mask);
+        while (host_keys[slot] != gpu_voxel_hash::EMPTY_KEY) {
+            slot = (slot + 1) & mask;
+        }
+        host_keys[slot] = key;
+        host_values[slot] = index;
+    }
+};
+
+GpuVoxelHashVolume::GpuVoxelHashVolume(const float& voxel_size_, const float& truncation_distance_,
+    const int& max_weight_)
+    : VoxelHashVolume(voxel_size_, truncation_distance_, max_weight_)
+    , uploaded_blocks(0)
+    , host_stale(false)
+{
+    if (!available()) {
+        throw std::runtime_error("GpuVoxelHashVolume::GpuVoxelHashVolume no CUDA device");
+    }
+
+    static std::once_flag tables_flag;
+    std::call_once(tables_flag, []() { gpu_voxel_hash::setTables(pcl::edgeTable, pcl::triTable); });
+    device.reset(new DeviceState);
+}
+
+GpuVoxelHashVolume::~GpuVoxelHashVolume()
+{
+}
+
+bool GpuVoxelHashVolume::available()
+{
+    static const bool result = []() {
+        int count = 0;
+        return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+    }();
+    return result;
+}
+
+/** \brief Blocks are allocated and culled to the frustums as on the CPU. Frame i + 1 is copied to its
+  * pinned buffer and uploaded while frame i is integrated, each block gets the frames in frame order.
+  */
+void GpuVoxelHashVolume::integrateDepthsOnDevice(const std::vector<cv::Mat>& depths, const std::vector<cv::Mat>& colors,
+    const std::vector<CameraIntrinsics>& intrinsics, const Matrix4fVector& poses)
+{
+    if (depths.size() != colors.size() || depths.size() != intrinsics.size() || depths.size() != poses.size()) {
+        throw std::invalid_argument("GpuVoxelHashVolume::integrateDepthsOnDevice depths, colors, intrinsics and poses sizes differ");
+    }
+    if (max_resident_blocks > 0) {
+        throw std::invalid_argument("GpuVoxelHashVolume::integrateDepthsOnDevice max_resident_blocks > 0");
+    }
+    for (size_t i = 0; i < depths.size(); ++i) {
+        const cv::Mat& depth = depths[i];
+        if (depth.type() != CV_32FC1 || colors[i].type() != CV_8UC3 || depth.size() != colors[i].size()) {
+            throw std::invalid_argument("GpuVoxelHashVolume::integrateDepthsOnDevice depth is not CV_32FC1 or color is not a CV_8UC3 of its size");
+        }
+        if (!intrinsics[i].isValid() || int(intrinsics[i].width) != depth.cols || int(intrinsics[i].height) != depth.rows) {
+            throw std::invalid_argument("GpuVoxelHashVolume::integrateDepthsOnDevice intrinsics do not match the depth image");
+        }
+    }
+    if (depths.empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < depths.size(); ++i) {
+        allocate_blocks(depths[i], intrinsics[i], poses[i]);
+    }
+
+    Matrix4fVector world_to_camera(depths.size());
+    std::vector<std::vector<uint32_t> > visible(depths.size());
+    ThreadPool::instance().parallel_for(0, depths.size(), [&](size_t i) {
+        world_to_camera[i] = poses[i].inverse();
+        frustum_blocks(intrinsics[i], world_to_camera[i], max_depth(depths[i]), visible[i]);
+    });
+
+    std::vector<uint32_t> offsets(1, 0);
+    std::vector<uint32_t> frame_blocks;
+    for (const std::vector<uint32_t>& blocks_of_frame : visible) {
+        frame_blocks.insert(frame_blocks.end(), blocks_of_frame.begin(), blocks_of_frame.end());
+        offsets.push_back(uint32_t(frame_blocks.size()));
+        for (const uint32_t& block : blocks_of_frame) {
+            dirty_blocks[block] = 1;
+        }
+    }
+
+    upload_new_blocks();
+    if (frame_blocks.size() > device->visible_capacity) {
+        check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::integrateDepthsOnDevice");
+        cudaFree(device->visible);
+        device->visible = nullptr;
+        device->visible_capacity = std::max(frame_blocks.size(), 2 * device->visible_capacity);
+        check(cudaMalloc(&device->visible, device->visible_capacity * sizeof(uint32_t)),
+            "GpuVoxelHashVolume::integrateDepthsOnDevice");
+    }
+    check(cudaMemcpyAsync(device->visible, frame_blocks.data(), frame_blocks.size() * sizeof(uint32_t),
+              cudaMemcpyHostToDevice, device->compute_stream),
+        "GpuVoxelHashVolume::integrateDepthsOnDevice");
+
+    const gpu_voxel_hash::Volume volume = device->volume(voxel_size, truncation_distance, max_weight);
+    for (size_t i = 0; i < depths.size(); ++i) {
+        DeviceState::FrameBuffer& frame = device->frames[i % 2];
+        const cv::Mat& depth = depths[i];
+        const size_t pixels = size_t(depth.rows) * depth.cols;
+        device->reserve_frame(frame, pixels);
+
+        //The integration of frame i - 2 still reads this buffer
+        check(cudaEventSynchronize(frame.consumed), "GpuVoxelHashVolume::integrateDepthsOnDevice");
+        for (int v = 0; v < depth.rows; ++v) {
+            std::memcpy(frame.host_depth + size_t(v) * depth.cols, depth.ptr<float>(v), depth.cols * sizeof(float));
+            std::memcpy(frame.host_color + 3 * size_t(v) * depth.cols, colors[i].ptr<uint8_t>(v), 3 * depth.cols);
+        }
+        check(cudaMemcpyAsync(frame.depth, frame.host_depth, pixels * sizeof(float), cudaMemcpyHostToDevice,
+                  device->copy_stream),
+            "GpuVoxelHashVolume::integrateDepthsOnDevice");
+        check(cudaMemcpyAsync(frame.color, frame.host_color, 3 * pixels, cudaMemcpyHostToDevice, device->copy_stream),
+            "GpuVoxelHashVolume::integrateDepthsOnDevice");
+        check(cudaEventRecord(frame.uploaded, device->copy_stream), "GpuVoxelHashVolume::integrateDepthsOnDevice");
+
+        check(cudaStreamWaitEvent(device->compute_stream, frame.uploaded, 0), "GpuVoxelHashVolume::integrateDepthsOnDevice");
+        gpu_voxel_hash::integrate(volume, device->visible + offsets[i], offsets[i + 1] - offsets[i], frame.depth,
+            frame.color, to_camera(world_to_camera[i], intrinsics[i]), device->compute_stream);
+        check(cudaEventRecord(frame.consumed, device->compute_stream), "GpuVoxelHashVolume::integrateDepthsOnDevice");
+    }
+    check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::integrateDepthsOnDevice");
+
+    last_camera = poses.back().block<3, 1>(0, 3);
+    host_stale = true;
+}
+
+void GpuVoxelHashVolume::raycastOnDevice(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose,
+    const float& max_depth, std::vector<Eigen::Vector3f>& points, std::vector<Eigen::Vector3f>& normals)
+{
+    if (!intrinsics.isValid()) {
+        throw std::invalid_argument("GpuVoxelHashVolume::raycastOnDevice !intrinsics.isValid()");
+    }
+
+    const size_t pixels = size_t(intrinsics.width) * intrinsics.height;
+    points.resize(pixels);
+    normals.resize(pixels);
+    if (block_coordinates.empty()) {
+        const Eigen::Vector3f invalid = Eigen::Vector3f::Constant(std::numeric_limits<float>::quiet_NaN());
+        std::fill(points.begin(), points.end(), invalid);
+        std::fill(normals.begin(), normals.end(), invalid);
+        return;
+    }
+
+    upload_new_blocks();
+    if (pixels > device->raycast_pixels) {
+        check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::raycastOnDevice");
+        cudaFree(device->points);
+        cudaFree(device->normals);
+        device->points = nullptr;
+        device->normals = nullptr;
+        device->raycast_pixels = 0;
+        check(cudaMalloc(&device->points, 3 * pixels * sizeof(float)), "GpuVoxelHashVolume::raycastOnDevice");
+        check(cudaMalloc(&device->normals, 3 * pixels * sizeof(float)), "GpuVoxelHashVolume::raycastOnDevice");
+        device->raycast_pixels = pixels;
+    }
+
+    gpu_voxel_hash::raycast(device->volume(voxel_size, truncation_distance, max_weight), to_camera(pose, intrinsics),
+        max_depth, device->points, device->normals, device->compute_stream);
+
+    //Eigen::Vector3f is three packed floats
+    check(cudaMemcpyAsync(points.data(), device->points, 3 * pixels * sizeof(float), cudaMemcpyDeviceToHost,
+              device->compute_stream),
+        "GpuVoxelHashVolume::raycastOnDevice");
+    check(cudaMemcpyAsync(normals.data(), device->normals, 3 * pixels * sizeof(float), cudaMemcpyDeviceToHost,
+              device->compute_stream),
+        "GpuVoxelHashVolume::raycastOnDevice");
+    check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::raycastOnDevice");
+}
+
+/** \brief The corners come in the order of extractMesh, so the vertex ids are the same. */
+void GpuVoxelHashVolume::extractMeshOnDevice(pcl::PolygonMesh& mesh, const int& min_weight)
+{
+    std::vector<float> positions;
+    std::vector<uint8_t> colors;
+    std::vector<unsigned long long> edges;
+    if (!block_coordinates.empty()) {
+        upload_new_blocks();
+        gpu_voxel_hash::extractMesh(device->volume(voxel_size, truncation_distance, max_weight),
+            uint32_t(uploaded_blocks), min_weight, positions, colors, edges, device->compute_stream);
+    }
+
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> triangles;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    triangles.reserve(edges.size());
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const auto inserted = ids.insert(std::make_pair(uint64_t(edges[i]), uint32_t(vertices.size())));
+        if (inserted.second) {
+            MeshVertex vertex;
+            vertex.position = Eigen::Vector3f(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+            vertex.r = colors[3 * i];
+            vertex.g = colors[3 * i + 1];
+            vertex.b = colors[3 * i + 2];
+            vertices.push_back(vertex);
+        }
+        triangles.push_back(inserted.first->second);
+    }
+
+    to_polygon_mesh(vertices, triangles, mesh);
+}
+
+void GpuVoxelHashVolume::downloadBlocks()
+{
+    if (!host_stale) {
+        return;
+    }
+
+    //Without a memory budget the slot of every block is its index
+    check(cudaMemcpyAsync(blocks.data(), device->blocks, uploaded_blocks * sizeof(Block), cudaMemcpyDeviceToHost,
+              device->compute_stream),
+        "GpuVoxelHashVolume::downloadBlocks");
+    check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::downloadBlocks");
+    host_stale = false;
+}
+
+void GpuVoxelHashVolume::uploadBlocks()
+{
+    if (max_resident_blocks > 0) {
+        throw std::invalid_argument("GpuVoxelHashVolume::uploadBlocks max_resident_blocks > 0");
+    }
+
+    upload_new_blocks();
+    upload_range(0, uploaded_blocks);
+    check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::uploadBlocks");
+    host_stale = false;
+}
+
+void GpuVoxelHashVolume::deviceMemoryReport(MemoryReport& report) const
+{
+    report.add("device blocks", uploaded_blocks, device->blocks_capacity * (sizeof(Block) + 3 * sizeof(int)));
+    report.add("device block table", device->host_keys.size(),
+        device->host_keys.size() * (sizeof(unsigned long long) + sizeof(uint32_t)));
+
+    size_t frame_bytes = device->visible_capacity * sizeof(uint32_t) + device->raycast_pixels * 6 * sizeof(float);
+    for (const DeviceState::FrameBuffer& frame : device->frames) {
+        frame_bytes += frame.pixels * (sizeof(float) + 3);
+    }
+    report.add("device frame buffers", 2, frame_bytes);
+}
+
+/** \brief The arrays at least double when they grow. The table is kept at most half full, it is built
+  * again when it grows, otherwise only the new keys are inserted.
+  */
+void GpuVoxelHashVolume::upload_new_blocks()
+{
+    const size_t count = block_coordinates.size();
+    if (count == uploaded_blocks) {
+        return;
+    }
+
+    if (count > device->blocks_capacity) {
+        const size_t capacity = std::max(count, std::max(MIN_DEVICE_BLOCKS, 2 * device->blocks_capacity));
+        gpu_voxel_hash::Block* grown_blocks = nullptr;
+        int* grown_coordinates = nullptr;
+        check(cudaMalloc(&grown_blocks, capacity * sizeof(gpu_voxel_hash::Block)), "GpuVoxelHashVolume::upload_new_blocks");
+        if (cudaMalloc(&grown_coordinates, 3 * capacity * sizeof(int)) != cudaSuccess) {
+            cudaFree(grown_blocks);
+            throw std::runtime_error("GpuVoxelHashVolume::upload_new_blocks out of device memory");
+        }
+        if (uploaded_blocks > 0) {
+            check(cudaMemcpyAsync(grown_blocks, device->blocks, uploaded_blocks * sizeof(gpu_voxel_hash::Block),
+                      cudaMemcpyDeviceToDevice, device->compute_stream),
+                "GpuVoxelHashVolume::upload_new_blocks");
+            check(cudaMemcpyAsync(grown_coordinates, device->coordinates, 3 * uploaded_blocks * sizeof(int),
+                      cudaMemcpyDeviceToDevice, device->compute_stream),
+                "GpuVoxelHashVolume::upload_new_blocks");
+        }
+        check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::upload_new_blocks");
+        cudaFree(device->blocks);
+        cudaFree(device->coordinates);
+        device->blocks = grown_blocks;
+        device->coordinates = grown_coordinates;
+        device->blocks_capacity = capacity;
+    }
+
+    std::vector<int> coordinates(3 * (count - uploaded_blocks));
+    for (size_t i = uploaded_blocks; i < count; ++i) {
+        const Eigen::Vector3i& block = block_coordinates[i];
+        std::copy(block.data(), block.data() + 3, coordinates.begin() + 3 * (i - uploaded_blocks));
+    }
+    check(cudaMemcpyAsync(device->coordinates + 3 * uploaded_blocks, coordinates.data(), coordinates.size() * sizeof(int),
+              cudaMemcpyHostToDevice, device->compute_stream),
+        "GpuVoxelHashVolume::upload_new_blocks");
+
+    size_t table_size = std::max<size_t>(MIN_DEVICE_BLOCKS, device->host_keys.size());
+    while (table_size < 2 * count) {
+        table_size *= 2;
+    }
+    size_t first_key = uploaded_blocks;
+    if (table_size != device->host_keys.size()) {
+        check(cudaStreamSynchronize(device->compute_stream), "GpuVoxelHashVolume::upload_new_blocks");
+        cudaFree(device->keys);
+        cudaFree(device->values);
+        device->keys = nullptr;
+        device->values = nullptr;
+        device->host_keys.assign(table_size, gpu_voxel_hash::EMPTY_KEY);
+        device->host_values.assign(table_size, 0);
+        check(cudaMalloc(&device->keys, table_size * sizeof(unsigned long long)), "GpuVoxelHashVolume::upload_new_blocks");
+        check(cudaMalloc(&device->values, table_size * sizeof(uint32_t)), "GpuVoxelHashVolume::upload_new_blocks");
+        first_key = 0;
+    }
+    for (size_t i = first_key; i < count; ++i) {
+        const Eigen::Vector3i& block = block_coordinates[i];
+        device->insert_key(gpu_voxel_hash::blockKey(block.x(), block.y(), block.z()), uint32_t(i));
+    }
+    check(cudaMemcpyAsync(device->keys, device->host_keys.data(), table_size * sizeof(unsigned long long),
+              cudaMemcpyHostToDevice, device->compute_stream),
+        "GpuVoxelHashVolume::upload_new_blocks");
+    check(cudaMemcpyAsync(device->values, device->host_values.data(), table_size * sizeof(uint32_t),
+              cudaMemcpyHostToDevice, device->compute_stream),
+        "GpuVoxelHashVolume::upload_new_blocks");
+
+    //New blocks are empty on the host, the older ones may be newer on the device
+    upload_range(uploaded_blocks, count);
+    uploaded_blocks = count;
+}
+
+void GpuVoxelHashVolume::upload_range(const size_t& begin, const size_t& end)
+{
+    if (begin == end) {
+        return;
+    }
+
+    check(cudaMemcpyAsync(device->blocks + begin, blocks.data() + begin, (end - begin) * sizeof(Block),
+              cudaMemcpyHostToDevice, device->compute_stream),
+        "GpuVoxelHashVolume::upload_range");
+}
+
+#else
+
+struct GpuVoxelHashVolume::DeviceState {
+};
+
+GpuVoxelHashVolume::GpuVoxelHashVolume(const float& voxel_size_, const float& truncation_distance_,
+    const int& max_weight_)
+    : VoxelHashVolume(voxel_size_, truncation_distance_, max_weight_)
+    , uploaded_blocks(0)
+    , host_stale(false)
+{
+    throw std::runtime_error("GpuVoxelHashVolume::GpuVoxelHashVolume built without ROOM_SCANNER_CUDA");
+}
+
+GpuVoxelHashVolume::~GpuVoxelHashVolume()
+{
+}
+
+bool GpuVoxelHashVolume::available()
+{
+    return false;
+}
+
+void GpuVoxelHashVolume::integrateDepthsOnDevice(const std::vector<cv::Mat>&, const std::vector<cv::Mat>&,
+    const std::vector<CameraIntrinsics>&, const Matrix4fVector&)
+{
+}
+
+void GpuVoxelHashVolume::raycastOnDevice(const CameraIntrinsics&, const Eigen::Matrix4f&, const float&,
+    std::vector<Eigen::Vector3f>&, std::vector<Eigen::Vector3f>&)
+{
+}
+
+void GpuVoxelHashVolume::extractMeshOnDevice(pcl::PolygonMesh&, const int&)
+{
+}
+
+void GpuVoxelHashVolume::downloadBlocks()
+{
+}
+
+void GpuVoxelHashVolume::uploadBlocks()
+{
+}
+
+void GpuVoxelHashVolume::deviceMemoryReport(MemoryReport&) const
+{
+}
+
+void GpuVoxelHashVolume::upload_new_blocks()
+{
+}
+
+void GpuVoxelHashVolume::upload_range(const size_t&, const size_t&)
+{
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "core/reconstruction/keyframecolorizer.h"
+
+#include <pcl/conversions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "utility/threadpool.h"
+
+KeyframeColorizer::KeyframeColorizer(const float& min_distance_, const float& min_angle, const size_t& max_keyframes_,
+    const float& visibility_depth_)
+    : min_distance(min_distance_)
+    , min_angle_cos(std::cos(min_angle * float(M_PI) / 180.0f))
+    , max_keyframes(max_keyframes_)
+    , visibility_depth(visibility_depth_)
+{
+    if (visibility_depth <= 0) {
+        throw std::invalid_argument("KeyframeColorizer::KeyframeColorizer visibility_depth <= 0");
+    }
+}
+
+void KeyframeColorizer::reset()
+{
+    keyframes.clear();
+}
+
+bool KeyframeColorizer::isKeyframe(const Eigen::Matrix4f& pose) const
+{
+    if (max_keyframes > 0 && keyframes.size() >= max_keyframes) {
+        return false;
+    }
+
+    for (const Keyframe& keyframe : keyframes) {
+        const float distance = (pose.block<3, 1>(0, 3) - keyframe.pose.block<3, 1>(0, 3)).norm();
+        //Cosine of the angle between the orientations
+        const float angle_cos = ((keyframe.pose.block<3, 3>(0, 0).transpose() * pose.block<3, 3>(0, 0)).trace() - 1.0f) / 2.0f;
+        if (distance <= min_distance && angle_cos >= min_angle_cos) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void KeyframeColorizer::addKeyframe(const cv::Mat& depth, const cv::Mat& color, const CameraIntrinsics& intrinsics,
+    const Eigen::Matrix4f& pose)
+{
+    if (depth.type() != CV_32FC1 || color.type() != CV_8UC3 || depth.size() != color.size()) {
+        throw std::invalid_argument("KeyframeColorizer::addKeyframe depth is not CV_32FC1 or color is not CV_8UC3 of its size");
+    }
+
+    Keyframe keyframe;
+    //NaN depth converts to 0, missing like 0 in meters
+    cv::Mat millimeters = depth * 1000.0f;
+    cv::patchNaNs(millimeters, 0);
+    millimeters.convertTo(keyframe.depth, CV_16UC1);
+    keyframe.color = color.clone();
+    keyframe.intrinsics = intrinsics;
+    keyframe.pose = pose;
+
+    //Rigid, so the inverse rotation is the transpose
+    keyframe.world_to_camera = Eigen::Matrix4f::Identity();
+    keyframe.world_to_camera.block<3, 3>(0, 0) = pose.block<3, 3>(0, 0).transpose();
+    keyframe.world_to_camera.block<3, 1>(0, 3) = -pose.block<3, 3>(0, 0).transpose() * pose.block<3, 1>(0, 3);
+
+    keyframes.push_back(keyframe);
+}
+
+void KeyframeColorizer::colorVertices(pcl::PointCloud<pcl::PointXYZRGB>& vertices) const
+{
+    if (keyframes.empty()) {
+        return;
+    }
+
+    ThreadPool::instance().parallel_for(0, vertices.size(), [&](size_t i) {
+        pcl::PointXYZRGB& vertex = vertices.points[i];
+        Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+        float weights = 0;
+        for (const Keyframe& keyframe : keyframes) {
+            Eigen::Vector3f color;
+            float weight;
+            if (observe(keyframe, vertex.getVector3fMap(), color, weight)) {
+                sum += weight * color;
+                weights += weight;
+            }
+        }
+
+        if (weights > 0) {
+            const Eigen::Vector3f color = sum / weights;
+            vertex.r = uint8_t(std::min(255.0f, color.x() + 0.5f));
+            vertex.g = uint8_t(std::min(255.0f, color.y() + 0.5f));
+            vertex.b = uint8_t(std::min(255.0f, color.z() + 0.5f));
+        }
+    });
+}
+
+void KeyframeColorizer::colorMesh(pcl::PolygonMesh& mesh) const
+{
+    pcl::PointCloud<pcl::PointXYZRGB> vertices;
+    pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+    colorVertices(vertices);
+    pcl::toPCLPointCloud2(vertices, mesh.cloud);
+}
+
+size_t KeyframeColorizer::size() const
+{
+    return keyframes.size();
+}
+
+void KeyframeColorizer::memoryReport(MemoryReport& report) const
+{
+    size_t bytes = keyframes.capacity() * sizeof(Keyframe);
+    for (const Keyframe& keyframe : keyframes) {
+        bytes += keyframe.depth.total() * keyframe.depth.elemSize() + keyframe.color.total() * keyframe.color.elemSize();
+    }
+    report.add("colour keyframes", keyframes.size(), bytes);
+}
+
+/** \brief The squared weight of a view falls with the depth and the angle off the optical axis, so the
+  * closest and most central keyframes dominate and the texture stays sharp.
+  */
+bool KeyframeColorizer::observe(const Keyframe& keyframe, const Eigen::Vector3f& point, Eigen::Vector3f& color,
+    float& weight) const
+{
+    const Eigen::Vector3f camera_point = keyframe.world_to_camera.block<3, 3>(0, 0) * point
+        + keyframe.world_to_camera.block<3, 1>(0, 3);
+    float u, v;
+    if (!keyframe.intrinsics.project(camera_point, u, v)) {
+        return false;
+    }
+
+    const int x = std::min(int(u), keyframe.depth.cols - 1);
+    const int y = std::min(int(v), keyframe.depth.rows - 1);
+    const uint16_t depth = keyframe.depth.at<uint16_t>(y, x);
+    if (depth == 0 || std::abs(camera_point.z() - depth * 0.001f) > visibility_depth) {
+        return false;
+    }
+
+    const cv::Vec3b& bgr = keyframe.color.at<cv::Vec3b>(y, x);
+    color = Eigen::Vector3f(bgr[2], bgr[1], bgr[0]);
+    //Cosine off the axis over the squared depth
+    const float view = 1.0f / (camera_point.norm() * camera_point.z());
+    weight = view * view;
+    return true;
+}
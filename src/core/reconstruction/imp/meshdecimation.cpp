@@ -0,0 +1,411 @@
+#include "core/reconstruction/meshdecimation.h"
+
+#include <pcl/conversions.h>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#include "utility/threadpool.h"
+
+namespace {
+
+const uint32_t NO_ID = std::numeric_limits<uint32_t>::max();
+
+/** \brief Cosine of the largest turn of a triangle normal a collapse may cause. */
+const double MIN_NORMAL_COS = 0.5;
+
+/** \brief Optimal placements further than this many edge lengths from the edge fall back to its points. */
+const double MAX_PLACEMENT_DISTANCE = 2.0;
+
+typedef std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > Quadrics;
+
+struct Collapse {
+    double cost;
+    uint32_t first;
+    uint32_t second;
+    uint32_t first_version;
+    uint32_t second_version;
+    Eigen::Vector3d position;
+
+    bool operator>(const Collapse& other) const
+    {
+        return cost > other.cost;
+    }
+};
+
+uint64_t undirected_edge(const uint32_t& first, const uint32_t& second)
+{
+    return (uint64_t(std::min(first, second)) << 32) | uint64_t(std::max(first, second));
+}
+
+double quadric_error(const Eigen::Matrix4d& quadric, const Eigen::Vector3d& position)
+{
+    const Eigen::Vector4d homogeneous(position.x(), position.y(), position.z(), 1.0);
+    return std::max(0.0, double(homogeneous.transpose() * quadric * homogeneous));
+}
+
+/** \brief For every vertex the first vertex at exactly its position, vertices with a NaN keep their own id.
+  * Marching cubes computes a vertex shared by several cubes from the same voxel edge, so copies match bit for bit.
+  */
+std::vector<uint32_t> coincident_vertices(const pcl::PointCloud<pcl::PointXYZRGB>& vertices)
+{
+    std::vector<uint32_t> result(vertices.size());
+    std::iota(result.begin(), result.end(), 0);
+
+    std::vector<uint32_t> order;
+    order.reserve(vertices.size());
+    for (uint32_t id = 0; id < uint32_t(vertices.size()); ++id) {
+        if (std::isfinite(vertices[id].x) && std::isfinite(vertices[id].y) && std::isfinite(vertices[id].z)) {
+            order.push_back(id);
+        }
+    }
+
+    const auto position = [&vertices](const uint32_t& id) {
+        return std::make_tuple(vertices[id].x, vertices[id].y, vertices[id].z);
+    };
+    std::sort(order.begin(), order.end(), [&position](const uint32_t& first, const uint32_t& second) {
+        return std::make_pair(position(first), first) < std::make_pair(position(second), second);
+    });
+
+    for (size_t i = 1; i < order.size(); ++i) {
+        if (position(order[i]) == position(order[i - 1])) {
+            result[order[i]] = result[order[i - 1]];
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+MeshDecimator::MeshDecimator(const double& max_error, const float& block_size_)
+    : max_squared_error(max_error * max_error)
+    , block_size(block_size_)
+{
+    if (block_size <= 0) {
+        throw std::invalid_argument("MeshDecimator::MeshDecimator block_size <= 0");
+    }
+}
+
+void MeshDecimator::decimate(const pcl::PolygonMesh& input, const float& target_ratio, pcl::PolygonMesh& output) const
+{
+    Vertices vertices;
+    pcl::fromPCLPointCloud2(input.cloud, vertices);
+
+    //Triangle soup, as the serial MarchingCubesTSDFOctree writes it, is welded first, edges of unwelded
+    //triangles are all on holes and would never collapse
+    const std::vector<uint32_t> welded = coincident_vertices(vertices);
+
+    //A vertex used by triangles of two blocks is locked, so no block moves what another one sees
+    std::unordered_map<uint64_t, uint32_t> block_ids;
+    std::vector<Block> blocks;
+    std::vector<uint32_t> vertex_blocks(vertices.size(), NO_ID);
+    std::vector<uint8_t> locked(vertices.size(), 0);
+    for (const pcl::Vertices& polygon : input.polygons) {
+        if (polygon.vertices.size() != 3) {
+            continue;
+        }
+
+        const uint32_t triangle[3] = { welded[polygon.vertices[0]], welded[polygon.vertices[1]], welded[polygon.vertices[2]] };
+        if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2]) {
+            continue;
+        }
+
+        Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+        for (const uint32_t& id : triangle) {
+            centroid += vertices[id].getVector3fMap();
+        }
+        const auto inserted = block_ids.insert(std::make_pair(block_key(centroid / 3.0f), uint32_t(blocks.size())));
+        if (inserted.second) {
+            blocks.push_back(Block());
+        }
+
+        const uint32_t block = inserted.first->second;
+        for (const uint32_t& id : triangle) {
+            blocks[block].triangles.push_back(id);
+            if (vertex_blocks[id] == NO_ID) {
+                vertex_blocks[id] = block;
+            } else if (vertex_blocks[id] != block) {
+                locked[id] = 1;
+            }
+        }
+    }
+
+    ThreadPool::instance().parallel_for(0, blocks.size(), [&](size_t i) {
+        decimate_block(blocks[i], locked, target_ratio, vertices);
+    });
+
+    //Only the vertices still referenced are written, in the order the blocks meet them
+    Vertices cloud;
+    std::vector<uint32_t> ids(vertices.size(), NO_ID);
+    output.polygons.clear();
+    for (const Block& block : blocks) {
+        for (size_t i = 0; i + 2 < block.triangles.size(); i += 3) {
+            pcl::Vertices polygon;
+            polygon.vertices.resize(3);
+            for (size_t j = 0; j < 3; ++j) {
+                uint32_t& id = ids[block.triangles[i + j]];
+                if (id == NO_ID) {
+                    id = uint32_t(cloud.size());
+                    cloud.push_back(vertices[block.triangles[i + j]]);
+                }
+                polygon.vertices[j] = id;
+            }
+            output.polygons.push_back(polygon);
+        }
+    }
+
+    pcl::toPCLPointCloud2(cloud, output.cloud);
+    output.header = input.header;
+}
+
+/** \brief Garland and Heckbert collapses of the block's edges, cheapest first. The heap is lazy, a collapse
+  * whose vertices changed since it was pushed is dropped when it comes up. Collapses that would fold
+  * a triangle over or join two sheets are skipped.
+  */
+void MeshDecimator::decimate_block(Block& block, const std::vector<uint8_t>& locked, const float& target_ratio,
+    Vertices& vertices) const
+{
+    const size_t triangles_count = block.triangles.size() / 3;
+    const size_t target_count = std::max<size_t>(1, size_t(std::ceil(double(target_ratio) * triangles_count)));
+    if (triangles_count <= target_count) {
+        return;
+    }
+
+    std::unordered_map<uint32_t, uint32_t> local_ids;
+    std::vector<uint32_t> global_ids;
+    std::vector<uint32_t> triangles(block.triangles.size());
+    for (size_t i = 0; i < block.triangles.size(); ++i) {
+        const auto inserted = local_ids.insert(std::make_pair(block.triangles[i], uint32_t(global_ids.size())));
+        if (inserted.second) {
+            global_ids.push_back(block.triangles[i]);
+        }
+        triangles[i] = inserted.first->second;
+    }
+
+    const size_t vertices_count = global_ids.size();
+    std::vector<Eigen::Vector3d> positions(vertices_count);
+    std::vector<uint8_t> frozen(vertices_count);
+    for (size_t v = 0; v < vertices_count; ++v) {
+        positions[v] = vertices[global_ids[v]].getVector3fMap().cast<double>();
+        frozen[v] = locked[global_ids[v]];
+    }
+
+    //An edge of one triangle lies on a hole of the mesh, edges shared with another block have locked vertices
+    std::unordered_map<uint64_t, int> edge_counts;
+    for (size_t t = 0; t < triangles_count; ++t) {
+        for (size_t j = 0; j < 3; ++j) {
+            ++edge_counts[undirected_edge(triangles[3 * t + j], triangles[3 * t + (j + 1) % 3])];
+        }
+    }
+    for (const auto& edge : edge_counts) {
+        if (edge.second == 1) {
+            frozen[uint32_t(edge.first >> 32)] = 1;
+            frozen[uint32_t(edge.first & 0xffffffffu)] = 1;
+        }
+    }
+
+    Quadrics quadrics(vertices_count, Eigen::Matrix4d::Zero());
+    std::vector<std::vector<uint32_t> > vertex_triangles(vertices_count);
+    for (size_t t = 0; t < triangles_count; ++t) {
+        const Eigen::Vector3d& a = positions[triangles[3 * t]];
+        Eigen::Vector3d normal = (positions[triangles[3 * t + 1]] - a).cross(positions[triangles[3 * t + 2]] - a);
+        const double norm = normal.norm();
+        Eigen::Matrix4d quadric = Eigen::Matrix4d::Zero();
+        if (norm > 0) {
+            normal /= norm;
+            const Eigen::Vector4d plane(normal.x(), normal.y(), normal.z(), -normal.dot(a));
+            quadric = plane * plane.transpose();
+        }
+
+        for (size_t j = 0; j < 3; ++j) {
+            quadrics[triangles[3 * t + j]] += quadric;
+            vertex_triangles[triangles[3 * t + j]].push_back(uint32_t(t));
+        }
+    }
+
+    std::vector<uint8_t> triangle_alive(triangles_count, 1);
+    std::vector<uint8_t> vertex_alive(vertices_count, 1);
+    std::vector<uint32_t> versions(vertices_count, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > heap;
+
+    const auto push_collapse = [&](const uint32_t& first, const uint32_t& second) {
+        if (frozen[first] && frozen[second]) {
+            return;
+        }
+
+        const Eigen::Matrix4d quadric = quadrics[first] + quadrics[second];
+        Collapse collapse;
+        if (frozen[first] || frozen[second]) {
+            collapse.position = positions[frozen[first] ? first : second];
+            collapse.cost = quadric_error(quadric, collapse.position);
+        } else {
+            const Eigen::Vector3d midpoint = 0.5 * (positions[first] + positions[second]);
+            collapse.position = midpoint;
+            collapse.cost = std::numeric_limits<double>::max();
+
+            //Planar neighbourhoods have a singular quadric, any point of the plane costs nothing
+            const Eigen::Matrix3d system = quadric.topLeftCorner<3, 3>();
+            const Eigen::FullPivLU<Eigen::Matrix3d> lu(system);
+            if (lu.isInvertible()) {
+                const Eigen::Vector3d optimal = lu.solve(-quadric.topRightCorner<3, 1>());
+                const double edge_length = (positions[first] - positions[second]).norm();
+                if ((optimal - midpoint).norm() <= MAX_PLACEMENT_DISTANCE * edge_length) {
+                    collapse.position = optimal;
+                    collapse.cost = quadric_error(quadric, optimal);
+                }
+            }
+            for (const Eigen::Vector3d& point : { positions[first], positions[second], midpoint }) {
+                const double cost = quadric_error(quadric, point);
+                if (cost < collapse.cost) {
+                    collapse.cost = cost;
+                    collapse.position = point;
+                }
+            }
+        }
+
+        if (collapse.cost > max_squared_error) {
+            return;
+        }
+        collapse.first = first;
+        collapse.second = second;
+        collapse.first_version = versions[first];
+        collapse.second_version = versions[second];
+        heap.push(collapse);
+    };
+
+    const auto neighbours_of = [&](const uint32_t& v, std::vector<uint32_t>& neighbours) {
+        neighbours.clear();
+        for (const uint32_t& t : vertex_triangles[v]) {
+            if (!triangle_alive[t]) {
+                continue;
+            }
+            for (size_t j = 0; j < 3; ++j) {
+                if (triangles[3 * t + j] != v) {
+                    neighbours.push_back(triangles[3 * t + j]);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+
+    const auto folds = [&](const uint32_t& moved, const uint32_t& other, const Eigen::Vector3d& position) {
+        for (const uint32_t& t : vertex_triangles[moved]) {
+            const uint32_t* corners = &triangles[3 * t];
+            if (!triangle_alive[t] || std::find(corners, corners + 3, other) != corners + 3) {
+                continue;
+            }
+
+            Eigen::Vector3d before[3], after[3];
+            for (size_t j = 0; j < 3; ++j) {
+                before[j] = positions[corners[j]];
+                after[j] = corners[j] == moved ? position : before[j];
+            }
+            const Eigen::Vector3d old_normal = (before[1] - before[0]).cross(before[2] - before[0]);
+            const Eigen::Vector3d new_normal = (after[1] - after[0]).cross(after[2] - after[0]);
+            const double norms = old_normal.norm() * new_normal.norm();
+            if (norms <= 0 || old_normal.dot(new_normal) < MIN_NORMAL_COS * norms) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (const auto& edge : edge_counts) {
+        push_collapse(uint32_t(edge.first >> 32), uint32_t(edge.first & 0xffffffffu));
+    }
+
+    size_t alive_count = triangles_count;
+    std::vector<uint32_t> first_neighbours, second_neighbours, common;
+    while (alive_count > target_count && !heap.empty()) {
+        const Collapse collapse = heap.top();
+        heap.pop();
+        if (!vertex_alive[collapse.first] || !vertex_alive[collapse.second]
+            || versions[collapse.first] != collapse.first_version
+            || versions[collapse.second] != collapse.second_version) {
+            continue;
+        }
+
+        const uint32_t keep = frozen[collapse.second] ? collapse.second : collapse.first;
+        const uint32_t remove = keep == collapse.first ? collapse.second : collapse.first;
+
+        //An interior edge has two triangles, more common neighbours would pinch the surface
+        neighbours_of(keep, first_neighbours);
+        neighbours_of(remove, second_neighbours);
+        common.clear();
+        std::set_intersection(first_neighbours.begin(), first_neighbours.end(),
+            second_neighbours.begin(), second_neighbours.end(), std::back_inserter(common));
+        if (common.size() > 2 || folds(keep, remove, collapse.position) || folds(remove, keep, collapse.position)) {
+            continue;
+        }
+
+        positions[keep] = collapse.position;
+        quadrics[keep] += quadrics[remove];
+        vertex_alive[remove] = 0;
+        ++versions[keep];
+        for (const uint32_t& t : vertex_triangles[remove]) {
+            if (!triangle_alive[t]) {
+                continue;
+            }
+
+            uint32_t* corners = &triangles[3 * t];
+            if (std::find(corners, corners + 3, keep) != corners + 3) {
+                triangle_alive[t] = 0;
+                --alive_count;
+            } else {
+                std::replace(corners, corners + 3, remove, keep);
+                vertex_triangles[keep].push_back(t);
+            }
+        }
+        vertex_triangles[remove].clear();
+        auto& keep_triangles = vertex_triangles[keep];
+        keep_triangles.erase(std::remove_if(keep_triangles.begin(), keep_triangles.end(),
+                                 [&](const uint32_t& t) { return !triangle_alive[t]; }),
+            keep_triangles.end());
+
+        neighbours_of(keep, first_neighbours);
+        for (const uint32_t& neighbour : first_neighbours) {
+            push_collapse(keep, neighbour);
+        }
+    }
+
+    for (size_t v = 0; v < vertices_count; ++v) {
+        if (vertex_alive[v] && !frozen[v]) {
+            vertices[global_ids[v]].getVector3fMap() = positions[v].cast<float>();
+        }
+    }
+
+    block.triangles.clear();
+    for (size_t t = 0; t < triangles_count; ++t) {
+        if (triangle_alive[t]) {
+            for (size_t j = 0; j < 3; ++j) {
+                block.triangles.push_back(global_ids[triangles[3 * t + j]]);
+            }
+        }
+    }
+}
+
+uint64_t MeshDecimator::block_key(const Eigen::Vector3f& point) const
+{
+    //21 bits per axis, blocks of a few decimetres cover kilometres
+    uint64_t key = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float coordinate = std::isfinite(point[axis]) ? point[axis] / block_size : 0.0f;
+        const int64_t index = int64_t(std::floor(coordinate)) + (int64_t(1) << 20);
+        key = (key << 21) | (uint64_t(index) & ((uint64_t(1) << 21) - 1));
+    }
+    return key;
+}
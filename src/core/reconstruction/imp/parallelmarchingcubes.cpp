@@ -0,0 +1,176 @@
+#include "core/reconstruction/parallelmarchingcubes.h"
+
+#include <pcl/conversions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "core/reconstruction/marchingcubestables.h"
+#include "utility/pointtransform.h"
+#include "utility/threadpool.h"
+
+/** \brief Vertices keep the order they are first met in the leaves, as in the serial reconstruction. */
+void ParallelMarchingCubesTSDFOctree::performReconstruction(pcl::PolygonMesh& output)
+{
+    getBoundingBox();
+    voxelizeData();
+
+    std::vector<const cpu_tsdf::OctreeNode*> leaves;
+    collect_leaves(tsdf_volume_->octree_->getRoot().get(), leaves);
+
+    //Several ranges per thread, the leaves near the surface are not spread evenly
+    const size_t ranges_count = std::max<size_t>(1, std::min(leaves.size(), 4 * (ThreadPool::instance().size() + 1)));
+    const size_t range_size = (leaves.size() + ranges_count - 1) / ranges_count;
+    std::vector<Range> ranges(ranges_count);
+    ThreadPool::instance().parallel_for(0, ranges_count, [&](size_t i) {
+        reconstruct_range(leaves, std::min(leaves.size(), i * range_size),
+            std::min(leaves.size(), (i + 1) * range_size), ranges[i]);
+    });
+
+    pcl::PointCloud<pcl::PointXYZRGB> cloud;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    output.polygons.clear();
+    for (Range& range : ranges) {
+        std::vector<uint32_t> range_ids(range.vertices.size());
+        for (size_t i = 0; i < range.vertices.size(); ++i) {
+            const auto inserted = ids.insert(std::make_pair(range.edges[i], uint32_t(cloud.size())));
+            if (inserted.second) {
+                cloud.push_back(range.vertices[i]);
+            }
+            range_ids[i] = inserted.first->second;
+        }
+
+        for (size_t i = 0; i + 2 < range.triangles.size(); i += 3) {
+            pcl::Vertices polygon;
+            polygon.vertices.resize(3);
+            for (size_t j = 0; j < 3; ++j) {
+                polygon.vertices[j] = range_ids[range.triangles[i + j]];
+            }
+            output.polygons.push_back(polygon);
+        }
+        range = Range();
+    }
+
+    point_transform::transform_in_place(Eigen::Matrix4f(tsdf_volume_->getGlobalTransform().matrix().cast<float>()), cloud);
+    pcl::toPCLPointCloud2(cloud, output.cloud);
+}
+
+void ParallelMarchingCubesTSDFOctree::collect_leaves(const cpu_tsdf::OctreeNode* node,
+    std::vector<const cpu_tsdf::OctreeNode*>& leaves) const
+{
+    if (!node->hasChildren()) {
+        leaves.push_back(node);
+        return;
+    }
+
+    for (const auto& child : node->getChildren()) {
+        collect_leaves(child.get(), leaves);
+    }
+}
+
+/** \brief Same cubes as cpu_tsdf::MarchingCubesTSDFOctree::reconstructVoxel, only read from the volume. */
+void ParallelMarchingCubesTSDFOctree::reconstruct_range(const std::vector<const cpu_tsdf::OctreeNode*>& leaves,
+    const size_t& begin, const size_t& end, Range& range)
+{
+    std::unordered_map<uint64_t, uint32_t> ids;
+    std::vector<float> values;
+    uint32_t cube_ids[12];
+
+    for (size_t i = begin; i < end; ++i) {
+        const cpu_tsdf::OctreeNode* leaf = leaves[i];
+        float d, w;
+        leaf->getData(d, w);
+        if (w < w_min_ || std::fabs(d) >= 1) {
+            continue;
+        }
+
+        float x, y, z;
+        leaf->getCenter(x, y, z);
+        Eigen::Vector3i index;
+        tsdf_volume_->getVoxelIndex(x, y, z, index(0), index(1), index(2));
+        if (index(0) <= 0 || index(0) >= res_x_ - 1
+            || index(1) <= 0 || index(1) >= res_y_ - 1
+            || index(2) <= 0 || index(2) >= res_z_ - 1) {
+            continue;
+        }
+        if (!getValidNeighborList1D(values, index)) {
+            continue;
+        }
+
+        int cube = 0;
+        for (int c = 0; c < 8; ++c) {
+            cube |= values[c] < iso_level_ ? 1 << c : 0;
+        }
+        if (pcl::edgeTable[cube] == 0) {
+            continue;
+        }
+
+        pcl::PointXYZRGB colored;
+        leaf_color(leaf, colored);
+
+        for (int e = 0; e < 12; ++e) {
+            if (!(pcl::edgeTable[cube] & (1 << e))) {
+                continue;
+            }
+
+            const int* low = marching_cubes_tables::CORNER_OFFSETS[marching_cubes_tables::edge_origin(e)];
+            const uint64_t edge = edge_key(index + Eigen::Vector3i(low[0], low[1], low[2]),
+                marching_cubes_tables::edge_axis(e));
+            const auto inserted = ids.insert(std::make_pair(edge, uint32_t(range.vertices.size())));
+            cube_ids[e] = inserted.first->second;
+            if (!inserted.second) {
+                continue;
+            }
+
+            const int a = marching_cubes_tables::EDGE_CORNERS[e][0];
+            const int b = marching_cubes_tables::EDGE_CORNERS[e][1];
+            const int* offset_a = marching_cubes_tables::CORNER_OFFSETS[a];
+            const int* offset_b = marching_cubes_tables::CORNER_OFFSETS[b];
+            const Eigen::Vector3f point_a = grid_point(index + Eigen::Vector3i(offset_a[0], offset_a[1], offset_a[2]));
+            const Eigen::Vector3f point_b = grid_point(index + Eigen::Vector3i(offset_b[0], offset_b[1], offset_b[2]));
+            const float mu = (iso_level_ - values[a]) / (values[b] - values[a]);
+
+            colored.getVector3fMap() = point_a + mu * (point_b - point_a);
+            range.vertices.push_back(colored);
+            range.edges.push_back(edge);
+        }
+
+        for (int t = 0; pcl::triTable[cube][t] != -1; ++t) {
+            range.triangles.push_back(cube_ids[pcl::triTable[cube][t]]);
+        }
+    }
+}
+
+void ParallelMarchingCubesTSDFOctree::leaf_color(const cpu_tsdf::OctreeNode* leaf, pcl::PointXYZRGB& point) const
+{
+    if (color_by_confidence_) {
+        const float std_dev = (100.0f - leaf->w_) / 100.0f;
+        point.r = uint8_t(std::max(0.0f, std::min((1 - std_dev) * 255.0f, 255.0f)));
+        point.g = 0;
+        point.b = uint8_t(std::max(0.0f, std::min(std_dev * 255.0f, 255.0f)));
+        return;
+    }
+
+    uint8_t r, g, b;
+    if (color_by_rgb_ && leaf->getRGB(r, g, b)) {
+        point.r = r;
+        point.g = g;
+        point.b = b;
+    }
+}
+
+/** \brief Corner of the marching cubes grid, as pcl::MarchingCubes::createSurface places it. */
+Eigen::Vector3f ParallelMarchingCubesTSDFOctree::grid_point(const Eigen::Vector3i& index) const
+{
+    return Eigen::Vector3f(
+        min_p_[0] + (max_p_[0] - min_p_[0]) * float(index[0]) / float(res_x_),
+        min_p_[1] + (max_p_[1] - min_p_[1]) * float(index[1]) / float(res_y_),
+        min_p_[2] + (max_p_[2] - min_p_[2]) * float(index[2]) / float(res_z_));
+}
+
+uint64_t ParallelMarchingCubesTSDFOctree::edge_key(const Eigen::Vector3i& index, const int& axis) const
+{
+    return ((uint64_t(index[2]) * uint64_t(res_y_ + 1) + uint64_t(index[1])) * uint64_t(res_x_ + 1)
+               + uint64_t(index[0])) * 3 + uint64_t(axis);
+}
@@ -7,6 +7,7 @@
 #include "core/registration/linearbasedregistration.hpp"
 #include "core/registration/linearregistration.hpp"
 #include "core/registration/middlebasedregistration.hpp"
+#include "core/registration/modelbasedregistration.hpp"
 #include "core/registration/parallelregistration.hpp"
 #include "core/registration/sacregistration.h"
 #include "io/pcdinputiterator.hpp"
@@ -16,7 +17,7 @@
 ReconstructionInterface::ReconstructionInterface(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
     , volumeReconstruction(new VolumeReconstruction(this, settings))
-    , pcdVizualizer(new PcdVizualizer(this, settings))
+    , pcdVizualizer(Vizualizer::create(this, settings, configs))
 {
 }
 
@@ -25,6 +26,7 @@ void ReconstructionInterface::reloadSettings()
     volumeReconstruction->deleteLater();
 
     volumeReconstruction = VolumeReconstruction::Ptr(new VolumeReconstruction(this, settings));
+    pcdVizualizer->clear();
     pcdVizualizer->redraw();
 }
 
@@ -48,11 +50,12 @@ void ReconstructionInterface::perform_tsdf_meshing(
     volumeReconstruction->prepareVolume();
     pcdVizualizer->redraw();
 
-    if (settings->value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
+    if (project.value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
         pcdVizualizer->visualizeCameraPoses(final_translation_matrix_vector);
+        pcdVizualizer->plotCameraPoses(final_translation_matrix_vector);
     }
 
-    if (settings->value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
+    if (project.value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
         pcl::PolygonMesh mesh;
         volumeReconstruction->calculateMesh();
         volumeReconstruction->getPoligonMesh(mesh);
@@ -62,20 +65,20 @@ void ReconstructionInterface::perform_tsdf_meshing(
 
 void ReconstructionInterface::perform_reconstruction()
 {
-    const bool is_fixed_size = settings->value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_FIXED_SIZE").toBool();
-    const int fixed_size = settings->value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_SIZE").toInt();
+    const bool is_fixed_size = project.value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_FIXED_SIZE").toBool();
+    const int fixed_size = project.value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_SIZE").toInt();
 
-    int from = is_fixed_size ? 0 : settings->value("READING_SETTING/FROM").toInt();
-    int to = is_fixed_size ? std::numeric_limits<int>::max() : settings->value("READING_SETTING/TO").toInt();
+    int from = is_fixed_size ? 0 : project.value("READING_SETTING/FROM").toInt();
+    int to = is_fixed_size ? std::numeric_limits<int>::max() : project.value("READING_SETTING/TO").toInt();
 
-    PcdInputIterator range_it(settings, from, to, 1);
+    PcdInputIterator range_it(project, from, to, 1);
     from = range_it.getLowerBound();
     to = range_it.getUpperBound();
 
     const int dinamyc_step = (to - from) / fixed_size == 0 ? 1 : (to - from) / fixed_size;
-    const int step = (is_fixed_size ? dinamyc_step : settings->value("READING_SETTING/STEP").toInt());
+    const int step = (is_fixed_size ? dinamyc_step : project.value("READING_SETTING/STEP").toInt());
 
-    range_it = PcdInputIterator(settings, from, to, step);
+    range_it = PcdInputIterator(project, from, to, step);
     from = range_it.getLowerBound();
     to = range_it.getUpperBound();
 
@@ -83,8 +86,8 @@ void ReconstructionInterface::perform_reconstruction()
     std::vector<double> fit;
     std::vector<double> mean;
 
-    PcdInputIterator it(settings, from, to, step);
-    PcdInputIterator it2(settings, from + step, to, step);
+    PcdInputIterator it(project, from, to, step);
+    PcdInputIterator it2(project, from + step, to, step);
     for (; it != PcdInputIterator() && it2 != PcdInputIterator(); ++it, ++it2) {
         Frames frames, transformed_frames;
 
@@ -92,7 +95,7 @@ void ReconstructionInterface::perform_reconstruction()
         frames.push_back(*it2);
 
         PcdFilters filters(this, settings);
-        filters.setInput(frames);
+        filters.setInput(std::move(frames));
         filters.filter(frames);
         ;
 
@@ -129,10 +132,11 @@ void ReconstructionInterface::perform_reconstruction()
     }
 
     pcdVizualizer->visualizeCameraPoses(final_transformations);
+    pcdVizualizer->plotCameraPoses(final_transformations);
     pcdVizualizer->plotCameraDistances(fit, false, "FS", "Score");
     pcdVizualizer->plotCameraDistances(mean, false, "Mean", "M Dist");
 
-    Frames frames(PcdInputIterator(settings, from, to, step), PcdInputIterator());
+    Frames frames(PcdInputIterator(project, from, to, step), PcdInputIterator());
     Frames transformed_frames;
 
     LinearRegistration<SaCRegistration> linear_sac(this, settings);
@@ -149,24 +153,21 @@ void ReconstructionInterface::perform_reconstruction()
         final_transformations.push_back(icp_transformations[i] * sac_transformations[i]);
     }
 
-    if (settings->value("VISUALIZATION/CPU_TSDF").toBool()) {
+    if (project.value("VISUALIZATION/CPU_TSDF").toBool()) {
         perform_tsdf_integration(frames, final_transformations);
         perform_tsdf_meshing(final_transformations);
     } else {
         pcdVizualizer->redraw();
-        if (settings->value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
+        if (project.value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
             pcdVizualizer->visualizeCameraPoses(final_transformations);
+            pcdVizualizer->plotCameraPoses(final_transformations);
         }
-        if (settings->value("VISUALIZATION/DRAW_ALL_CLOUDS").toBool()) {
+        if (project.value("VISUALIZATION/DRAW_ALL_CLOUDS").toBool()) {
             pcdVizualizer->visualizePointClouds(transformed_frames);
         }
-        if (settings->value("VISUALIZATION/DRAW_ALL_KEYPOINT_CLOUDS").toBool()) {
+        if (project.value("VISUALIZATION/DRAW_ALL_KEYPOINT_CLOUDS").toBool()) {
             pcdVizualizer->visualizeKeypointClouds(linear_icp.getTransformedKeypoints());
         }
-
-        while (!pcdVizualizer->viewer->wasStopped()) {
-            pcdVizualizer->spin();
-        }
     }
 }
 
@@ -194,18 +195,28 @@ void ReconstructionInterface::perform_lum_reconstruction()
     ebr.reconstruct();
 }
 
+void ReconstructionInterface::perform_model_based_reconstruction()
+{
+    ModelBasedRegistration mbr(this, settings);
+    mbr.setVolumeReconstructor(volumeReconstruction);
+    mbr.setVisualizer(pcdVizualizer);
+    mbr.reconstruct();
+}
+
 //#######################################################
 //#-----------------------SLOTS--------------------------
 
 void ReconstructionInterface::slot_perform_reconstruction()
 {
-    if (settings->value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION").toBool()) {
+    if (project.value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION").toBool()) {
         perform_reconstruction();
-    } else if (settings->value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_WITH_LOOPS").toBool()) {
+    } else if (project.value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_WITH_LOOPS").toBool()) {
         perform_iterative_reconstruction();
-    } else if (settings->value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION").toBool()) {
+    } else if (project.value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION").toBool()) {
         perform_partition_recursive_reconstruction();
-    } else if (settings->value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_ENABLE").toBool()) {
+    } else if (project.value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_ENABLE").toBool()) {
         perform_lum_reconstruction();
+    } else if (project.value("ALGORITHM_SETTINGS/MODEL_BASED_RECONSTRUCTION").toBool()) {
+        perform_model_based_reconstruction();
     }
 }
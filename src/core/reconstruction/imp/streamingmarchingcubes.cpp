@@ -0,0 +1,89 @@
+#include "core/reconstruction/streamingmarchingcubes.h"
+
+#include <pcl/conversions.h>
+
+#include "utility/pointtransform.h"
+
+StreamingMarchingCubesTSDFOctree::StreamingMarchingCubesTSDFOctree(
+    PlyStreamWriter* writer_, const size_t& chunk_size_, const bool& keep_mesh_)
+    : writer(writer_)
+    , chunk_size(chunk_size_ == 0 ? 1 : chunk_size_)
+    , keep_mesh(keep_mesh_)
+    , color_layer(nullptr)
+    , flushed_size(0)
+{
+}
+
+void StreamingMarchingCubesTSDFOctree::setColorLayer(const VoxelColorLayer* color_layer_)
+{
+    color_layer = color_layer_;
+}
+
+void StreamingMarchingCubesTSDFOctree::performReconstruction(pcl::PolygonMesh& output)
+{
+    getBoundingBox();
+    voxelizeData();
+
+    cloud.clear();
+    cloud_colored.clear();
+    flushed_size = 0;
+
+    reconstructNode(tsdf_volume_->octree_->getRoot().get());
+    flush();
+
+    pcl::toPCLPointCloud2(cloud_colored, output.cloud);
+    output.polygons.resize(cloud_colored.size() / 3);
+    for (size_t i = 0; i < output.polygons.size(); ++i) {
+        output.polygons[i].vertices.resize(3);
+        for (uint32_t j = 0; j < 3; ++j) {
+            output.polygons[i].vertices[j] = uint32_t(i) * 3 + j;
+        }
+    }
+
+    cloud.clear();
+    cloud_colored.clear();
+}
+
+void StreamingMarchingCubesTSDFOctree::reconstructNode(const cpu_tsdf::OctreeNode* node)
+{
+    if (node->hasChildren()) {
+        for (const auto& child : node->getChildren()) {
+            reconstructNode(child.get());
+        }
+        return;
+    }
+
+    reconstructVoxel(node, cloud, &cloud_colored);
+    if (cloud_colored.size() - flushed_size >= chunk_size) {
+        flush();
+    }
+}
+
+void StreamingMarchingCubesTSDFOctree::flush()
+{
+    if (cloud_colored.size() == flushed_size) {
+        return;
+    }
+
+    pcl::PointCloud<pcl::PointXYZRGB> chunk;
+    chunk.points.assign(cloud_colored.points.begin() + flushed_size, cloud_colored.points.end());
+    chunk.width = uint32_t(chunk.points.size());
+    chunk.height = 1;
+    point_transform::transform_in_place(Eigen::Matrix4f(tsdf_volume_->getGlobalTransform().matrix().cast<float>()), chunk);
+    if (color_layer != nullptr) {
+        color_layer->colorVertices(chunk);
+    }
+
+    if (writer != nullptr) {
+        writer->appendTriangles(chunk);
+    }
+
+    if (keep_mesh) {
+        std::copy(chunk.points.begin(), chunk.points.end(), cloud_colored.points.begin() + flushed_size);
+        flushed_size = cloud_colored.size();
+    } else {
+        cloud.clear();
+        cloud_colored.clear();
+        flushed_size = 0;
+    }
+}
@@ -1,62 +1,229 @@
 #include "core/reconstruction/volumereconstruction.h"
 
+#include <QFileInfo>
+#include <QStringList>
+
+#include <pcl/conversions.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "utility/memoryaccounting.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+#include "utility/threadpool.h"
+
+namespace {
+
+//Integration keeps the TSDF gauge about this fresh, a memory report walks the whole volume
+const std::chrono::milliseconds MEMORY_GAUGE_INTERVAL(1000);
+
+//boost's reference count block of a node: vtable, use and weak counts and the node pointer
+const size_t SHARED_COUNT_BYTES = 2 * sizeof(void*) + 2 * sizeof(int);
+
+struct OctreeCounts {
+    size_t internal_nodes = 0;
+    size_t internal_bytes = 0;
+    size_t leaves = 0;
+    size_t leaf_bytes = 0;
+    size_t children = 0;
+    size_t children_bytes = 0;
+};
+
+void count_octree_nodes(const cpu_tsdf::OctreeNode* node, OctreeCounts& counts)
+{
+    const size_t node_bytes = dynamic_cast<const cpu_tsdf::RGBNode*>(node)
+        ? sizeof(cpu_tsdf::RGBNode)
+        : sizeof(cpu_tsdf::OctreeNode);
+    if (!node->hasChildren()) {
+        ++counts.leaves;
+        counts.leaf_bytes += node_bytes;
+        return;
+    }
+
+    const std::vector<cpu_tsdf::OctreeNode::Ptr>& children = node->getChildren();
+    ++counts.internal_nodes;
+    counts.internal_bytes += node_bytes;
+    counts.children += children.size();
+    counts.children_bytes += children.capacity() * sizeof(cpu_tsdf::OctreeNode::Ptr) + children.size() * SHARED_COUNT_BYTES;
+    for (const cpu_tsdf::OctreeNode::Ptr& child : children) {
+        count_octree_nodes(child.get(), counts);
+    }
+}
+
+} // namespace
+
 VolumeReconstruction::VolumeReconstruction(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
-    , tsdf(new cpu_tsdf::TSDFVolumeOctree)
+    , voxel_hash(configs.value("CPU_TSDF_SETTINGS/BACKEND").toString() == "VOXEL_HASH")
+    , preview_mesh(voxel_hash && project.value("VISUALIZATION/CPU_TSDF_PREVIEW_MESH").toBool())
+    , preview_ready(false)
 {
-    const float& x_vol = std::round(configs.value("CPU_TSDF_SETTINGS/X_VOL").toFloat());
-    const float& y_vol = std::round(configs.value("CPU_TSDF_SETTINGS/Y_VOL").toFloat());
-    const float& z_vol = std::round(configs.value("CPU_TSDF_SETTINGS/Z_VOL").toFloat());
-    tsdf->setGridSize(x_vol, y_vol, z_vol);
+    const bool deferred_color = configs.value("CPU_TSDF_SETTINGS/DEFERRED_COLOR").toBool();
+    if (deferred_color) {
+        keyframe_colorizer.reset(new KeyframeColorizer(configs.value("CPU_TSDF_SETTINGS/KEYFRAME_DISTANCE").toFloat(),
+            configs.value("CPU_TSDF_SETTINGS/KEYFRAME_ANGLE").toFloat(),
+            size_t(std::max(0, configs.value("CPU_TSDF_SETTINGS/MAX_KEYFRAMES").toInt())),
+            configs.value("CPU_TSDF_SETTINGS/KEYFRAME_VISIBILITY_DEPTH").toFloat()));
+    }
+
+    if (voxel_hash) {
+        hash_volume = std::make_shared<VoxelHashVolume>(
+            configs.value("CPU_TSDF_SETTINGS/VOXEL_SIZE").toFloat(),
+            configs.value("CPU_TSDF_SETTINGS/TRUNCATION_DISTANCE").toFloat(),
+            configs.value("CPU_TSDF_SETTINGS/MAX_WEIGHT").toInt());
+        load_hash_intrinsics();
 
-    const int& x_res = configs.value("CPU_TSDF_SETTINGS/X_RES").toInt();
-    const int& y_res = configs.value("CPU_TSDF_SETTINGS/Y_RES").toInt();
-    const int& z_res = configs.value("CPU_TSDF_SETTINGS/Z_RES").toInt();
-    tsdf->setResolution(x_res, y_res, z_res);
-    tsdf->setIntegrateColor(true);
+        //A saved volume to mesh again or to integrate further
+        const QString initial_volume = configs.value("CPU_TSDF_SETTINGS/INITIAL_VOL_FILENAME").toString();
+        if (!initial_volume.isEmpty()) {
+            VoxelHashVolume::Ptr loaded = voxel_hash_file::load(initial_volume);
+            if (loaded) {
+                hash_volume = loaded;
+                LOG_INFO("tsdf") << "Loaded" << hash_volume->blocksCount() << "blocks from" << initial_volume;
+            } else {
+                LOG_WARNING("tsdf") << "Can't read" << initial_volume << ", starting with an empty volume";
+            }
+        }
 
-    Eigen::Affine3d tsdf_center(Eigen::Affine3d::Identity()); // Optionally offset the center
-    const double& x_shift = configs.value("CPU_TSDF_SETTINGS/X_SHIFT").toDouble();
-    const double& y_shift = configs.value("CPU_TSDF_SETTINGS/Y_SHIFT").toDouble();
-    const double& z_shift = configs.value("CPU_TSDF_SETTINGS/Z_SHIFT").toDouble();
-    tsdf_center.translation() << x_shift, y_shift, z_shift;
-    tsdf->setGlobalTransform(tsdf_center);
-    tsdf->reset();
+        //Blocks beyond the budget are paged out to a scratch file next to the project
+        const size_t memory_mb = size_t(std::max(0, configs.value("CPU_TSDF_SETTINGS/BLOCK_MEMORY_MB").toInt()));
+        if (configs.value("CPU_TSDF_SETTINGS/VOXEL_HASH_DEVICE").toString() == "GPU") {
+            if (!GpuVoxelHashVolume::available()) {
+                LOG_WARNING("tsdf") << "No CUDA device or built without ROOM_SCANNER_CUDA, the voxel hash volume stays on the CPU";
+            } else if (memory_mb > 0) {
+                LOG_WARNING("tsdf") << "BLOCK_MEMORY_MB pages the blocks out on the CPU, the voxel hash volume stays on the CPU";
+            } else {
+                gpu_volume = std::make_shared<GpuVoxelHashVolume>(
+                    hash_volume->voxelSize(), hash_volume->truncationDistance(), hash_volume->maxWeight());
+                gpu_volume->merge(*hash_volume);
+                gpu_volume->uploadBlocks();
+                hash_volume = gpu_volume;
+            }
+        }
+        if (memory_mb > 0 && !gpu_volume) {
+            hash_volume->setMemoryBudget(std::max<size_t>(1, memory_mb * 1024 * 1024 / sizeof(VoxelHashVolume::Block)),
+                configs.value("CPU_TSDF_SETTINGS/BLOCK_STORE_FILENAME").toString().toStdString());
+        }
+    } else {
+        tsdf.reset(new cpu_tsdf::TSDFVolumeOctree);
+        const float& x_vol = std::round(configs.value("CPU_TSDF_SETTINGS/X_VOL").toFloat());
+        const float& y_vol = std::round(configs.value("CPU_TSDF_SETTINGS/Y_VOL").toFloat());
+        const float& z_vol = std::round(configs.value("CPU_TSDF_SETTINGS/Z_VOL").toFloat());
+        tsdf->setGridSize(x_vol, y_vol, z_vol);
+
+        const int& x_res = configs.value("CPU_TSDF_SETTINGS/X_RES").toInt();
+        const int& y_res = configs.value("CPU_TSDF_SETTINGS/Y_RES").toInt();
+        const int& z_res = configs.value("CPU_TSDF_SETTINGS/Z_RES").toInt();
+        tsdf->setResolution(x_res, y_res, z_res);
+        //Geometry only, the mesh is coloured afterwards
+        const bool compact_color = !deferred_color && configs.value("CPU_TSDF_SETTINGS/COMPACT_COLOR").toBool();
+        tsdf->setIntegrateColor(!compact_color && !deferred_color);
+
+        Eigen::Affine3d tsdf_center(Eigen::Affine3d::Identity()); // Optionally offset the center
+        const double& x_shift = configs.value("CPU_TSDF_SETTINGS/X_SHIFT").toDouble();
+        const double& y_shift = configs.value("CPU_TSDF_SETTINGS/Y_SHIFT").toDouble();
+        const double& z_shift = configs.value("CPU_TSDF_SETTINGS/Z_SHIFT").toDouble();
+        tsdf_center.translation() << x_shift, y_shift, z_shift;
+        tsdf->setGlobalTransform(tsdf_center);
+        {
+            //The octree reset and integration are OpenMP loops of cpu_tsdf
+            const OpenMPLimit openmp_limit;
+            tsdf->reset();
+        }
+
+        if (compact_color) {
+            color_layer.reset(new VoxelColorLayer(Eigen::Vector3f(x_vol, y_vol, z_vol),
+                Eigen::Vector3i(x_res, y_res, z_res), tsdf_center.matrix().cast<float>(),
+                configs.value("CPU_TSDF_SETTINGS/MAX_WEIGHT").toInt()));
+        }
+    }
+
+    //One worker, so the clouds are integrated in the order they were added
+    if (configs.value("CPU_TSDF_SETTINGS/ASYNC_INTEGRATION").toBool()) {
+        integration_queue.reset(new FrameWriter(
+            std::max(1, configs.value("CPU_TSDF_SETTINGS/INTEGRATION_QUEUE_SIZE").toInt()), 1));
+    }
 }
 
 void VolumeReconstruction::addPointCloudVector(
     const PcdPtrVector& point_cloud_vector,
     const Matrix4fVector& translation_matrix_vector)
 {
-    for (size_t i = 0; i < point_cloud_vector.size(); i++) {
-        addPointCloud(point_cloud_vector[i], translation_matrix_vector[i]);
-        qDebug() << "TSDF Integration" << i + 1 << "/" << point_cloud_vector.size();
+    if (point_cloud_vector.size() != translation_matrix_vector.size()) {
+        throw std::invalid_argument("VolumeReconstruction::addPointCloudVector point_cloud_vector.size() != translation_matrix_vector.size()");
+    }
+
+    if (!integration_queue) {
+        integrate_batch(point_cloud_vector, translation_matrix_vector);
+        update_preview_mesh();
+        return;
+    }
+
+    //Packing the frames here overlaps it with the registration and keeps the queue small
+    if (hash_volume) {
+        const StagedFrames frames = stage_frames(point_cloud_vector, translation_matrix_vector);
+        integration_queue->enqueue([this, frames]() {
+            integrate_staged_frames(frames);
+            update_preview_mesh();
+        });
+        return;
+    }
+
+    //The registration keeps working with the frames, the queue integrates copies
+    PcdPtrVector copies;
+    for (const PcdPtr& point_cloud : point_cloud_vector) {
+        copies.push_back(PcdPtr(new Pcd(*point_cloud)));
     }
+
+    integration_queue->enqueue([this, copies, translation_matrix_vector]() {
+        integrate_batch(copies, translation_matrix_vector);
+        update_preview_mesh();
+    });
 }
 
 void VolumeReconstruction::addPointCloud(
     const PcdPtr& point_cloud,
     const Eigen::Matrix4f& translation_matrix)
 {
-    Eigen::Affine3d trans(Eigen::Affine3d::Identity());
-    trans(0, 0) = translation_matrix(0, 0);
-    trans(0, 1) = translation_matrix(0, 1);
-    trans(0, 2) = translation_matrix(0, 2);
-    trans(0, 3) = translation_matrix(0, 3);
-    trans(1, 0) = translation_matrix(1, 0);
-    trans(1, 1) = translation_matrix(1, 1);
-    trans(1, 2) = translation_matrix(1, 2);
-    trans(1, 3) = translation_matrix(1, 3);
-    trans(2, 0) = translation_matrix(2, 0);
-    trans(2, 1) = translation_matrix(2, 1);
-    trans(2, 2) = translation_matrix(2, 2);
-    trans(2, 3) = translation_matrix(2, 3);
-
-    tsdf->integrateCloud(*point_cloud, NormalPcd(), trans); // Integrate the cloud
+    addPointCloudVector(PcdPtrVector(1, point_cloud), Matrix4fVector(1, translation_matrix));
+}
+
+void VolumeReconstruction::waitIntegration()
+{
+    if (integration_queue) {
+        integration_queue->wait();
+    }
 }
 
 void VolumeReconstruction::prepareVolume()
 {
+    waitIntegration();
+
+    LOG_INFO("tsdf") << "Volume memory:\n" << memoryReport().toString().c_str();
+
+    if (hash_volume) {
+        LOG_INFO("tsdf") << "Voxel hash volume:" << hash_volume->blocksCount() << "blocks,"
+                         << hash_volume->residentBlocksCount() << "in memory";
+
+        if (configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_VOL").toBool()) {
+            QString filename = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_VOL_FILENAME").toString();
+            LOG_INFO("tsdf") << "Saving" << filename.toStdString().c_str() << "...";
+            if (gpu_volume) {
+                gpu_volume->downloadBlocks();
+            }
+            if (!voxel_hash_file::save(filename, *hash_volume,
+                    configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/VOL_COMPRESSION_LEVEL").toInt())) {
+                LOG_WARNING("tsdf") << "Can't write" << filename.toStdString().c_str();
+            }
+            LOG_INFO("tsdf") << "Done!";
+        }
+        return;
+    }
+
     float distance = 0;
     pcl::PointXYZ query_point(1.0, 2.0, -1.0);
 
@@ -65,31 +232,474 @@ void VolumeReconstruction::prepareVolume()
 
     if (configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_VOL").toBool()) {
         QString filename = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_VOL_FILENAME").toString();
-        qDebug() << "Saving" << filename.toStdString().c_str() << "...";
+        LOG_INFO("tsdf") << "Saving" << filename.toStdString().c_str() << "...";
         tsdf->save(filename.toStdString());
-        qDebug() << "Done!";
+        LOG_INFO("tsdf") << "Done!";
     }
 }
 
 void VolumeReconstruction::calculateMesh()
 {
-    qDebug() << "Calculating mesh...";
-    cpu_tsdf::MarchingCubesTSDFOctree mc;
-    mc.setInputTSDF(tsdf);
+    waitIntegration();
+
+    const bool save_ply = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_PLY").toBool();
+    const bool ply_binary = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/PLY_FORMAT").toString() == "binary";
+    //The voxel hash mesh is saved at once, a deferred coloured one once it is coloured, PlyStreamWriter only writes binary
+    const bool stream_ply = save_ply && ply_binary && !hash_volume && !keyframe_colorizer
+        && configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/PLY_STREAMING").toBool();
+    const QString ply_filename = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_PLY_FILENAME").toString();
+
+    LOG_INFO("tsdf") << "Calculating mesh...";
+    PROFILE_ZONE("marching_cubes");
+    if (gpu_volume) {
+        gpu_volume->extractMeshOnDevice(_mesh, configs.value("CPU_TSDF_SETTINGS/MIN_WEIGHT").toInt());
+        LOG_DEBUG("tsdf") << "Marching cubes over" << gpu_volume->blocksCount() << "blocks on the device";
+    } else if (hash_volume) {
+        const size_t updated = hash_volume->updateMesh(configs.value("CPU_TSDF_SETTINGS/MIN_WEIGHT").toInt());
+        LOG_DEBUG("tsdf") << "Marching cubes over" << updated << "/" << hash_volume->blocksCount() << "changed blocks";
+        hash_volume->getMesh(_mesh);
+    } else {
+        calculate_octree_mesh(stream_ply, ply_filename);
+    }
+    LOG_INFO("tsdf") << "Done!";
+
+    if (keyframe_colorizer) {
+        PROFILE_ZONE("keyframe_coloring");
+        LOG_INFO("tsdf") << "Colouring the mesh from" << keyframe_colorizer->size() << "keyframes...";
+        keyframe_colorizer->colorMesh(_mesh);
+    }
+
+    if (save_ply && !stream_ply) {
+        LOG_INFO("tsdf") << "Saving" << ply_filename.toStdString().c_str() << "...";
+        pcl_io::save_one_polygon_mesh(ply_filename, _mesh, ply_binary);
+        LOG_INFO("tsdf") << "Done!";
+    }
+
+    if (configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_PCD").toBool()) {
+        QString filename = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_PCD_FILENAME").toString();
+        LOG_INFO("tsdf") << "Saving" << filename.toStdString().c_str() << "...";
+        PcdPtr vertices(new Pcd);
+        pcl::fromPCLPointCloud2(_mesh.cloud, *vertices);
+        pcl_io::save_one_point_cloud(filename, vertices,
+            configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/PCD_FORMAT").toString());
+        LOG_INFO("tsdf") << "Done!";
+    }
+
+    decimate_mesh(save_ply, ply_filename);
+}
+
+void VolumeReconstruction::decimate_mesh(const bool& save_ply, const QString& ply_filename)
+{
+    const QStringList lods = configs.value("CPU_TSDF_SETTINGS/DECIMATION_LODS").toStringList();
+    if (lods.isEmpty() || lods.front().isEmpty()) {
+        return;
+    }
+    if (_mesh.polygons.empty()) {
+        LOG_INFO("tsdf") << "Decimation skipped, the mesh was streamed or is empty";
+        return;
+    }
+
+    PROFILE_ZONE("mesh_decimation");
+    const MeshDecimator decimator(configs.value("CPU_TSDF_SETTINGS/DECIMATION_MAX_ERROR").toDouble(),
+        configs.value("CPU_TSDF_SETTINGS/DECIMATION_BLOCK_SIZE").toFloat());
+    const bool binary = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/PLY_FORMAT").toString() == "binary";
+    const size_t full_count = _mesh.polygons.size();
+
+    std::vector<pcl::PolygonMesh> levels(lods.size());
+    for (int i = 0; i < lods.size(); ++i) {
+        const pcl::PolygonMesh& previous = i == 0 ? _mesh : levels[i - 1];
+        const float ratio = lods[i].trimmed().toFloat() * float(full_count) / float(previous.polygons.size());
+        decimator.decimate(previous, std::min(1.0f, ratio), levels[i]);
+        LOG_INFO("tsdf") << "Level of detail" << i + 1 << ":" << levels[i].polygons.size() << "/" << full_count << "triangles";
+
+        if (save_ply) {
+            const QString lod_filename = QString(ply_filename).replace(".ply", QString("_lod%1.ply").arg(i + 1));
+            LOG_INFO("tsdf") << "Saving" << lod_filename.toStdString().c_str() << "...";
+            pcl_io::save_one_polygon_mesh(lod_filename, levels[i], binary);
+        }
+    }
+
+    if (configs.value("CPU_TSDF_SETTINGS/DECIMATION_PREVIEW").toBool()) {
+        _mesh = std::move(levels.front());
+    }
+}
+
+bool VolumeReconstruction::takePreviewMesh(pcl::PolygonMesh& mesh)
+{
+    std::lock_guard<std::mutex> lock(preview_mutex);
+    if (!preview_ready) {
+        return false;
+    }
+
+    mesh = preview;
+    preview_ready = false;
+    return true;
+}
+
+MemoryReport VolumeReconstruction::memoryReport()
+{
+    waitIntegration();
+    MemoryReport report = volume_memory_report();
+    memory_accounting::set(memory_accounting::TSDF, report.totalBytes());
+    memory_gauge_time = std::chrono::steady_clock::now();
+    if (gpu_volume) {
+        gpu_volume->deviceMemoryReport(report);
+    }
+
+    return report;
+}
+
+void VolumeReconstruction::publish_memory_gauge()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now - memory_gauge_time < MEMORY_GAUGE_INTERVAL) {
+        return;
+    }
+
+    memory_accounting::set(memory_accounting::TSDF, volume_memory_report().totalBytes());
+    memory_gauge_time = now;
+}
+
+MemoryReport VolumeReconstruction::volume_memory_report() const
+{
+    MemoryReport report;
+    if (hash_volume) {
+        hash_volume->memoryReport(report);
+    } else {
+        octree_memory_report(report);
+    }
+    if (color_layer) {
+        color_layer->memoryReport(report);
+    }
+    if (keyframe_colorizer) {
+        keyframe_colorizer->memoryReport(report);
+    }
+
+    return report;
+}
+
+bool VolumeReconstruction::canRenderModel() const
+{
+    return bool(hash_volume);
+}
+
+bool VolumeReconstruction::saveVolume(const QString& filename)
+{
+    if (!hash_volume) {
+        return false;
+    }
+
+    waitIntegration();
+    if (gpu_volume) {
+        gpu_volume->downloadBlocks();
+    }
+    return voxel_hash_file::save(filename, *hash_volume,
+        configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/VOL_COMPRESSION_LEVEL").toInt());
+}
+
+bool VolumeReconstruction::mergeVolume(const QString& filename)
+{
+    if (!hash_volume) {
+        return false;
+    }
+
+    const VoxelHashVolume::Ptr other = voxel_hash_file::load(filename);
+    if (!other) {
+        return false;
+    }
+
+    waitIntegration();
+    if (gpu_volume) {
+        gpu_volume->downloadBlocks();
+    }
+    hash_volume->merge(*other);
+    if (gpu_volume) {
+        gpu_volume->uploadBlocks();
+    }
+    publish_memory_gauge();
+    return true;
+}
+
+VoxelHashVolume::Ptr VolumeReconstruction::integrateSubmap(const PcdPtrVector& point_cloud_vector,
+    const Matrix4fVector& translation_matrix_vector, const Eigen::Matrix4f& anchor) const
+{
+    if (!hash_volume) {
+        return nullptr;
+    }
+
+    PROFILE_ZONE("tsdf_submap");
+    const VoxelHashVolume::Ptr submap = std::make_shared<VoxelHashVolume>(
+        hash_volume->voxelSize(), hash_volume->truncationDistance(), hash_volume->maxWeight());
+
+    const Eigen::Matrix4f to_anchor = anchor.inverse();
+    std::vector<CameraIntrinsics> intrinsics;
+    Matrix4fVector poses;
+    for (size_t i = 0; i < point_cloud_vector.size(); i++) {
+        intrinsics.push_back(hash_intrinsics_of(*point_cloud_vector[i]));
+        poses.push_back(to_anchor * translation_matrix_vector[i]);
+    }
+    submap->integrateClouds(point_cloud_vector, intrinsics, poses);
+
+    return submap;
+}
+
+bool VolumeReconstruction::fuseSubmap(const VoxelHashVolume& submap, const Eigen::Matrix4f& anchor)
+{
+    if (!hash_volume) {
+        return false;
+    }
+
+    waitIntegration();
+    PROFILE_ZONE("tsdf_submap_fusion");
+    if (gpu_volume) {
+        gpu_volume->downloadBlocks();
+    }
+    hash_volume->mergeTransformed(submap, anchor);
+    if (gpu_volume) {
+        gpu_volume->uploadBlocks();
+    }
+    publish_memory_gauge();
+    return true;
+}
+
+bool VolumeReconstruction::renderModel(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose,
+    const float& max_depth, std::vector<Eigen::Vector3f>& points, std::vector<Eigen::Vector3f>& normals)
+{
+    if (!hash_volume) {
+        return false;
+    }
+    if (integration_queue) {
+        integration_queue->wait();
+    }
+
+    if (gpu_volume) {
+        gpu_volume->raycastOnDevice(intrinsics, pose, max_depth, points, normals);
+    } else {
+        hash_volume->raycast(intrinsics, pose, max_depth, points, normals);
+    }
+    return true;
+}
+
+/** \brief Runs where the clouds are integrated, so the volume is never meshed while it changes. */
+void VolumeReconstruction::update_preview_mesh()
+{
+    if (!preview_mesh) {
+        return;
+    }
+
+    //The device meshes the whole volume faster than the host updates the changed blocks
+    pcl::PolygonMesh mesh;
+    if (gpu_volume) {
+        gpu_volume->extractMeshOnDevice(mesh, configs.value("CPU_TSDF_SETTINGS/MIN_WEIGHT").toInt());
+    } else {
+        hash_volume->updateMesh(configs.value("CPU_TSDF_SETTINGS/MIN_WEIGHT").toInt());
+        hash_volume->getMesh(mesh);
+    }
+
+    std::lock_guard<std::mutex> lock(preview_mutex);
+    preview = std::move(mesh);
+    preview_ready = true;
+}
+
+/** \brief The voxel hash volume integrates up to CPU_TSDF_SETTINGS/BATCH_SIZE clouds at once. */
+void VolumeReconstruction::integrate_batch(
+    const PcdPtrVector& point_cloud_vector,
+    const Matrix4fVector& translation_matrix_vector)
+{
+    if (!hash_volume) {
+        PROFILE_ZONE("tsdf_integration");
+        for (size_t i = 0; i < point_cloud_vector.size(); i++) {
+            integrate_octree_cloud(*point_cloud_vector[i], translation_matrix_vector[i]);
+            select_keyframe(*point_cloud_vector[i], translation_matrix_vector[i]);
+            LOG_DEBUG("tsdf") << "TSDF Integration" << i + 1 << "/" << point_cloud_vector.size();
+        }
+        publish_memory_gauge();
+        return;
+    }
+
+    integrate_staged_frames(stage_frames(point_cloud_vector, translation_matrix_vector));
+}
+
+VolumeReconstruction::StagedFrames VolumeReconstruction::stage_frames(
+    const PcdPtrVector& point_cloud_vector,
+    const Matrix4fVector& translation_matrix_vector) const
+{
+    PROFILE_ZONE("tsdf_staging");
+    StagedFrames frames;
+    frames.depths.resize(point_cloud_vector.size());
+    frames.colors.resize(point_cloud_vector.size());
+    frames.poses = translation_matrix_vector;
+    for (const PcdPtr& point_cloud : point_cloud_vector) {
+        frames.intrinsics.push_back(hash_intrinsics_of(*point_cloud));
+    }
+
+    ThreadPool::instance().parallel_for(0, point_cloud_vector.size(), [&](size_t i) {
+        VoxelHashVolume::readFrame(*point_cloud_vector[i], frames.depths[i], frames.colors[i]);
+    });
+
+    return frames;
+}
+
+void VolumeReconstruction::integrate_staged_frames(const StagedFrames& frames)
+{
+    PROFILE_ZONE("tsdf_integration");
+    const size_t count = frames.depths.size();
+    const size_t batch_size = size_t(std::max(1, configs.value("CPU_TSDF_SETTINGS/BATCH_SIZE").toInt()));
+    for (size_t begin = 0; begin < count; begin += batch_size) {
+        const size_t end = std::min(count, begin + batch_size);
+
+        const std::vector<cv::Mat> depths(frames.depths.begin() + begin, frames.depths.begin() + end);
+        const std::vector<cv::Mat> colors(frames.colors.begin() + begin, frames.colors.begin() + end);
+        const std::vector<CameraIntrinsics> intrinsics(frames.intrinsics.begin() + begin, frames.intrinsics.begin() + end);
+        const Matrix4fVector poses(frames.poses.begin() + begin, frames.poses.begin() + end);
+        if (gpu_volume) {
+            gpu_volume->integrateDepthsOnDevice(depths, colors, intrinsics, poses);
+        } else {
+            hash_volume->integrateDepths(depths, colors, intrinsics, poses);
+        }
+        LOG_DEBUG("tsdf") << "TSDF Integration" << end << "/" << count;
+    }
+    for (size_t i = 0; keyframe_colorizer && i < count; i++) {
+        if (keyframe_colorizer->isKeyframe(frames.poses[i])) {
+            keyframe_colorizer->addKeyframe(frames.depths[i], frames.colors[i], frames.intrinsics[i], frames.poses[i]);
+        }
+    }
+    publish_memory_gauge();
+}
+
+void VolumeReconstruction::integrate_octree_cloud(const Pcd& point_cloud, const Eigen::Matrix4f& translation_matrix)
+{
+    Eigen::Affine3d trans(Eigen::Affine3d::Identity());
+    trans.matrix() = translation_matrix.cast<double>();
+
+    const OpenMPLimit openmp_limit;
+    tsdf->integrateCloud(point_cloud, NormalPcd(), trans); // Integrate the cloud
+    if (color_layer) {
+        color_layer->integrateCloud(point_cloud, translation_matrix);
+    }
+}
+
+void VolumeReconstruction::select_keyframe(const Pcd& point_cloud, const Eigen::Matrix4f& translation_matrix)
+{
+    if (!keyframe_colorizer || !keyframe_colorizer->isKeyframe(translation_matrix)) {
+        return;
+    }
+
+    const CameraIntrinsics intrinsics = CameraIntrinsics::fromOrganizedCloud(point_cloud);
+    if (!intrinsics.isValid()) {
+        return;
+    }
+
+    cv::Mat depth, color;
+    VoxelHashVolume::readFrame(point_cloud, depth, color);
+    keyframe_colorizer->addKeyframe(depth, color, intrinsics, translation_matrix);
+}
+
+/** \brief Calibrated at the stream resolution and scaled to the cloud's, or fitted to the cloud. */
+CameraIntrinsics VolumeReconstruction::hash_intrinsics_of(const Pcd& point_cloud) const
+{
+    if (!hash_intrinsics.isValid()) {
+        const CameraIntrinsics intrinsics = CameraIntrinsics::fromOrganizedCloud(point_cloud);
+        if (!intrinsics.isValid()) {
+            throw std::invalid_argument("VolumeReconstruction::hash_intrinsics_of cloud is not organized");
+        }
+        return intrinsics;
+    }
+
+    CameraIntrinsics intrinsics = hash_intrinsics;
+    const float scale_u = float(point_cloud.width) / hash_intrinsics.width;
+    const float scale_v = float(point_cloud.height) / hash_intrinsics.height;
+    intrinsics.width = point_cloud.width;
+    intrinsics.height = point_cloud.height;
+    intrinsics.fx *= scale_u;
+    intrinsics.cx *= scale_u;
+    intrinsics.fy *= scale_v;
+    intrinsics.cy *= scale_v;
+
+    return intrinsics;
+}
+
+void VolumeReconstruction::load_hash_intrinsics()
+{
+    const QString source = configs.value("CPU_TSDF_SETTINGS/INTRINSICS").toString();
+    if (source != "CAMERA_PARAMS" && source != "CAMERA_MATRIX") {
+        return;
+    }
+
+    const QString filename = QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+        + (source == "CAMERA_PARAMS"
+                  ? configs.value("ARUCO_SETTINGS/CAMERA_PARAMS_FILE_NAME").toString()
+                  : configs.value("OPENNI_SETTINGS/CALIB_MATRIX_NAME").toString());
+
+    cv::FileStorage storage(filename.toStdString(), cv::FileStorage::READ);
+    cv::Mat camera_matrix;
+    if (storage.isOpened()) {
+        storage["camera_matrix"] >> camera_matrix;
+    }
+    if (camera_matrix.rows != 3 || camera_matrix.cols != 3) {
+        LOG_WARNING("tsdf") << "Cannot load camera matrix from" << filename << ", fitting intrinsics to the clouds";
+        return;
+    }
+    camera_matrix.convertTo(camera_matrix, CV_32F);
+
+    //Only camera_params.yml stores the image size, the matrices are calibrated on the 640x480 stream
+    int width = 640, height = 480;
+    if (!storage["image_width"].empty() && !storage["image_height"].empty()) {
+        storage["image_width"] >> width;
+        storage["image_height"] >> height;
+    }
+
+    hash_intrinsics.width = unsigned(width);
+    hash_intrinsics.height = unsigned(height);
+    hash_intrinsics.fx = camera_matrix.at<float>(0, 0);
+    hash_intrinsics.fy = -camera_matrix.at<float>(1, 1);
+    hash_intrinsics.cx = camera_matrix.at<float>(0, 2);
+    hash_intrinsics.cy = camera_matrix.at<float>(1, 2);
+}
+
+void VolumeReconstruction::calculate_octree_mesh(const bool& stream_ply, const QString& ply_filename)
+{
+    std::unique_ptr<PlyStreamWriter> ply_writer;
+    std::unique_ptr<cpu_tsdf::MarchingCubesTSDFOctree> mc;
+    if (stream_ply) {
+        LOG_INFO("tsdf") << "Streaming" << ply_filename.toStdString().c_str() << "...";
+        ply_writer.reset(new PlyStreamWriter(ply_filename));
+        //The streamed chunks are released once written, the mesh is not kept in memory
+        StreamingMarchingCubesTSDFOctree* streaming = new StreamingMarchingCubesTSDFOctree(ply_writer.get(),
+            configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/PLY_STREAMING_CHUNK_SIZE").toUInt(), false);
+        streaming->setColorLayer(color_layer.get());
+        mc.reset(streaming);
+    } else if (configs.value("CPU_TSDF_SETTINGS/PARALLEL_MARCHING_CUBES").toBool()) {
+        mc.reset(new ParallelMarchingCubesTSDFOctree);
+    } else {
+        mc.reset(new cpu_tsdf::MarchingCubesTSDFOctree);
+    }
+    mc->setInputTSDF(tsdf);
     const int& min_weight = configs.value("CPU_TSDF_SETTINGS/MIN_WEIGHT").toInt();
-    mc.setMinWeight(min_weight); // Sets the minimum weight -- i.e. if a voxel sees a point less than 2 times, it will not render  a mesh triangle at that location
-    mc.setColorByRGB(true); // If true, tries to use the RGB values of the TSDF for meshing -- required if you want a colored mesh
-    mc.reconstruct(_mesh);
-    qDebug() << "Done!";
+    mc->setMinWeight(min_weight); // Sets the minimum weight -- i.e. if a voxel sees a point less than 2 times, it will not render  a mesh triangle at that location
+    mc->setColorByRGB(!keyframe_colorizer); // If true, tries to use the RGB values of the TSDF for meshing -- required if you want a colored mesh
+    mc->reconstruct(_mesh);
+    if (ply_writer && !ply_writer->close()) {
+        LOG_WARNING("tsdf") << "Can't write" << ply_filename.toStdString().c_str();
+    }
 
-    if (configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/SAVE_PLY").toBool()) {
-        QString filename = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_PLY_FILENAME").toString();
-        qDebug() << "Saving" << filename.toStdString().c_str() << "...";
-        pcl_io::save_one_polygon_mesh(filename, _mesh);
-        qDebug() << "Done!";
+    //Streamed chunks are coloured as they are written
+    if (color_layer && !stream_ply) {
+        color_layer->colorMesh(_mesh);
     }
 }
 
+void VolumeReconstruction::octree_memory_report(MemoryReport& report) const
+{
+    OctreeCounts counts;
+    count_octree_nodes(tsdf->octree_->getRoot().get(), counts);
+
+    report.add("octree internal nodes", counts.internal_nodes, counts.internal_bytes);
+    report.add("octree leaves", counts.leaves, counts.leaf_bytes);
+    report.add("octree child pointers", counts.children, counts.children_bytes);
+}
+
 void VolumeReconstruction::getPoligonMesh(
     pcl::PolygonMesh& mesh)
 {
@@ -0,0 +1,206 @@
+#include "core/reconstruction/voxelcolorlayer.h"
+
+#include <pcl/common/point_tests.h>
+#include <pcl/conversions.h>
+
+#include <Eigen/LU>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+const size_t INITIAL_CAPACITY = 1 << 16;
+
+//Rehashed to twice the size past this load
+const double MAX_LOAD = 0.7;
+
+} // namespace
+
+VoxelColorLayer::VoxelColorLayer(const Eigen::Vector3f& grid_size_, const Eigen::Vector3i& resolution_,
+    const Eigen::Matrix4f& volume_to_world, const int& max_weight_)
+    : grid_size(grid_size_)
+    , resolution(resolution_)
+    , world_to_volume(volume_to_world.inverse())
+    , max_weight(uint8_t(std::max(1, std::min(max_weight_, 255))))
+    , used(0)
+{
+    if ((resolution.array() <= 0).any() || (grid_size.array() <= 0).any()) {
+        throw std::invalid_argument("VoxelColorLayer::VoxelColorLayer grid is empty");
+    }
+    if (double(resolution.x()) * resolution.y() * resolution.z() >= double(EMPTY_KEY)) {
+        throw std::invalid_argument("VoxelColorLayer::VoxelColorLayer resolution does not fit 32 bit voxel keys");
+    }
+
+    reset();
+}
+
+void VoxelColorLayer::reset()
+{
+    keys.assign(INITIAL_CAPACITY, EMPTY_KEY);
+    colors.assign(INITIAL_CAPACITY, Color());
+    used = 0;
+}
+
+void VoxelColorLayer::integrateCloud(const Pcd& cloud, const Eigen::Matrix4f& pose)
+{
+    const Eigen::Matrix4f camera_to_volume = world_to_volume * pose;
+    for (const PointType& point : cloud.points) {
+        if (!pcl::isFinite(point)) {
+            continue;
+        }
+
+        Eigen::Vector3i voxel;
+        const Eigen::Vector3f local = (camera_to_volume * Eigen::Vector4f(point.x, point.y, point.z, 1)).head<3>();
+        if (!voxel_of_point(local, voxel)) {
+            continue;
+        }
+
+        //Running average as in cpu_tsdf::RGBNode, the weight saturates so that the colour keeps adapting
+        Color& color = insert(voxel_key(voxel));
+        const float weight = color.weight;
+        const float sum = weight + 1;
+        color.r = uint8_t((weight * color.r + point.r) / sum);
+        color.g = uint8_t((weight * color.g + point.g) / sum);
+        color.b = uint8_t((weight * color.b + point.b) / sum);
+        color.weight = uint8_t(std::min<int>(max_weight, color.weight + 1));
+    }
+}
+
+bool VoxelColorLayer::color(const Eigen::Vector3f& point, uint8_t& r, uint8_t& g, uint8_t& b) const
+{
+    Eigen::Vector3i voxel;
+    const Eigen::Vector3f local = (world_to_volume * Eigen::Vector4f(point.x(), point.y(), point.z(), 1)).head<3>();
+    if (!voxel_of_point(local, voxel)) {
+        return false;
+    }
+
+    const Color* exact = find(voxel);
+    if (exact) {
+        r = exact->r;
+        g = exact->g;
+        b = exact->b;
+        return true;
+    }
+
+    //Vertices sit between voxel centres, the surface voxel holding the points may be the next one
+    float sum[3] = { 0, 0, 0 };
+    float weight = 0;
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                const Eigen::Vector3i neighbour = voxel + Eigen::Vector3i(dx, dy, dz);
+                if ((neighbour.array() < 0).any() || (neighbour.array() >= resolution.array()).any()) {
+                    continue;
+                }
+                const Color* color = find(neighbour);
+                if (color) {
+                    sum[0] += float(color->weight) * color->r;
+                    sum[1] += float(color->weight) * color->g;
+                    sum[2] += float(color->weight) * color->b;
+                    weight += color->weight;
+                }
+            }
+        }
+    }
+    if (weight == 0) {
+        return false;
+    }
+
+    r = uint8_t(sum[0] / weight + 0.5f);
+    g = uint8_t(sum[1] / weight + 0.5f);
+    b = uint8_t(sum[2] / weight + 0.5f);
+    return true;
+}
+
+void VoxelColorLayer::colorVertices(pcl::PointCloud<pcl::PointXYZRGB>& vertices) const
+{
+    for (pcl::PointXYZRGB& vertex : vertices.points) {
+        color(vertex.getVector3fMap(), vertex.r, vertex.g, vertex.b);
+    }
+}
+
+void VoxelColorLayer::colorMesh(pcl::PolygonMesh& mesh) const
+{
+    pcl::PointCloud<pcl::PointXYZRGB> vertices;
+    pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+    colorVertices(vertices);
+    pcl::toPCLPointCloud2(vertices, mesh.cloud);
+}
+
+size_t VoxelColorLayer::size() const
+{
+    return used;
+}
+
+void VoxelColorLayer::memoryReport(MemoryReport& report) const
+{
+    report.add("colour layer voxels", used, MemoryReport::vectorBytes(keys) + MemoryReport::vectorBytes(colors));
+}
+
+bool VoxelColorLayer::voxel_of_point(const Eigen::Vector3f& point, Eigen::Vector3i& voxel) const
+{
+    for (int i = 0; i < 3; ++i) {
+        voxel[i] = int(std::floor((point[i] + grid_size[i] / 2) / grid_size[i] * resolution[i]));
+    }
+
+    return (voxel.array() >= 0).all() && (voxel.array() < resolution.array()).all();
+}
+
+uint32_t VoxelColorLayer::voxel_key(const Eigen::Vector3i& voxel) const
+{
+    return uint32_t(voxel.x()) + uint32_t(resolution.x()) * (uint32_t(voxel.y()) + uint32_t(resolution.y()) * uint32_t(voxel.z()));
+}
+
+size_t VoxelColorLayer::find_slot(const uint32_t& key) const
+{
+    //Capacity is a power of two, Fibonacci hashing spreads the neighbouring keys of a surface
+    const size_t mask = keys.size() - 1;
+    size_t slot = size_t(uint64_t(key) * 11400714819323198485ull >> 32) & mask;
+    while (keys[slot] != key && keys[slot] != EMPTY_KEY) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+const VoxelColorLayer::Color* VoxelColorLayer::find(const Eigen::Vector3i& voxel) const
+{
+    const size_t slot = find_slot(voxel_key(voxel));
+    return keys[slot] == EMPTY_KEY ? nullptr : &colors[slot];
+}
+
+VoxelColorLayer::Color& VoxelColorLayer::insert(const uint32_t& key)
+{
+    size_t slot = find_slot(key);
+    if (keys[slot] == key) {
+        return colors[slot];
+    }
+
+    if (double(used + 1) > MAX_LOAD * keys.size()) {
+        rehash(keys.size() * 2);
+        slot = find_slot(key);
+    }
+
+    keys[slot] = key;
+    colors[slot] = Color();
+    ++used;
+    return colors[slot];
+}
+
+void VoxelColorLayer::rehash(const size_t& capacity)
+{
+    std::vector<uint32_t> old_keys(capacity, EMPTY_KEY);
+    std::vector<Color> old_colors(capacity, Color());
+    old_keys.swap(keys);
+    old_colors.swap(colors);
+
+    for (size_t i = 0; i < old_keys.size(); ++i) {
+        if (old_keys[i] != EMPTY_KEY) {
+            const size_t slot = find_slot(old_keys[i]);
+            keys[slot] = old_keys[i];
+            colors[slot] = old_colors[i];
+        }
+    }
+}
@@ -0,0 +1,1194 @@
+#include "core/reconstruction/voxelhashvolume.h"
+
+#include <pcl/conversions.h>
+#include <pcl/surface/marching_cubes.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "core/reconstruction/marchingcubestables.h"
+#include "utility/cpufeatures.h"
+#include "utility/depthplane.h"
+#include "utility/halffloat.h"
+#include "utility/threadpool.h"
+
+#include <immintrin.h>
+
+namespace {
+
+inline int floor_div(const int& value, const int& divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+/** \brief BGR bytes of the points, through a header over the cloud as in DepthPlane. */
+void read_color(const Pcd& cloud, cv::Mat& color)
+{
+    const PointType point = PointType();
+    const int b = int(reinterpret_cast<const uint8_t*>(&point.b) - reinterpret_cast<const uint8_t*>(&point));
+    const int g = int(reinterpret_cast<const uint8_t*>(&point.g) - reinterpret_cast<const uint8_t*>(&point));
+    const int r = int(reinterpret_cast<const uint8_t*>(&point.r) - reinterpret_cast<const uint8_t*>(&point));
+
+    const cv::Mat points(int(cloud.height), int(cloud.width), CV_8UC(int(sizeof(PointType))),
+        const_cast<PointType*>(cloud.points.data()));
+    color.create(points.rows, points.cols, CV_8UC3);
+    const int from_to[] = { b, 0, g, 1, r, 2 };
+    cv::mixChannels(&points, 1, &color, 1, from_to, 3);
+}
+
+float max_depth(const cv::Mat& depth)
+{
+    float result = 0;
+    for (int v = 0; v < depth.rows; ++v) {
+        const float* row = depth.ptr<float>(v);
+        for (int u = 0; u < depth.cols; ++u) {
+            result = row[u] > result ? row[u] : result;
+        }
+    }
+
+    return result;
+}
+
+/** \brief Camera space first voxel of a row and step to the next one, fx, fy, cx + 0.5 and cy + 0.5. */
+struct RowProjection {
+    float first[3];
+    float step[3];
+    float camera[4];
+};
+
+typedef void (*ProjectRowFunction)(const RowProjection&, float*, float*, float*);
+
+const int ROW_SIZE = VoxelHashVolume::BLOCK_SIZE;
+
+//SSE2 is a part of x86-64, the compiler vectorizes the loop
+void project_row_sse(const RowProjection& row, float* z_camera, float* u, float* v)
+{
+    for (int x = 0; x < ROW_SIZE; ++x) {
+        const float x_camera = row.first[0] + row.step[0] * x;
+        const float y_camera = row.first[1] + row.step[1] * x;
+        z_camera[x] = row.first[2] + row.step[2] * x;
+
+        const float inverse_z = 1.0f / z_camera[x];
+        u[x] = row.camera[0] * x_camera * inverse_z + row.camera[2];
+        v[x] = row.camera[1] * y_camera * inverse_z + row.camera[3];
+    }
+}
+
+//A row of a block is one register
+CPU_TARGET("avx2")
+void project_row_avx2(const RowProjection& row, float* z_camera, float* u, float* v)
+{
+    static_assert(ROW_SIZE == 8, "project_row_avx2 takes rows of 8 voxels");
+
+    const __m256 index = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 x_camera = _mm256_add_ps(_mm256_set1_ps(row.first[0]), _mm256_mul_ps(_mm256_set1_ps(row.step[0]), index));
+    const __m256 y_camera = _mm256_add_ps(_mm256_set1_ps(row.first[1]), _mm256_mul_ps(_mm256_set1_ps(row.step[1]), index));
+    const __m256 z = _mm256_add_ps(_mm256_set1_ps(row.first[2]), _mm256_mul_ps(_mm256_set1_ps(row.step[2]), index));
+
+    const __m256 inverse_z = _mm256_div_ps(_mm256_set1_ps(1.0f), z);
+    _mm256_storeu_ps(z_camera, z);
+    _mm256_storeu_ps(u, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(row.camera[0]), x_camera), inverse_z),
+                            _mm256_set1_ps(row.camera[2])));
+    _mm256_storeu_ps(v, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(row.camera[1]), y_camera), inverse_z),
+                            _mm256_set1_ps(row.camera[3])));
+}
+
+ProjectRowFunction selected_project_row()
+{
+    static const ProjectRowFunction selected = cpu_features::hasAvx2() ? project_row_avx2 : project_row_sse;
+    return selected;
+}
+
+} // namespace
+
+VoxelHashVolume::VoxelHashVolume(const float& voxel_size_, const float& truncation_distance_, const int& max_weight_)
+    : voxel_size(voxel_size_)
+    , truncation_distance(truncation_distance_)
+    , max_weight(uint8_t(std::max(1, std::min(255, max_weight_))))
+    , mesh_min_weight(-1)
+    , max_resident_blocks(0)
+    , last_camera(Eigen::Vector3f::Zero())
+{
+    if (voxel_size <= 0 || truncation_distance <= 0) {
+        throw std::invalid_argument("VoxelHashVolume::VoxelHashVolume voxel_size <= 0 || truncation_distance <= 0");
+    }
+}
+
+void VoxelHashVolume::reset()
+{
+    blocks.clear();
+    block_coordinates.clear();
+    block_map.clear();
+    block_slots.clear();
+    slot_blocks.clear();
+    free_slots.clear();
+
+    dirty_blocks.clear();
+    mesh_min_weight = -1;
+    block_triangles.clear();
+    mesh_vertices.clear();
+    vertex_references.clear();
+    vertex_edges.clear();
+    free_vertices.clear();
+    edge_vertices.clear();
+}
+
+void VoxelHashVolume::setMemoryBudget(const size_t& max_resident_blocks_, const std::string& store_filename)
+{
+    max_resident_blocks = max_resident_blocks_;
+    if (max_resident_blocks > 0 && !store) {
+        store.reset(new BlockStore(store_filename, sizeof(Block)));
+    }
+
+    evict_to_budget();
+}
+
+void VoxelHashVolume::integrateCloud(const Pcd& cloud, const Eigen::Matrix4f& pose)
+{
+    const CameraIntrinsics intrinsics = CameraIntrinsics::fromOrganizedCloud(cloud);
+    if (!intrinsics.isValid()) {
+        throw std::invalid_argument("VoxelHashVolume::integrateCloud cloud is not organized");
+    }
+
+    integrateCloud(cloud, intrinsics, pose);
+}
+
+void VoxelHashVolume::integrateCloud(const Pcd& cloud, const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose)
+{
+    thread_local DepthPlane depth;
+    thread_local cv::Mat color;
+    depth.read(cloud);
+    read_color(cloud, color);
+
+    integrateDepth(depth.mat(), color, intrinsics, pose);
+}
+
+void VoxelHashVolume::integrateDepth(const cv::Mat& depth, const cv::Mat& color, const CameraIntrinsics& intrinsics,
+    const Eigen::Matrix4f& pose)
+{
+    integrate_frames(std::vector<cv::Mat>(1, depth), std::vector<cv::Mat>(1, color),
+        std::vector<CameraIntrinsics>(1, intrinsics), Matrix4fVector(1, pose));
+}
+
+void VoxelHashVolume::integrateClouds(const PcdPtrVector& clouds, const std::vector<CameraIntrinsics>& intrinsics,
+    const Matrix4fVector& poses)
+{
+    if (clouds.size() != intrinsics.size() || clouds.size() != poses.size()) {
+        throw std::invalid_argument("VoxelHashVolume::integrateClouds clouds, intrinsics and poses sizes differ");
+    }
+
+    std::vector<cv::Mat> depths(clouds.size()), colors(clouds.size());
+    ThreadPool::instance().parallel_for(0, clouds.size(), [&](size_t i) {
+        readFrame(*clouds[i], depths[i], colors[i]);
+    });
+
+    integrate_frames(depths, colors, intrinsics, poses);
+}
+
+void VoxelHashVolume::readFrame(const Pcd& cloud, cv::Mat& depth, cv::Mat& color)
+{
+    DepthPlane plane;
+    plane.read(cloud);
+    depth = plane.mat();
+    read_color(cloud, color);
+}
+
+void VoxelHashVolume::integrateDepths(const std::vector<cv::Mat>& depths, const std::vector<cv::Mat>& colors,
+    const std::vector<CameraIntrinsics>& intrinsics, const Matrix4fVector& poses)
+{
+    if (depths.size() != colors.size() || depths.size() != intrinsics.size() || depths.size() != poses.size()) {
+        throw std::invalid_argument("VoxelHashVolume::integrateDepths depths, colors, intrinsics and poses sizes differ");
+    }
+
+    integrate_frames(depths, colors, intrinsics, poses);
+}
+
+/** \brief Blocks are extracted in parallel and merged in block order, a vertex shared by several
+  * cubes is kept once.
+  */
+void VoxelHashVolume::extractMesh(pcl::PolygonMesh& mesh, const int& min_weight)
+{
+    std::vector<uint32_t> indices(block_coordinates.size());
+    for (uint32_t i = 0; i < indices.size(); ++i) {
+        indices[i] = i;
+    }
+
+    std::vector<std::vector<MeshVertex> > block_vertices;
+    std::vector<std::vector<uint64_t> > block_edges;
+    extract_blocks(indices, min_weight, block_vertices, block_edges);
+
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> triangles;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        for (size_t j = 0; j < block_vertices[i].size(); ++j) {
+            const auto inserted = ids.insert(std::make_pair(block_edges[i][j], uint32_t(vertices.size())));
+            if (inserted.second) {
+                vertices.push_back(block_vertices[i][j]);
+            }
+            triangles.push_back(inserted.first->second);
+        }
+    }
+
+    to_polygon_mesh(vertices, triangles, mesh);
+}
+
+size_t VoxelHashVolume::updateMesh(const int& min_weight)
+{
+    if (min_weight != mesh_min_weight) {
+        std::fill(dirty_blocks.begin(), dirty_blocks.end(), 1);
+        mesh_min_weight = min_weight;
+    }
+    block_triangles.resize(block_coordinates.size());
+
+    //Cubes of a block read the blocks one step up every axis, so the blocks one step down are stale too
+    std::vector<uint8_t> stale(block_coordinates.size(), 0);
+    for (uint32_t i = 0; i < block_coordinates.size(); ++i) {
+        if (!dirty_blocks[i]) {
+            continue;
+        }
+        for (int c = 0; c < 8; ++c) {
+            const int* offset = marching_cubes_tables::CORNER_OFFSETS[c];
+            const int neighbour = find_block(block_coordinates[i] - Eigen::Vector3i(offset[0], offset[1], offset[2]));
+            if (neighbour >= 0) {
+                stale[neighbour] = 1;
+            }
+        }
+    }
+
+    std::vector<uint32_t> stale_blocks;
+    std::vector<uint32_t> released;
+    for (uint32_t i = 0; i < block_coordinates.size(); ++i) {
+        if (!stale[i]) {
+            continue;
+        }
+        stale_blocks.push_back(i);
+        for (const uint32_t& vertex : block_triangles[i]) {
+            if (--vertex_references[vertex] == 0) {
+                released.push_back(vertex);
+            }
+        }
+        block_triangles[i].clear();
+    }
+
+    std::vector<std::vector<MeshVertex> > vertices;
+    std::vector<std::vector<uint64_t> > edges;
+    extract_blocks(stale_blocks, min_weight, vertices, edges);
+
+    //Merged in block order, so the ids do not depend on the number of threads
+    for (size_t i = 0; i < stale_blocks.size(); ++i) {
+        std::vector<uint32_t>& triangles = block_triangles[stale_blocks[i]];
+        triangles.reserve(vertices[i].size());
+        for (size_t j = 0; j < vertices[i].size(); ++j) {
+            triangles.push_back(acquire_vertex(edges[i][j], vertices[i][j]));
+        }
+    }
+
+    //Vertices whose edge no longer crosses the surface
+    for (const uint32_t& vertex : released) {
+        if (vertex_references[vertex] == 0) {
+            edge_vertices.erase(vertex_edges[vertex]);
+            free_vertices.push_back(vertex);
+        }
+    }
+
+    std::fill(dirty_blocks.begin(), dirty_blocks.end(), 0);
+    return stale_blocks.size();
+}
+
+void VoxelHashVolume::getMesh(pcl::PolygonMesh& mesh) const
+{
+    std::vector<uint32_t> triangles;
+    for (const std::vector<uint32_t>& block : block_triangles) {
+        triangles.insert(triangles.end(), block.begin(), block.end());
+    }
+
+    to_polygon_mesh(mesh_vertices, triangles, mesh);
+}
+
+void VoxelHashVolume::raycast(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose, const float& max_depth,
+    std::vector<Eigen::Vector3f>& points, std::vector<Eigen::Vector3f>& normals) const
+{
+    if (!intrinsics.isValid()) {
+        throw std::invalid_argument("VoxelHashVolume::raycast !intrinsics.isValid()");
+    }
+
+    const Eigen::Vector3f invalid = Eigen::Vector3f::Constant(std::numeric_limits<float>::quiet_NaN());
+    points.assign(size_t(intrinsics.width) * intrinsics.height, invalid);
+    normals.assign(points.size(), invalid);
+
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f origin = pose.block<3, 1>(0, 3);
+    ThreadPool::instance().parallel_for(0, intrinsics.height, [&](size_t v) {
+        for (size_t u = 0; u < intrinsics.width; ++u) {
+            //Unit depth ray, so the depth marched is the camera z of the surface
+            const Eigen::Vector3f camera_ray = intrinsics.backproject(float(u), float(v), 1.0f);
+            const Eigen::Vector3f ray = rotation * camera_ray;
+            float depth;
+            if (!march_ray(origin, ray, max_depth, depth)) {
+                continue;
+            }
+
+            //Central differences of the TSDF, pointing from the surface to the free space in front of it
+            const Eigen::Vector3f point = origin + ray * depth;
+            Eigen::Vector3f gradient;
+            bool has_gradient = true;
+            for (int axis = 0; axis < 3 && has_gradient; ++axis) {
+                Eigen::Vector3f offset = Eigen::Vector3f::Zero();
+                offset[axis] = voxel_size;
+                float forward, backward;
+                has_gradient = interpolate_tsdf(point + offset, forward) && interpolate_tsdf(point - offset, backward);
+                gradient[axis] = forward - backward;
+            }
+            if (!has_gradient || !(gradient.squaredNorm() > 0)) {
+                continue;
+            }
+
+            const size_t index = v * intrinsics.width + u;
+            points[index] = camera_ray * depth;
+            normals[index] = (rotation.transpose() * gradient).normalized();
+        }
+    });
+}
+
+float VoxelHashVolume::voxelSize() const
+{
+    return voxel_size;
+}
+
+float VoxelHashVolume::truncationDistance() const
+{
+    return truncation_distance;
+}
+
+size_t VoxelHashVolume::blocksCount() const
+{
+    return block_coordinates.size();
+}
+
+size_t VoxelHashVolume::residentBlocksCount() const
+{
+    return blocks.size() - free_slots.size();
+}
+
+void VoxelHashVolume::memoryReport(MemoryReport& report) const
+{
+    report.add("resident blocks", residentBlocksCount(), MemoryReport::vectorBytes(blocks));
+    report.add("block index", block_coordinates.size(),
+        MemoryReport::vectorBytes(block_coordinates) + MemoryReport::hashMapBytes(block_map)
+            + MemoryReport::vectorBytes(block_slots) + MemoryReport::vectorBytes(slot_blocks)
+            + MemoryReport::vectorBytes(free_slots) + MemoryReport::vectorBytes(dirty_blocks));
+
+    size_t triangles_count = 0;
+    size_t triangle_bytes = MemoryReport::vectorBytes(block_triangles);
+    for (const std::vector<uint32_t>& triangles : block_triangles) {
+        triangles_count += triangles.size() / 3;
+        triangle_bytes += MemoryReport::vectorBytes(triangles);
+    }
+    report.add("mesh triangles", triangles_count, triangle_bytes);
+    report.add("mesh vertices", mesh_vertices.size(),
+        MemoryReport::vectorBytes(mesh_vertices) + MemoryReport::vectorBytes(vertex_references)
+            + MemoryReport::vectorBytes(vertex_edges) + MemoryReport::vectorBytes(free_vertices)
+            + MemoryReport::hashMapBytes(edge_vertices));
+}
+
+int VoxelHashVolume::maxWeight() const
+{
+    return max_weight;
+}
+
+const Eigen::Vector3i& VoxelHashVolume::blockCoordinates(const uint32_t& index) const
+{
+    return block_coordinates[index];
+}
+
+void VoxelHashVolume::readBlock(const uint32_t& index, Block& block) const
+{
+    if (block_slots[index] >= 0) {
+        block = blocks[block_slots[index]];
+    } else {
+        store->read(index, &block);
+    }
+}
+
+void VoxelHashVolume::setBlock(const Eigen::Vector3i& coordinates, const Block& block)
+{
+    const uint32_t index = allocate_block(coordinates);
+    page_in(std::vector<uint32_t>(1, index));
+    resident_block(index) = block;
+    dirty_blocks[index] = 1;
+
+    evict_to_budget();
+}
+
+void VoxelHashVolume::merge(const VoxelHashVolume& other)
+{
+    if (other.voxel_size != voxel_size || other.truncation_distance != truncation_distance) {
+        throw std::invalid_argument(
+            "VoxelHashVolume::merge other.voxel_size != voxel_size || other.truncation_distance != truncation_distance");
+    }
+
+    Block block;
+    for (uint32_t i = 0; i < uint32_t(other.blocksCount()); ++i) {
+        other.readBlock(i, block);
+        const int found = find_block(other.blockCoordinates(i));
+        if (found < 0) {
+            setBlock(other.blockCoordinates(i), block);
+            continue;
+        }
+
+        const uint32_t index = uint32_t(found);
+        page_in(std::vector<uint32_t>(1, index));
+        Block& target = resident_block(index);
+        fuse_block(block, target);
+        dirty_blocks[index] = 1;
+
+        evict_to_budget();
+    }
+}
+
+/** \brief Target blocks are those overlapping the bounds of a transformed observed block of the other
+  * volume. Every voxel centre is taken back into the other volume and sampled there, in parallel over
+  * chunks of blocks, then the sampled blocks are fused one after another.
+  */
+void VoxelHashVolume::mergeTransformed(const VoxelHashVolume& other, const Eigen::Matrix4f& transformation)
+{
+    if (other.voxel_size != voxel_size || other.truncation_distance != truncation_distance) {
+        throw std::invalid_argument(
+            "VoxelHashVolume::mergeTransformed other.voxel_size != voxel_size || other.truncation_distance != truncation_distance");
+    }
+    if (transformation.hasNaN()) {
+        throw std::invalid_argument("VoxelHashVolume::mergeTransformed transformation.hasNaN()");
+    }
+    if (transformation.isIdentity()) {
+        merge(other);
+        return;
+    }
+
+    const float block_extent = float(BLOCK_SIZE) * voxel_size;
+    std::vector<Eigen::Vector3i> targets;
+    std::unordered_map<uint64_t, uint32_t> target_map;
+    Block block;
+    for (uint32_t i = 0; i < uint32_t(other.blocksCount()); ++i) {
+        other.readBlock(i, block);
+        const bool observed = std::any_of(block.voxels, block.voxels + BLOCK_VOXELS,
+            [](const Voxel& voxel) { return voxel.weight > 0; });
+        if (!observed) {
+            continue;
+        }
+
+        Eigen::Vector3f min_point = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+        Eigen::Vector3f max_point = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+        for (int c = 0; c < 8; ++c) {
+            const int* offset = marching_cubes_tables::CORNER_OFFSETS[c];
+            const Eigen::Vector3f corner
+                = (other.blockCoordinates(i) + Eigen::Vector3i(offset[0], offset[1], offset[2])).cast<float>() * block_extent;
+            const Eigen::Vector3f point = transformation.block<3, 3>(0, 0) * corner + transformation.block<3, 1>(0, 3);
+            min_point = min_point.cwiseMin(point);
+            max_point = max_point.cwiseMax(point);
+        }
+
+        const Eigen::Vector3i first = voxel_of_point(min_point / float(BLOCK_SIZE));
+        const Eigen::Vector3i last = voxel_of_point(max_point / float(BLOCK_SIZE));
+        for (int z = first.z(); z <= last.z(); ++z) {
+            for (int y = first.y(); y <= last.y(); ++y) {
+                for (int x = first.x(); x <= last.x(); ++x) {
+                    const Eigen::Vector3i target(x, y, z);
+                    if (target_map.insert(std::make_pair(block_key(target), uint32_t(targets.size()))).second) {
+                        targets.push_back(target);
+                    }
+                }
+            }
+        }
+    }
+
+    //Rigid, so the inverse rotation is the transpose
+    const Eigen::Matrix3f rotation = transformation.block<3, 3>(0, 0).transpose();
+    const Eigen::Vector3f translation = -rotation * transformation.block<3, 1>(0, 3);
+
+    //Sampled blocks of a chunk are a few megabytes at most
+    const size_t chunk_size = 4096;
+    std::vector<Block> sampled;
+    std::vector<uint8_t> observed;
+    for (size_t begin = 0; begin < targets.size(); begin += chunk_size) {
+        const size_t end = std::min(targets.size(), begin + chunk_size);
+        sampled.resize(end - begin);
+        observed.assign(end - begin, 0);
+
+        ThreadPool::instance().parallel_for(begin, end, [&](size_t t) {
+            Block& target = sampled[t - begin];
+            for (int v = 0; v < BLOCK_VOXELS; ++v) {
+                const Eigen::Vector3i local(v % BLOCK_SIZE, (v / BLOCK_SIZE) % BLOCK_SIZE, v / (BLOCK_SIZE * BLOCK_SIZE));
+                const Eigen::Vector3f centre
+                    = ((targets[t] * BLOCK_SIZE + local).cast<float>() + Eigen::Vector3f::Constant(0.5f)) * voxel_size;
+                if (other.sample_voxel(rotation * centre + translation, target.voxels[v])) {
+                    observed[t - begin] = 1;
+                } else {
+                    target.voxels[v].weight = 0;
+                }
+            }
+        });
+
+        for (size_t t = begin; t < end; ++t) {
+            if (!observed[t - begin]) {
+                continue;
+            }
+
+            const uint32_t index = allocate_block(targets[t]);
+            page_in(std::vector<uint32_t>(1, index));
+            fuse_block(sampled[t - begin], resident_block(index));
+            dirty_blocks[index] = 1;
+
+            evict_to_budget();
+        }
+    }
+}
+
+void VoxelHashVolume::fuse_block(const Block& source_block, Block& target) const
+{
+    for (int v = 0; v < BLOCK_VOXELS; ++v) {
+        const Voxel& source = source_block.voxels[v];
+        Voxel& voxel = target.voxels[v];
+        if (source.weight == 0) {
+            continue;
+        }
+
+        const float weight = voxel.weight;
+        const float updated_weight = weight + source.weight;
+        voxel.tsdf = half_float::fromFloat(
+            (half_float::toFloat(voxel.tsdf) * weight + half_float::toFloat(source.tsdf) * source.weight)
+            / updated_weight);
+        voxel.r = uint8_t((voxel.r * weight + source.r * float(source.weight)) / updated_weight + 0.5f);
+        voxel.g = uint8_t((voxel.g * weight + source.g * float(source.weight)) / updated_weight + 0.5f);
+        voxel.b = uint8_t((voxel.b * weight + source.b * float(source.weight)) / updated_weight + 0.5f);
+        voxel.weight = uint8_t(std::min<int>(max_weight, voxel.weight + source.weight));
+    }
+}
+
+//----------------------------------------------------
+
+uint64_t VoxelHashVolume::edge_key(const Eigen::Vector3i& voxel, const int& axis)
+{
+    const uint64_t x = uint64_t(voxel.x() + (1 << 19)) & 0xFFFFF;
+    const uint64_t y = uint64_t(voxel.y() + (1 << 19)) & 0xFFFFF;
+    const uint64_t z = uint64_t(voxel.z() + (1 << 19)) & 0xFFFFF;
+
+    return x | (y << 20) | (z << 40) | (uint64_t(axis) << 60);
+}
+
+/** \brief 21 bits per block coordinate, about 40 km of range at 1 cm voxels. */
+uint64_t VoxelHashVolume::block_key(const Eigen::Vector3i& block)
+{
+    const uint64_t x = uint64_t(block.x() + (1 << 20)) & 0x1FFFFF;
+    const uint64_t y = uint64_t(block.y() + (1 << 20)) & 0x1FFFFF;
+    const uint64_t z = uint64_t(block.z() + (1 << 20)) & 0x1FFFFF;
+
+    return x | (y << 21) | (z << 42);
+}
+
+int VoxelHashVolume::find_block(const Eigen::Vector3i& block) const
+{
+    const auto it = block_map.find(block_key(block));
+    return it == block_map.end() ? -1 : int(it->second);
+}
+
+uint32_t VoxelHashVolume::allocate_block(const Eigen::Vector3i& block)
+{
+    const uint32_t index = uint32_t(block_coordinates.size());
+    const auto inserted = block_map.insert(std::make_pair(block_key(block), index));
+    if (inserted.second) {
+        block_coordinates.push_back(block);
+        block_slots.push_back(int32_t(take_slot(index)));
+        dirty_blocks.push_back(1);
+
+        const Voxel voxel = { half_float::fromFloat(1.0f), 0, 0, 0, 0 };
+        Block& empty = resident_block(index);
+        std::fill(empty.voxels, empty.voxels + BLOCK_VOXELS, voxel);
+    }
+
+    return inserted.first->second;
+}
+
+VoxelHashVolume::Block& VoxelHashVolume::resident_block(const uint32_t& index)
+{
+    return blocks[block_slots[index]];
+}
+
+uint32_t VoxelHashVolume::take_slot(const uint32_t& index)
+{
+    uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = uint32_t(blocks.size());
+        blocks.push_back(Block());
+        slot_blocks.push_back(0);
+    }
+
+    slot_blocks[slot] = index;
+    return slot;
+}
+
+void VoxelHashVolume::page_in(const std::vector<uint32_t>& indices)
+{
+    for (const uint32_t& index : indices) {
+        if (block_slots[index] >= 0) {
+            continue;
+        }
+
+        const uint32_t slot = take_slot(index);
+        store->read(index, &blocks[slot]);
+        block_slots[index] = int32_t(slot);
+    }
+}
+
+void VoxelHashVolume::page_in_with_neighbours(const std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> needed;
+    for (const uint32_t& index : indices) {
+        for (int c = 0; c < 8; ++c) {
+            const int* offset = marching_cubes_tables::CORNER_OFFSETS[c];
+            const int neighbour = find_block(block_coordinates[index] + Eigen::Vector3i(offset[0], offset[1], offset[2]));
+            if (neighbour >= 0) {
+                needed.push_back(uint32_t(neighbour));
+            }
+        }
+    }
+
+    page_in(needed);
+}
+
+/** \brief Down to nine tenths of the budget, so the blocks are not sorted again for every new block. */
+void VoxelHashVolume::evict_to_budget()
+{
+    if (max_resident_blocks == 0 || residentBlocksCount() <= max_resident_blocks) {
+        return;
+    }
+
+    std::vector<std::pair<float, uint32_t> > resident;
+    for (uint32_t index = 0; index < block_slots.size(); ++index) {
+        if (block_slots[index] < 0) {
+            continue;
+        }
+        const Eigen::Vector3f centre = (block_coordinates[index].cast<float>() + Eigen::Vector3f::Constant(0.5f))
+            * float(BLOCK_SIZE) * voxel_size;
+        resident.push_back(std::make_pair((centre - last_camera).squaredNorm(), index));
+    }
+
+    //Farthest first, ties by index so the paging does not depend on the map order
+    const size_t target = max_resident_blocks - max_resident_blocks / 10;
+    const size_t evicted = resident.size() - std::min(resident.size(), target);
+    std::nth_element(resident.begin(), resident.begin() + evicted, resident.end(),
+        [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+
+    for (size_t i = 0; i < evicted; ++i) {
+        const uint32_t index = resident[i].second;
+        const uint32_t slot = uint32_t(block_slots[index]);
+        store->write(index, &blocks[slot]);
+        block_slots[index] = -1;
+        free_slots.push_back(slot);
+    }
+}
+
+/** \brief Within the budget, in chunks small enough to keep every chunk and the neighbours it reads resident. */
+void VoxelHashVolume::extract_blocks(const std::vector<uint32_t>& indices, const int& min_weight,
+    std::vector<std::vector<MeshVertex> >& vertices, std::vector<std::vector<uint64_t> >& edges)
+{
+    vertices.assign(indices.size(), std::vector<MeshVertex>());
+    edges.assign(indices.size(), std::vector<uint64_t>());
+
+    const size_t chunk_size = max_resident_blocks > 0 ? std::max<size_t>(1, max_resident_blocks / 9) : indices.size();
+    for (size_t begin = 0; begin < indices.size(); begin += chunk_size) {
+        const size_t end = std::min(indices.size(), begin + chunk_size);
+        if (max_resident_blocks > 0) {
+            page_in_with_neighbours(std::vector<uint32_t>(indices.begin() + begin, indices.begin() + end));
+        }
+
+        ThreadPool::instance().parallel_for(begin, end, [&](size_t i) {
+            extract_block(indices[i], min_weight, vertices[i], &edges[i]);
+        });
+        evict_to_budget();
+    }
+}
+
+const VoxelHashVolume::Voxel* VoxelHashVolume::find_voxel(const Eigen::Vector3i& voxel) const
+{
+    const Eigen::Vector3i block(floor_div(voxel.x(), BLOCK_SIZE), floor_div(voxel.y(), BLOCK_SIZE),
+        floor_div(voxel.z(), BLOCK_SIZE));
+    const int index = find_block(block);
+    if (index < 0) {
+        return nullptr;
+    }
+
+    if (block_slots[index] < 0) {
+        return nullptr;
+    }
+
+    const Eigen::Vector3i local = voxel - block * BLOCK_SIZE;
+    return &blocks[block_slots[index]].voxels[local.x() + BLOCK_SIZE * (local.y() + BLOCK_SIZE * local.z())];
+}
+
+Eigen::Vector3i VoxelHashVolume::voxel_of_point(const Eigen::Vector3f& point) const
+{
+    return Eigen::Vector3i(int(std::floor(point.x() / voxel_size)), int(std::floor(point.y() / voxel_size)),
+        int(std::floor(point.z() / voxel_size)));
+}
+
+bool VoxelHashVolume::interpolate_tsdf(const Eigen::Vector3f& point, float& tsdf) const
+{
+    const Eigen::Vector3f grid = point / voxel_size - Eigen::Vector3f::Constant(0.5f);
+    const Eigen::Vector3i base(int(std::floor(grid.x())), int(std::floor(grid.y())), int(std::floor(grid.z())));
+    const Eigen::Vector3f fraction = grid - base.cast<float>();
+
+    tsdf = 0;
+    for (int c = 0; c < 8; ++c) {
+        const int* offset = marching_cubes_tables::CORNER_OFFSETS[c];
+        const Voxel* voxel = find_voxel(base + Eigen::Vector3i(offset[0], offset[1], offset[2]));
+        if (!voxel || voxel->weight == 0) {
+            return false;
+        }
+
+        const float weight = (offset[0] ? fraction.x() : 1.0f - fraction.x())
+            * (offset[1] ? fraction.y() : 1.0f - fraction.y())
+            * (offset[2] ? fraction.z() : 1.0f - fraction.z());
+        tsdf += weight * half_float::toFloat(voxel->tsdf);
+    }
+
+    return true;
+}
+
+bool VoxelHashVolume::sample_voxel(const Eigen::Vector3f& point, Voxel& sample) const
+{
+    const Eigen::Vector3f grid = point / voxel_size - Eigen::Vector3f::Constant(0.5f);
+    const Eigen::Vector3i base(int(std::floor(grid.x())), int(std::floor(grid.y())), int(std::floor(grid.z())));
+    const Eigen::Vector3f fraction = grid - base.cast<float>();
+
+    float tsdf = 0;
+    float weight = 0;
+    Eigen::Vector3f color = Eigen::Vector3f::Zero();
+    for (int c = 0; c < 8; ++c) {
+        const int* offset = marching_cubes_tables::CORNER_OFFSETS[c];
+        const Voxel* voxel = find_voxel(base + Eigen::Vector3i(offset[0], offset[1], offset[2]));
+        if (!voxel || voxel->weight == 0) {
+            return false;
+        }
+
+        const float corner_weight = (offset[0] ? fraction.x() : 1.0f - fraction.x())
+            * (offset[1] ? fraction.y() : 1.0f - fraction.y())
+            * (offset[2] ? fraction.z() : 1.0f - fraction.z());
+        tsdf += corner_weight * half_float::toFloat(voxel->tsdf);
+        weight += corner_weight * voxel->weight;
+        color += corner_weight * Eigen::Vector3f(voxel->r, voxel->g, voxel->b);
+    }
+
+    sample.tsdf = half_float::fromFloat(tsdf);
+    sample.weight = uint8_t(std::max(1.0f, std::min(float(max_weight), weight + 0.5f)));
+    sample.r = uint8_t(color.x() + 0.5f);
+    sample.g = uint8_t(color.y() + 0.5f);
+    sample.b = uint8_t(color.z() + 0.5f);
+    return true;
+}
+
+/** \brief Unallocated blocks are left through their far side in one step. In observed space the step
+  * follows the distance to the surface, never shorter than a voxel, and the crossing found between
+  * two samples is refined with the interpolated TSDF.
+  */
+bool VoxelHashVolume::march_ray(const Eigen::Vector3f& origin, const Eigen::Vector3f& ray, const float& max_depth,
+    float& depth) const
+{
+    const float length = ray.norm();
+    const float voxel_step = voxel_size / length;
+    const float block_extent = float(BLOCK_SIZE) * voxel_size;
+
+    float previous_depth = 0;
+    float previous_tsdf = 0;
+    bool has_previous = false;
+    for (float t = 0; t < max_depth;) {
+        const Eigen::Vector3f point = origin + ray * t;
+        const Eigen::Vector3i voxel = voxel_of_point(point);
+        const Voxel* found = find_voxel(voxel);
+        if (!found) {
+            const Eigen::Vector3f low = Eigen::Vector3f(float(floor_div(voxel.x(), BLOCK_SIZE)),
+                float(floor_div(voxel.y(), BLOCK_SIZE)), float(floor_div(voxel.z(), BLOCK_SIZE))) * block_extent;
+            float exit = std::numeric_limits<float>::max();
+            for (int axis = 0; axis < 3; ++axis) {
+                if (ray[axis] != 0) {
+                    const float side = ray[axis] > 0 ? low[axis] + block_extent : low[axis];
+                    exit = std::min(exit, (side - origin[axis]) / ray[axis]);
+                }
+            }
+            t = std::max(t + 0.01f * voxel_step, exit + 0.01f * voxel_step);
+            has_previous = false;
+            continue;
+        }
+        if (found->weight == 0) {
+            t += voxel_step;
+            has_previous = false;
+            continue;
+        }
+
+        const float tsdf = half_float::toFloat(found->tsdf);
+        if (has_previous && previous_tsdf > 0 && tsdf <= 0) {
+            float front, back;
+            if (interpolate_tsdf(origin + ray * previous_depth, front) && interpolate_tsdf(point, back)
+                && front > 0 && back <= 0) {
+                depth = previous_depth + (t - previous_depth) * front / (front - back);
+            } else {
+                depth = previous_depth + (t - previous_depth) * previous_tsdf / (previous_tsdf - tsdf);
+            }
+            return true;
+        }
+        if (has_previous && previous_tsdf < 0 && tsdf > 0) {
+            //The back of a surface, whatever is behind it is hidden
+            return false;
+        }
+
+        previous_depth = t;
+        previous_tsdf = tsdf;
+        has_previous = true;
+        t += std::max(voxel_step, 0.8f * tsdf * truncation_distance / length);
+    }
+
+    return false;
+}
+
+void VoxelHashVolume::integrate_frames(const std::vector<cv::Mat>& depths, const std::vector<cv::Mat>& colors,
+    const std::vector<CameraIntrinsics>& intrinsics, const Matrix4fVector& poses)
+{
+    for (size_t i = 0; i < depths.size(); ++i) {
+        const cv::Mat& depth = depths[i];
+        if (depth.type() != CV_32FC1 || colors[i].type() != CV_8UC3 || depth.size() != colors[i].size()) {
+            throw std::invalid_argument("VoxelHashVolume::integrate_frames depth is not CV_32FC1 or color is not a CV_8UC3 of its size");
+        }
+        if (!intrinsics[i].isValid() || int(intrinsics[i].width) != depth.cols || int(intrinsics[i].height) != depth.rows) {
+            throw std::invalid_argument("VoxelHashVolume::integrate_frames intrinsics do not match the depth image");
+        }
+    }
+
+    for (size_t i = 0; i < depths.size(); ++i) {
+        allocate_blocks(depths[i], intrinsics[i], poses[i]);
+    }
+
+    Matrix4fVector world_to_camera(depths.size());
+    std::vector<std::vector<uint32_t> > visible(depths.size());
+    ThreadPool::instance().parallel_for(0, depths.size(), [&](size_t i) {
+        world_to_camera[i] = poses[i].inverse();
+        frustum_blocks(intrinsics[i], world_to_camera[i], max_depth(depths[i]), visible[i]);
+    });
+
+    //Frames of every block in frame order, as offsets into one array
+    std::vector<uint32_t> offsets(block_coordinates.size() + 1, 0);
+    for (const std::vector<uint32_t>& frame_blocks : visible) {
+        for (const uint32_t& block : frame_blocks) {
+            ++offsets[block + 1];
+        }
+    }
+    std::vector<uint32_t> touched;
+    for (uint32_t block = 0; block < block_coordinates.size(); ++block) {
+        if (offsets[block + 1] > 0) {
+            touched.push_back(block);
+        }
+        offsets[block + 1] += offsets[block];
+    }
+
+    if (max_resident_blocks > 0) {
+        page_in(touched);
+    }
+
+    std::vector<uint32_t> block_frames(offsets.back());
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+    for (uint32_t frame = 0; frame < visible.size(); ++frame) {
+        for (const uint32_t& block : visible[frame]) {
+            block_frames[filled[block]++] = frame;
+        }
+    }
+
+    ThreadPool::instance().parallel_for(0, touched.size(), [&](size_t i) {
+        const uint32_t block = touched[i];
+        for (uint32_t j = offsets[block]; j < offsets[block + 1]; ++j) {
+            const uint32_t frame = block_frames[j];
+            integrate_block(block, depths[frame], colors[frame], intrinsics[frame], world_to_camera[frame]);
+        }
+    });
+
+    if (!poses.empty()) {
+        last_camera = poses.back().block<3, 1>(0, 3);
+    }
+    evict_to_budget();
+}
+
+/** \brief Rays are walked in parallel per image row, the blocks are inserted afterwards in row order. */
+void VoxelHashVolume::allocate_blocks(const cv::Mat& depth, const CameraIntrinsics& intrinsics,
+    const Eigen::Matrix4f& pose)
+{
+    const Eigen::Matrix3f rotation = pose.block<3, 3>(0, 0);
+    const Eigen::Vector3f camera = pose.block<3, 1>(0, 3);
+    const int steps = int(std::ceil(2.0f * truncation_distance / voxel_size));
+
+    std::vector<std::vector<Eigen::Vector3i> > row_blocks(depth.rows);
+    ThreadPool::instance().parallel_for(0, size_t(depth.rows), [&](size_t v) {
+        std::vector<Eigen::Vector3i>& result = row_blocks[v];
+        const float* row = depth.ptr<float>(int(v));
+
+        Eigen::Vector3i previous(INT_MAX, INT_MAX, INT_MAX);
+        for (int u = 0; u < depth.cols; ++u) {
+            if (!(row[u] > 0)) {
+                continue;
+            }
+
+            const Eigen::Vector3f world = rotation * intrinsics.backproject(float(u), float(v), row[u]) + camera;
+            const Eigen::Vector3f direction = (world - camera).normalized();
+            const Eigen::Vector3f begin = world - direction * truncation_distance;
+            const Eigen::Vector3f step = direction * (2.0f * truncation_distance / steps);
+
+            for (int i = 0; i <= steps; ++i) {
+                const Eigen::Vector3i voxel = voxel_of_point(begin + step * float(i));
+                const Eigen::Vector3i block(floor_div(voxel.x(), BLOCK_SIZE), floor_div(voxel.y(), BLOCK_SIZE),
+                    floor_div(voxel.z(), BLOCK_SIZE));
+                if (block != previous) {
+                    previous = block;
+                    result.push_back(block);
+                }
+            }
+        }
+    });
+
+    for (const std::vector<Eigen::Vector3i>& result : row_blocks) {
+        for (const Eigen::Vector3i& block : result) {
+            allocate_block(block);
+        }
+    }
+}
+
+void VoxelHashVolume::frustum_blocks(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& world_to_camera,
+    const float& max_depth, std::vector<uint32_t>& result) const
+{
+    const Eigen::Matrix3f rotation = world_to_camera.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = world_to_camera.block<3, 1>(0, 3);
+    const float radius = std::sqrt(3.0f) * 0.5f * BLOCK_SIZE * voxel_size;
+    const float far = max_depth + truncation_distance;
+
+    std::vector<uint8_t> inside(block_coordinates.size(), 0);
+    ThreadPool::instance().parallel_for(0, block_coordinates.size(), [&](size_t i) {
+        const Eigen::Vector3f centre = (block_coordinates[i].cast<float>() + Eigen::Vector3f::Constant(0.5f))
+            * float(BLOCK_SIZE) * voxel_size;
+        const Eigen::Vector3f camera = rotation * centre + translation;
+        if (camera.z() + radius <= 0 || camera.z() - radius > far) {
+            return;
+        }
+        if (camera.z() <= radius) {
+            inside[i] = 1;
+            return;
+        }
+
+        const float u = intrinsics.fx * camera.x() / camera.z() + intrinsics.cx;
+        const float v = intrinsics.fy * camera.y() / camera.z() + intrinsics.cy;
+        const float u_radius = std::abs(intrinsics.fx) * radius / (camera.z() - radius);
+        const float v_radius = std::abs(intrinsics.fy) * radius / (camera.z() - radius);
+        inside[i] = u + u_radius >= 0 && u - u_radius < float(intrinsics.width)
+            && v + v_radius >= 0 && v - v_radius < float(intrinsics.height);
+    });
+
+    result.clear();
+    for (uint32_t i = 0; i < inside.size(); ++i) {
+        if (inside[i]) {
+            result.push_back(i);
+        }
+    }
+}
+
+/** \brief Voxels are projected into the depth image and averaged with the signed distance along the
+  * view axis. A row of voxels along x is projected at once, with AVX2 when the CPU has it.
+  */
+void VoxelHashVolume::integrate_block(const uint32_t& index, const cv::Mat& depth, const cv::Mat& color,
+    const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& world_to_camera)
+{
+    Block& block = resident_block(index);
+    dirty_blocks[index] = 1;
+    const Eigen::Vector3i origin = block_coordinates[index] * BLOCK_SIZE;
+    const Eigen::Matrix3f rotation = world_to_camera.block<3, 3>(0, 0);
+    const Eigen::Vector3f translation = world_to_camera.block<3, 1>(0, 3);
+    const Eigen::Vector3f step = rotation.col(0) * voxel_size;
+    const ProjectRowFunction project_row = selected_project_row();
+
+    RowProjection projection;
+    for (int axis = 0; axis < 3; ++axis) {
+        projection.step[axis] = step[axis];
+    }
+    projection.camera[0] = intrinsics.fx;
+    projection.camera[1] = intrinsics.fy;
+    projection.camera[2] = intrinsics.cx + 0.5f;
+    projection.camera[3] = intrinsics.cy + 0.5f;
+
+    float z_camera[BLOCK_SIZE];
+    float u[BLOCK_SIZE], v[BLOCK_SIZE];
+
+    for (int z = 0; z < BLOCK_SIZE; ++z) {
+        for (int y = 0; y < BLOCK_SIZE; ++y) {
+            const Eigen::Vector3f first = rotation
+                    * ((origin + Eigen::Vector3i(0, y, z)).cast<float>() + Eigen::Vector3f::Constant(0.5f)) * voxel_size
+                + translation;
+            for (int axis = 0; axis < 3; ++axis) {
+                projection.first[axis] = first[axis];
+            }
+            project_row(projection, z_camera, u, v);
+
+            Voxel* row = block.voxels + BLOCK_SIZE * (y + BLOCK_SIZE * z);
+            for (int x = 0; x < BLOCK_SIZE; ++x) {
+                if (!(z_camera[x] > 0) || !(u[x] >= 0) || !(v[x] >= 0) || u[x] >= depth.cols || v[x] >= depth.rows) {
+                    continue;
+                }
+                const int pu = int(u[x]);
+                const int pv = int(v[x]);
+                const float measured = depth.ptr<float>(pv)[pu];
+                if (!(measured > 0)) {
+                    continue;
+                }
+
+                const float sdf = measured - z_camera[x];
+                if (sdf < -truncation_distance) {
+                    continue;
+                }
+                const float tsdf = std::min(1.0f, sdf / truncation_distance);
+                const uint8_t* bgr = color.ptr<uint8_t>(pv) + 3 * pu;
+
+                Voxel& voxel = row[x];
+                const float weight = voxel.weight;
+                const float updated_weight = weight + 1.0f;
+                voxel.tsdf = half_float::fromFloat((half_float::toFloat(voxel.tsdf) * weight + tsdf) / updated_weight);
+                voxel.r = uint8_t((voxel.r * weight + bgr[2]) / updated_weight + 0.5f);
+                voxel.g = uint8_t((voxel.g * weight + bgr[1]) / updated_weight + 0.5f);
+                voxel.b = uint8_t((voxel.b * weight + bgr[0]) / updated_weight + 0.5f);
+                voxel.weight = uint8_t(std::min<int>(max_weight, voxel.weight + 1));
+            }
+        }
+    }
+}
+
+/** \brief Cubes span voxel centres, the ones at the block's far faces read the neighbour blocks. */
+void VoxelHashVolume::extract_block(const uint32_t& index, const int& min_weight, std::vector<MeshVertex>& vertices,
+    std::vector<uint64_t>* edge_keys) const
+{
+    const Block& block = blocks[block_slots[index]];
+    const Eigen::Vector3i origin = block_coordinates[index] * BLOCK_SIZE;
+
+    const Voxel* corners[8];
+    float values[8];
+    Eigen::Vector3f positions[8];
+    MeshVertex cube_vertices[12];
+    uint64_t cube_edges[12];
+
+    for (int z = 0; z < BLOCK_SIZE; ++z) {
+        for (int y = 0; y < BLOCK_SIZE; ++y) {
+            for (int x = 0; x < BLOCK_SIZE; ++x) {
+                bool valid = true;
+                int cube = 0;
+                for (int c = 0; c < 8 && valid; ++c) {
+                    const int* offset = marching_cubes_tables::CORNER_OFFSETS[c];
+                    const int cx = x + offset[0];
+                    const int cy = y + offset[1];
+                    const int cz = z + offset[2];
+                    corners[c] = cx < BLOCK_SIZE && cy < BLOCK_SIZE && cz < BLOCK_SIZE
+                        ? &block.voxels[cx + BLOCK_SIZE * (cy + BLOCK_SIZE * cz)]
+                        : find_voxel(origin + Eigen::Vector3i(cx, cy, cz));
+                    if (!corners[c] || corners[c]->weight < min_weight) {
+                        valid = false;
+                        break;
+                    }
+
+                    values[c] = half_float::toFloat(corners[c]->tsdf);
+                    if (std::abs(values[c]) >= 1.0f) {
+                        valid = false;
+                        break;
+                    }
+                    positions[c] = ((origin + Eigen::Vector3i(cx, cy, cz)).cast<float>()
+                        + Eigen::Vector3f::Constant(0.5f)) * voxel_size;
+                    cube |= values[c] < 0 ? 1 << c : 0;
+                }
+                if (!valid || pcl::edgeTable[cube] == 0) {
+                    continue;
+                }
+
+                for (int e = 0; e < 12; ++e) {
+                    if (!(pcl::edgeTable[cube] & (1 << e))) {
+                        continue;
+                    }
+                    const int a = marching_cubes_tables::EDGE_CORNERS[e][0];
+                    const int b = marching_cubes_tables::EDGE_CORNERS[e][1];
+                    const float mu = values[a] == values[b] ? 0.5f : values[a] / (values[a] - values[b]);
+                    const Voxel& nearest = *corners[mu < 0.5f ? a : b];
+
+                    MeshVertex& vertex = cube_vertices[e];
+                    vertex.position = positions[a] + mu * (positions[b] - positions[a]);
+                    vertex.r = nearest.r;
+                    vertex.g = nearest.g;
+                    vertex.b = nearest.b;
+
+                    if (edge_keys) {
+                        const int* low = marching_cubes_tables::CORNER_OFFSETS[marching_cubes_tables::edge_origin(e)];
+                        cube_edges[e] = edge_key(origin + Eigen::Vector3i(x + low[0], y + low[1], z + low[2]),
+                            marching_cubes_tables::edge_axis(e));
+                    }
+                }
+
+                for (int i = 0; pcl::triTable[cube][i] != -1; ++i) {
+                    vertices.push_back(cube_vertices[pcl::triTable[cube][i]]);
+                    if (edge_keys) {
+                        edge_keys->push_back(cube_edges[pcl::triTable[cube][i]]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/** \brief The vertex is updated, its edge's voxels may have changed. */
+uint32_t VoxelHashVolume::acquire_vertex(const uint64_t& edge, const MeshVertex& vertex)
+{
+    const auto found = edge_vertices.find(edge);
+    uint32_t id;
+    if (found != edge_vertices.end()) {
+        id = found->second;
+    } else if (!free_vertices.empty()) {
+        id = free_vertices.back();
+        free_vertices.pop_back();
+        edge_vertices[edge] = id;
+        vertex_edges[id] = edge;
+    } else {
+        id = uint32_t(mesh_vertices.size());
+        edge_vertices[edge] = id;
+        mesh_vertices.push_back(vertex);
+        vertex_references.push_back(0);
+        vertex_edges.push_back(edge);
+    }
+
+    mesh_vertices[id] = vertex;
+    ++vertex_references[id];
+    return id;
+}
+
+void VoxelHashVolume::to_polygon_mesh(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& triangles,
+    pcl::PolygonMesh& mesh)
+{
+    pcl::PointCloud<pcl::PointXYZRGB> cloud;
+    cloud.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        pcl::PointXYZRGB& point = cloud[i];
+        point.getVector3fMap() = vertices[i].position;
+        point.r = vertices[i].r;
+        point.g = vertices[i].g;
+        point.b = vertices[i].b;
+    }
+    pcl::toPCLPointCloud2(cloud, mesh.cloud);
+
+    mesh.polygons.resize(triangles.size() / 3);
+    for (size_t i = 0; i < mesh.polygons.size(); ++i) {
+        mesh.polygons[i].vertices.assign(triangles.begin() + 3 * i, triangles.begin() + 3 * i + 3);
+    }
+}
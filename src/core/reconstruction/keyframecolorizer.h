@@ -0,0 +1,71 @@
+#ifndef KEYFRAME_COLORIZER_H
+#define KEYFRAME_COLORIZER_H
+
+#include <pcl/PolygonMesh.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <vector>
+
+#include "core/base/cameraintrinsics.h"
+#include "core/base/scannertypes.h"
+#include "core/reconstruction/memoryreport.h"
+
+/** \brief Colours of a mesh taken from a few keyframes of the integrated frames instead of the volume.
+  * A keyframe keeps its depth in millimetres and its BGR colour. Its depth image is the z-buffer: a vertex
+  * is seen when its depth is within visibility_depth of the depth at its pixel.
+  */
+class KeyframeColorizer {
+public:
+    /** \brief min_angle in degrees, at most max_keyframes are kept, 0 for no limit. */
+    KeyframeColorizer(const float& min_distance, const float& min_angle, const size_t& max_keyframes,
+        const float& visibility_depth);
+
+    void reset();
+
+    /** \brief True when the camera to world pose is farther than min_distance or turned more than min_angle
+      * from every kept keyframe, and there is room for another one.
+      */
+    bool isKeyframe(const Eigen::Matrix4f& pose) const;
+
+    /** \brief CV_32FC1 depth in meters and CV_8UC3 BGR colour, as VoxelHashVolume::readFrame. */
+    void addKeyframe(const cv::Mat& depth, const cv::Mat& color, const CameraIntrinsics& intrinsics,
+        const Eigen::Matrix4f& pose);
+
+    /** \brief Recolours the world space vertices in parallel, by the observations of the keyframes seeing
+      * them, weighted towards close views near the optical axis. Vertices no keyframe sees keep their colour.
+      */
+    void colorVertices(pcl::PointCloud<pcl::PointXYZRGB>& vertices) const;
+
+    void colorMesh(pcl::PolygonMesh& mesh) const;
+
+    size_t size() const;
+
+    void memoryReport(MemoryReport& report) const;
+
+private:
+    struct Keyframe {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        cv::Mat depth;
+        cv::Mat color;
+        CameraIntrinsics intrinsics;
+        Eigen::Matrix4f pose;
+        Eigen::Matrix4f world_to_camera;
+    };
+
+    const float min_distance;
+    const float min_angle_cos;
+    const size_t max_keyframes;
+    const float visibility_depth;
+
+    std::vector<Keyframe, Eigen::aligned_allocator<Keyframe> > keyframes;
+
+    /** \brief False when the keyframe does not see the world point. */
+    bool observe(const Keyframe& keyframe, const Eigen::Vector3f& point, Eigen::Vector3f& color, float& weight) const;
+};
+
+#endif // KEYFRAME_COLORIZER_H
@@ -0,0 +1,42 @@
+#ifndef MARCHING_CUBES_TABLES_H
+#define MARCHING_CUBES_TABLES_H
+
+/** \brief Cube layout of pcl::MarchingCubes, whose edge and triangle tables are used
+  * by the marching cubes over the TSDF volumes.
+  */
+namespace marching_cubes_tables
+{
+
+/** \brief Offsets of the cube corners along x, y and z. */
+const int CORNER_OFFSETS[8][3] = {
+    { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 },
+    { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 }
+};
+
+/** \brief Corners of edge i, matching bit i of pcl::edgeTable. */
+const int EDGE_CORNERS[12][2] = {
+    { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+    { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+};
+
+/** \brief Axis the edge runs along. */
+inline int edge_axis(const int& edge)
+{
+    const int* a = CORNER_OFFSETS[EDGE_CORNERS[edge][0]];
+    const int* b = CORNER_OFFSETS[EDGE_CORNERS[edge][1]];
+    return a[0] != b[0] ? 0 : (a[1] != b[1] ? 1 : 2);
+}
+
+/** \brief Corner of the edge with the lower coordinate, the edge is identified by it and its axis. */
+inline int edge_origin(const int& edge)
+{
+    const int axis = edge_axis(edge);
+    const int a = EDGE_CORNERS[edge][0];
+    const int b = EDGE_CORNERS[edge][1];
+    return CORNER_OFFSETS[a][axis] < CORNER_OFFSETS[b][axis] ? a : b;
+}
+
+} // namespace marching_cubes_tables
+
+#endif // MARCHING_CUBES_TABLES_H
@@ -0,0 +1,63 @@
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/** \brief Bytes and element count of every component of a volume, to size the volume to the RAM.
+  * Containers are counted by capacity, hash maps and shared pointers by an estimate of their nodes.
+  */
+struct MemoryReport {
+    struct Component {
+        std::string name;
+        size_t count;
+        size_t bytes;
+    };
+
+    std::vector<Component> components;
+
+    inline void add(const std::string& name, const size_t& count, const size_t& bytes)
+    {
+        components.push_back({ name, count, bytes });
+    }
+
+    inline size_t totalBytes() const
+    {
+        size_t result = 0;
+        for (const Component& component : components) {
+            result += component.bytes;
+        }
+        return result;
+    }
+
+    /** \brief One line per component, then the total. */
+    inline std::string toString() const
+    {
+        std::string result;
+        char line[256];
+        for (const Component& component : components) {
+            std::snprintf(line, sizeof(line), "%s: %zu, %.2f MB\n", component.name.c_str(), component.count,
+                component.bytes / (1024.0 * 1024.0));
+            result += line;
+        }
+        std::snprintf(line, sizeof(line), "total: %.2f MB", totalBytes() / (1024.0 * 1024.0));
+        return result + line;
+    }
+
+    template <typename T>
+    static size_t vectorBytes(const std::vector<T>& vector)
+    {
+        return vector.capacity() * sizeof(T);
+    }
+
+    /** \brief Bucket array and one node holding the value and the next pointer per element. */
+    template <typename Map>
+    static size_t hashMapBytes(const Map& map)
+    {
+        return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename Map::value_type) + sizeof(void*));
+    }
+};
+
+#endif // MEMORY_REPORT_H
@@ -0,0 +1,46 @@
+#ifndef MESH_DECIMATION_H
+#define MESH_DECIMATION_H
+
+#include <pcl/PolygonMesh.h>
+#include <pcl/point_types.h>
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <vector>
+
+/** \brief Quadric error edge collapse of a marching cubes mesh, in parallel over cubic blocks of space.
+  * Triangles belong to the block of their centroid and vertices shared by several blocks or on a hole
+  * of the mesh never move, so blocks are independent and join without cracks. Flat walls have zero
+  * quadric error and collapse first, down to the block borders.
+  */
+class MeshDecimator {
+public:
+    /** \brief max_error in metres, the root of the largest quadric error of a collapse, block_size in metres. */
+    MeshDecimator(const double& max_error, const float& block_size);
+
+    /** \brief Collapses every block down to target_ratio of its triangles or until the next collapse would
+      * exceed max_error. Vertices keep the colour of the vertex they collapse into. Vertices at the same
+      * position are welded first, so triangle soup decimates like an indexed mesh.
+      */
+    void decimate(const pcl::PolygonMesh& input, const float& target_ratio, pcl::PolygonMesh& output) const;
+
+private:
+    const double max_squared_error;
+    const float block_size;
+
+    typedef pcl::PointCloud<pcl::PointXYZRGB> Vertices;
+
+    /** \brief Triangles of a block as global vertex ids, three per triangle. */
+    struct Block {
+        std::vector<uint32_t> triangles;
+    };
+
+    /** \brief locked per global vertex, positions of the block's free vertices are written in place. */
+    void decimate_block(Block& block, const std::vector<uint8_t>& locked, const float& target_ratio,
+        Vertices& vertices) const;
+
+    uint64_t block_key(const Eigen::Vector3f& point) const;
+};
+
+#endif // MESH_DECIMATION_H
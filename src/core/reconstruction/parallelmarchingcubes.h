@@ -0,0 +1,38 @@
+#ifndef PARALLEL_MARCHING_CUBES_H
+#define PARALLEL_MARCHING_CUBES_H
+
+#include <cpu_tsdf/marching_cubes_tsdf_octree.h>
+
+#include <cstdint>
+#include <vector>
+
+/** \brief Marching cubes over the TSDF octree in parallel over ranges of leaves. A vertex on an edge
+  * shared by several cubes is created once, so the mesh is indexed. The ranges are merged in leaf
+  * order, so the mesh is the same for any number of threads.
+  */
+class ParallelMarchingCubesTSDFOctree : public cpu_tsdf::MarchingCubesTSDFOctree {
+protected:
+    void performReconstruction(pcl::PolygonMesh& output) override;
+
+private:
+    /** \brief Vertices of a range with their grid edges, three local vertex ids per triangle. */
+    struct Range {
+        pcl::PointCloud<pcl::PointXYZRGB> vertices;
+        std::vector<uint64_t> edges;
+        std::vector<uint32_t> triangles;
+    };
+
+    void collect_leaves(const cpu_tsdf::OctreeNode* node, std::vector<const cpu_tsdf::OctreeNode*>& leaves) const;
+
+    void reconstruct_range(const std::vector<const cpu_tsdf::OctreeNode*>& leaves,
+        const size_t& begin, const size_t& end, Range& range);
+
+    /** \brief Left black when the leaf has no colour, as in the serial reconstruction. */
+    void leaf_color(const cpu_tsdf::OctreeNode* leaf, pcl::PointXYZRGB& point) const;
+
+    Eigen::Vector3f grid_point(const Eigen::Vector3i& index) const;
+
+    uint64_t edge_key(const Eigen::Vector3i& index, const int& axis) const;
+};
+
+#endif // PARALLEL_MARCHING_CUBES_H
@@ -11,7 +11,7 @@
 #include "core/base/scannertypes.h"
 #include "core/reconstruction/volumereconstruction.h"
 #include "gui/imagesviewerwidget.h"
-#include "gui/pcdvizualizer.h"
+#include "gui/vizualizer.h"
 
 class ReconstructionInterface : public ScannerBase {
     Q_OBJECT
@@ -23,7 +23,8 @@ public:
 
 private:
     VolumeReconstruction::Ptr volumeReconstruction;
-    PcdVizualizer::Ptr pcdVizualizer;
+    /** \brief Opens its window on the first drawing call, draws nothing when headless. */
+    Vizualizer::Ptr pcdVizualizer;
 
     void perform_tsdf_integration(
         Frames& frames,
@@ -40,6 +41,8 @@ private:
 
     void perform_lum_reconstruction();
 
+    void perform_model_based_reconstruction();
+
 public slots:
     void slot_perform_reconstruction();
 };
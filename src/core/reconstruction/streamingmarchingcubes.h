@@ -0,0 +1,39 @@
+#ifndef STREAMING_MARCHING_CUBES_H
+#define STREAMING_MARCHING_CUBES_H
+
+#include <cpu_tsdf/marching_cubes_tsdf_octree.h>
+
+#include "core/reconstruction/voxelcolorlayer.h"
+#include "io/plystreamwriter.h"
+
+/** \brief Marching cubes over the TSDF octree that hands every finished chunk of
+  * triangles to a PlyStreamWriter while the reconstruction is still running.
+  * When keep_mesh is false the output mesh stays empty and the memory of every
+  * chunk is released right after it is written.
+  */
+class StreamingMarchingCubesTSDFOctree : public cpu_tsdf::MarchingCubesTSDFOctree {
+public:
+    StreamingMarchingCubesTSDFOctree(PlyStreamWriter* writer, const size_t& chunk_size, const bool& keep_mesh);
+
+    /** \brief Chunks are recoloured from the layer before they are written, nullptr keeps the node colours. */
+    void setColorLayer(const VoxelColorLayer* color_layer);
+
+protected:
+    void performReconstruction(pcl::PolygonMesh& output) override;
+
+private:
+    PlyStreamWriter* writer;
+    size_t chunk_size;
+    bool keep_mesh;
+    const VoxelColorLayer* color_layer;
+
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    pcl::PointCloud<pcl::PointXYZRGB> cloud_colored;
+    size_t flushed_size;
+
+    void reconstructNode(const cpu_tsdf::OctreeNode* node);
+
+    void flush();
+};
+
+#endif // STREAMING_MARCHING_CUBES_H
@@ -11,8 +11,23 @@
 #include <cpu_tsdf/tsdf_interface.h>
 #include <cpu_tsdf/tsdf_volume_octree.h>
 
+#include <chrono>
+#include <memory>
+#include <mutex>
+
 #include "core/base/scannertypes.h"
+#include "core/reconstruction/gpuvoxelhashvolume.h"
+#include "core/reconstruction/keyframecolorizer.h"
+#include "core/reconstruction/memoryreport.h"
+#include "core/reconstruction/meshdecimation.h"
+#include "core/reconstruction/parallelmarchingcubes.h"
+#include "core/reconstruction/streamingmarchingcubes.h"
+#include "core/reconstruction/voxelcolorlayer.h"
+#include "core/reconstruction/voxelhashvolume.h"
+#include "io/framewriter.h"
 #include "io/pclio.h"
+#include "io/voxelhashfile.h"
+#include "io/plystreamwriter.h"
 
 //###############################################################
 // USAGE:
@@ -33,6 +48,10 @@ public:
 
     VolumeReconstruction(QObject* parent, QSettings* parent_settings);
 
+    /** \brief With CPU_TSDF_SETTINGS/ASYNC_INTEGRATION copies of the clouds are queued for a worker
+      * thread and the call returns at once, the queued clouds are integrated in the order they were added.
+      * The voxel hash volume queues the clouds as depth and colour frames, packed on the calling thread.
+      */
     void addPointCloudVector(
         const PcdPtrVector& point_cloud_vector,
         const Matrix4fVector& translation_matrix_vector);
@@ -41,15 +60,132 @@ public:
         const PcdPtr& point_cloud,
         const Eigen::Matrix4f& translation_matrix);
 
+    /** \brief Returns once the queued clouds are integrated. */
+    void waitIntegration();
+
+    /** \brief Both wait for the queued clouds to be integrated. */
     void prepareVolume();
 
+    /** \brief With CPU_TSDF_SETTINGS/DEFERRED_COLOR the mesh is coloured from the keyframes before it is saved.
+      * With CPU_TSDF_SETTINGS/DECIMATION_LODS the mesh is decimated to every level of detail after it is
+      * saved, each level from the previous one, and with SAVE_PLY every level is written next to FINAL_PLY_FILENAME.
+      * With DECIMATION_PREVIEW getPoligonMesh() returns the first level.
+      */
     void calculateMesh();
 
     void getPoligonMesh(pcl::PolygonMesh& mesh);
 
+    /** \brief With VISUALIZATION/CPU_TSDF_PREVIEW_MESH the voxel hash mesh is updated incrementally after
+      * every added batch. False when no preview newer than the last one taken is ready.
+      */
+    bool takePreviewMesh(pcl::PolygonMesh& mesh);
+
+    /** \brief Bytes per component and node counts of the volume, waits for the queued clouds.
+      * The total is also published to memory_accounting after every integrated batch.
+      */
+    MemoryReport memoryReport();
+
+    /** \brief Only the voxel hash volume can be rendered. */
+    bool canRenderModel() const;
+
+    /** \brief Waits for the queued clouds, then raycasts the voxel hash volume from the camera to world pose.
+      * False without a voxel hash volume.
+      */
+    bool renderModel(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose, const float& max_depth,
+        std::vector<Eigen::Vector3f>& points, std::vector<Eigen::Vector3f>& normals);
+
+    /** \brief Waits for the queued clouds and writes the voxel hash volume, a sub-volume to merge elsewhere.
+      * False without a voxel hash volume or when the file can't be written.
+      */
+    bool saveVolume(const QString& filename);
+
+    /** \brief Waits for the queued clouds and fuses the saved voxel hash volume into this one.
+      * False without a voxel hash volume or when the file can't be read, nothing is merged then.
+      */
+    bool mergeVolume(const QString& filename);
+
+    /** \brief A voxel hash volume of its own for the clouds, with the parameters of this one and the clouds
+      * placed relative to the anchor pose. Does not touch this volume, so several can be built at once.
+      * nullptr without a voxel hash volume.
+      */
+    VoxelHashVolume::Ptr integrateSubmap(const PcdPtrVector& point_cloud_vector,
+        const Matrix4fVector& translation_matrix_vector, const Eigen::Matrix4f& anchor) const;
+
+    /** \brief Waits for the queued clouds and resamples the submap into this volume, anchor taking it to
+      * world coordinates. False without a voxel hash volume.
+      */
+    bool fuseSubmap(const VoxelHashVolume& submap, const Eigen::Matrix4f& anchor);
+
 private:
+    /** \brief CPU_TSDF_SETTINGS/BACKEND, OCTREE is cpu_tsdf, VOXEL_HASH is VoxelHashVolume. */
+    const bool voxel_hash;
+
     boost::shared_ptr<cpu_tsdf::TSDFVolumeOctree> tsdf;
+    /** \brief With CPU_TSDF_SETTINGS/COMPACT_COLOR the octree is built of plain nodes and coloured from here. */
+    std::unique_ptr<VoxelColorLayer> color_layer;
+    /** \brief With CPU_TSDF_SETTINGS/DEFERRED_COLOR keyframes of the integrated clouds colour the mesh, the octree
+      * is built of plain nodes without a colour layer. Submaps add no keyframes.
+      */
+    std::unique_ptr<KeyframeColorizer> keyframe_colorizer;
+    VoxelHashVolume::Ptr hash_volume;
+    /** \brief With CPU_TSDF_SETTINGS/VOXEL_HASH_DEVICE=GPU the same volume as hash_volume, integrated, raycast
+      * and meshed on the CUDA device. Its host blocks are downloaded before they are saved or merged into.
+      */
+    GpuVoxelHashVolume::Ptr gpu_volume;
+    const bool preview_mesh;
+    std::mutex preview_mutex;
+    pcl::PolygonMesh preview;
+    bool preview_ready;
+
+    /** \brief CPU_TSDF_SETTINGS/INTRINSICS, invalid when the model is fitted to every cloud. */
+    CameraIntrinsics hash_intrinsics;
     pcl::PolygonMesh _mesh;
+
+    /** \brief Declared last, so the queued clouds are integrated before the volumes are destroyed. */
+    std::unique_ptr<FrameWriter> integration_queue;
+
+    /** \brief Clouds packed into the frames the voxel hash volume integrates. */
+    struct StagedFrames {
+        std::vector<cv::Mat> depths;
+        std::vector<cv::Mat> colors;
+        std::vector<CameraIntrinsics> intrinsics;
+        Matrix4fVector poses;
+    };
+
+    void integrate_batch(const PcdPtrVector& point_cloud_vector, const Matrix4fVector& translation_matrix_vector);
+
+    StagedFrames stage_frames(const PcdPtrVector& point_cloud_vector, const Matrix4fVector& translation_matrix_vector) const;
+
+    void integrate_staged_frames(const StagedFrames& frames);
+
+    void update_preview_mesh();
+
+    void integrate_octree_cloud(const Pcd& point_cloud, const Eigen::Matrix4f& translation_matrix);
+
+    /** \brief Keeps the frame when the colorizer takes its pose as a keyframe. */
+    void select_keyframe(const Pcd& point_cloud, const Eigen::Matrix4f& translation_matrix);
+
+    CameraIntrinsics hash_intrinsics_of(const Pcd& point_cloud) const;
+
+    /** \brief Calibrated camera matrix of the depth camera, fy negated for the y up OpenNI clouds. */
+    void load_hash_intrinsics();
+
+    void calculate_octree_mesh(const bool& stream_ply, const QString& ply_filename);
+
+    void decimate_mesh(const bool& save_ply, const QString& ply_filename);
+
+    /** \brief Without waiting for the queue, on the thread integrating the clouds. */
+    MemoryReport volume_memory_report() const;
+
+    /** \brief When the TSDF gauge was last published by publish_memory_gauge. */
+    std::chrono::steady_clock::time_point memory_gauge_time;
+
+    /** \brief Sets the TSDF memory gauge at most once per MEMORY_GAUGE_INTERVAL, the report walks the whole
+      * volume. memoryReport() always sets it.
+      */
+    void publish_memory_gauge();
+
+    void octree_memory_report(MemoryReport& report) const;
 };
 
 #endif // VOLUMERECONSTRUCTION_H
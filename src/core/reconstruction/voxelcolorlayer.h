@@ -0,0 +1,80 @@
+#ifndef VOXEL_COLOR_LAYER_H
+#define VOXEL_COLOR_LAYER_H
+
+#include <pcl/PolygonMesh.h>
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <vector>
+
+#include "core/base/scannertypes.h"
+#include "core/reconstruction/memoryreport.h"
+
+/** \brief Colours of a TSDF grid kept apart from its nodes, so the octree can be built of plain nodes.
+  * Only voxels holding an observed point get a colour, stored in two flat arrays, voxel keys and
+  * 4 byte running averages, addressed by open addressing on the voxel key.
+  */
+class VoxelColorLayer {
+public:
+    struct Color {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+        uint8_t weight;
+    };
+
+    /** \brief Grid of resolution voxels over grid_size meters centered at the volume origin,
+      * volume_to_world places the grid in the world.
+      */
+    VoxelColorLayer(const Eigen::Vector3f& grid_size, const Eigen::Vector3i& resolution,
+        const Eigen::Matrix4f& volume_to_world, const int& max_weight);
+
+    void reset();
+
+    /** \brief Every point of the camera space cloud seen from the camera to world pose colours the voxel it falls in. */
+    void integrateCloud(const Pcd& cloud, const Eigen::Matrix4f& pose);
+
+    /** \brief Colour of the voxel holding the world point, else the weighted average of its 26 neighbours.
+      * False when none of them is coloured.
+      */
+    bool color(const Eigen::Vector3f& point, uint8_t& r, uint8_t& g, uint8_t& b) const;
+
+    /** \brief Recolours the world space vertices, vertices without a colour are left as they are. */
+    void colorVertices(pcl::PointCloud<pcl::PointXYZRGB>& vertices) const;
+
+    void colorMesh(pcl::PolygonMesh& mesh) const;
+
+    size_t size() const;
+
+    void memoryReport(MemoryReport& report) const;
+
+private:
+    static const uint32_t EMPTY_KEY = 0xFFFFFFFFu;
+
+    const Eigen::Vector3f grid_size;
+    const Eigen::Vector3i resolution;
+    const Eigen::Matrix4f world_to_volume;
+    const uint8_t max_weight;
+
+    std::vector<uint32_t> keys;
+    std::vector<Color> colors;
+    size_t used;
+
+    /** \brief False outside the grid. */
+    bool voxel_of_point(const Eigen::Vector3f& point, Eigen::Vector3i& voxel) const;
+
+    uint32_t voxel_key(const Eigen::Vector3i& voxel) const;
+
+    /** \brief Slot holding the key, or the empty slot it would take. */
+    size_t find_slot(const uint32_t& key) const;
+
+    /** \brief nullptr when the voxel has no colour. */
+    const Color* find(const Eigen::Vector3i& voxel) const;
+
+    Color& insert(const uint32_t& key);
+
+    void rehash(const size_t& capacity);
+};
+
+#endif // VOXEL_COLOR_LAYER_H
@@ -0,0 +1,240 @@
+#ifndef VOXEL_HASH_VOLUME_H
+#define VOXEL_HASH_VOLUME_H
+
+#include <pcl/PolygonMesh.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "core/base/cameraintrinsics.h"
+#include "core/base/scannertypes.h"
+#include "core/reconstruction/memoryreport.h"
+#include "io/blockstore.h"
+
+/** \brief Unbounded TSDF stored as 8x8x8 voxel blocks, allocated only within the truncation band
+  * around observed surfaces and found through a hash map of block coordinates. Blocks live
+  * contiguously in one vector, a voxel takes 6 bytes: half float TSDF, weight and RGB.
+  * With a memory budget the blocks farthest from the last camera are paged out to a block store.
+  */
+class VoxelHashVolume {
+public:
+    typedef std::shared_ptr<VoxelHashVolume> Ptr;
+
+    static const int BLOCK_SIZE = 8;
+    static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+#pragma pack(push, 1)
+    struct Voxel {
+        /** \brief Half float signed distance over the truncation distance, in [-1, 1]. */
+        uint16_t tsdf;
+        uint8_t weight;
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+#pragma pack(pop)
+
+    /** \brief Voxel x + BLOCK_SIZE * (y + BLOCK_SIZE * z). */
+    struct Block {
+        Voxel voxels[BLOCK_VOXELS];
+    };
+
+    VoxelHashVolume(const float& voxel_size, const float& truncation_distance, const int& max_weight);
+
+    void reset();
+
+    /** \brief At most max_resident_blocks voxel blocks in memory, 0 for no limit, the others are kept
+      * in store_filename. The budget may be exceeded while a batch is integrated or meshed.
+      */
+    void setMemoryBudget(const size_t& max_resident_blocks, const std::string& store_filename);
+
+    /** \brief Integrates an organized camera space cloud seen from the camera to world pose,
+      * with the camera model fitted to the cloud.
+      */
+    void integrateCloud(const Pcd& cloud, const Eigen::Matrix4f& pose);
+
+    void integrateCloud(const Pcd& cloud, const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose);
+
+    /** \brief Projective integration of a CV_32FC1 depth image in meters, NaN or 0 where missing,
+      * and its CV_8UC3 BGR colour image. Blocks are allocated along the rays of the depth pixels,
+      * then every allocated block inside the camera frustum is integrated, in parallel.
+      */
+    void integrateDepth(const cv::Mat& depth, const cv::Mat& color, const CameraIntrinsics& intrinsics,
+        const Eigen::Matrix4f& pose);
+
+    /** \brief Contiguous CV_32FC1 depth in meters and CV_8UC3 BGR colour of an organized cloud, the frame
+      * layout the volume integrates, a fraction of the size of the cloud.
+      */
+    static void readFrame(const Pcd& cloud, cv::Mat& depth, cv::Mat& color);
+
+    /** \brief Integrates a batch of frames at once, as integrateClouds. */
+    void integrateDepths(const std::vector<cv::Mat>& depths, const std::vector<cv::Mat>& colors,
+        const std::vector<CameraIntrinsics>& intrinsics, const Matrix4fVector& poses);
+
+    /** \brief Integrates a batch of clouds at once. The blocks of all of them are allocated in cloud
+      * order first, then the blocks are integrated in parallel, each applying the clouds seeing it in
+      * cloud order, so the result does not depend on the number of threads.
+      */
+    void integrateClouds(const PcdPtrVector& clouds, const std::vector<CameraIntrinsics>& intrinsics,
+        const Matrix4fVector& poses);
+
+    /** \brief Indexed marching cubes mesh over voxels seen at least min_weight times. */
+    void extractMesh(pcl::PolygonMesh& mesh, const int& min_weight);
+
+    /** \brief Re-extracts the triangles of the blocks changed since the last update and of the
+      * neighbours whose cubes read them, returns the number of blocks re-extracted. A vertex keeps
+      * its id while its voxel edge keeps crossing the surface.
+      */
+    size_t updateMesh(const int& min_weight);
+
+    /** \brief Mesh of the last updateMesh, vertex i has id i. Unused ids are left where their vertex was. */
+    void getMesh(pcl::PolygonMesh& mesh) const;
+
+    /** \brief Camera space points and normals of the first surface seen through every pixel from the
+      * camera to world pose, NaN where none is found before max_depth. Rows are cast in parallel,
+      * rays step over unallocated blocks whole. Paged out blocks are seen as empty space.
+      */
+    void raycast(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose, const float& max_depth,
+        std::vector<Eigen::Vector3f>& points, std::vector<Eigen::Vector3f>& normals) const;
+
+    float voxelSize() const;
+    float truncationDistance() const;
+    int maxWeight() const;
+    size_t blocksCount() const;
+    size_t residentBlocksCount() const;
+
+    /** \brief Resident voxels, block index and incremental mesh state. */
+    void memoryReport(MemoryReport& report) const;
+
+    /** \brief Blocks by index in [0, blocksCount()), in allocation order, paged out ones are read from the store. */
+    const Eigen::Vector3i& blockCoordinates(const uint32_t& index) const;
+    void readBlock(const uint32_t& index, Block& block) const;
+
+    /** \brief Allocates the block when needed and overwrites its voxels, for loading saved volumes. */
+    void setBlock(const Eigen::Vector3i& coordinates, const Block& block);
+
+    /** \brief Fuses a volume of the same voxel size and truncation distance into this one, voxels seen by
+      * both are averaged by their weights as if the other volume's frames were integrated here.
+      */
+    void merge(const VoxelHashVolume& other);
+
+    /** \brief merge of the other volume moved by the rigid transformation, its voxels resampled trilinearly
+      * at the voxel centres here. Only the voxels with all eight neighbours observed are carried over.
+      */
+    void mergeTransformed(const VoxelHashVolume& other, const Eigen::Matrix4f& transformation);
+
+protected:
+    struct MeshVertex {
+        Eigen::Vector3f position;
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+    const float voxel_size;
+    const float truncation_distance;
+    const uint8_t max_weight;
+
+    std::vector<Eigen::Vector3i> block_coordinates;
+    std::unordered_map<uint64_t, uint32_t> block_map;
+
+    /** \brief Voxels of the resident blocks: slot of every block, -1 when paged out, block of every
+      * slot, and the slots left by paged out blocks.
+      */
+    std::vector<Block> blocks;
+    std::vector<int32_t> block_slots;
+    std::vector<uint32_t> slot_blocks;
+    std::vector<uint32_t> free_slots;
+    size_t max_resident_blocks;
+    std::unique_ptr<BlockStore> store;
+    Eigen::Vector3f last_camera;
+
+    /** \brief Incremental mesh: blocks changed since the last updateMesh, vertex ids of the triangles
+      * of every block, and the vertices with their reference counts and voxel edges.
+      */
+    std::vector<uint8_t> dirty_blocks;
+    int mesh_min_weight;
+    std::vector<std::vector<uint32_t> > block_triangles;
+    std::vector<MeshVertex> mesh_vertices;
+    std::vector<uint32_t> vertex_references;
+    std::vector<uint64_t> vertex_edges;
+    std::vector<uint32_t> free_vertices;
+    std::unordered_map<uint64_t, uint32_t> edge_vertices;
+
+    static uint64_t block_key(const Eigen::Vector3i& block);
+
+    /** \brief Voxel edge from voxel along axis 0, 1 or 2, voxel coordinates within 20 bits. */
+    static uint64_t edge_key(const Eigen::Vector3i& voxel, const int& axis);
+
+    /** \brief -1 when the block is not allocated. */
+    int find_block(const Eigen::Vector3i& block) const;
+
+    uint32_t allocate_block(const Eigen::Vector3i& block);
+
+    /** \brief Voxels of a resident block. */
+    Block& resident_block(const uint32_t& index);
+
+    uint32_t take_slot(const uint32_t& index);
+
+    void page_in(const std::vector<uint32_t>& indices);
+
+    /** \brief The blocks and the neighbours their cubes read. */
+    void page_in_with_neighbours(const std::vector<uint32_t>& indices);
+
+    /** \brief Pages out the blocks farthest from the last camera while over the budget. */
+    void evict_to_budget();
+
+    void extract_blocks(const std::vector<uint32_t>& indices, const int& min_weight,
+        std::vector<std::vector<MeshVertex> >& vertices, std::vector<std::vector<uint64_t> >& edges);
+
+    /** \brief nullptr when the voxel's block is not allocated or paged out. */
+    const Voxel* find_voxel(const Eigen::Vector3i& voxel) const;
+
+    Eigen::Vector3i voxel_of_point(const Eigen::Vector3f& point) const;
+
+    /** \brief Trilinear TSDF between voxel centres, false when a corner is missing or never observed. */
+    bool interpolate_tsdf(const Eigen::Vector3f& point, float& tsdf) const;
+
+    /** \brief Trilinear TSDF, weight and colour between voxel centres, as interpolate_tsdf. */
+    bool sample_voxel(const Eigen::Vector3f& point, Voxel& sample) const;
+
+    /** \brief Weighted average of the source's observed voxels into the target, as merge. */
+    void fuse_block(const Block& source, Block& target) const;
+
+    /** \brief Depth along the ray of origin + ray * depth where the TSDF crosses zero from the front. */
+    bool march_ray(const Eigen::Vector3f& origin, const Eigen::Vector3f& ray, const float& max_depth,
+        float& depth) const;
+
+    void integrate_frames(const std::vector<cv::Mat>& depths, const std::vector<cv::Mat>& colors,
+        const std::vector<CameraIntrinsics>& intrinsics, const Matrix4fVector& poses);
+
+    /** \brief Blocks within the truncation band along the camera rays of the depth pixels. */
+    void allocate_blocks(const cv::Mat& depth, const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& pose);
+
+    /** \brief Allocated blocks whose bounding sphere is in front of the camera, inside the image
+      * and no farther than max_depth plus the truncation distance.
+      */
+    void frustum_blocks(const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& world_to_camera,
+        const float& max_depth, std::vector<uint32_t>& result) const;
+
+    void integrate_block(const uint32_t& index, const cv::Mat& depth, const cv::Mat& color,
+        const CameraIntrinsics& intrinsics, const Eigen::Matrix4f& world_to_camera);
+
+    /** \brief With edge_keys, also the voxel edge of every vertex. */
+    void extract_block(const uint32_t& index, const int& min_weight, std::vector<MeshVertex>& vertices,
+        std::vector<uint64_t>* edge_keys = nullptr) const;
+
+    uint32_t acquire_vertex(const uint64_t& edge, const MeshVertex& vertex);
+
+    /** \brief Three vertex ids per triangle. */
+    static void to_polygon_mesh(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& triangles,
+        pcl::PolygonMesh& mesh);
+};
+
+#endif // VOXEL_HASH_VOLUME_H
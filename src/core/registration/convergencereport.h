@@ -0,0 +1,94 @@
+#ifndef CONVERGENCEREPORT_H
+#define CONVERGENCEREPORT_H
+
+#include <QString>
+
+#include <chrono>
+
+/** \brief Iterations, exit reason, wall time and residual summary of one pair's iterative alignment.
+  * Without residuals of the final iteration inliers is zero.
+  */
+struct ConvergenceReport {
+    enum ExitReason {
+        NotRun,
+        PoseIncrement,
+        FitnessPlateau,
+        IterationLimit,
+        TimeBudget,
+        NoCorrespondences,
+        ClosedForm,
+        Failed
+    };
+
+    int iterations;
+    ExitReason reason;
+    double milliseconds;
+    int inliers;
+    double inlier_rms;
+
+    ConvergenceReport()
+        : iterations(0)
+        , reason(NotRun)
+        , milliseconds(0)
+        , inliers(0)
+        , inlier_rms(0)
+    {
+    }
+
+    static QString reasonName(const ExitReason& reason)
+    {
+        switch (reason) {
+        case PoseIncrement:
+            return "pose increment";
+        case FitnessPlateau:
+            return "fitness plateau";
+        case IterationLimit:
+            return "iteration limit";
+        case TimeBudget:
+            return "time budget";
+        case NoCorrespondences:
+            return "no correspondences";
+        case ClosedForm:
+            return "closed form";
+        case Failed:
+            return "failed";
+        default:
+            return "not run";
+        }
+    }
+
+    inline QString toString() const
+    {
+        return QString("%1 iterations, %2, %3 ms, %4 inliers, %5 rms")
+            .arg(iterations)
+            .arg(reasonName(reason))
+            .arg(milliseconds, 0, 'f', 3)
+            .arg(inliers)
+            .arg(inlier_rms, 0, 'g', 4);
+    }
+};
+
+/** \brief Wall time since construction, for per-pair time budgets. */
+class BudgetTimer {
+public:
+    BudgetTimer()
+        : start(std::chrono::steady_clock::now())
+    {
+    }
+
+    inline double milliseconds() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /** \brief A budget of zero or less never expires. */
+    inline bool expired(const double& budget_milliseconds) const
+    {
+        return budget_milliseconds > 0 && milliseconds() >= budget_milliseconds;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // CONVERGENCEREPORT_H
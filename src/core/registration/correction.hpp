@@ -15,12 +15,12 @@ public:
     }
 
     void setInput(
-        const Frames& inner_frames_,
+        Frames inner_frames_,
         const KeypointsFrames& inner_keypoints_frames_,
         const Matrix4fVector& inner_frames_transformations_,
         const KeypointsFrame& edge_keypoints_)
     {
-        inner_frames = inner_frames_;
+        inner_frames = std::move(inner_frames_);
         inner_keypoints_frames = inner_keypoints_frames_;
         src_inner_keypoints_frames = inner_keypoints_frames_;
         inner_frames_transformations = inner_frames_transformations_;
@@ -67,74 +67,73 @@ private:
     PcdPtrVector merged_keypoints;
     Matrix4fVector result_t;
 
+    /** \brief Cloud j holds the second keypoints of pair j - 1 then the first ones of pair j, the edge pair
+      * closing the loop at both ends. Every cloud is sized once and filled by block copies, the edge
+      * keypoints are transformed in the merged cloud and edge_keypoints is left as it was given.
+      */
     void merge_keypoints_frames()
     {
-        for (size_t j = 0; j <= inner_keypoints_frames.size(); j++) {
-            PcdPtr new_keypoint_cloud(new Pcd);
+        const size_t pairs_count = inner_keypoints_frames.size();
+        merged_keypoints.reserve(pairs_count + 1);
+        merged_correspondences.reserve(pairs_count + 1);
 
-            if (j == 0) {
-                pcl::transformPointCloud(
-                    *edge_keypoints.keypointsPcdPair.first,
-                    *edge_keypoints.keypointsPcdPair.first,
-                    inner_frames_transformations.front());
-
-                for (uint i = 0; i < edge_keypoints.keypointsPcdPair.first->size(); ++i) {
-                    new_keypoint_cloud->push_back((*edge_keypoints.keypointsPcdPair.first)[i]);
-                }
-
-                pcl::Correspondences correspondences;
-                for (uint i = 0; i < inner_keypoints_frames[0].keypointsPcdPair.first->size(); i++) {
-                    new_keypoint_cloud->push_back((*inner_keypoints_frames[0].keypointsPcdPair.first)[i]);
-
-                    pcl::Correspondence correspondence;
-                    correspondence = inner_keypoints_frames[0].keypointsPcdCorrespondences[i];
-                    correspondence.index_query = new_keypoint_cloud->size() - 1;
-                    correspondences.push_back(correspondence);
-                }
-                merged_correspondences.push_back(correspondences);
-            } else if (j == inner_keypoints_frames.size()) {
-                for (uint i = 0; i < inner_keypoints_frames[j - 1].keypointsPcdPair.second->size(); ++i) {
-                    new_keypoint_cloud->push_back((*inner_keypoints_frames[j - 1].keypointsPcdPair.second)[i]);
-                }
-
-                pcl::transformPointCloud(
-                    *edge_keypoints.keypointsPcdPair.second,
-                    *edge_keypoints.keypointsPcdPair.second,
-                    inner_frames_transformations.back());
+        for (size_t j = 0; j <= pairs_count; j++) {
+            const Pcd& head = j == 0 ? *edge_keypoints.keypointsPcdPair.first
+                                     : *inner_keypoints_frames[j - 1].keypointsPcdPair.second;
+            const Pcd& tail = j == pairs_count ? *edge_keypoints.keypointsPcdPair.second
+                                               : *inner_keypoints_frames[j].keypointsPcdPair.first;
 
-                pcl::Correspondences correspondences;
-                for (uint i = 0; i < edge_keypoints.keypointsPcdPair.second->size(); ++i) {
-                    new_keypoint_cloud->push_back((*edge_keypoints.keypointsPcdPair.second)[i]);
+            PcdPtr new_keypoint_cloud = concatenate(head, tail);
+            if (j == 0) {
+                transform_points(inner_frames_transformations.front(), *new_keypoint_cloud, 0, head.size());
+            }
+            if (j == pairs_count) {
+                transform_points(inner_frames_transformations.back(), *new_keypoint_cloud, head.size(), tail.size());
+            }
 
+            pcl::Correspondences correspondences(tail.size());
+            if (j == pairs_count) {
+                //The edge matches point into the first merged cloud, whose head is the edge first keypoints
+                for (size_t i = 0; i < tail.size(); ++i) {
                     const uint index_query = edge_keypoints.keypointsPcdCorrespondences[i].index_query;
-                    const PointType a(new_keypoint_cloud->back());
-                    const PointType b((*merged_keypoints[0])[index_query]);
-
-                    correspondences.push_back(pcl::Correspondence(
-                        new_keypoint_cloud->size() - 1, index_query, pcl::euclideanDistance(a, b)));
+                    const size_t index = head.size() + i;
+                    correspondences[i] = pcl::Correspondence(int(index), index_query,
+                        pcl::euclideanDistance((*new_keypoint_cloud)[index], (*merged_keypoints[0])[index_query]));
                 }
-                merged_correspondences.push_back(correspondences);
             } else {
-                for (size_t i = 0; i < inner_keypoints_frames[j - 1].keypointsPcdPair.second->size(); i++) {
-                    new_keypoint_cloud->push_back(inner_keypoints_frames[j - 1].keypointsPcdPair.second->at(i));
+                const pcl::Correspondences& pair_correspondences = inner_keypoints_frames[j].keypointsPcdCorrespondences;
+                std::copy(pair_correspondences.begin(), pair_correspondences.begin() + tail.size(), correspondences.begin());
+                for (size_t i = 0; i < tail.size(); ++i) {
+                    correspondences[i].index_query = int(head.size() + i);
                 }
-
-                pcl::Correspondences correspondences;
-                for (size_t i = 0; i < inner_keypoints_frames[j].keypointsPcdPair.first.get()->points.size(); i++) {
-                    new_keypoint_cloud->push_back((*inner_keypoints_frames[j].keypointsPcdPair.first)[i]);
-
-                    pcl::Correspondence correspondence;
-                    correspondence = inner_keypoints_frames[j].keypointsPcdCorrespondences[i];
-                    correspondence.index_query = new_keypoint_cloud->size() - 1;
-                    correspondences.push_back(correspondence);
-                }
-                merged_correspondences.push_back(correspondences);
             }
 
+            merged_correspondences.push_back(std::move(correspondences));
             merged_keypoints.push_back(new_keypoint_cloud);
         }
     }
 
+    static PcdPtr concatenate(const Pcd& head, const Pcd& tail)
+    {
+        PcdPtr result(new Pcd);
+        result->points.reserve(head.size() + tail.size());
+        result->points.insert(result->points.end(), head.points.begin(), head.points.end());
+        result->points.insert(result->points.end(), tail.points.begin(), tail.points.end());
+        result->width = uint32_t(result->points.size());
+        result->height = 1;
+        return result;
+    }
+
+    static void transform_points(const Eigen::Matrix4f& transformation, Pcd& cloud, const size_t& from, const size_t& count)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        const point_transform::Points points = { &cloud.points[from].x, count, sizeof(PointType) / sizeof(float) };
+        point_transform::apply(transformation, &points, 1);
+    }
+
     void calculate_correction()
     {
         CorrectionMethod correction(this, settings);
@@ -144,18 +143,19 @@ private:
 
     void perform_correction()
     {
+        //The keypoints detach from src_inner_keypoints_frames on their first transform
         for (uint i = 0; i < result_t.size(); ++i) {
-            inner_frames[i].transform(result_t[i]);
+            inner_frames[i] = inner_frames[i].transform(result_t[i]);
 
             if (i == 0) {
-                inner_keypoints_frames[i].transformFirst(result_t[i]);
+                inner_keypoints_frames[i].transformFirstInPlace(result_t[i]);
             }
             if (i + 1 == result_t.size()) {
-                inner_keypoints_frames[i - 1].transformSecond(result_t[i]);
+                inner_keypoints_frames[i - 1].transformSecondInPlace(result_t[i]);
             }
             if (i > 0 && i < inner_keypoints_frames.size()) {
-                inner_keypoints_frames[i - 1].transformSecond(result_t[i]);
-                inner_keypoints_frames[i].transformFirst(result_t[i]);
+                inner_keypoints_frames[i - 1].transformSecondInPlace(result_t[i]);
+                inner_keypoints_frames[i].transformFirstInPlace(result_t[i]);
             }
         }
     }
@@ -0,0 +1,84 @@
+#ifndef DENSEICPREGISTRATION_H
+#define DENSEICPREGISTRATION_H
+
+#include <QObject>
+
+#include "core/base/scannertypes.h"
+#include "core/registration/convergencereport.h"
+#include "core/registration/densepyramid.h"
+
+/** \brief Point to plane ICP over the full organized clouds of a frame pair. Source points are
+  * matched by reprojection into the target image instead of a kd-tree search, the normal
+  * equations are accumulated per row band on the thread pool. Alignment runs coarse to fine
+  * over the frames' DensePyramid levels. Keypoints are not used, the frames come from setFrames.
+  * With setModel the source frame is aligned to a rendered view of the model instead of the target
+  * frame. Without organized clouds the initial transformation is kept.
+  */
+class DenseICPRegistration : public ScannerBase {
+    Q_OBJECT
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    DenseICPRegistration(QObject* parent, QSettings* parent_settings);
+
+    void setInput(
+        const KeypointsFrame& keypoints_frame_,
+        const Eigen::Matrix4f& initial_transformation_);
+
+    /** \brief target_frame_ is the first frame of the pair, source_frame_ the second one. */
+    void setFrames(const Frame& target_frame_, const Frame& source_frame_);
+
+    /** \brief Camera space points and normals of the model seen from the camera to world model_pose,
+      * taking the place of the target frame.
+      */
+    void setModel(DensePyramid::Level model_, const Eigen::Matrix4f& model_pose_);
+
+    /** \brief Predicted align() result, used as the starting guess instead of the initial transformation. */
+    void setPrediction(const Eigen::Matrix4f& predicted_transformation_);
+
+    Eigen::Matrix4f align();
+
+    Eigen::Matrix4f getTransformation() const;
+
+    float getFitnessScore() const;
+
+    ConvergenceReport getConvergenceReport() const;
+
+    /** \brief False when the full resolution level was not aligned and the initial transformation was kept. */
+    bool isAligned() const;
+
+private:
+    /** \brief Iteration budget per pyramid level, from the coarsest level to the full resolution. */
+    std::vector<int> level_iterations;
+    const int pixel_step;
+    const float max_correspondence_distance;
+    const double transformation_epsilon;
+    const int min_correspondences;
+    const double time_budget;
+
+    Frame target_frame;
+    Frame source_frame;
+    DensePyramid::Level model;
+    Eigen::Matrix4f model_pose;
+    bool has_model;
+    Eigen::Matrix4f initial_transformation;
+    Eigen::Matrix4f predicted_transformation;
+    bool has_prediction;
+    Eigen::Matrix4f result_t;
+    float fitness_score;
+    ConvergenceReport report;
+    bool result_aligned;
+
+    void calculate();
+
+    /** \brief Returns false when the level has too few correspondences or a degenerate system. */
+    bool align_level(
+        const DensePyramid::Level& target,
+        const DensePyramid::Level& source,
+        const int& level_index,
+        Eigen::Matrix4f& camera_t,
+        float& level_fitness_score) const;
+};
+
+#endif // DENSEICPREGISTRATION_H
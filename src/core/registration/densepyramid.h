@@ -0,0 +1,71 @@
+#ifndef DENSEPYRAMID_H
+#define DENSEPYRAMID_H
+
+#include <Eigen/Core>
+
+#include <memory>
+#include <vector>
+
+#include "core/base/cameraintrinsics.h"
+#include "core/base/scannertypes.h"
+
+/** \brief Camera space points and normals of an organized cloud at halving resolutions.
+  * Level 0 is the cloud itself, every next level averages 2x2 blocks of depth consistent points.
+  * Invalid points and normals are NaN.
+  */
+class DensePyramid {
+public:
+    struct Level {
+        unsigned int width;
+        unsigned int height;
+        CameraIntrinsics intrinsics;
+        std::vector<Eigen::Vector3f> points;
+        std::vector<Eigen::Vector3f> normals;
+
+        inline bool hasPoint(const size_t& index) const
+        {
+            return std::isfinite(points[index].z());
+        }
+
+        inline bool hasNormal(const size_t& index) const
+        {
+            return std::isfinite(normals[index].x());
+        }
+    };
+
+    /** \brief Returns nullptr when the cloud is not organized or the camera model can't be fitted.
+      * Level 0 takes normals from the organized normals given, otherwise they are calculated.
+      */
+    static std::shared_ptr<const DensePyramid> build(const Pcd& cloud, const int& levels_count,
+        const NormalPcd* normals = nullptr);
+
+    /** \brief Pyramid of the frame's cloud with at least levels_count levels, built once and kept
+      * in the frame's derived data. Safe to call for the same frame from several threads.
+      */
+    static std::shared_ptr<const DensePyramid> ofFrame(const Frame& frame, const int& levels_count);
+
+    /** \brief Pyramid over a level 0 whose points and normals are already known, such as a raycast model view. */
+    static std::shared_ptr<const DensePyramid> fromLevel(Level base, const int& levels_count);
+
+    inline size_t size() const
+    {
+        return levels.size();
+    }
+
+    inline const Level& level(const size_t& index) const
+    {
+        return levels[index];
+    }
+
+private:
+    std::vector<Level> levels;
+
+    /** \brief Coarser levels below the existing ones, up to levels_count of them. */
+    void build_levels(const int& levels_count);
+
+    static void downsample(const Level& fine, Level& coarse);
+
+    static void calculate_normals(Level& level);
+};
+
+#endif // DENSEPYRAMID_H
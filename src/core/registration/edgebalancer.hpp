@@ -1,6 +1,7 @@
 #ifndef EDGEBALANCER_HPP
 #define EDGEBALANCER_HPP
 
+#include <atomic>
 #include <iterator>
 #include <stdexcept>
 
@@ -8,8 +9,15 @@
 #include "core/base/scannertypes.h"
 #include "core/registration/icpregistration.h"
 #include "core/registration/linearregistration.hpp"
+#include "core/registration/pairregistrationcache.h"
 #include "core/registration/sacregistration.h"
+#include "utility/log.h"
+#include "utility/threadpool.h"
 
+/** \brief Moves loop edges whose Metric deviates from the average to the nearest inlier frame. With
+  * EDGE_BALANCER_SETTINGS/COARSE the edges are scored by SaC alone, the chosen edges are registered
+  * with SaC and ICP by the caller anyway.
+  */
 template <typename Metric, typename Iter>
 class EdgeBalancer : public ScannerBase {
 public:
@@ -22,6 +30,7 @@ public:
         QObject* parent = nullptr)
         : ScannerBase(parent, settings)
         , loop_size(loop_size_)
+        , coarse(configs.value("EDGE_BALANCER_SETTINGS/COARSE").toBool())
     {
         if (begin_iterator == end_iterator) {
             throw std::invalid_argument("EdgeBalancer::setInput begin_iterator == end_iterator");
@@ -42,6 +51,9 @@ public:
         calculate_abs_deviations();
         balance_outliers();
 
+        LOG_DEBUG("registration") << "EdgeBalancer:" << (coarse ? "coarse" : "full") << "pair registrations"
+                                  << pair_cache.getMisses() << "cached" << pair_cache.getHits();
+
         return getBalancedEdges();
     }
 
@@ -93,11 +105,39 @@ private:
     typedef std::vector<Edge, Eigen::aligned_allocator<Matrix> > Edges;
 
     const uint loop_size;
+    const bool coarse;
     Iter begin_it;
     Iter end_it;
     Edges edges;
     double average_metric;
     double average_abs_deviation;
+    PairRegistrationCache pair_cache;
+
+    /** \brief SaC and then ICP results of a two frame chain, each distinct pair and initial transformation registers once.
+      * Coarse scoring leaves ICP at identity.
+      */
+    PairRegistrationCache::Result register_edge_pair(
+        const Edge& first, const Edge& second, const Matrix& initial_transformation)
+    {
+        return pair_cache.get(first.index, second.index, initial_transformation, [&]() {
+            Frames pair_frames, transformed_pair_frames;
+            pair_frames.push_back(*first.it);
+            pair_frames.push_back(*second.it);
+
+            LinearRegistration<SaCRegistration> linear_sac(this, settings);
+            linear_sac.setInput(pair_frames, initial_transformation);
+            const Matrix4fVector sac_t = linear_sac.align(transformed_pair_frames);
+            if (coarse) {
+                return PairRegistrationCache::Result(sac_t[1], Matrix::Identity());
+            }
+
+            LinearRegistration<ICPRegistration> linear_icp(this, settings);
+            linear_icp.setInput(transformed_pair_frames, Matrix::Identity());
+            const Matrix4fVector icp_t = linear_icp.align(transformed_pair_frames);
+
+            return PairRegistrationCache::Result(sac_t[1], icp_t[1]);
+        });
+    }
 
     void init_edges(const uint& begin_edge_index = 0)
     {
@@ -134,6 +174,13 @@ private:
             throw std::out_of_range("EdgeBalancer::calculate_transformations begin_edge_index >= edges.size()");
         }
 
+        if (end_edge_index == begin_edge_index + 2) {
+            const auto pair_t = register_edge_pair(
+                edges[begin_edge_index], edges[begin_edge_index + 1], edges[begin_edge_index].transformation);
+            edges[begin_edge_index + 1].transformation = Matrix(pair_t.first) * Matrix(pair_t.second);
+            return;
+        }
+
         Frames edge_frames, transformed_edge_frames;
         std::transform(edges.begin() + begin_edge_index, edges.begin() + end_edge_index,
             std::back_inserter(edge_frames), [](const Edge& edge) { return *edge.it; });
@@ -141,6 +188,12 @@ private:
         LinearRegistration<SaCRegistration> linear_sac(this, settings);
         linear_sac.setInput(edge_frames, edges[begin_edge_index].transformation);
         const Matrix4fVector sac_t = linear_sac.align(transformed_edge_frames);
+        if (coarse) {
+            for (uint i = 1; i < sac_t.size(); ++i) {
+                edges[i + begin_edge_index].transformation = sac_t[i];
+            }
+            return;
+        }
 
         LinearRegistration<ICPRegistration> linear_icp(this, settings);
         linear_icp.setInput(transformed_edge_frames, Matrix::Identity());
@@ -226,6 +279,10 @@ private:
         }
     }
 
+    /** \brief Nearest candidate inside the loop first, then beyond the edge. Candidates of one side are scored
+      * on the thread pool in walk order and the walk is cut after its first inlier, so the scored candidates
+      * are the ones a sequential walk would score.
+      */
     Edge find_nearest_inlier(const uint& index)
     {
         if (edges[index].abs_deviation <= average_abs_deviation) {
@@ -233,60 +290,59 @@ private:
         }
 
         Edges tmp_edges(1, edges[index]);
-        Edge minus_edge(edges[index]);
-        Edge plus_edge(edges[index]);
 
-        while ((--minus_edge).index - edges[index - 1].index >= 3
-            && minus_edge.abs_deviation > average_abs_deviation) {
-            Frames tmp_edge_frames, tmp_transformed_edge_frames;
-            tmp_edge_frames.push_back(*edges[index - 1].it);
-            tmp_edge_frames.push_back(*minus_edge.it);
-
-            LinearRegistration<SaCRegistration> linear_sac(this, settings);
-            linear_sac.setInput(tmp_edge_frames, edges[index - 1].transformation);
-            const Matrix4fVector sac_t = linear_sac.align(tmp_transformed_edge_frames);
-
-            LinearRegistration<ICPRegistration> linear_icp(this, settings);
-            linear_icp.setInput(tmp_transformed_edge_frames, Matrix::Identity());
-            const Matrix4fVector icp_t = linear_icp.align(tmp_transformed_edge_frames);
+        Edges minus_candidates;
+        Edge minus_edge(edges[index]);
+        while ((--minus_edge).index - edges[index - 1].index >= 3) {
+            minus_candidates.push_back(minus_edge);
+        }
+        score_candidates(index, minus_candidates, tmp_edges);
 
-            minus_edge.transformation = icp_t[1] * sac_t[1];
-            minus_edge.metric = Metric::calculate(minus_edge.transformation, edges[index - 1].transformation);
-            minus_edge.calculate_abs_deviation(average_metric);
+        std::sort(tmp_edges.begin(), tmp_edges.end(),
+            [](const Edge& a, const Edge& b) { return a.abs_deviation < b.abs_deviation; });
 
-            tmp_edges.push_back(minus_edge);
+        if (tmp_edges.front().abs_deviation > average_abs_deviation) {
+            Edges plus_candidates;
+            Edge plus_edge(edges[index]);
+            while (((++plus_edge).index - edges[index].index <= loop_size * 2) && (plus_edge.it != end_it)) {
+                plus_candidates.push_back(plus_edge);
+            }
+            score_candidates(index, plus_candidates, tmp_edges);
         }
 
         std::sort(tmp_edges.begin(), tmp_edges.end(),
             [](const Edge& a, const Edge& b) { return a.abs_deviation < b.abs_deviation; });
 
-        while ((tmp_edges.front().abs_deviation > average_abs_deviation)
-            && ((++plus_edge).index - edges[index].index <= loop_size * 2)
-            && (plus_edge.it != end_it)
-            && (plus_edge.abs_deviation > average_abs_deviation)) {
-            Frames tmp_edge_frames, tmp_transformed_edge_frames;
-            tmp_edge_frames.push_back(*edges[index - 1].it);
-            tmp_edge_frames.push_back(*plus_edge.it);
-
-            LinearRegistration<SaCRegistration> linear_sac(this, settings);
-            linear_sac.setInput(tmp_edge_frames, edges[index - 1].transformation);
-            const Matrix4fVector sac_t = linear_sac.align(tmp_transformed_edge_frames);
+        return tmp_edges.front();
+    }
 
-            LinearRegistration<ICPRegistration> linear_icp(this, settings);
-            linear_icp.setInput(tmp_transformed_edge_frames, Matrix::Identity());
-            const Matrix4fVector icp_t = linear_icp.align(tmp_transformed_edge_frames);
+    /** \brief Registers the candidates against edge index - 1 and appends them up to the first inlier.
+      * A candidate behind an already found inlier is skipped, every one before it is always scored.
+      */
+    void score_candidates(const uint& index, Edges& candidates, Edges& scored)
+    {
+        std::atomic<size_t> first_inlier(candidates.size());
 
-            plus_edge.transformation = icp_t[1] * sac_t[1];
-            plus_edge.metric = Metric::calculate(plus_edge.transformation, edges[index - 1].transformation);
-            plus_edge.calculate_abs_deviation(average_metric);
+        ThreadPool::instance().parallel_for(0, candidates.size(), [&](size_t i) {
+            if (i > first_inlier.load()) {
+                return;
+            }
 
-            tmp_edges.push_back(plus_edge);
-        }
+            Edge& candidate = candidates[i];
+            const auto pair_t = register_edge_pair(edges[index - 1], candidate, edges[index - 1].transformation);
+            candidate.transformation = Matrix(pair_t.second) * Matrix(pair_t.first);
+            candidate.metric = Metric::calculate(candidate.transformation, edges[index - 1].transformation);
+            candidate.calculate_abs_deviation(average_metric);
 
-        std::sort(tmp_edges.begin(), tmp_edges.end(),
-            [](const Edge& a, const Edge& b) { return a.abs_deviation < b.abs_deviation; });
+            if (candidate.abs_deviation <= average_abs_deviation) {
+                size_t current = first_inlier.load();
+                while (i < current && !first_inlier.compare_exchange_weak(current, i)) {
+                }
+            }
+        });
 
-        return tmp_edges.front();
+        const size_t scored_count = std::min(first_inlier.load() + 1, candidates.size());
+        std::copy(candidates.begin(), candidates.begin() + scored_count, std::back_inserter(scored));
     }
 };
 
@@ -3,6 +3,8 @@
 
 #include <boost/iterator/counting_iterator.hpp>
 
+#include "core/keypoints/loopclosureindex.h"
+#include "core/keypoints/orbkeypointdetector.h"
 #include "core/registration/correction.hpp"
 #include "core/registration/edgebalancer.hpp"
 #include "core/registration/elchcorrection.h"
@@ -10,9 +12,18 @@
 #include "core/registration/icpregistration.h"
 #include "core/registration/linearregistration.hpp"
 #include "core/registration/lumcorrection.h"
+#include "core/registration/posegraph.h"
+#include "core/registration/poseindex.h"
 #include "core/registration/registrationalgorithm.hpp"
 #include "core/registration/sacregistration.h"
+#include "io/loopjobs.h"
 #include "io/pcdinputiterator.hpp"
+#include "utility/log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
 
 class EdgeBasedRegistration : public RegistrationAlgorithm {
 public:
@@ -23,6 +34,7 @@ public:
         std::pair<Frame, Frame> edge_frames;
         KeypointsFrame edge_keypoints;
         std::pair<Eigen::Matrix4f, Eigen::Matrix4f> edge_transformations;
+        std::vector<int> pose_graph_vertices;
 
         Loop(const uint& start_loop_frame_index, const uint& end_loop_frame_index)
         {
@@ -38,14 +50,76 @@ public:
 
     EdgeBasedRegistration(QObject* parent, QSettings* parent_settings)
         : RegistrationAlgorithm(parent, parent_settings)
-        , loop_size(settings->value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_FIXED_STEP").toInt())
+        , loop_size(project.value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_FIXED_STEP").toInt())
+        , use_pose_graph(configs.value("POSE_GRAPH_SETTINGS/ENABLE").toBool())
+        , jobs_folder(loop_jobs::jobs_folder(project, configs))
+        , distributed_worker(false)
+        , integrate_loops(true)
     {
     }
 
+    /** \brief Worker side of DISTRIBUTED_SETTINGS: processes the loop jobs of the shared folder until none
+      * shows up for IDLE_TIMEOUT_S and returns how many it completed. The pose graph is left to the
+      * coordinator. With SUB_VOLUMES and the voxel hash backend every loop is integrated into a volume
+      * of its own, written next to its result, otherwise the frames are not integrated here at all.
+      * A job that is damaged or fails is marked failed for the coordinator and the worker goes on.
+      */
+    size_t runLoopJobs()
+    {
+        if (jobs_folder.isEmpty()) {
+            throw std::invalid_argument("EdgeBasedRegistration::runLoopJobs DISTRIBUTED_SETTINGS/ENABLE is off");
+        }
+
+        const uint64_t parameters_hash = reconstruction_checkpoint::parameters_hash(project, configs);
+        const int poll_interval = std::max(10, configs.value("DISTRIBUTED_SETTINGS/POLL_INTERVAL_MS").toInt());
+        const std::chrono::seconds idle_timeout(configs.value("DISTRIBUTED_SETTINGS/IDLE_TIMEOUT_S").toInt());
+        const bool sub_volumes = !use_pose_graph && configs.value("DISTRIBUTED_SETTINGS/SUB_VOLUMES").toBool()
+            && cpu_tsdf
+            && configs.value("CPU_TSDF_SETTINGS/BACKEND").toString() == "VOXEL_HASH";
+
+        size_t completed_count = 0;
+        auto idle_since = std::chrono::steady_clock::now();
+        for (;;) {
+            size_t index = 0;
+            reconstruction_checkpoint::LoopRecord record;
+            if (!loop_jobs::claim_job(jobs_folder, parameters_hash, index, record)) {
+                if (std::chrono::steady_clock::now() - idle_since > idle_timeout) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval));
+                continue;
+            }
+            idle_since = std::chrono::steady_clock::now();
+
+            try {
+                complete_loop_job(parameters_hash, index, record, sub_volumes);
+            } catch (const std::exception& e) {
+                LOG_WARNING("distributed") << "Loop" << index << "failed:" << e.what();
+                loop_jobs::fail_job(jobs_folder, index);
+                continue;
+            }
+
+            ++completed_count;
+            LOG_INFO("distributed") << "Loop" << index << "completed," << completed_count << "by this worker";
+        }
+
+        return completed_count;
+    }
+
 private:
     const int loop_size;
+    const bool use_pose_graph;
     Loops loops;
 
+    /** \brief DISTRIBUTED_SETTINGS/JOBS_FOLDER, empty when the loops are processed here. */
+    const QString jobs_folder;
+    bool distributed_worker;
+    bool integrate_loops;
+
+    /** \brief One graph for the whole session, frame indexes map to its vertices. Loops are added in order. */
+    PoseGraph pose_graph;
+    std::map<uint, int> pose_graph_vertices;
+
     void prepare_all_loops()
     {
         const uint read_loop_size = loop_size * read_step;
@@ -53,19 +127,19 @@ private:
         Frames edge_frames;
         Frames transformed_edge_frames;
 
-        if (!settings->value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_EDGE_BALANCING").toBool()) {
+        if (!project.value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_EDGE_BALANCING").toBool()) {
             for (uint i = read_from + read_loop_size; i <= read_to; i += read_loop_size) {
                 loops.push_back(Loop(i - read_loop_size, i));
             }
 
             const uint edges_from = loops.front().edge_frames_indexes.first;
             const uint edges_to = loops.back().edge_frames_indexes.second;
-            for (Iter it(settings, edges_from, edges_to, read_loop_size); it != Iter(); ++it) {
+            for (Iter it(project, edges_from, edges_to, read_loop_size); it != Iter(); ++it) {
                 edge_frames.push_back(*it);
             }
         } else {
-            Iter it(settings, read_from, read_to, read_step);
-            EdgeBalancer<CameraDistanceMetric, Iter> eb(it, Iter(), loop_size, settings);
+            Iter it(project, read_from, read_to, read_step);
+            EdgeBalancer<CameraDistanceMetric, Iter> eb(it, Iter(), loop_size, settings, this);
             std::vector<uint> edge_indices = eb.balance();
 
             for (uint index = 0, edge_index = 0; it != Iter(); ++it, ++index) {
@@ -88,7 +162,7 @@ private:
         }
 
         PcdFilters filters(this, settings);
-        filters.setInput(edge_frames);
+        filters.setInput(std::move(edge_frames));
         filters.filter(edge_frames);
 
         LinearRegistration<SaCRegistration> linear_sac(this, settings);
@@ -114,13 +188,139 @@ private:
 
     void process_all_loops()
     {
-        for (uint i = 0; i < loops.size(); ++i) {
-            loops[i] = process_one_loop(loops[i]);
+        if (!jobs_folder.isEmpty()) {
+            distribute_loops();
+        } else {
+            const size_t lanes_count = concurrent_loops_count(
+                loops.size(), loop_size, "ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_LOOPS_MEMORY_MB");
+            process_loops(loops, lanes_count,
+                [this](const Loop& loop, TicketGate* vizualization_gate, const size_t& ticket) {
+                    return process_one_loop(loop, vizualization_gate, ticket);
+                });
+        }
+
+        if (use_pose_graph) {
+            if (configs.value("LOOP_CLOSURE_SETTINGS/ENABLE").toBool()) {
+                add_loop_closures();
+            }
+
+            //Loops were corrected as they completed, the final solve also moves the earlier ones
+            pose_graph.optimize(configs.value("POSE_GRAPH_SETTINGS/MAX_ITERATIONS").toInt());
+            std::vector<const RegistrationAlgorithm::Loop*> corrected_loops;
+            for (auto& loop : loops) {
+                for (uint i = 0; i < loop.pose_graph_vertices.size(); ++i) {
+                    loop.inner_transformations[i] = pose_graph.getPose(loop.pose_graph_vertices[i]);
+                }
+                corrected_loops.push_back(&loop);
+            }
+            complete_checkpoint_loops(corrected_loops);
         }
 
         loops_data_vizualization(loops);
     }
 
+    /** \brief Processes a loop job as a worker does and writes its result, throws when it can't. */
+    void complete_loop_job(const uint64_t& parameters_hash, const size_t& index,
+        reconstruction_checkpoint::LoopRecord record, const bool& sub_volumes)
+    {
+        if (!is_prepared_record(record)) {
+            throw std::runtime_error("EdgeBasedRegistration::complete_loop_job damaged job");
+        }
+
+        const bool was_integrating = integrate_loops;
+        distributed_worker = true;
+        integrate_loops = sub_volumes;
+        Loop loop;
+        try {
+            if (sub_volumes) {
+                volumeReconstruction.reset(new VolumeReconstruction(this, settings));
+            }
+            loop = process_one_loop(prepared_loop(record), nullptr, index);
+        } catch (...) {
+            distributed_worker = false;
+            integrate_loops = was_integrating;
+            throw;
+        }
+        distributed_worker = false;
+        integrate_loops = was_integrating;
+
+        if (sub_volumes && !volumeReconstruction->saveVolume(loop_jobs::volume_filename(jobs_folder, index))) {
+            throw std::runtime_error("EdgeBasedRegistration::complete_loop_job can't write the sub-volume");
+        }
+
+        record.completed = true;
+        record.frame_indexes = loop.inner_frame_indexes;
+        record.inner_transformations = loop.inner_transformations;
+        record.fitness_scores = loop.inner_t_fitness_scores;
+        if (!loop_jobs::write_result(jobs_folder, index, parameters_hash, record)) {
+            throw std::runtime_error("EdgeBasedRegistration::complete_loop_job can't write the result");
+        }
+    }
+
+    /** \brief Coordinator side of DISTRIBUTED_SETTINGS: writes a job per loop neither in the checkpoint nor
+      * with a result in the folder, then takes the results in loop order as the workers return them, so a
+      * rerun only waits for the missing loops. A loop's sub-volume is merged when its worker wrote one,
+      * otherwise its frames are read and integrated here. With the pose graph the loops go into the graph
+      * here as they arrive. While it waits the coordinator processes unclaimed jobs itself, so it finishes
+      * without any live worker, and loops a worker marked failed are processed here from their own record.
+      * The folder is cleared once every loop is received.
+      */
+    void distribute_loops()
+    {
+        const uint64_t parameters_hash = reconstruction_checkpoint::parameters_hash(project, configs);
+        const std::vector<reconstruction_checkpoint::LoopRecord> records = prepared_loops();
+        for (size_t i = 0; i < records.size(); ++i) {
+            reconstruction_checkpoint::LoopRecord result;
+            if (!completed_checkpoint_loop(i, result) && !loop_jobs::load_result(jobs_folder, i, parameters_hash, result)
+                && !loop_jobs::write_job(jobs_folder, i, parameters_hash, records[i])) {
+                throw std::runtime_error("EdgeBasedRegistration::distribute_loops can't write the job");
+            }
+        }
+        LOG_INFO("distributed") << records.size() << "loop jobs in" << jobs_folder;
+
+        const int poll_interval = std::max(10, configs.value("DISTRIBUTED_SETTINGS/POLL_INTERVAL_MS").toInt());
+        const int claim_timeout = configs.value("DISTRIBUTED_SETTINGS/CLAIM_TIMEOUT_S").toInt();
+        //The poses of the sub-volumes move with the pose graph
+        const bool merge_volumes = !use_pose_graph && configs.value("DISTRIBUTED_SETTINGS/SUB_VOLUMES").toBool();
+        for (size_t i = 0; i < loops.size(); ++i) {
+            reconstruction_checkpoint::LoopRecord result;
+            if (completed_checkpoint_loop(i, result)) {
+                loops[i] = replayed_record_loop(loops[i], result, nullptr, i, true);
+                continue;
+            }
+            while (!loop_jobs::load_result(jobs_folder, i, parameters_hash, result)) {
+                if (loop_jobs::take_failed_job(jobs_folder, i)) {
+                    LOG_WARNING("distributed") << "Loop" << i + 1 << "failed on a worker, it is processed here";
+                    complete_loop_job(parameters_hash, i, records[i], false);
+                    continue;
+                }
+
+                const size_t requeued_count = loop_jobs::requeue_stale_claims(jobs_folder, claim_timeout);
+                if (requeued_count > 0) {
+                    LOG_WARNING("distributed") << requeued_count << "stale claims are given to other workers";
+                }
+
+                //Its frames are integrated when the result is received, as those of any worker without sub-volumes
+                size_t index = 0;
+                reconstruction_checkpoint::LoopRecord job;
+                if (loop_jobs::claim_job(jobs_folder, parameters_hash, index, job)) {
+                    complete_loop_job(parameters_hash, index, index < records.size() ? records[index] : job, false);
+                    LOG_INFO("distributed") << "Loop" << index + 1 << "processed by the coordinator";
+                    continue;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval));
+            }
+
+            const bool merged = merge_volumes
+                && volumeReconstruction->mergeVolume(loop_jobs::volume_filename(jobs_folder, i));
+            loops[i] = received_loop(loops[i], result, i, merged);
+            LOG_INFO("distributed") << "Loop" << i + 1 << "/" << loops.size() << (merged ? "merged" : "received");
+        }
+
+        //The checkpoint holds the loops from now on
+        loop_jobs::clear(jobs_folder);
+    }
+
     void perform_tsdf_meshing()
     {
         Matrix4fVector result_t;
@@ -130,13 +330,20 @@ private:
         }
 
         volumeReconstruction->prepareVolume();
+
+        if (!pcdVizualizer) {
+            volumeReconstruction->calculateMesh();
+            return;
+        }
+
         pcdVizualizer->redraw();
 
-        if (settings->value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
-            pcdVizualizer->visualizeCameraPoses(result_t);
+        if (project.value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
+            //The poses are drawn loop by loop as the loops finish
+            pcdVizualizer->plotCameraPoses(result_t);
         }
 
-        if (settings->value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
+        if (project.value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
             pcl::PolygonMesh mesh;
             volumeReconstruction->calculateMesh();
             volumeReconstruction->getPoligonMesh(mesh);
@@ -144,16 +351,21 @@ private:
         }
     }
 
-    Loop process_one_loop(const Loop& loop)
+    Loop process_one_loop(const Loop& loop, TicketGate* vizualization_gate, const size_t& ticket)
     {
         Frames inner_frames;
-        Iter it(settings, loop.edge_frames_indexes.first, loop.edge_frames_indexes.second, read_step);
+        Iter it(project, loop.edge_frames_indexes.first, loop.edge_frames_indexes.second, read_step);
         for (; it != Iter(); ++it) {
             inner_frames.push_back(*it);
         }
 
+        Loop result_loop(loop);
+        for (const Frame& frame : inner_frames) {
+            result_loop.inner_frame_indexes.push_back(frame.frameIndex);
+        }
+
         PcdFilters filters(this, settings);
-        filters.setInput(inner_frames);
+        filters.setInput(std::move(inner_frames));
         filters.filter(inner_frames);
 
         Frames transformed_inner_frames;
@@ -172,7 +384,7 @@ private:
             result_t.push_back(icp_t[i] * sac_t[i]);
         }
 
-        if (settings->value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_ELCH_LUM").toBool()) {
+        if (!use_pose_graph && project.value("ALGORITHM_SETTINGS/EDGE_BASED_RECONSTRUCTION_ELCH_LUM").toBool()) {
             Correction<ElchCorrection> elch(this, settings);
             elch.setInput(transformed_inner_frames, linear_icp.getTransformedKeypoints(), result_t, loop.edge_keypoints);
             const Matrix4fVector elch_t = elch.correct(transformed_inner_frames);
@@ -189,14 +401,293 @@ private:
             transformed_keypoints = lum.getTransformedKeypoints();
         }
 
-        vizualization(inner_frames, transformed_inner_frames, transformed_keypoints, result_t);
+        //A worker's loops are integrated into its own sub-volume
+        const bool submap = integrate_loops && !distributed_worker
+            && integrate_loop_submap(ticket, inner_frames, result_t);
+        const auto finish_loop = [&]() {
+            if (use_pose_graph && !distributed_worker) {
+                result_loop.pose_graph_vertices = add_loop_to_pose_graph(loop, result_t);
+                for (uint i = 0; i < result_t.size(); ++i) {
+                    result_t[i] = pose_graph.getPose(result_loop.pose_graph_vertices[i]);
+                    transformed_inner_frames[i] = inner_frames[i].transform(result_t[i]);
+                }
+            }
+            if (integrate_loops && !submap) {
+                vizualization(inner_frames, transformed_inner_frames, transformed_keypoints, result_t);
+            }
+        };
+        if (vizualization_gate) {
+            vizualization_gate->run(ticket, finish_loop);
+        } else {
+            finish_loop();
+        }
 
-        Loop result_loop(loop);
         result_loop.inner_transformations = result_t;
         result_loop.inner_t_fitness_scores = linear_icp.getFitnessScores();
 
         return result_loop;
     }
+
+    std::vector<const RegistrationAlgorithm::Loop*> result_loops() const
+    {
+        std::vector<const RegistrationAlgorithm::Loop*> result;
+        for (const Loop& loop : loops) {
+            result.push_back(&loop);
+        }
+
+        return result;
+    }
+
+    std::vector<reconstruction_checkpoint::LoopRecord> prepared_loops() const
+    {
+        std::vector<reconstruction_checkpoint::LoopRecord> records(loops.size());
+        for (uint i = 0; i < loops.size(); ++i) {
+            records[i].indexes = { loops[i].edge_frames_indexes.first, loops[i].edge_frames_indexes.second };
+            records[i].transformations.push_back(loops[i].edge_transformations.first);
+            records[i].transformations.push_back(loops[i].edge_transformations.second);
+            records[i].keypoints.push_back(loops[i].edge_keypoints);
+        }
+
+        return records;
+    }
+
+    /** \brief The edge frames are read and filtered again, their registration is taken from the records. */
+    bool restore_prepared_loops(const std::vector<reconstruction_checkpoint::LoopRecord>& records)
+    {
+        Loops restored_loops;
+        for (const auto& record : records) {
+            if (!is_prepared_record(record)) {
+                return false;
+            }
+            restored_loops.push_back(prepared_loop(record));
+        }
+        if (restored_loops.empty()) {
+            return false;
+        }
+
+        Frames edge_frames;
+        std::vector<uint> edge_frames_indexes(1, restored_loops.front().edge_frames_indexes.first);
+        for (const auto& loop : restored_loops) {
+            edge_frames_indexes.push_back(loop.edge_frames_indexes.second);
+        }
+        for (const uint& index : edge_frames_indexes) {
+            Iter it(project, index, index + 1, 1);
+            if (it == Iter() || uint((*it).frameIndex) != index) {
+                return false;
+            }
+            edge_frames.push_back(*it);
+        }
+
+        PcdFilters filters(this, settings);
+        filters.setInput(std::move(edge_frames));
+        filters.filter(edge_frames);
+
+        for (uint i = 0; i < restored_loops.size(); ++i) {
+            restored_loops[i].edge_frames = std::make_pair(edge_frames[i], edge_frames[i + 1]);
+        }
+
+        loops = std::move(restored_loops);
+        return true;
+    }
+
+    static bool is_prepared_record(const reconstruction_checkpoint::LoopRecord& record)
+    {
+        return record.indexes.size() == 2 && record.transformations.size() == 2 && record.keypoints.size() == 1;
+    }
+
+    /** \brief The loop of a record of prepared_loops(), without its edge frames. */
+    static Loop prepared_loop(const reconstruction_checkpoint::LoopRecord& record)
+    {
+        Loop loop(record.indexes[0], record.indexes[1]);
+        loop.edge_transformations = std::make_pair(record.transformations[0], record.transformations[1]);
+        loop.edge_keypoints = record.keypoints[0];
+        return loop;
+    }
+
+    /** \brief Completed loops go into the pose graph as they did when they were registered. */
+    void replayed_loop(RegistrationAlgorithm::Loop& replayed)
+    {
+        if (!use_pose_graph) {
+            return;
+        }
+
+        Loop& loop = static_cast<Loop&>(replayed);
+        loop.pose_graph_vertices = add_loop_to_pose_graph(loop, loop.inner_transformations);
+        for (uint i = 0; i < loop.inner_transformations.size(); ++i) {
+            loop.inner_transformations[i] = pose_graph.getPose(loop.pose_graph_vertices[i]);
+        }
+    }
+
+    /** \brief Proposes revisits of the edge frames by appearance, verifies them with keypoint
+      * registration and adds the verified ones to the pose graph as loop closing edges. With POSE_OVERLAP
+      * frames whose current graph poses overlap are proposed as well, and appearance candidates whose
+      * views can't overlap are dropped before keypoint matching.
+      */
+    void add_loop_closures()
+    {
+        Frames frames(1, loops.front().edge_frames.first);
+        std::vector<uint> frame_indexes(1, loops.front().edge_frames_indexes.first);
+        for (const auto& loop : loops) {
+            frames.push_back(loop.edge_frames.second);
+            frame_indexes.push_back(loop.edge_frames_indexes.second);
+        }
+
+        const bool use_orb = configs.value("LOOP_CLOSURE_SETTINGS/ORB").toBool();
+        std::vector<cv::Mat> descriptors;
+        for (const Frame& frame : frames) {
+            const PcdPtr unused_first = std::make_shared<Pcd>();
+            const PcdPtr unused_second = std::make_shared<Pcd>();
+            if (use_orb) {
+                OrbKeypointDetector detector(this, settings, frame, frame, unused_first, unused_second);
+                descriptors.push_back(detector.getFirstFrameFeatures().descriptors);
+            } else {
+                SurfKeypointDetector detector(this, settings, frame, frame, unused_first, unused_second);
+                descriptors.push_back(detector.getFirstFrameFeatures().descriptors);
+            }
+        }
+
+        auto vocabulary = std::make_shared<BowVocabulary>(
+            configs.value("LOOP_CLOSURE_SETTINGS/VOCABULARY_BRANCHING").toInt(),
+            configs.value("LOOP_CLOSURE_SETTINGS/VOCABULARY_DEPTH").toInt());
+        vocabulary->train(descriptors, configs.value("LOOP_CLOSURE_SETTINGS/VOCABULARY_MAX_DESCRIPTORS").toInt(),
+            configs.value("LOOP_CLOSURE_SETTINGS/VOCABULARY_ITERATIONS").toInt());
+        if (vocabulary->empty()) {
+            return;
+        }
+
+        const int min_gap = configs.value("LOOP_CLOSURE_SETTINGS/MIN_GAP").toInt();
+        const size_t max_candidates = configs.value("LOOP_CLOSURE_SETTINGS/MAX_CANDIDATES").toUInt();
+        const double min_score = configs.value("LOOP_CLOSURE_SETTINGS/MIN_SCORE").toDouble();
+        const int min_keypoints = configs.value("LOOP_CLOSURE_SETTINGS/MIN_KEYPOINTS").toInt();
+        const float max_fitness = configs.value("LOOP_CLOSURE_SETTINGS/MAX_FITNESS").toFloat();
+        const PoseGraph::Matrix6d information = PoseGraph::information(
+            configs.value("LOOP_CLOSURE_SETTINGS/TRANSLATION_WEIGHT").toDouble(),
+            configs.value("LOOP_CLOSURE_SETTINGS/ROTATION_WEIGHT").toDouble());
+
+        const bool use_poses = configs.value("LOOP_CLOSURE_SETTINGS/POSE_OVERLAP").toBool();
+        PoseIndex pose_index(configs.value("LOOP_CLOSURE_SETTINGS/POSE_MAX_DISTANCE").toFloat(),
+            configs.value("LOOP_CLOSURE_SETTINGS/POSE_MAX_ANGLE").toFloat());
+        Matrix4fVector poses;
+        for (const uint& frame_index : frame_indexes) {
+            poses.push_back(pose_graph.getPose(pose_graph_vertices.at(frame_index)));
+        }
+        if (use_poses) {
+            pose_index.build(poses);
+        }
+
+        //Frames are added as they are queried, so only earlier frames are proposed
+        LoopClosureIndex index(vocabulary);
+        size_t closures_count = 0;
+        size_t rejected_count = 0;
+        for (int i = 0; i < int(frames.size()); ++i) {
+            auto candidates = index.query(descriptors[i], i - min_gap, max_candidates, min_score);
+            index.add(i, descriptors[i]);
+
+            if (use_poses) {
+                const size_t appearance_count = candidates.size();
+                candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                     [&](const LoopClosureIndex::Candidates::value_type& candidate) {
+                                         return !pose_index.overlaps(poses[i], poses[candidate.first]);
+                                     }),
+                    candidates.end());
+                rejected_count += appearance_count - candidates.size();
+
+                for (const int& frame_id : pose_index.query(poses[i], i - min_gap, max_candidates)) {
+                    if (candidates.size() >= max_candidates) {
+                        break;
+                    }
+                    if (std::find_if(candidates.begin(), candidates.end(),
+                            [&](const LoopClosureIndex::Candidates::value_type& candidate) { return candidate.first == frame_id; })
+                        == candidates.end()) {
+                        candidates.push_back(std::make_pair(frame_id, 0.0));
+                    }
+                }
+            }
+
+            for (const auto& candidate : candidates) {
+                Frames pair_frames;
+                pair_frames.push_back(frames[candidate.first]);
+                pair_frames.push_back(frames[i]);
+                Frames transformed_pair_frames;
+
+                LinearRegistration<SaCRegistration> linear_sac(this, settings);
+                linear_sac.setInput(pair_frames, Eigen::Matrix4f::Identity());
+                const Matrix4fVector sac_t = linear_sac.align(transformed_pair_frames);
+                if (linear_sac.getKeypoints().empty()
+                    || int(linear_sac.getKeypoints().front().keypointsPcdPair.first->size()) < min_keypoints) {
+                    continue;
+                }
+
+                LinearRegistration<ICPRegistration> linear_icp(this, settings);
+                linear_icp.setInput(transformed_pair_frames, Eigen::Matrix4f::Identity());
+                linear_icp.setKeypoints(linear_sac.getTransformedKeypoints());
+                const Matrix4fVector icp_t = linear_icp.align(transformed_pair_frames);
+                if (linear_icp.getFitnessScores().front() > max_fitness) {
+                    continue;
+                }
+
+                const Eigen::Matrix4f measurement = icp_t[1] * sac_t[1];
+                if (measurement.hasNaN()) {
+                    continue;
+                }
+                pose_graph.addEdge(pose_graph_vertices.at(frame_indexes[candidate.first]),
+                    pose_graph_vertices.at(frame_indexes[i]), measurement, information);
+                ++closures_count;
+            }
+        }
+
+        LOG_INFO("registration") << "Loop closures:" << closures_count << "verified over" << frames.size() << "edge frames,"
+                                 << rejected_count << "candidates without overlap";
+    }
+
+    /** \brief Adds the loop's frames with odometry edges between neighbours and the registered edge pair as
+      * the closing edge, then solves the graph. The loop's poses are moved to where its first frame already
+      * is in the graph. Returns the vertices of the loop's frames.
+      */
+    std::vector<int> add_loop_to_pose_graph(const Loop& loop, const Matrix4fVector& loop_transformations)
+    {
+        const uint first_index = loop.edge_frames_indexes.first;
+        const uint last_index = loop.edge_frames_indexes.second;
+        if (loop_transformations.size() != (last_index - first_index) / read_step + 1) {
+            throw std::runtime_error("EdgeBasedRegistration::add_loop_to_pose_graph frames do not match the loop");
+        }
+
+        const PoseGraph::Matrix6d odometry_information = PoseGraph::information(
+            configs.value("POSE_GRAPH_SETTINGS/ODOMETRY_TRANSLATION_WEIGHT").toDouble(),
+            configs.value("POSE_GRAPH_SETTINGS/ODOMETRY_ROTATION_WEIGHT").toDouble());
+        const PoseGraph::Matrix6d edge_information = PoseGraph::information(
+            configs.value("POSE_GRAPH_SETTINGS/EDGE_TRANSLATION_WEIGHT").toDouble(),
+            configs.value("POSE_GRAPH_SETTINGS/EDGE_ROTATION_WEIGHT").toDouble());
+
+        if (pose_graph_vertices.count(first_index) == 0) {
+            pose_graph_vertices[first_index] = pose_graph.addVertex(
+                loop.edge_transformations.first, pose_graph.getVerticesCount() == 0);
+        }
+        const int first_vertex = pose_graph_vertices[first_index];
+        const Eigen::Matrix4f to_graph = pose_graph.getPose(first_vertex) * loop_transformations.front().inverse();
+
+        std::vector<int> vertices(1, first_vertex);
+        for (uint i = 1; i < loop_transformations.size(); ++i) {
+            const uint frame_index = first_index + i * read_step;
+            if (pose_graph_vertices.count(frame_index) == 0) {
+                pose_graph_vertices[frame_index] = pose_graph.addVertex(to_graph * loop_transformations[i]);
+            }
+            vertices.push_back(pose_graph_vertices[frame_index]);
+
+            pose_graph.addEdge(vertices[i - 1], vertices[i],
+                loop_transformations[i - 1].inverse() * loop_transformations[i], odometry_information);
+        }
+        pose_graph.addEdge(first_vertex, vertices.back(),
+            loop.edge_transformations.first.inverse() * loop.edge_transformations.second, edge_information);
+
+        const int iterations = pose_graph.optimize(configs.value("POSE_GRAPH_SETTINGS/MAX_ITERATIONS").toInt());
+        if (configs.value("POSE_GRAPH_SETTINGS/ENABLE_LOG").toBool()) {
+            LOG_INFO("registration") << "Pose graph:" << pose_graph.getVerticesCount() << "vertices," << pose_graph.getEdgesCount()
+                                     << "edges," << iterations << "iterations, chi2" << pose_graph.getChi2();
+        }
+
+        return vertices;
+    }
 };
 
 #endif //EDGE_BASED_REGISTRATION_HPP
@@ -24,6 +24,9 @@ private:
     Matrix4fVector result_t;
 
     void calculate_elch_correction();
+
+    /** \brief False when the edge correspondences are too few to fix the loop closure. */
+    bool estimate_loop_transform(Eigen::Matrix4f& loop_transform) const;
 };
 
 #endif //ELCH_CORRECTION_HPP
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef GICPFRAMEDATA_H
+#define GICPFRAMEDATA_H
+
+#include <pcl/registration/gicp.h>
+#include <pcl/search/kdtree.h>
+
+#include <memory>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Camera space search tree and plane covariances of a frame for pcl GICP.
+  * Both are pose independent, so one entry serves the frame as a source and as a target.
+  */
+struct GICPFrameData {
+    typedef pcl::GeneralizedIterativeClosestPoint<PointType, PointType> GICP;
+    typedef pcl::search::KdTree<PointType> KdTree;
+
+    /** \brief Every pixel_step-th valid pixel of the frame cloud. */
+    PcdPtr cloud;
+    KdTree::Ptr tree;
+    GICP::MatricesVectorPtr covariances;
+
+    int pixel_step;
+    int k_correspondences;
+    double epsilon;
+
+    /** \brief Same covariances as GICP computes itself, for k nearest neighbours and the given epsilon. */
+    static std::shared_ptr<const GICPFrameData> build(
+        const Pcd& frame_cloud, const int& pixel_step, const int& k_correspondences, const double& epsilon);
+
+    /** \brief Built once per frame cloud and kept in the frame's derived data. */
+    static std::shared_ptr<const GICPFrameData> ofFrame(
+        const Frame& frame, const int& pixel_step, const int& k_correspondences, const double& epsilon);
+
+    /** \brief Hands the cached tree and covariances to gicp, setInputSource and setInputTarget reset them. */
+    static void setup(GICP& gicp, const GICPFrameData& source, const GICPFrameData& target);
+};
+
+#endif // GICPFRAMEDATA_H
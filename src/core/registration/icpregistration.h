@@ -3,7 +3,10 @@
 
 #include <QObject>
 
+#include <memory>
+
 #include "core/base/scannertypes.h"
+#include "core/registration/convergencereport.h"
 
 class ICPRegistration : public ScannerBase {
     Q_OBJECT
@@ -17,19 +20,54 @@ public:
         const KeypointsFrame& keypoints_frame_,
         const Eigen::Matrix4f& initial_transformation_);
 
+    /** \brief With ICP_SETTINGS/GICP the frames themselves are aligned by GICP over their cached
+      * search trees and covariances instead of the keypoints. target_frame_ is the first frame of the pair.
+      */
+    void setFrames(const Frame& target_frame_, const Frame& source_frame_);
+
+    /** \brief Predicted align() result, used as the starting guess instead of the initial transformation. */
+    void setPrediction(const Eigen::Matrix4f& predicted_transformation_);
+
+    /** \brief The prediction only applies to this call, so one registrator may align many pairs. */
     Eigen::Matrix4f align();
 
+    /** \brief configs.ini section of the parameters align() depends on. */
+    static QString settingsSection();
+
     Eigen::Matrix4f getTransformation() const;
 
     float getFitnessScore() const;
 
+    ConvergenceReport getConvergenceReport() const;
+
 private:
     KeypointsFrame keypoints_frame;
+    Frame target_frame;
+    Frame source_frame;
+    bool has_frames;
     Eigen::Matrix4f initial_transformation;
+    Eigen::Matrix4f predicted_transformation;
+    bool has_prediction;
     Eigen::Matrix4f result_t;
     float fitness_score;
+    ConvergenceReport report;
+
+    //pcl registrations made on the first align and reused by the next pairs of a batch
+    struct Solvers;
+    std::shared_ptr<Solvers> solvers;
 
     void calculate();
+
+    void calculate_frames_gicp();
+
+    /** \brief Weighted closed form fit over the known correspondences with Cauchy reweighting.
+      * Returns false when the reweighted residuals still point to bad correspondences.
+      */
+    bool calculate_closed_form();
+
+    /** \brief Fitness of the keypoint GICP path, by ICP_SETTINGS/FULL_FITNESS the full pcl evaluation. */
+    template <typename PclRegistration>
+    float keypoint_fitness(PclRegistration& registration);
 };
 
 #endif // ICPREGISTRATION_H
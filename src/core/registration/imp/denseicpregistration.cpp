@@ -0,0 +1,283 @@
+#include "core/registration/denseicpregistration.h"
+
+#include <Eigen/Cholesky>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <cmath>
+
+#include "utility/log.h"
+#include "utility/threadpool.h"
+
+namespace {
+
+const size_t ROW_BANDS_COUNT = 32;
+
+/** \brief Upper part of one band's normal equations, reduced in double precision. */
+struct NormalEquations {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Eigen::Matrix<double, 6, 6> ata;
+    Eigen::Matrix<double, 6, 1> atb;
+    double squared_error;
+    size_t count;
+
+    NormalEquations()
+        : ata(Eigen::Matrix<double, 6, 6>::Zero())
+        , atb(Eigen::Matrix<double, 6, 1>::Zero())
+        , squared_error(0)
+        , count(0)
+    {
+    }
+
+    NormalEquations& operator+=(const NormalEquations& other)
+    {
+        ata += other.ata;
+        atb += other.atb;
+        squared_error += other.squared_error;
+        count += other.count;
+        return *this;
+    }
+};
+
+} // namespace
+
+DenseICPRegistration::DenseICPRegistration(QObject* parent, QSettings* parent_settings)
+    : ScannerBase(parent, parent_settings)
+    , pixel_step(std::max(1, configs.value("DENSE_ICP_SETTINGS/PIXEL_STEP").toInt()))
+    , max_correspondence_distance(configs.value("DENSE_ICP_SETTINGS/MAX_CORRESPONDENCE_DISTANCE").toFloat())
+    , transformation_epsilon(configs.value("DENSE_ICP_SETTINGS/TRANSFORMATION_EPSILON").toDouble())
+    , min_correspondences(configs.value("DENSE_ICP_SETTINGS/MIN_CORRESPONDENCES").toInt())
+    , time_budget(configs.value("DENSE_ICP_SETTINGS/TIME_BUDGET_MS").toDouble())
+    , initial_transformation(Eigen::Matrix4f::Identity())
+    , model_pose(Eigen::Matrix4f::Identity())
+    , has_model(false)
+    , predicted_transformation(Eigen::Matrix4f::Identity())
+    , has_prediction(false)
+    , result_t(Eigen::Matrix4f::Identity())
+    , fitness_score(0)
+    , result_aligned(false)
+{
+    for (const auto& iterations : configs.value("DENSE_ICP_SETTINGS/PYRAMID_ITERATIONS").toStringList()) {
+        level_iterations.push_back(iterations.trimmed().toInt());
+    }
+}
+
+void DenseICPRegistration::setInput(
+    const KeypointsFrame&,
+    const Eigen::Matrix4f& initial_transformation_)
+{
+    initial_transformation = initial_transformation_;
+}
+
+void DenseICPRegistration::setFrames(const Frame& target_frame_, const Frame& source_frame_)
+{
+    target_frame = target_frame_;
+    source_frame = source_frame_;
+}
+
+void DenseICPRegistration::setModel(DensePyramid::Level model_, const Eigen::Matrix4f& model_pose_)
+{
+    model = std::move(model_);
+    model_pose = model_pose_;
+    has_model = true;
+}
+
+void DenseICPRegistration::setPrediction(const Eigen::Matrix4f& predicted_transformation_)
+{
+    predicted_transformation = predicted_transformation_;
+    has_prediction = true;
+}
+
+Eigen::Matrix4f DenseICPRegistration::align()
+{
+    const BudgetTimer timer;
+    result_t = initial_transformation;
+    report = ConvergenceReport();
+    result_aligned = false;
+    calculate();
+    report.milliseconds = timer.milliseconds();
+
+    if (configs.value("DENSE_ICP_SETTINGS/ENABLE_LOG").toBool()) {
+        LOG_DEBUG("registration") << "Dense ICP:" << report.toString();
+    }
+
+    return result_t;
+}
+
+Eigen::Matrix4f DenseICPRegistration::getTransformation() const
+{
+    return result_t;
+}
+
+float DenseICPRegistration::getFitnessScore() const
+{
+    return fitness_score;
+}
+
+ConvergenceReport DenseICPRegistration::getConvergenceReport() const
+{
+    return report;
+}
+
+bool DenseICPRegistration::isAligned() const
+{
+    return result_aligned;
+}
+
+//----------------------------------------------------
+
+/** \brief Solves for the camera to camera transform, the world correction is
+  * target_pose * camera_transform * source_pose^-1 and result_t = initial * correction.
+  */
+void DenseICPRegistration::calculate()
+{
+    const int levels_count = int(level_iterations.size());
+    if (levels_count == 0) {
+        LOG_WARNING("registration") << "Dense ICP: no pyramid iterations configured.";
+        return;
+    }
+
+    const auto target = has_model ? DensePyramid::fromLevel(model, levels_count)
+                                  : DensePyramid::ofFrame(target_frame, levels_count);
+    const auto source = DensePyramid::ofFrame(source_frame, levels_count);
+    if (!target || !source) {
+        LOG_WARNING("registration") << "Dense ICP: clouds are not organized.";
+        return;
+    }
+
+    const Eigen::Matrix4f target_pose(has_model ? model_pose : Eigen::Matrix4f(target_frame.pose));
+    const Eigen::Matrix4f source_pose(source_frame.pose);
+    Eigen::Matrix4f camera_t = has_prediction
+        ? Eigen::Matrix4f(target_pose.inverse() * initial_transformation.inverse() * predicted_transformation * source_pose)
+        : Eigen::Matrix4f(target_pose.inverse() * source_pose);
+
+    //Coarsest level first, a level that fails leaves the estimate to the finer ones.
+    //Once the time budget runs out the remaining levels get a single iteration each.
+    const BudgetTimer timer;
+    const int coarsest = std::min({ levels_count, int(target->size()), int(source->size()) }) - 1;
+    bool finest_aligned = false;
+    report.reason = ConvergenceReport::IterationLimit;
+    for (int level = coarsest; level >= 0; --level) {
+        const int iterations = level_iterations[levels_count - 1 - level];
+        Eigen::Matrix4f level_t = camera_t;
+        float level_fitness_score = 0;
+
+        bool aligned = true;
+        for (int iteration = 0; iteration < iterations && aligned; ++iteration) {
+            const Eigen::Matrix4f previous_t = level_t;
+            aligned = align_level(target->level(level), source->level(level), level, level_t, level_fitness_score);
+            ++report.iterations;
+            if (aligned && (level_t - previous_t).squaredNorm() < transformation_epsilon) {
+                report.reason = ConvergenceReport::PoseIncrement;
+                break;
+            }
+            if (timer.expired(time_budget)) {
+                report.reason = ConvergenceReport::TimeBudget;
+                break;
+            }
+        }
+        if (!aligned) {
+            report.reason = ConvergenceReport::NoCorrespondences;
+        }
+
+        if (aligned) {
+            camera_t = level_t;
+            fitness_score = level_fitness_score;
+        }
+        finest_aligned = aligned && level == 0;
+    }
+
+    result_aligned = finest_aligned;
+    if (finest_aligned) {
+        result_t = initial_transformation * target_pose * camera_t * source_pose.inverse();
+    }
+}
+
+/** \brief One Gauss-Newton step at a pyramid level. Coarser levels allow proportionally longer
+  * correspondences and need proportionally fewer of them, the pixel step is for the full resolution only.
+  */
+bool DenseICPRegistration::align_level(
+    const DensePyramid::Level& target,
+    const DensePyramid::Level& source,
+    const int& level_index,
+    Eigen::Matrix4f& camera_t,
+    float& level_fitness_score) const
+{
+    const float level_distance = max_correspondence_distance * float(1 << level_index);
+    const float squared_max_distance = level_distance * level_distance;
+    const size_t level_min_correspondences = std::max(size_t(6), size_t(min_correspondences) >> (2 * level_index));
+    const size_t step = level_index == 0 ? size_t(pixel_step) : 1;
+    const size_t rows_per_band = (source.height + ROW_BANDS_COUNT - 1) / ROW_BANDS_COUNT;
+
+    const Eigen::Matrix3f rotation = camera_t.topLeftCorner<3, 3>();
+    const Eigen::Vector3f translation = camera_t.topRightCorner<3, 1>();
+
+    std::vector<NormalEquations, Eigen::aligned_allocator<NormalEquations> > bands(ROW_BANDS_COUNT);
+    ThreadPool::instance().parallel_for(0, ROW_BANDS_COUNT, [&](size_t band) {
+        NormalEquations& equations = bands[band];
+        const size_t row_end = std::min(size_t(source.height), (band + 1) * rows_per_band);
+        for (size_t v = band * rows_per_band; v < row_end; v += step) {
+            for (size_t u = 0; u < source.width; u += step) {
+                const size_t source_index = v * source.width + u;
+                if (!source.hasPoint(source_index)) {
+                    continue;
+                }
+
+                const Eigen::Vector3f moved = rotation * source.points[source_index] + translation;
+                float target_u, target_v;
+                if (!target.intrinsics.project(moved, target_u, target_v)) {
+                    continue;
+                }
+
+                const size_t target_index = size_t(target_v) * target.width + size_t(target_u);
+                if (!target.hasNormal(target_index)) {
+                    continue;
+                }
+
+                const Eigen::Vector3f& normal = target.normals[target_index];
+                const Eigen::Vector3f difference = moved - target.points[target_index];
+                if (difference.squaredNorm() > squared_max_distance) {
+                    continue;
+                }
+
+                Eigen::Matrix<double, 6, 1> jacobian;
+                jacobian.head<3>() = moved.cross(normal).cast<double>();
+                jacobian.tail<3>() = normal.cast<double>();
+                const double residual = double(normal.dot(difference));
+
+                equations.ata.noalias() += jacobian * jacobian.transpose();
+                equations.atb.noalias() -= jacobian * residual;
+                equations.squared_error += residual * residual;
+                ++equations.count;
+            }
+        }
+    });
+
+    NormalEquations total;
+    for (const auto& band : bands) {
+        total += band;
+    }
+
+    if (total.count < level_min_correspondences) {
+        LOG_DEBUG("registration") << "Dense ICP: too few correspondences" << total.count << "at level" << level_index;
+        return false;
+    }
+
+    const Eigen::Matrix<double, 6, 1> update = total.ata.ldlt().solve(total.atb);
+    if (!update.allFinite()) {
+        LOG_DEBUG("registration") << "Dense ICP: degenerate normal equations at level" << level_index;
+        return false;
+    }
+
+    Eigen::Matrix4f increment = Eigen::Matrix4f::Identity();
+    const Eigen::Vector3d angular = update.head<3>();
+    if (angular.norm() > 0) {
+        increment.topLeftCorner<3, 3>() = Eigen::AngleAxisd(angular.norm(), angular.normalized()).toRotationMatrix().cast<float>();
+    }
+    increment.topRightCorner<3, 1>() = update.tail<3>().cast<float>();
+    camera_t = increment * camera_t;
+    level_fitness_score = float(total.squared_error / double(total.count));
+
+    return true;
+}
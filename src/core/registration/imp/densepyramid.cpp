@@ -0,0 +1,189 @@
+#include "core/registration/densepyramid.h"
+
+#include <Eigen/Geometry>
+
+#include <cmath>
+#include <limits>
+
+#include "core/base/framenormals.h"
+#include "utility/threadpool.h"
+
+namespace {
+
+/** \brief Points of a 2x2 block farther than this fraction of the first valid depth are not averaged. */
+const float DEPTH_CONSISTENCY_RATIO = 0.03f;
+
+inline Eigen::Vector3f invalid_vector()
+{
+    return Eigen::Vector3f::Constant(std::numeric_limits<float>::quiet_NaN());
+}
+
+} // namespace
+
+std::shared_ptr<const DensePyramid> DensePyramid::build(const Pcd& cloud, const int& levels_count,
+    const NormalPcd* normals)
+{
+    if (!cloud.isOrganized() || levels_count < 1) {
+        return nullptr;
+    }
+
+    auto pyramid = std::make_shared<DensePyramid>();
+    pyramid->levels.resize(1);
+
+    Level& base = pyramid->levels.front();
+    base.width = cloud.width;
+    base.height = cloud.height;
+    base.intrinsics = CameraIntrinsics::fromOrganizedCloud(cloud);
+    if (!base.intrinsics.isValid()) {
+        return nullptr;
+    }
+
+    base.points.resize(cloud.size());
+    for (size_t i = 0; i < cloud.size(); ++i) {
+        const PointType& point = cloud[i];
+        base.points[i] = std::isfinite(point.z) && point.z > 0.0f ? point.getVector3fMap() : invalid_vector();
+    }
+    if (normals && FrameNormals::matches(*normals, cloud)) {
+        base.normals.resize(cloud.size());
+        for (size_t i = 0; i < cloud.size(); ++i) {
+            const NormalType& normal = (*normals)[i];
+            base.normals[i] = base.hasPoint(i) && std::isfinite(normal.normal_x)
+                ? Eigen::Vector3f(normal.normal_x, normal.normal_y, normal.normal_z)
+                : invalid_vector();
+        }
+    } else {
+        calculate_normals(base);
+    }
+    pyramid->build_levels(levels_count);
+
+    return pyramid;
+}
+
+std::shared_ptr<const DensePyramid> DensePyramid::ofFrame(const Frame& frame, const int& levels_count)
+{
+    if (!frame.derivedDataPtr || !frame.pointCloudPtr) {
+        return build(frame.pointCloudPtr ? *frame.pointCloudPtr : Pcd(), levels_count);
+    }
+
+    FrameDerivedData& data = *frame.derivedDataPtr;
+    std::lock_guard<std::mutex> lock(data.mutex);
+
+    const std::shared_ptr<const Pcd> cloud = frame.pointCloudPtr;
+    if (!FrameDerivedData::isBuiltFrom(data.densePyramidSource, cloud) || !data.densePyramid
+        || data.densePyramid->size() < size_t(levels_count)) {
+        data.densePyramid = build(*cloud, levels_count, frame.pointCloudNormalPcdPtr.get());
+        data.densePyramidSource = cloud;
+    }
+
+    return data.densePyramid;
+}
+
+std::shared_ptr<const DensePyramid> DensePyramid::fromLevel(Level base, const int& levels_count)
+{
+    if (!base.intrinsics.isValid() || levels_count < 1 || base.points.size() != size_t(base.width) * base.height
+        || base.normals.size() != base.points.size()) {
+        return nullptr;
+    }
+
+    auto pyramid = std::make_shared<DensePyramid>();
+    pyramid->levels.push_back(std::move(base));
+    pyramid->build_levels(levels_count);
+
+    return pyramid;
+}
+
+//----------------------------------------------------
+
+void DensePyramid::build_levels(const int& levels_count)
+{
+    while (int(levels.size()) < levels_count) {
+        const Level& fine = levels.back();
+        if (fine.width < 2 || fine.height < 2) {
+            break;
+        }
+
+        Level coarse;
+        downsample(fine, coarse);
+        calculate_normals(coarse);
+        levels.push_back(std::move(coarse));
+    }
+}
+
+/** \brief Pixel u of the coarse level covers fine pixels 2u and 2u + 1, centred at 2u + 0.5. */
+void DensePyramid::downsample(const Level& fine, Level& coarse)
+{
+    coarse.width = fine.width / 2;
+    coarse.height = fine.height / 2;
+    coarse.intrinsics = fine.intrinsics;
+    coarse.intrinsics.width = coarse.width;
+    coarse.intrinsics.height = coarse.height;
+    coarse.intrinsics.fx = fine.intrinsics.fx / 2.0f;
+    coarse.intrinsics.fy = fine.intrinsics.fy / 2.0f;
+    coarse.intrinsics.cx = (fine.intrinsics.cx - 0.5f) / 2.0f;
+    coarse.intrinsics.cy = (fine.intrinsics.cy - 0.5f) / 2.0f;
+    coarse.points.assign(size_t(coarse.width) * coarse.height, invalid_vector());
+
+    ThreadPool::instance().parallel_for(0, coarse.height, [&](size_t v) {
+        for (size_t u = 0; u < coarse.width; ++u) {
+            Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+            float reference_z = 0.0f;
+            int count = 0;
+
+            for (size_t dv = 0; dv < 2; ++dv) {
+                for (size_t du = 0; du < 2; ++du) {
+                    const Eigen::Vector3f& point = fine.points[(2 * v + dv) * fine.width + 2 * u + du];
+                    if (!std::isfinite(point.z())) {
+                        continue;
+                    }
+                    if (count == 0) {
+                        reference_z = point.z();
+                    } else if (std::abs(point.z() - reference_z) > DEPTH_CONSISTENCY_RATIO * reference_z) {
+                        continue;
+                    }
+
+                    sum += point;
+                    ++count;
+                }
+            }
+
+            if (count > 0) {
+                coarse.points[v * coarse.width + u] = sum / float(count);
+            }
+        }
+    });
+}
+
+/** \brief Normals from the cross product of the neighbour differences, facing the camera. */
+void DensePyramid::calculate_normals(Level& level)
+{
+    level.normals.assign(level.points.size(), invalid_vector());
+    if (level.width < 3 || level.height < 3) {
+        return;
+    }
+
+    ThreadPool::instance().parallel_for(1, level.height - 1, [&](size_t v) {
+        for (size_t u = 1; u + 1 < level.width; ++u) {
+            const size_t index = v * level.width + u;
+            const Eigen::Vector3f& left = level.points[index - 1];
+            const Eigen::Vector3f& right = level.points[index + 1];
+            const Eigen::Vector3f& up = level.points[index - level.width];
+            const Eigen::Vector3f& down = level.points[index + level.width];
+            if (!level.hasPoint(index) || !std::isfinite(left.z()) || !std::isfinite(right.z())
+                || !std::isfinite(up.z()) || !std::isfinite(down.z())) {
+                continue;
+            }
+
+            Eigen::Vector3f normal = (right - left).cross(down - up);
+            const float length = normal.norm();
+            if (length <= 0.0f) {
+                continue;
+            }
+            normal /= length;
+
+            if (normal.dot(level.points[index]) > 0.0f) {
+                normal = -normal;
+            }
+            level.normals[index] = normal;
+        }
+    });
+}
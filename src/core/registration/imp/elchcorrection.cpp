@@ -1,7 +1,10 @@
 #include "core/registration/elchcorrection.h"
 
-#include <QDebug>
 #include <pcl/registration/elch.h>
+#include <pcl/registration/transformation_estimation_svd.h>
+
+#include "utility/log.h"
+#include "utility/profiler.h"
 
 ElchCorrection::ElchCorrection(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
@@ -29,18 +32,25 @@ Matrix4fVector ElchCorrection::getTransformations()
 
 void ElchCorrection::calculate_elch_correction()
 {
-    qDebug() << "Calculating ELCH";
+    PROFILE_ZONE("elch");
+    LOG_INFO("registration") << "Calculating ELCH";
 
     pcl::registration::ELCH<pcl::PointXYZRGB> elch;
     for (int i = 0; i < merged_keypoints.size(); i++) {
         elch.addPointCloud(merged_keypoints[i]);
     }
 
-    pcl::registration::ELCH<pcl::PointXYZRGB>::RegistrationPtr reg = elch.getReg();
-    reg->setMaxCorrespondenceDistance(configs.value("SAC_SETTINGS/INLIER_THRESHOLD").toDouble());
-    reg->setMaximumIterations(configs.value("SAC_SETTINGS/MAX_ITERATIONS").toInt());
-    reg->setEuclideanFitnessEpsilon(configs.value("ICP_SETTINGS/EUCLIDEAN_EPSILON").toDouble());
-    reg->setTransformationEpsilon(configs.value("ICP_SETTINGS/TRANSFORMATION_EPSILON").toDouble());
+    Eigen::Matrix4f loop_transform;
+    if (configs.value("ELCH_SETTINGS/KNOWN_LOOP_TRANSFORM").toBool() && estimate_loop_transform(loop_transform)) {
+        //ELCH only distributes the error, it runs no registration of its own
+        elch.setLoopTransform(loop_transform);
+    } else {
+        pcl::registration::ELCH<pcl::PointXYZRGB>::RegistrationPtr reg = elch.getReg();
+        reg->setMaxCorrespondenceDistance(configs.value("SAC_SETTINGS/INLIER_THRESHOLD").toDouble());
+        reg->setMaximumIterations(configs.value("SAC_SETTINGS/MAX_ITERATIONS").toInt());
+        reg->setEuclideanFitnessEpsilon(configs.value("ICP_SETTINGS/EUCLIDEAN_EPSILON").toDouble());
+        reg->setTransformationEpsilon(configs.value("ICP_SETTINGS/TRANSFORMATION_EPSILON").toDouble());
+    }
 
     elch.setLoopStart(0);
     elch.setLoopEnd(merged_keypoints.size() - 1);
@@ -52,5 +62,36 @@ void ElchCorrection::calculate_elch_correction()
         result_t.push_back((*loopGraphPtr)[i].transform.matrix());
     }
 
-    qDebug() << "Done!";
+    LOG_INFO("registration") << "Done!";
+}
+
+/** \brief The last merged cloud ends with the edge keypoints and its correspondences match them into the
+  * first one, as the edge registration found them. The closed form fit on those is the alignment ELCH
+  * would otherwise search for with ICP between the loop end and start clouds.
+  */
+bool ElchCorrection::estimate_loop_transform(Eigen::Matrix4f& loop_transform) const
+{
+    if (merged_keypoints.size() < 2 || merged_correspondences.size() != merged_keypoints.size()) {
+        return false;
+    }
+
+    const Pcd& loop_end = *merged_keypoints.back();
+    const Pcd& loop_start = *merged_keypoints.front();
+    pcl::Correspondences correspondences;
+    correspondences.reserve(merged_correspondences.back().size());
+    for (const pcl::Correspondence& correspondence : merged_correspondences.back()) {
+        if (correspondence.index_query >= 0 && size_t(correspondence.index_query) < loop_end.size()
+            && correspondence.index_match >= 0 && size_t(correspondence.index_match) < loop_start.size()) {
+            correspondences.push_back(correspondence);
+        }
+    }
+    if (correspondences.size() < std::max<size_t>(3, configs.value("ELCH_SETTINGS/MIN_CORRESPONDENCES").toUInt())) {
+        LOG_WARNING("registration") << "ELCH loop transform from" << correspondences.size() << "correspondences only, registering";
+        return false;
+    }
+
+    pcl::registration::TransformationEstimationSVD<pcl::PointXYZRGB, pcl::PointXYZRGB> estimation;
+    estimation.estimateRigidTransformation(loop_end, loop_start, correspondences, loop_transform);
+
+    return loop_transform.allFinite();
 }
@@ -0,0 +1,97 @@
+#include "core/registration/gicpframedata.h"
+
+#include <Eigen/SVD>
+
+#include <algorithm>
+#include <cmath>
+
+#include "utility/threadpool.h"
+
+std::shared_ptr<const GICPFrameData> GICPFrameData::build(
+    const Pcd& frame_cloud, const int& pixel_step, const int& k_correspondences, const double& epsilon)
+{
+    auto data = std::make_shared<GICPFrameData>();
+    data->pixel_step = pixel_step;
+    data->k_correspondences = k_correspondences;
+    data->epsilon = epsilon;
+
+    data->cloud = std::make_shared<Pcd>();
+    const size_t step = size_t(std::max(1, pixel_step));
+    const size_t width = frame_cloud.isOrganized() ? frame_cloud.width : frame_cloud.size();
+    const size_t height = frame_cloud.isOrganized() ? frame_cloud.height : 1;
+    for (size_t v = 0; v < height; v += step) {
+        for (size_t u = 0; u < width; u += step) {
+            const PointType& point = frame_cloud[v * width + u];
+            if (std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z)) {
+                data->cloud->push_back(point);
+            }
+        }
+    }
+
+    data->tree = std::make_shared<KdTree>();
+    data->covariances = std::make_shared<GICP::MatricesVector>(data->cloud->size());
+    if (int(data->cloud->size()) < k_correspondences) {
+        return data;
+    }
+    data->tree->setInputCloud(data->cloud);
+
+    const Pcd& cloud = *data->cloud;
+    GICP::MatricesVector& covariances = *data->covariances;
+    ThreadPool::instance().parallel_for(0, cloud.size(), [&](size_t i) {
+        std::vector<int> indices(k_correspondences);
+        std::vector<float> squared_distances(k_correspondences);
+        data->tree->nearestKSearch(cloud[i], k_correspondences, indices, squared_distances);
+
+        Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+        Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+        for (const int& index : indices) {
+            const Eigen::Vector3d point = cloud[index].getVector3fMap().cast<double>();
+            mean += point;
+            covariance += point * point.transpose();
+        }
+        mean /= double(indices.size());
+        covariance = covariance / double(indices.size()) - mean * mean.transpose();
+
+        //Plane-to-plane model, the normal direction gets the epsilon variance
+        const Eigen::JacobiSVD<Eigen::Matrix3d> svd(covariance, Eigen::ComputeFullU);
+        const Eigen::Matrix3d& u = svd.matrixU();
+        covariances[i] = u * Eigen::Vector3d(1.0, 1.0, epsilon).asDiagonal() * u.transpose();
+    });
+
+    return data;
+}
+
+std::shared_ptr<const GICPFrameData> GICPFrameData::ofFrame(
+    const Frame& frame, const int& pixel_step, const int& k_correspondences, const double& epsilon)
+{
+    if (!frame.pointCloudPtr) {
+        throw std::invalid_argument("GICPFrameData::ofFrame !frame.pointCloudPtr");
+    }
+    if (!frame.derivedDataPtr) {
+        return build(*frame.pointCloudPtr, pixel_step, k_correspondences, epsilon);
+    }
+
+    FrameDerivedData& data = *frame.derivedDataPtr;
+    std::lock_guard<std::mutex> lock(data.mutex);
+
+    const std::shared_ptr<const Pcd> cloud = frame.pointCloudPtr;
+    if (!FrameDerivedData::isBuiltFrom(data.gicpSource, cloud) || !data.gicp
+        || data.gicp->pixel_step != pixel_step || data.gicp->k_correspondences != k_correspondences
+        || data.gicp->epsilon != epsilon) {
+        data.gicp = build(*cloud, pixel_step, k_correspondences, epsilon);
+        data.gicpSource = cloud;
+    }
+
+    return data.gicp;
+}
+
+void GICPFrameData::setup(GICP& gicp, const GICPFrameData& source, const GICPFrameData& target)
+{
+    gicp.setCorrespondenceRandomness(source.k_correspondences);
+    gicp.setInputSource(source.cloud);
+    gicp.setInputTarget(target.cloud);
+    gicp.setSearchMethodSource(source.tree, true);
+    gicp.setSearchMethodTarget(target.tree, true);
+    gicp.setSourceCovariances(source.covariances);
+    gicp.setTargetCovariances(target.covariances);
+}
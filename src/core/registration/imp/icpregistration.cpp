@@ -1,13 +1,156 @@
 #include "core/registration/icpregistration.h"
 
 #include <QDebug>
-#include <pcl/common/transforms.h>
 #include <pcl/registration/gicp.h>
 #include <pcl/registration/icp_nl.h>
 
+#include <algorithm>
+#include <cmath>
+
+#include "core/keypoints/rigidfit.h"
+#include "core/registration/gicpframedata.h"
+#include "utility/log.h"
+#include "utility/pointtransform.h"
+#include "utility/profiler.h"
+
+namespace {
+
+/** \brief Cauchy constant for 95% efficiency on gaussian residuals. */
+const double CAUCHY_CONSTANT = 2.3849;
+
+/** \brief Scales the MAD to the standard deviation of gaussian residuals. */
+const double MAD_TO_SIGMA = 1.4826;
+
+/** \brief Exposes the iterations pcl ran in the last align call. */
+template <typename PclRegistration>
+class IterationCounting : public PclRegistration {
+public:
+    inline int getIterations() const
+    {
+        return this->nr_iterations_;
+    }
+
+    /** \brief Correspondences of the last iteration with squared distances, empty for GICP. */
+    inline const pcl::Correspondences& getCorrespondences() const
+    {
+        return *this->correspondences_;
+    }
+};
+
+/** \brief Mean of the squared residuals, as pcl's fitness score, with the count and RMS of the residuals
+  * under inlier_distance in the report.
+  */
+template <typename SquaredResidual>
+float summarize_residuals(const size_t& count, const SquaredResidual& squared_residual,
+    const double& inlier_distance, ConvergenceReport& report)
+{
+    const double squared_inlier_distance = inlier_distance * inlier_distance;
+    double squared_sum = 0, inlier_squared_sum = 0;
+    report.inliers = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const double squared = double(squared_residual(i));
+        squared_sum += squared;
+        if (squared <= squared_inlier_distance) {
+            inlier_squared_sum += squared;
+            ++report.inliers;
+        }
+    }
+    report.inlier_rms = report.inliers > 0 ? std::sqrt(inlier_squared_sum / report.inliers) : 0;
+
+    return count > 0 ? float(squared_sum / count) : 0;
+}
+
+/** \brief Runs pcl in blocks of iterations from the guess, so that the time budget is checked between
+  * blocks. Nonlinear ICP exits through its convergence criteria, GICP has its own increment test
+  * and stops short of the block when the increment falls under the thresholds.
+  */
+template <typename PclRegistration>
+bool adaptive_align(
+    IterationCounting<PclRegistration>& registration,
+    const bool& is_gicp,
+    const ScannerConfig::IcpSettings& adaptive,
+    const Eigen::Matrix4f& guess,
+    ConvergenceReport& report)
+{
+    if (is_gicp) {
+        registration.setTransformationEpsilon(adaptive.translation_threshold);
+        registration.setRotationEpsilon(adaptive.rotation_threshold);
+    } else {
+        registration.setTransformationEpsilon(adaptive.translation_threshold * adaptive.translation_threshold);
+        registration.setTransformationRotationEpsilon(std::cos(adaptive.rotation_threshold));
+    }
+    registration.setEuclideanFitnessEpsilon(adaptive.relative_fitness_epsilon);
+
+    const BudgetTimer timer;
+    const int block = std::max(1, adaptive.iteration_block);
+    Eigen::Matrix4f current = guess;
+    Pcd transformed_cloud;
+
+    report = ConvergenceReport();
+    for (;;) {
+        const int block_iterations = std::min(block, adaptive.max_iterations - report.iterations);
+        registration.setMaximumIterations(block_iterations);
+        registration.align(transformed_cloud, current);
+        report.iterations += registration.getIterations();
+
+        if (!registration.hasConverged()) {
+            report.reason = ConvergenceReport::Failed;
+            break;
+        }
+        current = registration.getFinalTransformation();
+
+        if (is_gicp) {
+            if (registration.getIterations() < block_iterations) {
+                report.reason = ConvergenceReport::PoseIncrement;
+                break;
+            }
+        } else {
+            typedef pcl::registration::DefaultConvergenceCriteria<float> Criteria;
+            const auto state = registration.getConvergeCriteria()->getConvergenceState();
+            if (state == Criteria::CONVERGENCE_CRITERIA_TRANSFORM) {
+                report.reason = ConvergenceReport::PoseIncrement;
+                break;
+            }
+            if (state == Criteria::CONVERGENCE_CRITERIA_REL_MSE || state == Criteria::CONVERGENCE_CRITERIA_ABS_MSE) {
+                report.reason = ConvergenceReport::FitnessPlateau;
+                break;
+            }
+            if (state == Criteria::CONVERGENCE_CRITERIA_NO_CORRESPONDENCES) {
+                report.reason = ConvergenceReport::NoCorrespondences;
+                break;
+            }
+        }
+
+        if (report.iterations >= adaptive.max_iterations) {
+            report.reason = ConvergenceReport::IterationLimit;
+            break;
+        }
+        if (timer.expired(adaptive.time_budget)) {
+            report.reason = ConvergenceReport::TimeBudget;
+            break;
+        }
+    }
+    report.milliseconds = timer.milliseconds();
+
+    return report.reason != ConvergenceReport::Failed && report.reason != ConvergenceReport::NoCorrespondences;
+}
+
+} // namespace
+
+struct ICPRegistration::Solvers {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    IterationCounting<pcl::GeneralizedIterativeClosestPoint<PointType, PointType> > gicp;
+    IterationCounting<pcl::IterativeClosestPointNonLinear<PointType, PointType> > icp;
+    IterationCounting<GICPFrameData::GICP> frames_gicp;
+};
+
 ICPRegistration::ICPRegistration(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
+    , has_frames(false)
     , initial_transformation(Eigen::Matrix4f::Identity())
+    , predicted_transformation(Eigen::Matrix4f::Identity())
+    , has_prediction(false)
     , result_t(Eigen::Matrix4f::Identity())
     , fitness_score(0)
 {
@@ -18,16 +161,52 @@ void ICPRegistration::setInput(
     const Eigen::Matrix4f& initial_transformation_)
 {
     keypoints_frame = keypoints_frame_;
+    keypoints_frame.detach();
     initial_transformation = initial_transformation_;
 }
 
+void ICPRegistration::setFrames(const Frame& target_frame_, const Frame& source_frame_)
+{
+    target_frame = target_frame_;
+    source_frame = source_frame_;
+    has_frames = true;
+}
+
+void ICPRegistration::setPrediction(const Eigen::Matrix4f& predicted_transformation_)
+{
+    predicted_transformation = predicted_transformation_;
+    has_prediction = true;
+}
+
 Eigen::Matrix4f ICPRegistration::align()
 {
+    PROFILE_ZONE("icp");
+    const BudgetTimer timer;
     result_t = initial_transformation;
-    calculate();
+    report = ConvergenceReport();
+    if (!solvers) {
+        solvers.reset(new Solvers());
+    }
+    if (has_frames && configs.icp().gicp) {
+        calculate_frames_gicp();
+    } else {
+        calculate();
+    }
+    report.milliseconds = timer.milliseconds();
+    has_prediction = false;
+
+    if (configs.icp().enable_log) {
+        qDebug() << "ICP:" << report.toString();
+    }
+
     return result_t;
 }
 
+QString ICPRegistration::settingsSection()
+{
+    return "ICP_SETTINGS";
+}
+
 Eigen::Matrix4f ICPRegistration::getTransformation() const
 {
     return result_t;
@@ -38,57 +217,183 @@ float ICPRegistration::getFitnessScore() const
     return fitness_score;
 }
 
+ConvergenceReport ICPRegistration::getConvergenceReport() const
+{
+    return report;
+}
+
 //----------------------------------------------------
 
 void ICPRegistration::calculate()
 {
+    if (configs.icp().closed_form && calculate_closed_form()) {
+        return;
+    }
+
     PcdPtr& input_point_cloud_ptr = keypoints_frame.keypointsPcdPair.second;
     PcdPtr& target_point_cloud_ptr = keypoints_frame.keypointsPcdPair.first;
-    pcl::Correspondences& correspondeces = keypoints_frame.keypointsPcdCorrespondences;
-
-    const int& maxIter = configs.value("ICP_SETTINGS/MAX_ITERATIONS").toInt();
-    const double& trans_epsilon = configs.value("ICP_SETTINGS/TRANSFORMATION_EPSILON").toDouble();
-    const double& euclid_epsilon = configs.value("ICP_SETTINGS/EUCLIDEAN_EPSILON").toDouble();
 
+    const ScannerConfig::IcpSettings& adaptive = configs.icp();
     const int& k_size = input_point_cloud_ptr->size();
 
-    if (configs.value("ICP_SETTINGS/POINT_TO_PLANE").toBool() && k_size > 20) {
-        pcl::GeneralizedIterativeClosestPoint<PointType, PointType> gicp;
+    //result_t = X * initial, so the predicted X is prediction * initial^-1
+    const Eigen::Matrix4f guess = has_prediction
+        ? Eigen::Matrix4f(predicted_transformation * initial_transformation.inverse())
+        : Eigen::Matrix4f::Identity();
+
+    if (adaptive.point_to_plane && k_size > 20) {
+        IterationCounting<pcl::GeneralizedIterativeClosestPoint<PointType, PointType> >& gicp = solvers->gicp;
         gicp.setInputSource(input_point_cloud_ptr);
         gicp.setInputTarget(target_point_cloud_ptr);
-        gicp.setMaximumIterations(maxIter);
-        gicp.setTransformationEpsilon(trans_epsilon);
-        gicp.setEuclideanFitnessEpsilon(euclid_epsilon);
-        Pcd transformed_cloud;
-        gicp.align(transformed_cloud);
 
-        if (gicp.hasConverged()) {
+        if (adaptive_align(gicp, true, adaptive, guess, report)) {
             //ICP alignment
-            pcl::transformPointCloud(*target_point_cloud_ptr, *target_point_cloud_ptr, initial_transformation);
+            point_transform::transform_in_place(initial_transformation, *target_point_cloud_ptr);
             result_t = gicp.getFinalTransformation() * initial_transformation;
-            pcl::transformPointCloud(*input_point_cloud_ptr, *input_point_cloud_ptr, result_t);
-            fitness_score = gicp.getFitnessScore();
+            point_transform::transform_in_place(result_t, *input_point_cloud_ptr);
+            fitness_score = keypoint_fitness(gicp);
         } else {
-            qDebug() << "PCL GICP has not converge.";
+            LOG_WARNING("registration") << "PCL GICP has not converge.";
         }
     } else {
-        pcl::IterativeClosestPointNonLinear<PointType, PointType> icp;
+        IterationCounting<pcl::IterativeClosestPointNonLinear<PointType, PointType> >& icp = solvers->icp;
         icp.setInputSource(input_point_cloud_ptr);
         icp.setInputTarget(target_point_cloud_ptr);
-        icp.setMaximumIterations(maxIter);
-        icp.setTransformationEpsilon(trans_epsilon);
-        icp.setEuclideanFitnessEpsilon(euclid_epsilon);
-        Pcd transformed_cloud;
-        icp.align(transformed_cloud);
 
-        if (icp.hasConverged()) {
+        if (adaptive_align(icp, false, adaptive, guess, report)) {
             //ICP alignment
-            pcl::transformPointCloud(*target_point_cloud_ptr, *target_point_cloud_ptr, initial_transformation);
+            point_transform::transform_in_place(initial_transformation, *target_point_cloud_ptr);
             result_t = icp.getFinalTransformation() * initial_transformation;
-            pcl::transformPointCloud(*input_point_cloud_ptr, *input_point_cloud_ptr, result_t);
-            fitness_score = icp.getFitnessScore();
+            point_transform::transform_in_place(result_t, *input_point_cloud_ptr);
+            const pcl::Correspondences& correspondences = icp.getCorrespondences();
+            fitness_score = adaptive.full_fitness || correspondences.empty()
+                ? float(icp.getFitnessScore())
+                : summarize_residuals(correspondences.size(),
+                      [&](size_t i) { return correspondences[i].distance; }, adaptive.inlier_distance, report);
         } else {
-            qDebug() << "ICP did not converge.";
+            LOG_WARNING("registration") << "ICP did not converge.";
+        }
+    }
+}
+
+/** \brief Camera space clouds keep their trees and covariances valid for every pose, so each frame
+  * builds them once although it is the target of one pair and the source of the next one.
+  * As in DenseICPRegistration, result_t = initial * target_pose * camera_transform * source_pose^-1.
+  */
+void ICPRegistration::calculate_frames_gicp()
+{
+    const int& pixel_step = configs.icp().gicp_pixel_step;
+    const int& k_correspondences = configs.icp().gicp_k_correspondences;
+    const double& gicp_epsilon = configs.icp().gicp_epsilon;
+
+    const auto target = GICPFrameData::ofFrame(target_frame, pixel_step, k_correspondences, gicp_epsilon);
+    const auto source = GICPFrameData::ofFrame(source_frame, pixel_step, k_correspondences, gicp_epsilon);
+    if (int(target->cloud->size()) < k_correspondences || int(source->cloud->size()) < k_correspondences) {
+        LOG_WARNING("registration") << "Frames GICP: too few points.";
+        return;
+    }
+
+    IterationCounting<GICPFrameData::GICP>& gicp = solvers->frames_gicp;
+    GICPFrameData::setup(gicp, *source, *target);
+
+    const Eigen::Matrix4f target_pose(target_frame.pose);
+    const Eigen::Matrix4f source_pose(source_frame.pose);
+    const Eigen::Matrix4f guess = has_prediction
+        ? Eigen::Matrix4f(target_pose.inverse() * initial_transformation.inverse() * predicted_transformation * source_pose)
+        : Eigen::Matrix4f(target_pose.inverse() * source_pose);
+    if (adaptive_align(gicp, true, configs.icp(), guess, report)) {
+        result_t = initial_transformation * target_pose * gicp.getFinalTransformation() * source_pose.inverse();
+        fitness_score = gicp.getFitnessScore();
+    } else {
+        LOG_WARNING("registration") << "Frames GICP has not converge.";
+    }
+}
+
+/** \brief pcl GICP keeps no residuals, the keypoint correspondences, already aligned in place, stand in for them. */
+template <typename PclRegistration>
+float ICPRegistration::keypoint_fitness(PclRegistration& registration)
+{
+    const pcl::Correspondences& correspondences = keypoints_frame.keypointsPcdCorrespondences;
+    if (configs.icp().full_fitness || correspondences.empty()) {
+        return float(registration.getFitnessScore());
+    }
+
+    const Pcd& input = *keypoints_frame.keypointsPcdPair.second;
+    const Pcd& target = *keypoints_frame.keypointsPcdPair.first;
+    return summarize_residuals(correspondences.size(), [&](size_t i) {
+        return (input[correspondences[i].index_query].getVector3fMap()
+            - target[correspondences[i].index_match].getVector3fMap()).squaredNorm();
+    }, configs.icp().inlier_distance, report);
+}
+
+/** \brief Mirrors the nonlinear path, result_t = X * initial where X maps the input keypoints onto the target ones. */
+bool ICPRegistration::calculate_closed_form()
+{
+    PcdPtr& input_point_cloud_ptr = keypoints_frame.keypointsPcdPair.second;
+    PcdPtr& target_point_cloud_ptr = keypoints_frame.keypointsPcdPair.first;
+    const pcl::Correspondences& correspondences = keypoints_frame.keypointsPcdCorrespondences;
+    if (correspondences.size() < 3) {
+        return false;
+    }
+
+    const int& iterations = configs.icp().closed_form_iterations;
+    const double& min_scale = configs.icp().closed_form_min_scale;
+    const double& max_rms = configs.icp().closed_form_max_rms;
+
+    std::vector<Eigen::Vector3f> source(correspondences.size()), target(correspondences.size());
+    for (size_t i = 0; i < correspondences.size(); ++i) {
+        source[i] = (*input_point_cloud_ptr)[correspondences[i].index_query].getVector3fMap();
+        target[i] = (*target_point_cloud_ptr)[correspondences[i].index_match].getVector3fMap();
+    }
+
+    std::vector<double> weights(correspondences.size(), 1.0);
+    std::vector<double> residuals(correspondences.size());
+    Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+    double weighted_squared_sum = 0, weight_sum = 0;
+
+    for (int iteration = 0; iteration <= std::max(0, iterations); ++iteration) {
+        RigidFit fit;
+        for (size_t i = 0; i < source.size(); ++i) {
+            fit.add(source[i], target[i], weights[i]);
+        }
+        transformation = fit.transformation();
+
+        const Eigen::Matrix3f rotation = transformation.topLeftCorner<3, 3>();
+        const Eigen::Vector3f translation = transformation.topRightCorner<3, 1>();
+        for (size_t i = 0; i < source.size(); ++i) {
+            residuals[i] = double((rotation * source[i] + translation - target[i]).norm());
         }
+
+        //Residuals are distances, so their median is the MAD around zero
+        std::vector<double> sorted_residuals(residuals);
+        const auto median = sorted_residuals.begin() + sorted_residuals.size() / 2;
+        std::nth_element(sorted_residuals.begin(), median, sorted_residuals.end());
+        const double scale = CAUCHY_CONSTANT * std::max(min_scale, MAD_TO_SIGMA * *median);
+
+        weighted_squared_sum = 0;
+        weight_sum = 0;
+        for (size_t i = 0; i < residuals.size(); ++i) {
+            const double normalized = residuals[i] / scale;
+            weights[i] = 1.0 / (1.0 + normalized * normalized);
+            weighted_squared_sum += weights[i] * residuals[i] * residuals[i];
+            weight_sum += weights[i];
+        }
+    }
+
+    const double rms = std::sqrt(weighted_squared_sum / weight_sum);
+    if (!std::isfinite(rms) || rms > max_rms) {
+        qDebug() << "Closed form ICP residuals are too large:" << rms;
+        return false;
     }
+
+    point_transform::transform_in_place(initial_transformation, *target_point_cloud_ptr);
+    result_t = transformation * initial_transformation;
+    point_transform::transform_in_place(result_t, *input_point_cloud_ptr);
+    fitness_score = float(weighted_squared_sum / weight_sum);
+    summarize_residuals(residuals.size(), [&](size_t i) { return residuals[i] * residuals[i]; },
+        configs.icp().inlier_distance, report);
+    report.iterations = std::max(0, iterations) + 1;
+    report.reason = ConvergenceReport::ClosedForm;
+
+    return true;
 }
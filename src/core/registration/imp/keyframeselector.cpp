@@ -0,0 +1,116 @@
+#include "core/registration/keyframeselector.h"
+#include "core/registration/denseicpregistration.h"
+
+#include <Eigen/Geometry>
+
+#include <cmath>
+
+Frames KeyframeSelection::keyframesOf(const Frames& frames) const
+{
+    if (frames.size() != frame_keyframes.size()) {
+        throw std::invalid_argument("KeyframeSelection::keyframesOf frames.size() != frame_keyframes.size()");
+    }
+
+    Frames result;
+    for (const uint& index : keyframes) {
+        result.push_back(frames[index]);
+    }
+
+    return result;
+}
+
+Matrix4fVector KeyframeSelection::compose(const Matrix4fVector& keyframe_transformations) const
+{
+    if (keyframe_transformations.size() != keyframes.size()) {
+        throw std::invalid_argument("KeyframeSelection::compose keyframe_transformations.size() != keyframes.size()");
+    }
+
+    Matrix4fVector result;
+    for (uint i = 0; i < frame_keyframes.size(); ++i) {
+        result.push_back(keyframe_transformations[frame_keyframes[i]] * relative_transformations[i]);
+    }
+
+    return result;
+}
+
+std::vector<float> KeyframeSelection::expandPairScores(const std::vector<float>& keyframe_pair_scores) const
+{
+    if (keyframe_pair_scores.size() + 1 != keyframes.size()) {
+        throw std::invalid_argument("KeyframeSelection::expandPairScores keyframe_pair_scores.size() + 1 != keyframes.size()");
+    }
+
+    std::vector<float> result;
+    for (uint i = 0; i < keyframe_pair_scores.size(); ++i) {
+        result.insert(result.end(), keyframes[i + 1] - keyframes[i], keyframe_pair_scores[i]);
+    }
+
+    return result;
+}
+
+//----------------------------------------------------
+
+KeyframeSelector::KeyframeSelector(QObject* parent, QSettings* parent_settings)
+    : ScannerBase(parent, parent_settings)
+    , max_translation(configs.value("KEYFRAME_SETTINGS/TRANSLATION").toFloat())
+    , max_rotation(configs.value("KEYFRAME_SETTINGS/ROTATION").toFloat() * float(M_PI) / 180.0f)
+    , max_gap(std::max(1u, configs.value("KEYFRAME_SETTINGS/MAX_GAP").toUInt()))
+{
+}
+
+KeyframeSelection KeyframeSelector::select(const Frames& frames)
+{
+    KeyframeSelection selection;
+    if (frames.empty()) {
+        return selection;
+    }
+
+    selection.keyframes.push_back(0);
+    selection.frame_keyframes.push_back(0);
+    selection.relative_transformations.push_back(Eigen::Matrix4f::Identity());
+
+    //Frames are compared in camera coordinates, so the dense ICP result is the relative transformation
+    Eigen::Matrix4f previous_relative = Eigen::Matrix4f::Identity();
+    for (uint i = 1; i < frames.size(); ++i) {
+        const uint keyframe = selection.keyframes.back();
+        Eigen::Matrix4f relative = Eigen::Matrix4f::Identity();
+        bool tracked = false;
+
+        if (i != frames.size() - 1 && i - keyframe < max_gap) {
+            Frame target = frames[keyframe];
+            Frame source = frames[i];
+            target.pose.setIdentity();
+            source.pose.setIdentity();
+
+            DenseICPRegistration dense(this, settings);
+            dense.setFrames(target, source);
+            dense.setPrediction(previous_relative);
+            dense.setInput(KeypointsFrame(), Eigen::Matrix4f::Identity());
+            relative = dense.align();
+
+            const ConvergenceReport::ExitReason reason = dense.getConvergenceReport().reason;
+            tracked = reason != ConvergenceReport::NotRun && reason != ConvergenceReport::NoCorrespondences
+                && !relative.hasNaN() && !is_far(relative);
+        }
+
+        if (tracked) {
+            selection.frame_keyframes.push_back(uint(selection.keyframes.size() - 1));
+            selection.relative_transformations.push_back(relative);
+            previous_relative = relative;
+        } else {
+            selection.keyframes.push_back(i);
+            selection.frame_keyframes.push_back(uint(selection.keyframes.size() - 1));
+            selection.relative_transformations.push_back(Eigen::Matrix4f::Identity());
+            previous_relative.setIdentity();
+        }
+    }
+
+    return selection;
+}
+
+bool KeyframeSelector::is_far(const Eigen::Matrix4f& relative_transformation) const
+{
+    const float translation = relative_transformation.topRightCorner<3, 1>().norm();
+    const float rotation = Eigen::AngleAxisf(Eigen::Matrix3f(relative_transformation.topLeftCorner<3, 3>())).angle();
+
+    return translation > max_translation || rotation > max_rotation;
+}
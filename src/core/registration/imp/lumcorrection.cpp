@@ -4,6 +4,8 @@
 #include <pcl/common/distances.h>
 #include <pcl/registration/lum.h>
 
+#include "utility/profiler.h"
+
 LumCorrection::LumCorrection(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
 {
@@ -30,6 +32,7 @@ Matrix4fVector LumCorrection::getTransformations() const
 
 void LumCorrection::calculate_lum_correction()
 {
+    PROFILE_ZONE("lum");
     qDebug() << "Calculating LUM";
 
     //Converting PCD XYZRGB to XYZ
@@ -0,0 +1,55 @@
+#include "core/registration/motionmodel.h"
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+
+MotionModel::MotionModel(const size_t& history_size_)
+    : history_size(std::max(size_t(1), history_size_))
+    , last_pose(Eigen::Matrix4f::Identity())
+    , has_pose(false)
+{
+}
+
+void MotionModel::add(const Eigen::Matrix4f& pose)
+{
+    if (has_pose) {
+        relatives.push_back(last_pose.inverse() * pose);
+        if (relatives.size() > history_size) {
+            relatives.pop_front();
+        }
+    }
+
+    last_pose = pose;
+    has_pose = true;
+}
+
+bool MotionModel::predict(Eigen::Matrix4f& next_pose) const
+{
+    if (relatives.empty()) {
+        return false;
+    }
+
+    //Quaternions of one rotation come with either sign, the sum needs them on one side
+    const Eigen::Quaternionf reference(Eigen::Matrix3f(relatives.back().topLeftCorner<3, 3>()));
+    Eigen::Vector4f quaternion_sum = Eigen::Vector4f::Zero();
+    Eigen::Vector3f translation_sum = Eigen::Vector3f::Zero();
+    for (const auto& relative : relatives) {
+        const Eigen::Quaternionf rotation(Eigen::Matrix3f(relative.topLeftCorner<3, 3>()));
+        quaternion_sum += rotation.dot(reference) < 0 ? Eigen::Vector4f(-rotation.coeffs()) : Eigen::Vector4f(rotation.coeffs());
+        translation_sum += relative.topRightCorner<3, 1>();
+    }
+
+    Eigen::Matrix4f velocity = Eigen::Matrix4f::Identity();
+    velocity.topLeftCorner<3, 3>() = Eigen::Quaternionf(quaternion_sum.normalized()).toRotationMatrix();
+    velocity.topRightCorner<3, 1>() = translation_sum / float(relatives.size());
+    next_pose = last_pose * velocity;
+
+    return true;
+}
+
+void MotionModel::clear()
+{
+    relatives.clear();
+    has_pose = false;
+}
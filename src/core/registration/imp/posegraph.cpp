@@ -0,0 +1,273 @@
+#include "core/registration/posegraph.h"
+
+#include <Eigen/Geometry>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+const double SMALL_ANGLE = 1e-5;
+const double INITIAL_LAMBDA = 1e-6;
+const double LAMBDA_DECREASE = 1.0 / 3.0;
+const double LAMBDA_INCREASE = 4.0;
+const int MAX_REJECTED_STEPS = 10;
+
+Eigen::Matrix3d skew(const Eigen::Vector3d& v)
+{
+    Eigen::Matrix3d result;
+    result << 0, -v.z(), v.y(),
+        v.z(), 0, -v.x(),
+        -v.y(), v.x(), 0;
+    return result;
+}
+
+Eigen::Matrix4d inverse(const Eigen::Matrix4d& transformation)
+{
+    Eigen::Matrix4d result = Eigen::Matrix4d::Identity();
+    result.topLeftCorner<3, 3>() = transformation.topLeftCorner<3, 3>().transpose();
+    result.topRightCorner<3, 1>() = -result.topLeftCorner<3, 3>() * transformation.topRightCorner<3, 1>();
+    return result;
+}
+}
+
+PoseGraph::PoseGraph()
+    : solver_vertices_count(0)
+    , solver_edges_count(0)
+    , lambda(INITIAL_LAMBDA)
+{
+}
+
+int PoseGraph::addVertex(const Eigen::Matrix4f& pose, const bool& is_fixed)
+{
+    if (pose.hasNaN()) {
+        throw std::invalid_argument("PoseGraph::addVertex pose.hasNaN()");
+    }
+
+    poses.push_back(pose.cast<double>());
+    fixed.push_back(is_fixed);
+    return int(poses.size()) - 1;
+}
+
+void PoseGraph::addEdge(const int& from, const int& to, const Eigen::Matrix4f& measurement, const Matrix6d& information)
+{
+    if (from < 0 || to < 0 || from >= int(poses.size()) || to >= int(poses.size()) || from == to) {
+        throw std::invalid_argument("PoseGraph::addEdge invalid vertices");
+    }
+    if (measurement.hasNaN()) {
+        throw std::invalid_argument("PoseGraph::addEdge measurement.hasNaN()");
+    }
+
+    Edge edge;
+    edge.from = from;
+    edge.to = to;
+    edge.measurement_inverse = inverse(measurement.cast<double>());
+    edge.information = information;
+    edges.push_back(edge);
+}
+
+PoseGraph::Matrix6d PoseGraph::information(const double& translation_weight, const double& rotation_weight)
+{
+    Vector6d diagonal;
+    diagonal << Eigen::Vector3d::Constant(translation_weight), Eigen::Vector3d::Constant(rotation_weight);
+    return diagonal.asDiagonal();
+}
+
+/** \brief Right perturbations T * exp(d), to first order in the error the Jacobians are
+  * -Ad(T_to^-1 * T_from) for the from vertex and identity for the to vertex.
+  */
+int PoseGraph::optimize(const int& max_iterations, const double& epsilon)
+{
+    std::vector<int> columns(poses.size(), -1);
+    int free_count = 0;
+    for (size_t i = 0; i < poses.size(); ++i) {
+        if (!fixed[i]) {
+            columns[i] = 6 * free_count++;
+        }
+    }
+    if (free_count == 0 || edges.empty()) {
+        return 0;
+    }
+
+    const int size = 6 * free_count;
+    if (!solver || solver_vertices_count != poses.size() || solver_edges_count != edges.size()) {
+        solver.reset();
+        solver_vertices_count = poses.size();
+        solver_edges_count = edges.size();
+        lambda = INITIAL_LAMBDA;
+    }
+
+    double current_chi2 = chi2(poses);
+    int iteration = 0;
+    int rejected_steps = 0;
+    while (iteration < max_iterations && rejected_steps < MAX_REJECTED_STEPS) {
+        std::vector<Eigen::Triplet<double> > triplets;
+        triplets.reserve(edges.size() * 4 * 36 + size);
+        Eigen::VectorXd b = Eigen::VectorXd::Zero(size);
+
+        const auto add_block = [&triplets](const int& row, const int& column, const Matrix6d& block) {
+            for (int c = 0; c < 6; ++c) {
+                for (int r = 0; r < 6; ++r) {
+                    triplets.push_back(Eigen::Triplet<double>(row + r, column + c, block(r, c)));
+                }
+            }
+        };
+
+        for (const Edge& edge : edges) {
+            const Vector6d error = edge_error(edge);
+            const Matrix6d jacobian_from = -adjoint(inverse(poses[edge.to]) * poses[edge.from]);
+            const int from = columns[edge.from];
+            const int to = columns[edge.to];
+
+            if (from >= 0) {
+                add_block(from, from, jacobian_from.transpose() * edge.information * jacobian_from);
+                b.segment<6>(from) += jacobian_from.transpose() * edge.information * error;
+            }
+            if (to >= 0) {
+                add_block(to, to, edge.information);
+                b.segment<6>(to) += edge.information * error;
+            }
+            if (from >= 0 && to >= 0) {
+                const Matrix6d cross = jacobian_from.transpose() * edge.information;
+                add_block(from, to, cross);
+                add_block(to, from, cross.transpose());
+            }
+        }
+        for (int i = 0; i < size; ++i) {
+            triplets.push_back(Eigen::Triplet<double>(i, i, lambda));
+        }
+
+        Eigen::SparseMatrix<double> hessian(size, size);
+        hessian.setFromTriplets(triplets.begin(), triplets.end());
+
+        if (!solver) {
+            solver.reset(new Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> >());
+            solver->analyzePattern(hessian);
+        }
+        solver->factorize(hessian);
+        if (solver->info() != Eigen::Success) {
+            lambda *= LAMBDA_INCREASE;
+            ++rejected_steps;
+            continue;
+        }
+
+        const Eigen::VectorXd step = solver->solve(-b);
+        ++iteration;
+
+        auto estimates = poses;
+        for (size_t i = 0; i < estimates.size(); ++i) {
+            if (columns[i] >= 0) {
+                estimates[i] = estimates[i] * exp(step.segment<6>(columns[i]));
+            }
+        }
+
+        const double estimates_chi2 = chi2(estimates);
+        if (estimates_chi2 <= current_chi2) {
+            poses.swap(estimates);
+            current_chi2 = estimates_chi2;
+            lambda = std::max(lambda * LAMBDA_DECREASE, 1e-12);
+            rejected_steps = 0;
+            if (step.squaredNorm() < epsilon) {
+                break;
+            }
+        } else {
+            lambda *= LAMBDA_INCREASE;
+            ++rejected_steps;
+        }
+    }
+
+    return iteration;
+}
+
+Eigen::Matrix4f PoseGraph::getPose(const int& vertex) const
+{
+    return poses.at(vertex).cast<float>();
+}
+
+void PoseGraph::setPose(const int& vertex, const Eigen::Matrix4f& pose)
+{
+    poses.at(vertex) = pose.cast<double>();
+}
+
+size_t PoseGraph::getVerticesCount() const
+{
+    return poses.size();
+}
+
+size_t PoseGraph::getEdgesCount() const
+{
+    return edges.size();
+}
+
+double PoseGraph::getChi2() const
+{
+    return chi2(poses);
+}
+
+//----------------------------------------------------
+
+PoseGraph::Vector6d PoseGraph::edge_error(const Edge& edge) const
+{
+    return log(edge.measurement_inverse * inverse(poses[edge.from]) * poses[edge.to]);
+}
+
+double PoseGraph::chi2(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& estimates) const
+{
+    double result = 0;
+    for (const Edge& edge : edges) {
+        const Vector6d error = log(edge.measurement_inverse * inverse(estimates[edge.from]) * estimates[edge.to]);
+        result += error.dot(edge.information * error);
+    }
+
+    return result;
+}
+
+Eigen::Matrix4d PoseGraph::exp(const Vector6d& twist)
+{
+    const Eigen::Vector3d rho = twist.head<3>();
+    const Eigen::Vector3d phi = twist.tail<3>();
+    const double theta = phi.norm();
+    const Eigen::Matrix3d w = skew(phi);
+
+    //Below SMALL_ANGLE the series are used, the closed forms lose all precision there
+    Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity() + w + 0.5 * w * w;
+    Eigen::Matrix3d v = Eigen::Matrix3d::Identity() + 0.5 * w + w * w / 6.0;
+    if (theta > SMALL_ANGLE) {
+        rotation = Eigen::AngleAxisd(theta, phi / theta).toRotationMatrix();
+        v = Eigen::Matrix3d::Identity() + (1.0 - std::cos(theta)) / (theta * theta) * w
+            + (theta - std::sin(theta)) / (theta * theta * theta) * w * w;
+    }
+
+    Eigen::Matrix4d result = Eigen::Matrix4d::Identity();
+    result.topLeftCorner<3, 3>() = rotation;
+    result.topRightCorner<3, 1>() = v * rho;
+    return result;
+}
+
+PoseGraph::Vector6d PoseGraph::log(const Eigen::Matrix4d& transformation)
+{
+    const Eigen::AngleAxisd angle_axis(Eigen::Matrix3d(transformation.topLeftCorner<3, 3>()));
+    const double theta = angle_axis.angle();
+    const Eigen::Vector3d phi = theta * angle_axis.axis();
+    const Eigen::Matrix3d w = skew(phi);
+
+    Eigen::Matrix3d v_inverse = Eigen::Matrix3d::Identity() - 0.5 * w + w * w / 12.0;
+    if (theta > SMALL_ANGLE) {
+        v_inverse = Eigen::Matrix3d::Identity() - 0.5 * w
+            + (1.0 - theta * std::sin(theta) / (2.0 * (1.0 - std::cos(theta)))) / (theta * theta) * w * w;
+    }
+
+    Vector6d result;
+    result << v_inverse * transformation.topRightCorner<3, 1>(), phi;
+    return result;
+}
+
+PoseGraph::Matrix6d PoseGraph::adjoint(const Eigen::Matrix4d& transformation)
+{
+    const Eigen::Matrix3d rotation = transformation.topLeftCorner<3, 3>();
+
+    Matrix6d result = Matrix6d::Zero();
+    result.topLeftCorner<3, 3>() = rotation;
+    result.topRightCorner<3, 3>() = skew(transformation.topRightCorner<3, 1>()) * rotation;
+    result.bottomRightCorner<3, 3>() = rotation;
+    return result;
+}
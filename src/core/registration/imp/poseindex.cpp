@@ -0,0 +1,72 @@
+#include "core/registration/poseindex.h"
+
+#include <cmath>
+
+namespace {
+
+pcl::PointXYZ centre_of(const Eigen::Matrix4f& pose)
+{
+    return pcl::PointXYZ(pose(0, 3), pose(1, 3), pose(2, 3));
+}
+
+} // namespace
+
+PoseIndex::PoseIndex(const float& max_distance_, const float& max_angle)
+    : max_distance(max_distance_)
+    , min_cos_angle(std::cos(max_angle * float(M_PI) / 180.0f))
+    , centres(new pcl::PointCloud<pcl::PointXYZ>)
+{
+}
+
+void PoseIndex::build(const Matrix4fVector& poses_)
+{
+    poses = poses_;
+    centres->clear();
+    for (const Eigen::Matrix4f& pose : poses) {
+        centres->push_back(centre_of(pose));
+    }
+
+    if (!centres->empty()) {
+        tree.setInputCloud(centres);
+    }
+}
+
+std::vector<int> PoseIndex::query(const Eigen::Matrix4f& pose, const int& max_frame_id, const size_t& max_candidates) const
+{
+    std::vector<int> result;
+    if (centres->empty() || max_frame_id < 0 || max_candidates == 0) {
+        return result;
+    }
+
+    //Radius search comes back sorted by distance
+    std::vector<int> indices;
+    std::vector<float> squared_distances;
+    tree.radiusSearch(centre_of(pose), double(max_distance), indices, squared_distances);
+
+    for (const int& index : indices) {
+        if (index <= max_frame_id && overlaps(pose, poses[index])) {
+            result.push_back(index);
+            if (result.size() == max_candidates) {
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+bool PoseIndex::overlaps(const Eigen::Matrix4f& first_pose, const Eigen::Matrix4f& second_pose) const
+{
+    if ((first_pose.topRightCorner<3, 1>() - second_pose.topRightCorner<3, 1>()).norm() > max_distance) {
+        return false;
+    }
+
+    const Eigen::Vector3f first_direction = first_pose.block<3, 1>(0, 2).normalized();
+    const Eigen::Vector3f second_direction = second_pose.block<3, 1>(0, 2).normalized();
+    return first_direction.dot(second_direction) >= min_cos_angle;
+}
+
+size_t PoseIndex::size() const
+{
+    return poses.size();
+}
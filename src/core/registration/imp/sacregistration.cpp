@@ -3,10 +3,18 @@
 #include <QDebug>
 #include <pcl/registration/correspondence_rejection_sample_consensus.h>
 
+#include "core/keypoints/inlierkernel.h"
+#include "core/keypoints/rigidfit.h"
+#include "core/keypoints/rigidsampleconsensus.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+
 SaCRegistration::SaCRegistration(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
     , inlier_threshold(configs.value("SAC_SETTINGS/INLIER_THRESHOLD").toDouble())
     , max_iter(configs.value("SAC_SETTINGS/MAX_ITERATIONS").toInt())
+    , predicted_transformation(Eigen::Matrix4f::Identity())
+    , has_prediction(false)
 {
 }
 
@@ -15,16 +23,30 @@ void SaCRegistration::setInput(
     const Eigen::Matrix4f& initial_transformation_)
 {
     keypoints_frame = keypoints_frame_;
+    keypoints_frame.detach();
     initial_transformation = initial_transformation_;
 }
 
+void SaCRegistration::setPrediction(const Eigen::Matrix4f& predicted_transformation_)
+{
+    predicted_transformation = predicted_transformation_;
+    has_prediction = true;
+}
+
 Eigen::Matrix4f SaCRegistration::align()
 {
+    PROFILE_ZONE("sac");
     result_t = Eigen::Matrix4f::Identity();
     calculate();
+    has_prediction = false;
     return result_t;
 }
 
+QString SaCRegistration::settingsSection()
+{
+    return "SAC_SETTINGS";
+}
+
 Eigen::Matrix4f SaCRegistration::getTransformation() const
 {
     return result_t;
@@ -36,6 +58,21 @@ float SaCRegistration::getFitnessScore() const
 }
 
 void SaCRegistration::calculate()
+{
+    Eigen::Matrix4f sac_transformation;
+    if (!prediction_transformation(sac_transformation)) {
+        sac_transformation = configs.value("SAC_SETTINGS/RIGID_SAC_ENABLE").toBool()
+            ? rigid_sac_transformation()
+            : pcl_sac_transformation();
+    }
+    result_t = initial_transformation * sac_transformation;
+
+    //Transform Keypoint clouds
+    point_transform::transform_in_place(initial_transformation, *keypoints_frame.keypointsPcdPair.first);
+    point_transform::transform_in_place(result_t, *keypoints_frame.keypointsPcdPair.second);
+}
+
+Eigen::Matrix4f SaCRegistration::pcl_sac_transformation() const
 {
     pcl::registration::CorrespondenceRejectorSampleConsensus<PointType> sac;
     sac.setInputSource(keypoints_frame.keypointsPcdPair.second);
@@ -47,11 +84,70 @@ void SaCRegistration::calculate()
     pcl::Correspondences tmp_correspondences;
     sac.getCorrespondences(tmp_correspondences);
 
-    result_t = initial_transformation * sac.getBestTransformation();
+    return sac.getBestTransformation();
+}
 
-    //Transform Keypoint clouds
-    pcl::transformPointCloud(
-        *keypoints_frame.keypointsPcdPair.first, *keypoints_frame.keypointsPcdPair.first, initial_transformation);
-    pcl::transformPointCloud(
-        *keypoints_frame.keypointsPcdPair.second, *keypoints_frame.keypointsPcdPair.second, result_t);
+Eigen::Matrix4f SaCRegistration::rigid_sac_transformation() const
+{
+    const pcl::Correspondences& correspondences = keypoints_frame.keypointsPcdCorrespondences;
+    std::vector<Eigen::Vector3f> source(correspondences.size());
+    std::vector<Eigen::Vector3f> target(correspondences.size());
+    for (size_t i = 0; i < correspondences.size(); i++) {
+        source[i] = (*keypoints_frame.keypointsPcdPair.second)[correspondences[i].index_query].getVector3fMap();
+        target[i] = (*keypoints_frame.keypointsPcdPair.first)[correspondences[i].index_match].getVector3fMap();
+    }
+
+    RigidSampleConsensus::Parameters parameters;
+    parameters.inlier_threshold = DISABLED_INLIER_THRESHOLD;
+    parameters.max_iterations = max_iter;
+    parameters.confidence = configs.value("SAC_SETTINGS/CONFIDENCE").toDouble();
+    parameters.preemption_block = configs.value("SAC_SETTINGS/PREEMPTION_BLOCK").toInt();
+    parameters.prosac = configs.value("SAC_SETTINGS/PROSAC").toBool();
+    parameters.refine = configs.value("SAC_SETTINGS/REFINE").toBool();
+    parameters.seed = configs.value("SAC_SETTINGS/SEED").toUInt();
+
+    RigidSampleConsensus sac(parameters);
+    std::vector<int> inliers;
+    Eigen::Matrix4f transformation;
+    sac.estimate(source, target, inliers, transformation);
+
+    return transformation;
+}
+
+/** \brief result_t = initial * X, so the predicted X is initial^-1 * prediction. */
+bool SaCRegistration::prediction_transformation(Eigen::Matrix4f& transformation) const
+{
+    const pcl::Correspondences& correspondences = keypoints_frame.keypointsPcdCorrespondences;
+    if (!has_prediction || correspondences.size() < 3) {
+        return false;
+    }
+
+    std::vector<Eigen::Vector3f> source(correspondences.size());
+    std::vector<Eigen::Vector3f> target(correspondences.size());
+    for (size_t i = 0; i < correspondences.size(); i++) {
+        source[i] = (*keypoints_frame.keypointsPcdPair.second)[correspondences[i].index_query].getVector3fMap();
+        target[i] = (*keypoints_frame.keypointsPcdPair.first)[correspondences[i].index_match].getVector3fMap();
+    }
+
+    const Eigen::Matrix4f prediction = initial_transformation.inverse() * predicted_transformation;
+    std::vector<int> inliers;
+    inlier_kernel::select(inlier_kernel::Points(source), inlier_kernel::Points(target), prediction,
+        float(inlier_threshold * inlier_threshold), inliers);
+
+    const double min_ratio = configs.value("SAC_SETTINGS/MOTION_PRIOR_MIN_INLIER_RATIO").toDouble();
+    if (inliers.size() < 3 || double(inliers.size()) < min_ratio * double(correspondences.size())) {
+        return false;
+    }
+
+    RigidFit fit;
+    for (const int& index : inliers) {
+        fit.add(source[index], target[index]);
+    }
+    transformation = fit.transformation();
+
+    if (configs.value("SAC_SETTINGS/ENABLE_LOG").toBool()) {
+        LOG_DEBUG("registration") << "SaC: motion prior accepted with" << inliers.size() << "/" << correspondences.size() << "inliers";
+    }
+
+    return true;
 }
@@ -0,0 +1,223 @@
+#include "core/registration/streamingodometry.h"
+#include "core/registration/icpregistration.h"
+#include "core/registration/sacregistration.h"
+
+#include <Eigen/Geometry>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cmath>
+
+#include "utility/log.h"
+
+StreamingOdometry::StreamingOdometry(QObject* parent, QSettings* parent_settings)
+    : Registration(parent, parent_settings)
+    , min_keypoints(configs.value("STREAMING_ODOMETRY_SETTINGS/MIN_KEYPOINTS").toInt())
+    , max_fitness(configs.value("STREAMING_ODOMETRY_SETTINGS/MAX_FITNESS").toFloat())
+    , keyframe_translation(configs.value("STREAMING_ODOMETRY_SETTINGS/KEYFRAME_TRANSLATION").toFloat())
+    , keyframe_rotation(configs.value("STREAMING_ODOMETRY_SETTINGS/KEYFRAME_ROTATION").toFloat() * float(M_PI) / 180.0f)
+    , preview_size(configs.value("STREAMING_ODOMETRY_SETTINGS/PREVIEW_SIZE").toInt())
+    , preview_scale(configs.value("STREAMING_ODOMETRY_SETTINGS/PREVIEW_SCALE").toFloat())
+    , tracking_lost(false)
+    , lost_count(0)
+    , keyframe_pose(Eigen::Matrix4f::Identity())
+    , has_keyframe(false)
+    , motion_model(configs.value("REGISTRATION_SETTINGS/MOTION_PRIOR_HISTORY").toUInt())
+    , tracked_pairs(0)
+    , worker(new FrameWriter(configs.value("STREAMING_ODOMETRY_SETTINGS/QUEUE_SIZE").toUInt(), 1))
+{
+}
+
+StreamingOdometry::~StreamingOdometry()
+{
+    worker.reset();
+}
+
+bool StreamingOdometry::push(const Frame& frame)
+{
+    if (!frame.pointCloudPtr || frame.pointCloudPtr->empty() || frame.pointCloudImage.empty()) {
+        throw std::invalid_argument("StreamingOdometry::push frame has no cloud or image");
+    }
+
+    return worker->enqueue([this, frame]() { process(frame); }, true);
+}
+
+void StreamingOdometry::wait()
+{
+    worker->wait();
+}
+
+void StreamingOdometry::reset()
+{
+    worker->wait();
+
+    keyframe = Frame();
+    keyframe_pose.setIdentity();
+    has_keyframe = false;
+    motion_model.clear();
+    tracked_pairs = 0;
+    budget.reset();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    poses.clear();
+    frame_indexes.clear();
+    tracking_lost = false;
+    lost_count = 0;
+}
+
+Matrix4fVector StreamingOdometry::getPoses()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return poses;
+}
+
+std::vector<int> StreamingOdometry::getFrameIndexes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return frame_indexes;
+}
+
+Eigen::Matrix4f StreamingOdometry::getLastPose()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return poses.empty() ? Eigen::Matrix4f(Eigen::Matrix4f::Identity()) : poses.back();
+}
+
+bool StreamingOdometry::isTrackingLost()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tracking_lost;
+}
+
+size_t StreamingOdometry::getLostCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lost_count;
+}
+
+size_t StreamingOdometry::getDroppedCount() const
+{
+    return worker->getDroppedCount();
+}
+
+cv::Mat StreamingOdometry::getPreview()
+{
+    cv::Mat preview(preview_size, preview_size, CV_8UC3, cv::Scalar(0, 0, 0));
+    const cv::Point center(preview_size / 2, preview_size / 2);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    //Top view, x to the right and z up the image
+    const auto to_pixel = [&](const Eigen::Matrix4f& pose) {
+        return center + cv::Point(int(pose(0, 3) * preview_scale), -int(pose(2, 3) * preview_scale));
+    };
+    for (size_t i = 1; i < poses.size(); ++i) {
+        cv::line(preview, to_pixel(poses[i - 1]), to_pixel(poses[i]), cv::Scalar(0, 255, 0), 1);
+    }
+
+    const cv::Scalar status_color = tracking_lost ? cv::Scalar(0, 0, 255) : cv::Scalar(0, 255, 0);
+    if (!poses.empty()) {
+        const Eigen::Matrix4f& pose = poses.back();
+        const cv::Point position = to_pixel(pose);
+        const cv::Point direction(int(pose(0, 2) * 15.0f), -int(pose(2, 2) * 15.0f));
+        cv::circle(preview, position, 3, status_color, -1);
+        cv::line(preview, position, position + direction, status_color, 1);
+    }
+
+    cv::putText(preview, QString("%1 %2 frames, %3 lost, %4 dropped")
+                             .arg(tracking_lost ? "LOST" : "TRACKING")
+                             .arg(poses.size())
+                             .arg(lost_count)
+                             .arg(worker->getDroppedCount())
+                             .toStdString(),
+        cv::Point(5, 15), cv::FONT_HERSHEY_SIMPLEX, 0.4, status_color, 1);
+
+    return preview;
+}
+
+void StreamingOdometry::process(const Frame& frame)
+{
+    if (!has_keyframe) {
+        keyframe = frame;
+        keyframe_pose = Eigen::Matrix4f::Identity();
+        has_keyframe = true;
+        motion_model.add(keyframe_pose);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        poses.push_back(keyframe_pose);
+        frame_indexes.push_back(frame.frameIndex);
+        return;
+    }
+
+    Eigen::Matrix4f pose;
+    const bool tracked = track(frame, pose);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tracking_lost = !tracked;
+        if (tracked) {
+            poses.push_back(pose);
+            frame_indexes.push_back(frame.frameIndex);
+        } else {
+            ++lost_count;
+        }
+    }
+
+    if (!tracked) {
+        //The next frames are still matched against the last keyframe, so tracking recovers when the camera comes back
+        motion_model.clear();
+        motion_model.add(keyframe_pose);
+        LOG_WARNING("registration") << "StreamingOdometry: tracking lost at frame" << frame.frameIndex;
+        return;
+    }
+
+    motion_model.add(pose);
+    if (is_keyframe(pose)) {
+        //The copy shares the derived data, the features extracted while tracking the frame serve the next pairs
+        keyframe = frame;
+        keyframe_pose = pose;
+    }
+}
+
+/** \brief Same composition as the offline linear SaC then ICP pipeline, with the keyframe as the pair's first frame. */
+bool StreamingOdometry::track(const Frame& frame, Eigen::Matrix4f& pose)
+{
+    KeypointsFrame keypoints_frame = calculate_one_keypoint_pair(keyframe, frame, tracked_pairs++);
+    if (int(keypoints_frame.keypointsPcdPair.second->size()) < min_keypoints) {
+        return false;
+    }
+
+    Eigen::Matrix4f prediction;
+    const bool has_prediction = configs.value("REGISTRATION_SETTINGS/MOTION_PRIOR").toBool()
+        && motion_model.predict(prediction);
+
+    float sac_fitness = 0;
+    const Eigen::Matrix4f sac_t = register_keypoint_pair<SaCRegistration>(
+        keypoints_frame, keyframe, frame, keyframe_pose, sac_fitness,
+        has_prediction ? &prediction : nullptr);
+    if (sac_t.hasNaN()) {
+        return false;
+    }
+
+    const KeypointsFrame transformed_keypoints_frame = keypoints_frame.transformFirst(keyframe_pose).transformSecond(sac_t);
+
+    float icp_fitness = 0;
+    const Eigen::Matrix4f icp_t = register_keypoint_pair<ICPRegistration>(
+        transformed_keypoints_frame, keyframe.transform(keyframe_pose), frame.transform(sac_t),
+        Eigen::Matrix4f::Identity(), icp_fitness);
+    if (icp_t.hasNaN() || icp_fitness > max_fitness) {
+        return false;
+    }
+
+    pose = icp_t * sac_t;
+    return true;
+}
+
+bool StreamingOdometry::is_keyframe(const Eigen::Matrix4f& pose) const
+{
+    const Eigen::Matrix4f relative = keyframe_pose.inverse() * pose;
+    const float translation = relative.topRightCorner<3, 1>().norm();
+    const float rotation = Eigen::AngleAxisf(Eigen::Matrix3f(relative.topLeftCorner<3, 3>())).angle();
+
+    return translation > keyframe_translation || rotation > keyframe_rotation;
+}
@@ -0,0 +1,319 @@
+#include "core/registration/turntableregistration.h"
+
+#include <QStringList>
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include <Eigen/Geometry>
+#include <Eigen/SVD>
+
+#include <algorithm>
+#include <cmath>
+
+#include "core/keypoints/rigidsampleconsensus.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+
+namespace {
+
+const float DEGREES_TO_RADIANS = float(M_PI) / 180.0f;
+
+/** \brief Points closer to the axis than this give no angle. */
+const float MIN_AXIS_DISTANCE = 0.001f;
+
+bool parse_vector(const QVariant& value, Eigen::Vector3f& vector)
+{
+    const QStringList components = value.toStringList();
+    if (components.size() != 3) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        bool ok = false;
+        vector[i] = components[i].trimmed().toFloat(&ok);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TurntableRegistration::TurntableRegistration(QObject* parent, QSettings* parent_settings)
+    : ScannerBase(parent, parent_settings)
+    , inlier_threshold(configs.value("TURNTABLE_SETTINGS/INLIER_THRESHOLD").toFloat())
+    , max_iterations(configs.value("TURNTABLE_SETTINGS/MAX_ITERATIONS").toInt())
+    , min_axis_angle(configs.value("TURNTABLE_SETTINGS/MIN_AXIS_ANGLE").toFloat() * DEGREES_TO_RADIANS)
+    , angle_per_frame(configs.value("TURNTABLE_SETTINGS/ANGLE_PER_FRAME").toFloat() * DEGREES_TO_RADIANS)
+    , axial_translation(configs.value("TURNTABLE_SETTINGS/AXIAL_TRANSLATION").toBool())
+    , refine_iterations(configs.value("TURNTABLE_SETTINGS/REFINE_ITERATIONS").toInt())
+    , has_axis(false)
+    , axis(Eigen::Vector3f::UnitY())
+    , center(Eigen::Vector3f::Zero())
+    , initial_transformation(Eigen::Matrix4f::Identity())
+    , frames_gap(1)
+    , result_t(Eigen::Matrix4f::Identity())
+    , fitness_score(0)
+{
+    Eigen::Vector3f configured_axis;
+    if (parse_vector(configs.value("TURNTABLE_SETTINGS/AXIS"), configured_axis) && configured_axis.norm() > 0) {
+        axis = configured_axis.normalized();
+        parse_vector(configs.value("TURNTABLE_SETTINGS/CENTER"), center);
+        has_axis = true;
+    }
+}
+
+void TurntableRegistration::setInput(
+    const KeypointsFrame& keypoints_frame_,
+    const Eigen::Matrix4f& initial_transformation_)
+{
+    keypoints_frame = keypoints_frame_;
+    initial_transformation = initial_transformation_;
+}
+
+void TurntableRegistration::setFrames(const Frame& target_frame_, const Frame& source_frame_)
+{
+    frames_gap = target_frame_.frameIndex >= 0 && source_frame_.frameIndex >= 0
+        ? source_frame_.frameIndex - target_frame_.frameIndex
+        : 1;
+}
+
+Eigen::Matrix4f TurntableRegistration::align()
+{
+    PROFILE_ZONE("turntable");
+    result_t = initial_transformation;
+    fitness_score = 0;
+    calculate();
+    frames_gap = 1;
+    return result_t;
+}
+
+QString TurntableRegistration::settingsSection()
+{
+    return "TURNTABLE_SETTINGS";
+}
+
+Eigen::Matrix4f TurntableRegistration::getTransformation() const
+{
+    return result_t;
+}
+
+float TurntableRegistration::getFitnessScore() const
+{
+    return fitness_score;
+}
+
+bool TurntableRegistration::hasAxis() const
+{
+    return has_axis;
+}
+
+/** \brief As SaCRegistration, result_t = initial * X where X maps the second frame's keypoints onto the first's.
+  * Every correspondence gives an angle, the one with most inliers is refitted on them.
+  */
+void TurntableRegistration::calculate()
+{
+    const pcl::Correspondences& correspondences = keypoints_frame.keypointsPcdCorrespondences;
+    if (correspondences.size() < 3) {
+        return;
+    }
+
+    std::vector<Eigen::Vector3f> source(correspondences.size());
+    std::vector<Eigen::Vector3f> target(correspondences.size());
+    for (size_t i = 0; i < correspondences.size(); ++i) {
+        source[i] = (*keypoints_frame.keypointsPcdPair.second)[correspondences[i].index_query].getVector3fMap();
+        target[i] = (*keypoints_frame.keypointsPcdPair.first)[correspondences[i].index_match].getVector3fMap();
+    }
+
+    std::vector<int> inliers;
+    if (!has_axis) {
+        RigidSampleConsensus::Parameters parameters;
+        parameters.inlier_threshold = inlier_threshold;
+        parameters.max_iterations = max_iterations;
+        parameters.confidence = configs.value("SAC_SETTINGS/CONFIDENCE").toDouble();
+        parameters.preemption_block = configs.value("SAC_SETTINGS/PREEMPTION_BLOCK").toInt();
+        parameters.prosac = configs.value("SAC_SETTINGS/PROSAC").toBool();
+        parameters.refine = true;
+        parameters.seed = configs.value("SAC_SETTINGS/SEED").toUInt();
+
+        RigidSampleConsensus sac(parameters);
+        Eigen::Matrix4f transformation;
+        if (!sac.estimate(source, target, inliers, transformation)) {
+            return;
+        }
+
+        result_t = initial_transformation * transformation;
+        fitness_score = select_inliers(source, target, transformation, inliers);
+        if (!adopt_axis(transformation)) {
+            return;
+        }
+    }
+
+    //Hypotheses are spread over the correspondences, a known angle is the only one
+    std::vector<float> hypotheses;
+    if (angle_per_frame != 0) {
+        hypotheses.push_back(angle_per_frame * float(frames_gap));
+    } else {
+        const size_t stride = std::max<size_t>(1, source.size() / size_t(std::max(1, max_iterations)));
+        for (size_t i = 0; i < source.size(); i += stride) {
+            const Eigen::Vector3f s = source[i] - center;
+            const Eigen::Vector3f t = target[i] - center;
+            const Eigen::Vector3f s_plane = s - axis.dot(s) * axis;
+            const Eigen::Vector3f t_plane = t - axis.dot(t) * axis;
+            if (s_plane.norm() > MIN_AXIS_DISTANCE && t_plane.norm() > MIN_AXIS_DISTANCE) {
+                hypotheses.push_back(std::atan2(axis.dot(s_plane.cross(t_plane)), s_plane.dot(t_plane)));
+            }
+        }
+    }
+
+    std::vector<int> best_inliers, hypothesis_inliers;
+    for (const float& hypothesis : hypotheses) {
+        float shift = 0;
+        float angle = hypothesis;
+        if (axial_translation) {
+            //The shift is fitted on the pairs the hypothesis already explains without one
+            select_inliers(source, target, about_axis(hypothesis, 0), hypothesis_inliers);
+            if (!hypothesis_inliers.empty()) {
+                fit(source, target, hypothesis_inliers, angle, shift);
+                angle = hypothesis;
+            }
+        }
+        select_inliers(source, target, about_axis(angle, shift), hypothesis_inliers);
+        if (hypothesis_inliers.size() > best_inliers.size()) {
+            best_inliers.swap(hypothesis_inliers);
+        }
+    }
+    if (best_inliers.size() < 3) {
+        return;
+    }
+
+    float angle = 0, shift = 0;
+    fit(source, target, best_inliers, angle, shift);
+    refine(angle, shift);
+
+    const Eigen::Matrix4f transformation = about_axis(angle, shift);
+    result_t = initial_transformation * transformation;
+    fitness_score = select_inliers(source, target, transformation, inliers);
+
+    if (configs.value("TURNTABLE_SETTINGS/ENABLE_LOG").toBool()) {
+        LOG_DEBUG("registration") << "Turntable:" << angle / DEGREES_TO_RADIANS << "degrees," << shift << "shift,"
+                                  << inliers.size() << "/" << source.size() << "inliers";
+    }
+}
+
+/** \brief The points of the axis are fixed, (I - R) c = t, which has a line of solutions along the axis.
+  * The minimum norm one is kept, t along the axis is the shift of the pair.
+  */
+bool TurntableRegistration::adopt_axis(const Eigen::Matrix4f& transformation)
+{
+    const Eigen::Matrix3f rotation = transformation.topLeftCorner<3, 3>();
+    const Eigen::AngleAxisf angle_axis(rotation);
+    if (std::abs(angle_axis.angle()) < min_axis_angle) {
+        return false;
+    }
+
+    const Eigen::Matrix3f system = Eigen::Matrix3f::Identity() - rotation;
+    axis = angle_axis.axis().normalized();
+    center = system.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(
+        Eigen::Vector3f(transformation.topRightCorner<3, 1>()));
+    has_axis = true;
+
+    LOG_INFO("registration") << "Turntable: axis" << axis.x() << axis.y() << axis.z() << "through" << center.x() << center.y() << center.z();
+    return true;
+}
+
+Eigen::Matrix4f TurntableRegistration::about_axis(const float& angle, const float& shift) const
+{
+    const Eigen::Matrix3f rotation = Eigen::AngleAxisf(angle, axis).toRotationMatrix();
+    Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+    transformation.topLeftCorner<3, 3>() = rotation;
+    transformation.topRightCorner<3, 1>() = center - rotation * center + shift * axis;
+    return transformation;
+}
+
+/** \brief In the plane across the axis the best angle is the argument of the summed products of the pairs
+  * as complex numbers, the shift is the mean offset along the axis.
+  */
+void TurntableRegistration::fit(const std::vector<Eigen::Vector3f>& source, const std::vector<Eigen::Vector3f>& target,
+    const std::vector<int>& pairs, float& angle, float& shift) const
+{
+    double sine = 0, cosine = 0, offset = 0;
+    for (const int& i : pairs) {
+        const Eigen::Vector3f s = source[i] - center;
+        const Eigen::Vector3f t = target[i] - center;
+        const Eigen::Vector3f s_plane = s - axis.dot(s) * axis;
+        const Eigen::Vector3f t_plane = t - axis.dot(t) * axis;
+        sine += double(axis.dot(s_plane.cross(t_plane)));
+        cosine += double(s_plane.dot(t_plane));
+        offset += double(axis.dot(t - s));
+    }
+
+    angle = float(std::atan2(sine, cosine));
+    shift = axial_translation && !pairs.empty() ? float(offset / double(pairs.size())) : 0.0f;
+}
+
+float TurntableRegistration::select_inliers(const std::vector<Eigen::Vector3f>& source,
+    const std::vector<Eigen::Vector3f>& target, const Eigen::Matrix4f& transformation, std::vector<int>& inliers) const
+{
+    const Eigen::Matrix3f rotation = transformation.topLeftCorner<3, 3>();
+    const Eigen::Vector3f translation = transformation.topRightCorner<3, 1>();
+    const float squared_threshold = inlier_threshold * inlier_threshold;
+
+    inliers.clear();
+    double squared_sum = 0;
+    for (size_t i = 0; i < source.size(); ++i) {
+        const float squared = (rotation * source[i] + translation - target[i]).squaredNorm();
+        if (squared <= squared_threshold) {
+            inliers.push_back(int(i));
+            squared_sum += double(squared);
+        }
+    }
+
+    return inliers.empty() ? 0.0f : float(squared_sum / double(inliers.size()));
+}
+
+void TurntableRegistration::refine(float& angle, float& shift)
+{
+    const PcdPtr& source_cloud = keypoints_frame.keypointsPcdPair.second;
+    const PcdPtr& target_cloud = keypoints_frame.keypointsPcdPair.first;
+    if (refine_iterations <= 0 || source_cloud->size() < 3 || target_cloud->size() < 3) {
+        return;
+    }
+
+    pcl::KdTreeFLANN<PointType> tree;
+    tree.setInputCloud(target_cloud);
+
+    std::vector<Eigen::Vector3f> source, target;
+    std::vector<int> pairs, indices(1);
+    std::vector<float> squared_distances(1);
+    const float squared_threshold = inlier_threshold * inlier_threshold;
+    for (int iteration = 0; iteration < refine_iterations; ++iteration) {
+        const Eigen::Matrix4f transformation = about_axis(angle, shift);
+        source.clear();
+        target.clear();
+        pairs.clear();
+        for (const PointType& point : source_cloud->points) {
+            if (!std::isfinite(point.x)) {
+                continue;
+            }
+
+            const Eigen::Vector3f original = point.getVector3fMap();
+            PointType moved(point);
+            moved.getVector3fMap() = transformation.topLeftCorner<3, 3>() * original + transformation.topRightCorner<3, 1>();
+            if (tree.nearestKSearch(moved, 1, indices, squared_distances) == 1 && squared_distances[0] <= squared_threshold) {
+                pairs.push_back(int(source.size()));
+                source.push_back(original);
+                target.push_back((*target_cloud)[indices[0]].getVector3fMap());
+            }
+        }
+        if (pairs.size() < 3) {
+            return;
+        }
+
+        const float previous_angle = angle;
+        fit(source, target, pairs, angle, shift);
+        if (std::abs(angle - previous_angle) < 1e-5f) {
+            return;
+        }
+    }
+}
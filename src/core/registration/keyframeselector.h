@@ -0,0 +1,50 @@
+#ifndef KEYFRAMESELECTOR_H
+#define KEYFRAMESELECTOR_H
+
+#include "core/base/scannerbase.h"
+#include "core/base/scannertypes.h"
+
+/** \brief Keyframes of a frame sequence and the cheap pose of every frame relative to its keyframe. */
+struct KeyframeSelection {
+    /** \brief Frame indexes of the keyframes, the first and the last frame are always keyframes. */
+    std::vector<uint> keyframes;
+    /** \brief Per frame, the position in keyframes of the keyframe it was estimated against. */
+    std::vector<uint> frame_keyframes;
+    /** \brief Per frame, keyframe camera to frame camera transformation, identity for keyframes. */
+    Matrix4fVector relative_transformations;
+
+    Frames keyframesOf(const Frames& frames) const;
+
+    /** \brief Poses of every frame from the poses of the keyframes. */
+    Matrix4fVector compose(const Matrix4fVector& keyframe_transformations) const;
+
+    /** \brief Per pair of consecutive frames, the score of the pair of keyframes spanning it, as compose
+      * for the poses, so the scores line up with the frames again.
+      */
+    std::vector<float> expandPairScores(const std::vector<float>& keyframe_pair_scores) const;
+};
+
+/** \brief Adaptive replacement for a fixed reading step. Every frame is aligned to the last keyframe
+  * with dense ICP, which is cheap next to keypoint registration, and becomes the next keyframe once
+  * its motion exceeds KEYFRAME_SETTINGS/TRANSLATION or ROTATION, the alignment fails, or MAX_GAP
+  * frames passed. Needs the organized clouds, so it runs before filtering.
+  */
+class KeyframeSelector : public ScannerBase {
+    Q_OBJECT
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    KeyframeSelector(QObject* parent, QSettings* parent_settings);
+
+    KeyframeSelection select(const Frames& frames);
+
+private:
+    const float max_translation;
+    const float max_rotation;
+    const uint max_gap;
+
+    bool is_far(const Eigen::Matrix4f& relative_transformation) const;
+};
+
+#endif // KEYFRAMESELECTOR_H
@@ -4,10 +4,13 @@
 #include <boost/iterator/counting_iterator.hpp>
 
 #include "core/registration/icpregistration.h"
+#include "core/registration/keyframeselector.h"
 #include "core/registration/linearregistration.hpp"
 #include "core/registration/registrationalgorithm.hpp"
 #include "core/registration/sacregistration.h"
+#include "core/registration/turntableregistration.h"
 #include "io/pcdinputiterator.hpp"
+#include "utility/pipeline.h"
 
 class LinearBasedRegistration : public RegistrationAlgorithm {
 public:
@@ -30,7 +33,7 @@ public:
 
     LinearBasedRegistration(QObject* parent, QSettings* parent_settings)
         : RegistrationAlgorithm(parent, parent_settings)
-        , loop_size(settings->value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_WITH_LOOPS_STEP").toInt())
+        , loop_size(project.value("ALGORITHM_SETTINGS/LINEAR_RECONSTRUCTION_WITH_LOOPS_STEP").toInt())
     {
     }
 
@@ -47,7 +50,7 @@ private:
         }
 
         Frames frames;
-        for (Iter it(settings, read_from, read_to, read_loop_size); it != Iter(); ++it) {
+        for (Iter it(project, read_from, read_to, read_loop_size); it != Iter(); ++it) {
             frames.push_back(*it);
         }
 
@@ -66,7 +69,8 @@ private:
             if (i > 0) {
                 loops[i].first_edge_transformation = loops[i - 1].inner_transformations.back();
             }
-            loops[i] = process_one_loop(loops[i]);
+            loops[i] = checkpointed_loop(loops[i], nullptr, i,
+                [this](const Loop& loop, TicketGate*, const size_t&) { return process_one_loop(loop); });
         }
 
         loops_data_vizualization(loops);
@@ -81,13 +85,20 @@ private:
         }
 
         volumeReconstruction->prepareVolume();
+
+        if (!pcdVizualizer) {
+            volumeReconstruction->calculateMesh();
+            return;
+        }
+
         pcdVizualizer->redraw();
 
-        if (settings->value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
-            pcdVizualizer->visualizeCameraPoses(result_t);
+        if (project.value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
+            //The poses are drawn loop by loop as the loops finish
+            pcdVizualizer->plotCameraPoses(result_t);
         }
 
-        if (settings->value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
+        if (project.value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
             pcl::PolygonMesh mesh;
             volumeReconstruction->calculateMesh();
             volumeReconstruction->getPoligonMesh(mesh);
@@ -97,28 +108,72 @@ private:
 
     Loop process_one_loop(const Loop& loop)
     {
+        //Keyframes are selected over the whole loop and absolute poses chain every pair, both need the staged path
+        if (configs.value("STAGE_PIPELINE_SETTINGS/ENABLE").toBool()
+            && configs.value("REGISTRATION_SETTINGS/RELATIVE_POSES").toBool()
+            && !configs.value("KEYFRAME_SETTINGS/ENABLE").toBool()
+            && !configs.value("TURNTABLE_SETTINGS/ENABLE").toBool()) {
+            return process_one_loop_streamed(loop);
+        }
+
         Loop result_loop(loop);
 
         Frames inner_frames(1, result_loop.edge_frames.first);
         Frames transformed_inner_frames;
 
-        Iter it(settings, result_loop.inner_indexes.front(), result_loop.inner_indexes.back(), read_step);
+        Iter it(project, result_loop.inner_indexes.front(), result_loop.inner_indexes.back(), read_step);
         for (it; it != Iter(); ++it) {
             inner_frames.push_back(*it);
         }
         inner_frames.push_back(result_loop.edge_frames.second);
 
+        result_loop.inner_frame_indexes.clear();
+        for (const Frame& frame : inner_frames) {
+            result_loop.inner_frame_indexes.push_back(frame.frameIndex);
+        }
+
+        //Only keyframes are registered and integrated, the other frames keep their pose against a keyframe
+        const bool use_keyframes = configs.value("KEYFRAME_SETTINGS/ENABLE").toBool();
+        KeyframeSelection selection;
+        if (use_keyframes) {
+            KeyframeSelector selector(this, settings);
+            selection = selector.select(inner_frames);
+            inner_frames = selection.keyframesOf(inner_frames);
+        }
+
         PcdFilters filters(this, settings);
-        filters.setInput(inner_frames);
+        filters.setInput(std::move(inner_frames));
         filters.filter(inner_frames);
 
-        LinearRegistration<SaCRegistration> linear_sac(this, settings);
-        linear_sac.setInput(inner_frames, result_loop.first_edge_transformation);
-        const Matrix4fVector sac_t = linear_sac.align(transformed_inner_frames);
+        //A turntable rotation stands in for SaC and, without TURNTABLE_SETTINGS/ICP, for ICP as well
+        const bool turntable = configs.value("TURNTABLE_SETTINGS/ENABLE").toBool();
+        Matrix4fVector sac_t;
+        KeypointsFrames sac_keypoints;
+        std::vector<float> sac_fitness_scores;
+        if (turntable) {
+            LinearRegistration<TurntableRegistration> linear_turntable(this, settings);
+            linear_turntable.setInput(inner_frames, result_loop.first_edge_transformation);
+            sac_t = linear_turntable.align(transformed_inner_frames);
+            sac_keypoints = linear_turntable.getTransformedKeypoints();
+            sac_fitness_scores = linear_turntable.getFitnessScores();
+        } else {
+            LinearRegistration<SaCRegistration> linear_sac(this, settings);
+            linear_sac.setInput(inner_frames, result_loop.first_edge_transformation);
+            sac_t = linear_sac.align(transformed_inner_frames);
+            sac_keypoints = linear_sac.getTransformedKeypoints();
+        }
+
+        if (turntable && !configs.value("TURNTABLE_SETTINGS/ICP").toBool()) {
+            vizualization(inner_frames, transformed_inner_frames, sac_keypoints, sac_t);
+            result_loop.inner_transformations = use_keyframes ? selection.compose(sac_t) : sac_t;
+            result_loop.inner_t_fitness_scores
+                = use_keyframes ? selection.expandPairScores(sac_fitness_scores) : sac_fitness_scores;
+            return result_loop;
+        }
 
         LinearRegistration<ICPRegistration> linear_icp(this, settings);
         linear_icp.setInput(transformed_inner_frames, Eigen::Matrix4f(Eigen::Matrix4f::Identity()));
-        linear_icp.setKeypoints(linear_sac.getTransformedKeypoints());
+        linear_icp.setKeypoints(sac_keypoints);
         const Matrix4fVector icp_t = linear_icp.align(transformed_inner_frames);
 
         Matrix4fVector result_t;
@@ -127,11 +182,199 @@ private:
         }
         vizualization(inner_frames, transformed_inner_frames, linear_icp.getTransformedKeypoints(), result_t);
 
+        result_loop.inner_transformations = use_keyframes ? selection.compose(result_t) : result_t;
+        result_loop.inner_t_fitness_scores = use_keyframes
+            ? selection.expandPairScores(linear_icp.getFitnessScores())
+            : linear_icp.getFitnessScores();
+
+        return result_loop;
+    }
+
+    /** \brief A pair of consecutive frames on its way through the stages of process_one_loop_streamed. */
+    struct StreamedPair {
+        //Place of the pair in the loop, for the keypoint budget of the loop
+        size_t index;
+        Frame first;
+        Frame second;
+        KeypointsFrame keypoints;
+        //SaC poses of the frames and the pair's transformation of the last registration stage
+        FramePose first_pose;
+        FramePose second_pose;
+        FramePose transformation;
+        float fitness_score;
+        Frame transformed_first;
+        Frame transformed_second;
+    };
+
+    /** \brief process_one_loop with the frames flowing through concurrent stages connected by bounded queues,
+      * configs.ini STAGE_PIPELINE_SETTINGS: load, filter, pair, keypoints, SaC, SaC poses, ICP and integrate.
+      * Every pair is registered from identity as with RELATIVE_POSES, so the results match the staged path,
+      * and every frame is integrated as soon as its pose is known instead of once the whole loop is done.
+      */
+    Loop process_one_loop_streamed(const Loop& loop)
+    {
+        Loop result_loop(loop);
+
+        const size_t queue_size = configs.value("STAGE_PIPELINE_SETTINGS/QUEUE_SIZE").toUInt();
+        const size_t filter_threads = configs.value("STAGE_PIPELINE_SETTINGS/FILTER_THREADS").toUInt();
+        const size_t keypoints_threads = configs.value("STAGE_PIPELINE_SETTINGS/KEYPOINTS_THREADS").toUInt();
+        const size_t registration_threads = configs.value("STAGE_PIPELINE_SETTINGS/REGISTRATION_THREADS").toUInt();
+
+        LinearRegistration<SaCRegistration> linear_sac(this, settings);
+        LinearRegistration<ICPRegistration> linear_icp(this, settings);
+
+        pipeline::Graph graph;
+        auto loaded = graph.queue<Frame>(queue_size);
+        auto filtered = graph.queue<Frame>(queue_size);
+        auto pairs = graph.queue<StreamedPair>(queue_size);
+        auto keypoints = graph.queue<StreamedPair>(queue_size);
+        auto sac_pairs = graph.queue<StreamedPair>(queue_size);
+        auto icp_input = graph.queue<StreamedPair>(queue_size);
+        auto icp_pairs = graph.queue<StreamedPair>(queue_size);
+
+        graph.source<Frame>("load", loaded, [&](pipeline::Emitter<Frame>& emit) {
+            if (!emit(result_loop.edge_frames.first)) {
+                return;
+            }
+            for (Iter it(project, result_loop.inner_indexes.front(), result_loop.inner_indexes.back(),
+                     read_step);
+                 it != Iter(); ++it) {
+                if (!emit(*it)) {
+                    return;
+                }
+            }
+            emit(result_loop.edge_frames.second);
+        });
+
+        graph.stage<Frame, Frame>("filter", filter_threads, loaded, filtered, [&](Frame& frame) {
+            PcdFilters filters(this, settings);
+            Frames frames(1, frame);
+            filters.setInput(std::move(frames));
+            filters.filter(frames);
+            return frames.front();
+        });
+
+        Frame previous_frame;
+        bool has_previous_frame = false;
+        size_t pairs_count = 0;
+        graph.serial<Frame, StreamedPair>("pair", filtered, pairs,
+            [&](Frame& frame, pipeline::Emitter<StreamedPair>& emit) {
+                if (has_previous_frame) {
+                    StreamedPair pair;
+                    pair.index = pairs_count++;
+                    pair.first = previous_frame;
+                    pair.second = frame;
+                    emit(std::move(pair));
+                }
+                previous_frame = frame;
+                has_previous_frame = true;
+            });
+
+        graph.stage<StreamedPair, StreamedPair>("keypoints", keypoints_threads, pairs, keypoints,
+            [&](StreamedPair& pair) {
+                pair.keypoints = linear_sac.pairKeypoints(pair.first, pair.second, pair.index);
+                return pair;
+            });
+
+        graph.stage<StreamedPair, StreamedPair>("sac", registration_threads, keypoints, sac_pairs,
+            [&](StreamedPair& pair) {
+                pair.transformation = linear_sac.registerPair(pair.keypoints, pair.first, pair.second, pair.fitness_score);
+                return pair;
+            });
+
+        //Absolute SaC poses are the prefix products of the relative ones
+        Eigen::Matrix4f sac_pose = result_loop.first_edge_transformation;
+        graph.serial<StreamedPair, StreamedPair>("sac_poses", sac_pairs, icp_input,
+            [&](StreamedPair& pair, pipeline::Emitter<StreamedPair>& emit) {
+                pair.first_pose = sac_pose;
+                sac_pose = sac_pose * Eigen::Matrix4f(pair.transformation);
+                pair.second_pose = sac_pose;
+                pair.transformed_first = pair.first.transform(pair.first_pose);
+                pair.transformed_second = pair.second.transform(pair.second_pose);
+                pair.keypoints.transformFirstInPlace(pair.first_pose);
+                pair.keypoints.transformSecondInPlace(pair.second_pose);
+                emit(std::move(pair));
+            });
+
+        graph.stage<StreamedPair, StreamedPair>("icp", registration_threads, icp_input, icp_pairs,
+            [&](StreamedPair& pair) {
+                pair.transformation = linear_icp.registerPair(
+                    pair.keypoints, pair.transformed_first, pair.transformed_second, pair.fitness_score);
+                return pair;
+            });
+
+        Matrix4fVector result_t;
+        std::vector<float> fitness_scores;
+        std::vector<int> frame_indexes;
+        Eigen::Matrix4f icp_pose = Eigen::Matrix4f::Identity();
+        graph.sink<StreamedPair>("integrate", icp_pairs, [&](StreamedPair& pair) {
+            const Eigen::Matrix4f first_icp_pose = icp_pose;
+            icp_pose = icp_pose * Eigen::Matrix4f(pair.transformation);
+
+            if (result_t.empty()) {
+                result_t.push_back(first_icp_pose * Eigen::Matrix4f(pair.first_pose));
+                frame_indexes.push_back(pair.first.frameIndex);
+
+                Frames src_frames(1, pair.first);
+                vizualization(src_frames, Frames(1, pair.transformed_first.transform(first_icp_pose)),
+                    KeypointsFrames(), Matrix4fVector(1, result_t.back()));
+            }
+            result_t.push_back(icp_pose * Eigen::Matrix4f(pair.second_pose));
+            fitness_scores.push_back(pair.fitness_score);
+            frame_indexes.push_back(pair.second.frameIndex);
+
+            Frames src_frames(1, pair.second);
+            vizualization(src_frames, Frames(1, pair.transformed_second.transform(icp_pose)),
+                KeypointsFrames(1, pair.keypoints.transformFirst(first_icp_pose).transformSecond(icp_pose)),
+                Matrix4fVector(1, result_t.back()));
+        });
+
+        graph.run();
+
+        result_loop.inner_frame_indexes = frame_indexes;
         result_loop.inner_transformations = result_t;
-        result_loop.inner_t_fitness_scores = linear_icp.getFitnessScores();
+        result_loop.inner_t_fitness_scores = fitness_scores;
 
         return result_loop;
     }
+
+    std::vector<const RegistrationAlgorithm::Loop*> result_loops() const
+    {
+        std::vector<const RegistrationAlgorithm::Loop*> result;
+        for (const Loop& loop : loops) {
+            result.push_back(&loop);
+        }
+
+        return result;
+    }
+
+    std::vector<reconstruction_checkpoint::LoopRecord> prepared_loops() const
+    {
+        std::vector<reconstruction_checkpoint::LoopRecord> records(loops.size());
+        for (uint i = 0; i < loops.size(); ++i) {
+            records[i].indexes = { loops[i].inner_indexes.front(), loops[i].inner_indexes.back() };
+        }
+
+        return records;
+    }
+
+    /** \brief Preparing only reads the edge frames, so the loops are prepared again and checked against the records. */
+    bool restore_prepared_loops(const std::vector<reconstruction_checkpoint::LoopRecord>& records)
+    {
+        prepare_all_loops();
+
+        bool matches = loops.size() == records.size();
+        for (uint i = 0; matches && i < loops.size(); ++i) {
+            matches = records[i].indexes.size() == 2
+                && records[i].indexes[0] == loops[i].inner_indexes.front()
+                && records[i].indexes[1] == loops[i].inner_indexes.back();
+        }
+        if (!matches) {
+            loops.clear();
+        }
+
+        return matches;
+    }
 };
 
 #endif //LINEAR_BASED_REGISTRATION_HPP
@@ -1,6 +1,7 @@
 #ifndef LINEAR_REGISTRATION_H
 #define LINEAR_REGISTRATION_H
 
+#include "core/registration/motionmodel.h"
 #include "core/registration/registration.hpp"
 
 template <typename RegistrationMethod>
@@ -13,49 +14,111 @@ public:
     {
     }
 
-    void setInput(const Frames& input_frames, const Eigen::Matrix4f& input_initital_transformation)
+    void setInput(Frames input_frames, const Eigen::Matrix4f& input_initital_transformation)
     {
         if (input_initital_transformation.hasNaN()) {
             throw std::invalid_argument(
                 "LinearRegistration::setInput input_initital_transformation.hasNaN()");
         }
 
-        frames = input_frames;
+        frames = std::move(input_frames);
         initial_transformation = input_initital_transformation;
         fitness_scores.clear();
     }
 
+    /** \brief Transformation of one pair from identity for a pipeline stage worker, as with RELATIVE_POSES. */
+    Eigen::Matrix4f registerPair(const KeypointsFrame& keypoint_frame, const Frame& first_frame,
+        const Frame& second_frame, float& fitness_score)
+    {
+        return register_keypoint_pair<RegistrationMethod>(keypoint_frame, first_frame, second_frame,
+            Eigen::Matrix4f::Identity(), fitness_score);
+    }
+
+    /** \brief Relative transformations of keypoints_frames[i] between frames i and i + 1 from
+      * initial_transformations[i], spread over the thread pool with a registrator per worker.
+      */
+    Matrix4fVector alignBatch(const KeypointsFrames& keypoints_frames, const Matrix4fVector& initial_transformations)
+    {
+        if (keypoints_frames.size() >= frames.size() && !keypoints_frames.empty()) {
+            throw std::invalid_argument("LinearRegistration::alignBatch keypoints_frames.size() >= frames.size()");
+        }
+
+        std::vector<std::pair<unsigned int, unsigned int> > pairs;
+        for (unsigned int i = 0; i < keypoints_frames.size(); ++i) {
+            pairs.push_back(std::make_pair(i, i + 1));
+        }
+
+        std::vector<float> batch_fitness_scores;
+        const Matrix4fVector result = align_batch<RegistrationMethod>(
+            keypoints_frames, initial_transformations, pairs, batch_fitness_scores);
+        fitness_scores = batch_fitness_scores;
+        return result;
+    }
+
 protected:
     void calculate_all_keypoint_pairs()
     {
+        std::vector<std::pair<unsigned int, unsigned int> > pairs;
         for (unsigned int i = 1; i < frames.size(); ++i) {
-            keypoints.push_back(calculate_one_keypoint_pair(frames[i - 1], frames[i]));
+            pairs.push_back(std::make_pair(i - 1, i));
         }
-    }
 
-    Eigen::Matrix4f calculate_one_keypoint_pair_registration(
-        const KeypointsFrame& keypoint_frame, const Eigen::Matrix4f& initial_transformation)
-    {
-        RegistrationMethod registrator(this, settings);
-        registrator.setInput(keypoint_frame, initial_transformation);
-        const Eigen::Matrix4f result_t = registrator.align();
-        fitness_scores.push_back(registrator.getFitnessScore());
-        return result_t;
+        keypoints = calculate_keypoint_pairs(pairs);
     }
 
     void calculate_all_keypoint_pairs_registration()
     {
+        if (configs.value("REGISTRATION_SETTINGS/RELATIVE_POSES").toBool()) {
+            calculate_all_relative_keypoint_pairs_registration();
+            return;
+        }
+
         transformed_keypoints.clear();
         transformations.clear();
         transformations.push_back(initial_transformation);
 
+        const bool use_motion_prior = configs.value("REGISTRATION_SETTINGS/MOTION_PRIOR").toBool();
+        MotionModel motion_model(configs.value("REGISTRATION_SETTINGS/MOTION_PRIOR_HISTORY").toUInt());
+        motion_model.add(transformations.back());
+
+        //Every pair depends on the previous pose, one registrator serves the whole chain
+        RegistrationMethod registrator(this, settings);
         for (unsigned int i = 0; i < keypoints.size(); ++i) {
             transformed_keypoints.push_back(keypoints[i].transformFirst(transformations.back()));
 
-            transformations.push_back(
-                calculate_one_keypoint_pair_registration(keypoints[i], transformations.back()));
+            Eigen::Matrix4f prediction;
+            const bool has_prediction = use_motion_prior && motion_model.predict(prediction);
+
+            float fitness_score = 0;
+            transformations.push_back(register_keypoint_pair<RegistrationMethod>(
+                keypoints[i], frames[i], frames[i + 1], transformations.back(), fitness_score,
+                has_prediction ? &prediction : nullptr, &registrator));
+            fitness_scores.push_back(fitness_score);
+            motion_model.add(transformations.back());
+
+            transformed_keypoints.back().transformSecondInPlace(transformations.back());
+        }
+    }
 
-            transformed_keypoints.back() = transformed_keypoints.back().transformSecond(transformations.back());
+    /** \brief Registers every pair from identity as one batch, then absolute poses are the prefix products
+      * of the relative ones.
+      */
+    void calculate_all_relative_keypoint_pairs_registration()
+    {
+        const Matrix4fVector relative_transformations = alignBatch(
+            keypoints, Matrix4fVector(keypoints.size(), Eigen::Matrix4f::Identity()));
+        const std::vector<float> relative_fitness_scores = fitness_scores;
+        fitness_scores.clear();
+
+        transformed_keypoints.clear();
+        transformations.clear();
+        transformations.push_back(initial_transformation);
+
+        for (unsigned int i = 0; i < keypoints.size(); ++i) {
+            transformed_keypoints.push_back(keypoints[i].transformFirst(transformations.back()));
+            transformations.push_back(transformations.back() * relative_transformations[i]);
+            transformed_keypoints.back().transformSecondInPlace(transformations.back());
+            fitness_scores.push_back(relative_fitness_scores[i]);
         }
     }
 };
@@ -35,7 +35,7 @@ public:
 
     MiddleBasedRegistration(QObject* parent, QSettings* parent_settings)
         : RegistrationAlgorithm(parent, parent_settings)
-        , loop_size(settings->value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION_STEP").toInt())
+        , loop_size(project.value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION_STEP").toInt())
     {
     }
 
@@ -52,17 +52,17 @@ private:
         Frames middle_frames;
         Frames transformed_middle_frames;
 
-        if (!settings->value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION_EDGE_BALANCING").toBool()) {
+        if (!project.value("ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION_EDGE_BALANCING").toBool()) {
             for (uint i = read_from + read_loop_size; i <= read_to; i += read_loop_size) {
                 loops.push_back(Loop(i - read_loop_size, i - 1, (i - read_loop_size / 2) / read_step));
             }
 
-            for (Iter it(settings, loops.front().middle_index, loops.back().middle_index, read_loop_size); it != Iter(); ++it) {
+            for (Iter it(project, loops.front().middle_index, loops.back().middle_index, read_loop_size); it != Iter(); ++it) {
                 middle_frames.push_back(*it);
             }
         } else {
-            Iter it(settings, edges_from, edges_to, read_step);
-            EdgeBalancer<CameraDistanceMetric, PcdInputIterator> eb(it, Iter(), loop_size, settings);
+            Iter it(project, edges_from, edges_to, read_step);
+            EdgeBalancer<CameraDistanceMetric, PcdInputIterator> eb(it, Iter(), loop_size, settings, this);
             std::vector<uint> edge_indices = eb.balance();
 
             for (uint edge_index = 0; it != Iter(); ++it, ++edge_index) {
@@ -100,7 +100,7 @@ private:
         }
 
         PcdFilters filters(this, settings);
-        filters.setInput(middle_frames);
+        filters.setInput(std::move(middle_frames));
         filters.filter(middle_frames);
 
         LinearRegistration<SaCRegistration> linear_sac(this, settings);
@@ -120,9 +120,12 @@ private:
 
     void process_all_loops()
     {
-        for (uint i = 0; i < loops.size(); ++i) {
-            loops[i] = process_one_loop(loops[i]);
-        }
+        const size_t lanes_count = concurrent_loops_count(
+            loops.size(), loop_size, "ALGORITHM_SETTINGS/MIDDLE_BASED_RECONSTRUCTION_LOOPS_MEMORY_MB");
+        process_loops(loops, lanes_count,
+            [this](const Loop& loop, TicketGate* vizualization_gate, const size_t& ticket) {
+                return process_one_loop(loop, vizualization_gate, ticket);
+            });
 
         loops_data_vizualization(loops);
     }
@@ -136,13 +139,20 @@ private:
         }
 
         volumeReconstruction->prepareVolume();
+
+        if (!pcdVizualizer) {
+            volumeReconstruction->calculateMesh();
+            return;
+        }
+
         pcdVizualizer->redraw();
 
-        if (settings->value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
-            pcdVizualizer->visualizeCameraPoses(result_t);
+        if (project.value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
+            //The poses are drawn loop by loop as the loops finish
+            pcdVizualizer->plotCameraPoses(result_t);
         }
 
-        if (settings->value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
+        if (project.value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
             pcl::PolygonMesh mesh;
             volumeReconstruction->calculateMesh();
             volumeReconstruction->getPoligonMesh(mesh);
@@ -150,15 +160,20 @@ private:
         }
     }
 
-    Loop process_one_loop(const Loop& loop)
+    Loop process_one_loop(const Loop& loop, TicketGate* vizualization_gate, const size_t& ticket)
     {
         Frames inner_frames;
-        for (Iter it(settings, loop.inner_range.first, loop.inner_range.second, read_step); it != Iter(); ++it) {
+        for (Iter it(project, loop.inner_range.first, loop.inner_range.second, read_step); it != Iter(); ++it) {
             inner_frames.push_back(*it);
         }
 
+        Loop result_loop(loop);
+        for (const Frame& frame : inner_frames) {
+            result_loop.inner_frame_indexes.push_back(frame.frameIndex);
+        }
+
         PcdFilters filters(this, settings);
-        filters.setInput(inner_frames);
+        filters.setInput(std::move(inner_frames));
         filters.filter(inner_frames);
 
         Frames transformed_inner_frames;
@@ -176,14 +191,62 @@ private:
             result_t.push_back(icp_t[i] * sac_t[i]);
         }
 
-        vizualization(inner_frames, transformed_inner_frames, parallel_icp.getTransformedKeypoints(), result_t);
+        if (!integrate_loop_submap(ticket, inner_frames, result_t)) {
+            gated_vizualization(
+                vizualization_gate, ticket,
+                inner_frames, transformed_inner_frames, parallel_icp.getTransformedKeypoints(), result_t);
+        } else if (vizualization_gate) {
+            //Later loops replayed from the checkpoint wait for this ticket
+            vizualization_gate->pass(ticket);
+        }
 
-        Loop result_loop(loop);
         result_loop.inner_transformations = result_t;
         result_loop.inner_t_fitness_scores = parallel_icp.getFitnessScores();
 
         return result_loop;
     }
+
+    std::vector<const RegistrationAlgorithm::Loop*> result_loops() const
+    {
+        std::vector<const RegistrationAlgorithm::Loop*> result;
+        for (const Loop& loop : loops) {
+            result.push_back(&loop);
+        }
+
+        return result;
+    }
+
+    std::vector<reconstruction_checkpoint::LoopRecord> prepared_loops() const
+    {
+        std::vector<reconstruction_checkpoint::LoopRecord> records(loops.size());
+        for (uint i = 0; i < loops.size(); ++i) {
+            records[i].indexes = { loops[i].inner_range.first, loops[i].inner_range.second, loops[i].middle_index };
+            records[i].transformations.push_back(loops[i].middle_transformation);
+        }
+
+        return records;
+    }
+
+    /** \brief The middle frames are only needed for registering them, so they are not read again. */
+    bool restore_prepared_loops(const std::vector<reconstruction_checkpoint::LoopRecord>& records)
+    {
+        Loops restored_loops;
+        for (const auto& record : records) {
+            if (record.indexes.size() != 3 || record.transformations.size() != 1) {
+                return false;
+            }
+
+            Loop loop(record.indexes[0], record.indexes[1], record.indexes[2]);
+            loop.middle_transformation = record.transformations[0];
+            restored_loops.push_back(loop);
+        }
+        if (restored_loops.empty()) {
+            return false;
+        }
+
+        loops = std::move(restored_loops);
+        return true;
+    }
 };
 
 #endif //MIDDLE_BASED_REGISTRATION_HPP
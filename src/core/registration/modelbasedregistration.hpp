@@ -0,0 +1,282 @@
+#ifndef MODEL_BASED_REGISTRATION_HPP
+#define MODEL_BASED_REGISTRATION_HPP
+
+#include "core/registration/denseicpregistration.h"
+#include "core/registration/densepyramid.h"
+#include "core/registration/motionmodel.h"
+#include "core/registration/registrationalgorithm.hpp"
+#include "io/pcdinputiterator.hpp"
+#include "utility/log.h"
+
+/** \brief Frame to model tracking. Every frame is aligned with dense ICP to the voxel hash volume
+  * raycast from its predicted pose, then integrated, so the frames are registered against everything
+  * seen so far instead of being chained pair by pair. When the model gives too few points or the
+  * alignment fails the frame is aligned to the previous frame instead. Needs the VOXEL_HASH backend.
+  */
+class ModelBasedRegistration : public RegistrationAlgorithm {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    struct Loop : RegistrationAlgorithm::Loop {
+        Loop(const uint& from, const uint& to)
+        {
+            inner_indexes = { from, to };
+        }
+    };
+    typedef std::vector<Loop, Eigen::aligned_allocator<Loop> > Loops;
+
+    ModelBasedRegistration(QObject* parent, QSettings* parent_settings)
+        : RegistrationAlgorithm(parent, parent_settings)
+        , loop_size(std::max(2, project.value("ALGORITHM_SETTINGS/MODEL_BASED_RECONSTRUCTION_STEP").toInt()))
+        , raycast_max_depth(configs.value("MODEL_TRACKING_SETTINGS/RAYCAST_MAX_DEPTH").toFloat())
+        , min_model_points(configs.value("MODEL_TRACKING_SETTINGS/MIN_MODEL_POINTS").toUInt())
+        , last_pose(Eigen::Matrix4f::Identity())
+        , has_pose(false)
+        , motion_model(configs.value("REGISTRATION_SETTINGS/MOTION_PRIOR_HISTORY").toUInt())
+        , fallback_count(0)
+        , lost_count(0)
+    {
+    }
+
+private:
+    const int loop_size;
+    const float raycast_max_depth;
+    const size_t min_model_points;
+    Loops loops;
+
+    //Tracking state carried from loop to loop
+    Eigen::Matrix4f last_pose;
+    bool has_pose;
+    Frame previous_frame;
+    MotionModel motion_model;
+    size_t fallback_count;
+    size_t lost_count;
+
+    /** \brief Consecutive ranges of loop_size frames, the last one takes the remaining frames. */
+    void prepare_all_loops()
+    {
+        const uint read_loop_size = loop_size * read_step;
+        for (uint i = read_from; i + read_step <= uint(read_to); i += read_loop_size) {
+            loops.push_back(Loop(i, std::min(i + read_loop_size - 1, uint(read_to))));
+        }
+    }
+
+    void process_all_loops()
+    {
+        if (!project.value("VISUALIZATION/CPU_TSDF").toBool()) {
+            throw std::runtime_error("ModelBasedRegistration::process_all_loops the model needs VISUALIZATION/CPU_TSDF");
+        }
+        if (!volumeReconstruction || !volumeReconstruction->canRenderModel()) {
+            throw std::runtime_error("ModelBasedRegistration::process_all_loops the model needs CPU_TSDF_SETTINGS/BACKEND=VOXEL_HASH");
+        }
+
+        for (uint i = 0; i < loops.size(); ++i) {
+            loops[i] = checkpointed_loop(loops[i], nullptr, i,
+                [this](const Loop& loop, TicketGate*, const size_t&) { return process_one_loop(loop); });
+        }
+        LOG_INFO("registration") << "Model tracking:" << fallback_count << "frames aligned to the previous frame,"
+                                 << lost_count << "frames kept at the predicted pose";
+
+        loops_data_vizualization(loops);
+    }
+
+    void perform_tsdf_meshing()
+    {
+        Matrix4fVector result_t;
+        for (uint i = 0; i < loops.size(); ++i) {
+            std::copy(loops[i].inner_transformations.begin(), loops[i].inner_transformations.end(),
+                std::back_inserter(result_t));
+        }
+
+        volumeReconstruction->prepareVolume();
+
+        if (!pcdVizualizer) {
+            volumeReconstruction->calculateMesh();
+            return;
+        }
+
+        pcdVizualizer->redraw();
+
+        if (project.value("VISUALIZATION/DRAW_ALL_CAMERA_POSES").toBool()) {
+            //The poses are drawn loop by loop as the loops finish
+            pcdVizualizer->plotCameraPoses(result_t);
+        }
+
+        if (project.value("VISUALIZATION/CPU_TSDF_DRAW_MESH").toBool()) {
+            pcl::PolygonMesh mesh;
+            volumeReconstruction->calculateMesh();
+            volumeReconstruction->getPoligonMesh(mesh);
+            pcdVizualizer->visualizeMesh(mesh);
+        }
+    }
+
+    /** \brief Every frame is integrated right after it is tracked, the next one is tracked against it. */
+    Loop process_one_loop(const Loop& loop)
+    {
+        Loop result_loop(loop);
+
+        Frames frames;
+        for (Iter it(project, loop.inner_indexes.front(), loop.inner_indexes.back(), read_step); it != Iter(); ++it) {
+            frames.push_back(*it);
+        }
+
+        PcdFilters filters(this, settings);
+        filters.setInput(std::move(frames));
+        filters.filter(frames);
+        PcdFilters::reorganize_all_frames(frames);
+
+        result_loop.inner_frame_indexes.clear();
+        result_loop.inner_transformations.clear();
+        result_loop.inner_t_fitness_scores.clear();
+        for (const Frame& frame : frames) {
+            float fitness_score = 0;
+            const Eigen::Matrix4f pose = track(frame, fitness_score);
+            volumeReconstruction->addPointCloud(frame.pointCloudPtr, pose);
+
+            result_loop.inner_frame_indexes.push_back(frame.frameIndex);
+            result_loop.inner_transformations.push_back(pose);
+            result_loop.inner_t_fitness_scores.push_back(fitness_score);
+        }
+
+        pcl::PolygonMesh mesh;
+        if (pcdVizualizer && volumeReconstruction->takePreviewMesh(mesh)) {
+            pcdVizualizer->visualizePreviewMesh(mesh);
+        }
+
+        return result_loop;
+    }
+
+    /** \brief The first frame is the world origin. */
+    Eigen::Matrix4f track(const Frame& frame, float& fitness_score)
+    {
+        Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+        if (has_pose) {
+            Eigen::Matrix4f predicted = last_pose;
+            if (configs.value("REGISTRATION_SETTINGS/MOTION_PRIOR").toBool()) {
+                motion_model.predict(predicted);
+            }
+
+            if (!align_to_model(frame, predicted, pose, fitness_score)) {
+                ++fallback_count;
+                if (!align_to_previous_frame(frame, predicted, pose, fitness_score)) {
+                    ++lost_count;
+                    pose = predicted;
+                    LOG_WARNING("registration") << "Model tracking: frame" << frame.frameIndex << "kept at the predicted pose";
+                }
+            }
+        }
+
+        last_pose = pose;
+        has_pose = true;
+        previous_frame = frame.transform(pose);
+        motion_model.add(pose);
+
+        return pose;
+    }
+
+    bool align_to_model(const Frame& frame, const Eigen::Matrix4f& predicted, Eigen::Matrix4f& pose, float& fitness_score)
+    {
+        const auto pyramid = DensePyramid::ofFrame(frame, 1);
+        if (!pyramid) {
+            return false;
+        }
+
+        //The model is rendered with the frame's own camera model, pixel for pixel
+        DensePyramid::Level model;
+        model.width = pyramid->level(0).width;
+        model.height = pyramid->level(0).height;
+        model.intrinsics = pyramid->level(0).intrinsics;
+        if (!volumeReconstruction->renderModel(model.intrinsics, predicted, raycast_max_depth, model.points, model.normals)) {
+            return false;
+        }
+
+        size_t model_points = 0;
+        for (size_t i = 0; i < model.points.size(); ++i) {
+            model_points += model.hasNormal(i) ? 1 : 0;
+        }
+        if (model_points < min_model_points) {
+            return false;
+        }
+
+        DenseICPRegistration dense_icp(this, settings);
+        dense_icp.setInput(KeypointsFrame(), Eigen::Matrix4f::Identity());
+        dense_icp.setModel(std::move(model), predicted);
+        dense_icp.setFrames(Frame(), frame.transform(predicted));
+        const Eigen::Matrix4f correction = dense_icp.align();
+        if (!dense_icp.isAligned()) {
+            return false;
+        }
+
+        pose = correction * predicted;
+        fitness_score = dense_icp.getFitnessScore();
+        return true;
+    }
+
+    bool align_to_previous_frame(const Frame& frame, const Eigen::Matrix4f& predicted, Eigen::Matrix4f& pose,
+        float& fitness_score)
+    {
+        if (previous_frame.pointCloudPtr->empty()) {
+            return false;
+        }
+
+        DenseICPRegistration dense_icp(this, settings);
+        dense_icp.setInput(KeypointsFrame(), Eigen::Matrix4f::Identity());
+        dense_icp.setFrames(previous_frame, frame.transform(predicted));
+        const Eigen::Matrix4f correction = dense_icp.align();
+        if (!dense_icp.isAligned()) {
+            return false;
+        }
+
+        pose = correction * predicted;
+        fitness_score = dense_icp.getFitnessScore();
+        return true;
+    }
+
+    /** \brief A replayed loop continues the tracking from its stored poses, its frames are not kept. */
+    void replayed_loop(RegistrationAlgorithm::Loop& loop)
+    {
+        for (const Eigen::Matrix4f& pose : loop.inner_transformations) {
+            last_pose = pose;
+            has_pose = true;
+            motion_model.add(pose);
+        }
+        previous_frame = Frame();
+    }
+
+    std::vector<const RegistrationAlgorithm::Loop*> result_loops() const
+    {
+        std::vector<const RegistrationAlgorithm::Loop*> result;
+        for (const Loop& loop : loops) {
+            result.push_back(&loop);
+        }
+
+        return result;
+    }
+
+    std::vector<reconstruction_checkpoint::LoopRecord> prepared_loops() const
+    {
+        std::vector<reconstruction_checkpoint::LoopRecord> records(loops.size());
+        for (uint i = 0; i < loops.size(); ++i) {
+            records[i].indexes = loops[i].inner_indexes;
+        }
+
+        return records;
+    }
+
+    bool restore_prepared_loops(const std::vector<reconstruction_checkpoint::LoopRecord>& records)
+    {
+        prepare_all_loops();
+
+        bool matches = loops.size() == records.size();
+        for (uint i = 0; matches && i < loops.size(); ++i) {
+            matches = records[i].indexes == loops[i].inner_indexes;
+        }
+        if (!matches) {
+            loops.clear();
+        }
+
+        return matches;
+    }
+};
+
+#endif //MODEL_BASED_REGISTRATION_HPP
@@ -0,0 +1,30 @@
+#ifndef MOTIONMODEL_H
+#define MOTIONMODEL_H
+
+#include <Eigen/Core>
+
+#include <deque>
+
+/** \brief Constant velocity prediction of the next absolute pose of a chain of poses.
+  * The velocity is the mean of the last history_size relative transforms T_(i-1)^-1 * T_i,
+  * with rotations averaged as quaternions, so that a single bad pair is smoothed out.
+  */
+class MotionModel {
+public:
+    explicit MotionModel(const size_t& history_size);
+
+    void add(const Eigen::Matrix4f& pose);
+
+    /** \brief Returns false until two poses were added. */
+    bool predict(Eigen::Matrix4f& next_pose) const;
+
+    void clear();
+
+private:
+    const size_t history_size;
+    Eigen::Matrix4f last_pose;
+    bool has_pose;
+    std::deque<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > relatives;
+};
+
+#endif // MOTIONMODEL_H
@@ -0,0 +1,90 @@
+#ifndef PAIR_REGISTRATION_CACHE_H
+#define PAIR_REGISTRATION_CACHE_H
+
+#include <Eigen/Core>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+/** \brief Results of registering one frame pair from an initial transformation, keyed by the two
+  * frame indexes and the exact bits of the initial transformation, so a hit returns what the
+  * registration itself would have returned.
+  */
+class PairRegistrationCache {
+public:
+    typedef Eigen::Matrix<float, 4, 4, Eigen::DontAlign> Transformation;
+    typedef std::pair<Transformation, Transformation> Result;
+
+    PairRegistrationCache()
+        : hits(0)
+        , misses(0)
+    {
+    }
+
+    PairRegistrationCache(const PairRegistrationCache&) = delete;
+    PairRegistrationCache& operator=(const PairRegistrationCache&) = delete;
+
+    /** \brief Returns the cached result or stores and returns what calculate() gives. */
+    template <typename Function>
+    Result get(const unsigned int& first_index, const unsigned int& second_index,
+        const Eigen::Matrix4f& initial_transformation, const Function& calculate)
+    {
+        const Key key = make_key(first_index, second_index, initial_transformation);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto it = results.find(key);
+            if (it != results.end()) {
+                ++hits;
+                return it->second;
+            }
+            ++misses;
+        }
+
+        const Result result = calculate();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        results.insert(std::make_pair(key, result));
+        return result;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.clear();
+    }
+
+    size_t getHits()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+
+    size_t getMisses()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+
+private:
+    typedef std::tuple<unsigned int, unsigned int, std::array<uint32_t, 16> > Key;
+
+    std::mutex mutex;
+    std::map<Key, Result> results;
+    size_t hits;
+    size_t misses;
+
+    static Key make_key(const unsigned int& first_index, const unsigned int& second_index,
+        const Eigen::Matrix4f& initial_transformation)
+    {
+        std::array<uint32_t, 16> bits;
+        std::memcpy(bits.data(), initial_transformation.data(), sizeof(bits));
+        return Key(first_index, second_index, bits);
+    }
+};
+
+#endif // PAIR_REGISTRATION_CACHE_H
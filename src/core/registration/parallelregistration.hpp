@@ -14,7 +14,7 @@ public:
     }
 
     void setInput(
-        const Frames& input_frames,
+        Frames input_frames,
         const unsigned int& input_middle_frame_index,
         const Eigen::Matrix4f& input_initital_transformation)
     {
@@ -27,49 +27,66 @@ public:
                 "ParallelRegistration::setInput input_initital_transformation.hasNaN()");
         }
 
-        frames = input_frames;
+        frames = std::move(input_frames);
         middle_frame_index = input_middle_frame_index;
         initial_transformation = input_initital_transformation;
         fitness_scores.clear();
     }
 
+    /** \brief Transformations of keypoints_frames[index] between the middle frame and the index-th other frame
+      * from initial_transformations[index], spread over the thread pool with a registrator per worker.
+      */
+    Matrix4fVector alignBatch(const KeypointsFrames& keypoints_frames, const Matrix4fVector& initial_transformations)
+    {
+        if (keypoints_frames.size() >= frames.size() && !keypoints_frames.empty()) {
+            throw std::invalid_argument("ParallelRegistration::alignBatch keypoints_frames.size() >= frames.size()");
+        }
+
+        std::vector<std::pair<unsigned int, unsigned int> > pairs;
+        for (unsigned int index = 0; index < keypoints_frames.size(); ++index) {
+            pairs.push_back(std::make_pair(middle_frame_index, index < middle_frame_index ? index : index + 1));
+        }
+
+        std::vector<float> batch_fitness_scores;
+        const Matrix4fVector result = align_batch<RegistrationMethod>(
+            keypoints_frames, initial_transformations, pairs, batch_fitness_scores);
+        fitness_scores = batch_fitness_scores;
+        return result;
+    }
+
 protected:
     unsigned int middle_frame_index;
 
     void calculate_all_keypoint_pairs()
     {
+        std::vector<std::pair<unsigned int, unsigned int> > pairs;
         for (unsigned int i = 0; i < frames.size(); ++i) {
             if (i != middle_frame_index) {
-                keypoints.push_back(calculate_one_keypoint_pair(frames[middle_frame_index], frames[i]));
+                pairs.push_back(std::make_pair(middle_frame_index, i));
             }
         }
-    }
 
-    Eigen::Matrix4f calculate_one_keypoint_pair_registration(
-        const KeypointsFrame& keypoint_frame, const Eigen::Matrix4f& initial_transformation)
-    {
-        RegistrationMethod registrator(this, settings);
-        registrator.setInput(keypoint_frame, initial_transformation);
-        const Eigen::Matrix4f result_t = registrator.align();
-        fitness_scores.push_back(registrator.getFitnessScore());
-        return result_t;
+        keypoints = calculate_keypoint_pairs(pairs);
     }
 
+    /** \brief Every frame is registered against the middle one independently, so all pairs run as one batch. */
     void calculate_all_keypoint_pairs_registration()
     {
         transformed_keypoints.clear();
         transformations.clear();
         transformations.resize(frames.size(), initial_transformation);
 
-        for (unsigned int i = 0; i < frames.size(); ++i) {
-            const unsigned int index = i < middle_frame_index ? i : i - 1;
+        const Matrix4fVector pair_transformations = alignBatch(
+            keypoints, Matrix4fVector(keypoints.size(), initial_transformation));
 
-            if (i != middle_frame_index) {
-                transformed_keypoints.push_back(keypoints[index].transformFirst(initial_transformation));
-                transformations[i] = calculate_one_keypoint_pair_registration(keypoints[index], initial_transformation);
-                transformed_keypoints.back() = transformed_keypoints.back().transformSecond(transformations[i]);
-            }
-        }
+        transformed_keypoints.resize(keypoints.size());
+        ThreadPool::instance().parallel_for(0, keypoints.size(), [&](size_t index) {
+            const unsigned int i = index < middle_frame_index ? index : index + 1;
+            transformations[i] = pair_transformations[index];
+            transformed_keypoints[index] = keypoints[index]
+                                               .transformFirst(initial_transformation)
+                                               .transformSecond(transformations[i]);
+        });
     }
 };
 
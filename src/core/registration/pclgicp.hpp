@@ -21,12 +21,41 @@ public:
 
     void setInputCloud(const Pcd::Ptr& input_cloud)
     {
-        gicp_input_cloud = pcl_pointcloud2gicp_pointcloud(input_cloud);
+        gicp_input_cloud = pcl_pointcloud2gicp_pointcloud(input_cloud, gicp_epsilon);
     }
 
     void setTargetCloud(const Pcd::Ptr& target_cloud)
     {
-        gicp_target_cloud = pcl_pointcloud2gicp_pointcloud(target_cloud);
+        gicp_target_cloud = pcl_pointcloud2gicp_pointcloud(target_cloud, gicp_epsilon);
+    }
+
+    /** \brief Point sets converted once by pcl_pointcloud2gicp_pointcloud keep their kd-tree and
+      * matrices, so a cloud used by several alignments is prepared only once.
+      * A target set is not safe to align against from several threads at once.
+      */
+    void setInputCloud(const GICPPointCloudPtr& input_cloud)
+    {
+        gicp_input_cloud = input_cloud;
+    }
+
+    void setTargetCloud(const GICPPointCloudPtr& target_cloud)
+    {
+        gicp_target_cloud = target_cloud;
+    }
+
+    static GICPPointCloudPtr pcl_pointcloud2gicp_pointcloud(const Pcd::Ptr& pcl_cloud, const double& epsilon = 1e-5)
+    {
+        GICPPointCloudPtr gicp_cloud_ptr(new GICPPointCloud);
+
+        std::for_each(pcl_cloud->begin(), pcl_cloud->end(), [&](const PointType& p) {
+            gicp_cloud_ptr->AppendPoint(pclpoint2gicpoint(p));
+        });
+
+        gicp_cloud_ptr->BuildKDTree();
+        gicp_cloud_ptr->ComputeMatrices();
+        gicp_cloud_ptr->SetGICPEpsilon(epsilon);
+
+        return gicp_cloud_ptr;
     }
 
     void align()
@@ -77,7 +106,7 @@ private:
     Eigen::Matrix4f final_transformation;
     Eigen::Matrix4f base_transformation;
 
-    GICPPoint pclpoint2gicpoint(const PointType& pcl_point)
+    static GICPPoint pclpoint2gicpoint(const PointType& pcl_point)
     {
         GICPPoint gicp_point;
         gicp_point.x = pcl_point.x;
@@ -87,21 +116,6 @@ private:
         return gicp_point;
     }
 
-    GICPPointCloudPtr pcl_pointcloud2gicp_pointcloud(const Pcd::Ptr& pcl_cloud)
-    {
-        GICPPointCloudPtr gicp_cloud_ptr(new GICPPointCloud);
-
-        std::for_each(pcl_cloud->begin(), pcl_cloud->end(), [&](const PointType& p) {
-            gicp_cloud_ptr->AppendPoint(pclpoint2gicpoint(p));
-        });
-
-        gicp_cloud_ptr->BuildKDTree();
-        gicp_cloud_ptr->ComputeMatrices();
-        gicp_cloud_ptr->SetGICPEpsilon(gicp_epsilon);
-
-        return gicp_cloud_ptr;
-    }
-
     Eigen::Matrix4f gdc_mat2eigen_mat(const dgc_transform_t& gdc_mat)
     {
         Eigen::Matrix4f eigen_mat;
@@ -0,0 +1,77 @@
+#ifndef POSEGRAPH_H
+#define POSEGRAPH_H
+
+#include <Eigen/Core>
+#include <Eigen/SparseCholesky>
+
+#include <memory>
+#include <vector>
+
+/** \brief Sparse SE(3) pose graph. Vertices are absolute poses, an edge measures the relative pose
+  * T_from^-1 * T_to with a 6x6 information matrix over (translation, rotation). optimize() runs
+  * Levenberg-Marquardt from the current estimates with a sparse Cholesky solve of the normal
+  * equations, so vertices and edges may be added as loops complete and the graph solved again.
+  */
+class PoseGraph {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+    typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+    PoseGraph();
+
+    /** \brief Returns the vertex index, fixed vertices are not optimized. */
+    int addVertex(const Eigen::Matrix4f& pose, const bool& fixed = false);
+
+    void addEdge(const int& from, const int& to, const Eigen::Matrix4f& measurement, const Matrix6d& information);
+
+    /** \brief Information with separate translation and rotation weights. */
+    static Matrix6d information(const double& translation_weight, const double& rotation_weight);
+
+    /** \brief Returns the number of iterations run, stops once a step is below epsilon. */
+    int optimize(const int& max_iterations, const double& epsilon = 1e-9);
+
+    Eigen::Matrix4f getPose(const int& vertex) const;
+
+    void setPose(const int& vertex, const Eigen::Matrix4f& pose);
+
+    size_t getVerticesCount() const;
+
+    size_t getEdgesCount() const;
+
+    /** \brief Sum of the squared weighted errors of all edges. */
+    double getChi2() const;
+
+private:
+    struct Edge {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        int from;
+        int to;
+        Eigen::Matrix4d measurement_inverse;
+        Matrix6d information;
+    };
+
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > poses;
+    std::vector<bool> fixed;
+    std::vector<Edge, Eigen::aligned_allocator<Edge> > edges;
+
+    //Symbolic factorization, reused while the structure of the graph does not change
+    std::unique_ptr<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > > solver;
+    size_t solver_vertices_count;
+    size_t solver_edges_count;
+    double lambda;
+
+    Vector6d edge_error(const Edge& edge) const;
+
+    double chi2(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& estimates) const;
+
+    static Eigen::Matrix4d exp(const Vector6d& twist);
+
+    static Vector6d log(const Eigen::Matrix4d& transformation);
+
+    static Matrix6d adjoint(const Eigen::Matrix4d& transformation);
+};
+
+#endif // POSEGRAPH_H
@@ -0,0 +1,40 @@
+#ifndef POSE_INDEX_H
+#define POSE_INDEX_H
+
+#include "core/base/scannertypes.h"
+
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include <vector>
+
+/** \brief Overlap of camera views from their estimated poses. A kd-tree over the camera centres answers
+  * which frames are within max_distance of a pose, then frames looking more than max_angle away from
+  * its view direction are dropped. Poses are camera to world with the camera looking along z.
+  */
+class PoseIndex {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /** \brief max_angle in degrees. */
+    PoseIndex(const float& max_distance, const float& max_angle);
+
+    /** \brief Indexes poses with their positions as frame ids. */
+    void build(const Matrix4fVector& poses);
+
+    /** \brief Nearest first, at most max_candidates frames overlapping pose, ids above max_frame_id are skipped. */
+    std::vector<int> query(const Eigen::Matrix4f& pose, const int& max_frame_id, const size_t& max_candidates) const;
+
+    bool overlaps(const Eigen::Matrix4f& first_pose, const Eigen::Matrix4f& second_pose) const;
+
+    size_t size() const;
+
+private:
+    const float max_distance;
+    const float min_cos_angle;
+
+    Matrix4fVector poses;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr centres;
+    pcl::KdTreeFLANN<pcl::PointXYZ> tree;
+};
+
+#endif // POSE_INDEX_H
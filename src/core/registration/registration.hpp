@@ -5,9 +5,19 @@
 #include "core/base/scannertypes.h"
 
 #include "core/keypoints/arucokeypointdetector.h"
+#include "core/keypoints/keypointbudget.h"
 #include "core/keypoints/keypointsdetector.hpp"
 #include "core/keypoints/keypointsrejection.h"
+#include "core/keypoints/orbkeypointdetector.h"
 #include "core/keypoints/surfkeypointdetector.h"
+#include "io/pairresultcache.h"
+#include "utility/hash.h"
+#include "utility/threadpool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
 
 class Registration : public ScannerBase {
 public:
@@ -15,20 +25,21 @@ public:
 
     Registration(QObject* parent, QSettings* parent_settings)
         : ScannerBase(parent, parent_settings)
+        , pair_cache_folder(pair_result_cache::cache_folder(project, configs))
+        , detectors(pipeline_detectors(project))
+        , detect_keypoints(detector_set(detectors))
     {
     }
 
-    void setKeypoints(const KeypointsFrames& keypoints_)
+    void setKeypoints(KeypointsFrames keypoints_)
     {
-        keypoints = keypoints_;
+        keypoints = std::move(keypoints_);
     }
 
     Matrix4fVector align(Frames& output_transformed_data)
     {
         if (keypoints.empty()) {
             calculate_all_keypoint_pairs();
-
-            calculate_all_keypoint_pairs_rejection();
         }
 
         calculate_all_keypoint_pairs_registration();
@@ -60,6 +71,12 @@ public:
         return fitness_scores;
     }
 
+    /** \brief Keypoints of one pair for a pipeline stage worker, pair_index is the pair's place in the chain. */
+    KeypointsFrame pairKeypoints(const Frame& first_frame, const Frame& second_frame, const size_t& pair_index)
+    {
+        return calculate_one_keypoint_pair(first_frame, second_frame, pair_index);
+    }
+
 protected:
     Matrix4fVector transformations;
     Eigen::Matrix4f initial_transformation;
@@ -68,39 +85,297 @@ protected:
     KeypointsFrames keypoints;
     KeypointsFrames transformed_keypoints;
     std::vector<float> fitness_scores;
+    /** \brief Empty when the pair result cache is disabled. */
+    const QString pair_cache_folder;
+    /** \brief Keypoint budget of the pairs of this registration, reset by calculate_keypoint_pairs. */
+    keypoint_budget::Chain budget;
+
+    enum Detector {
+        ARUCO_DETECTOR = 1,
+        SURF_DETECTOR = 2,
+        ORB_DETECTOR = 4,
+        DETECTOR_SETS_COUNT = 8
+    };
+    typedef KeypointsFrame (Registration::*DetectKeypoints)(const Frame&, const Frame&, const size_t&, keypoint_budget::Report&);
+
+    /** \brief The PIPELINE_SETTINGS detectors as Detector bits, read once per registration. */
+    const int detectors;
+    /** \brief detect_with<detectors>, so a pair neither reads the detector flags nor branches on them. */
+    const DetectKeypoints detect_keypoints;
+
+    /** \brief Detects and rejects the keypoints of one pair, on any thread, and reports it to the budget.
+      * With the pair result cache a pair already seen with the same detection settings and budget is read
+      * from disk, with the counts it reported.
+      */
+    KeypointsFrame calculate_one_keypoint_pair(const Frame& input_frame1, const Frame& input_frame2, const size_t& pair_index)
+    {
+        //SURF and ORB keep the budget of the chain as it is when the pair starts
+        const size_t budget_size = keypoint_budget::enabled() ? budget.size() : 0;
+        keypoint_budget::Report budget_report;
+
+        KeypointsFrame result;
+        if (pair_cache_folder.isEmpty()) {
+            result = detect_one_keypoint_pair(input_frame1, input_frame2, budget_size, budget_report);
+            budget.report(pair_index, budget_report);
+            return result;
+        }
+
+        uint64_t key = hash::fnv1a("KEYPOINTS", 9);
+        for (const int detector : { ARUCO_DETECTOR, SURF_DETECTOR, ORB_DETECTOR }) {
+            key = hash::fnv1a_value(bool(detectors & detector), key);
+        }
+        for (const char* section : { "CALIBRATION_SETTINGS", "OPENCV_KEYPOINT_DETECTION_SETTINGS",
+                 "ORB_KEYPOINT_DETECTION_SETTINGS", "ARUCO_SETTINGS", "SAC_SETTINGS" }) {
+            key = hash::fnv1a_value(configs.sectionHash(section), key);
+        }
+        key = hash::fnv1a_value(uint64_t(budget_size), key);
+        key = pair_result_cache::frame_hash(input_frame1, key);
+        key = pair_result_cache::frame_hash(input_frame2, key);
+
+        if (!pair_result_cache::load_keypoints(pair_cache_folder, key, result, budget_report)) {
+            result = detect_one_keypoint_pair(input_frame1, input_frame2, budget_size, budget_report);
+            pair_result_cache::save_keypoints(pair_cache_folder, key, result, budget_report);
+        }
+        budget.report(pair_index, budget_report);
+
+        return result;
+    }
 
-    KeypointsFrame calculate_one_keypoint_pair(const Frame& frame1, const Frame& frame2)
+    KeypointsFrame detect_one_keypoint_pair(const Frame& input_frame1, const Frame& input_frame2,
+        const size_t& budget_size, keypoint_budget::Report& budget_report)
     {
+        return (this->*detect_keypoints)(input_frame1, input_frame2, budget_size, budget_report);
+    }
+
+    /** \brief One instantiation per detector set, the unused detectors are compiled out.
+      * toWorld() is a shallow copy of frames already in world coordinates.
+      */
+    template <int Detectors>
+    KeypointsFrame detect_with(const Frame& input_frame1, const Frame& input_frame2, const size_t& budget_size,
+        keypoint_budget::Report& budget_report)
+    {
+        const Frame frame1 = input_frame1.toWorld();
+        const Frame frame2 = input_frame2.toWorld();
+        const keypoint_budget::Scope budget_scope(budget_size);
         KeypointsFrame result;
 
-        if (settings->value("PIPELINE_SETTINGS/ARUCO_KEYPOINTS").toBool()) {
+        if (Detectors & ARUCO_DETECTOR) {
             KeypointsDetector<ArUcoKeypointDetector> aruco(this, settings);
             aruco.setInput(frame1, frame2);
             result += aruco.detect();
         }
-        if (settings->value("PIPELINE_SETTINGS/SURF_KEYPOINTS").toBool()) {
+        if (Detectors & SURF_DETECTOR) {
             KeypointsDetector<SurfKeypointDetector> surf(this, settings);
             surf.setInput(frame1, frame2);
             result += surf.detect();
         }
+        if (Detectors & ORB_DETECTOR) {
+            KeypointsDetector<OrbKeypointDetector> orb(this, settings);
+            orb.setInput(frame1, frame2);
+            result += orb.detect();
+        }
+
+        KeypointsRejection rejection(this, settings);
+        if (!keypoint_budget::enabled()) {
+            return rejection.rejection(result);
+        }
+
+        budget_report.budgeted = result.keypointsPcdCorrespondences.size();
+        KeypointsFrame rejected = rejection.rejection(result);
+        budget_report.inliers = rejected.keypointsPcdCorrespondences.size();
+        return rejected;
+    }
+
+    static int pipeline_detectors(const ProjectSettings& pipeline_settings)
+    {
+        return (pipeline_settings.value("PIPELINE_SETTINGS/ARUCO_KEYPOINTS").toBool() ? ARUCO_DETECTOR : 0)
+            | (pipeline_settings.value("PIPELINE_SETTINGS/SURF_KEYPOINTS").toBool() ? SURF_DETECTOR : 0)
+            | (pipeline_settings.value("PIPELINE_SETTINGS/ORB_KEYPOINTS").toBool() ? ORB_DETECTOR : 0);
+    }
+
+    static DetectKeypoints detector_set(const int& detectors)
+    {
+        static const DetectKeypoints sets[DETECTOR_SETS_COUNT] = {
+            &Registration::detect_with<0>,
+            &Registration::detect_with<1>,
+            &Registration::detect_with<2>,
+            &Registration::detect_with<3>,
+            &Registration::detect_with<4>,
+            &Registration::detect_with<5>,
+            &Registration::detect_with<6>,
+            &Registration::detect_with<7>
+        };
+        return sets[detectors];
+    }
+
+    /** \brief Runs every pair on the thread pool, the result keeps the order of the pairs.
+      * Every frame of the pairs is brought to world coordinates once, the pairs it is in share the copy.
+      */
+    KeypointsFrames calculate_keypoint_pairs(const std::vector<std::pair<unsigned int, unsigned int> >& pairs)
+    {
+        std::vector<uint8_t> used(frames.size(), 0);
+        for (const auto& pair : pairs) {
+            used[pair.first] = 1;
+            used[pair.second] = 1;
+        }
+
+        Frames world_frames(frames.size());
+        ThreadPool::instance().parallel_for(0, frames.size(), [&](size_t i) {
+            if (used[i]) {
+                world_frames[i] = frames[i].toWorld();
+            }
+        });
+
+        KeypointsFrames result(pairs.size());
+
+        budget.reset();
+        ThreadPool::instance().parallel_for(0, pairs.size(), [&](size_t i) {
+            result[i] = calculate_one_keypoint_pair(world_frames[pairs[i].first], world_frames[pairs[i].second], i);
+        });
 
         return result;
     }
 
     virtual void calculate_all_keypoint_pairs() = 0;
 
-    void calculate_all_keypoint_pairs_rejection()
+    /** \brief Registers one pair with registrator, or a new RegistrationMethod without it, methods with setFrames
+      * also get the pair's frames and methods with setPrediction get the predicted result, when there is one.
+      * With the pair result cache the result is keyed by the method's settings section, the keypoints, the
+      * frames, the initial and the predicted transformation.
+      */
+    template <typename RegistrationMethod>
+    Eigen::Matrix4f register_keypoint_pair(
+        const KeypointsFrame& keypoint_frame,
+        const Frame& first_frame,
+        const Frame& second_frame,
+        const Eigen::Matrix4f& pair_initial_transformation,
+        float& fitness_score,
+        const Eigen::Matrix4f* predicted_transformation = nullptr,
+        RegistrationMethod* registrator = nullptr)
     {
-        KeypointsRejection rejection(this, settings);
-        keypoints = rejection.rejection(keypoints);
+        if (pair_cache_folder.isEmpty()) {
+            return align_keypoint_pair<RegistrationMethod>(keypoint_frame, first_frame, second_frame,
+                pair_initial_transformation, fitness_score, predicted_transformation, registrator);
+        }
+
+        const QString section = RegistrationMethod::settingsSection();
+        const QByteArray section_name = section.toUtf8();
+        uint64_t key = hash::fnv1a(section_name.constData(), size_t(section_name.size()));
+        key = hash::fnv1a_value(configs.sectionHash(section), key);
+        key = pair_result_cache::keypoints_hash(keypoint_frame, key);
+        key = pair_result_cache::frame_hash(first_frame, key);
+        key = pair_result_cache::frame_hash(second_frame, key);
+        key = pair_result_cache::transformation_hash(pair_initial_transformation, key);
+        key = hash::fnv1a_value(predicted_transformation != nullptr, key);
+        if (predicted_transformation) {
+            key = pair_result_cache::transformation_hash(*predicted_transformation, key);
+        }
+
+        Eigen::Matrix4f result_t;
+        if (!pair_result_cache::load_registration(pair_cache_folder, key, result_t, fitness_score)) {
+            result_t = align_keypoint_pair<RegistrationMethod>(keypoint_frame, first_frame, second_frame,
+                pair_initial_transformation, fitness_score, predicted_transformation, registrator);
+            pair_result_cache::save_registration(pair_cache_folder, key, result_t, fitness_score);
+        }
+
+        return result_t;
     }
 
-    virtual Eigen::Matrix4f calculate_one_keypoint_pair_registration(
-        const KeypointsFrame& keypoint_frame, const Eigen::Matrix4f& initial_transformation)
-        = 0;
+    template <typename RegistrationMethod>
+    Eigen::Matrix4f align_keypoint_pair(
+        const KeypointsFrame& keypoint_frame,
+        const Frame& first_frame,
+        const Frame& second_frame,
+        const Eigen::Matrix4f& pair_initial_transformation,
+        float& fitness_score,
+        const Eigen::Matrix4f* predicted_transformation,
+        RegistrationMethod* registrator)
+    {
+        if (!registrator) {
+            RegistrationMethod pair_registrator(this, settings);
+            return align_keypoint_pair<RegistrationMethod>(keypoint_frame, first_frame, second_frame,
+                pair_initial_transformation, fitness_score, predicted_transformation, &pair_registrator);
+        }
+
+        set_registrator_frames(*registrator, first_frame, second_frame, 0);
+        if (predicted_transformation) {
+            set_registrator_prediction(*registrator, *predicted_transformation, 0);
+        }
+        registrator->setInput(keypoint_frame, pair_initial_transformation);
+        const Eigen::Matrix4f result_t = registrator->align();
+        fitness_score = registrator->getFitnessScore();
+        return result_t;
+    }
+
+    /** \brief Registers keypoints_frames[i] between frames pairs[i] from initial_transformations[i]. The batch is
+      * cut into a chunk per worker, each with one RegistrationMethod that aligns all of its pairs, so the
+      * method's settings and solvers are built once per chunk instead of per pair.
+      */
+    template <typename RegistrationMethod>
+    Matrix4fVector align_batch(
+        const KeypointsFrames& keypoints_frames,
+        const Matrix4fVector& initial_transformations,
+        const std::vector<std::pair<unsigned int, unsigned int> >& pairs,
+        std::vector<float>& batch_fitness_scores)
+    {
+        if (keypoints_frames.size() != initial_transformations.size() || keypoints_frames.size() != pairs.size()) {
+            throw std::invalid_argument("Registration::align_batch keypoints_frames.size() != initial_transformations.size()");
+        }
+
+        Matrix4fVector result(keypoints_frames.size(), Eigen::Matrix4f::Identity());
+        batch_fitness_scores.assign(keypoints_frames.size(), 0);
+        const size_t chunks_count = std::min(keypoints_frames.size(), ThreadPool::instance().size() + 1);
+        if (chunks_count == 0) {
+            return result;
+        }
+
+        const size_t chunk_size = (keypoints_frames.size() + chunks_count - 1) / chunks_count;
+
+        ThreadPool::instance().parallel_for(0, chunks_count, [&](size_t chunk) {
+            const size_t begin = chunk * chunk_size;
+            const size_t end = std::min(keypoints_frames.size(), begin + chunk_size);
+            if (begin >= end) {
+                return;
+            }
+
+            RegistrationMethod registrator(this, settings);
+            for (size_t i = begin; i < end; ++i) {
+                result[i] = register_keypoint_pair<RegistrationMethod>(keypoints_frames[i],
+                    frames[pairs[i].first], frames[pairs[i].second], initial_transformations[i],
+                    batch_fitness_scores[i], nullptr, &registrator);
+            }
+        });
+
+        return result;
+    }
 
     virtual void calculate_all_keypoint_pairs_registration() = 0;
 
+    template <typename RegistrationMethod>
+    static auto set_registrator_frames(
+        RegistrationMethod& registrator, const Frame& first_frame, const Frame& second_frame, int)
+        -> decltype(registrator.setFrames(first_frame, second_frame), void())
+    {
+        registrator.setFrames(first_frame, second_frame);
+    }
+
+    template <typename RegistrationMethod>
+    static void set_registrator_frames(RegistrationMethod&, const Frame&, const Frame&, long)
+    {
+    }
+
+    template <typename RegistrationMethod>
+    static auto set_registrator_prediction(RegistrationMethod& registrator, const Eigen::Matrix4f& prediction, int)
+        -> decltype(registrator.setPrediction(prediction), void())
+    {
+        registrator.setPrediction(prediction);
+    }
+
+    template <typename RegistrationMethod>
+    static void set_registrator_prediction(RegistrationMethod&, const Eigen::Matrix4f&, long)
+    {
+    }
+
     void apply_transformation()
     {
         if (frames.size() != transformations.size()) {
@@ -4,9 +4,31 @@
 #include "core/base/scannerbase.h"
 #include "core/base/scannertypes.h"
 #include "core/reconstruction/volumereconstruction.h"
-#include "gui/pcdvizualizer.h"
+#include "core/registration/icpregistration.h"
+#include "core/registration/linearregistration.hpp"
+#include "core/registration/posegraph.h"
+#include "core/registration/poseindex.h"
+#include "core/registration/sacregistration.h"
+#include "gui/vizualizer.h"
 #include "io/pcdinputiterator.hpp"
+#include "io/reconstructioncheckpoint.h"
+#include "utility/joblimits.h"
+#include "utility/log.h"
+#include "utility/memoryaccounting.h"
 #include "utility/pcdfilters.h"
+#include "utility/profiler.h"
+#include "utility/threadpool.h"
+#include "utility/ticketgate.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
 
 class RegistrationAlgorithm : public ScannerBase {
 public:
@@ -15,13 +37,22 @@ public:
         std::vector<uint> inner_indexes;
         Matrix4fVector inner_transformations;
         std::vector<float> inner_t_fitness_scores;
+        /** \brief Project frame numbers of inner_transformations, a checkpointed loop is replayed from them. */
+        std::vector<int> inner_frame_indexes;
     };
 
     RegistrationAlgorithm(QObject* parent, QSettings* parent_settings)
         : ScannerBase(parent, parent_settings)
-        , read_from(settings->value("READING_SETTING/FROM").toInt())
-        , read_to(settings->value("READING_SETTING/TO").toInt())
-        , read_step(settings->value("READING_SETTING/STEP").toInt())
+        , read_from(project.value("READING_SETTING/FROM").toInt())
+        , read_to(project.value("READING_SETTING/TO").toInt())
+        , read_step(project.value("READING_SETTING/STEP").toInt())
+        , cpu_tsdf(project.value("VISUALIZATION/CPU_TSDF").toBool())
+        , draw_all_clouds(project.value("VISUALIZATION/DRAW_ALL_CLOUDS").toBool())
+        , draw_all_keypoint_clouds(project.value("VISUALIZATION/DRAW_ALL_KEYPOINT_CLOUDS").toBool())
+        , submaps(cpu_tsdf && configs.value("CPU_TSDF_SETTINGS/SUBMAPS").toBool()
+              && configs.value("CPU_TSDF_SETTINGS/BACKEND").toString() == "VOXEL_HASH")
+        , checkpoint_filename(reconstruction_checkpoint::checkpoint_filename(project, configs))
+        , forced_profiling(false)
     {
         if (read_from >= read_to) {
             throw std::invalid_argument("RegistrationAlgorithm read_from >= read_to");
@@ -33,7 +64,7 @@ public:
             throw std::invalid_argument("RegistrationAlgorithm read_step == 0");
         }
 
-        size = std::distance(Iter(settings, read_from, read_to, read_step), Iter());
+        size = int(PcdFrameRange(project, read_from, read_to, read_step).size());
     }
 
     void setVolumeReconstructor(const VolumeReconstruction::Ptr& inputVolumeReconstruction)
@@ -45,23 +76,74 @@ public:
         volumeReconstruction = inputVolumeReconstruction;
     }
 
-    void setVisualizer(const PcdVizualizer::Ptr& inputPcdVizualizer)
+    /** \brief Optional, without a visualizer or with a disabled one the algorithm runs headless. */
+    void setVisualizer(const Vizualizer::Ptr& inputPcdVizualizer)
     {
         if (!inputPcdVizualizer) {
             throw std::invalid_argument("MiddleBasedRegistration::setVisualizer !inputPcdVizualizer");
         }
 
-        pcdVizualizer = inputPcdVizualizer;
+        if (inputPcdVizualizer->enabled()) {
+            pcdVizualizer = inputPcdVizualizer;
+        }
+    }
+
+    /** \brief Stage timings of profiler::jsonReport() with the figures of memory_accounting. */
+    static std::string stageReport()
+    {
+        std::string report = profiler::jsonReport();
+        report.insert(report.rfind("\n}"), ",\n  \"memory\": " + memory_accounting::jsonReport());
+        return report;
+    }
+
+    /** \brief The next reconstruct() times its stages even with PROFILING/ENABLED off. */
+    void setProfiling(const bool& enabled)
+    {
+        forced_profiling = enabled;
     }
 
+    /** \brief Every loop with its registered poses, valid once reconstruct() returns. */
+    std::vector<const Loop*> resultLoops() const
+    {
+        return result_loops();
+    }
+
+    /** \brief With checkpoints enabled a run with the same registration settings resumes after the
+      * last completed loop, the completed loops are only integrated again with their stored poses.
+      * With CHECKPOINT_SETTINGS/APPEND a completed run only registers and integrates the frames up to
+      * READING_SETTING/TO captured after it, see append_frames(). With PROFILING/ENABLED the stage timings and the memory high-water marks of the run are
+      * reported as JSON at the end.
+      */
     void reconstruct()
     {
-        prepare_all_loops();
-        process_all_loops();
+        const QString trace_filename = configs.value("PROFILING/TRACE_FILENAME").toString();
+        profiler::setEnabled(forced_profiling || configs.value("PROFILING/ENABLED").toBool());
+        profiler::setTraceEnabled(!trace_filename.isEmpty());
+        profiler::reset();
+        memory_accounting::resetPeaks();
+        {
+            PROFILE_ZONE("reconstruct");
+            if (!append_frames()) {
+                if (!resume_from_checkpoint()) {
+                    PROFILE_ZONE("prepare_loops");
+                    prepare_all_loops();
+                    start_checkpoint();
+                }
+                account_loops();
+                {
+                    PROFILE_ZONE("process_loops");
+                    process_all_loops();
+                }
+                account_loops();
+                fuse_loop_submaps();
+            }
 
-        if (settings->value("VISUALIZATION/CPU_TSDF").toBool()) {
-            perform_tsdf_meshing();
+            if (cpu_tsdf) {
+                PROFILE_ZONE("tsdf_meshing");
+                perform_tsdf_meshing();
+            }
         }
+        profiling_report();
     }
 
 protected:
@@ -70,8 +152,15 @@ protected:
     int read_step;
     int size;
 
+    /** \brief VISUALIZATION flags every loop checks, read once per algorithm. */
+    const bool cpu_tsdf;
+    const bool draw_all_clouds;
+    const bool draw_all_keypoint_clouds;
+    /** \brief CPU_TSDF_SETTINGS/SUBMAPS with the voxel hash backend, see integrate_loop_submap(). */
+    const bool submaps;
+
     VolumeReconstruction::Ptr volumeReconstruction;
-    PcdVizualizer::Ptr pcdVizualizer;
+    Vizualizer::Ptr pcdVizualizer;
 
     virtual void prepare_all_loops() = 0;
 
@@ -79,9 +168,225 @@ protected:
 
     virtual void perform_tsdf_meshing() = 0;
 
+    /** \brief State of every prepared loop, enough to process the loops without preparing them again. */
+    virtual std::vector<reconstruction_checkpoint::LoopRecord> prepared_loops() const = 0;
+
+    /** \brief Rebuilds the loops from prepared_loops() of an earlier run, false leaves them unprepared. */
+    virtual bool restore_prepared_loops(const std::vector<reconstruction_checkpoint::LoopRecord>& records) = 0;
+
+    virtual std::vector<const Loop*> result_loops() const = 0;
+
+    /** \brief Called in the loop's visualization turn before a completed loop is integrated again. */
+    virtual void replayed_loop(Loop& /*loop*/)
+    {
+    }
+
+    /** \brief Loops in flight at once, limited by the pool, by the memory budget in megabytes
+      * stored under memory_budget_key, by what is left of the process memory budget and by the
+      * job_limits of the calling thread, at least one. A loop holds its filtered and its transformed frames.
+      */
+    size_t concurrent_loops_count(
+        const size_t& loops_count, const int& frames_per_loop, const QString& memory_budget_key) const
+    {
+        size_t memory_budget = project.value(memory_budget_key).toULongLong() << 20;
+        if (job_limits::current().loops_memory > 0) {
+            memory_budget = std::min(memory_budget, job_limits::current().loops_memory);
+        }
+        const size_t frame_bytes = size_t(resolution::sensorWidth(configs)) * size_t(resolution::sensorHeight(configs))
+            * (sizeof(PointType) + sizeof(NormalType) + 3);
+        const size_t loop_bytes = 2 * size_t(std::max(frames_per_loop, 1)) * frame_bytes;
+
+        size_t lanes_count = std::min(std::min(memory_budget / loop_bytes, loops_count), ThreadPool::instance().size() + 1);
+        if (memory_accounting::budget() > 0) {
+            const size_t used = memory_accounting::total();
+            const size_t left = memory_accounting::budget() > used ? memory_accounting::budget() - used : 0;
+            lanes_count = std::min(lanes_count, std::max<size_t>(1, left / loop_bytes));
+        }
+
+        if (job_limits::current().loop_lanes > 0) {
+            lanes_count = std::min(lanes_count, job_limits::current().loop_lanes);
+        }
+
+        return lanes_count;
+    }
+
+    /** \brief Replaces every loop by process_one_loop(loop, gate, index), one lane runs them in order.
+      * More lanes each take the next loop until none are left, stages built in a lane read the project through
+      * the snapshot of this algorithm. Visualization and TSDF integration wait in the ticket gate, so they still
+      * see the loops in order and one at a time. The lanes are threads of their own: a lane waiting in the gate
+      * must not be a pool task, which a helping wait of the lane holding the turn could start below itself.
+      */
+    template <typename Loops, typename ProcessLoop>
+    void process_loops(Loops& loops, const size_t& lanes_count, const ProcessLoop& process_one_loop)
+    {
+        if (lanes_count <= 1) {
+            for (size_t i = 0; i < loops.size(); ++i) {
+                loops[i] = checkpointed_loop(loops[i], nullptr, i, process_one_loop);
+            }
+            return;
+        }
+
+        const job_limits::Limits limits = job_limits::current();
+        std::atomic<size_t> next_loop(0);
+        TicketGate vizualization_gate;
+
+        std::vector<std::exception_ptr> errors(lanes_count);
+        std::vector<std::thread> lanes;
+        for (size_t lane = 0; lane < lanes_count; ++lane) {
+            lanes.push_back(std::thread([&, lane]() {
+                const job_limits::Scope scope(limits);
+                const OpenMPLimit openmp_limit;
+                try {
+                    for (size_t i = next_loop++; i < loops.size(); i = next_loop++) {
+                        try {
+                            loops[i] = checkpointed_loop(loops[i], &vizualization_gate, i, process_one_loop);
+                        } catch (...) {
+                            vizualization_gate.pass(i);
+                            throw;
+                        }
+
+                        //Over the process memory budget the lanes but the first one stop taking loops
+                        if (lane > 0 && memory_accounting::excess() > 0) {
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    errors[lane] = std::current_exception();
+                    //The loops left are not taken, their tickets must not hold up the lanes still running
+                    for (size_t i = next_loop.exchange(loops.size()); i < loops.size(); ++i) {
+                        vizualization_gate.pass(i);
+                    }
+                }
+            }));
+        }
+
+        for (auto& lane : lanes) {
+            lane.join();
+        }
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    /** \brief Loops completed in the checkpoint are replayed, the others are processed and recorded. */
+    template <typename LoopType, typename ProcessLoop>
+    LoopType checkpointed_loop(
+        const LoopType& loop, TicketGate* vizualization_gate, const size_t& ticket, const ProcessLoop& process_one_loop)
+    {
+        PROFILE_ZONE_INDEX("loop", int(ticket));
+        reconstruction_checkpoint::LoopRecord record;
+        if (completed_checkpoint_loop(ticket, record)) {
+            return replayed_record_loop(loop, record, vizualization_gate, ticket, true);
+        }
+
+        LoopType result_loop = process_one_loop(loop, vizualization_gate, ticket);
+        complete_checkpoint_loops(std::vector<const Loop*>(1, &result_loop), ticket);
+        loop_camera_poses(result_loop, ticket);
+        return result_loop;
+    }
+
+    bool completed_checkpoint_loop(const size_t& index, reconstruction_checkpoint::LoopRecord& record)
+    {
+        if (checkpoint_filename.isEmpty()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        if (index >= checkpoint.loops.size() || !checkpoint.loops[index].completed) {
+            return false;
+        }
+
+        record = checkpoint.loops[index];
+        return true;
+    }
+
+    /** \brief A loop completed by another process, replayed as a completed checkpoint loop is and recorded
+      * in the checkpoint. With integrated set the loop is in the volume already and its frames are not read.
+      */
+    template <typename LoopType>
+    LoopType received_loop(const LoopType& loop, const reconstruction_checkpoint::LoopRecord& record,
+        const size_t& ticket, const bool& integrated)
+    {
+        PROFILE_ZONE_INDEX("loop", int(ticket));
+        LoopType result_loop = replayed_record_loop(loop, record, nullptr, ticket, !integrated);
+        complete_checkpoint_loops(std::vector<const Loop*>(1, &result_loop), ticket);
+        return result_loop;
+    }
+
+    template <typename LoopType>
+    LoopType replayed_record_loop(const LoopType& loop, const reconstruction_checkpoint::LoopRecord& record,
+        TicketGate* vizualization_gate, const size_t& ticket, const bool& integrate)
+    {
+        LoopType result_loop(loop);
+        result_loop.inner_frame_indexes = record.frame_indexes;
+        result_loop.inner_transformations = record.inner_transformations;
+        result_loop.inner_t_fitness_scores = record.fitness_scores;
+        replay_loop(result_loop, vizualization_gate, ticket, integrate);
+        loop_camera_poses(result_loop, ticket);
+        return result_loop;
+    }
+
+    /** \brief Adds the loop to the camera glyphs as soon as it finishes, loops finishing out of order
+      * keep their own set.
+      */
+    void loop_camera_poses(const Loop& loop, const size_t& ticket)
+    {
+        if (pcdVizualizer) {
+            pcdVizualizer->visualizeCameraPoses(
+                loop.inner_transformations, loop.inner_t_fitness_scores, QString("loop_%1").arg(ticket));
+        }
+    }
+
+    /** \brief Records loops[i] as the loop of checkpoint index first_index + i, then saves the checkpoint. */
+    void complete_checkpoint_loops(const std::vector<const Loop*>& loops, const size_t& first_index = 0)
+    {
+        if (checkpoint_filename.isEmpty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        for (size_t i = 0; i < loops.size(); ++i) {
+            if (first_index + i >= checkpoint.loops.size()) {
+                throw std::runtime_error("RegistrationAlgorithm::complete_checkpoint_loops loop is not in the checkpoint");
+            }
+
+            reconstruction_checkpoint::LoopRecord& record = checkpoint.loops[first_index + i];
+            record.completed = true;
+            record.frame_indexes = loops[i]->inner_frame_indexes;
+            record.inner_transformations = loops[i]->inner_transformations;
+            record.fitness_scores = loops[i]->inner_t_fitness_scores;
+        }
+        save_checkpoint();
+    }
+
+    /** \brief Without a gate the loop is visualized right away, otherwise in its ticket's turn. */
+    void gated_vizualization(
+        TicketGate* vizualization_gate,
+        const size_t& ticket,
+        Frames& src_frames,
+        const Frames& transformed_frames,
+        const KeypointsFrames& transformed_keypoints,
+        const Matrix4fVector& transformations)
+    {
+        if (!vizualization_gate) {
+            vizualization(src_frames, transformed_frames, transformed_keypoints, transformations);
+            return;
+        }
+
+        vizualization_gate->run(ticket, [&]() {
+            vizualization(src_frames, transformed_frames, transformed_keypoints, transformations);
+        });
+    }
+
     template <typename T, typename A>
     void loops_data_vizualization(const std::vector<T, A>& loops)
     {
+        if (!pcdVizualizer) {
+            return;
+        }
+
         Matrix4fVector inner_transformations;
         std::vector<double> inner_t_fitness_scores;
 
@@ -92,12 +397,8 @@ protected:
                 std::back_inserter(inner_t_fitness_scores));
         }
 
-        pcdVizualizer->visualizeCameraPoses(inner_transformations);
+        pcdVizualizer->plotCameraPoses(inner_transformations);
         pcdVizualizer->plotCameraDistances(inner_t_fitness_scores, false, "Fitness scores", "Score");
-
-        while (!pcdVizualizer->viewer->wasStopped()) {
-            pcdVizualizer->spin();
-        }
     }
 
     void vizualization(
@@ -106,20 +407,454 @@ protected:
         const KeypointsFrames& transformed_keypoints,
         const Matrix4fVector& transformations)
     {
-        if (settings->value("VISUALIZATION/CPU_TSDF").toBool()) {
+        if (cpu_tsdf) {
             PcdFilters::reorganize_all_frames(src_frames);
             PcdPtrVector point_cloud_vector;
             std::transform(src_frames.begin(), src_frames.end(), std::back_inserter(point_cloud_vector),
                 [](const Frame& frame) { return frame.pointCloudPtr; });
 
             volumeReconstruction->addPointCloudVector(point_cloud_vector, transformations);
-        } else {
-            if (settings->value("VISUALIZATION/DRAW_ALL_CLOUDS").toBool()) {
+
+            //The preview of the batches integrated so far, the latest one may still be in the queue
+            pcl::PolygonMesh mesh;
+            if (pcdVizualizer && volumeReconstruction->takePreviewMesh(mesh)) {
+                pcdVizualizer->visualizePreviewMesh(mesh);
+            }
+        } else if (pcdVizualizer) {
+            if (draw_all_clouds) {
                 pcdVizualizer->visualizePointClouds(transformed_frames);
             }
-            if (settings->value("VISUALIZATION/DRAW_ALL_KEYPOINT_CLOUDS").toBool()) {
-                pcdVizualizer->visualizeKeypointClouds(transformed_keypoints);
+            if (draw_all_keypoint_clouds) {
+                //Every batch keeps its own keypoint set on screen
+                pcdVizualizer->visualizeKeypointClouds(transformed_keypoints,
+                    QString("keypoints_%1").arg(src_frames.empty() ? 0 : src_frames.front().frameIndex));
+            }
+        }
+    }
+
+    /** \brief With submaps the loop's frames are integrated into a volume of its own relative to its first
+      * pose, outside of the visualization turns, so loops integrate in parallel. The submap is fused once
+      * the loops are final, moved rigidly with the loop's corrected first pose. False without submaps.
+      */
+    bool integrate_loop_submap(const size_t& ticket, Frames& src_frames, const Matrix4fVector& transformations)
+    {
+        if (!submaps || src_frames.empty()) {
+            return false;
+        }
+
+        PcdFilters::reorganize_all_frames(src_frames);
+        PcdPtrVector point_cloud_vector;
+        std::transform(src_frames.begin(), src_frames.end(), std::back_inserter(point_cloud_vector),
+            [](const Frame& frame) { return frame.pointCloudPtr; });
+
+        const VoxelHashVolume::Ptr submap
+            = volumeReconstruction->integrateSubmap(point_cloud_vector, transformations, transformations.front());
+        if (!submap) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(submaps_mutex);
+        loop_submaps[ticket] = submap;
+        return true;
+    }
+
+private:
+    const QString checkpoint_filename;
+    reconstruction_checkpoint::Checkpoint checkpoint;
+    std::mutex checkpoint_mutex;
+    bool forced_profiling;
+
+    /** \brief Submaps of the processed loops by loop index, in the loop's first frame coordinates. */
+    std::map<size_t, VoxelHashVolume::Ptr> loop_submaps;
+    std::mutex submaps_mutex;
+
+    /** \brief Fuses the submaps in loop order with the final first pose of their loops. */
+    void fuse_loop_submaps()
+    {
+        if (loop_submaps.empty()) {
+            return;
+        }
+
+        PROFILE_ZONE("submap_fusion");
+        const std::vector<const Loop*> loops = result_loops();
+        for (const auto& entry : loop_submaps) {
+            volumeReconstruction->fuseSubmap(*entry.second, loops.at(entry.first)->inner_transformations.front());
+            LOG_DEBUG("tsdf") << "Submap fusion" << entry.first + 1 << "/" << loops.size();
+        }
+        loop_submaps.clear();
+    }
+
+    bool resume_from_checkpoint()
+    {
+        if (checkpoint_filename.isEmpty()) {
+            return false;
+        }
+
+        reconstruction_checkpoint::Checkpoint stored;
+        if (!reconstruction_checkpoint::load(checkpoint_filename,
+                reconstruction_checkpoint::parameters_hash(project, configs), stored)) {
+            return false;
+        }
+        stored.loops.erase(std::remove_if(stored.loops.begin(), stored.loops.end(),
+                               [](const reconstruction_checkpoint::LoopRecord& record) { return record.indexes.empty(); }),
+            stored.loops.end());
+        if (!restore_prepared_loops(stored.loops)) {
+            return false;
+        }
+
+        const size_t completed_count = std::count_if(stored.loops.begin(), stored.loops.end(),
+            [](const reconstruction_checkpoint::LoopRecord& record) { return record.completed; });
+        LOG_INFO("registration") << "Resuming from" << checkpoint_filename << ":" << completed_count << "of" << stored.loops.size()
+                                 << "loops completed";
+
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        checkpoint = std::move(stored);
+        return true;
+    }
+
+    void start_checkpoint()
+    {
+        if (checkpoint_filename.isEmpty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        checkpoint.parameters_hash = reconstruction_checkpoint::parameters_hash(project, configs);
+        checkpoint.append_hash = reconstruction_checkpoint::append_hash(project, configs);
+        checkpoint.loops = prepared_loops();
+        save_checkpoint();
+    }
+
+    void save_checkpoint()
+    {
+        if (!reconstruction_checkpoint::save(checkpoint_filename, checkpoint)) {
+            LOG_WARNING("registration") << "Checkpoint could not be saved to" << checkpoint_filename;
+        }
+    }
+
+    /** \brief Sets the loops gauge of memory_accounting, the frames the loops hold are counted with the frames. */
+    void account_loops() const
+    {
+        size_t bytes = 0;
+        for (const Loop* loop : result_loops()) {
+            bytes += sizeof(Loop) + loop->inner_indexes.capacity() * sizeof(uint)
+                + loop->inner_transformations.capacity() * sizeof(Eigen::Matrix4f)
+                + loop->inner_t_fitness_scores.capacity() * sizeof(float)
+                + loop->inner_frame_indexes.capacity() * sizeof(int);
+        }
+        memory_accounting::set(memory_accounting::LOOPS, bytes);
+    }
+
+    /** \brief Logs the stage timings and writes them to PROFILING/REPORT_FILENAME when it is set,
+      * the timeline to PROFILING/TRACE_FILENAME.
+      */
+    void profiling_report() const
+    {
+        if (!profiler::enabled()) {
+            return;
+        }
+
+        const QString trace_filename = configs.value("PROFILING/TRACE_FILENAME").toString();
+        if (!trace_filename.isEmpty() && !profiler::writeChromeTrace(trace_filename.toStdString())) {
+            LOG_WARNING("registration") << "RegistrationAlgorithm: can't write" << trace_filename;
+        }
+
+        const std::string report = stageReport();
+        LOG_INFO("registration") << "Profiling report:\n" << report.c_str();
+
+        const QString filename = configs.value("PROFILING/REPORT_FILENAME").toString();
+        if (filename.isEmpty()) {
+            return;
+        }
+        QFile file(filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || file.write(report.data(), qint64(report.size())) != qint64(report.size())) {
+            LOG_WARNING("registration") << "RegistrationAlgorithm: can't write" << filename;
+        }
+    }
+
+    /** \brief Reads and filters the loop's frames again and integrates them with the stored poses,
+      * without integrate only replayed_loop is called.
+      */
+    void replay_loop(Loop& loop, TicketGate* vizualization_gate, const size_t& ticket, const bool& integrate)
+    {
+        Frames frames;
+        if (integrate && (cpu_tsdf || pcdVizualizer)) {
+            frames = read_checkpointed_frames(loop.inner_frame_indexes);
+        }
+
+        const auto finish_loop = [&]() {
+            replayed_loop(loop);
+            if (frames.empty()) {
+                return;
+            }
+            if (frames.size() != loop.inner_transformations.size()) {
+                throw std::runtime_error("RegistrationAlgorithm::replay_loop frames do not match the transformations");
+            }
+
+            Frames transformed_frames;
+            for (uint i = 0; i < frames.size(); ++i) {
+                transformed_frames.push_back(frames[i].transform(loop.inner_transformations[i]));
+            }
+            vizualization(frames, transformed_frames, KeypointsFrames(), loop.inner_transformations);
+        };
+        if (vizualization_gate) {
+            vizualization_gate->run(ticket, finish_loop);
+        } else {
+            finish_loop();
+        }
+    }
+
+    /** \brief The filtered frames of a checkpointed loop, in its order. */
+    Frames read_checkpointed_frames(const std::vector<int>& frame_indexes)
+    {
+        Frames frames;
+        for (const int& frame_index : frame_indexes) {
+            Iter it(project, frame_index, frame_index + 1, 1);
+            if (it == Iter() || (*it).frameIndex != frame_index) {
+                throw std::runtime_error("RegistrationAlgorithm::read_checkpointed_frames checkpointed frame is missing");
+            }
+            frames.push_back(*it);
+        }
+
+        PcdFilters filters(this, settings);
+        filters.setInput(std::move(frames));
+        filters.filter(frames);
+        return frames;
+    }
+
+    /** \brief CHECKPOINT_SETTINGS/APPEND: with every loop of the checkpoint completed, the frames after its last
+      * frame are registered as a chain from it and each one against the APPEND_NEIGHBOURS checkpointed frames
+      * nearest to its chained pose. The checkpointed poses are fixed in a local pose graph, so only the new
+      * frames move. The new frames are integrated into the saved volume and recorded as one more loop.
+      * False leaves the run to resume or start over.
+      */
+    bool append_frames()
+    {
+        if (checkpoint_filename.isEmpty() || !configs.value("CHECKPOINT_SETTINGS/APPEND").toBool()) {
+            return false;
+        }
+
+        reconstruction_checkpoint::Checkpoint stored;
+        if (!reconstruction_checkpoint::load(checkpoint_filename,
+                reconstruction_checkpoint::append_hash(project, configs), stored, true)
+            || stored.loops.empty()) {
+            LOG_WARNING("registration") << "Append: no run in" << checkpoint_filename << "to append to";
+            return false;
+        }
+
+        std::vector<int> old_indexes;
+        Matrix4fVector old_poses;
+        for (const reconstruction_checkpoint::LoopRecord& record : stored.loops) {
+            if (!record.completed || record.frame_indexes.size() != record.inner_transformations.size()) {
+                LOG_WARNING("registration") << "Append: the run in" << checkpoint_filename << "is not completed";
+                return false;
+            }
+            old_indexes.insert(old_indexes.end(), record.frame_indexes.begin(), record.frame_indexes.end());
+            old_poses.insert(old_poses.end(), record.inner_transformations.begin(), record.inner_transformations.end());
+        }
+
+        const size_t last = size_t(std::max_element(old_indexes.begin(), old_indexes.end()) - old_indexes.begin());
+        const int last_index = old_indexes[last];
+        if (read_to - last_index < read_step) {
+            LOG_INFO("registration") << "Append: no frames after" << last_index;
+            return true;
+        }
+
+        //The last checkpointed frame leads the chain with its pose
+        Frames frames;
+        const PcdFrameRange range(project, uint(last_index), uint(read_to), uint(read_step));
+        for (size_t i = 0; i < range.size(); ++i) {
+            if (int(range.frameIndex(i)) >= last_index) {
+                frames.push_back(range[i]);
+            }
+        }
+        if (frames.size() < 2 || frames.front().frameIndex != last_index) {
+            LOG_INFO("registration") << "Append: no frames after" << last_index;
+            return true;
+        }
+        LOG_INFO("registration") << "Append:" << frames.size() - 1 << "frames after" << last_index;
+
+        PcdFilters filters(this, settings);
+        filters.setInput(std::move(frames));
+        filters.filter(frames);
+
+        std::vector<float> fitness_scores;
+        Matrix4fVector poses = chain_appended_frames(frames, old_poses[last], fitness_scores);
+        {
+            PROFILE_ZONE("append_pose_graph");
+            correct_appended_frames(frames, old_indexes, old_poses, poses);
+        }
+
+        //The chain's first frame is in the volume already
+        Frames new_frames(frames.begin() + 1, frames.end());
+        const Matrix4fVector new_poses(poses.begin() + 1, poses.end());
+        if (cpu_tsdf || pcdVizualizer) {
+            if (cpu_tsdf) {
+                restore_volume(stored);
+            }
+
+            Frames transformed_frames;
+            for (uint i = 0; i < new_frames.size(); ++i) {
+                transformed_frames.push_back(new_frames[i].transform(new_poses[i]));
+            }
+            vizualization(new_frames, transformed_frames, KeypointsFrames(), new_poses);
+        }
+
+        reconstruction_checkpoint::LoopRecord record;
+        record.completed = true;
+        for (const Frame& frame : new_frames) {
+            record.frame_indexes.push_back(frame.frameIndex);
+        }
+        record.inner_transformations = new_poses;
+        record.fitness_scores = fitness_scores;
+        stored.loops.push_back(record);
+
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+        checkpoint = std::move(stored);
+        save_checkpoint();
+        return true;
+    }
+
+    /** \brief Absolute poses of frames registered one after another from first_pose, SaC then ICP. */
+    Matrix4fVector chain_appended_frames(const Frames& frames, const Eigen::Matrix4f& first_pose, std::vector<float>& fitness_scores)
+    {
+        PROFILE_ZONE("append_chain");
+        Frames transformed_frames;
+        LinearRegistration<SaCRegistration> linear_sac(this, settings);
+        linear_sac.setInput(frames, first_pose);
+        const Matrix4fVector sac_t = linear_sac.align(transformed_frames);
+
+        LinearRegistration<ICPRegistration> linear_icp(this, settings);
+        linear_icp.setInput(transformed_frames, Eigen::Matrix4f::Identity());
+        linear_icp.setKeypoints(linear_sac.getTransformedKeypoints());
+        const Matrix4fVector icp_t = linear_icp.align(transformed_frames);
+        fitness_scores = linear_icp.getFitnessScores();
+
+        Matrix4fVector poses;
+        for (uint i = 0; i < frames.size(); ++i) {
+            poses.push_back(icp_t[i] * sac_t[i]);
+        }
+        return poses;
+    }
+
+    /** \brief Pose graph of the chain with odometry edges and with an edge per verified pair of a new frame
+      * and a nearby checkpointed one, LOOP_CLOSURE_SETTINGS verify the pairs. Pairs are registered on the
+      * thread pool.
+      */
+    void correct_appended_frames(
+        const Frames& frames, const std::vector<int>& old_indexes, const Matrix4fVector& old_poses, Matrix4fVector& poses)
+    {
+        const size_t neighbours = configs.value("CHECKPOINT_SETTINGS/APPEND_NEIGHBOURS").toUInt();
+        PoseIndex pose_index(configs.value("LOOP_CLOSURE_SETTINGS/POSE_MAX_DISTANCE").toFloat(),
+            configs.value("LOOP_CLOSURE_SETTINGS/POSE_MAX_ANGLE").toFloat());
+        pose_index.build(old_poses);
+
+        //Pairs of a checkpointed frame and a new frame of the chain
+        std::vector<std::pair<size_t, size_t> > pairs;
+        std::map<size_t, Frame> old_frames;
+        for (size_t i = 1; i < frames.size() && neighbours > 0; ++i) {
+            for (const int& id : pose_index.query(poses[i], int(old_poses.size()) - 1, neighbours)) {
+                if (old_indexes[id] != frames.front().frameIndex) {
+                    pairs.push_back(std::make_pair(size_t(id), i));
+                    old_frames[size_t(id)] = Frame();
+                }
+            }
+        }
+
+        for (auto& old_frame : old_frames) {
+            old_frame.second = read_checkpointed_frames(std::vector<int>(1, old_indexes[old_frame.first])).front();
+        }
+
+        const int min_keypoints = configs.value("LOOP_CLOSURE_SETTINGS/MIN_KEYPOINTS").toInt();
+        const float max_fitness = configs.value("LOOP_CLOSURE_SETTINGS/MAX_FITNESS").toFloat();
+        Matrix4fVector measurements(pairs.size());
+        std::vector<uint8_t> verified(pairs.size(), 0);
+        ThreadPool::instance().parallel_for(0, pairs.size(), [&](size_t i) {
+            Frames pair_frames;
+            pair_frames.push_back(old_frames.at(pairs[i].first));
+            pair_frames.push_back(frames[pairs[i].second]);
+            Frames transformed_pair_frames;
+
+            LinearRegistration<SaCRegistration> linear_sac(this, settings);
+            linear_sac.setInput(pair_frames, Eigen::Matrix4f::Identity());
+            const Matrix4fVector sac_t = linear_sac.align(transformed_pair_frames);
+            if (linear_sac.getKeypoints().empty()
+                || int(linear_sac.getKeypoints().front().keypointsPcdPair.first->size()) < min_keypoints) {
+                return;
+            }
+
+            LinearRegistration<ICPRegistration> linear_icp(this, settings);
+            linear_icp.setInput(transformed_pair_frames, Eigen::Matrix4f::Identity());
+            linear_icp.setKeypoints(linear_sac.getTransformedKeypoints());
+            const Matrix4fVector icp_t = linear_icp.align(transformed_pair_frames);
+            measurements[i] = icp_t[1] * sac_t[1];
+            verified[i] = linear_icp.getFitnessScores().front() <= max_fitness && !measurements[i].hasNaN();
+        });
+
+        const PoseGraph::Matrix6d odometry_information = PoseGraph::information(
+            configs.value("POSE_GRAPH_SETTINGS/ODOMETRY_TRANSLATION_WEIGHT").toDouble(),
+            configs.value("POSE_GRAPH_SETTINGS/ODOMETRY_ROTATION_WEIGHT").toDouble());
+        const PoseGraph::Matrix6d closure_information = PoseGraph::information(
+            configs.value("LOOP_CLOSURE_SETTINGS/TRANSLATION_WEIGHT").toDouble(),
+            configs.value("LOOP_CLOSURE_SETTINGS/ROTATION_WEIGHT").toDouble());
+
+        //Vertex i is frame i of the chain, the first one is checkpointed and fixed
+        PoseGraph pose_graph;
+        pose_graph.addVertex(poses.front(), true);
+        for (size_t i = 1; i < poses.size(); ++i) {
+            pose_graph.addVertex(poses[i]);
+            pose_graph.addEdge(int(i - 1), int(i), poses[i - 1].inverse() * poses[i], odometry_information);
+        }
+
+        std::map<size_t, int> old_vertices;
+        size_t closures_count = 0;
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            if (!verified[i]) {
+                continue;
+            }
+            if (old_vertices.count(pairs[i].first) == 0) {
+                old_vertices[pairs[i].first] = pose_graph.addVertex(old_poses[pairs[i].first], true);
+            }
+            pose_graph.addEdge(old_vertices[pairs[i].first], int(pairs[i].second), measurements[i], closure_information);
+            ++closures_count;
+        }
+
+        LOG_INFO("registration") << "Append:" << closures_count << "of" << pairs.size() << "pairs with checkpointed frames verified";
+        if (closures_count == 0) {
+            return;
+        }
+
+        pose_graph.optimize(configs.value("POSE_GRAPH_SETTINGS/MAX_ITERATIONS").toInt());
+        for (size_t i = 1; i < poses.size(); ++i) {
+            poses[i] = pose_graph.getPose(int(i));
+        }
+    }
+
+    /** \brief The volume of the completed run: loaded already with CPU_TSDF_SETTINGS/INITIAL_VOL_FILENAME,
+      * otherwise merged from SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_VOL_FILENAME, and when that can't be
+      * read every checkpointed frame is integrated again with its stored pose.
+      */
+    void restore_volume(const reconstruction_checkpoint::Checkpoint& stored)
+    {
+        PROFILE_ZONE("append_restore_volume");
+        if (!configs.value("CPU_TSDF_SETTINGS/INITIAL_VOL_FILENAME").toString().isEmpty()) {
+            return;
+        }
+
+        const QString filename = configs.value("SAVING_FINAL_POINT_CLOUD_SETTINGS/FINAL_VOL_FILENAME").toString();
+        if (volumeReconstruction->mergeVolume(filename)) {
+            return;
+        }
+
+        LOG_WARNING("registration") << "Append: can't merge" << filename << ", the checkpointed frames are integrated again";
+        for (const reconstruction_checkpoint::LoopRecord& record : stored.loops) {
+            Frames frames = read_checkpointed_frames(record.frame_indexes);
+            Frames transformed_frames;
+            for (uint i = 0; i < frames.size(); ++i) {
+                transformed_frames.push_back(frames[i].transform(record.inner_transformations[i]));
             }
+            vizualization(frames, transformed_frames, KeypointsFrames(), record.inner_transformations);
         }
     }
 };
@@ -17,8 +17,17 @@ public:
         const KeypointsFrame& keypoints_frame_,
         const Eigen::Matrix4f& initial_transformation_);
 
+    /** \brief Predicted align() result. When it already has MOTION_PRIOR_MIN_INLIER_RATIO of the
+      * correspondences within INLIER_THRESHOLD, its inliers are refitted and sampling is skipped.
+      */
+    void setPrediction(const Eigen::Matrix4f& predicted_transformation_);
+
+    /** \brief The prediction only applies to this call, so one registrator may align many pairs. */
     Eigen::Matrix4f align();
 
+    /** \brief configs.ini section of the parameters align() depends on. */
+    static QString settingsSection();
+
     Eigen::Matrix4f getTransformation() const;
 
     float getFitnessScore() const;
@@ -29,9 +38,17 @@ private:
 
     KeypointsFrame keypoints_frame;
     Eigen::Matrix4f initial_transformation;
+    Eigen::Matrix4f predicted_transformation;
+    bool has_prediction;
     Eigen::Matrix4f result_t;
 
     void calculate();
+
+    bool prediction_transformation(Eigen::Matrix4f& transformation) const;
+
+    Eigen::Matrix4f pcl_sac_transformation() const;
+
+    Eigen::Matrix4f rigid_sac_transformation() const;
 };
 
 #endif // SACREGISTRATION_H
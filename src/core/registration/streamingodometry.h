@@ -0,0 +1,85 @@
+#ifndef STREAMINGODOMETRY_H
+#define STREAMINGODOMETRY_H
+
+#include "core/registration/motionmodel.h"
+#include "core/registration/registration.hpp"
+#include "io/framewriter.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <mutex>
+
+/** \brief Online odometry of the sensor stream. Frames are registered on a worker thread against the
+  * last keyframe with the keypoint pipeline (detection, rejection, SaC and ICP), so poses and a top view
+  * preview of the trajectory are available while scanning. Frames arriving while the worker is busy
+  * beyond QUEUE_SIZE are dropped, the stream is never stalled.
+  */
+class StreamingOdometry : public Registration {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    StreamingOdometry(QObject* parent, QSettings* parent_settings);
+    ~StreamingOdometry();
+
+    /** \brief Queues the frame, returns false when it was dropped. */
+    bool push(const Frame& frame);
+
+    /** \brief Blocks until every queued frame is registered. */
+    void wait();
+
+    void reset();
+
+    /** \brief Absolute poses of the tracked frames, in stream order. */
+    Matrix4fVector getPoses();
+
+    std::vector<int> getFrameIndexes();
+
+    Eigen::Matrix4f getLastPose();
+
+    bool isTrackingLost();
+
+    size_t getLostCount();
+
+    size_t getDroppedCount() const;
+
+    /** \brief Top view of the trajectory, red while tracking is lost. */
+    cv::Mat getPreview();
+
+protected:
+    void calculate_all_keypoint_pairs() {}
+
+    void calculate_all_keypoint_pairs_registration() {}
+
+private:
+    const int min_keypoints;
+    const float max_fitness;
+    const float keyframe_translation;
+    const float keyframe_rotation;
+    const int preview_size;
+    const float preview_scale;
+
+    std::mutex mutex;
+    Matrix4fVector poses;
+    std::vector<int> frame_indexes;
+    bool tracking_lost;
+    size_t lost_count;
+
+    //Worker thread only
+    Frame keyframe;
+    Eigen::Matrix4f keyframe_pose;
+    bool has_keyframe;
+    MotionModel motion_model;
+    //Pairs tracked since the last reset, in the order of the keypoint budget
+    size_t tracked_pairs;
+
+    std::unique_ptr<FrameWriter> worker;
+
+    void process(const Frame& frame);
+
+    bool track(const Frame& frame, Eigen::Matrix4f& pose);
+
+    bool is_keyframe(const Eigen::Matrix4f& pose) const;
+};
+
+#endif // STREAMINGODOMETRY_H
@@ -0,0 +1,78 @@
+#ifndef TURNTABLE_REGISTRATION_H
+#define TURNTABLE_REGISTRATION_H
+
+#include "core/base/scannertypes.h"
+
+#include <vector>
+
+/** \brief Registration of a sensor turning about a fixed axis, TURNTABLE_SETTINGS. The axis is constant in
+  * camera coordinates, so every pair is a rotation about it, plus a shift along it with AXIAL_TRANSLATION.
+  * Without AXIS the first pair turning by MIN_AXIS_ANGLE is registered with 6-DOF sample consensus and
+  * its screw axis is kept for the following pairs of this registrator.
+  */
+class TurntableRegistration : public ScannerBase {
+    Q_OBJECT
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TurntableRegistration(QObject* parent, QSettings* parent_settings);
+
+    void setInput(
+        const KeypointsFrame& keypoints_frame_,
+        const Eigen::Matrix4f& initial_transformation_);
+
+    /** \brief With ANGLE_PER_FRAME the frame indexes give the pair's angle. target_frame_ is the first frame of the pair. */
+    void setFrames(const Frame& target_frame_, const Frame& source_frame_);
+
+    Eigen::Matrix4f align();
+
+    /** \brief configs.ini section of the parameters align() depends on. */
+    static QString settingsSection();
+
+    Eigen::Matrix4f getTransformation() const;
+
+    /** \brief Mean squared residual of the inlier keypoints. */
+    float getFitnessScore() const;
+
+    bool hasAxis() const;
+
+private:
+    const float inlier_threshold;
+    const int max_iterations;
+    const float min_axis_angle;
+    const float angle_per_frame;
+    const bool axial_translation;
+    const int refine_iterations;
+
+    bool has_axis;
+    Eigen::Vector3f axis;
+    Eigen::Vector3f center;
+
+    KeypointsFrame keypoints_frame;
+    Eigen::Matrix4f initial_transformation;
+    int frames_gap;
+    Eigen::Matrix4f result_t;
+    float fitness_score;
+
+    void calculate();
+
+    /** \brief Keeps the screw axis of a general transformation turning by at least MIN_AXIS_ANGLE. */
+    bool adopt_axis(const Eigen::Matrix4f& transformation);
+
+    /** \brief Source to target rotation about the axis by angle and shift along it. */
+    Eigen::Matrix4f about_axis(const float& angle, const float& shift) const;
+
+    /** \brief Least squares angle and shift of pairs, in closed form. */
+    void fit(const std::vector<Eigen::Vector3f>& source, const std::vector<Eigen::Vector3f>& target,
+        const std::vector<int>& pairs, float& angle, float& shift) const;
+
+    /** \brief Pairs within INLIER_THRESHOLD of transformation and the mean of their squared residuals. */
+    float select_inliers(const std::vector<Eigen::Vector3f>& source, const std::vector<Eigen::Vector3f>& target,
+        const Eigen::Matrix4f& transformation, std::vector<int>& inliers) const;
+
+    /** \brief ICP over the nearest keypoints with the same one or two degrees of freedom. */
+    void refine(float& angle, float& shift);
+};
+
+#endif // TURNTABLE_REGISTRATION_H
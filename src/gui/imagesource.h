@@ -0,0 +1,67 @@
+#ifndef IMAGE_SOURCE_H
+#define IMAGE_SOURCE_H
+
+#include <QString>
+#include <QStringList>
+
+#include "opencv2/opencv.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+/** \brief Images produced on demand by index, so a viewer only holds the few it shows.
+  * image() may be called from several threads at once.
+  */
+class ImageSource {
+public:
+    typedef std::shared_ptr<ImageSource> Ptr;
+
+    virtual ~ImageSource() {}
+
+    virtual int size() const = 0;
+
+    /** \brief Empty when the image can not be produced. */
+    virtual cv::Mat image(const int& index) const = 0;
+};
+
+/** \brief Images already in memory, for callers that have them all anyway. */
+class VectorImageSource : public ImageSource {
+public:
+    explicit VectorImageSource(std::vector<cv::Mat> images);
+
+    int size() const;
+    cv::Mat image(const int& index) const;
+
+private:
+    const std::vector<cv::Mat> images;
+};
+
+/** \brief Image files decoded when they are asked for. */
+class FileImageSource : public ImageSource {
+public:
+    explicit FileImageSource(const QStringList& filenames);
+
+    int size() const;
+    cv::Mat image(const int& index) const;
+
+private:
+    const QStringList filenames;
+};
+
+/** \brief Images made by a callback, such as match images drawn again from stored keypoints. */
+class CallbackImageSource : public ImageSource {
+public:
+    typedef std::function<cv::Mat(const int&)> Callback;
+
+    CallbackImageSource(const int& count, const Callback& callback);
+
+    int size() const;
+    cv::Mat image(const int& index) const;
+
+private:
+    const int count;
+    const Callback callback;
+};
+
+#endif // IMAGE_SOURCE_H
@@ -18,12 +18,29 @@
 #include "opencv2/opencv.hpp"
 #include "opencv2/stitching/stitcher.hpp"
 
+#include <future>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "gui/imagesource.h"
+
+/** \brief Pages through the images of an ImageSource. Images are decoded when shown and kept scaled
+  * to the window in a small LRU cache, the neighbours of the current one are prefetched on the pool.
+  */
 class ImagesViewerWidget : public QWidget {
     Q_OBJECT
 
 public:
     ImagesViewerWidget(std::vector<cv::Mat> images_vector, QString window_title);
 
+    ImagesViewerWidget(const ImageSource::Ptr& image_source, QString window_title);
+
+    /** \brief Waits for the prefetches in flight, they fill this widget's cache. */
+    ~ImagesViewerWidget();
+
 protected:
     void mousePressEvent(QMouseEvent* e);
 
@@ -33,7 +50,15 @@ private:
 
     int image_index;
 
-    std::vector<QImage> imagesVector;
+    ImageSource::Ptr source;
+
+    //Guards the cache, prefetches fill it from the pool threads
+    std::mutex cache_mutex;
+    /** \brief Most recently used first. */
+    std::list<int> cache_order;
+    std::unordered_map<int, std::pair<QImage, std::list<int>::iterator> > cache;
+    std::set<int> pending;
+    std::vector<std::future<void> > prefetches;
 
     QVBoxLayout* vBox;
     QImage mainImage;
@@ -42,7 +67,17 @@ private:
 
     QString title;
 
-    QImage Mat2QImage(cv::Mat const& src);
+    QImage Mat2QImage(cv::Mat const& src) const;
+
+    /** \brief Decoded and scaled down to the window size, null when the source has no image. */
+    QImage thumbnail(const int& index) const;
+
+    QImage cached_thumbnail(const int& index);
+    void insert_thumbnail(const int& index, const QImage& image);
+
+    void prefetch_neighbours(const int& index);
+
+    void show_image(const int& index);
 
 private slots:
     void slot_change_image(int);
@@ -0,0 +1,64 @@
+#include "gui/imagesource.h"
+
+#include <stdexcept>
+
+VectorImageSource::VectorImageSource(std::vector<cv::Mat> images_)
+    : images(std::move(images_))
+{
+}
+
+int VectorImageSource::size() const
+{
+    return int(images.size());
+}
+
+cv::Mat VectorImageSource::image(const int& index) const
+{
+    if (index < 0 || index >= size()) {
+        throw std::invalid_argument("VectorImageSource::image index < 0 || index >= size()");
+    }
+
+    return images[index];
+}
+
+FileImageSource::FileImageSource(const QStringList& filenames_)
+    : filenames(filenames_)
+{
+}
+
+int FileImageSource::size() const
+{
+    return filenames.size();
+}
+
+cv::Mat FileImageSource::image(const int& index) const
+{
+    if (index < 0 || index >= size()) {
+        throw std::invalid_argument("FileImageSource::image index < 0 || index >= size()");
+    }
+
+    return cv::imread(filenames[index].toStdString(), CV_LOAD_IMAGE_COLOR);
+}
+
+CallbackImageSource::CallbackImageSource(const int& count_, const Callback& callback_)
+    : count(count_)
+    , callback(callback_)
+{
+    if (count < 0 || !callback) {
+        throw std::invalid_argument("CallbackImageSource::CallbackImageSource count < 0 || !callback");
+    }
+}
+
+int CallbackImageSource::size() const
+{
+    return count;
+}
+
+cv::Mat CallbackImageSource::image(const int& index) const
+{
+    if (index < 0 || index >= size()) {
+        throw std::invalid_argument("CallbackImageSource::image index < 0 || index >= size()");
+    }
+
+    return callback(index);
+}
@@ -1,29 +1,45 @@
 #include "gui/imagesviewerwidget.h"
 
+#include "utility/threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+const int CACHE_SIZE = 8;
+const int PREFETCH_RADIUS = 2;
+
+//Larger images are shown scaled down, only the scaled copy is cached
+const QSize MAX_IMAGE_SIZE(1280, 960);
+}
+
 ImagesViewerWidget::ImagesViewerWidget(std::vector<cv::Mat> images_vector, QString window_title)
+    : ImagesViewerWidget(ImageSource::Ptr(new VectorImageSource(std::move(images_vector))), window_title)
+{
+}
+
+ImagesViewerWidget::ImagesViewerWidget(const ImageSource::Ptr& image_source, QString window_title)
+    : width(0)
+    , height(0)
+    , image_index(0)
+    , source(image_source)
 {
     setParent(0);
 
-    if (images_vector.empty() == false) {
+    if (source && source->size() > 0) {
         title = window_title;
 
-        for (size_t i = 0; i < images_vector.size(); i++)
-            imagesVector.push_back(Mat2QImage(images_vector[i]));
-
-        image_index = 0;
-
-        width = imagesVector[0].width();
-        height = imagesVector[0].height();
+        const QImage first = thumbnail(0);
+        width = first.width();
+        height = first.height();
         resize(width, height);
-
-        mainImage = imagesVector[0];
+        insert_thumbnail(0, first);
 
         mainLabel = new QLabel("");
-        mainLabel->setPixmap(QPixmap::fromImage(mainImage));
         mainLabel->resize(width, height);
 
         slider = new QSlider(Qt::Horizontal);
-        slider->setRange(0, imagesVector.size() - 1);
+        slider->setRange(0, source->size() - 1);
         slider->setTickInterval(10);
         slider->setSingleStep(1);
         connect(slider, SIGNAL(sliderMoved(int)),
@@ -35,44 +51,39 @@ ImagesViewerWidget::ImagesViewerWidget(std::vector<cv::Mat> images_vector, QStri
 
         setLayout(vBox);
 
-        setWindowTitle(QString("%1 Image #%2").arg(title).arg(image_index));
-    }
-
-    if (imagesVector.empty() == false)
+        show_image(0);
         show();
-    else
+    } else {
         close();
+    }
 }
 
-void ImagesViewerWidget::mousePressEvent(QMouseEvent* e)
+ImagesViewerWidget::~ImagesViewerWidget()
 {
-    if (e->buttons() == Qt::RightButton) {
-        if (image_index + 1 < imagesVector.size()) {
-            image_index++;
+    for (auto& prefetch : prefetches) {
+        ThreadPool::instance().wait(prefetch);
+    }
+}
 
-            mainImage = imagesVector[image_index];
-            mainLabel->setPixmap(QPixmap::fromImage(mainImage));
-            mainLabel->resize(width, height);
-            mainLabel->repaint();
+void ImagesViewerWidget::mousePressEvent(QMouseEvent* e)
+{
+    if (!source) {
+        return;
+    }
 
-            setWindowTitle(QString("%1 Image #%2").arg(title).arg(image_index));
+    if (e->buttons() == Qt::RightButton) {
+        if (image_index + 1 < source->size()) {
+            show_image(image_index + 1);
         }
     }
     if (e->buttons() == Qt::LeftButton) {
         if (image_index - 1 >= 0) {
-            image_index--;
-
-            mainImage = imagesVector[image_index];
-            mainLabel->setPixmap(QPixmap::fromImage(mainImage));
-            mainLabel->resize(width, height);
-            mainLabel->repaint();
-
-            setWindowTitle(QString("%1 Image #%2").arg(title).arg(image_index));
+            show_image(image_index - 1);
         }
     }
 }
 
-QImage ImagesViewerWidget::Mat2QImage(cv::Mat const& src)
+QImage ImagesViewerWidget::Mat2QImage(cv::Mat const& src) const
 {
     cv::Mat temp;
     cvtColor(src, temp, CV_BGR2RGB);
@@ -82,14 +93,108 @@ QImage ImagesViewerWidget::Mat2QImage(cv::Mat const& src)
     return dest2;
 }
 
-void ImagesViewerWidget::slot_change_image(int index)
+QImage ImagesViewerWidget::thumbnail(const int& index) const
+{
+    const cv::Mat image = source->image(index);
+    if (image.empty()) {
+        return QImage();
+    }
+
+    const QImage full = Mat2QImage(image);
+    if (full.width() > MAX_IMAGE_SIZE.width() || full.height() > MAX_IMAGE_SIZE.height()) {
+        return full.scaled(MAX_IMAGE_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    return full;
+}
+
+QImage ImagesViewerWidget::cached_thumbnail(const int& index)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        const auto cached = cache.find(index);
+        if (cached != cache.end()) {
+            cache_order.splice(cache_order.begin(), cache_order, cached->second.second);
+            return cached->second.first;
+        }
+    }
+
+    const QImage image = thumbnail(index);
+    insert_thumbnail(index, image);
+    return image;
+}
+
+void ImagesViewerWidget::insert_thumbnail(const int& index, const QImage& image)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache.count(index) != 0) {
+        return;
+    }
+
+    cache_order.push_front(index);
+    cache[index] = std::make_pair(image, cache_order.begin());
+    while (int(cache.size()) > CACHE_SIZE) {
+        cache.erase(cache_order.back());
+        cache_order.pop_back();
+    }
+}
+
+void ImagesViewerWidget::prefetch_neighbours(const int& index)
+{
+    //Finished prefetches are dropped, the rest is waited for on destruction
+    prefetches.erase(std::remove_if(prefetches.begin(), prefetches.end(),
+                         [](const std::future<void>& prefetch) {
+                             return prefetch.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                         }),
+        prefetches.end());
+
+    for (int distance = 1; distance <= PREFETCH_RADIUS; ++distance) {
+        for (const int& neighbour : { index + distance, index - distance }) {
+            if (neighbour < 0 || neighbour >= source->size()) {
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex);
+                if (cache.count(neighbour) != 0 || !pending.insert(neighbour).second) {
+                    continue;
+                }
+            }
+
+            prefetches.push_back(ThreadPool::instance().submit([this, neighbour]() {
+                QImage image;
+                try {
+                    image = thumbnail(neighbour);
+                } catch (const std::exception& e) {
+                    qDebug() << "ImagesViewerWidget prefetch of" << neighbour << "failed:" << e.what();
+                }
+                {
+                    std::lock_guard<std::mutex> lock(cache_mutex);
+                    pending.erase(neighbour);
+                }
+                if (!image.isNull()) {
+                    insert_thumbnail(neighbour, image);
+                }
+            }));
+        }
+    }
+}
+
+void ImagesViewerWidget::show_image(const int& index)
 {
     image_index = index;
 
-    mainImage = imagesVector[image_index];
+    mainImage = cached_thumbnail(image_index);
     mainLabel->setPixmap(QPixmap::fromImage(mainImage));
     mainLabel->resize(width, height);
     mainLabel->repaint();
 
     setWindowTitle(QString("%1 Image #%2").arg(title).arg(image_index));
-}
\ No newline at end of file
+
+    prefetch_neighbours(image_index);
+}
+
+void ImagesViewerWidget::slot_change_image(int index)
+{
+    show_image(index);
+}
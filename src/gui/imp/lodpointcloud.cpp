@@ -0,0 +1,222 @@
+#include "gui/lodpointcloud.h"
+
+#include <pcl/common/point_tests.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+const int KEY_BITS = 21;
+const int64_t KEY_OFFSET = int64_t(1) << (KEY_BITS - 1);
+const uint64_t KEY_MASK = (uint64_t(1) << KEY_BITS) - 1;
+
+Eigen::Vector3i floor_index(const Eigen::Vector3f& point, const float& size)
+{
+    return Eigen::Vector3i(int(std::floor(point.x() / size)), int(std::floor(point.y() / size)),
+        int(std::floor(point.z() / size)));
+}
+
+} // namespace
+
+LodPointCloud::LodPointCloud(const float& chunk_size_, const float& voxel_size_, const int& levels_count_,
+    const float& lod_distance_, const size_t& max_points_)
+    : chunk_size(chunk_size_)
+    , voxel_size(voxel_size_)
+    , levels_count(std::max(1, levels_count_))
+    , lod_distance(lod_distance_)
+    , max_points(max_points_)
+{
+    if (voxel_size <= 0 || chunk_size < voxel_size) {
+        throw std::invalid_argument("LodPointCloud::LodPointCloud voxel_size <= 0 || chunk_size < voxel_size");
+    }
+}
+
+void LodPointCloud::addCloud(const Pcd& cloud)
+{
+    for (const PointType& point : cloud.points) {
+        if (!pcl::isFinite(point)) {
+            continue;
+        }
+
+        const Eigen::Vector3f position(point.x, point.y, point.z);
+        const Eigen::Vector3i chunk_coordinates = floor_index(position, chunk_size);
+        const auto inserted = chunks.insert(std::make_pair(pack_key(chunk_coordinates), Chunk()));
+        Chunk& chunk = inserted.first->second;
+        if (inserted.second) {
+            chunk.center = (chunk_coordinates.cast<float>() + Eigen::Vector3f::Constant(0.5f)) * chunk_size;
+            chunk.level = -1;
+        }
+        chunk.dirty = true;
+
+        const uint64_t voxel_key = pack_key(floor_index(position, voxel_size));
+        const auto voxel = chunk.voxel_ids.insert(std::make_pair(voxel_key, uint32_t(chunk.voxels.size())));
+        if (voxel.second) {
+            chunk.voxels.push_back({ Eigen::Vector3f::Zero(), 0, 0, 0, 0 });
+            chunk.voxel_keys.push_back(voxel_key);
+        }
+
+        Accumulator& accumulator = chunk.voxels[voxel.first->second];
+        accumulator.position += position;
+        accumulator.r += point.r;
+        accumulator.g += point.g;
+        accumulator.b += point.b;
+        ++accumulator.count;
+    }
+}
+
+std::vector<uint64_t> LodPointCloud::update(const Eigen::Vector3f& camera)
+{
+    struct Entry {
+        Chunk* chunk;
+        uint64_t key;
+        float distance;
+        int level;
+    };
+
+    std::vector<Entry> entries;
+    entries.reserve(chunks.size());
+    size_t total_points = 0;
+    for (auto& chunk : chunks) {
+        const float distance = (chunk.second.center - camera).norm();
+        const int level = level_of_distance(distance);
+        entries.push_back({ &chunk.second, chunk.first, distance, level });
+        total_points += level_points(chunk.second, level);
+    }
+
+    //Over the budget the farthest chunks are coarsened first, one level per pass
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.distance > b.distance || (a.distance == b.distance && a.key < b.key);
+    });
+    bool coarsened = true;
+    while (max_points > 0 && total_points > max_points && coarsened) {
+        coarsened = false;
+        for (size_t i = 0; i < entries.size() && total_points > max_points; ++i) {
+            Entry& entry = entries[i];
+            if (entry.level + 1 < levels_count) {
+                total_points -= level_points(*entry.chunk, entry.level);
+                ++entry.level;
+                total_points += level_points(*entry.chunk, entry.level);
+                coarsened = true;
+            }
+        }
+    }
+
+    std::vector<uint64_t> changed;
+    for (const Entry& entry : entries) {
+        if (entry.chunk->dirty || entry.chunk->level != entry.level || !entry.chunk->display) {
+            build_display(*entry.chunk, entry.level);
+            changed.push_back(entry.key);
+        }
+    }
+
+    return changed;
+}
+
+PcdPtr LodPointCloud::chunkCloud(const uint64_t& key) const
+{
+    const auto chunk = chunks.find(key);
+    if (chunk == chunks.end() || !chunk->second.display) {
+        return PcdPtr(new Pcd);
+    }
+
+    return chunk->second.display;
+}
+
+void LodPointCloud::invalidate()
+{
+    for (auto& chunk : chunks) {
+        chunk.second.dirty = true;
+    }
+}
+
+void LodPointCloud::clear()
+{
+    chunks.clear();
+}
+
+size_t LodPointCloud::chunksCount() const
+{
+    return chunks.size();
+}
+
+size_t LodPointCloud::displayedPoints() const
+{
+    size_t result = 0;
+    for (const auto& chunk : chunks) {
+        result += chunk.second.display ? chunk.second.display->size() : 0;
+    }
+
+    return result;
+}
+
+uint64_t LodPointCloud::pack_key(const Eigen::Vector3i& coordinates)
+{
+    return (uint64_t(coordinates.x() + KEY_OFFSET) & KEY_MASK)
+        | ((uint64_t(coordinates.y() + KEY_OFFSET) & KEY_MASK) << KEY_BITS)
+        | ((uint64_t(coordinates.z() + KEY_OFFSET) & KEY_MASK) << (2 * KEY_BITS));
+}
+
+Eigen::Vector3i LodPointCloud::unpack_key(const uint64_t& key)
+{
+    return Eigen::Vector3i(int(int64_t(key & KEY_MASK) - KEY_OFFSET),
+        int(int64_t((key >> KEY_BITS) & KEY_MASK) - KEY_OFFSET),
+        int(int64_t((key >> (2 * KEY_BITS)) & KEY_MASK) - KEY_OFFSET));
+}
+
+int LodPointCloud::level_of_distance(const float& distance) const
+{
+    if (lod_distance <= 0 || distance <= lod_distance) {
+        return 0;
+    }
+
+    return std::min(levels_count - 1, int(std::floor(std::log2(distance / lod_distance))) + 1);
+}
+
+size_t LodPointCloud::level_points(const Chunk& chunk, const int& level) const
+{
+    return std::max<size_t>(1, chunk.voxels.size() >> (2 * level));
+}
+
+void LodPointCloud::build_display(Chunk& chunk, const int& level) const
+{
+    //Finest voxels are grouped by their level voxel, floor division by 2^level of the coordinates
+    std::unordered_map<uint64_t, Accumulator> groups;
+    groups.reserve(level_points(chunk, level));
+    for (size_t i = 0; i < chunk.voxels.size(); ++i) {
+        Eigen::Vector3i coordinates = unpack_key(chunk.voxel_keys[i]);
+        for (int axis = 0; axis < 3; ++axis) {
+            coordinates[axis] >>= level;
+        }
+
+        const Accumulator& voxel = chunk.voxels[i];
+        Accumulator& group = groups.insert(std::make_pair(pack_key(coordinates),
+                                               Accumulator{ Eigen::Vector3f::Zero(), 0, 0, 0, 0 }))
+                                 .first->second;
+        group.position += voxel.position;
+        group.r += voxel.r;
+        group.g += voxel.g;
+        group.b += voxel.b;
+        group.count += voxel.count;
+    }
+
+    PcdPtr display(new Pcd);
+    display->points.reserve(groups.size());
+    for (const auto& group : groups) {
+        const Accumulator& sum = group.second;
+        PointType point;
+        point.getVector3fMap() = sum.position / float(sum.count);
+        point.r = uint8_t(sum.r / sum.count);
+        point.g = uint8_t(sum.g / sum.count);
+        point.b = uint8_t(sum.b / sum.count);
+        display->points.push_back(point);
+    }
+    display->width = uint32_t(display->points.size());
+    display->height = 1;
+    display->is_dense = true;
+
+    chunk.display = display;
+    chunk.level = level;
+    chunk.dirty = false;
+}
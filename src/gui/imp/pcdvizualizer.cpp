@@ -1,163 +1,327 @@
 #include "gui/pcdvizualizer.h"
 
 #include <pcl/common/distances.h>
+#include <pcl/conversions.h>
 #include <pcl/visualization/pcl_plotter.h>
 
 #include <boost/random.hpp>
 #include <boost/random/normal_distribution.hpp>
 
+#include <vtkCellArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkUnsignedCharArray.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+
+#include "utility/hash.h"
+#include "utility/log.h"
+
+namespace {
+const char* const MESH_ID = "tsdf_mesh";
+const char* const PREVIEW_MESH_ID = "tsdf_preview_mesh";
+const char* const DEBUG_TEXT_ID = "debug_text";
+const char* const VOLUME_CUBE_ID = "volume_cube";
+const char* const CAMERA_GLYPHS_ID = "camera_poses";
+
+//Apex at the camera and four corners of the image plane, looking down +z
+const int FRUSTUM_POINTS = 5;
+const float FRUSTUM_CORNERS[4][2] = { { -0.5f, -0.375f }, { 0.5f, -0.375f }, { 0.5f, 0.375f }, { -0.5f, 0.375f } };
+
+const int RENDER_INTERVAL_MS = 10;
+
+std::string lod_chunk_id(const uint64_t& key)
+{
+    return QString("lod_chunk_%1").arg(key).toStdString();
+}
+
+std::string item_id(const std::string& prefix, const qint64& key)
+{
+    return QString("%1_%2").arg(QString::fromStdString(prefix)).arg(key).toStdString();
+}
+
+uint64_t chunk_key(const Eigen::Vector3f& point, const float& chunk_size)
+{
+    const uint64_t x = uint64_t(int64_t(std::floor(point.x() / chunk_size)) + (1 << 20)) & 0x1FFFFF;
+    const uint64_t y = uint64_t(int64_t(std::floor(point.y() / chunk_size)) + (1 << 20)) & 0x1FFFFF;
+    const uint64_t z = uint64_t(int64_t(std::floor(point.z() / chunk_size)) + (1 << 20)) & 0x1FFFFF;
+    return x | (y << 21) | (z << 42);
+}
+
+/** \brief Triangles by the chunk of their first vertex, every chunk with its own vertices in first use
+  * order, so a chunk keeps its content hash while its triangles do not change.
+  */
+std::map<uint64_t, pcl::PolygonMesh> split_mesh(const pcl::PolygonMesh& mesh, const float& chunk_size,
+    std::map<uint64_t, uint64_t>& hashes)
+{
+    pcl::PointCloud<pcl::PointXYZRGB> vertices;
+    pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+
+    std::map<uint64_t, std::vector<size_t> > chunk_polygons;
+    for (size_t i = 0; i < mesh.polygons.size(); ++i) {
+        const std::vector<uint32_t>& ids = mesh.polygons[i].vertices;
+        if (!ids.empty() && ids[0] < vertices.size()) {
+            chunk_polygons[chunk_key(vertices.points[ids[0]].getVector3fMap(), chunk_size)].push_back(i);
+        }
+    }
+
+    std::map<uint64_t, pcl::PolygonMesh> result;
+    for (const auto& chunk : chunk_polygons) {
+        pcl::PointCloud<pcl::PointXYZRGB> chunk_vertices;
+        std::unordered_map<uint32_t, uint32_t> local_ids;
+        pcl::PolygonMesh& chunk_mesh = result[chunk.first];
+        uint64_t hash = hash::FNV_OFFSET_BASIS;
+        for (const size_t& polygon : chunk.second) {
+            pcl::Vertices local;
+            for (const uint32_t& id : mesh.polygons[polygon].vertices) {
+                const auto inserted = local_ids.insert(std::make_pair(id, uint32_t(chunk_vertices.size())));
+                if (inserted.second) {
+                    const pcl::PointXYZRGB& vertex = vertices.points[id];
+                    chunk_vertices.push_back(vertex);
+                    hash = hash::fnv1a(vertex.data, 3 * sizeof(float), hash);
+                    hash = hash::fnv1a_value(vertex.rgba, hash);
+                }
+                local.vertices.push_back(inserted.first->second);
+            }
+            hash = hash::fnv1a(local.vertices.data(), local.vertices.size() * sizeof(uint32_t), hash);
+            chunk_mesh.polygons.push_back(local);
+        }
+        pcl::toPCLPointCloud2(chunk_vertices, chunk_mesh.cloud);
+        hashes[chunk.first] = hash;
+    }
+
+    return result;
+}
+}
+
 PcdVizualizer::PcdVizualizer(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
-    , viewer(new pcl::visualization::PCLVisualizer("3D Viewer"))
+    , stopped(false)
+    , quit(false)
+    , lod_camera(Eigen::Vector3f::Zero())
+    , lod_chunk_size(configs.value("VISUALIZATOR_SETTINGS/LOD_CHUNK_SIZE").toFloat())
+    , mesh_chunk_size(std::max(0.01f, configs.value("VISUALIZATOR_SETTINGS/MESH_CHUNK_SIZE").toFloat()))
+    , camera_glyph_size(project.value("VISUALIZATION/CAMERA_SPHERE_RADIUS").toFloat())
+    , unindexed_frames(0)
 {
-    viewer->setBackgroundColor(
+    if (configs.value("VISUALIZATOR_SETTINGS/LOD_POINT_CLOUDS").toBool()) {
+        lod_cloud.reset(new LodPointCloud(
+            lod_chunk_size,
+            configs.value("VISUALIZATOR_SETTINGS/LOD_VOXEL_SIZE").toFloat(),
+            configs.value("VISUALIZATOR_SETTINGS/LOD_LEVELS").toInt(),
+            configs.value("VISUALIZATOR_SETTINGS/LOD_DISTANCE").toFloat(),
+            configs.value("VISUALIZATOR_SETTINGS/LOD_MAX_POINTS").toUInt()));
+    }
+
+    const Eigen::Vector3d background(
         configs.value("VISUALIZATOR_SETTINGS/BG_R").toDouble() / 255.0f,
         configs.value("VISUALIZATOR_SETTINGS/BG_G").toDouble() / 255.0f,
         configs.value("VISUALIZATOR_SETTINGS/BG_B").toDouble() / 255.0f);
-    visualize_debug_text();
+    const float axis_size = configs.value("VISUALIZATOR_SETTINGS/DRAW_AXIS").toBool()
+        ? configs.value("VISUALIZATOR_SETTINGS/AXIS_SIZE").toFloat()
+        : 0;
+    render_thread = std::thread(&PcdVizualizer::render_loop, this, background, axis_size, debug_text_command());
+}
 
-    if (configs.value("VISUALIZATOR_SETTINGS/DRAW_AXIS").toBool()) {
-        viewer->addCoordinateSystem(configs.value("VISUALIZATOR_SETTINGS/AXIS_SIZE").toFloat());
-    }
-    viewer->initCameraParameters();
-    viewer->spinOnce(100);
+PcdVizualizer::~PcdVizualizer()
+{
+    quit = true;
+    render_thread.join();
+}
+
+bool PcdVizualizer::enabled() const
+{
+    return true;
 }
 
 void PcdVizualizer::redraw()
 {
-    viewer->removeAllShapes();
-    viewer->removeAllPointClouds();
-    visualize_debug_text();
+    const Command debug_text = debug_text_command();
 
     //Draw volume cude
-    if (configs.value("CPU_TSDF_SETTINGS/DRAW_VOLUME_CUBE").toBool()) {
-        const double x_vol = configs.value("CPU_TSDF_SETTINGS/X_VOL").toDouble();
-        const double y_vol = configs.value("CPU_TSDF_SETTINGS/Y_VOL").toDouble();
-        const double z_vol = configs.value("CPU_TSDF_SETTINGS/Z_VOL").toDouble();
-        const double x_shift = configs.value("CPU_TSDF_SETTINGS/X_SHIFT").toDouble();
-        const double y_shift = configs.value("CPU_TSDF_SETTINGS/Y_SHIFT").toDouble();
-        const double z_shift = configs.value("CPU_TSDF_SETTINGS/Z_SHIFT").toDouble();
-
-        viewer->addCube(-(x_vol / 2.0f) + x_shift, (x_vol / 2.0f) + x_shift,
-            -(y_vol / 2.0f) + y_shift, (y_vol / 2.0f) + y_shift,
-            -(z_vol / 2.0f) + z_shift, (z_vol / 2.0f) + z_shift);
-    }
+    const bool draw_cube = configs.value("CPU_TSDF_SETTINGS/DRAW_VOLUME_CUBE").toBool();
+    const double x_vol = configs.value("CPU_TSDF_SETTINGS/X_VOL").toDouble();
+    const double y_vol = configs.value("CPU_TSDF_SETTINGS/Y_VOL").toDouble();
+    const double z_vol = configs.value("CPU_TSDF_SETTINGS/Z_VOL").toDouble();
+    const double x_shift = configs.value("CPU_TSDF_SETTINGS/X_SHIFT").toDouble();
+    const double y_shift = configs.value("CPU_TSDF_SETTINGS/Y_SHIFT").toDouble();
+    const double z_shift = configs.value("CPU_TSDF_SETTINGS/Z_SHIFT").toDouble();
+
+    enqueue([=](pcl::visualization::PCLVisualizer& viewer) {
+        debug_text(viewer);
+
+        viewer.removeShape(VOLUME_CUBE_ID);
+        if (draw_cube) {
+            viewer.addCube(-(x_vol / 2.0f) + x_shift, (x_vol / 2.0f) + x_shift,
+                -(y_vol / 2.0f) + y_shift, (y_vol / 2.0f) + y_shift,
+                -(z_vol / 2.0f) + z_shift, (z_vol / 2.0f) + z_shift, 1.0, 1.0, 1.0, VOLUME_CUBE_ID);
+        }
+    });
+}
+
+void PcdVizualizer::clear()
+{
+    camera_glyph_size = project.value("VISUALIZATION/CAMERA_SPHERE_RADIUS").toFloat();
+
+    const Command debug_text = debug_text_command();
+    enqueue([this, debug_text](pcl::visualization::PCLVisualizer& viewer) {
+        viewer.removeAllShapes();
+        viewer.removeAllPointClouds();
+        if (lod_cloud) {
+            lod_cloud->clear();
+        }
+        mesh_chunks.clear();
+        preview_chunks.clear();
+        keypoint_set_sizes.clear();
+        camera_pose_sets.clear();
+        camera_glyphs = nullptr;
+        debug_text(viewer);
+    });
 }
 
+/** \brief The clouds are held, not copied, frames detach their clouds before modifying them in place. */
 void PcdVizualizer::visualizePointClouds(const Frames& frames)
 {
-    const int rand_num = rand();
-    for (int i = 0; i < frames.size(); i++) {
-        pcl::visualization::PointCloudColorHandlerRGBField<PointType> rgb(frames[i].pointCloudPtr);
-        viewer->addPointCloud<PointType>(
-            frames[i].pointCloudPtr, rgb, QString("Cloud #%1").arg(i + rand_num).toStdString());
+    PcdPtrVector clouds;
+    for (const Frame& frame : frames) {
+        clouds.push_back(frame.worldPointCloud());
     }
+
+    if (lod_cloud) {
+        enqueue([this, clouds](pcl::visualization::PCLVisualizer& viewer) {
+            for (const PcdPtr& cloud : clouds) {
+                lod_cloud->addCloud(*cloud);
+            }
+            update_lod_cloud(viewer);
+        });
+        return;
+    }
+
+    //Frames not read from a project get ids of their own
+    std::vector<std::string> ids;
+    for (const Frame& frame : frames) {
+        ids.push_back(frame.frameIndex >= 0 ? item_id("frame", frame.frameIndex)
+                                            : item_id("unindexed_frame", unindexed_frames++));
+    }
+
+    enqueue([clouds, ids](pcl::visualization::PCLVisualizer& viewer) {
+        for (size_t i = 0; i < clouds.size(); i++) {
+            pcl::visualization::PointCloudColorHandlerRGBField<PointType> rgb(clouds[i]);
+            if (!viewer.updatePointCloud<PointType>(clouds[i], rgb, ids[i])) {
+                viewer.addPointCloud<PointType>(clouds[i], rgb, ids[i]);
+            }
+        }
+    });
 }
 
-void PcdVizualizer::visualizeKeypointClouds(const KeypointsFrames& keypointsFrames)
+void PcdVizualizer::visualizeKeypointClouds(const KeypointsFrames& keypointsFrames, const QString& set_id)
 {
-    if (keypointsFrames.empty() == false) {
-        const int rand_num = rand();
+    if (keypointsFrames.empty()) {
+        return;
+    }
+
+    const bool draw_first_last = configs.value("VISUALIZATOR_SETTINGS/DRAW_FIRST_LAST_KP_CLOUDS").toBool();
+    const bool draw_pare_second = configs.value("VISUALIZATOR_SETTINGS/DRAW_PARE_SECOND_KP_CLOUD").toBool();
+    const bool draw_pare_first = configs.value("VISUALIZATOR_SETTINGS/DRAW_PARE_FIRST_KP_CLOUD").toBool();
+    const bool different_color_pares = configs.value("VISUALIZATOR_SETTINGS/DRAW_DIFFERENT_COLOR_PARES").toBool();
+    const std::string prefix = set_id.toStdString();
+
+    enqueue([=](pcl::visualization::PCLVisualizer& viewer) {
+        const auto draw_cloud = [&viewer](const PcdPtr& cloud, const int& r, const int& g, const int& b,
+                                    const int& point_size, const std::string& id) {
+            pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> color(cloud, r, g, b);
+            if (!viewer.updatePointCloud<PointType>(cloud, color, id)) {
+                viewer.addPointCloud<PointType>(cloud, color, id);
+            }
+            viewer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, point_size, id);
+        };
+
+        //A smaller set than the previous one of the same id leaves no stale items
+        const int count = int(keypointsFrames.size());
+        const int previous_count = keypoint_set_sizes[prefix];
+        for (int i = count; i < previous_count; i++) {
+            viewer.removeCorrespondences(item_id(prefix + "_correspondences", i));
+            viewer.removePointCloud(item_id(prefix + "_first", i));
+            viewer.removePointCloud(item_id(prefix + "_second", i));
+        }
+        keypoint_set_sizes[prefix] = count;
 
-        for (int i = 0; i < keypointsFrames.size(); i++) {
-            if (!keypointsFrames[i].keypointsPcdCorrespondences.empty())
-                viewer->addCorrespondences<PointType>(
+        for (int i = 0; i < count; i++) {
+            const std::string id = item_id(prefix + "_correspondences", i);
+            viewer.removeCorrespondences(id);
+            if (!keypointsFrames[i].keypointsPcdCorrespondences.empty()) {
+                viewer.addCorrespondences<PointType>(
                     keypointsFrames[i].keypointsPcdPair.first,
                     keypointsFrames[i].keypointsPcdPair.second,
-                    keypointsFrames[i].keypointsPcdCorrespondences,
-                    QString("Cor %1").arg(i + rand_num).toStdString());
+                    keypointsFrames[i].keypointsPcdCorrespondences, id);
+            }
         }
 
-        if (configs.value("VISUALIZATOR_SETTINGS/DRAW_FIRST_LAST_KP_CLOUDS").toBool()) {
-            pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> single_color2(
-                keypointsFrames[0].keypointsPcdPair.first, 0, 0, 0);
-            viewer->addPointCloud<PointType>(
-                keypointsFrames[0].keypointsPcdPair.first,
-                single_color2, QString("Cloud P1 %1").arg(0 + rand_num).toStdString());
-            viewer->setPointCloudRenderingProperties(
-                pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 6,
-                QString("Cloud P1 %1").arg(0 + rand_num).toStdString());
-
-            pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> single_color3(
-                keypointsFrames[keypointsFrames.size() - 1].keypointsPcdPair.second, 0, 255, 0);
-            viewer->addPointCloud<PointType>(
-                keypointsFrames[keypointsFrames.size() - 1].keypointsPcdPair.second,
-                single_color3,
-                QString("Cloud P2 %1").arg(keypointsFrames.size() - 1 + rand_num).toStdString());
-            viewer->setPointCloudRenderingProperties(
-                pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 6,
-                QString("Cloud P2 %1").arg(keypointsFrames.size() - 1 + rand_num).toStdString());
+        if (draw_first_last) {
+            draw_cloud(keypointsFrames[0].keypointsPcdPair.first, 0, 0, 0, 6, item_id(prefix + "_first", 0));
+            draw_cloud(keypointsFrames[count - 1].keypointsPcdPair.second, 0, 255, 0, 6,
+                item_id(prefix + "_second", count - 1));
         }
 
-        for (int i = 1; i < keypointsFrames.size(); i++) {
+        for (int i = 1; i < count; i++) {
             int r1, g1, b1;
             if (i % 2 == 0) {
-                r1 = 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
+                r1 = 255.0f * ((float)(i + 1) / (float)count);
                 g1 = 0;
-                b1 = 255.0f - 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
+                b1 = 255.0f - 255.0f * ((float)(i + 1) / (float)count);
             } else {
-                r1 = 255.0f - 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
+                r1 = 255.0f - 255.0f * ((float)(i + 1) / (float)count);
                 g1 = 0;
-                b1 = 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
+                b1 = 255.0f * ((float)(i + 1) / (float)count);
             }
 
-            if (configs.value("VISUALIZATOR_SETTINGS/DRAW_PARE_SECOND_KP_CLOUD").toBool()) {
-                pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> single_color1(
-                    keypointsFrames[i - 1].keypointsPcdPair.second, r1, g1, b1);
-                viewer->addPointCloud<PointType>(
-                    keypointsFrames[i - 1].keypointsPcdPair.second,
-                    single_color1,
-                    QString("Cloud P2 %1").arg(i - 1 + rand_num).toStdString());
-                viewer->setPointCloudRenderingProperties(
-                    pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 6,
-                    QString("Cloud P2 %1").arg(i - 1 + rand_num).toStdString());
+            if (draw_pare_second) {
+                draw_cloud(keypointsFrames[i - 1].keypointsPcdPair.second, r1, g1, b1, 6,
+                    item_id(prefix + "_second", i - 1));
             }
 
-            if (configs.value("VISUALIZATOR_SETTINGS/DRAW_PARE_FIRST_KP_CLOUD").toBool()) {
-                if (configs.value("VISUALIZATOR_SETTINGS/DRAW_DIFFERENT_COLOR_PARES").toBool()) {
+            if (draw_pare_first) {
+                if (different_color_pares) {
                     if (i % 2 == 0) {
-                        r1 = 255.0f - 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
-                        b1 = 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
+                        r1 = 255.0f - 255.0f * ((float)(i + 1) / (float)count);
+                        b1 = 255.0f * ((float)(i + 1) / (float)count);
                     } else {
-                        r1 = 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
-                        b1 = 255.0f - 255.0f * ((float)(i + 1) / (float)keypointsFrames.size());
+                        r1 = 255.0f * ((float)(i + 1) / (float)count);
+                        b1 = 255.0f - 255.0f * ((float)(i + 1) / (float)count);
                     }
                 }
 
-                pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> single_color(
-                    keypointsFrames[i].keypointsPcdPair.first, r1, g1, b1);
-                viewer->addPointCloud<PointType>(
-                    keypointsFrames[i].keypointsPcdPair.first,
-                    single_color,
-                    QString("Cloud P1 %1").arg(i + rand_num).toStdString());
-                viewer->setPointCloudRenderingProperties(
-                    pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 4,
-                    QString("Cloud P1 %1").arg(i + rand_num).toStdString());
+                draw_cloud(keypointsFrames[i].keypointsPcdPair.first, r1, g1, b1, 4, item_id(prefix + "_first", i));
             }
         }
-    }
+    });
 }
 
-void PcdVizualizer::visualizeCameraPoses(
-    const Matrix4fVector& final_translation_matrix_vector)
+void PcdVizualizer::visualizeCameraPoses(const Matrix4fVector& final_translation_matrix_vector,
+    const std::vector<float>& fitness_scores, const QString& set_id)
 {
-    std::vector<double> data(1, 0);
+    CameraPoseSet set;
+    set.poses = final_translation_matrix_vector;
+    set.fitness_scores = fitness_scores;
+    const std::string id = set_id.toStdString();
+
+    enqueue([this, set, id](pcl::visualization::PCLVisualizer& viewer) {
+        camera_pose_sets[id] = set;
+        update_camera_glyphs(viewer);
+    });
+}
 
-    const float radius = settings->value("VISUALIZATION/CAMERA_SPHERE_RADIUS").toFloat();
-    viewer->addSphere(PointType(), radius, QString("%1").arg(0 + std::rand()).toStdString());
+void PcdVizualizer::plotCameraPoses(const Matrix4fVector& final_translation_matrix_vector)
+{
+    std::vector<double> data(1, 0);
     for (int i = 1; i < final_translation_matrix_vector.size(); i++) {
-        PointType pA;
-        pA.x = final_translation_matrix_vector[i - 1](0, 3);
-        pA.y = final_translation_matrix_vector[i - 1](1, 3);
-        pA.z = final_translation_matrix_vector[i - 1](2, 3);
-
-        PointType pC;
-        pC.x = final_translation_matrix_vector[i](0, 3);
-        pC.y = final_translation_matrix_vector[i](1, 3);
-        pC.z = final_translation_matrix_vector[i](2, 3);
-
-        data.push_back(pcl::euclideanDistance(pcl::PointXYZ(pA.x, pA.y, pA.z), pcl::PointXYZ(pC.x, pC.y, pC.z)));
-        viewer->addSphere(pC, radius, QString("%1").arg(i + std::rand()).toStdString());
+        data.push_back((final_translation_matrix_vector[i].block<3, 1>(0, 3)
+                           - final_translation_matrix_vector[i - 1].block<3, 1>(0, 3))
+                           .norm());
     }
 
     plotNormalDistribution(data, "Camera distances Normal Distribution");
@@ -166,7 +330,17 @@ void PcdVizualizer::visualizeCameraPoses(
 
 void PcdVizualizer::visualizeMesh(const pcl::PolygonMesh& mesh)
 {
-    viewer->addPolygonMesh(mesh);
+    enqueue([this, mesh](pcl::visualization::PCLVisualizer& viewer) {
+        remove_mesh_chunks(viewer, PREVIEW_MESH_ID, preview_chunks);
+        update_mesh_chunks(viewer, mesh, MESH_ID, mesh_chunks);
+    });
+}
+
+void PcdVizualizer::visualizePreviewMesh(const pcl::PolygonMesh& mesh)
+{
+    enqueue([this, mesh](pcl::visualization::PCLVisualizer& viewer) {
+        update_mesh_chunks(viewer, mesh, PREVIEW_MESH_ID, preview_chunks);
+    });
 }
 
 void PcdVizualizer::plotNormalDistribution(const std::vector<double>& input_data, const char* title) const
@@ -205,14 +379,17 @@ void PcdVizualizer::plotNormalDistribution(const std::vector<double>& input_data
         xes.push_back(x / scale_factor);
     }
 
-    pcl::visualization::PCLPlotter* plotter = new pcl::visualization::PCLPlotter(title);
-    plotter->addPlotData(xes.data(), nd.data(), nd.size());
-    plotter->addPlotData(xes.data(), nd.data(), nd.size(), "Probability", vtkChart::BAR);
-    plotter->setYRange(0, 1);
-    plotter->setXTitle("X");
-    plotter->setYTitle("Probability");
-    plotter->setTitle("Standard deviation");
-    plotter->spinOnce();
+    const std::string plot_title(title);
+    enqueue([plot_title, xes, nd](pcl::visualization::PCLVisualizer&) {
+        pcl::visualization::PCLPlotter* plotter = new pcl::visualization::PCLPlotter(plot_title.c_str());
+        plotter->addPlotData(xes.data(), nd.data(), nd.size());
+        plotter->addPlotData(xes.data(), nd.data(), nd.size(), "Probability", vtkChart::BAR);
+        plotter->setYRange(0, 1);
+        plotter->setXTitle("X");
+        plotter->setYTitle("Probability");
+        plotter->setTitle("Standard deviation");
+        plotter->spinOnce();
+    });
 }
 
 void PcdVizualizer::plotCameraDistances(
@@ -228,25 +405,30 @@ void PcdVizualizer::plotCameraDistances(
     std::vector<double> xes(data.size());
     std::iota(xes.begin(), xes.end(), 0);
 
-    pcl::visualization::PCLPlotter* plotter = new pcl::visualization::PCLPlotter(name);
-    plotter->addPlotData(xes.data(), data.data(), data.size());
-    plotter->addPlotData(xes.data(), data.data(), data.size(), value, vtkChart::POINTS);
-    if (fixed_range) {
-        plotter->setYRange(0, 0.1f);
-    }
-    plotter->setTitle(name);
-    plotter->setXTitle("#");
-    plotter->setYTitle(value);
-    plotter->spinOnce();
+    const std::string plot_name(name);
+    const std::string plot_value(value);
+    enqueue([xes, data, fixed_range, plot_name, plot_value](pcl::visualization::PCLVisualizer&) {
+        pcl::visualization::PCLPlotter* plotter = new pcl::visualization::PCLPlotter(plot_name.c_str());
+        plotter->addPlotData(xes.data(), data.data(), data.size());
+        plotter->addPlotData(xes.data(), data.data(), data.size(), plot_value.c_str(), vtkChart::POINTS);
+        if (fixed_range) {
+            plotter->setYRange(0, 0.1f);
+        }
+        plotter->setTitle(plot_name.c_str());
+        plotter->setXTitle("#");
+        plotter->setYTitle(plot_value.c_str());
+        plotter->spinOnce();
+    });
 }
 
-void PcdVizualizer::spin(const uint& spin_time)
+bool PcdVizualizer::wasStopped() const
 {
-    if (!viewer) {
-        throw std::runtime_error("PcdVizualizer::spin !viewer");
-    }
+    return stopped;
+}
 
-    viewer->spinOnce(spin_time);
+void PcdVizualizer::spin(const uint& spin_time)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(spin_time));
 }
 
 //---------------------------------------------------------------
@@ -259,36 +441,237 @@ float PcdVizualizer::gaussian_pdf(const float& x, const float& u, const float& s
     return (1.0f / (sigma * std::sqrt(2.0f * M_PI))) * e;
 }
 
-void PcdVizualizer::visualize_debug_text()
+void PcdVizualizer::enqueue(Command command) const
 {
-    if (configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_ENABLE").toBool()) {
-        QString allGroupsString;
-        foreach (const QString& group, settings->childGroups()) {
-            if (settings->value(QString("%1/ENABLE_IN_VISUALIZATION").arg(group)).toBool()) {
-                QString groupString = QString("%1 \n").arg(group);
-                settings->beginGroup(group);
-
-                foreach (const QString& key, settings->childKeys()) {
-                    if (key != "ENABLE_IN_VISUALIZATION") {
-                        groupString.append(QString("%1: %2; ").arg(key, settings->value(key).toString()));
-                    }
-                }
+    if (stopped) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(commands_mutex);
+    commands.push_back(std::move(command));
+}
+
+/** \brief VTK is only ever touched here, the viewer is created and destroyed on this thread. */
+void PcdVizualizer::render_loop(const Eigen::Vector3d& background, const float& axis_size, const Command& debug_text)
+{
+    viewer.reset(new pcl::visualization::PCLVisualizer("3D Viewer"));
+    viewer->setBackgroundColor(background.x(), background.y(), background.z());
+    debug_text(*viewer);
+
+    if (axis_size > 0) {
+        viewer->addCoordinateSystem(axis_size);
+    }
+    viewer->initCameraParameters();
+    lod_camera = camera_position(*viewer);
+
+    while (!viewer->wasStopped()) {
+        std::deque<Command> pending;
+        {
+            std::lock_guard<std::mutex> lock(commands_mutex);
+            pending.swap(commands);
+        }
+        if (pending.empty() && quit) {
+            break;
+        }
+
+        for (const Command& command : pending) {
+            command(*viewer);
+        }
 
-                settings->endGroup();
-                groupString.append("\n\n");
+        viewer->spinOnce(RENDER_INTERVAL_MS);
 
-                allGroupsString.append(groupString);
+        //Levels only change past a quarter of a chunk
+        if (lod_cloud && (camera_position(*viewer) - lod_camera).norm() > lod_chunk_size / 4) {
+            update_lod_cloud(*viewer);
+        }
+    }
+
+    stopped = true;
+    {
+        std::lock_guard<std::mutex> lock(commands_mutex);
+        commands.clear();
+    }
+    viewer->close();
+    viewer.reset();
+}
+
+void PcdVizualizer::update_lod_cloud(pcl::visualization::PCLVisualizer& viewer)
+{
+    lod_camera = camera_position(viewer);
+    for (const uint64_t& key : lod_cloud->update(lod_camera)) {
+        const PcdPtr cloud = lod_cloud->chunkCloud(key);
+        const std::string id = lod_chunk_id(key);
+        pcl::visualization::PointCloudColorHandlerRGBField<PointType> rgb(cloud);
+        if (!viewer.updatePointCloud<PointType>(cloud, rgb, id)) {
+            viewer.addPointCloud<PointType>(cloud, rgb, id);
+        }
+    }
+}
+
+void PcdVizualizer::update_mesh_chunks(pcl::visualization::PCLVisualizer& viewer, const pcl::PolygonMesh& mesh,
+    const std::string& prefix, std::unordered_map<uint64_t, uint64_t>& chunks)
+{
+    std::map<uint64_t, uint64_t> hashes;
+    const std::map<uint64_t, pcl::PolygonMesh> split = split_mesh(mesh, mesh_chunk_size, hashes);
+
+    for (auto it = chunks.begin(); it != chunks.end();) {
+        if (split.count(it->first) == 0) {
+            viewer.removePolygonMesh(item_id(prefix, qint64(it->first)));
+            it = chunks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    size_t updated = 0;
+    for (const auto& chunk : split) {
+        const auto shown = chunks.find(chunk.first);
+        if (shown != chunks.end() && shown->second == hashes[chunk.first]) {
+            continue;
+        }
+
+        const std::string id = item_id(prefix, qint64(chunk.first));
+        if (shown == chunks.end() || !viewer.updatePolygonMesh(chunk.second, id)) {
+            viewer.removePolygonMesh(id);
+            viewer.addPolygonMesh(chunk.second, id);
+        }
+        chunks[chunk.first] = hashes[chunk.first];
+        ++updated;
+    }
+    LOG_DEBUG("viewer") << "Mesh" << prefix << ":" << updated << "/" << split.size() << "chunks updated";
+}
+
+void PcdVizualizer::update_camera_glyphs(pcl::visualization::PCLVisualizer& viewer)
+{
+    float min_score = std::numeric_limits<float>::max();
+    float max_score = std::numeric_limits<float>::lowest();
+    size_t poses_count = 0;
+    for (const auto& set : camera_pose_sets) {
+        poses_count += set.second.poses.size();
+        for (const float& score : set.second.fitness_scores) {
+            min_score = std::min(min_score, score);
+            max_score = std::max(max_score, score);
+        }
+    }
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+    vtkSmartPointer<vtkUnsignedCharArray> colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    points->Allocate(vtkIdType(poses_count * FRUSTUM_POINTS));
+    colors->SetNumberOfComponents(3);
+    colors->Allocate(vtkIdType(poses_count * FRUSTUM_POINTS * 3));
+
+    const float size = camera_glyph_size;
+    for (const auto& set : camera_pose_sets) {
+        const Matrix4fVector& poses = set.second.poses;
+        const std::vector<float>& scores = set.second.fitness_scores;
+        //Scores are of the pairs ending at the last poses, the first pose of a loop has none
+        const size_t first_scored = poses.size() - std::min(poses.size(), scores.size());
+
+        for (size_t i = 0; i < poses.size(); ++i) {
+            unsigned char color[3] = { 255, 255, 255 };
+            if (i >= first_scored) {
+                const float range = max_score - min_score;
+                const float t = range > 0 ? (scores[i - first_scored] - min_score) / range : 0;
+                color[0] = (unsigned char)(255.0f * t);
+                color[1] = (unsigned char)(255.0f * (1 - t));
+                color[2] = 0;
+            }
+
+            const vtkIdType apex = points->GetNumberOfPoints();
+            const Eigen::Vector3f center = poses[i].block<3, 1>(0, 3);
+            points->InsertNextPoint(center.x(), center.y(), center.z());
+            for (const float* corner : FRUSTUM_CORNERS) {
+                const Eigen::Vector3f point = poses[i].block<3, 3>(0, 0)
+                        * Eigen::Vector3f(corner[0] * size, corner[1] * size, size)
+                    + center;
+                points->InsertNextPoint(point.x(), point.y(), point.z());
+            }
+            for (int k = 0; k < FRUSTUM_POINTS; ++k) {
+                colors->InsertNextTupleValue(color);
+            }
+
+            for (int k = 0; k < 4; ++k) {
+                const vtkIdType side[2] = { apex, apex + 1 + k };
+                const vtkIdType edge[2] = { apex + 1 + k, apex + 1 + (k + 1) % 4 };
+                lines->InsertNextCell(2, side);
+                lines->InsertNextCell(2, edge);
             }
         }
-        viewer->addText(
-            allGroupsString.toStdString(),
-            configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_X").toInt(),
-            configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_Y").toInt(),
-            configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_FONTSIZE").toInt(),
-            configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_R").toDouble() / 255.0f,
-            configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_G").toDouble() / 255.0f,
-            configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_B").toDouble() / 255.0f);
     }
+
+    //The actor keeps its polydata, refilling it in place avoids a new actor and mapper per update
+    const bool added = camera_glyphs != nullptr;
+    if (!added) {
+        camera_glyphs = vtkSmartPointer<vtkPolyData>::New();
+    }
+    camera_glyphs->SetPoints(points);
+    camera_glyphs->SetLines(lines);
+    camera_glyphs->GetPointData()->SetScalars(colors);
+    camera_glyphs->Modified();
+
+    if (!added) {
+        viewer.removeShape(CAMERA_GLYPHS_ID);
+        viewer.addModelFromPolyData(camera_glyphs, CAMERA_GLYPHS_ID);
+    }
+}
+
+void PcdVizualizer::remove_mesh_chunks(pcl::visualization::PCLVisualizer& viewer, const std::string& prefix,
+    std::unordered_map<uint64_t, uint64_t>& chunks)
+{
+    for (const auto& chunk : chunks) {
+        viewer.removePolygonMesh(item_id(prefix, qint64(chunk.first)));
+    }
+    chunks.clear();
+}
+
+Eigen::Vector3f PcdVizualizer::camera_position(pcl::visualization::PCLVisualizer& viewer) const
+{
+    std::vector<pcl::visualization::Camera> cameras;
+    viewer.getCameras(cameras);
+    if (cameras.empty()) {
+        return Eigen::Vector3f::Zero();
+    }
+
+    return Eigen::Vector3d(cameras[0].pos[0], cameras[0].pos[1], cameras[0].pos[2]).cast<float>();
+}
+
+PcdVizualizer::Command PcdVizualizer::debug_text_command() const
+{
+    if (!configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_ENABLE").toBool()) {
+        return [](pcl::visualization::PCLVisualizer& viewer) { viewer.removeShape(DEBUG_TEXT_ID); };
+    }
+
+    QString allGroupsString;
+    //From the project snapshot, the viewer runs on the reconstruction thread while the GUI writes the QSettings
+    foreach (const QString& group, project.childGroups()) {
+        if (project.value(QString("%1/ENABLE_IN_VISUALIZATION").arg(group)).toBool()) {
+            QString groupString = QString("%1 \n").arg(group);
+
+            foreach (const QString& key, project.childKeys(group)) {
+                if (key != "ENABLE_IN_VISUALIZATION") {
+                    groupString.append(QString("%1: %2; ").arg(key, project.value(group + "/" + key).toString()));
+                }
+            }
+
+            groupString.append("\n\n");
+
+            allGroupsString.append(groupString);
+        }
+    }
+
+    const std::string text = allGroupsString.toStdString();
+    const int x = configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_X").toInt();
+    const int y = configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_Y").toInt();
+    const int font_size = configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_FONTSIZE").toInt();
+    const double r = configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_R").toDouble() / 255.0f;
+    const double g = configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_G").toDouble() / 255.0f;
+    const double b = configs.value("VISUALIZATOR_SETTINGS/DEBUG_INI_B").toDouble() / 255.0f;
+    return [=](pcl::visualization::PCLVisualizer& viewer) {
+        if (!viewer.updateText(text, x, y, font_size, r, g, b, DEBUG_TEXT_ID)) {
+            viewer.addText(text, x, y, font_size, r, g, b, DEBUG_TEXT_ID);
+        }
+    };
 }
 
 void PcdVizualizer::set_viewer_pose(
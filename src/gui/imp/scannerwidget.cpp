@@ -10,9 +10,11 @@
 #include <QRect>
 
 #include "io/pcdinputiterator.hpp"
+#include "io/sessionarchive.h"
 
 ScannerWidget::ScannerWidget(QWidget* parent)
     : QMainWindow(parent)
+    , reconstructionRunning(false)
 {
     setWindowFlags(Qt::CustomizeWindowHint | Qt::WindowCloseButtonHint);
     QRect screenRect = QDesktopWidget().availableGeometry(this);
@@ -21,12 +23,27 @@ ScannerWidget::ScannerWidget(QWidget* parent)
     initializeOpenDialogInterface();
 }
 
+ScannerWidget::~ScannerWidget()
+{
+    if (reconstructionThread.joinable()) {
+        reconstructionThread.join();
+    }
+}
+
 void ScannerWidget::reloadSettings()
 {
+    if (reconstructionRunning) {
+        statusBar->showMessage("Reconstruction is running, settings are kept until it finishes");
+        return;
+    }
+
+    ScannerConfig::reload();
     initializeSettings();
 
     openniInterface->deleteLater();
     openniInterface = new OpenNiInterface(this, settings);
+    connect(openniInterface, SIGNAL(signal_capture_telemetry(QString)), this, SLOT(slot_capture_telemetry(QString)));
+    reconstructionInterface->setSettings(settings);
     reconstructionInterface->reloadSettings();
 
     initializeMainInterfaceSettings();
@@ -37,7 +54,7 @@ void ScannerWidget::initializeSettings()
     settings = new QSettings(settingsPath, QSettings::IniFormat, this);
 
     if (settings->value("READING_SETTING/AUTO_SET_RANGE").toBool()) {
-        PcdInputIterator it(settings, 0, std::numeric_limits<uint>::max(), 1);
+        PcdInputIterator it(ProjectSettings(*settings), 0, std::numeric_limits<uint>::max(), 1);
         settings->setValue("READING_SETTING/FROM", it.getLowerBound());
         settings->setValue("READING_SETTING/TO", it.getUpperBound());
         settings->sync();
@@ -47,6 +64,7 @@ void ScannerWidget::initializeSettings()
 void ScannerWidget::initializeReconstruction()
 {
     openniInterface = new OpenNiInterface(this, settings);
+    connect(openniInterface, SIGNAL(signal_capture_telemetry(QString)), this, SLOT(slot_capture_telemetry(QString)));
     reconstructionInterface = new ReconstructionInterface(this, settings);
 }
 
@@ -81,11 +99,13 @@ void ScannerWidget::initializeMainInterface()
     takeOpImagesButton = new QPushButton("Take Long Images", this);
     takeOneOpImageButton = new QPushButton("Take One Long Image", this);
     saveDataButton = new QPushButton("Save Long Image Data", this);
+    packArchiveButton = new QPushButton("Pack Session Archive", this);
     connect(initButton, SIGNAL(clicked()), this, SLOT(slot_start_stream()));
     connect(takeImagesButton, SIGNAL(clicked()), this, SLOT(slot_start_rotation_stream()));
     connect(takeOpImagesButton, SIGNAL(clicked()), this, SLOT(slot_take_long_images()));
     connect(takeOneOpImageButton, SIGNAL(clicked()), this, SLOT(slot_take_one_long_image()));
     connect(saveDataButton, SIGNAL(clicked()), this, SLOT(slot_save_long_image_data()));
+    connect(packArchiveButton, SIGNAL(clicked()), this, SLOT(slot_pack_session_archive()));
 
     recCheck = new QCheckBox("Record stream", this);
     streamFromCheck = new QCheckBox("Replay recorded stream", this);
@@ -148,6 +168,7 @@ void ScannerWidget::initializeDebugInterface()
     vBoxLayout->addWidget(takeOpImagesButton);
     vBoxLayout->addWidget(takeOneOpImageButton);
     vBoxLayout->addWidget(saveDataButton);
+    vBoxLayout->addWidget(packArchiveButton);
 
     QGroupBox* groupBox = new QGroupBox(tr("Stream settings"));
     QVBoxLayout* groupBoxVBoxLayout = new QVBoxLayout;
@@ -371,10 +392,53 @@ void ScannerWidget::slot_save_long_image_data()
     openniInterface->save_long_image_data();
 }
 
+void ScannerWidget::slot_pack_session_archive()
+{
+    const ScannerConfig configs;
+    const bool success = SessionArchive::pack(ProjectSettings(*settings), &configs);
+    statusBar->showMessage(success ? "Session archive packed" : "Can't pack session archive");
+}
+
 void ScannerWidget::slot_perform_reconstruction()
 {
+    if (reconstructionRunning) {
+        return;
+    }
+    if (reconstructionThread.joinable()) {
+        reconstructionThread.join();
+    }
+
     reloadSettings();
-    reconstructionInterface->slot_perform_reconstruction();
+    reconstructionRunning = true;
+    setReconstructionControlsEnabled(false);
+    statusBar->showMessage("Reconstruction is running...");
+
+    reconstructionThread = std::thread([this]() {
+        try {
+            reconstructionInterface->slot_perform_reconstruction();
+        } catch (const std::exception& e) {
+            qDebug() << "Reconstruction failed:" << e.what();
+        }
+        QMetaObject::invokeMethod(this, "slot_reconstruction_finished", Qt::QueuedConnection);
+    });
+}
+
+void ScannerWidget::slot_reconstruction_finished()
+{
+    reconstructionThread.join();
+    reconstructionRunning = false;
+    setReconstructionControlsEnabled(true);
+    statusBar->showMessage("Reconstruction finished");
+}
+
+void ScannerWidget::setReconstructionControlsEnabled(const bool& enabled)
+{
+    drawScene3dModelButton->setEnabled(enabled);
+    reconstructCheck->setEnabled(enabled);
+    undistrtionCheck->setEnabled(enabled);
+    bilateralFilterCheck->setEnabled(enabled);
+    statFilterCheck->setEnabled(enabled);
+    mlsFilterCheck->setEnabled(enabled);
 }
 
 void ScannerWidget::slot_record_stream(int state)
@@ -406,3 +470,8 @@ void ScannerWidget::slot_use_bilateral(int state)
     settings->setValue("STREAM_SETTINGS/ENABLE_BILATERAL_FILTER", state != Qt::Unchecked);
     settings->sync();
 }
+
+void ScannerWidget::slot_capture_telemetry(const QString& text)
+{
+    statusBar->showMessage(text);
+}
@@ -0,0 +1,130 @@
+#include "gui/vizualizer.h"
+
+#include "gui/pcdvizualizer.h"
+#include "utility/log.h"
+
+Vizualizer::Ptr Vizualizer::create(QObject* parent, QSettings* settings, const ScannerConfig& configs)
+{
+#ifdef Q_OS_LINUX
+    const bool display = !qgetenv("DISPLAY").isEmpty() || !qgetenv("WAYLAND_DISPLAY").isEmpty();
+#else
+    const bool display = true;
+#endif
+    if (configs.value("VISUALIZATOR_SETTINGS/HEADLESS").toBool() || !display) {
+        LOG_INFO("viewer") << "Vizualizer::create headless, nothing is drawn";
+        return Ptr(new NullVizualizer);
+    }
+
+    return Ptr(new LazyVizualizer(parent, settings));
+}
+
+LazyVizualizer::LazyVizualizer(QObject* parent_, QSettings* settings_)
+    : parent(parent_)
+    , settings(settings_)
+    , redraw_pending(false)
+{
+}
+
+bool LazyVizualizer::enabled() const
+{
+    return true;
+}
+
+void LazyVizualizer::redraw()
+{
+    std::unique_lock<std::mutex> lock(instance_mutex);
+    if (!instance) {
+        redraw_pending = true;
+        return;
+    }
+    const Vizualizer::Ptr current = instance;
+    lock.unlock();
+
+    current->redraw();
+}
+
+void LazyVizualizer::clear()
+{
+    const Vizualizer::Ptr current = constructed();
+    if (current) {
+        current->clear();
+    }
+}
+
+void LazyVizualizer::visualizePointClouds(const Frames& frames)
+{
+    viewer()->visualizePointClouds(frames);
+}
+
+void LazyVizualizer::visualizeKeypointClouds(const KeypointsFrames& keypointsFrames, const QString& set_id)
+{
+    viewer()->visualizeKeypointClouds(keypointsFrames, set_id);
+}
+
+void LazyVizualizer::visualizeCameraPoses(const Matrix4fVector& final_translation_matrix_vector,
+    const std::vector<float>& fitness_scores, const QString& set_id)
+{
+    viewer()->visualizeCameraPoses(final_translation_matrix_vector, fitness_scores, set_id);
+}
+
+void LazyVizualizer::plotCameraPoses(const Matrix4fVector& final_translation_matrix_vector)
+{
+    viewer()->plotCameraPoses(final_translation_matrix_vector);
+}
+
+void LazyVizualizer::visualizeMesh(const pcl::PolygonMesh& mesh)
+{
+    viewer()->visualizeMesh(mesh);
+}
+
+void LazyVizualizer::visualizePreviewMesh(const pcl::PolygonMesh& mesh)
+{
+    viewer()->visualizePreviewMesh(mesh);
+}
+
+void LazyVizualizer::plotNormalDistribution(const std::vector<double>& input_data, const char* title) const
+{
+    viewer()->plotNormalDistribution(input_data, title);
+}
+
+void LazyVizualizer::plotCameraDistances(
+    const std::vector<double>& data,
+    const bool& fixed_range,
+    const char* name,
+    const char* value) const
+{
+    viewer()->plotCameraDistances(data, fixed_range, name, value);
+}
+
+bool LazyVizualizer::wasStopped() const
+{
+    const Vizualizer::Ptr current = constructed();
+    return current && current->wasStopped();
+}
+
+void LazyVizualizer::spin(const uint& spin_time)
+{
+    const Vizualizer::Ptr current = constructed();
+    if (current) {
+        current->spin(spin_time);
+    }
+}
+
+Vizualizer::Ptr LazyVizualizer::viewer() const
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    if (!instance) {
+        instance.reset(new PcdVizualizer(parent, settings));
+        if (redraw_pending) {
+            instance->redraw();
+        }
+    }
+
+    return instance;
+}
+
+Vizualizer::Ptr LazyVizualizer::constructed() const
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    return instance;
+}
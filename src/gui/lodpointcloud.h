@@ -0,0 +1,88 @@
+#ifndef LOD_POINT_CLOUD_H
+#define LOD_POINT_CLOUD_H
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Display cloud of every frame added, merged into one voxel grid split in cubic chunks.
+  * Every chunk is shown at a level of detail picked by its distance to the camera, level l
+  * averaging the points of 2^l finest voxels per axis. Coarser levels are picked for the farthest
+  * chunks while the estimated points shown exceed the budget, so the points handed to the
+  * renderer stay bounded however many frames are added.
+  */
+class LodPointCloud {
+public:
+    /** \brief Levels are used up to levels_count - 1, level 0 from the camera to lod_distance,
+      * every next one up to twice the distance of the previous one.
+      */
+    LodPointCloud(const float& chunk_size, const float& voxel_size, const int& levels_count,
+        const float& lod_distance, const size_t& max_points);
+
+    /** \brief World space points, merged into the finest voxels. */
+    void addCloud(const Pcd& cloud);
+
+    /** \brief Picks the levels for the camera position, rebuilds the chunks whose points or level
+      * changed and returns their keys.
+      */
+    std::vector<uint64_t> update(const Eigen::Vector3f& camera);
+
+    /** \brief Display points of a chunk returned by update, empty when the chunk has none. */
+    PcdPtr chunkCloud(const uint64_t& key) const;
+
+    /** \brief Every chunk is returned by the next update, for when the renderer lost them. */
+    void invalidate();
+
+    /** \brief Drops every frame added. */
+    void clear();
+
+    size_t chunksCount() const;
+
+    /** \brief Points in the display clouds built so far. */
+    size_t displayedPoints() const;
+
+private:
+    /** \brief Sum of the points of a finest voxel. */
+    struct Accumulator {
+        Eigen::Vector3f position;
+        uint32_t r;
+        uint32_t g;
+        uint32_t b;
+        uint32_t count;
+    };
+
+    struct Chunk {
+        Eigen::Vector3f center;
+        std::vector<Accumulator> voxels;
+        std::unordered_map<uint64_t, uint32_t> voxel_ids;
+        std::vector<uint64_t> voxel_keys;
+        int level;
+        bool dirty;
+        PcdPtr display;
+    };
+
+    const float chunk_size;
+    const float voxel_size;
+    const int levels_count;
+    const float lod_distance;
+    const size_t max_points;
+
+    std::unordered_map<uint64_t, Chunk> chunks;
+
+    /** \brief Integer coordinates within 21 bits each, around 0. */
+    static uint64_t pack_key(const Eigen::Vector3i& coordinates);
+    static Eigen::Vector3i unpack_key(const uint64_t& key);
+
+    int level_of_distance(const float& distance) const;
+
+    /** \brief Estimate, a surface keeps a quarter of its points one level up. */
+    size_t level_points(const Chunk& chunk, const int& level) const;
+
+    void build_display(Chunk& chunk, const int& level) const;
+};
+
+#endif // LOD_POINT_CLOUD_H
@@ -6,33 +6,79 @@
 #include <QSettings>
 #include <QString>
 
+#include <atomic>
 #include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 
 #include <pcl/console/parse.h>
 #include <pcl/visualization/pcl_visualizer.h>
 
-#include "core/base/scannertypes.h"
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
 
-class PcdVizualizer : public ScannerBase {
+#include "core/base/scannertypes.h"
+#include "gui/lodpointcloud.h"
+#include "gui/vizualizer.h"
+
+/** \brief 3D viewer running on its own render thread. Every call queues a command holding snapshots
+  * of the clouds and meshes it draws and returns at once, so the reconstruction never waits on rendering.
+  * The viewer keeps rendering until its window is closed, later calls are dropped.
+  * Items have stable ids, per frame, keypoint set, camera and mesh chunk, drawing an item again
+  * updates it in place and leaves the rest of the scene untouched.
+  */
+class PcdVizualizer : public ScannerBase, public Vizualizer {
     Q_OBJECT
 
 public:
     typedef boost::shared_ptr<PcdVizualizer> Ptr;
 
-    pcl::visualization::PCLVisualizer::Ptr viewer;
-
     PcdVizualizer(QObject* parent, QSettings* parent_settings);
 
+    /** \brief Renders the queued commands, then closes the window. */
+    ~PcdVizualizer();
+
+    bool enabled() const;
+
+    /** \brief Refreshes the settings text and the volume cube, the rest of the scene is kept. */
     void redraw();
 
+    /** \brief Removes everything drawn, for a new reconstruction. */
+    void clear();
+
+    /** \brief With VISUALIZATOR_SETTINGS/LOD_POINT_CLOUDS the frames are merged into the level of detail
+      * cloud instead of adding an actor per frame.
+      */
     void visualizePointClouds(const Frames& frames);
 
-    void visualizeKeypointClouds(const KeypointsFrames& keypointsFrames);
+    /** \brief Keypoint sets of the same set_id replace each other. */
+    void visualizeKeypointClouds(const KeypointsFrames& keypointsFrames, const QString& set_id = "keypoints");
+
+    /** \brief Every pose set is drawn as a frustum glyph per camera, all sets in one actor, so thousands
+      * of poses stay a single draw call. Sets of the same set_id replace each other, a set added as
+      * a loop finishes only rebuilds the glyph arrays. fitness_scores of the last poses colour them
+      * from green, the best score drawn, to red, the worst, poses without a score are white.
+      */
+    void visualizeCameraPoses(const Matrix4fVector& final_translation_matrix_vector,
+        const std::vector<float>& fitness_scores = std::vector<float>(), const QString& set_id = "camera_poses");
 
-    void visualizeCameraPoses(const Matrix4fVector& final_translation_matrix_vector);
+    /** \brief Distances between neighbour cameras. */
+    void plotCameraPoses(const Matrix4fVector& final_translation_matrix_vector);
 
+    /** \brief Meshes are drawn in cubic chunks of VISUALIZATOR_SETTINGS/MESH_CHUNK_SIZE, only the
+      * chunks whose triangles changed since the previous mesh are uploaded again.
+      */
     void visualizeMesh(const pcl::PolygonMesh& mesh);
 
+    /** \brief Replaces the previous preview mesh, the final mesh replaces the preview. */
+    void visualizePreviewMesh(const pcl::PolygonMesh& mesh);
+
     void plotNormalDistribution(const std::vector<double>& input_data, const char* title = "Normal Distribution") const;
 
     void plotCameraDistances(
@@ -41,16 +87,73 @@ public:
         const char* name,
         const char* value) const;
 
+    /** \brief True once the window is closed. */
+    bool wasStopped() const;
+
+    /** \brief Rendering runs on its own thread, only waits spin_time milliseconds. */
     void spin(const uint& spin_time = 1);
 
 private:
+    typedef std::function<void(pcl::visualization::PCLVisualizer&)> Command;
+
+    mutable std::mutex commands_mutex;
+    mutable std::deque<Command> commands;
+    std::atomic<bool> stopped;
+    std::atomic<bool> quit;
+
+    //Render thread state
+    pcl::visualization::PCLVisualizer::Ptr viewer;
+    std::unique_ptr<LodPointCloud> lod_cloud;
+    Eigen::Vector3f lod_camera;
+    const float lod_chunk_size;
+    const float mesh_chunk_size;
+    /** \brief Content hash of every chunk on screen by chunk key. */
+    std::unordered_map<uint64_t, uint64_t> mesh_chunks;
+    std::unordered_map<uint64_t, uint64_t> preview_chunks;
+    /** \brief Keypoint pairs on screen by set id. */
+    std::unordered_map<std::string, int> keypoint_set_sizes;
+
+    struct CameraPoseSet {
+        Matrix4fVector poses;
+        std::vector<float> fitness_scores;
+    };
+    /** \brief Read on the calling thread in the constructor and clear(). */
+    float camera_glyph_size;
+    std::map<std::string, CameraPoseSet> camera_pose_sets;
+    /** \brief Stays the input of the one camera actor, refilled on every change. */
+    vtkSmartPointer<vtkPolyData> camera_glyphs;
+    /** \brief Next id of a frame without frameIndex, used on the calling thread. */
+    qint64 unindexed_frames;
+
+    /** \brief Started last, once the state it renders is constructed. */
+    std::thread render_thread;
+
+    void enqueue(Command command) const;
+
+    void render_loop(const Eigen::Vector3d& background, const float& axis_size, const Command& debug_text);
+
+    /** \brief Adds, updates or removes the actors of the chunks changed for the current camera. */
+    void update_lod_cloud(pcl::visualization::PCLVisualizer& viewer);
+
+    Eigen::Vector3f camera_position(pcl::visualization::PCLVisualizer& viewer) const;
+
+    /** \brief Splits the mesh in chunks, updates the changed ones and removes the ones left empty. */
+    void update_mesh_chunks(pcl::visualization::PCLVisualizer& viewer, const pcl::PolygonMesh& mesh,
+        const std::string& prefix, std::unordered_map<uint64_t, uint64_t>& chunks);
+
+    void update_camera_glyphs(pcl::visualization::PCLVisualizer& viewer);
+
+    static void remove_mesh_chunks(pcl::visualization::PCLVisualizer& viewer, const std::string& prefix,
+        std::unordered_map<uint64_t, uint64_t>& chunks);
+
     float gaussian_pdf(const float& x, const float& u, const float& sigma) const;
 
     void set_viewer_pose(
         pcl::visualization::PCLVisualizer& viewer,
         const Eigen::Affine3f& viewer_pose);
 
-    void visualize_debug_text();
+    /** \brief Reads the settings on the calling thread, the command only draws the text. */
+    Command debug_text_command() const;
 };
 
 #endif // PCDVIZUALIZER_H
@@ -12,6 +12,9 @@
 #include <QWidget>
 #include <QtWidgets/QMainWindow>
 
+#include <atomic>
+#include <thread>
+
 #include "core/reconstruction/reconstructioninterface.h"
 #include "io/openniinterface.h"
 #include "utility/tools.h"
@@ -22,6 +25,9 @@ class ScannerWidget : public QMainWindow {
 public:
     ScannerWidget(QWidget* parent = 0);
 
+    /** \brief Waits for a running reconstruction. */
+    ~ScannerWidget();
+
 private:
     QSettings* settings;
     QString settingsPath;
@@ -44,6 +50,7 @@ private:
     QPushButton* takeOpImagesButton;
     QPushButton* takeOneOpImageButton;
     QPushButton* saveDataButton;
+    QPushButton* packArchiveButton;
 
     QPushButton* drawScene3dModelButton;
     QCheckBox* reconstructCheck;
@@ -55,6 +62,12 @@ private:
     OpenNiInterface* openniInterface;
     ReconstructionInterface* reconstructionInterface;
 
+    /** \brief The reconstruction runs off the GUI thread, settings are not reloaded meanwhile. */
+    std::thread reconstructionThread;
+    std::atomic<bool> reconstructionRunning;
+
+    void setReconstructionControlsEnabled(const bool& enabled);
+
     void reloadSettings();
     void initializeSettings();
     void initializeReconstruction();
@@ -80,6 +93,7 @@ public slots:
     void slot_take_long_images();
     void slot_take_one_long_image();
     void slot_save_long_image_data();
+    void slot_pack_session_archive();
     void slot_perform_reconstruction();
 
     void slot_record_stream(int);
@@ -87,6 +101,10 @@ public slots:
     void slot_record_pcd(int);
     void slot_use_undistortion(int);
     void slot_use_bilateral(int);
+
+private slots:
+    void slot_reconstruction_finished();
+    void slot_capture_telemetry(const QString& text);
 };
 
 #endif // SCANNERWIDGET_H
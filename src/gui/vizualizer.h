@@ -0,0 +1,125 @@
+#ifndef VIZUALIZER_H
+#define VIZUALIZER_H
+
+#include <QObject>
+#include <QSettings>
+#include <QString>
+
+#include <pcl/PolygonMesh.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Everything the reconstruction draws, so it does not depend on a window being there.
+  * PcdVizualizer is the 3D viewer, NullVizualizer draws nothing and LazyVizualizer opens the
+  * viewer on the first drawing call.
+  */
+class Vizualizer {
+public:
+    typedef boost::shared_ptr<Vizualizer> Ptr;
+
+    virtual ~Vizualizer() {}
+
+    /** \brief False when nothing is ever drawn, callers may then skip preparing what they draw. */
+    virtual bool enabled() const = 0;
+
+    virtual void redraw() = 0;
+
+    virtual void clear() = 0;
+
+    virtual void visualizePointClouds(const Frames& frames) = 0;
+
+    virtual void visualizeKeypointClouds(const KeypointsFrames& keypointsFrames, const QString& set_id = "keypoints") = 0;
+
+    virtual void visualizeCameraPoses(const Matrix4fVector& final_translation_matrix_vector,
+        const std::vector<float>& fitness_scores = std::vector<float>(), const QString& set_id = "camera_poses")
+        = 0;
+
+    virtual void plotCameraPoses(const Matrix4fVector& final_translation_matrix_vector) = 0;
+
+    virtual void visualizeMesh(const pcl::PolygonMesh& mesh) = 0;
+
+    virtual void visualizePreviewMesh(const pcl::PolygonMesh& mesh) = 0;
+
+    virtual void plotNormalDistribution(const std::vector<double>& input_data, const char* title = "Normal Distribution") const = 0;
+
+    virtual void plotCameraDistances(
+        const std::vector<double>& data,
+        const bool& fixed_range,
+        const char* name,
+        const char* value) const = 0;
+
+    virtual bool wasStopped() const = 0;
+
+    virtual void spin(const uint& spin_time = 1) = 0;
+
+    /** \brief NullVizualizer with VISUALIZATOR_SETTINGS/HEADLESS or without a display, else LazyVizualizer. */
+    static Ptr create(QObject* parent, QSettings* settings, const ScannerConfig& configs);
+};
+
+/** \brief For headless runs, needs no OpenGL context. */
+class NullVizualizer : public Vizualizer {
+public:
+    bool enabled() const { return false; }
+    void redraw() {}
+    void clear() {}
+    void visualizePointClouds(const Frames&) {}
+    void visualizeKeypointClouds(const KeypointsFrames&, const QString&) {}
+    void visualizeCameraPoses(const Matrix4fVector&, const std::vector<float>&, const QString&) {}
+    void plotCameraPoses(const Matrix4fVector&) {}
+    void visualizeMesh(const pcl::PolygonMesh&) {}
+    void visualizePreviewMesh(const pcl::PolygonMesh&) {}
+    void plotNormalDistribution(const std::vector<double>&, const char*) const {}
+    void plotCameraDistances(const std::vector<double>&, const bool&, const char*, const char*) const {}
+    bool wasStopped() const { return false; }
+    void spin(const uint&) {}
+};
+
+/** \brief Constructs the PcdVizualizer, and so its window, on the first call that draws something.
+  * A redraw() before it only marks the settings text and the volume cube to be drawn with the
+  * first item, clear() has nothing to clear. Calls may come from several threads.
+  */
+class LazyVizualizer : public Vizualizer {
+public:
+    LazyVizualizer(QObject* parent, QSettings* settings);
+
+    bool enabled() const;
+    void redraw();
+    void clear();
+    void visualizePointClouds(const Frames& frames);
+    void visualizeKeypointClouds(const KeypointsFrames& keypointsFrames, const QString& set_id);
+    void visualizeCameraPoses(const Matrix4fVector& final_translation_matrix_vector,
+        const std::vector<float>& fitness_scores, const QString& set_id);
+    void plotCameraPoses(const Matrix4fVector& final_translation_matrix_vector);
+    void visualizeMesh(const pcl::PolygonMesh& mesh);
+    void visualizePreviewMesh(const pcl::PolygonMesh& mesh);
+    void plotNormalDistribution(const std::vector<double>& input_data, const char* title) const;
+    void plotCameraDistances(
+        const std::vector<double>& data,
+        const bool& fixed_range,
+        const char* name,
+        const char* value) const;
+    bool wasStopped() const;
+    void spin(const uint& spin_time);
+
+private:
+    QObject* const parent;
+    QSettings* const settings;
+
+    mutable std::mutex instance_mutex;
+    mutable Vizualizer::Ptr instance;
+    bool redraw_pending;
+
+    /** \brief Constructs the viewer on the first call. */
+    Vizualizer::Ptr viewer() const;
+
+    /** \brief nullptr until a drawing call constructed the viewer. */
+    Vizualizer::Ptr constructed() const;
+};
+
+#endif // VIZUALIZER_H
@@ -0,0 +1,36 @@
+#ifndef BLOCK_STORE_H
+#define BLOCK_STORE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/** \brief Scratch file of fixed size records, record i at offset i * record_size, for data paged
+  * out of memory. The file is created empty and removed with the store. Not thread safe.
+  */
+class BlockStore {
+public:
+    BlockStore(const std::string& filename, const size_t& record_size);
+    ~BlockStore();
+
+    BlockStore(const BlockStore&) = delete;
+    BlockStore& operator=(const BlockStore&) = delete;
+
+    void write(const uint64_t& record, const void* data);
+
+    void read(const uint64_t& record, void* data);
+
+    /** \brief Records written out and read back since the store was created. */
+    size_t writtenCount() const;
+    size_t readCount() const;
+
+private:
+    const std::string filename;
+    const size_t record_size;
+
+    std::fstream file;
+    size_t written_count;
+    size_t read_count;
+};
+
+#endif // BLOCK_STORE_H
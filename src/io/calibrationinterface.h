@@ -11,7 +11,14 @@
 #include <pcl/io/io.h>
 
 #include <core/base/scannertypes.h>
+#include <io/calibrationmodel.h>
 #include <io/pclio.h>
+#include <io/undistortiontable.h>
+
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
 
 class CalibrationInterface : public ScannerBase {
     Q_OBJECT
@@ -25,14 +32,27 @@ public:
 
     void calibrate();
     void calibrate(PcdPtrVector& input_pcd_vector);
+
+    /** \brief Applies getUndistortionTable(), the calibration data is not read again. */
     void undistort(Frames& frames);
 
+    /** \brief Model of the project calibration data, computed once per process and stored next to the
+      * data. Recomputed when the calibration clouds or their settings change.
+      */
+    CalibrationModel::ConstPtr getModel();
+
+    /** \brief getModel() precomputed per pixel, built once per process and shared with the live stream. */
+    UndistortionTable::ConstPtr getUndistortionTable();
+
     void saveCalibrationData();
     void loadCalibrationData();
 
 private:
+    /** \brief The sensor resolution of the calibration clouds, frames of another one are not undistorted. */
+    const int width;
+    const int height;
+
     PcdPtrVector raw_pcd_data_vector;
-    PcdPtrVector udistort_pcd_vector;
     PcdPtrVector calib_plane_vector;
     std::vector<std::vector<int> > matches_vector;
 
@@ -47,9 +67,29 @@ private:
     void calculate_least_squares(int index);
     void calculate_calibration_plane(int index);
     void calculate_calibration_map(int index);
+    /** \brief Runs of width points of the plane's cloud without NaN, the unit the steps above are spread in. */
+    size_t rows_count(int index) const;
+
+    /** \brief A model being built is shared by its future, the thread building it is kept so a task its
+      * waits run on the same thread builds a model of its own instead of waiting for itself.
+      */
+    struct ModelEntry {
+        std::shared_future<CalibrationModel::ConstPtr> model;
+        std::thread::id builder;
+    };
+
+    static std::mutex models_mutex;
+    static std::map<QString, ModelEntry> models;
+    static std::map<QString, UndistortionTable::ConstPtr> tables;
+
+    QString model_filename() const;
+    QString model_key(const QString& filename, const uint64_t& parameters_hash) const;
+    uint64_t model_parameters_hash() const;
+    CalibrationModel::ConstPtr build_model();
+    /** \brief The stored model when it is up to date, otherwise build_model() saved next to the data. */
+    CalibrationModel::ConstPtr load_model(const QString& filename, const uint64_t& parameters_hash);
 
-    void undistort_all_pcd();
-    void undistort_one_pcd(int index);
+    void reorganize_one_pcd(int index);
 };
 
 #endif // CALIBRATIONINTERFACE_H
@@ -0,0 +1,36 @@
+#ifndef CALIBRATION_MODEL_H
+#define CALIBRATION_MODEL_H
+
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** \brief Depth correction computed from the calibration clouds, all an undistortion needs.
+  * Per calibration cloud, its organized depth with NaN where it has no point and the shift
+  * of every pixel from the fitted plane.
+  */
+struct CalibrationModel {
+    typedef std::shared_ptr<const CalibrationModel> ConstPtr;
+
+#pragma pack(push, 1)
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t parameters_hash;
+        uint32_t planes_count;
+        uint32_t plane_size;
+    };
+#pragma pack(pop)
+
+    std::vector<std::vector<float> > depths;
+    std::vector<std::vector<float> > shifts;
+
+    bool save(const QString& filename, const uint64_t& parameters_hash) const;
+
+    /** \brief nullptr when the file is missing, damaged or computed from other calibration data. */
+    static ConstPtr load(const QString& filename, const uint64_t& parameters_hash, const uint32_t& plane_size);
+};
+
+#endif // CALIBRATION_MODEL_H
@@ -0,0 +1,92 @@
+#ifndef CAPTURE_RING_H
+#define CAPTURE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/** \brief Lock-free single producer single consumer ring of preallocated slots.
+  * The producer fills a slot in place between beginWrite and endWrite, the consumer
+  * reads it between beginRead and endRead. A write into a full ring is dropped and counted.
+  */
+template <typename Slot>
+class CaptureRing {
+public:
+    explicit CaptureRing(const size_t& capacity, const Slot& prototype = Slot())
+        : slots(capacity + 1, prototype)
+        , head(0)
+        , tail(0)
+        , dropped_count(0)
+    {
+    }
+
+    CaptureRing(const CaptureRing&) = delete;
+    CaptureRing& operator=(const CaptureRing&) = delete;
+
+    /** \brief Producer side. Returns nullptr when the ring is full. */
+    Slot* beginWrite()
+    {
+        const size_t current_head = head.load(std::memory_order_relaxed);
+        if (next(current_head) == tail.load(std::memory_order_acquire)) {
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        return &slots[current_head];
+    }
+
+    void endWrite()
+    {
+        head.store(next(head.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    /** \brief Consumer side. Returns nullptr when the ring is empty. */
+    Slot* beginRead()
+    {
+        const size_t current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        return &slots[current_tail];
+    }
+
+    void endRead()
+    {
+        tail.store(next(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    size_t capacity() const
+    {
+        return slots.size() - 1;
+    }
+
+    /** \brief Slots written and not read yet, exact only on the consumer side. */
+    size_t size() const
+    {
+        const size_t current_head = head.load(std::memory_order_acquire);
+        const size_t current_tail = tail.load(std::memory_order_acquire);
+        return current_head >= current_tail ? current_head - current_tail : current_head + slots.size() - current_tail;
+    }
+
+    size_t getDroppedCount() const
+    {
+        return dropped_count.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<Slot> slots;
+
+    std::atomic<size_t> head;
+    char head_padding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char tail_padding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dropped_count;
+
+    inline size_t next(const size_t& position) const
+    {
+        return position + 1 == slots.size() ? 0 : position + 1;
+    }
+};
+
+#endif // CAPTURE_RING_H
@@ -0,0 +1,80 @@
+#ifndef CAPTURE_TELEMETRY_H
+#define CAPTURE_TELEMETRY_H
+
+#include <QString>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/** \brief Running figures of the capture loop: latency from the arrival of a frame pair to the end of its
+  * processing, skew between the depth and the color sensor timestamps, gaps in the sensor timestamps
+  * counted as frames the sensor or the driver dropped, and the queue depths and drops of the consumers.
+  * The figures are for the current report interval, the totals for the whole stream.
+  */
+class CaptureTelemetry {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Sample {
+        //Microseconds of the sensor clocks
+        uint64_t depth_timestamp;
+        uint64_t color_timestamp;
+        Clock::time_point arrival;
+        Clock::time_point completed;
+    };
+
+    struct Queues {
+        size_t ring_size;
+        size_t ring_capacity;
+        size_t ring_dropped;
+        size_t writer_size;
+        size_t writer_dropped;
+        size_t odometry_dropped;
+    };
+
+    struct Figures {
+        size_t frames;
+        double mean_latency_ms;
+        double max_latency_ms;
+        double mean_skew_ms;
+        double max_skew_ms;
+        size_t sensor_dropped;
+        double fps;
+
+        Figures();
+    };
+
+    /** \brief fps is the nominal rate of the stream, the sensor gaps are counted in its periods. */
+    explicit CaptureTelemetry(const int& fps);
+
+    void add(const Sample& sample);
+
+    void setQueues(const Queues& queues);
+
+    /** \brief True once per interval, getInterval() then has the figures of the interval that ended. */
+    bool reportDue(const std::chrono::milliseconds& interval);
+
+    const Figures& getInterval() const;
+
+    const Figures& getTotal() const;
+
+    /** \brief One line, for the status bar and the log. */
+    QString text(const Figures& figures) const;
+
+private:
+    const uint64_t period_us;
+
+    Figures interval;
+    //The last complete interval
+    Figures reported;
+    Figures total;
+    Queues queues;
+    uint64_t last_depth_timestamp;
+    Clock::time_point interval_start;
+    Clock::time_point stream_start;
+
+    static void accumulate(Figures& figures, const double& latency_ms, const double& skew_ms, const size_t& dropped);
+};
+
+#endif // CAPTURE_TELEMETRY_H
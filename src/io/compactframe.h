@@ -0,0 +1,59 @@
+#ifndef COMPACT_FRAME_H
+#define COMPACT_FRAME_H
+
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "core/base/cameraintrinsics.h"
+#include "core/base/scannertypes.h"
+
+/** \brief Resident form of a frame just read: uint16 millimetre depth and 3 byte BGR colour per pixel,
+  * x and y are reconstructed from the pinhole model fitted to the cloud. About 5 bytes per pixel
+  * instead of the 32 of the cloud and the 3 of the image, expand() gives back the PCL cloud.
+  * Only frames whose every point the model reproduces within the tolerance are packed.
+  */
+class CompactFrame {
+public:
+    typedef std::shared_ptr<const CompactFrame> ConstPtr;
+
+    CompactFrame();
+
+    /** \brief False for frames that are not organized, have normals, indexes or a pose, or that the model
+      * does not reproduce within max_error meters, the frame is then kept as is.
+      */
+    bool pack(const Frame& frame, const float& max_error);
+
+    Frame expand() const;
+
+    size_t size() const;
+
+private:
+    CameraIntrinsics intrinsics;
+    int width;
+    int height;
+    bool is_dense;
+    pcl::PCLHeader header;
+
+    //0 for the points without a depth
+    std::vector<uint16_t> depth_mm;
+    std::vector<uint8_t> color_bgr;
+    uint8_t alpha;
+    //Kept apart only when it is not the colours of the cloud
+    bool image_from_colors;
+    cv::Mat image;
+
+    QString source_id;
+    int frame_index;
+
+    inline Eigen::Vector3f point(const int& u, const int& v, const uint16_t& depth) const
+    {
+        return intrinsics.backproject(float(u), float(v), float(depth) * 0.001f);
+    }
+};
+
+#endif // COMPACT_FRAME_H
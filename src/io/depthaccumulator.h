@@ -0,0 +1,54 @@
+#ifndef DEPTH_ACCUMULATOR_H
+#define DEPTH_ACCUMULATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** \brief Per pixel temporal average of depth images, zero depth is missing and not counted.
+  * All buffers are allocated once, adding a sample is a branch free pass the compiler vectorizes.
+  * MEDIAN keeps the last window samples and returns their median. ROBUST_MEAN takes the median of
+  * the first window samples as reference and averages only samples within rejection_ratio of it.
+  */
+class DepthAccumulator {
+public:
+    enum Mode {
+        MEAN,
+        MEDIAN,
+        ROBUST_MEAN
+    };
+
+    DepthAccumulator(const size_t& pixels_count, const Mode& mode, const int& window, const float& rejection_ratio);
+
+    void reset();
+
+    void add(const uint16_t* depth);
+
+    /** \brief Zero where no sample is valid. */
+    void result(uint16_t* depth) const;
+
+    size_t samplesCount() const;
+
+    /** \brief MEAN, MEDIAN or ROBUST_MEAN, MEAN for anything else. */
+    static Mode modeFromString(const std::string& mode);
+
+private:
+    const size_t pixels_count;
+    const Mode mode;
+    const size_t window;
+    const float rejection_ratio;
+
+    size_t samples_count;
+    std::vector<uint32_t> sums;
+    std::vector<uint32_t> counts;
+    //Sample * pixels_count + pixel, ring of the last window samples
+    std::vector<uint16_t> samples;
+    std::vector<uint16_t> reference;
+
+    void accumulate(const uint16_t* depth);
+    void accumulate_within_reference(const uint16_t* depth);
+    void compute_medians(uint16_t* depth) const;
+};
+
+#endif // DEPTH_ACCUMULATOR_H
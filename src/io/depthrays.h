@@ -0,0 +1,35 @@
+#ifndef DEPTH_RAYS_H
+#define DEPTH_RAYS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** \brief openni::CoordinateConverter::convertDepthToWorld as a table: the world point of a pixel is its
+  * depth times the ray of the pixel, and the x of the ray only depends on the column, the y on the row.
+  * The table is built once per stream mode and applied 4 pixels per SSE step.
+  */
+class DepthRays {
+public:
+    typedef std::shared_ptr<const DepthRays> ConstPtr;
+
+    DepthRays(const int& width, const int& height, const float& horizontal_fov, const float& vertical_fov);
+
+    /** \brief Table of the mode, the last one built is shared until the mode changes. */
+    static ConstPtr forMode(const int& width, const int& height, const float& horizontal_fov, const float& vertical_fov);
+
+    /** \brief width * height xyz triples into world, row by row. */
+    void apply(const uint16_t* depth, float* world) const;
+
+private:
+    const int width;
+    const int height;
+    const float horizontal_fov;
+    const float vertical_fov;
+
+    std::vector<float> column_rays;
+    std::vector<float> row_rays;
+};
+
+#endif // DEPTH_RAYS_H
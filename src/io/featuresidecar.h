@@ -0,0 +1,55 @@
+#ifndef FEATURE_SIDECAR_H
+#define FEATURE_SIDECAR_H
+
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+/** \brief Per frame feature file stored next to the frame: header with the
+  * detector parameters hash, packed keypoints and raw descriptor matrix.
+  */
+namespace feature_sidecar
+{
+
+#pragma pack(push, 1)
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t parameters_hash;
+    uint32_t keypoints_count;
+    uint32_t descriptor_rows;
+    uint32_t descriptor_cols;
+    uint32_t descriptor_type;
+};
+
+struct PackedKeypoint
+{
+    float x;
+    float y;
+    float size;
+    float angle;
+    float response;
+    int32_t octave;
+    int32_t class_id;
+};
+#pragma pack(pop)
+
+bool save(
+    const QString& filename,
+    const uint64_t& parameters_hash,
+    const std::vector<cv::KeyPoint>& keypoints,
+    const cv::Mat& descriptors);
+
+/** \brief Fails when the file is missing, damaged or written with other detector parameters. */
+bool load(
+    const QString& filename,
+    const uint64_t& parameters_hash,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::Mat& descriptors);
+
+} // namespace feature_sidecar
+
+#endif // FEATURE_SIDECAR_H
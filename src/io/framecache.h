@@ -0,0 +1,68 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <QString>
+
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "core/base/scannertypes.h"
+#include "io/compactframe.h"
+
+/** \brief Process wide LRU cache of loaded frames keyed by project and frame index.
+  * Past the process memory budget, see memory_accounting, it evicts frames on every insertion.
+  * With FRAME_CACHE_SETTINGS/COMPACT the frames are held as CompactFrame and expanded on every hit.
+  */
+class FrameCache {
+public:
+    typedef std::function<Frame(uint)> Loader;
+
+    static FrameCache& instance();
+
+    Frame get(const QString& project, const uint& frame_index, const Loader& loader);
+
+    /** \brief Drops the frames whose source pattern lies directly in the data folder. */
+    void invalidate(const QString& project);
+
+    void clear();
+
+    size_t getMemoryUsage();
+
+    static size_t frame_size(const Frame& frame);
+
+private:
+    typedef std::pair<QString, uint> Key;
+
+    struct Entry {
+        Frame frame;
+        //Set instead of the frame for compacted frames
+        CompactFrame::ConstPtr compact;
+        size_t size;
+        std::list<Key>::iterator lru_it;
+    };
+
+    FrameCache();
+
+    bool enabled;
+    size_t memory_budget;
+    bool compact;
+    //Meters
+    float compact_tolerance;
+    uint64_t settings_generation;
+
+    std::mutex mutex;
+    std::map<Key, Entry> entries;
+    std::list<Key> lru;
+    size_t memory_usage;
+
+    /** \brief Reads the settings again after a config reload, under the mutex.
+      * Frames held with another compaction are dropped, a new tolerance must not hit old quantized frames.
+      */
+    void refresh_settings();
+
+    void evict();
+};
+
+#endif // FRAME_CACHE_H
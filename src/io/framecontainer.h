@@ -0,0 +1,71 @@
+#ifndef FRAME_CONTAINER_H
+#define FRAME_CONTAINER_H
+
+#include <QString>
+
+#include <opencv2/opencv.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+
+#include "core/base/cameraintrinsics.h"
+
+/** \brief Compact single file frame format: header with intrinsics,
+  * uint16 depth in millimetres and a raw BGR or JPEG colour plane.
+  */
+namespace frame_container
+{
+
+enum ColorEncoding {
+    COLOR_RAW_BGR = 0,
+    COLOR_JPEG = 1
+};
+
+#pragma pack(push, 1)
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+    float depth_units_per_meter;
+    uint32_t color_encoding;
+    uint32_t depth_size;
+    uint32_t color_size;
+};
+#pragma pack(pop)
+
+bool encode(
+    const cv::Mat& depth_mm,
+    const cv::Mat& color,
+    const CameraIntrinsics& intrinsics,
+    const int& jpeg_quality,
+    std::vector<char>& buffer);
+
+bool decode(
+    const char* data,
+    const size_t& size,
+    pcl::PointCloud<pcl::PointXYZRGB>& cloud,
+    cv::Mat& image,
+    CameraIntrinsics* intrinsics = nullptr);
+
+bool save(
+    const QString& filename,
+    const cv::Mat& depth_mm,
+    const cv::Mat& color,
+    const CameraIntrinsics& intrinsics,
+    const int& jpeg_quality);
+
+bool load(
+    const QString& filename,
+    pcl::PointCloud<pcl::PointXYZRGB>& cloud,
+    cv::Mat& image);
+
+} // namespace frame_container
+
+#endif // FRAME_CONTAINER_H
@@ -0,0 +1,49 @@
+#ifndef FRAME_INDEX_H
+#define FRAME_INDEX_H
+
+#include <QString>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** \brief Sorted indexes of all complete frames (cloud and image pair or frame container) of a data folder.
+  * Built once per folder, persisted next to it and shared read-only between iterators.
+  */
+class FrameIndex {
+public:
+    typedef std::shared_ptr<const FrameIndex> ConstPtr;
+
+    static ConstPtr get(const QString& data_folder);
+
+    static void invalidate(const QString& data_folder);
+
+    const std::vector<uint>& getIndexes() const;
+
+    const QString& getDataFolder() const;
+
+private:
+    explicit FrameIndex(const QString& data_folder);
+
+    QString data_folder;
+    qint64 folder_timestamp;
+    std::vector<uint> indexes;
+
+    static std::mutex mutex;
+    static std::map<QString, ConstPtr> indexes_map;
+
+    QString index_filename() const;
+
+    bool load_index_file();
+
+    void save_index_file() const;
+
+    void scan_data_folder();
+
+    static qint64 timestamp(const QString& data_folder);
+
+    static bool parse_index(const QString& filename, uint& index);
+};
+
+#endif // FRAME_INDEX_H
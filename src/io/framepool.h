@@ -0,0 +1,83 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** \brief Recycles objects with large buffers, an object acquired comes back to the pool when its last
+  * pointer is released. Up to capacity objects are kept, past it acquire() makes new ones and they are
+  * deleted on release, so a burst never blocks the capture. Objects may outlive the pool.
+  */
+template <typename T>
+class FramePool {
+public:
+    typedef boost::shared_ptr<T> Ptr;
+    typedef std::function<T*()> Factory;
+
+    FramePool(const size_t& capacity, const Factory& factory)
+        : state(std::make_shared<State>())
+    {
+        state->capacity = capacity;
+        state->factory = factory;
+        state->free_objects.reserve(capacity);
+        state->created_count = 0;
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    Ptr acquire()
+    {
+        T* object = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->free_objects.empty()) {
+                object = state->free_objects.back().release();
+                state->free_objects.pop_back();
+            }
+        }
+
+        if (object == nullptr) {
+            object = state->factory();
+            std::lock_guard<std::mutex> lock(state->mutex);
+            ++state->created_count;
+        }
+
+        const std::shared_ptr<State> owner = state;
+        return Ptr(object, [owner](T* released) { owner->give_back(released); });
+    }
+
+    /** \brief Objects made so far, stays at the peak number in use once the capture is steady. */
+    size_t getCreatedCount() const
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->created_count;
+    }
+
+private:
+    struct State {
+        size_t capacity;
+        Factory factory;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<T> > free_objects;
+        size_t created_count;
+
+        void give_back(T* released)
+        {
+            std::unique_ptr<T> object(released);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (free_objects.size() < capacity) {
+                free_objects.push_back(std::move(object));
+            }
+        }
+    };
+
+    std::shared_ptr<State> state;
+};
+
+#endif // FRAME_POOL_H
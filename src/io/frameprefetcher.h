@@ -0,0 +1,48 @@
+#ifndef FRAME_PREFETCHER_H
+#define FRAME_PREFETCHER_H
+
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Keeps the next frames of a range decoding in the shared thread pool
+  * while the current frame is processed. Every reader, a slice of the range walked by one worker,
+  * has a window of its own, so readers at different positions do not evict each other's frames.
+  */
+class FramePrefetcher {
+public:
+    typedef std::function<Frame(uint)> Loader;
+    /** \brief Id of a reader, its prefetched frames are dropped with the last copy. */
+    typedef std::shared_ptr<const uint> Reader;
+
+    FramePrefetcher(const Loader& loader, const std::vector<uint>& range, uint depth);
+
+    static Reader addReader(const std::shared_ptr<FramePrefetcher>& prefetcher);
+
+    /** \brief Frame at position, the reader's window moves to the frames after it and before end. */
+    Frame get(const Reader& reader, uint position, uint end);
+
+private:
+    struct Entry {
+        std::shared_future<Frame> frame;
+        uint reader;
+    };
+
+    const Loader loader;
+    const std::vector<uint> range;
+    const uint depth;
+
+    std::mutex mutex;
+    uint next_reader;
+    std::map<uint, Entry> queue;
+
+    void schedule(uint position, uint reader);
+
+    void release_reader(uint reader);
+};
+
+#endif // FRAME_PREFETCHER_H
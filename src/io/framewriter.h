@@ -0,0 +1,53 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** \brief Bounded queue of write jobs served by its own writer threads.
+  * Producers either block while the queue is full or drop the job and count it.
+  */
+class FrameWriter {
+public:
+    typedef std::function<void()> Job;
+
+    FrameWriter(size_t max_queue_size, size_t threads_count);
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    bool enqueue(const Job& job, const bool& drop_when_full = false);
+
+    void wait();
+
+    size_t getQueueSize();
+
+    size_t getDroppedCount() const;
+
+    size_t getWrittenCount() const;
+
+private:
+    const size_t max_queue_size;
+
+    std::vector<std::thread> writers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable space_available;
+    std::condition_variable all_done;
+    size_t active_jobs;
+    bool stopping;
+
+    std::atomic<size_t> dropped_count;
+    std::atomic<size_t> written_count;
+
+    void work();
+};
+
+#endif // FRAME_WRITER_H
@@ -0,0 +1,52 @@
+#include "io/blockstore.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+BlockStore::BlockStore(const std::string& filename_, const size_t& record_size_)
+    : filename(filename_)
+    , record_size(record_size_)
+    , file(filename_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc)
+    , written_count(0)
+    , read_count(0)
+{
+    if (!file.is_open()) {
+        throw std::runtime_error("BlockStore::BlockStore can't open " + filename);
+    }
+}
+
+BlockStore::~BlockStore()
+{
+    file.close();
+    std::remove(filename.c_str());
+}
+
+void BlockStore::write(const uint64_t& record, const void* data)
+{
+    file.seekp(std::streamoff(record * record_size));
+    file.write(static_cast<const char*>(data), std::streamsize(record_size));
+    if (!file) {
+        throw std::runtime_error("BlockStore::write can't write " + filename);
+    }
+    ++written_count;
+}
+
+void BlockStore::read(const uint64_t& record, void* data)
+{
+    file.seekg(std::streamoff(record * record_size));
+    file.read(static_cast<char*>(data), std::streamsize(record_size));
+    if (!file) {
+        throw std::runtime_error("BlockStore::read can't read " + filename);
+    }
+    ++read_count;
+}
+
+size_t BlockStore::writtenCount() const
+{
+    return written_count;
+}
+
+size_t BlockStore::readCount() const
+{
+    return read_count;
+}
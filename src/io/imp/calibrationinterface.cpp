@@ -1,10 +1,18 @@
 #include "io/calibrationinterface.h"
+#include "utility/hash.h"
+#include "utility/log.h"
+#include "utility/threadpool.h"
 
-#define WIDTH 640
-#define HEIGHT 480
+#include <QDateTime>
+
+#include <array>
+#include <chrono>
+#include <exception>
 
 CalibrationInterface::CalibrationInterface(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
+    , width(resolution::sensorWidth(configs))
+    , height(resolution::sensorHeight(configs))
 {
 }
 
@@ -48,7 +56,7 @@ void CalibrationInterface::initialize()
         calib_plane_vector.push_back(PcdPtr(new Pcd(*raw_pcd_data_vector[i])));
 
         //Fill calib map vector
-        calib_map_vector.push_back(CalibMap(WIDTH * HEIGHT, 0));
+        calib_map_vector.push_back(CalibMap(size_t(width) * height, 0));
     }
 }
 
@@ -70,19 +78,19 @@ void CalibrationInterface::initialize(PcdPtrVector input_pcd_vector)
         calib_plane_vector.push_back(PcdPtr(new Pcd(*raw_pcd_data_vector[i])));
 
         //Fill calib map vector
-        calib_map_vector.push_back(CalibMap(WIDTH * HEIGHT, 0));
+        calib_map_vector.push_back(CalibMap(size_t(width) * height, 0));
     }
 }
 
 void CalibrationInterface::calibrate_all_pcd()
 {
-    qDebug() << "Calibration...";
+    LOG_INFO("io") << "Calibration...";
 
-    for (uint i = 0; i < raw_pcd_data_vector.size(); ++i) {
-        calibrate_one_pcd(i);
-    }
+    ThreadPool::instance().parallel_for(0, raw_pcd_data_vector.size(), [this](size_t i) {
+        calibrate_one_pcd(int(i));
+    });
 
-    qDebug() << "Done!";
+    LOG_INFO("io") << "Done!";
 }
 
 void CalibrationInterface::calibrate_one_pcd(int index)
@@ -92,37 +100,46 @@ void CalibrationInterface::calibrate_one_pcd(int index)
     calculate_calibration_map(index);
 }
 
+/** \brief Sums of the normal equations per row of points, added up in row order so the result does
+  * not depend on the threads. Doubles, a float sum of a whole plane loses the low digits.
+  */
 void CalibrationInterface::calculate_least_squares(int index)
 {
-    Eigen::VectorXf b_vector(3);
-    float v_x1 = 0.0f, v_x2 = 0.0f, v_x3 = 0.0f;
+    const Pcd& cloud = *raw_pcd_data_vector[index];
+    std::vector<std::array<double, 8> > row_sums(rows_count(index));
+
+    ThreadPool::instance().parallel_for(0, row_sums.size(), [&](size_t row) {
+        double xx = 0.0, xy = 0.0, x_sum = 0.0, yy = 0.0, y_sum = 0.0, xz = 0.0, yz = 0.0, z_sum = 0.0;
+        const size_t end = std::min(cloud.size(), (row + 1) * size_t(width));
+        for (size_t i = row * size_t(width); i < end; ++i) {
+            const double x = cloud.points[i].x;
+            const double y = cloud.points[i].y;
+            const double z = cloud.points[i].z;
+            xx += x * x;
+            xy += x * y;
+            x_sum += x;
+            yy += y * y;
+            y_sum += y;
+            xz += x * z;
+            yz += y * z;
+            z_sum += z;
+        }
+        row_sums[row] = { { xx, xy, x_sum, yy, y_sum, xz, yz, z_sum } };
+    });
 
-    Eigen::MatrixXf A_matrix(3, 3);
-    float x11 = 0.0f, x12 = 0.0f, x13 = 0.0f;
-    float x21 = 0.0f, x22 = 0.0f, x23 = 0.0f;
-    float x31 = 0.0f, x32 = 0.0f, x33 = 0.0f;
-
-    for (uint i = 0; i < (*raw_pcd_data_vector[index]).size(); ++i) {
-        const float x = (*raw_pcd_data_vector[index])[i].x;
-        const float y = (*raw_pcd_data_vector[index])[i].y;
-        const float z = raw_pcd_data_vector[index].get()->points[i].z;
-        x11 += x * x;
-        x12 += x * y;
-        x13 += x;
-        x21 += x * y;
-        x22 += y * y;
-        x23 += y;
-        x31 += x;
-        x32 += y;
-
-        v_x1 += x * z;
-        v_x2 += y * z;
-        v_x3 += z;
+    std::array<double, 8> sums = {};
+    for (const auto& row : row_sums) {
+        for (size_t j = 0; j < sums.size(); ++j) {
+            sums[j] += row[j];
+        }
     }
-    x33 = static_cast<float>(raw_pcd_data_vector[index].get()->points.size());
 
-    A_matrix << x11, x12, x13, x21, x22, x23, x31, x32, x33;
-    b_vector << v_x1, v_x2, v_x3;
+    Eigen::MatrixXf A_matrix(3, 3);
+    A_matrix << float(sums[0]), float(sums[1]), float(sums[2]),
+        float(sums[1]), float(sums[3]), float(sums[4]),
+        float(sums[2]), float(sums[4]), float(cloud.points.size());
+    Eigen::VectorXf b_vector(3);
+    b_vector << float(sums[5]), float(sums[6]), float(sums[7]);
 
     x_vector[index] = A_matrix.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b_vector);
 }
@@ -132,137 +149,233 @@ void CalibrationInterface::calculate_calibration_plane(int index)
     const float A = x_vector[index][0];
     const float B = x_vector[index][1];
     const float C = x_vector[index][2];
-
-    float D = (*raw_pcd_data_vector[index])[0].z;
-    for (uint i = 1; i < (*raw_pcd_data_vector[index]).size(); ++i) {
-        D += (*raw_pcd_data_vector[index])[i].z;
-        D /= 2;
-    }
-
-    for (int i = 0; i < raw_pcd_data_vector[index].get()->points.size(); i++) {
-        const float x = (*raw_pcd_data_vector[index])[i].x;
-        const float y = (*raw_pcd_data_vector[index])[i].y;
-        const float z = (-(A * x) / C) + (-(B * y) / C) + C;
-
-        (*calib_plane_vector[index])[i].x = x;
-        (*calib_plane_vector[index])[i].y = y;
-        (*calib_plane_vector[index])[i].z = z;
-    }
+    //z = -(A * x) / C - (B * y) / C + C with the divisions out of the loop
+    const float a = -A / C;
+    const float b = -B / C;
+
+    const Pcd& raw = *raw_pcd_data_vector[index];
+    Pcd& plane = *calib_plane_vector[index];
+    ThreadPool::instance().parallel_for(0, rows_count(index), [&](size_t row) {
+        const size_t end = std::min(raw.size(), (row + 1) * size_t(width));
+        for (size_t i = row * size_t(width); i < end; ++i) {
+            const float x = raw.points[i].x;
+            const float y = raw.points[i].y;
+            plane.points[i].x = x;
+            plane.points[i].y = y;
+            plane.points[i].z = a * x + b * y + C;
+        }
+    });
 }
 
 void CalibrationInterface::calculate_calibration_map(int index)
 {
-    for (int i = 0; i < matches_vector[index].size(); i++) {
-        const float raw_z = (*raw_pcd_data_vector[index])[i].z;
-        const float plane_z = (*calib_plane_vector[index])[i].z;
-        const float shift = raw_z - plane_z;
-        calib_map_vector[index][matches_vector[index][i]] = shift;
-    }
+    const Pcd& raw = *raw_pcd_data_vector[index];
+    const Pcd& plane = *calib_plane_vector[index];
+    const std::vector<int>& matches = matches_vector[index];
+    CalibMap& map = calib_map_vector[index];
+
+    //Every point has its own pixel, the rows write apart
+    ThreadPool::instance().parallel_for(0, rows_count(index), [&](size_t row) {
+        const size_t end = std::min(matches.size(), (row + 1) * size_t(width));
+        for (size_t i = row * size_t(width); i < end; ++i) {
+            map[matches[i]] = raw.points[i].z - plane.points[i].z;
+        }
+    });
+}
+
+size_t CalibrationInterface::rows_count(int index) const
+{
+    return (raw_pcd_data_vector[index]->size() + size_t(width) - 1) / size_t(width);
 }
 
 //####################################################################
 //-------------------------Undistortion-------------------------------
 
+/** \brief Frames are independent, rows of a frame too, so all rows are spread over the thread pool. */
 void CalibrationInterface::undistort(Frames& frames)
 {
+    const UndistortionTable::ConstPtr table = getUndistortionTable();
+    if (table->empty()) {
+        return;
+    }
+
     for (uint i = 0; i < frames.size(); ++i) {
-        udistort_pcd_vector.push_back(frames[i].pointCloudPtr);
+        if (frames[i].width != width || frames[i].height != height) {
+            LOG_WARNING("io") << "Frame" << frames[i].frameIndex << "is" << frames[i].width << "x" << frames[i].height
+                              << ", the calibration is" << width << "x" << height << ", it is not undistorted";
+            continue;
+        }
+        frames[i].detach();
     }
 
-    undistort_all_pcd();
+    LOG_INFO("io") << "Applying undistortion to" << frames.size() << "point clouds...";
+    ThreadPool::instance().parallel_for(0, frames.size() * height, [&](size_t row) {
+        Pcd& cloud = *frames[row / height].pointCloudPtr;
+        if (int(cloud.width) != width || int(cloud.height) != height) {
+            return;
+        }
+        const int y = int(row % height);
+        table->apply(&cloud.at(0, y).z, sizeof(PointType), y * width, width);
+    });
+    LOG_INFO("io") << "Done!";
 }
 
-void CalibrationInterface::undistort_all_pcd()
+CalibrationModel::ConstPtr CalibrationInterface::getModel()
 {
-    //Reorganize
-    for (int i = 0; i < matches_vector.size(); i++) {
-        PcdPtr tmp_pdc_ptr(new Pcd);
-        tmp_pdc_ptr->width = WIDTH;
-        tmp_pdc_ptr->height = HEIGHT;
-        tmp_pdc_ptr->resize(HEIGHT * WIDTH);
-
-        for (uint y = 0; y < HEIGHT; ++y) {
-            for (uint x = 0; x < WIDTH; ++x) {
-                tmp_pdc_ptr->at(x, y).x = 0;
-                tmp_pdc_ptr->at(x, y).y = 0;
-                tmp_pdc_ptr->at(x, y).z = NAN;
-                tmp_pdc_ptr->at(x, y).r = 0;
-                tmp_pdc_ptr->at(x, y).g = 0;
-                tmp_pdc_ptr->at(x, y).b = 0;
-            }
+    const QString filename = model_filename();
+    const uint64_t parameters_hash = model_parameters_hash();
+    const QString key = model_key(filename, parameters_hash);
+
+    //Built outside the lock, the build loads the clouds and waits for the pool
+    std::promise<CalibrationModel::ConstPtr> promise;
+    std::shared_future<CalibrationModel::ConstPtr> model;
+    {
+        std::lock_guard<std::mutex> lock(models_mutex);
+        const auto it = models.find(key);
+        if (it == models.end()) {
+            ModelEntry entry = { promise.get_future().share(), std::this_thread::get_id() };
+            models.insert(std::make_pair(key, entry));
+        } else if (it->second.builder == std::this_thread::get_id()
+            && it->second.model.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return load_model(filename, parameters_hash);
+        } else {
+            model = it->second.model;
         }
+    }
 
-        for (uint j = 0; j < raw_pcd_data_vector[i]->size(); ++j) {
-            tmp_pdc_ptr->points[matches_vector[i][j]] = raw_pcd_data_vector[i]->points[j];
+    if (model.valid()) {
+        ThreadPool::instance().wait(model);
+        return model.get();
+    }
+
+    try {
+        const CalibrationModel::ConstPtr built = load_model(filename, parameters_hash);
+        promise.set_value(built);
+        return built;
+    } catch (...) {
+        //The next caller tries again
+        {
+            std::lock_guard<std::mutex> lock(models_mutex);
+            models.erase(key);
         }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
 
-        *raw_pcd_data_vector[i] = *tmp_pdc_ptr;
-        raw_pcd_data_vector[i]->is_dense = false;
+CalibrationModel::ConstPtr CalibrationInterface::load_model(const QString& filename, const uint64_t& parameters_hash)
+{
+    CalibrationModel::ConstPtr model = CalibrationModel::load(filename, parameters_hash, uint32_t(width) * height);
+    if (!model) {
+        model = build_model();
+        if (!model->save(filename, parameters_hash)) {
+            LOG_WARNING("io") << "Calibration model could not be saved to" << filename;
+        }
     }
+    return model;
+}
 
-    //Undistort
-    qDebug() << "Applying undistortion to point clouds...";
-    for (int i = 0; i < udistort_pcd_vector.size(); i++) {
-        qDebug() << QString("Undistortion %1 / %2").arg(i + 1).arg(udistort_pcd_vector.size()).toStdString().c_str();
-        undistort_one_pcd(i);
+UndistortionTable::ConstPtr CalibrationInterface::getUndistortionTable()
+{
+    const QString key = model_key(model_filename(), model_parameters_hash());
+    {
+        std::lock_guard<std::mutex> lock(models_mutex);
+        const auto it = tables.find(key);
+        if (it != tables.end()) {
+            return it->second;
+        }
     }
-    qDebug() << "Done!";
+
+    const CalibrationModel::ConstPtr model = getModel();
+    const UndistortionTable::ConstPtr table = std::make_shared<UndistortionTable>(*model, width * height);
+
+    std::lock_guard<std::mutex> lock(models_mutex);
+    return tables.insert(std::make_pair(key, table)).first->second;
 }
 
-void CalibrationInterface::undistort_one_pcd(int index)
+//----------------------------------------------------
+
+std::mutex CalibrationInterface::models_mutex;
+std::map<QString, CalibrationInterface::ModelEntry> CalibrationInterface::models;
+std::map<QString, UndistortionTable::ConstPtr> CalibrationInterface::tables;
+
+QString CalibrationInterface::model_filename() const
 {
-    if (udistort_pcd_vector.empty() || raw_pcd_data_vector.empty()) {
-        return;
+    return QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+        + configs.value("CALIBRATION_SETTINGS/MODEL_NAME").toString();
+}
+
+QString CalibrationInterface::model_key(const QString& filename, const uint64_t& parameters_hash) const
+{
+    return filename + QString("@%1").arg(qulonglong(parameters_hash), 16, 16, QChar('0'));
+}
+
+/** \brief Hash of the calibration clouds' names, sizes and modification times. */
+uint64_t CalibrationInterface::model_parameters_hash() const
+{
+    const QString folder = QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/";
+    const int number = configs.value("CALIBRATION_SETTINGS/NUMBER").toInt();
+
+    uint64_t result = hash::fnv1a_value(number);
+    for (int i = 0; i < number; ++i) {
+        const QFileInfo info(folder + configs.value("CALIBRATION_SETTINGS/POINT_CLOUD_NAME").toString().arg(i));
+        const QByteArray name = info.fileName().toUtf8();
+        result = hash::fnv1a(name.constData(), size_t(name.size()) + 1, result);
+        result = hash::fnv1a_value(qint64(info.exists() ? info.size() : -1), result);
+        result = hash::fnv1a_value(qint64(info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1), result);
     }
 
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            if (!std::isnan(udistort_pcd_vector[index]->at(x, y).z)) {
-                float z = udistort_pcd_vector[index]->at(x, y).z;
-
-                //Detecting sample radius
-                int begin_index = -1;
-                int end_index = -1;
-                for (int i = 0; i < raw_pcd_data_vector.size(); i++) {
-                    if (std::isnan(raw_pcd_data_vector[i]->at(x, y).z)) {
-                        continue;
-                    }
-
-                    if (raw_pcd_data_vector[i]->at(x, y).z > z) {
-                        end_index = i;
-                        if (i > 0) {
-                            begin_index = i - 1;
-                        }
-                        break;
-                    }
-                }
-
-                //Undistort
-                if (begin_index == -1 && end_index == -1) {
-                    const float shift = calib_map_vector[calib_map_vector.size() - 1][x + y * WIDTH];
-                    udistort_pcd_vector[index].get()->at(x, y).z -= shift;
-                } else if (begin_index == -1 && end_index != -1) {
-                    const float shift = calib_map_vector[0][x + y * WIDTH];
-                    udistort_pcd_vector[index].get()->at(x, y).z -= shift;
-                } else {
-                    const float shift_1 = calib_map_vector[begin_index][x + y * WIDTH];
-                    const float shift_2 = calib_map_vector[end_index][x + y * WIDTH];
-                    const float z_1 = raw_pcd_data_vector[begin_index].get()->at(x, y).z;
-                    const float z_2 = raw_pcd_data_vector[end_index].get()->at(x, y).z;
-
-                    if (z >= z_1 && z < z_2) //If Z fits in the radius
-                    {
-                        const float n = ((z - z_1) / ((z_2 - z_1) / 100.0f)) / 100.0f;
-                        const float k = (shift_2 - shift_1) * n;
-                        udistort_pcd_vector[index]->at(x, y).z -= shift_1 + k;
-                    } else //If it does not
-                    {
-                        udistort_pcd_vector[index].get()->at(x, y).z -= shift_1;
-                    }
-                }
-            }
+    return result;
+}
+
+CalibrationModel::ConstPtr CalibrationInterface::build_model()
+{
+    loadCalibrationData();
+    calibrate();
+
+    ThreadPool::instance().parallel_for(0, matches_vector.size(), [this](size_t i) {
+        reorganize_one_pcd(int(i));
+    });
+
+    auto model = std::make_shared<CalibrationModel>();
+    for (uint i = 0; i < raw_pcd_data_vector.size(); ++i) {
+        std::vector<float> depth(size_t(width) * height);
+        for (uint j = 0; j < depth.size(); ++j) {
+            depth[j] = raw_pcd_data_vector[i]->points[j].z;
         }
+        model->depths.push_back(std::move(depth));
+        model->shifts.push_back(calib_map_vector[i]);
     }
+
+    return model;
+}
+
+void CalibrationInterface::reorganize_one_pcd(int index)
+{
+    //Per thread, after the swap it holds the compact cloud and is reused by the next one
+    thread_local Pcd organized;
+    organized.resize(size_t(width) * height);
+    organized.width = width;
+    organized.height = height;
+
+    for (uint i = 0; i < organized.size(); ++i) {
+        PointType& point = organized[i];
+        point.x = 0;
+        point.y = 0;
+        point.z = NAN;
+        point.r = 0;
+        point.g = 0;
+        point.b = 0;
+    }
+
+    for (uint j = 0; j < raw_pcd_data_vector[index]->size(); ++j) {
+        organized.points[matches_vector[index][j]] = raw_pcd_data_vector[index]->points[j];
+    }
+
+    raw_pcd_data_vector[index]->swap(organized);
+    raw_pcd_data_vector[index]->is_dense = false;
 }
 
 //####################################################################
@@ -274,24 +387,24 @@ void CalibrationInterface::saveCalibrationData()
 
 void CalibrationInterface::loadCalibrationData()
 {
-    const bool log = configs.value("CALIBRATION_SETTINGS/NUMBER").toBool();
+    const bool log = configs.value("CALIBRATION_SETTINGS/ENABLE_LOG").toBool();
 
     if (log) {
-        qDebug() << "Load calibration data\n"
-                 << "Start reading data...";
+        LOG_INFO("io") << "Load calibration data\n"
+                       << "Start reading data...";
     }
 
     raw_pcd_data_vector.clear();
     int to = configs.value("CALIBRATION_SETTINGS/NUMBER").toInt();
     for (uint i = 0; i < to; ++i) {
         if (log) {
-            qDebug() << "Reading" << QFileInfo(settings->fileName()).absolutePath() + "/" + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/" + configs.value("CALIBRATION_SETTINGS/POINT_CLOUD_NAME").toString().arg(i);
+            LOG_INFO("io") << "Reading" << QFileInfo(project.fileName()).absolutePath() + "/" + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/" + configs.value("CALIBRATION_SETTINGS/POINT_CLOUD_NAME").toString().arg(i);
         }
 
         PcdPtr point_cloud_ptr(new Pcd);
         pcl_io::load_one_point_cloud(
-            (QFileInfo(settings->fileName()).absolutePath() + "/"
-                + settings->value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
+            (QFileInfo(project.fileName()).absolutePath() + "/"
+                + project.value("PROJECT_SETTINGS/CALIB_DATA_FOLDER").toString() + "/"
                 + configs.value("CALIBRATION_SETTINGS/POINT_CLOUD_NAME").toString().arg(i)),
             point_cloud_ptr);
         pcl_io::scale_one_point_cloud(point_cloud_ptr);
@@ -304,7 +417,7 @@ void CalibrationInterface::loadCalibrationData()
     }
 
     if (log) {
-        qDebug() << "Done!\n"
-                 << "Total:" << raw_pcd_data_vector.size();
+        LOG_INFO("io") << "Done!\n"
+                       << "Total:" << raw_pcd_data_vector.size();
     }
 }
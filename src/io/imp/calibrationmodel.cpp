@@ -0,0 +1,82 @@
+#include "io/calibrationmodel.h"
+
+#include <QFile>
+#include <QSaveFile>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char CALIBRATION_MODEL_MAGIC[4] = { 'R', 'S', 'C', 'M' };
+const uint32_t CALIBRATION_MODEL_VERSION = 1;
+
+} // namespace
+
+bool CalibrationModel::save(const QString& filename, const uint64_t& parameters_hash) const
+{
+    if (depths.size() != shifts.size()) {
+        throw std::invalid_argument("CalibrationModel::save depths.size() != shifts.size()");
+    }
+
+    Header header;
+    std::memcpy(header.magic, CALIBRATION_MODEL_MAGIC, sizeof(header.magic));
+    header.version = CALIBRATION_MODEL_VERSION;
+    header.parameters_hash = parameters_hash;
+    header.planes_count = uint32_t(depths.size());
+    header.plane_size = depths.empty() ? 0 : uint32_t(depths.front().size());
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(reinterpret_cast<const char*>(&header), sizeof(Header)) != qint64(sizeof(Header))) {
+        return false;
+    }
+
+    const qint64 plane_bytes = qint64(header.plane_size * sizeof(float));
+    for (uint32_t i = 0; i < header.planes_count; ++i) {
+        if (depths[i].size() != header.plane_size || shifts[i].size() != header.plane_size) {
+            throw std::invalid_argument("CalibrationModel::save planes of different sizes");
+        }
+        if (file.write(reinterpret_cast<const char*>(depths[i].data()), plane_bytes) != plane_bytes
+            || file.write(reinterpret_cast<const char*>(shifts[i].data()), plane_bytes) != plane_bytes) {
+            return false;
+        }
+    }
+
+    return file.commit();
+}
+
+CalibrationModel::ConstPtr CalibrationModel::load(
+    const QString& filename, const uint64_t& parameters_hash, const uint32_t& plane_size)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+
+    Header header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(Header)) != qint64(sizeof(Header))
+        || std::memcmp(header.magic, CALIBRATION_MODEL_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CALIBRATION_MODEL_VERSION
+        || header.parameters_hash != parameters_hash
+        || (header.planes_count != 0 && header.plane_size != plane_size)) {
+        return nullptr;
+    }
+
+    const qint64 plane_bytes = qint64(header.plane_size * sizeof(float));
+    if (file.size() != qint64(sizeof(Header)) + 2 * plane_bytes * header.planes_count) {
+        return nullptr;
+    }
+
+    auto model = std::make_shared<CalibrationModel>();
+    model->depths.resize(header.planes_count, std::vector<float>(header.plane_size));
+    model->shifts.resize(header.planes_count, std::vector<float>(header.plane_size));
+    for (uint32_t i = 0; i < header.planes_count; ++i) {
+        if (file.read(reinterpret_cast<char*>(model->depths[i].data()), plane_bytes) != plane_bytes
+            || file.read(reinterpret_cast<char*>(model->shifts[i].data()), plane_bytes) != plane_bytes) {
+            return nullptr;
+        }
+    }
+
+    return model;
+}
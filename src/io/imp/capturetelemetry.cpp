@@ -0,0 +1,100 @@
+#include "io/capturetelemetry.h"
+
+#include <algorithm>
+#include <cmath>
+
+CaptureTelemetry::Figures::Figures()
+    : frames(0)
+    , mean_latency_ms(0)
+    , max_latency_ms(0)
+    , mean_skew_ms(0)
+    , max_skew_ms(0)
+    , sensor_dropped(0)
+    , fps(0)
+{
+}
+
+CaptureTelemetry::CaptureTelemetry(const int& fps)
+    : period_us(fps > 0 ? uint64_t(1000000 / fps) : 0)
+    , queues(Queues{ 0, 0, 0, 0, 0, 0 })
+    , last_depth_timestamp(0)
+    , interval_start(Clock::now())
+    , stream_start(interval_start)
+{
+}
+
+void CaptureTelemetry::add(const Sample& sample)
+{
+    const double latency_ms = std::chrono::duration<double, std::milli>(sample.completed - sample.arrival).count();
+    const double skew_ms = std::abs(double(sample.depth_timestamp) - double(sample.color_timestamp)) / 1000.0;
+
+    //A gap of n periods is n - 1 frames that never arrived, half a period of jitter is tolerated
+    size_t dropped = 0;
+    if (period_us > 0 && last_depth_timestamp > 0 && sample.depth_timestamp > last_depth_timestamp) {
+        const uint64_t gap = sample.depth_timestamp - last_depth_timestamp;
+        const uint64_t periods = (gap + period_us / 2) / period_us;
+        dropped = periods > 1 ? size_t(periods - 1) : 0;
+    }
+    last_depth_timestamp = sample.depth_timestamp;
+
+    accumulate(interval, latency_ms, skew_ms, dropped);
+    accumulate(total, latency_ms, skew_ms, dropped);
+}
+
+void CaptureTelemetry::setQueues(const Queues& queues_)
+{
+    queues = queues_;
+}
+
+bool CaptureTelemetry::reportDue(const std::chrono::milliseconds& interval_length)
+{
+    const Clock::time_point now = Clock::now();
+    if (now - interval_start < interval_length) {
+        return false;
+    }
+
+    interval.fps = double(interval.frames) / std::chrono::duration<double>(now - interval_start).count();
+    total.fps = double(total.frames) / std::chrono::duration<double>(now - stream_start).count();
+    reported = interval;
+    interval = Figures();
+    interval_start = now;
+
+    return true;
+}
+
+const CaptureTelemetry::Figures& CaptureTelemetry::getInterval() const
+{
+    return reported;
+}
+
+const CaptureTelemetry::Figures& CaptureTelemetry::getTotal() const
+{
+    return total;
+}
+
+QString CaptureTelemetry::text(const Figures& figures) const
+{
+    return QString("%1 fps, latency %2/%3 ms, skew %4/%5 ms, sensor dropped %6, ring %7/%8 dropped %9, writer %10 dropped %11, odometry dropped %12")
+        .arg(figures.fps, 0, 'f', 1)
+        .arg(figures.mean_latency_ms, 0, 'f', 1)
+        .arg(figures.max_latency_ms, 0, 'f', 1)
+        .arg(figures.mean_skew_ms, 0, 'f', 1)
+        .arg(figures.max_skew_ms, 0, 'f', 1)
+        .arg(figures.sensor_dropped)
+        .arg(queues.ring_size)
+        .arg(queues.ring_capacity)
+        .arg(queues.ring_dropped)
+        .arg(queues.writer_size)
+        .arg(queues.writer_dropped)
+        .arg(queues.odometry_dropped);
+}
+
+void CaptureTelemetry::accumulate(Figures& figures, const double& latency_ms, const double& skew_ms, const size_t& dropped)
+{
+    ++figures.frames;
+    figures.mean_latency_ms += (latency_ms - figures.mean_latency_ms) / double(figures.frames);
+    figures.max_latency_ms = std::max(figures.max_latency_ms, latency_ms);
+    figures.mean_skew_ms += (skew_ms - figures.mean_skew_ms) / double(figures.frames);
+    figures.max_skew_ms = std::max(figures.max_skew_ms, skew_ms);
+    figures.sensor_dropped += dropped;
+}
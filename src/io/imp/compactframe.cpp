@@ -0,0 +1,135 @@
+#include "io/compactframe.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+CompactFrame::CompactFrame()
+    : width(0)
+    , height(0)
+    , is_dense(false)
+    , alpha(0)
+    , image_from_colors(false)
+    , frame_index(-1)
+{
+}
+
+bool CompactFrame::pack(const Frame& frame, const float& max_error)
+{
+    if (!frame.pointCloudPtr || frame.hasPose() || !frame.pointCloudIndexes.empty()
+        || (frame.pointCloudNormalPcdPtr && !frame.pointCloudNormalPcdPtr->empty())) {
+        return false;
+    }
+
+    const Pcd& cloud = *frame.pointCloudPtr;
+    if (cloud.height <= 1 || cloud.empty() || size_t(cloud.width) * cloud.height != cloud.size()) {
+        return false;
+    }
+
+    intrinsics = CameraIntrinsics::fromOrganizedCloud(cloud);
+    if (!intrinsics.isValid()) {
+        return false;
+    }
+
+    width = int(cloud.width);
+    height = int(cloud.height);
+    is_dense = cloud.is_dense;
+    header = cloud.header;
+    alpha = cloud.points[0].a;
+    depth_mm.assign(cloud.size(), 0);
+    color_bgr.resize(cloud.size() * 3);
+
+    for (int v = 0; v < height; ++v) {
+        for (int u = 0; u < width; ++u) {
+            const size_t index = size_t(v) * width + u;
+            const PointType& source = cloud.points[index];
+            if (source.a != alpha) {
+                return false;
+            }
+
+            color_bgr[index * 3] = source.b;
+            color_bgr[index * 3 + 1] = source.g;
+            color_bgr[index * 3 + 2] = source.r;
+
+            if (std::isnan(source.x) && std::isnan(source.y) && std::isnan(source.z)) {
+                continue;
+            }
+
+            const float millimeters = std::round(source.z * 1000.0f);
+            if (!(millimeters >= 1.0f && millimeters <= 65535.0f)) {
+                return false;
+            }
+
+            depth_mm[index] = uint16_t(millimeters);
+            const Eigen::Vector3f restored = point(u, v, depth_mm[index]);
+            if (std::abs(restored.x() - source.x) > max_error || std::abs(restored.y() - source.y) > max_error
+                || std::abs(restored.z() - source.z) > max_error) {
+                return false;
+            }
+        }
+    }
+
+    //The image of PCD and BMP pairs or of containers is usually the colours of the cloud
+    const cv::Mat& frame_image = frame.pointCloudImage;
+    image_from_colors = frame_image.type() == CV_8UC3 && frame_image.cols == width && frame_image.rows == height;
+    for (int v = 0; v < height && image_from_colors; ++v) {
+        image_from_colors = std::memcmp(frame_image.ptr<uint8_t>(v), &color_bgr[size_t(v) * width * 3], size_t(width) * 3) == 0;
+    }
+    image = image_from_colors ? cv::Mat() : frame_image;
+
+    source_id = frame.sourceId;
+    frame_index = frame.frameIndex;
+
+    return true;
+}
+
+Frame CompactFrame::expand() const
+{
+    auto cloud = std::make_shared<Pcd>();
+    cloud->header = header;
+    cloud->width = uint32_t(width);
+    cloud->height = uint32_t(height);
+    cloud->is_dense = is_dense;
+    cloud->resize(size_t(width) * height);
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (int v = 0; v < height; ++v) {
+        for (int u = 0; u < width; ++u) {
+            const size_t index = size_t(v) * width + u;
+            PointType& target = cloud->points[index];
+
+            if (depth_mm[index] == 0) {
+                target.x = target.y = target.z = nan;
+            } else {
+                const Eigen::Vector3f restored = point(u, v, depth_mm[index]);
+                target.x = restored.x();
+                target.y = restored.y();
+                target.z = restored.z();
+            }
+
+            target.b = color_bgr[index * 3];
+            target.g = color_bgr[index * 3 + 1];
+            target.r = color_bgr[index * 3 + 2];
+            target.a = alpha;
+        }
+    }
+
+    Frame result;
+    result.pointCloudPtr = cloud;
+    if (image_from_colors) {
+        result.pointCloudImage.create(height, width, CV_8UC3);
+        std::memcpy(result.pointCloudImage.data, color_bgr.data(), color_bgr.size());
+    } else {
+        result.pointCloudImage = image;
+    }
+    result.setResolution(*cloud, result.pointCloudImage);
+    result.sourceId = source_id;
+    result.frameIndex = frame_index;
+
+    return result;
+}
+
+size_t CompactFrame::size() const
+{
+    return depth_mm.size() * sizeof(uint16_t) + color_bgr.size() + image.total() * image.elemSize();
+}
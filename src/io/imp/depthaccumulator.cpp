@@ -0,0 +1,138 @@
+#include "io/depthaccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "utility/threadpool.h"
+
+DepthAccumulator::DepthAccumulator(const size_t& pixels_count_, const Mode& mode_, const int& window_,
+    const float& rejection_ratio_)
+    : pixels_count(pixels_count_)
+    , mode(mode_)
+    , window(size_t(std::max(1, window_)))
+    , rejection_ratio(rejection_ratio_)
+    , samples_count(0)
+    , sums(pixels_count_, 0)
+    , counts(pixels_count_, 0)
+{
+    if (mode != MEAN) {
+        samples.resize(window * pixels_count);
+        reference.resize(pixels_count);
+    }
+}
+
+void DepthAccumulator::reset()
+{
+    samples_count = 0;
+    std::fill(sums.begin(), sums.end(), 0);
+    std::fill(counts.begin(), counts.end(), 0);
+}
+
+void DepthAccumulator::add(const uint16_t* depth)
+{
+    if (mode == MEAN) {
+        accumulate(depth);
+    } else {
+        std::copy(depth, depth + pixels_count, samples.begin() + (samples_count % window) * pixels_count);
+
+        if (mode == ROBUST_MEAN) {
+            if (samples_count + 1 == window) {
+                //The reference exists from now on, the buffered samples are accumulated against it
+                compute_medians(reference.data());
+                for (size_t i = 0; i < window; ++i) {
+                    accumulate_within_reference(samples.data() + i * pixels_count);
+                }
+            } else if (samples_count + 1 > window) {
+                accumulate_within_reference(depth);
+            }
+        }
+    }
+
+    ++samples_count;
+}
+
+void DepthAccumulator::result(uint16_t* depth) const
+{
+    if (mode == MEDIAN || (mode == ROBUST_MEAN && samples_count < window)) {
+        compute_medians(depth);
+        return;
+    }
+
+    for (size_t i = 0; i < pixels_count; ++i) {
+        depth[i] = counts[i] == 0 ? 0 : uint16_t((sums[i] + counts[i] / 2) / counts[i]);
+    }
+}
+
+size_t DepthAccumulator::samplesCount() const
+{
+    return samples_count;
+}
+
+DepthAccumulator::Mode DepthAccumulator::modeFromString(const std::string& mode)
+{
+    if (mode == "MEDIAN") {
+        return MEDIAN;
+    }
+    if (mode == "ROBUST_MEAN") {
+        return ROBUST_MEAN;
+    }
+
+    return MEAN;
+}
+
+//----------------------------------------------------
+
+void DepthAccumulator::accumulate(const uint16_t* depth)
+{
+    uint32_t* sums_data = sums.data();
+    uint32_t* counts_data = counts.data();
+    for (size_t i = 0; i < pixels_count; ++i) {
+        sums_data[i] += depth[i];
+        counts_data[i] += depth[i] != 0;
+    }
+}
+
+void DepthAccumulator::accumulate_within_reference(const uint16_t* depth)
+{
+    uint32_t* sums_data = sums.data();
+    uint32_t* counts_data = counts.data();
+    const uint16_t* reference_data = reference.data();
+    for (size_t i = 0; i < pixels_count; ++i) {
+        const float tolerance = rejection_ratio * reference_data[i];
+        const float difference = std::abs(float(depth[i]) - float(reference_data[i]));
+        const uint32_t inside = depth[i] != 0 && reference_data[i] != 0 && difference <= tolerance;
+        sums_data[i] += inside * depth[i];
+        counts_data[i] += inside;
+    }
+}
+
+void DepthAccumulator::compute_medians(uint16_t* depth) const
+{
+    const size_t buffered = std::min(samples_count, window);
+    const size_t rows_count = std::max<size_t>(1, ThreadPool::instance().size() * 4);
+    const size_t row_size = (pixels_count + rows_count - 1) / rows_count;
+
+    ThreadPool::instance().parallel_for(0, rows_count, [&](size_t row) {
+        std::vector<uint16_t> values;
+        values.reserve(buffered);
+        const size_t end = std::min(pixels_count, (row + 1) * row_size);
+        for (size_t i = row * row_size; i < end; ++i) {
+            values.clear();
+            for (size_t j = 0; j < buffered; ++j) {
+                const uint16_t value = samples[j * pixels_count + i];
+                if (value != 0) {
+                    values.push_back(value);
+                }
+            }
+            if (values.empty()) {
+                depth[i] = 0;
+                continue;
+            }
+
+            std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+            depth[i] = values[values.size() / 2];
+        }
+    });
+}
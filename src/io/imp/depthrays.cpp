@@ -0,0 +1,79 @@
+#include "io/depthrays.h"
+
+#include <emmintrin.h>
+
+#include <cmath>
+#include <mutex>
+
+DepthRays::DepthRays(const int& width_, const int& height_, const float& horizontal_fov_, const float& vertical_fov_)
+    : width(width_)
+    , height(height_)
+    , horizontal_fov(horizontal_fov_)
+    , vertical_fov(vertical_fov_)
+    , column_rays(size_t(width_))
+    , row_rays(size_t(height_))
+{
+    //Same normalization and factors as OpenNI
+    const float xz_factor = std::tan(horizontal_fov / 2.0f) * 2.0f;
+    const float yz_factor = std::tan(vertical_fov / 2.0f) * 2.0f;
+    for (int u = 0; u < width; ++u) {
+        column_rays[u] = (float(u) / float(width) - 0.5f) * xz_factor;
+    }
+    for (int v = 0; v < height; ++v) {
+        row_rays[v] = (0.5f - float(v) / float(height)) * yz_factor;
+    }
+}
+
+DepthRays::ConstPtr DepthRays::forMode(const int& width, const int& height, const float& horizontal_fov, const float& vertical_fov)
+{
+    static std::mutex mutex;
+    static ConstPtr last;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!last || last->width != width || last->height != height
+        || last->horizontal_fov != horizontal_fov || last->vertical_fov != vertical_fov) {
+        last = std::make_shared<DepthRays>(width, height, horizontal_fov, vertical_fov);
+    }
+
+    return last;
+}
+
+void DepthRays::apply(const uint16_t* depth, float* world) const
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    for (int v = 0; v < height; ++v) {
+        const uint16_t* depth_row = depth + size_t(v) * width;
+        float* world_row = world + size_t(v) * width * 3;
+        const float row_ray = row_rays[v];
+        const __m128 row_ray4 = _mm_set1_ps(row_ray);
+
+        int u = 0;
+        for (; u + 4 <= width; u += 4) {
+            const __m128i depth4 = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth_row + u)), zero);
+            const __m128 z = _mm_cvtepi32_ps(depth4);
+            const __m128 x = _mm_mul_ps(z, _mm_loadu_ps(&column_rays[u]));
+            const __m128 y = _mm_mul_ps(z, row_ray4);
+
+            //x y z triples of the 4 pixels across 3 registers
+            const __m128 xy_low = _mm_unpacklo_ps(x, y);
+            const __m128 xy_high = _mm_unpackhi_ps(x, y);
+            const __m128 t0 = _mm_shuffle_ps(z, xy_low, _MM_SHUFFLE(2, 2, 0, 0));
+            const __m128 t1 = _mm_shuffle_ps(xy_low, z, _MM_SHUFFLE(1, 1, 3, 3));
+            const __m128 t2 = _mm_shuffle_ps(z, xy_high, _MM_SHUFFLE(2, 2, 2, 2));
+            const __m128 t3 = _mm_shuffle_ps(xy_high, z, _MM_SHUFFLE(3, 3, 3, 3));
+
+            float* out = world_row + size_t(u) * 3;
+            _mm_storeu_ps(out, _mm_shuffle_ps(xy_low, t0, _MM_SHUFFLE(2, 0, 1, 0)));
+            _mm_storeu_ps(out + 4, _mm_shuffle_ps(t1, xy_high, _MM_SHUFFLE(1, 0, 2, 0)));
+            _mm_storeu_ps(out + 8, _mm_shuffle_ps(t2, t3, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+
+        for (; u < width; ++u) {
+            const float z = float(depth_row[u]);
+            world_row[u * 3] = z * column_rays[u];
+            world_row[u * 3 + 1] = z * row_ray;
+            world_row[u * 3 + 2] = z;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include "io/featuresidecar.h"
+
+#include <QFile>
+#include <QSaveFile>
+
+#include <cstring>
+
+namespace {
+
+const char FEATURE_SIDECAR_MAGIC[4] = { 'R', 'S', 'F', 'T' };
+const uint32_t FEATURE_SIDECAR_VERSION = 1;
+
+} // namespace
+
+bool feature_sidecar::save(
+    const QString& filename,
+    const uint64_t& parameters_hash,
+    const std::vector<cv::KeyPoint>& keypoints,
+    const cv::Mat& descriptors)
+{
+    if (!descriptors.empty() && descriptors.rows != int(keypoints.size())) {
+        throw std::invalid_argument("feature_sidecar::save descriptors.rows != keypoints.size()");
+    }
+
+    const cv::Mat continuous_descriptors = descriptors.isContinuous() ? descriptors : descriptors.clone();
+
+    Header header;
+    std::memcpy(header.magic, FEATURE_SIDECAR_MAGIC, sizeof(header.magic));
+    header.version = FEATURE_SIDECAR_VERSION;
+    header.parameters_hash = parameters_hash;
+    header.keypoints_count = uint32_t(keypoints.size());
+    header.descriptor_rows = uint32_t(continuous_descriptors.rows);
+    header.descriptor_cols = uint32_t(continuous_descriptors.cols);
+    header.descriptor_type = uint32_t(continuous_descriptors.type());
+
+    std::vector<PackedKeypoint> packed(keypoints.size());
+    for (size_t i = 0; i < keypoints.size(); ++i) {
+        packed[i].x = keypoints[i].pt.x;
+        packed[i].y = keypoints[i].pt.y;
+        packed[i].size = keypoints[i].size;
+        packed[i].angle = keypoints[i].angle;
+        packed[i].response = keypoints[i].response;
+        packed[i].octave = keypoints[i].octave;
+        packed[i].class_id = keypoints[i].class_id;
+    }
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    const qint64 keypoints_size = qint64(packed.size() * sizeof(PackedKeypoint));
+    const qint64 descriptors_size = qint64(continuous_descriptors.total() * continuous_descriptors.elemSize());
+
+    const bool written = file.write(reinterpret_cast<const char*>(&header), sizeof(Header)) == qint64(sizeof(Header))
+        && file.write(reinterpret_cast<const char*>(packed.data()), keypoints_size) == keypoints_size
+        && file.write(reinterpret_cast<const char*>(continuous_descriptors.data), descriptors_size) == descriptors_size;
+
+    return written && file.commit();
+}
+
+bool feature_sidecar::load(
+    const QString& filename,
+    const uint64_t& parameters_hash,
+    std::vector<cv::KeyPoint>& keypoints,
+    cv::Mat& descriptors)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    Header header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(Header)) != qint64(sizeof(Header))
+        || std::memcmp(header.magic, FEATURE_SIDECAR_MAGIC, sizeof(header.magic)) != 0
+        || header.version != FEATURE_SIDECAR_VERSION
+        || header.parameters_hash != parameters_hash
+        || (header.descriptor_rows != 0 && header.descriptor_rows != header.keypoints_count)) {
+        return false;
+    }
+
+    std::vector<PackedKeypoint> packed(header.keypoints_count);
+    const qint64 keypoints_size = qint64(packed.size() * sizeof(PackedKeypoint));
+    if (file.read(reinterpret_cast<char*>(packed.data()), keypoints_size) != keypoints_size) {
+        return false;
+    }
+
+    cv::Mat loaded_descriptors;
+    if (header.descriptor_rows != 0) {
+        loaded_descriptors.create(int(header.descriptor_rows), int(header.descriptor_cols), int(header.descriptor_type));
+        const qint64 descriptors_size = qint64(loaded_descriptors.total() * loaded_descriptors.elemSize());
+        if (file.read(reinterpret_cast<char*>(loaded_descriptors.data), descriptors_size) != descriptors_size) {
+            return false;
+        }
+    }
+
+    keypoints.resize(packed.size());
+    for (size_t i = 0; i < packed.size(); ++i) {
+        keypoints[i] = cv::KeyPoint(
+            packed[i].x, packed[i].y, packed[i].size, packed[i].angle,
+            packed[i].response, packed[i].octave, packed[i].class_id);
+    }
+    descriptors = loaded_descriptors;
+
+    return true;
+}
@@ -0,0 +1,196 @@
+#include "io/framecache.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <algorithm>
+
+#include "core/base/scannerconfig.h"
+#include "utility/memoryaccounting.h"
+
+FrameCache::FrameCache()
+    : enabled(false)
+    , memory_budget(0)
+    , compact(false)
+    , compact_tolerance(0)
+    , settings_generation(0)
+    , memory_usage(0)
+{
+    refresh_settings();
+}
+
+FrameCache& FrameCache::instance()
+{
+    static FrameCache cache;
+    return cache;
+}
+
+Frame FrameCache::get(const QString& project, const uint& frame_index, const Loader& loader)
+{
+    const Key key(project, frame_index);
+    Frame result;
+    CompactFrame::ConstPtr compact_result;
+    bool found = false;
+    bool use_cache;
+    bool use_compact;
+    float tolerance;
+    size_t budget;
+    uint64_t generation;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        refresh_settings();
+        use_cache = enabled && memory_budget > 0;
+        use_compact = compact;
+        tolerance = compact_tolerance;
+        budget = memory_budget;
+        generation = settings_generation;
+
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second.lru_it);
+            result = it->second.frame;
+            compact_result = it->second.compact;
+            found = true;
+        }
+    }
+
+    //Expanded outside the lock, every hit gets clouds of its own
+    if (compact_result) {
+        result = compact_result->expand();
+        result.track();
+        return result;
+    }
+    if (found) {
+        return result;
+    }
+
+    Frame frame = loader(frame_index);
+    if (!use_cache) {
+        return frame;
+    }
+
+    CompactFrame::ConstPtr packed;
+    if (use_compact && !frame.pointCloudPtr->empty()) {
+        std::shared_ptr<CompactFrame> compact_frame = std::make_shared<CompactFrame>();
+        if (compact_frame->pack(frame, tolerance)) {
+            packed = memory_accounting::track(CompactFrame::ConstPtr(compact_frame), memory_accounting::FRAMES,
+                compact_frame->size());
+        }
+    }
+
+    const size_t size = packed ? packed->size() : frame_size(frame);
+    if (frame.pointCloudPtr->empty() || size > budget) {
+        return frame;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    //Not kept when a reload in between changed the settings the frame was packed with
+    if (settings_generation == generation && entries.find(key) == entries.end()) {
+        lru.push_front(key);
+        Entry& entry = entries[key];
+        if (packed) {
+            entry.compact = packed;
+        } else {
+            entry.frame = frame;
+        }
+        entry.size = size;
+        entry.lru_it = lru.begin();
+        memory_usage += size;
+        evict();
+    }
+
+    //Hits give the quantized frame, so does the load
+    if (packed) {
+        Frame expanded = packed->expand();
+        expanded.track();
+        return expanded;
+    }
+
+    return frame;
+}
+
+void FrameCache::invalidate(const QString& project)
+{
+    const QString folder = QDir::cleanPath(project);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (QDir::cleanPath(QFileInfo(it->first.first).path()) == folder) {
+            memory_usage -= it->second.size;
+            lru.erase(it->second.lru_it);
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    memory_accounting::set(memory_accounting::FRAME_CACHE, memory_usage);
+}
+
+void FrameCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    memory_usage = 0;
+    memory_accounting::set(memory_accounting::FRAME_CACHE, memory_usage);
+}
+
+size_t FrameCache::getMemoryUsage()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_usage;
+}
+
+size_t FrameCache::frame_size(const Frame& frame)
+{
+    size_t size = frame.pointCloudImage.total() * frame.pointCloudImage.elemSize();
+    size += frame.pointCloudIndexes.size() * sizeof(int);
+    if (frame.pointCloudPtr) {
+        size += frame.pointCloudPtr->size() * sizeof(PointType);
+    }
+    if (frame.pointCloudNormalPcdPtr) {
+        size += frame.pointCloudNormalPcdPtr->size() * sizeof(NormalType);
+    }
+
+    return size;
+}
+
+void FrameCache::refresh_settings()
+{
+    if (settings_generation == ScannerConfig::currentGeneration()) {
+        return;
+    }
+
+    const bool was_compact = compact;
+    const float previous_tolerance = compact_tolerance;
+
+    ScannerConfig configs;
+    settings_generation = configs.generation();
+    enabled = configs.value("FRAME_CACHE_SETTINGS/ENABLE").toBool();
+    memory_budget = configs.value("FRAME_CACHE_SETTINGS/MEMORY_BUDGET_MB").toULongLong() * 1024 * 1024;
+    compact = configs.value("FRAME_CACHE_SETTINGS/COMPACT").toBool();
+    compact_tolerance = configs.value("FRAME_CACHE_SETTINGS/COMPACT_TOLERANCE_MM").toFloat() * 0.001f;
+
+    if (!enabled || compact != was_compact || compact_tolerance != previous_tolerance) {
+        entries.clear();
+        lru.clear();
+        memory_usage = 0;
+    }
+    evict();
+}
+
+void FrameCache::evict()
+{
+    //Over the process memory budget the cache gives back up to the excess, the frames it drops may
+    //still be held elsewhere
+    size_t excess = memory_accounting::excess();
+    while ((memory_usage > memory_budget || excess > 0) && !lru.empty()) {
+        auto it = entries.find(lru.back());
+        memory_usage -= it->second.size;
+        excess -= std::min(excess, it->second.size);
+        entries.erase(it);
+        lru.pop_back();
+    }
+    memory_accounting::set(memory_accounting::FRAME_CACHE, memory_usage);
+}
@@ -0,0 +1,180 @@
+#include "io/framecontainer.h"
+
+#include <QFile>
+
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const char FRAME_CONTAINER_MAGIC[4] = { 'R', 'S', 'F', '1' };
+const uint32_t FRAME_CONTAINER_VERSION = 1;
+const float DEPTH_UNITS_PER_METER = 1000.0f;
+
+} // namespace
+
+bool frame_container::encode(
+    const cv::Mat& depth_mm,
+    const cv::Mat& color,
+    const CameraIntrinsics& intrinsics,
+    const int& jpeg_quality,
+    std::vector<char>& buffer)
+{
+    if (depth_mm.type() != CV_16UC1 || color.type() != CV_8UC3 || depth_mm.size() != color.size()) {
+        throw std::invalid_argument("frame_container::encode depth or color has wrong type or size");
+    }
+
+    std::vector<uchar> color_data;
+    uint32_t color_encoding = COLOR_RAW_BGR;
+    if (jpeg_quality > 0) {
+        std::vector<int> params;
+        params.push_back(CV_IMWRITE_JPEG_QUALITY);
+        params.push_back(jpeg_quality);
+        if (cv::imencode(".jpg", color, color_data, params)) {
+            color_encoding = COLOR_JPEG;
+        }
+    }
+    if (color_encoding == COLOR_RAW_BGR) {
+        const cv::Mat continuous_color = color.isContinuous() ? color : color.clone();
+        color_data.assign(continuous_color.datastart, continuous_color.dataend);
+    }
+
+    const cv::Mat continuous_depth = depth_mm.isContinuous() ? depth_mm : depth_mm.clone();
+
+    Header header;
+    std::memcpy(header.magic, FRAME_CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = FRAME_CONTAINER_VERSION;
+    header.width = depth_mm.cols;
+    header.height = depth_mm.rows;
+    header.fx = intrinsics.fx;
+    header.fy = intrinsics.fy;
+    header.cx = intrinsics.cx;
+    header.cy = intrinsics.cy;
+    header.depth_units_per_meter = DEPTH_UNITS_PER_METER;
+    header.color_encoding = color_encoding;
+    header.depth_size = uint32_t(continuous_depth.total() * continuous_depth.elemSize());
+    header.color_size = uint32_t(color_data.size());
+
+    buffer.resize(sizeof(Header) + header.depth_size + header.color_size);
+    std::memcpy(buffer.data(), &header, sizeof(Header));
+    std::memcpy(buffer.data() + sizeof(Header), continuous_depth.data, header.depth_size);
+    std::memcpy(buffer.data() + sizeof(Header) + header.depth_size, color_data.data(), header.color_size);
+
+    return true;
+}
+
+bool frame_container::decode(
+    const char* data,
+    const size_t& size,
+    pcl::PointCloud<pcl::PointXYZRGB>& cloud,
+    cv::Mat& image,
+    CameraIntrinsics* intrinsics)
+{
+    if (data == nullptr || size < sizeof(Header)) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, FRAME_CONTAINER_MAGIC, sizeof(header.magic)) != 0
+        || header.version != FRAME_CONTAINER_VERSION
+        || header.depth_size != header.width * header.height * sizeof(uint16_t)
+        || size < sizeof(Header) + header.depth_size + header.color_size) {
+        return false;
+    }
+
+    const char* color_data = data + sizeof(Header) + header.depth_size;
+    if (header.color_encoding == COLOR_JPEG) {
+        const cv::Mat encoded(1, int(header.color_size), CV_8UC1, const_cast<char*>(color_data));
+        image = cv::imdecode(encoded, CV_LOAD_IMAGE_COLOR);
+    } else if (header.color_size == header.width * header.height * 3) {
+        image = cv::Mat(header.height, header.width, CV_8UC3, const_cast<char*>(color_data)).clone();
+    } else {
+        return false;
+    }
+    if (image.empty() || image.cols != int(header.width) || image.rows != int(header.height)) {
+        return false;
+    }
+
+    CameraIntrinsics frame_intrinsics;
+    frame_intrinsics.width = header.width;
+    frame_intrinsics.height = header.height;
+    frame_intrinsics.fx = header.fx;
+    frame_intrinsics.fy = header.fy;
+    frame_intrinsics.cx = header.cx;
+    frame_intrinsics.cy = header.cy;
+    if (!frame_intrinsics.isValid()) {
+        return false;
+    }
+
+    const uint16_t* depth = reinterpret_cast<const uint16_t*>(data + sizeof(Header));
+    const float depth_scale = 1.0f / header.depth_units_per_meter;
+    const float inv_fx = 1.0f / frame_intrinsics.fx;
+    const float inv_fy = 1.0f / frame_intrinsics.fy;
+
+    cloud.width = header.width;
+    cloud.height = header.height;
+    cloud.is_dense = false;
+    cloud.resize(size_t(header.width) * header.height);
+
+    for (uint32_t v = 0; v < header.height; ++v) {
+        const cv::Vec3b* color_row = image.ptr<cv::Vec3b>(v);
+        for (uint32_t u = 0; u < header.width; ++u) {
+            const size_t index = size_t(v) * header.width + u;
+            pcl::PointXYZRGB& point = cloud.points[index];
+
+            if (depth[index] == 0) {
+                point.x = point.y = point.z = std::numeric_limits<float>::quiet_NaN();
+            } else {
+                const float z = float(depth[index]) * depth_scale;
+                point.x = (float(u) - frame_intrinsics.cx) * z * inv_fx;
+                point.y = (float(v) - frame_intrinsics.cy) * z * inv_fy;
+                point.z = z;
+            }
+
+            point.r = color_row[u][2];
+            point.g = color_row[u][1];
+            point.b = color_row[u][0];
+        }
+    }
+
+    if (intrinsics != nullptr) {
+        *intrinsics = frame_intrinsics;
+    }
+
+    return true;
+}
+
+bool frame_container::save(
+    const QString& filename,
+    const cv::Mat& depth_mm,
+    const cv::Mat& color,
+    const CameraIntrinsics& intrinsics,
+    const int& jpeg_quality)
+{
+    std::vector<char> buffer;
+    if (!encode(depth_mm, color, intrinsics, jpeg_quality, buffer)) {
+        return false;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    return file.write(buffer.data(), buffer.size()) == qint64(buffer.size());
+}
+
+bool frame_container::load(
+    const QString& filename,
+    pcl::PointCloud<pcl::PointXYZRGB>& cloud,
+    cv::Mat& image)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    return decode(data.constData(), size_t(data.size()), cloud, image);
+}
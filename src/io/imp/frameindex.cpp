@@ -0,0 +1,169 @@
+#include "io/frameindex.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include <algorithm>
+#include <iterator>
+
+#include "utility/log.h"
+
+std::mutex FrameIndex::mutex;
+std::map<QString, FrameIndex::ConstPtr> FrameIndex::indexes_map;
+
+FrameIndex::FrameIndex(const QString& data_folder_)
+    : data_folder(QDir::cleanPath(data_folder_))
+    , folder_timestamp(timestamp(data_folder_))
+{
+    if (!load_index_file()) {
+        scan_data_folder();
+        save_index_file();
+    }
+}
+
+FrameIndex::ConstPtr FrameIndex::get(const QString& data_folder)
+{
+    const QString key = QDir::cleanPath(data_folder);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = indexes_map.find(key);
+    if (it != indexes_map.end() && it->second->folder_timestamp == timestamp(key)) {
+        return it->second;
+    }
+
+    ConstPtr index(new FrameIndex(key));
+    indexes_map[key] = index;
+
+    return index;
+}
+
+void FrameIndex::invalidate(const QString& data_folder)
+{
+    const QString key = QDir::cleanPath(data_folder);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    indexes_map.erase(key);
+    QFile::remove(key + ".index");
+}
+
+const std::vector<uint>& FrameIndex::getIndexes() const
+{
+    return indexes;
+}
+
+const QString& FrameIndex::getDataFolder() const
+{
+    return data_folder;
+}
+
+QString FrameIndex::index_filename() const
+{
+    return data_folder + ".index";
+}
+
+bool FrameIndex::load_index_file()
+{
+    QFile file(index_filename());
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    QTextStream stream(&file);
+    qint64 stored_timestamp = 0;
+    qulonglong size = 0;
+    stream >> stored_timestamp >> size;
+    if (stream.status() != QTextStream::Ok || stored_timestamp != folder_timestamp) {
+        return false;
+    }
+
+    std::vector<uint> stored_indexes(size);
+    for (auto& index : stored_indexes) {
+        stream >> index;
+    }
+    if (stream.status() != QTextStream::Ok || !std::is_sorted(stored_indexes.begin(), stored_indexes.end())) {
+        return false;
+    }
+
+    indexes.swap(stored_indexes);
+    return true;
+}
+
+void FrameIndex::save_index_file() const
+{
+    QFile file(index_filename());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        LOG_WARNING("io") << "FrameIndex: can't write" << index_filename();
+        return;
+    }
+
+    QTextStream stream(&file);
+    stream << folder_timestamp << " " << qulonglong(indexes.size()) << "\n";
+    for (const auto& index : indexes) {
+        stream << index << "\n";
+    }
+}
+
+void FrameIndex::scan_data_folder()
+{
+    const QStringList filenames = QDir(data_folder).entryList(
+        QStringList() << "*.pcd" << "*.bmp" << "*.rsf", QDir::Files, QDir::NoSort);
+
+    std::vector<uint> pcd_indexes, img_indexes, container_indexes;
+    pcd_indexes.reserve(filenames.size());
+    img_indexes.reserve(filenames.size());
+
+    for (const auto& filename : filenames) {
+        uint index = 0;
+        if (parse_index(filename, index)) {
+            if (filename.endsWith(".pcd")) {
+                pcd_indexes.push_back(index);
+            } else if (filename.endsWith(".bmp")) {
+                img_indexes.push_back(index);
+            } else {
+                container_indexes.push_back(index);
+            }
+        }
+    }
+
+    std::sort(pcd_indexes.begin(), pcd_indexes.end());
+    std::sort(img_indexes.begin(), img_indexes.end());
+    std::sort(container_indexes.begin(), container_indexes.end());
+
+    std::vector<uint> pair_indexes;
+    std::set_intersection(pcd_indexes.begin(), pcd_indexes.end(),
+        img_indexes.begin(), img_indexes.end(), std::back_inserter(pair_indexes));
+
+    indexes.clear();
+    std::set_union(pair_indexes.begin(), pair_indexes.end(),
+        container_indexes.begin(), container_indexes.end(), std::back_inserter(indexes));
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+    LOG_INFO("io") << "FrameIndex: found" << indexes.size() << "frames in" << data_folder;
+}
+
+qint64 FrameIndex::timestamp(const QString& data_folder)
+{
+    return QFileInfo(data_folder).lastModified().toMSecsSinceEpoch();
+}
+
+bool FrameIndex::parse_index(const QString& filename, uint& index)
+{
+    const int stem_size = filename.lastIndexOf('.');
+    int i = 0;
+    while (i < stem_size && !filename[i].isDigit()) {
+        ++i;
+    }
+    if (i == stem_size) {
+        return false;
+    }
+
+    index = 0;
+    for (; i < stem_size && filename[i].isDigit(); ++i) {
+        index = index * 10 + uint(filename[i].digitValue());
+    }
+
+    return true;
+}
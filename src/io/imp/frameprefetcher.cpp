@@ -0,0 +1,104 @@
+#include "io/frameprefetcher.h"
+
+#include <algorithm>
+
+#include "utility/threadpool.h"
+
+FramePrefetcher::FramePrefetcher(const Loader& loader_, const std::vector<uint>& range_, uint depth_)
+    : loader(loader_)
+    , range(range_)
+    , depth(depth_)
+    , next_reader(0)
+{
+    if (!loader) {
+        throw std::invalid_argument("FramePrefetcher !loader");
+    }
+}
+
+FramePrefetcher::Reader FramePrefetcher::addReader(const std::shared_ptr<FramePrefetcher>& prefetcher)
+{
+    uint id;
+    {
+        std::lock_guard<std::mutex> lock(prefetcher->mutex);
+        id = prefetcher->next_reader++;
+    }
+
+    const std::weak_ptr<FramePrefetcher> owner = prefetcher;
+    return Reader(new uint(id), [owner](const uint* reader) {
+        if (const std::shared_ptr<FramePrefetcher> locked = owner.lock()) {
+            locked->release_reader(*reader);
+        }
+        delete reader;
+    });
+}
+
+Frame FramePrefetcher::get(const Reader& reader, uint position, uint end)
+{
+    if (!reader) {
+        throw std::invalid_argument("FramePrefetcher::get !reader");
+    }
+    if (position >= range.size() || position >= end) {
+        throw std::out_of_range("FramePrefetcher::get position >= range.size() || position >= end");
+    }
+
+    const uint id = *reader;
+    end = std::min<uint>(end, uint(range.size()));
+    std::shared_future<Frame> frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        //Only this reader's frames outside its new window
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->second.reader == id && (it->first < position || it->first > position + depth)) {
+                it = queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto it = queue.find(position);
+        if (it != queue.end()) {
+            frame = it->second.frame;
+            queue.erase(it);
+        }
+
+        for (uint i = position + 1; i <= position + depth && i < end; ++i) {
+            schedule(i, id);
+        }
+    }
+
+    if (!frame.valid()) {
+        return loader(range[position]);
+    }
+
+    ThreadPool::instance().wait(frame);
+    return frame.get();
+}
+
+void FramePrefetcher::schedule(uint position, uint reader)
+{
+    if (queue.find(position) != queue.end()) {
+        return;
+    }
+
+    const Loader load = loader;
+    const uint frame_index = range[position];
+    Entry entry;
+    entry.frame = ThreadPool::instance().submit([load, frame_index]() {
+        return load(frame_index);
+    }).share();
+    entry.reader = reader;
+    queue[position] = entry;
+}
+
+void FramePrefetcher::release_reader(uint reader)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = queue.begin(); it != queue.end();) {
+        if (it->second.reader == reader) {
+            it = queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#include "io/framewriter.h"
+
+#include <exception>
+
+#include "utility/log.h"
+
+FrameWriter::FrameWriter(size_t max_queue_size_, size_t threads_count)
+    : max_queue_size(max_queue_size_ == 0 ? 1 : max_queue_size_)
+    , active_jobs(0)
+    , stopping(false)
+    , dropped_count(0)
+    , written_count(0)
+{
+    if (threads_count == 0) {
+        threads_count = 1;
+    }
+
+    for (size_t i = 0; i < threads_count; ++i) {
+        writers.emplace_back(&FrameWriter::work, this);
+    }
+}
+
+FrameWriter::~FrameWriter()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+
+    for (auto& writer : writers) {
+        writer.join();
+    }
+}
+
+bool FrameWriter::enqueue(const Job& job, const bool& drop_when_full)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (jobs.size() >= max_queue_size) {
+        if (drop_when_full) {
+            ++dropped_count;
+            return false;
+        }
+        space_available.wait(lock, [this]() { return jobs.size() < max_queue_size; });
+    }
+
+    jobs.push_back(job);
+    lock.unlock();
+    job_available.notify_one();
+
+    return true;
+}
+
+void FrameWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this]() { return jobs.empty() && active_jobs == 0; });
+}
+
+size_t FrameWriter::getQueueSize()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size();
+}
+
+size_t FrameWriter::getDroppedCount() const
+{
+    return dropped_count;
+}
+
+size_t FrameWriter::getWrittenCount() const
+{
+    return written_count;
+}
+
+void FrameWriter::work()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++active_jobs;
+        }
+        space_available.notify_one();
+
+        try {
+            job();
+            ++written_count;
+        } catch (const std::exception& e) {
+            LOG_WARNING("io") << "FrameWriter: job failed:" << e.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --active_jobs;
+        }
+        all_done.notify_all();
+    }
+}
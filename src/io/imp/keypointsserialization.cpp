@@ -0,0 +1,98 @@
+#include "io/keypointsserialization.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+template <typename T>
+void append_array(QByteArray& buffer, const std::vector<T>& values)
+{
+    const uint32_t count = uint32_t(values.size());
+    buffer.append(reinterpret_cast<const char*>(&count), int(sizeof(count)));
+    buffer.append(reinterpret_cast<const char*>(values.data()), int(values.size() * sizeof(T)));
+}
+
+template <typename T>
+bool read_array(const QByteArray& buffer, size_t& offset, std::vector<T>& values)
+{
+    uint32_t count = 0;
+    if (size_t(buffer.size()) - offset < sizeof(count)) {
+        return false;
+    }
+    std::memcpy(&count, buffer.constData() + offset, sizeof(count));
+    offset += sizeof(count);
+
+    if (size_t(buffer.size()) - offset < size_t(count) * sizeof(T)) {
+        return false;
+    }
+    values.resize(count);
+    std::memcpy(values.data(), buffer.constData() + offset, size_t(count) * sizeof(T));
+    offset += size_t(count) * sizeof(T);
+    return true;
+}
+
+void append_cloud(QByteArray& buffer, const PcdPtr& cloud)
+{
+    std::vector<keypoints_serialization::PackedPoint> packed(cloud ? cloud->size() : 0);
+    for (size_t i = 0; i < packed.size(); ++i) {
+        const PointType& point = cloud->points[i];
+        packed[i].x = point.x;
+        packed[i].y = point.y;
+        packed[i].z = point.z;
+        packed[i].rgba = point.rgba;
+    }
+    append_array(buffer, packed);
+}
+
+bool read_cloud(const QByteArray& buffer, size_t& offset, PcdPtr& cloud)
+{
+    std::vector<keypoints_serialization::PackedPoint> packed;
+    if (!read_array(buffer, offset, packed)) {
+        return false;
+    }
+
+    cloud = std::make_shared<Pcd>();
+    cloud->resize(packed.size());
+    for (size_t i = 0; i < packed.size(); ++i) {
+        PointType& point = cloud->points[i];
+        point.x = packed[i].x;
+        point.y = packed[i].y;
+        point.z = packed[i].z;
+        point.rgba = packed[i].rgba;
+    }
+    return true;
+}
+
+} // namespace
+
+void keypoints_serialization::append(QByteArray& buffer, const KeypointsFrame& keypoints)
+{
+    append_cloud(buffer, keypoints.keypointsPcdPair.first);
+    append_cloud(buffer, keypoints.keypointsPcdPair.second);
+
+    std::vector<PackedCorrespondence> correspondences(keypoints.keypointsPcdCorrespondences.size());
+    for (size_t i = 0; i < correspondences.size(); ++i) {
+        correspondences[i].index_query = keypoints.keypointsPcdCorrespondences[i].index_query;
+        correspondences[i].index_match = keypoints.keypointsPcdCorrespondences[i].index_match;
+        correspondences[i].distance = keypoints.keypointsPcdCorrespondences[i].distance;
+    }
+    append_array(buffer, correspondences);
+}
+
+bool keypoints_serialization::read(const QByteArray& buffer, size_t& offset, KeypointsFrame& keypoints)
+{
+    std::vector<PackedCorrespondence> correspondences;
+    if (!read_cloud(buffer, offset, keypoints.keypointsPcdPair.first)
+        || !read_cloud(buffer, offset, keypoints.keypointsPcdPair.second)
+        || !read_array(buffer, offset, correspondences)) {
+        return false;
+    }
+
+    keypoints.keypointsPcdCorrespondences.clear();
+    for (const PackedCorrespondence& correspondence : correspondences) {
+        keypoints.keypointsPcdCorrespondences.push_back(pcl::Correspondence(
+            correspondence.index_query, correspondence.index_match, correspondence.distance));
+    }
+    return true;
+}
@@ -0,0 +1,193 @@
+#include "io/loopjobs.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QSysInfo>
+
+namespace {
+
+QString loop_name(const size_t& index)
+{
+    return QString("loop_%1").arg(qulonglong(index), 6, 10, QChar('0'));
+}
+
+QString job_filename(const QString& folder, const size_t& index)
+{
+    return folder + "/" + loop_name(index) + ".job";
+}
+
+QString result_filename(const QString& folder, const size_t& index)
+{
+    return folder + "/" + loop_name(index) + ".result";
+}
+
+QString failed_filename(const QString& folder, const size_t& index)
+{
+    return folder + "/" + loop_name(index) + ".failed";
+}
+
+/** \brief loop_000012.job.<host>_<pid>, unique to the worker process. */
+QString claim_filename(const QString& folder, const size_t& index)
+{
+    return job_filename(folder, index) + "." + QSysInfo::machineHostName() + "_"
+        + QString::number(QCoreApplication::applicationPid());
+}
+
+/** \brief The loop index of a loop_<index>.<extension> name. */
+bool loop_index(const QString& filename, size_t& index)
+{
+    if (!filename.startsWith("loop_")) {
+        return false;
+    }
+
+    bool parsed = false;
+    index = size_t(filename.mid(5, 6).toULongLong(&parsed));
+    return parsed;
+}
+
+} // namespace
+
+QString loop_jobs::jobs_folder(const ProjectSettings& project, const ScannerConfig& configs)
+{
+    if (!configs.value("DISTRIBUTED_SETTINGS/ENABLE").toBool()) {
+        return QString();
+    }
+
+    return QDir(QFileInfo(project.fileName()).absolutePath())
+        .absoluteFilePath(configs.value("DISTRIBUTED_SETTINGS/JOBS_FOLDER").toString());
+}
+
+void loop_jobs::clear(const QString& folder)
+{
+    QDir dir(folder);
+    for (const QString& filename : dir.entryList(QStringList("loop_*"), QDir::Files)) {
+        dir.remove(filename);
+    }
+}
+
+bool loop_jobs::write_job(const QString& folder, const size_t& index, const uint64_t& parameters_hash,
+    const reconstruction_checkpoint::LoopRecord& record)
+{
+    if (!QDir().mkpath(folder)) {
+        return false;
+    }
+
+    reconstruction_checkpoint::Checkpoint job;
+    job.parameters_hash = parameters_hash;
+    job.loops.push_back(record);
+    return reconstruction_checkpoint::save(job_filename(folder, index), job);
+}
+
+bool loop_jobs::claim_job(const QString& folder, const uint64_t& parameters_hash, size_t& index,
+    reconstruction_checkpoint::LoopRecord& record)
+{
+    //Sorted by name, so the lowest index is tried first
+    const QStringList jobs = QDir(folder).entryList(QStringList("loop_*.job"), QDir::Files, QDir::Name);
+    for (const QString& job : jobs) {
+        size_t job_index = 0;
+        if (!loop_index(job, job_index)) {
+            continue;
+        }
+
+        reconstruction_checkpoint::Checkpoint claimed;
+        if (!reconstruction_checkpoint::load(folder + "/" + job, parameters_hash, claimed)
+            || claimed.loops.size() != 1) {
+            continue;
+        }
+
+        //Another worker may have renamed it first
+        const QString claim = claim_filename(folder, job_index);
+        if (!QFile::rename(folder + "/" + job, claim)) {
+            continue;
+        }
+
+        //The claim's age is what requeue_stale_claims looks at
+        QFile claim_file(claim);
+        if (claim_file.open(QIODevice::ReadWrite)) {
+            claim_file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        }
+
+        index = job_index;
+        record = claimed.loops.front();
+        return true;
+    }
+
+    return false;
+}
+
+void loop_jobs::fail_job(const QString& folder, const size_t& index)
+{
+    //Not requeued, the next worker would fail on it as well
+    QFile::remove(failed_filename(folder, index));
+    if (!QFile::rename(claim_filename(folder, index), failed_filename(folder, index))) {
+        QFile failed(failed_filename(folder, index));
+        failed.open(QIODevice::WriteOnly);
+    }
+}
+
+bool loop_jobs::take_failed_job(const QString& folder, const size_t& index)
+{
+    return QFile::remove(failed_filename(folder, index));
+}
+
+bool loop_jobs::write_result(const QString& folder, const size_t& index, const uint64_t& parameters_hash,
+    const reconstruction_checkpoint::LoopRecord& record)
+{
+    reconstruction_checkpoint::Checkpoint result;
+    result.parameters_hash = parameters_hash;
+    result.loops.push_back(record);
+    if (!reconstruction_checkpoint::save(result_filename(folder, index), result)) {
+        return false;
+    }
+
+    QFile::remove(claim_filename(folder, index));
+    return true;
+}
+
+bool loop_jobs::load_result(const QString& folder, const size_t& index, const uint64_t& parameters_hash,
+    reconstruction_checkpoint::LoopRecord& record)
+{
+    reconstruction_checkpoint::Checkpoint result;
+    if (!reconstruction_checkpoint::load(result_filename(folder, index), parameters_hash, result)
+        || result.loops.size() != 1 || !result.loops.front().completed) {
+        return false;
+    }
+
+    record = result.loops.front();
+    return true;
+}
+
+QString loop_jobs::volume_filename(const QString& folder, const size_t& index)
+{
+    return folder + "/" + loop_name(index) + ".vol";
+}
+
+size_t loop_jobs::requeue_stale_claims(const QString& folder, const int& timeout_seconds)
+{
+    if (timeout_seconds <= 0) {
+        return 0;
+    }
+
+    size_t count = 0;
+    const QDateTime now = QDateTime::currentDateTime();
+    const QFileInfoList claims = QDir(folder).entryInfoList(QStringList("loop_*.job.*"), QDir::Files);
+    for (const QFileInfo& claim : claims) {
+        size_t index = 0;
+        if (!loop_index(claim.fileName(), index) || claim.lastModified().secsTo(now) < timeout_seconds) {
+            continue;
+        }
+
+        //A result written meanwhile makes the claim obsolete
+        if (QFileInfo(result_filename(folder, index)).exists()) {
+            QFile::remove(claim.absoluteFilePath());
+        } else if (QFile::rename(claim.absoluteFilePath(), job_filename(folder, index))) {
+            ++count;
+        }
+    }
+
+    return count;
+}
@@ -1,19 +1,28 @@
 #include "io/openniinterface.h"
+#include "core/keypoints/featurestore.h"
+#include "core/registration/streamingodometry.h"
+#include "io/calibrationinterface.h"
+#include "io/framecache.h"
+#include "io/frameindex.h"
+#include "utility/log.h"
+#include "utility/threadpool.h"
 
 #include <QDir>
 #include <QtSerialPort/QSerialPortInfo>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
-#define WIDTH 640
-#define HEIGHT 480
-
 #define INIT_PAUSE_TIME 2500
 
 OpenNiInterface::OpenNiInterface(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
     , max_frames_size(configs.value("OPENNI_SETTINGS/MAX_BUFFER_SIZE").toInt())
+    , width(resolution::sensorWidth(configs))
+    , height(resolution::sensorHeight(configs))
+    , horizontal_fov(0.f)
+    , vertical_fov(0.f)
     , record_stream(settings->value("STREAM_SETTINGS/ENABLE_STREAM_RECORDING").toBool())
     , stream_from_record(settings->value("STREAM_SETTINGS/ENABLE_REPLAY_RECORD_STREAM").toBool())
     , record_to_pcd_data(settings->value("STREAM_SETTINGS/ENABLE_CONVERT_TO_PCD").toBool())
@@ -21,8 +30,14 @@ OpenNiInterface::OpenNiInterface(QObject* parent, QSettings* parent_settings)
     , stream_bilateral(settings->value("STREAM_SETTINGS/ENABLE_BILATERAL_FILTER").toBool())
     , device_inited(false)
     , serial(new QSerialPort(this))
+    , writer(new FrameWriter(max_frames_size, configs.value("OPENNI_SETTINGS/WRITER_THREADS").toUInt()))
 {
     load_calibration_data();
+
+    if (configs.value("OPENNI_SETTINGS/DEPTH_CORRECTION").toBool()) {
+        CalibrationInterface calibrationInterface(this, settings);
+        depth_correction = calibrationInterface.getUndistortionTable();
+    }
 }
 
 OpenNiInterface::~OpenNiInterface()
@@ -30,6 +45,23 @@ OpenNiInterface::~OpenNiInterface()
     shutdown_interface();
 }
 
+void OpenNiInterface::select_video_mode(openni::VideoStream& stream) const
+{
+    const openni::VideoMode current = stream.getVideoMode();
+    const openni::Array<openni::VideoMode>& modes = stream.getSensorInfo().getSupportedVideoModes();
+    for (int i = 0; i < modes.getSize(); ++i) {
+        if (modes[i].getResolutionX() == width && modes[i].getResolutionY() == height
+            && modes[i].getPixelFormat() == current.getPixelFormat()) {
+            if (stream.setVideoMode(modes[i]) != openni::STATUS_OK) {
+                LOG_WARNING("capture") << QString("Couldn't set the %1x%2 video mode").arg(width).arg(height);
+            }
+            return;
+        }
+    }
+
+    LOG_INFO("capture") << QString("No %1x%2 video mode, the default one is used").arg(width).arg(height);
+}
+
 void OpenNiInterface::clearDataFolder()
 {
     const QString pcd_data_folder = QFileInfo(settings->fileName()).absolutePath()
@@ -45,6 +77,10 @@ void OpenNiInterface::clearDataFolder()
     foreach (QString dirFile, dir.entryList()) {
         dir.remove(dirFile);
     }
+
+    FrameIndex::invalidate(pcd_data_folder);
+    FrameCache::instance().invalidate(pcd_data_folder);
+    FeatureStore::instance().invalidate(pcd_data_folder);
 }
 
 void OpenNiInterface::load_calibration_data()
@@ -66,23 +102,49 @@ void OpenNiInterface::load_calibration_data()
     } 
     else 
     {
-        qDebug() << QString("Cannot load calibration data! \nCalib mat: %1 \nDist coeffs: %2")
-                        .arg(calib_mat_path.c_str())
-                        .arg(dist_coeffs_path.c_str())
-                        .toStdString()
-                        .c_str();
+        LOG_WARNING("capture") << QString("Cannot load calibration data! \nCalib mat: %1 \nDist coeffs: %2")
+                                      .arg(calib_mat_path.c_str())
+                                      .arg(dist_coeffs_path.c_str())
+                                      .toStdString()
+                                      .c_str();
     }
 }
 
 void OpenNiInterface::initialize_interface()
 {
     if (!device_inited) {
-        qDebug() << "Initialization...";
+        LOG_INFO("capture") << "Initialization...";
         QString openni_out_text = configs.value("OPENNI_SETTINGS/OUT_TEXT").toString();
 
         openni::Status stat = openni::OpenNI::initialize();
         if (stat != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Driver initializatioin failed");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Driver initializatioin failed");
+            return;
+        }
+
+        const QString rawSessionPath = QFileInfo(settings->fileName()).absolutePath() + "/"
+            + settings->value("PROJECT_SETTINGS/STREAM_DATA_FOLDER").toString() + "/"
+            + configs.value("OPENNI_SETTINGS/RAW_SESSION_FILE_NAME").toString();
+
+        //A raw session is replayed without the device or the OpenNI playback
+        if (stream_from_record && QFileInfo(rawSessionPath).exists()) {
+            raw_replay.reset(new RawSessionReader(rawSessionPath));
+            if (!raw_replay->isOpen()) {
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't open recording!");
+                LOG_INFO("capture") << "Path:" << rawSessionPath;
+                raw_replay.reset();
+                return;
+            }
+
+            const raw_session::Header& mode = raw_replay->getMode();
+            width = int(mode.width);
+            height = int(mode.height);
+            horizontal_fov = mode.horizontal_fov;
+            vertical_fov = mode.vertical_fov;
+            create_frame_buffers();
+
+            device_inited = true;
+            LOG_INFO("capture") << QString("%1 %2 %3x%4").arg(openni_out_text).arg("Replaying raw session").arg(width).arg(height);
             return;
         }
 
@@ -92,8 +154,8 @@ void OpenNiInterface::initialize_interface()
                 + configs.value("OPENNI_SETTINGS/RECORDED_STREAM_FILE_NAME").toString();
 
             if (!boost::filesystem::exists(filePath.toStdString()) || (device.open(filePath.toStdString().c_str()) != openni::STATUS_OK)) {
-                qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't open recording!");
-                qDebug() << "Path:" << filePath;
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't open recording!");
+                LOG_INFO("capture") << "Path:" << filePath;
                 return;
             } else {
                 openni::PlaybackControl* pbc = device.getPlaybackControl();
@@ -101,70 +163,139 @@ void OpenNiInterface::initialize_interface()
                 pbc->setSpeed(-1);
             }
         } else if (device.open(openni::ANY_DEVICE) != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't open device!");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't open device!");
             return;
         }
 
         device_inited = true;
-        qDebug() << QString("%1 %2").arg(openni_out_text).arg("Initialized successfully!");
+        LOG_INFO("capture") << QString("%1 %2").arg(openni_out_text).arg("Initialized successfully!");
 
         if (device.setDepthColorSyncEnabled(true) != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't sync color and depth frames");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't sync color and depth frames");
         }
 
         if (depthStream.create(device, openni::SENSOR_DEPTH) != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't create a depth stream");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't create a depth stream");
         }
         if (colorStream.create(device, openni::SENSOR_COLOR) != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't create a color stream");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't create a color stream");
+        }
+
+        //A recording replays the mode it was recorded in
+        if (!stream_from_record) {
+            select_video_mode(depthStream);
+            select_video_mode(colorStream);
         }
 
         if (depthStream.start() != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't start a depth stream");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't start a depth stream");
         }
         if (colorStream.start() != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't start a color stream");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't start a color stream");
+        }
+
+        const openni::VideoMode mode = depthStream.getVideoMode();
+        if (mode.getResolutionX() > 0 && mode.getResolutionY() > 0) {
+            width = mode.getResolutionX();
+            height = mode.getResolutionY();
+        }
+        horizontal_fov = depthStream.getHorizontalFieldOfView();
+        vertical_fov = depthStream.getVerticalFieldOfView();
+        LOG_INFO("capture") << QString("%1 %2x%3").arg(openni_out_text).arg(width).arg(height);
+
+        if (record_stream && !stream_from_record && configs.value("OPENNI_SETTINGS/RAW_SESSION_RECORDING").toBool()) {
+            raw_session::Header header;
+            header.width = uint32_t(width);
+            header.height = uint32_t(height);
+            header.horizontal_fov = horizontal_fov;
+            header.vertical_fov = vertical_fov;
+            header.fps = uint32_t(std::max(0, mode.getFps()));
+            raw_recorder.reset(new RawSessionWriter(rawSessionPath, header,
+                configs.value("OPENNI_SETTINGS/RAW_SESSION_JPEG_QUALITY").toInt(),
+                configs.value("OPENNI_SETTINGS/RAW_SESSION_COMPRESSION_LEVEL").toInt(),
+                configs.value("OPENNI_SETTINGS/RAW_SESSION_QUEUE_SIZE").toUInt()));
+            if (!raw_recorder->isOpen()) {
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't create recording!");
+                raw_recorder.reset();
+            }
+        }
+
+        create_frame_buffers();
+        if (configs.value("OPENNI_SETTINGS/CAPTURE_RING_ENABLE").toBool()) {
+            capture_ring.reset(new CaptureRing<CaptureSlot>(configs.value("OPENNI_SETTINGS/CAPTURE_RING_SIZE").toUInt(),
+                CaptureSlot(size_t(width) * height)));
+            capture_listener.reset(new CaptureListener(colorStream, *capture_ring, raw_recorder.get()));
         }
 
         if (device.setImageRegistrationMode(openni::IMAGE_REGISTRATION_DEPTH_TO_COLOR) != openni::STATUS_OK) {
-            qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't enable registration depth to color");
+            LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't enable registration depth to color");
         }
 
-        if (record_stream && !stream_from_record) {
+        if (record_stream && !stream_from_record && !raw_recorder) {
             const QString filePath = QFileInfo(settings->fileName()).absolutePath() + "/"
                 + settings->value("PROJECT_SETTINGS/STREAM_DATA_FOLDER").toString() + "/"
                 + configs.value("OPENNI_SETTINGS/RECORDED_STREAM_FILE_NAME").toString();
 
             if (recorder.create(filePath.toStdString().c_str()) != openni::STATUS_OK) {
-                qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't create recording!");
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't create recording!");
             }
 
             if (recorder.attach(colorStream) != openni::STATUS_OK) {
-                qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't attach color stream!");
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't attach color stream!");
             }
             if (recorder.attach(depthStream) != openni::STATUS_OK) {
-                qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't attach depth stream!");
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't attach depth stream!");
             }
 
             if (recorder.start() != openni::STATUS_OK) {
-                qDebug() << QString("%1 %2").arg(openni_out_text).arg("Couldn't start recorder!");
+                LOG_WARNING("capture") << QString("%1 %2").arg(openni_out_text).arg("Couldn't start recorder!");
             }
         }
 
-        qDebug() << "Done!";
+        LOG_INFO("capture") << "Done!";
     }
 }
 
+void OpenNiInterface::create_frame_buffers()
+{
+    //The slots are sized for the mode the streams run in
+    long_image_slot = CaptureSlot(size_t(width) * height);
+    stream_slot = CaptureSlot(size_t(width) * height);
+
+    //Frames in flight are those queued to the writer and the one on screen
+    const size_t pool_size = std::min<size_t>(max_frames_size,
+        configs.value("OPENNI_SETTINGS/FRAME_POOL_SIZE").toUInt()) + 1;
+    frame_pool.reset(new FramePool<Frame>(pool_size, [this]() {
+        Frame* pooled = new Frame(settings, &configs);
+        pooled->world_coords.reserve(size_t(width) * height);
+        return pooled;
+    }));
+}
+
 void OpenNiInterface::shutdown_interface()
 {
     if (device_inited) {
-        qDebug() << "Shutdown...";
+        LOG_INFO("capture") << "Shutdown...";
         const QString openni_out_text = configs.value("OPENNI_SETTINGS/OUT_TEXT").toString();
 
-        if (record_stream) {
+        if (capture_listener) {
+            depthStream.removeNewFrameListener(capture_listener.get());
+        }
+
+        if (raw_recorder) {
+            raw_recorder->flush();
+            LOG_INFO("capture") << "Raw session recorded" << raw_recorder->getWrittenCount() << "frames, dropped" << raw_recorder->getDroppedCount();
+            raw_recorder.reset();
+        } else if (record_stream) {
             recorder.stop();
             recorder.destroy();
         }
+        raw_replay.reset();
+
+        writer->wait();
+        if (writer->getDroppedCount() > 0) {
+            LOG_WARNING("capture") << "Frame writer dropped" << writer->getDroppedCount() << "frames";
+        }
 
         depthStream.stop();
         depthStream.destroy();
@@ -176,34 +307,76 @@ void OpenNiInterface::shutdown_interface()
         openni::OpenNI::shutdown();
 
         device_inited = false;
-        qDebug() << QString("%1 %2").arg(openni_out_text).arg("Shutdown successful!");
+        LOG_INFO("capture") << QString("%1 %2").arg(openni_out_text).arg("Shutdown successful!");
     }
 }
 
 void OpenNiInterface::start_stream()
 {
     if (record_to_pcd_data) {
-        qDebug() << "Clearing data folder...";
+        LOG_INFO("capture") << "Clearing data folder...";
         clearDataFolder();
     }
 
     uint frame_index = 0;
 
-    while (device_inited) {
-        take_one_frame(++frame_index);
+    if (configs.value("STREAMING_ODOMETRY_SETTINGS/ENABLE").toBool()) {
+        odometry.reset(new StreamingOdometry(this, settings));
     }
+
+    telemetry.reset(new CaptureTelemetry(raw_replay ? int(raw_replay->getMode().fps) : depthStream.getVideoMode().getFps()));
+    telemetry_text.clear();
+
+    if (capture_ring && !raw_replay) {
+        depthStream.addNewFrameListener(capture_listener.get());
+
+        while (device_inited) {
+            CaptureSlot* slot = capture_ring->beginRead();
+            if (slot == nullptr) {
+                show_preview();
+                cv::waitKey(1);
+                continue;
+            }
+
+            Frame::Ptr frame = frame_pool->acquire();
+            frame->read(*slot, width, height, horizontal_fov, vertical_fov);
+            capture_ring->endRead();
+
+            process_frame(frame, ++frame_index);
+            show_preview();
+        }
+
+        depthStream.removeNewFrameListener(capture_listener.get());
+        if (capture_ring->getDroppedCount() > 0) {
+            LOG_WARNING("capture") << "Capture ring dropped" << capture_ring->getDroppedCount() << "frames";
+        }
+    } else {
+        while (device_inited && take_one_frame(++frame_index)) {
+            show_preview();
+        }
+    }
+
+    if (odometry) {
+        odometry->wait();
+        LOG_INFO("capture") << "Streaming odometry tracked" << odometry->getPoses().size() << "frames, lost"
+                            << odometry->getLostCount() << "dropped" << odometry->getDroppedCount();
+    }
+
+    LOG_INFO("capture") << "Stream" << telemetry->getTotal().frames << "frames:" << telemetry->text(telemetry->getTotal());
+    telemetry.reset();
+    preview_frame.reset();
 }
 
 void OpenNiInterface::start_rotation_stream()
 {
     if (isInit()) {
         initialize_rotation();
-        qDebug() << "Rotate:" << configs.value("OPENNI_SETTINGS/ROTATION_ANGLE").toInt();
+        LOG_INFO("capture") << "Rotate:" << configs.value("OPENNI_SETTINGS/ROTATION_ANGLE").toInt();
         rotate(configs.value("OPENNI_SETTINGS/ROTATION_ANGLE").toInt());
 
         start_stream();
 
-        qDebug() << "Return:" << -configs.value("OPENNI_SETTINGS/ROTATION_ANGLE").toInt();
+        LOG_INFO("capture") << "Return:" << -configs.value("OPENNI_SETTINGS/ROTATION_ANGLE").toInt();
         rotate(-1 * configs.value("OPENNI_SETTINGS/ROTATION_ANGLE").toInt());
         shutdown_rotation();
     }
@@ -214,22 +387,37 @@ void OpenNiInterface::take_long_images()
     if (device_inited) {
         frames.clear();
         Frames().swap(frames);
+        clearDataFolder();
         initialize_rotation();
 
-        for (int i = 0; i < configs.value("LONG_IMAGE_SETTINGS/TO").toInt() && device_inited;
-             i += configs.value("LONG_IMAGE_SETTINGS/STEP").toInt()) {
-            rotate(i > 0 ? configs.value("LONG_IMAGE_SETTINGS/STEP").toInt() : 0);
-            std::this_thread::sleep_for(std::chrono::milliseconds(INIT_PAUSE_TIME));
+        const int step = configs.value("LONG_IMAGE_SETTINGS/STEP").toInt();
+        const int to = configs.value("LONG_IMAGE_SETTINGS/TO").toInt();
 
-            qDebug() << i / configs.value("LONG_IMAGE_SETTINGS/STEP").toInt()
-                     << "/" << configs.value("LONG_IMAGE_SETTINGS/TO").toInt() / configs.value("LONG_IMAGE_SETTINGS/STEP").toInt();
+        rotate(0);
+        wait_for_rotation();
 
-            frames.push_back(take_one_optimized_image(configs.value("LONG_IMAGE_SETTINGS/NUMBER").toInt()));
+        //The table only has to stand still during the exposure, the average of a step is computed
+        //and saved while it moves to the next one
+        for (int i = 0; i < to && device_inited; i += step) {
+            LOG_DEBUG("capture") << i / step << "/" << to / step;
+
+            expose_long_image(configs.value("LONG_IMAGE_SETTINGS/NUMBER").toInt());
+            const bool is_last = i + step >= to || !device_inited;
+            rotate(is_last ? -1 : step);
+
+            const Frame::Ptr image = finish_long_image();
+            const uint index = uint(frames.size());
+            frames.push_back(image);
+            writer->enqueue([image, index]() { image->save(index); });
+
+            if (!is_last) {
+                wait_for_rotation();
+            }
         }
 
-        rotate(-1);
+        writer->wait();
         shutdown_rotation();
-        save_long_image_data();
+        LOG_INFO("capture") << "Done!";
     }
 }
 
@@ -242,15 +430,17 @@ void OpenNiInterface::take_one_long_image()
 
 void OpenNiInterface::save_long_image_data()
 {
-    qDebug() << "Saving data...";
+    LOG_INFO("capture") << "Saving data...";
 
     clearDataFolder();
 
     for (uint i = 0; i < frames.size(); ++i) {
-        frames[i]->save(i);
+        const Frame::Ptr frame = frames[i];
+        writer->enqueue([frame, i]() { frame->save(i); });
     }
+    writer->wait();
 
-    qDebug() << "Done!";
+    LOG_INFO("capture") << "Done!";
 }
 
 bool OpenNiInterface::isInit()
@@ -258,81 +448,243 @@ bool OpenNiInterface::isInit()
     return device_inited;
 }
 
+OpenNiInterface::CaptureListener::CaptureListener(openni::VideoStream& colorStream_, CaptureRing<CaptureSlot>& ring_, RawSessionWriter* recorder_)
+    : colorStream(colorStream_)
+    , ring(ring_)
+    , recorder(recorder_)
+{
+}
+
+void OpenNiInterface::CaptureListener::onNewFrame(openni::VideoStream& depthStream)
+{
+    if (depthStream.readFrame(&depth_frame) != openni::STATUS_OK || colorStream.readFrame(&color_frame) != openni::STATUS_OK) {
+        return;
+    }
+
+    //Before the ring, so the recording keeps the pairs the pipeline has no room for
+    if (recorder != nullptr) {
+        recorder->append(static_cast<const uint16_t*>(depth_frame.getData()), static_cast<const uint8_t*>(color_frame.getData()),
+            std::min<size_t>(depth_frame.getDataSize() / sizeof(openni::DepthPixel), color_frame.getDataSize() / sizeof(openni::RGB888Pixel)),
+            depth_frame.getTimestamp(), color_frame.getTimestamp());
+    }
+
+    CaptureSlot* slot = ring.beginWrite();
+    if (slot == nullptr) {
+        return;
+    }
+
+    copy_to_slot(depth_frame, color_frame, *slot);
+    ring.endWrite();
+}
+
+void OpenNiInterface::copy_to_slot(const openni::VideoFrameRef& depth_frame, const openni::VideoFrameRef& color_frame, CaptureSlot& slot)
+{
+    const size_t depth_size = std::min<size_t>(depth_frame.getDataSize(), slot.depth.size() * sizeof(openni::DepthPixel));
+    const size_t color_size = std::min<size_t>(color_frame.getDataSize(), slot.color.size() * sizeof(openni::RGB888Pixel));
+    memcpy(slot.depth.data(), depth_frame.getData(), depth_size);
+    memcpy(slot.color.data(), color_frame.getData(), color_size);
+    slot.timestamp = depth_frame.getTimestamp();
+    slot.color_timestamp = color_frame.getTimestamp();
+    slot.arrival = CaptureTelemetry::Clock::now();
+}
+
+bool OpenNiInterface::read_stream_slot(CaptureSlot& slot)
+{
+    if (raw_replay) {
+        uint8_t* rgb = reinterpret_cast<uint8_t*>(slot.color.data());
+        if (!raw_replay->next(slot.depth.data(), rgb, slot.timestamp, slot.color_timestamp)) {
+            if (!configs.value("OPENNI_SETTINGS/REPEAT_RECORDING").toBool()) {
+                return false;
+            }
+            raw_replay->rewind();
+            if (!raw_replay->next(slot.depth.data(), rgb, slot.timestamp, slot.color_timestamp)) {
+                return false;
+            }
+        }
+        slot.arrival = CaptureTelemetry::Clock::now();
+        return true;
+    }
+
+    openni::VideoFrameRef color_frame;
+    depthStream.readFrame(&frame);
+    colorStream.readFrame(&color_frame);
+    copy_to_slot(frame, color_frame, slot);
+    if (raw_recorder) {
+        raw_recorder->append(slot.depth.data(), reinterpret_cast<const uint8_t*>(slot.color.data()), slot.depth.size(),
+            slot.timestamp, slot.color_timestamp);
+    }
+    return true;
+}
+
 OpenNiInterface::Frame::Ptr OpenNiInterface::take_one_frame(const uint& frame_index)
 {
-    Frame::Ptr frame(new Frame(colorStream, depthStream, settings, &configs));
+    Frame::Ptr frame = frame_pool->acquire();
+    //Through a slot only when the raw pair is needed, else straight from the driver's buffers
+    if (raw_replay || raw_recorder) {
+        if (!read_stream_slot(stream_slot)) {
+            return nullptr;
+        }
+        frame->read(stream_slot, width, height, horizontal_fov, vertical_fov);
+    } else {
+        frame->read(colorStream, depthStream);
+    }
+    process_frame(frame, frame_index);
+
+    return frame;
+}
 
+void OpenNiInterface::process_frame(const Frame::Ptr& frame, const uint& frame_index)
+{
     if (stream_bilateral) {
         apply_bilateral_filter(frame->world_coords);
-        frame->update_world_coords();
+    }
+
+    if (depth_correction) {
+        apply_depth_correction(frame->world_coords);
     }
 
     if (stream_undistortion) {
         apply_undistortion(frame->world_coords);
-        frame->update_world_coords();
 
         cv::Mat undist_mat; //Note: cv::undistort works only with empty out buffer
         cv::undistort(frame->color_frame_mat, undist_mat, calib_matrix, dist_coeffs);
         frame->color_frame_mat = undist_mat;
     }
 
-    if (configs.value("ARUCO_SETTINGS/ENABLE_IN_STREAM").toBool()) {
-        std::vector<aruco::Marker> Markers;
-        ArUcoKeypointDetector aruco(this, settings);
-        aruco.getMarkersVector(frame->color_frame_mat, &Markers);
+    //The filters only change the coordinates and the image, the cloud is built once from the result
+    frame->update_world_coords();
+
+    if (odometry) {
+        ::Frame odometry_frame;
+        odometry_frame.pointCloudPtr = frame->point_cloud;
+        odometry_frame.pointCloudImage = frame->color_frame_mat.clone();
+        odometry_frame.setResolution(*odometry_frame.pointCloudPtr, odometry_frame.pointCloudImage);
+        odometry_frame.frameIndex = int(frame_index);
+        odometry->push(odometry_frame);
     }
 
-    cv::imshow("Color", frame->color_frame_mat);
-    cv::imshow("Depth", frame->depth_frame_mat);
-    cv::waitKey(30);
+    if (configs.value("ARUCO_SETTINGS/ENABLE_IN_STREAM").toBool()) {
+        if (!aruco_stream_detector) {
+            aruco_stream_detector.reset(new ArUcoStreamDetector(this, settings));
+        }
+        aruco_stream_detector->detectMarkers(frame->color_frame_mat);
+    }
 
     if (frame_index > 15 && record_to_pcd_data) {
-        qDebug() << "Saving Frame" << frame_index - 15;
-        frame->save(frame_index - 15);
+        const uint save_index = frame_index - 15;
+        if (writer->enqueue([frame, save_index]() { frame->save(save_index); }, true)) {
+            LOG_DEBUG("capture") << "Saving Frame" << save_index;
+        } else {
+            LOG_WARNING("capture") << "Dropped Frame" << save_index << "total dropped:" << writer->getDroppedCount();
+        }
     }
 
-    return frame;
+    //The activity is done once the frame is queued, the preview below only waits for the GUI
+    if (telemetry) {
+        update_telemetry(*frame);
+    }
+
+    //Only the newest frame is kept for the preview, the ones it replaces are never shown
+    preview_frame = frame;
 }
 
-OpenNiInterface::Frame::Ptr OpenNiInterface::take_one_optimized_image(const uint& number)
+void OpenNiInterface::show_preview()
 {
-    Frame::Ptr sum_frame(new Frame(colorStream, depthStream, settings, &configs));
-    std::vector<cv::Vec3f> counter_map(WIDTH * HEIGHT, cv::Vec3f(1, 1, 1));
+    const CaptureTelemetry::Clock::time_point now = CaptureTelemetry::Clock::now();
+    if (!preview_frame || now - last_preview < std::chrono::milliseconds(configs.value("OPENNI_SETTINGS/PREVIEW_INTERVAL_MS").toInt())) {
+        return;
+    }
+    last_preview = now;
 
-    for (uint i = 0; i < number; ++i) {
-        qDebug() << QString("%1/%2").arg(i + 1).arg(number);
+    //The depth preview is never saved, the figures are drawn onto it a line each
+    const QStringList telemetry_lines = telemetry_text.split(", ", QString::SkipEmptyParts);
+    for (int i = 0; i < telemetry_lines.size(); ++i) {
+        cv::putText(preview_frame->depth_frame_mat, telemetry_lines[i].toStdString(), cv::Point(4, 14 + 14 * i),
+            cv::FONT_HERSHEY_PLAIN, 0.9, cv::Scalar(0, 255, 0));
+    }
+
+    cv::imshow("Color", preview_frame->color_frame_mat);
+    cv::imshow("Depth", preview_frame->depth_frame_mat);
+    if (odometry) {
+        cv::imshow("Odometry", odometry->getPreview());
+    }
+    //The frame goes back to the pool once the writer is done with it
+    preview_frame.reset();
 
-        Frame::Ptr tmp_frame(new Frame(colorStream, depthStream, settings, &configs));
+    cv::waitKey(1);
+}
 
-        for (uint y = 0; y < HEIGHT; ++y) {
-            for (uint x = 0; x < WIDTH; ++x) {
-                const uint index = x + y * WIDTH;
+void OpenNiInterface::update_telemetry(const Frame& frame)
+{
+    telemetry->add(CaptureTelemetry::Sample{
+        frame.depth_timestamp, frame.color_timestamp, frame.arrival, CaptureTelemetry::Clock::now() });
 
-                ++counter_map[index][0];
-                sum_frame->world_coords[index][0] += tmp_frame->world_coords[index][0];
-                ++counter_map[index][1];
-                sum_frame->world_coords[index][1] += tmp_frame->world_coords[index][1];
+    if (!telemetry->reportDue(std::chrono::milliseconds(configs.value("OPENNI_SETTINGS/TELEMETRY_INTERVAL_MS").toInt()))) {
+        return;
+    }
 
-                if (tmp_frame->world_coords[index][2] != 0) {
-                    ++counter_map[index][2];
-                    sum_frame->world_coords[index][2] += tmp_frame->world_coords[index][2];
-                }
-            }
+    telemetry->setQueues(CaptureTelemetry::Queues{
+        capture_ring ? capture_ring->size() : 0,
+        capture_ring ? capture_ring->capacity() : 0,
+        capture_ring ? capture_ring->getDroppedCount() : 0,
+        writer->getQueueSize(),
+        writer->getDroppedCount(),
+        odometry ? odometry->getDroppedCount() : 0 });
+
+    telemetry_text = telemetry->text(telemetry->getInterval());
+    LOG_INFO("capture") << telemetry_text;
+    emit signal_capture_telemetry(telemetry_text);
+}
+
+OpenNiInterface::Frame::Ptr OpenNiInterface::take_one_optimized_image(const uint& number)
+{
+    expose_long_image(number);
+    return finish_long_image();
+}
+
+/** \brief Only the raw depth is accumulated, the world coordinates are converted once from the average. */
+void OpenNiInterface::expose_long_image(const uint& number)
+{
+    if (!depth_accumulator) {
+        depth_accumulator.reset(new DepthAccumulator(size_t(width) * height,
+            DepthAccumulator::modeFromString(configs.value("LONG_IMAGE_SETTINGS/MODE").toString().toStdString()),
+            configs.value("LONG_IMAGE_SETTINGS/WINDOW").toInt(),
+            configs.value("LONG_IMAGE_SETTINGS/REJECTION_RATIO").toFloat()));
+    }
+    depth_accumulator->reset();
+
+    //A replayed session gives the pairs of the exposure one after another
+    if (raw_replay) {
+        for (uint i = 0; i < std::max(1u, number) && read_stream_slot(long_image_slot); ++i) {
+            depth_accumulator->add(long_image_slot.depth.data());
         }
+        return;
     }
 
-    for (uint y = 0; y < HEIGHT; ++y) {
-        for (uint x = 0; x < WIDTH; ++x) {
-            sum_frame->world_coords[x + y * WIDTH][0] /= counter_map[x + y * WIDTH][0];
-            sum_frame->world_coords[x + y * WIDTH][1] /= counter_map[x + y * WIDTH][1];
-            sum_frame->world_coords[x + y * WIDTH][2] /= counter_map[x + y * WIDTH][2];
+    colorStream.readFrame(&frame);
+    memcpy(long_image_slot.color.data(), frame.getData(),
+        std::min<size_t>(frame.getDataSize(), long_image_slot.color.size() * sizeof(openni::RGB888Pixel)));
+
+    for (uint i = 0; i < std::max(1u, number); ++i) {
+        LOG_DEBUG("capture") << QString("%1/%2").arg(i + 1).arg(number);
+
+        depthStream.readFrame(&frame);
+        if (size_t(frame.getDataSize()) < long_image_slot.depth.size() * sizeof(openni::DepthPixel)) {
+            continue;
         }
+        depth_accumulator->add(static_cast<const openni::DepthPixel*>(frame.getData()));
     }
+}
 
-    sum_frame->update_world_coords();
-    cv::imshow(QString("DepthMap %1").arg(rand()).toStdString(), sum_frame->depth_frame_mat);
+OpenNiInterface::Frame::Ptr OpenNiInterface::finish_long_image()
+{
+    depth_accumulator->result(long_image_slot.depth.data());
+    Frame::Ptr result = frame_pool->acquire();
+    result->read(long_image_slot, width, height, horizontal_fov, vertical_fov);
+    result->update_world_coords();
+    cv::imshow(QString("DepthMap %1").arg(rand()).toStdString(), result->depth_frame_mat);
 
-    return sum_frame;
+    return result;
 }
 
 void OpenNiInterface::initialize_rotation()
@@ -340,13 +692,53 @@ void OpenNiInterface::initialize_rotation()
     serial->setPortName(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString());
     serial->setBaudRate(QSerialPort::Baud57600);
 
-    if (!serial->open(QIODevice::WriteOnly)) {
-        qDebug() << QObject::tr("Failed to open port %1, error: %2")
-                        .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
-                        .arg(serial->errorString());
+    rotation_timer.start();
+    if (!serial->open(QIODevice::ReadWrite)) {
+        LOG_WARNING("capture") << QObject::tr("Failed to open port %1, error: %2")
+                                      .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
+                                      .arg(serial->errorString());
+        return;
+    }
+
+    //The controller restarts when the port opens, any line it prints means it is ready
+    if (!configs.value("OPENNI_SETTINGS/ROTATION_ACK_ENABLE").toBool() || !wait_for_controller(QByteArray(), INIT_PAUSE_TIME)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::max<qint64>(0, INIT_PAUSE_TIME - rotation_timer.elapsed())));
+    }
+}
+
+void OpenNiInterface::wait_for_rotation()
+{
+    if (configs.value("OPENNI_SETTINGS/ROTATION_ACK_ENABLE").toBool()) {
+        if (!wait_for_controller(configs.value("OPENNI_SETTINGS/ROTATION_ACK").toByteArray(),
+                configs.value("OPENNI_SETTINGS/ROTATION_ACK_TIMEOUT_MS").toLongLong())) {
+            LOG_WARNING("capture") << "No rotation acknowledgement from" << configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString()
+                                   << "in" << rotation_timer.elapsed() << "ms";
+        }
+        return;
     }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(INIT_PAUSE_TIME));
+    //Without acknowledgements the motion is given a fixed time from the command on
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::max<qint64>(0, INIT_PAUSE_TIME - rotation_timer.elapsed())));
+}
+
+bool OpenNiInterface::wait_for_controller(const QByteArray& expected, const qint64& timeout_ms)
+{
+    while (serial->isOpen()) {
+        while (serial->canReadLine()) {
+            const QByteArray line = serial->readLine().trimmed();
+            LOG_DEBUG("capture") << "Read:" << line.constData();
+            if (expected.isEmpty() || line == expected) {
+                return true;
+            }
+        }
+
+        const qint64 remaining = timeout_ms - rotation_timer.elapsed();
+        if (remaining <= 0 || !serial->waitForReadyRead(int(remaining))) {
+            return false;
+        }
+    }
+
+    return false;
 }
 
 void OpenNiInterface::shutdown_rotation()
@@ -359,55 +751,57 @@ void OpenNiInterface::rotate(int angle)
     const QByteArray writeData = QByteArray::fromStdString(QString("%1\n").arg(angle).toStdString());
 
     if (writeData.isEmpty()) {
-        qDebug() << QObject::tr(
-                        "Either no data was currently available on the standard input for reading, or an error occurred for port %1, error: %2")
-                        .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
-                        .arg(serial->errorString());
+        LOG_WARNING("capture") << QObject::tr(
+                                      "Either no data was currently available on the standard input for reading, or an error occurred for port %1, error: %2")
+                                      .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
+                                      .arg(serial->errorString());
         return;
     }
 
+    //Lines left from an earlier command are not an acknowledgement of this one
+    serial->readAll();
+    rotation_timer.start();
     const qint64 bytesWritten = serial->write(writeData);
 
     if (bytesWritten == -1) {
-        qDebug() << QObject::tr("Failed to write the data to port %1, error: %2")
-                        .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
-                        .arg(serial->errorString());
+        LOG_WARNING("capture") << QObject::tr("Failed to write the data to port %1, error: %2")
+                                      .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
+                                      .arg(serial->errorString());
     } else if (bytesWritten != writeData.size()) {
-        qDebug() << QObject::tr("Failed to write all the data to port %1, error: %2")
-                        .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
-                        .arg(serial->errorString());
+        LOG_WARNING("capture") << QObject::tr("Failed to write all the data to port %1, error: %2")
+                                      .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
+                                      .arg(serial->errorString());
     } else if (!serial->waitForBytesWritten(5000)) {
-        qDebug() << QObject::tr("Operation timed out or an error occurred for port %1, error: %2")
-                        .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
-                        .arg(serial->errorString());
+        LOG_WARNING("capture") << QObject::tr("Operation timed out or an error occurred for port %1, error: %2")
+                                      .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString())
+                                      .arg(serial->errorString());
     } else {
-        qDebug() << QObject::tr("Data successfully sent to port %1")
-                        .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString());
+        LOG_INFO("capture") << QObject::tr("Data successfully sent to port %1")
+                                   .arg(configs.value("OPENNI_SETTINGS/SERIAL_PORT_NAME").toString());
     }
-
-    const QByteArray readData = serial->readAll();
-    qDebug() << "Read:" << readData.toStdString().c_str();
 }
 
 void OpenNiInterface::apply_undistortion(
     std::vector<cv::Vec3f>& world_coords)
 {
-    cv::Mat img(HEIGHT, WIDTH, CV_32FC1);
-    cv::Mat img_res(HEIGHT, WIDTH, CV_32FC1);
+    depth_plane.read(world_coords, width, height);
+    //Note: cv::undistort works only with empty out buffer
+    filtered_depth_plane.mat().release();
+    undistort(depth_plane.mat(), filtered_depth_plane.mat(), calib_matrix, dist_coeffs);
+    filtered_depth_plane.write(world_coords);
+}
 
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            img.at<float>(y, x) = world_coords[x + y * WIDTH][2];
-        }
+void OpenNiInterface::apply_depth_correction(
+    std::vector<cv::Vec3f>& world_coords)
+{
+    //The table is built for the calibration resolution
+    if (depth_correction->pixelsCount() != width * height) {
+        return;
     }
 
-    undistort(img, img_res, calib_matrix, dist_coeffs);
-
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            world_coords[x + y * WIDTH][2] = std::round(img_res.at<float>(y, x));
-        }
-    }
+    ThreadPool::instance().parallel_for(0, size_t(height), [&](size_t y) {
+        depth_correction->apply(&world_coords[y * width][2], sizeof(cv::Vec3f), int(y) * width, width, 0.001f);
+    });
 }
 
 void OpenNiInterface::apply_bilateral_filter(
@@ -417,20 +811,13 @@ void OpenNiInterface::apply_bilateral_filter(
     const double sigma_color = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/SIGMA_COLOR").toDouble();
     const double sigma_space = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/SIGMA_SPACE").toDouble();
 
-    cv::Mat img(HEIGHT, WIDTH, CV_32FC1);
-    cv::Mat img_res(HEIGHT, WIDTH, CV_32FC1);
-
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            img.at<float>(y, x) = world_coords[x + y * WIDTH][2];
-        }
-    }
-
-    bilateralFilter(img, img_res, d, sigma_color, sigma_space);
-
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            world_coords[x + y * WIDTH][2] = std::round(img_res.at<float>(y, x));
-        }
+    depth_plane.read(world_coords, width, height);
+    if (configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/METHOD").toString() == "GUIDED") {
+        const int radius = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/GUIDED_RADIUS").toInt();
+        const double epsilon = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/GUIDED_EPSILON").toDouble();
+        depth_guided_filter.apply(depth_plane.mat(), filtered_depth_plane.mat(), radius, epsilon);
+    } else {
+        bilateralFilter(depth_plane.mat(), filtered_depth_plane.mat(), d, sigma_color, sigma_space);
     }
+    filtered_depth_plane.write(world_coords);
 }
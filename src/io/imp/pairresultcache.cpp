@@ -0,0 +1,183 @@
+#include "io/pairresultcache.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <cstring>
+
+#include "io/keypointsserialization.h"
+#include "utility/hash.h"
+
+namespace {
+
+const char KEYPOINTS_MAGIC[4] = { 'R', 'S', 'P', 'K' };
+const char REGISTRATION_MAGIC[4] = { 'R', 'S', 'P', 'R' };
+const uint32_t PAIR_RESULT_CACHE_VERSION = 2;
+
+QString entry_filename(const QString& folder, const uint64_t& key, const QString& extension)
+{
+    return folder + "/" + QString("%1.%2").arg(qulonglong(key), 16, 16, QChar('0')).arg(extension);
+}
+
+pair_result_cache::Header make_header(const char* magic, const uint64_t& key)
+{
+    pair_result_cache::Header header;
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = PAIR_RESULT_CACHE_VERSION;
+    header.key = key;
+    return header;
+}
+
+bool save_entry(const QString& filename, const QByteArray& buffer)
+{
+    if (!QDir().mkpath(QFileInfo(filename).absolutePath())) {
+        return false;
+    }
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    return file.write(buffer) == qint64(buffer.size()) && file.commit();
+}
+
+/** \brief The entry's payload, empty when the file is missing or not the entry of key. */
+bool load_entry(const QString& filename, const char* magic, const uint64_t& key, QByteArray& payload)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray buffer = file.readAll();
+    pair_result_cache::Header header;
+    if (size_t(buffer.size()) < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, buffer.constData(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0
+        || header.version != PAIR_RESULT_CACHE_VERSION
+        || header.key != key) {
+        return false;
+    }
+
+    payload = buffer.mid(int(sizeof(header)));
+    return true;
+}
+
+} // namespace
+
+QString pair_result_cache::cache_folder(const ProjectSettings& project, const ScannerConfig& configs)
+{
+    if (!configs.value("PAIR_RESULT_CACHE_SETTINGS/ENABLE").toBool()) {
+        return QString();
+    }
+
+    return QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/"
+        + configs.value("PAIR_RESULT_CACHE_SETTINGS/FOLDER_NAME").toString();
+}
+
+uint64_t pair_result_cache::frame_hash(const Frame& frame, const uint64_t& seed)
+{
+    uint64_t result = seed;
+    if (frame.pointCloudPtr) {
+        //Field by field, the padding of the points is not part of the content
+        for (const PointType& point : frame.pointCloudPtr->points) {
+            result = hash::fnv1a_value(point.x, result);
+            result = hash::fnv1a_value(point.y, result);
+            result = hash::fnv1a_value(point.z, result);
+            result = hash::fnv1a_value(point.rgba, result);
+        }
+    }
+
+    const cv::Mat image = frame.pointCloudImage.isContinuous() ? frame.pointCloudImage : frame.pointCloudImage.clone();
+    result = hash::fnv1a_value(image.type(), result);
+    result = hash::fnv1a(image.data, image.total() * image.elemSize(), result);
+
+    return hash::fnv1a(frame.pose.data(), 16 * sizeof(float), result);
+}
+
+uint64_t pair_result_cache::keypoints_hash(const KeypointsFrame& keypoints, const uint64_t& seed)
+{
+    QByteArray buffer;
+    keypoints_serialization::append(buffer, keypoints);
+    return hash::fnv1a(buffer.constData(), size_t(buffer.size()), seed);
+}
+
+uint64_t pair_result_cache::transformation_hash(const Eigen::Matrix4f& transformation, const uint64_t& seed)
+{
+    return hash::fnv1a(transformation.data(), 16 * sizeof(float), seed);
+}
+
+bool pair_result_cache::save_keypoints(const QString& folder, const uint64_t& key, const KeypointsFrame& keypoints,
+    const keypoint_budget::Report& budget_report)
+{
+    const Header header = make_header(KEYPOINTS_MAGIC, key);
+    QByteArray buffer(reinterpret_cast<const char*>(&header), int(sizeof(header)));
+    keypoints_serialization::append(buffer, keypoints);
+
+    PackedBudgetReport packed_report;
+    packed_report.budgeted = budget_report.budgeted;
+    packed_report.inliers = budget_report.inliers;
+    buffer.append(reinterpret_cast<const char*>(&packed_report), int(sizeof(packed_report)));
+
+    return save_entry(entry_filename(folder, key, "kpc"), buffer);
+}
+
+bool pair_result_cache::load_keypoints(const QString& folder, const uint64_t& key, KeypointsFrame& keypoints,
+    keypoint_budget::Report& budget_report)
+{
+    QByteArray payload;
+    if (!load_entry(entry_filename(folder, key, "kpc"), KEYPOINTS_MAGIC, key, payload)) {
+        return false;
+    }
+
+    size_t offset = 0;
+    KeypointsFrame result;
+    PackedBudgetReport packed_report;
+    if (!keypoints_serialization::read(payload, offset, result)
+        || offset + sizeof(packed_report) != size_t(payload.size())) {
+        return false;
+    }
+    std::memcpy(&packed_report, payload.constData() + offset, sizeof(packed_report));
+
+    keypoints = result;
+    budget_report.budgeted = size_t(packed_report.budgeted);
+    budget_report.inliers = size_t(packed_report.inliers);
+    return true;
+}
+
+bool pair_result_cache::save_registration(
+    const QString& folder, const uint64_t& key, const Eigen::Matrix4f& transformation, const float& fitness_score)
+{
+    PackedRegistration registration;
+    std::memcpy(registration.transformation, transformation.data(), sizeof(registration.transformation));
+    registration.fitness_score = fitness_score;
+
+    const Header header = make_header(REGISTRATION_MAGIC, key);
+    QByteArray buffer(reinterpret_cast<const char*>(&header), int(sizeof(header)));
+    buffer.append(reinterpret_cast<const char*>(&registration), int(sizeof(registration)));
+
+    return save_entry(entry_filename(folder, key, "rgc"), buffer);
+}
+
+bool pair_result_cache::load_registration(
+    const QString& folder, const uint64_t& key, Eigen::Matrix4f& transformation, float& fitness_score)
+{
+    QByteArray payload;
+    if (!load_entry(entry_filename(folder, key, "rgc"), REGISTRATION_MAGIC, key, payload)
+        || size_t(payload.size()) != sizeof(PackedRegistration)) {
+        return false;
+    }
+
+    PackedRegistration registration;
+    std::memcpy(&registration, payload.constData(), sizeof(registration));
+    std::memcpy(transformation.data(), registration.transformation, sizeof(registration.transformation));
+    fitness_score = registration.fitness_score;
+    return true;
+}
@@ -0,0 +1,168 @@
+#include "io/plystreamwriter.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "utility/log.h"
+
+namespace {
+
+const int COUNT_FIELD_WIDTH = 10;
+
+#pragma pack(push, 1)
+struct PlyVertex {
+    float x;
+    float y;
+    float z;
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+};
+
+struct PlyFace {
+    uint8_t size;
+    int32_t indices[3];
+};
+#pragma pack(pop)
+
+QByteArray count_field(const uint32_t& count)
+{
+    return QString("%1").arg(count, COUNT_FIELD_WIDTH, 10, QChar(' ')).toLatin1();
+}
+
+} // namespace
+
+PlyStreamWriter::PlyStreamWriter(const QString& filename)
+    : file(filename)
+    , faces_file(filename + ".faces.tmp")
+    , vertices_count(0)
+    , faces_count(0)
+    , vertex_count_position(0)
+    , face_count_position(0)
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARNING("io") << "PlyStreamWriter: can't open" << filename;
+        return;
+    }
+    if (!faces_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        LOG_WARNING("io") << "PlyStreamWriter: can't open" << faces_file.fileName();
+        file.close();
+        return;
+    }
+
+    file.write("ply\nformat binary_little_endian 1.0\nelement vertex ");
+    vertex_count_position = file.pos();
+    file.write(count_field(0));
+    file.write("\nproperty float x\nproperty float y\nproperty float z\n"
+               "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+               "element face ");
+    face_count_position = file.pos();
+    file.write(count_field(0));
+    file.write("\nproperty list uchar int vertex_indices\nend_header\n");
+}
+
+PlyStreamWriter::~PlyStreamWriter()
+{
+    close();
+}
+
+bool PlyStreamWriter::isOpen() const
+{
+    return file.isOpen();
+}
+
+uint32_t PlyStreamWriter::appendVertices(const pcl::PointCloud<pcl::PointXYZRGB>& vertices)
+{
+    const uint32_t first_index = vertices_count;
+    if (!file.isOpen() || vertices.empty()) {
+        return first_index;
+    }
+
+    buffer.resize(vertices.size() * sizeof(PlyVertex));
+    PlyVertex* out = reinterpret_cast<PlyVertex*>(buffer.data());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const pcl::PointXYZRGB& point = vertices[i];
+        out[i].x = point.x;
+        out[i].y = point.y;
+        out[i].z = point.z;
+        out[i].red = point.r;
+        out[i].green = point.g;
+        out[i].blue = point.b;
+    }
+
+    file.write(buffer.data(), qint64(buffer.size()));
+    vertices_count += uint32_t(vertices.size());
+
+    return first_index;
+}
+
+void PlyStreamWriter::appendFaces(const std::vector<pcl::Vertices>& faces)
+{
+    if (!faces_file.isOpen()) {
+        return;
+    }
+
+    buffer.clear();
+    for (const auto& face : faces) {
+        if (face.vertices.size() != 3) {
+            throw std::invalid_argument("PlyStreamWriter::appendFaces face is not a triangle");
+        }
+
+        PlyFace out;
+        out.size = 3;
+        for (int i = 0; i < 3; ++i) {
+            out.indices[i] = int32_t(face.vertices[i]);
+        }
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&out), reinterpret_cast<const char*>(&out) + sizeof(PlyFace));
+    }
+
+    faces_file.write(buffer.data(), qint64(buffer.size()));
+    faces_count += uint32_t(faces.size());
+}
+
+void PlyStreamWriter::appendTriangles(const pcl::PointCloud<pcl::PointXYZRGB>& vertices)
+{
+    const uint32_t first_index = appendVertices(vertices);
+
+    std::vector<pcl::Vertices> faces(vertices.size() / 3);
+    for (size_t i = 0; i < faces.size(); ++i) {
+        faces[i].vertices.resize(3);
+        for (uint32_t j = 0; j < 3; ++j) {
+            faces[i].vertices[j] = first_index + uint32_t(i) * 3 + j;
+        }
+    }
+    appendFaces(faces);
+}
+
+bool PlyStreamWriter::close()
+{
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    bool success = faces_file.isOpen() && faces_file.seek(0);
+    while (success && !faces_file.atEnd()) {
+        const QByteArray chunk = faces_file.read(1 << 20);
+        success = file.write(chunk) == chunk.size();
+    }
+
+    success = success
+        && file.seek(vertex_count_position) && file.write(count_field(vertices_count)) == COUNT_FIELD_WIDTH
+        && file.seek(face_count_position) && file.write(count_field(faces_count)) == COUNT_FIELD_WIDTH;
+
+    file.close();
+    faces_file.close();
+    faces_file.remove();
+
+    return success;
+}
+
+uint32_t PlyStreamWriter::getVerticesCount() const
+{
+    return vertices_count;
+}
+
+uint32_t PlyStreamWriter::getFacesCount() const
+{
+    return faces_count;
+}
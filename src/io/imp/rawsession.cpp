@@ -0,0 +1,181 @@
+#include "io/rawsession.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <cstring>
+
+#include "utility/log.h"
+
+namespace {
+
+const char RAW_SESSION_MAGIC[4] = { 'R', 'S', 'R', '1' };
+const uint32_t RAW_SESSION_VERSION = 1;
+
+size_t pixels_count(const raw_session::Header& mode)
+{
+    return size_t(mode.width) * mode.height;
+}
+
+} // namespace
+
+RawSessionWriter::RawSessionWriter(const QString& filename, const raw_session::Header& mode_, const int& jpeg_quality_,
+    const int& compression_level_, const size_t& max_queue_size)
+    : file(filename)
+    , mode(mode_)
+    , jpeg_quality(jpeg_quality_)
+    , compression_level(compression_level_)
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARNING("io") << "RawSessionWriter: can't create" << filename;
+        return;
+    }
+
+    raw_session::Header header = mode;
+    std::memcpy(header.magic, RAW_SESSION_MAGIC, sizeof(header.magic));
+    header.version = RAW_SESSION_VERSION;
+    header.reserved = 0;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    //A single writer keeps the records in capture order
+    writer.reset(new FrameWriter(max_queue_size, 1));
+}
+
+RawSessionWriter::~RawSessionWriter()
+{
+    writer.reset();
+    file.close();
+}
+
+bool RawSessionWriter::isOpen() const
+{
+    return file.isOpen();
+}
+
+bool RawSessionWriter::append(const uint16_t* depth, const uint8_t* rgb, const size_t& count,
+    const uint64_t& depth_timestamp, const uint64_t& color_timestamp)
+{
+    if (!writer || count < pixels_count(mode)) {
+        return false;
+    }
+
+    std::shared_ptr<std::vector<uint16_t> > depth_copy = std::make_shared<std::vector<uint16_t> >(depth, depth + pixels_count(mode));
+    std::shared_ptr<std::vector<uint8_t> > rgb_copy = std::make_shared<std::vector<uint8_t> >(rgb, rgb + 3 * pixels_count(mode));
+    return writer->enqueue([this, depth_copy, rgb_copy, depth_timestamp, color_timestamp]() {
+        write(*depth_copy, *rgb_copy, depth_timestamp, color_timestamp);
+    }, true);
+}
+
+void RawSessionWriter::flush()
+{
+    if (writer) {
+        writer->wait();
+    }
+    file.flush();
+}
+
+size_t RawSessionWriter::getWrittenCount() const
+{
+    return writer ? writer->getWrittenCount() : 0;
+}
+
+size_t RawSessionWriter::getDroppedCount() const
+{
+    return writer ? writer->getDroppedCount() : 0;
+}
+
+void RawSessionWriter::write(const std::vector<uint16_t>& depth, const std::vector<uint8_t>& rgb,
+    const uint64_t& depth_timestamp, const uint64_t& color_timestamp)
+{
+    const QByteArray depth_data = qCompress(reinterpret_cast<const uchar*>(depth.data()),
+        int(depth.size() * sizeof(uint16_t)), compression_level);
+
+    cv::Mat bgr;
+    cv::cvtColor(cv::Mat(int(mode.height), int(mode.width), CV_8UC3, const_cast<uint8_t*>(rgb.data())), bgr, CV_RGB2BGR);
+    std::vector<uchar> color_data;
+    std::vector<int> params;
+    params.push_back(CV_IMWRITE_JPEG_QUALITY);
+    params.push_back(jpeg_quality);
+    if (!cv::imencode(".jpg", bgr, color_data, params)) {
+        return;
+    }
+
+    raw_session::Record record;
+    record.depth_size = uint32_t(depth_data.size());
+    record.color_size = uint32_t(color_data.size());
+    record.depth_timestamp = depth_timestamp;
+    record.color_timestamp = color_timestamp;
+
+    file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    file.write(depth_data);
+    file.write(reinterpret_cast<const char*>(color_data.data()), qint64(color_data.size()));
+}
+
+RawSessionReader::RawSessionReader(const QString& filename)
+    : file(filename)
+{
+    std::memset(&mode, 0, sizeof(mode));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    if (file.read(reinterpret_cast<char*>(&mode), sizeof(mode)) != qint64(sizeof(mode))
+        || std::memcmp(mode.magic, RAW_SESSION_MAGIC, sizeof(mode.magic)) != 0
+        || mode.version != RAW_SESSION_VERSION
+        || pixels_count(mode) == 0) {
+        LOG_WARNING("io") << "RawSessionReader: not a raw session" << filename;
+        file.close();
+    }
+}
+
+bool RawSessionReader::isOpen() const
+{
+    return file.isOpen();
+}
+
+const raw_session::Header& RawSessionReader::getMode() const
+{
+    return mode;
+}
+
+bool RawSessionReader::next(uint16_t* depth, uint8_t* rgb, uint64_t& depth_timestamp, uint64_t& color_timestamp)
+{
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    raw_session::Record record;
+    if (file.read(reinterpret_cast<char*>(&record), sizeof(record)) != qint64(sizeof(record))) {
+        return false;
+    }
+
+    depth_data = file.read(record.depth_size);
+    color_data.resize(record.color_size);
+    if (depth_data.size() != int(record.depth_size)
+        || file.read(reinterpret_cast<char*>(color_data.data()), record.color_size) != qint64(record.color_size)) {
+        return false;
+    }
+
+    const QByteArray depth_pixels = qUncompress(depth_data);
+    if (size_t(depth_pixels.size()) != pixels_count(mode) * sizeof(uint16_t)) {
+        return false;
+    }
+    std::memcpy(depth, depth_pixels.constData(), size_t(depth_pixels.size()));
+
+    const cv::Mat bgr = cv::imdecode(color_data, CV_LOAD_IMAGE_COLOR);
+    if (bgr.cols != int(mode.width) || bgr.rows != int(mode.height)) {
+        return false;
+    }
+    cv::Mat rgb_mat(int(mode.height), int(mode.width), CV_8UC3, rgb);
+    cv::cvtColor(bgr, rgb_mat, CV_BGR2RGB);
+
+    depth_timestamp = record.depth_timestamp;
+    color_timestamp = record.color_timestamp;
+    return true;
+}
+
+void RawSessionReader::rewind()
+{
+    if (file.isOpen()) {
+        file.seek(sizeof(raw_session::Header));
+    }
+}
@@ -0,0 +1,269 @@
+#include "io/reconstructioncheckpoint.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+
+#include <cstring>
+
+#include "io/keypointsserialization.h"
+#include "utility/hash.h"
+
+namespace {
+
+const char CHECKPOINT_MAGIC[4] = { 'R', 'S', 'C', 'K' };
+const uint32_t CHECKPOINT_VERSION = 2;
+
+//configs.ini sections the registered poses depend on
+const char* const REGISTRATION_SECTIONS[] = {
+    "CALIBRATION_SETTINGS",
+    "OPENCV_KEYPOINT_DETECTION_SETTINGS",
+    "ORB_KEYPOINT_DETECTION_SETTINGS",
+    "ARUCO_SETTINGS",
+    "OPENCV_BILATERAL_FILTER_SETTINGS",
+    "STATISTICAL_OUTLIER_REMOVAL_FILTER_SETTINGS",
+    "ORGANIZED_OUTLIER_REMOVAL_FILTER_SETTINGS",
+    "MOVING_LEAST_SQUARES_FILTER_SETTINGS",
+    "NORMAL_ESTIMATION_SETTINGS",
+    "VOXEL_GRID_REDUCTION_SETTINGS",
+    "REGISTRATION_SETTINGS",
+    "KEYFRAME_SETTINGS",
+    "EDGE_BALANCER_SETTINGS",
+    "SAC_SETTINGS",
+    "TURNTABLE_SETTINGS",
+    "ICP_SETTINGS",
+    "DENSE_ICP_SETTINGS",
+    "MODEL_TRACKING_SETTINGS",
+    "POSE_GRAPH_SETTINGS",
+    "ELCH_SETTINGS",
+    "LOOP_CLOSURE_SETTINGS"
+};
+
+//project.ini groups the registered poses depend on, memory budgets and prefetching only change the pace
+const char* const REGISTRATION_GROUPS[] = {
+    "READING_SETTING",
+    "ALGORITHM_SETTINGS",
+    "PIPELINE_SETTINGS"
+};
+
+bool is_pace_key(const QString& key)
+{
+    return key == "PREFETCH_SIZE" || key == "ENABLE_IN_VISUALIZATION" || key.endsWith("_MEMORY_MB");
+}
+
+template <typename T>
+void write_value(QByteArray& buffer, const T& value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), int(sizeof(T)));
+}
+
+template <typename T>
+void write_array(QByteArray& buffer, const T* data, const size_t& count)
+{
+    write_value(buffer, uint32_t(count));
+    buffer.append(reinterpret_cast<const char*>(data), int(count * sizeof(T)));
+}
+
+void write_matrices(QByteArray& buffer, const Matrix4fVector& matrices)
+{
+    write_value(buffer, uint32_t(matrices.size()));
+    for (const Eigen::Matrix4f& matrix : matrices) {
+        buffer.append(reinterpret_cast<const char*>(matrix.data()), int(16 * sizeof(float)));
+    }
+}
+
+class Reader {
+public:
+    explicit Reader(const QByteArray& buffer_)
+        : buffer(buffer_)
+        , offset(0)
+    {
+    }
+
+    template <typename T>
+    bool value(T& result)
+    {
+        return bytes(&result, sizeof(T));
+    }
+
+    template <typename T>
+    bool array(std::vector<T>& result)
+    {
+        uint32_t count = 0;
+        if (!value(count) || size_t(buffer.size() - offset) < size_t(count) * sizeof(T)) {
+            return false;
+        }
+        result.resize(count);
+        return bytes(result.data(), count * sizeof(T));
+    }
+
+    bool matrices(Matrix4fVector& result)
+    {
+        uint32_t count = 0;
+        if (!value(count) || size_t(buffer.size() - offset) < size_t(count) * 16 * sizeof(float)) {
+            return false;
+        }
+        result.resize(count);
+        for (Eigen::Matrix4f& matrix : result) {
+            bytes(matrix.data(), 16 * sizeof(float));
+        }
+        return true;
+    }
+
+    bool keypoints(KeypointsFrame& result)
+    {
+        return keypoints_serialization::read(buffer, offset, result);
+    }
+
+    bool atEnd() const
+    {
+        return offset == size_t(buffer.size());
+    }
+
+private:
+    const QByteArray& buffer;
+    size_t offset;
+
+    bool bytes(void* result, const size_t& size)
+    {
+        if (size_t(buffer.size()) - offset < size) {
+            return false;
+        }
+        std::memcpy(result, buffer.constData() + offset, size);
+        offset += size;
+        return true;
+    }
+};
+
+uint64_t registration_hash(const ProjectSettings& project, const ScannerConfig& configs, const bool& skip_range_end)
+{
+    uint64_t result = hash::FNV_OFFSET_BASIS;
+    for (const char* section : REGISTRATION_SECTIONS) {
+        result = hash::fnv1a_value(configs.sectionHash(section), result);
+    }
+
+    for (const char* group : REGISTRATION_GROUPS) {
+        QStringList keys = project.childKeys(group);
+        keys.sort();
+        for (const QString& key : keys) {
+            if (is_pace_key(key) || (skip_range_end && QString(group) == "READING_SETTING" && key == "TO")) {
+                continue;
+            }
+            const QByteArray entry = (QString(group) + "/" + key + "=" + project.value(QString(group) + "/" + key).toString()).toUtf8();
+            result = hash::fnv1a(entry.constData(), size_t(entry.size()) + 1, result);
+        }
+    }
+
+    const QByteArray data_folder = project.value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString().toUtf8();
+    return hash::fnv1a(data_folder.constData(), size_t(data_folder.size()), result);
+}
+
+} // namespace
+
+uint64_t reconstruction_checkpoint::parameters_hash(const ProjectSettings& project, const ScannerConfig& configs)
+{
+    return registration_hash(project, configs, false);
+}
+
+uint64_t reconstruction_checkpoint::append_hash(const ProjectSettings& project, const ScannerConfig& configs)
+{
+    return registration_hash(project, configs, true);
+}
+
+QString reconstruction_checkpoint::checkpoint_filename(const ProjectSettings& project, const ScannerConfig& configs)
+{
+    if (!configs.value("CHECKPOINT_SETTINGS/ENABLE").toBool()) {
+        return QString();
+    }
+
+    return QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/"
+        + configs.value("CHECKPOINT_SETTINGS/FILE_NAME").toString();
+}
+
+bool reconstruction_checkpoint::save(const QString& filename, const Checkpoint& checkpoint)
+{
+    Header header;
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.parameters_hash = checkpoint.parameters_hash;
+    header.append_hash = checkpoint.append_hash;
+    header.loops_count = uint32_t(checkpoint.loops.size());
+
+    QByteArray buffer;
+    write_value(buffer, header);
+    for (const LoopRecord& loop : checkpoint.loops) {
+        write_array(buffer, loop.indexes.data(), loop.indexes.size());
+        write_matrices(buffer, loop.transformations);
+
+        write_value(buffer, uint32_t(loop.keypoints.size()));
+        for (const KeypointsFrame& keypoints : loop.keypoints) {
+            keypoints_serialization::append(buffer, keypoints);
+        }
+
+        write_value(buffer, uint8_t(loop.completed));
+        write_array(buffer, loop.frame_indexes.data(), loop.frame_indexes.size());
+        write_matrices(buffer, loop.inner_transformations);
+        write_array(buffer, loop.fitness_scores.data(), loop.fitness_scores.size());
+    }
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    return file.write(buffer) == qint64(buffer.size()) && file.commit();
+}
+
+bool reconstruction_checkpoint::load(
+    const QString& filename, const uint64_t& parameters_hash, Checkpoint& checkpoint, const bool& append)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray buffer = file.readAll();
+    Reader reader(buffer);
+
+    Header header;
+    if (!reader.value(header)
+        || std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CHECKPOINT_VERSION
+        || (append ? header.append_hash : header.parameters_hash) != parameters_hash) {
+        return false;
+    }
+
+    Checkpoint result;
+    result.parameters_hash = header.parameters_hash;
+    result.append_hash = header.append_hash;
+    result.loops.resize(header.loops_count);
+    for (LoopRecord& loop : result.loops) {
+        uint32_t keypoints_count = 0;
+        if (!reader.array(loop.indexes) || !reader.matrices(loop.transformations) || !reader.value(keypoints_count)) {
+            return false;
+        }
+
+        loop.keypoints.resize(keypoints_count);
+        for (KeypointsFrame& keypoints : loop.keypoints) {
+            if (!reader.keypoints(keypoints)) {
+                return false;
+            }
+        }
+
+        uint8_t completed = 0;
+        if (!reader.value(completed) || !reader.array(loop.frame_indexes)
+            || !reader.matrices(loop.inner_transformations) || !reader.array(loop.fitness_scores)) {
+            return false;
+        }
+        loop.completed = completed != 0;
+    }
+    if (!reader.atEnd()) {
+        return false;
+    }
+
+    checkpoint = std::move(result);
+    return true;
+}
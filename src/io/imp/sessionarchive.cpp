@@ -0,0 +1,336 @@
+#include "io/sessionarchive.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstring>
+
+#include "io/framecontainer.h"
+#include "io/frameindex.h"
+
+namespace {
+
+const char ARCHIVE_MAGIC[4] = { 'R', 'S', 'A', '1' };
+const char ARCHIVE_FOOTER_MAGIC[4] = { 'R', 'S', 'A', 'E' };
+const uint32_t ARCHIVE_VERSION = 1;
+const uint64_t ARCHIVE_ALIGNMENT = 8;
+
+#pragma pack(push, 1)
+struct ArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t reserved;
+};
+
+struct ArchiveFooter {
+    uint64_t table_offset;
+    uint64_t entries_count;
+    char magic[4];
+    uint32_t version;
+};
+#pragma pack(pop)
+
+} // namespace
+
+std::mutex SessionArchive::mutex;
+std::map<QString, SessionArchive::ConstPtr> SessionArchive::archives_map;
+std::set<QString> SessionArchive::pending_swaps;
+
+SessionArchive::SessionArchive(const QString& filename)
+    : file(filename)
+    , mapping(nullptr)
+    , mapping_size(0)
+    , timestamp(QFileInfo(filename).lastModified().toMSecsSinceEpoch())
+{
+}
+
+SessionArchive::~SessionArchive()
+{
+    if (mapping != nullptr) {
+        file.unmap(const_cast<uchar*>(mapping));
+    }
+}
+
+SessionArchive::ConstPtr SessionArchive::open(const QString& filename)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    swap_pending(filename);
+
+    const QFileInfo file_info(filename);
+    if (filename.isEmpty() || !file_info.exists()) {
+        archives_map.erase(filename);
+        return nullptr;
+    }
+
+    auto it = archives_map.find(filename);
+    if (it != archives_map.end() && it->second->timestamp == file_info.lastModified().toMSecsSinceEpoch()) {
+        return it->second;
+    }
+
+    std::shared_ptr<SessionArchive> archive(new SessionArchive(filename));
+    if (!archive->map_file()) {
+        qDebug() << "SessionArchive: can't open" << filename;
+        archives_map.erase(filename);
+        return nullptr;
+    }
+
+    archives_map[filename] = archive;
+    return archive;
+}
+
+QString SessionArchive::archive_filename(const ProjectSettings& project, const ScannerConfig* configs)
+{
+    const QString archive_name = configs->value("READING_PATTERNS_SETTINGS/SESSION_ARCHIVE_NAME").toString();
+    if (archive_name.isEmpty()) {
+        return QString();
+    }
+
+    return QFileInfo(project.fileName()).absolutePath() + "/" + archive_name;
+}
+
+bool SessionArchive::pack(const ProjectSettings& project, const ScannerConfig* configs)
+{
+    const QString filename = archive_filename(project, configs);
+    if (filename.isEmpty()) {
+        return false;
+    }
+
+    const QString data_folder = QFileInfo(project.fileName()).absolutePath() + "/"
+        + project.value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString();
+    const QString container_pattern = data_folder + "/"
+        + configs->value("READING_PATTERNS_SETTINGS/FRAME_CONTAINER_NAME").toString();
+    const QString cloud_pattern = data_folder + "/"
+        + configs->value("READING_PATTERNS_SETTINGS/POINT_CLOUD_NAME").toString();
+    const QString image_pattern = data_folder + "/"
+        + configs->value("READING_PATTERNS_SETTINGS/POINT_CLOUD_IMAGE_NAME").toString();
+    const int jpeg_quality = configs->value("OPENNI_SETTINGS/FRAME_CONTAINER_JPEG_QUALITY").toInt();
+
+    const QString tmp_filename = filename + ".tmp";
+    SessionArchiveWriter writer(tmp_filename);
+    bool success = writer.isOpen();
+
+    const FrameIndex::ConstPtr frame_index = FrameIndex::get(data_folder);
+    const std::vector<uint>& indexes = frame_index->getIndexes();
+    for (auto it = indexes.begin(); success && it != indexes.end(); ++it) {
+        const uint index = *it;
+        std::vector<char> container;
+
+        QFile container_file(container_pattern.arg(index));
+        if (container_file.open(QIODevice::ReadOnly)) {
+            const QByteArray data = container_file.readAll();
+            container.assign(data.constData(), data.constData() + data.size());
+        } else {
+            Frame frame;
+            if (!frame.load(cloud_pattern.arg(index), image_pattern.arg(index))) {
+                qDebug() << "SessionArchive: can't load frame #" << index;
+                continue;
+            }
+
+            const Pcd& cloud = *frame.pointCloudPtr;
+            cv::Mat depth_mm(cloud.height, cloud.width, CV_16UC1);
+            for (uint v = 0; v < cloud.height; ++v) {
+                ushort* depth_row = depth_mm.ptr<ushort>(v);
+                for (uint u = 0; u < cloud.width; ++u) {
+                    const float z = cloud.at(u, v).z;
+                    depth_row[u] = std::isfinite(z) ? cv::saturate_cast<ushort>(z * 1000.0f) : 0;
+                }
+            }
+
+            frame_container::encode(depth_mm, frame.pointCloudImage,
+                CameraIntrinsics::fromOrganizedCloud(cloud), jpeg_quality, container);
+        }
+
+        success = writer.append(index, container);
+    }
+
+    success = writer.close() && success;
+    if (!success) {
+        qDebug() << "SessionArchive: can't write" << tmp_filename;
+        QFile::remove(tmp_filename);
+        return false;
+    }
+
+    //Mapped readers keep the old file, it is replaced once the last of them is closed
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_swaps.insert(filename);
+    return swap_pending(filename) || pending_swaps.count(filename) != 0;
+}
+
+bool SessionArchive::swap_pending(const QString& filename)
+{
+    if (pending_swaps.count(filename) == 0) {
+        return false;
+    }
+
+    auto it = archives_map.find(filename);
+    if (it != archives_map.end()) {
+        if (it->second.use_count() > 1) {
+            return false;
+        }
+        archives_map.erase(it);
+    }
+    pending_swaps.erase(filename);
+
+    const QString tmp_filename = filename + ".tmp";
+    QFile::remove(filename);
+    if (!QFile::rename(tmp_filename, filename)) {
+        qDebug() << "SessionArchive: can't replace" << filename;
+        QFile::remove(tmp_filename);
+        return false;
+    }
+
+    return true;
+}
+
+const std::vector<uint>& SessionArchive::getIndexes() const
+{
+    return indexes;
+}
+
+bool SessionArchive::contains(const uint& frame_index) const
+{
+    return entries_map.find(frame_index) != entries_map.end();
+}
+
+const SessionArchive::Entry* SessionArchive::entry(const uint& frame_index) const
+{
+    auto it = entries_map.find(frame_index);
+    return it == entries_map.end() ? nullptr : &entries[it->second];
+}
+
+const char* SessionArchive::data(const Entry& entry) const
+{
+    return reinterpret_cast<const char*>(mapping + entry.offset);
+}
+
+bool SessionArchive::load(const uint& frame_index, Frame& frame) const
+{
+    const Entry* frame_entry = entry(frame_index);
+    if (frame_entry == nullptr) {
+        return false;
+    }
+
+    auto cloud = std::make_shared<Pcd>();
+    cv::Mat image;
+    if (!frame_container::decode(data(*frame_entry), frame_entry->size, *cloud, image) || cloud->empty()) {
+        return false;
+    }
+
+    frame.pointCloudImage = image;
+    frame.pointCloudPtr = cloud;
+    frame.setResolution(*cloud, image);
+    frame.pointCloudIndexes.clear();
+    frame.pointCloudNormalPcdPtr = std::make_shared<NormalPcd>();
+
+    return true;
+}
+
+bool SessionArchive::map_file()
+{
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(ArchiveHeader) + sizeof(ArchiveFooter))) {
+        return false;
+    }
+
+    mapping_size = file.size();
+    mapping = file.map(0, mapping_size);
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    ArchiveHeader header;
+    std::memcpy(&header, mapping, sizeof(ArchiveHeader));
+    ArchiveFooter footer;
+    std::memcpy(&footer, mapping + mapping_size - sizeof(ArchiveFooter), sizeof(ArchiveFooter));
+
+    if (std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0
+        || std::memcmp(footer.magic, ARCHIVE_FOOTER_MAGIC, sizeof(footer.magic)) != 0
+        || header.version != ARCHIVE_VERSION
+        || footer.table_offset + footer.entries_count * sizeof(Entry) + sizeof(ArchiveFooter) != uint64_t(mapping_size)) {
+        return false;
+    }
+
+    entries.resize(footer.entries_count);
+    std::memcpy(entries.data(), mapping + footer.table_offset, footer.entries_count * sizeof(Entry));
+
+    indexes.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].offset + entries[i].size > footer.table_offset) {
+            return false;
+        }
+        entries_map[entries[i].frame_index] = i;
+        indexes.push_back(entries[i].frame_index);
+    }
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+    return true;
+}
+
+SessionArchiveWriter::SessionArchiveWriter(const QString& filename)
+    : file(filename)
+{
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        ArchiveHeader header;
+        std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+        header.version = ARCHIVE_VERSION;
+        header.reserved = 0;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+}
+
+SessionArchiveWriter::~SessionArchiveWriter()
+{
+    close();
+}
+
+bool SessionArchiveWriter::isOpen() const
+{
+    return file.isOpen();
+}
+
+bool SessionArchiveWriter::append(const uint& frame_index, const std::vector<char>& container, const int64_t& timestamp)
+{
+    if (!file.isOpen() || container.empty()) {
+        return false;
+    }
+
+    const uint64_t padding = (ARCHIVE_ALIGNMENT - uint64_t(file.pos()) % ARCHIVE_ALIGNMENT) % ARCHIVE_ALIGNMENT;
+    const char zeros[ARCHIVE_ALIGNMENT] = {};
+    file.write(zeros, qint64(padding));
+
+    SessionArchive::Entry entry;
+    entry.frame_index = frame_index;
+    entry.reserved = 0;
+    entry.offset = uint64_t(file.pos());
+    entry.size = container.size();
+    entry.timestamp = timestamp;
+
+    if (file.write(container.data(), qint64(container.size())) != qint64(container.size())) {
+        return false;
+    }
+
+    entries.push_back(entry);
+    return true;
+}
+
+bool SessionArchiveWriter::close()
+{
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    ArchiveFooter footer;
+    footer.table_offset = uint64_t(file.pos());
+    footer.entries_count = entries.size();
+    std::memcpy(footer.magic, ARCHIVE_FOOTER_MAGIC, sizeof(footer.magic));
+    footer.version = ARCHIVE_VERSION;
+
+    const qint64 table_size = qint64(entries.size() * sizeof(SessionArchive::Entry));
+    const bool success = file.write(reinterpret_cast<const char*>(entries.data()), table_size) == table_size
+        && file.write(reinterpret_cast<const char*>(&footer), sizeof(footer)) == qint64(sizeof(footer));
+
+    file.close();
+    return success;
+}
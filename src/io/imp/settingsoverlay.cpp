@@ -0,0 +1,42 @@
+#include "io/settingsoverlay.h"
+
+#include <QSettings>
+#include <QStringList>
+
+namespace settings_overlay
+{
+
+bool write(QSettings& source, const QString& target_filename, const Values& values)
+{
+    QSettings target(target_filename, QSettings::IniFormat);
+    target.clear();
+    for (const QString& key : source.allKeys()) {
+        target.setValue(key, source.value(key));
+    }
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        target.setValue(it.key(), it.value());
+    }
+
+    target.sync();
+    return target.status() == QSettings::NoError;
+}
+
+void section(const ScannerConfig& configs, const QString& section, Values& configs_values, Values& project_values)
+{
+    configs_values.clear();
+    project_values.clear();
+
+    //ScannerConfig can't list its keys, the section is read from the file
+    const QString prefix = section + "/";
+    const QSettings ini(configs.fileName(), QSettings::IniFormat);
+    for (const QString& key : ini.allKeys()) {
+        if (!key.startsWith(prefix) || key.count('/') < 2) {
+            continue;
+        }
+
+        const QString target = key.mid(prefix.size());
+        (configs.contains(target) ? configs_values : project_values).insert(target, ini.value(key));
+    }
+}
+
+} // namespace settings_overlay
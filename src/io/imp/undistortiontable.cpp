@@ -0,0 +1,152 @@
+#include "io/undistortiontable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "utility/cpufeatures.h"
+
+#include <immintrin.h>
+
+namespace {
+
+typedef void (*SlotFunction)(const float*, const float*, const float*, const float*, float*, int);
+
+/** \brief correction = z >= start ? shift + slope * (z - start) : correction, over count pixels of one slot.
+  * SSE2 is a part of x86-64, four pixels per step.
+  */
+void apply_slot_sse(const float* z, const float* starts, const float* shifts, const float* slopes,
+    float* correction, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 depth = _mm_loadu_ps(z + i);
+        const __m128 start = _mm_loadu_ps(starts + i);
+        const __m128 segment = _mm_add_ps(_mm_loadu_ps(shifts + i), _mm_mul_ps(_mm_loadu_ps(slopes + i), _mm_sub_ps(depth, start)));
+        const __m128 inside = _mm_cmpge_ps(depth, start);
+        _mm_storeu_ps(correction + i, _mm_or_ps(_mm_and_ps(inside, segment), _mm_andnot_ps(inside, _mm_loadu_ps(correction + i))));
+    }
+    for (; i < count; ++i) {
+        const float segment = shifts[i] + slopes[i] * (z[i] - starts[i]);
+        correction[i] = z[i] >= starts[i] ? segment : correction[i];
+    }
+}
+
+//Eight pixels per step, the rest as with SSE
+CPU_TARGET("avx2")
+void apply_slot_avx2(const float* z, const float* starts, const float* shifts, const float* slopes,
+    float* correction, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 depth = _mm256_loadu_ps(z + i);
+        const __m256 start = _mm256_loadu_ps(starts + i);
+        const __m256 segment = _mm256_add_ps(_mm256_loadu_ps(shifts + i),
+            _mm256_mul_ps(_mm256_loadu_ps(slopes + i), _mm256_sub_ps(depth, start)));
+        const __m256 inside = _mm256_cmp_ps(depth, start, _CMP_GE_OQ);
+        _mm256_storeu_ps(correction + i, _mm256_blendv_ps(_mm256_loadu_ps(correction + i), segment, inside));
+    }
+    apply_slot_sse(z + i, starts + i, shifts + i, slopes + i, correction + i, count - i);
+}
+
+SlotFunction selected_apply_slot()
+{
+    static const SlotFunction selected = cpu_features::hasAvx2() ? apply_slot_avx2 : apply_slot_sse;
+    return selected;
+}
+
+} // namespace
+
+UndistortionTable::UndistortionTable(const CalibrationModel& model, const int& pixels_count_)
+    : slots_count(int(model.depths.size()))
+    , pixels_count(pixels_count_)
+    , starts(size_t(slots_count) * pixels_count, std::numeric_limits<float>::infinity())
+    , shifts(size_t(slots_count) * pixels_count, 0.0f)
+    , slopes(size_t(slots_count) * pixels_count, 0.0f)
+{
+    if (model.depths.size() != model.shifts.size()) {
+        throw std::invalid_argument("UndistortionTable::UndistortionTable depths.size() != shifts.size()");
+    }
+    for (int plane = 0; plane < slots_count; ++plane) {
+        if (int(model.depths[plane].size()) != pixels_count || int(model.shifts[plane].size()) != pixels_count) {
+            throw std::invalid_argument("UndistortionTable::UndistortionTable planes do not match pixels_count");
+        }
+    }
+
+    std::vector<std::pair<float, float> > samples;
+    for (int pixel = 0; pixel < pixels_count; ++pixel) {
+        samples.clear();
+        for (int plane = 0; plane < slots_count; ++plane) {
+            if (!std::isnan(model.depths[plane][pixel])) {
+                samples.push_back(std::make_pair(model.depths[plane][pixel], model.shifts[plane][pixel]));
+            }
+        }
+        std::stable_sort(samples.begin(), samples.end(),
+            [](const std::pair<float, float>& a, const std::pair<float, float>& b) { return a.first < b.first; });
+
+        for (size_t k = 0; k < samples.size(); ++k) {
+            const size_t slot = k * pixels_count + pixel;
+            starts[slot] = samples[k].first;
+            shifts[slot] = samples[k].second;
+            if (k + 1 < samples.size() && samples[k + 1].first > samples[k].first) {
+                slopes[slot] = (samples[k + 1].second - samples[k].second) / (samples[k + 1].first - samples[k].first);
+            }
+        }
+    }
+}
+
+bool UndistortionTable::empty() const
+{
+    return slots_count == 0;
+}
+
+int UndistortionTable::pixelsCount() const
+{
+    return pixels_count;
+}
+
+/** \brief Below the first plane the first shift holds, above the last plane the last one. The slots
+  * are sorted, so the last slot starting at or below the depth is the segment it lies in.
+  */
+void UndistortionTable::apply(float* depths, const size_t& stride, const int& first_pixel, const int& count,
+    const float& scale) const
+{
+    if (first_pixel < 0 || count < 0 || first_pixel + count > pixels_count) {
+        throw std::invalid_argument("UndistortionTable::apply pixels out of range");
+    }
+    if (slots_count == 0 || count == 0) {
+        return;
+    }
+
+    //Per thread, contiguous copies of the depths for the slot kernels
+    thread_local std::vector<float> z;
+    thread_local std::vector<float> correction;
+    z.resize(count);
+    correction.resize(count);
+
+    char* bytes = reinterpret_cast<char*>(depths);
+    for (int i = 0; i < count; ++i) {
+        z[i] = *reinterpret_cast<float*>(bytes + i * stride) * scale;
+    }
+
+    const float* first_shifts = shifts.data() + first_pixel;
+    for (int i = 0; i < count; ++i) {
+        correction[i] = first_shifts[i];
+    }
+
+    const SlotFunction apply_slot = selected_apply_slot();
+    for (int slot = 0; slot < slots_count; ++slot) {
+        const size_t offset = size_t(slot) * pixels_count + first_pixel;
+        apply_slot(z.data(), starts.data() + offset, shifts.data() + offset, slopes.data() + offset,
+            correction.data(), count);
+    }
+
+    const float inverse_scale = 1.0f / scale;
+    for (int i = 0; i < count; ++i) {
+        const float corrected = (z[i] - correction[i]) * inverse_scale;
+        float& depth = *reinterpret_cast<float*>(bytes + i * stride);
+        depth = z[i] > 0 ? corrected : depth;
+    }
+}
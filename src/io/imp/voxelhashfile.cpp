@@ -0,0 +1,150 @@
+#include "io/voxelhashfile.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "utility/threadpool.h"
+
+namespace {
+
+const char VOLUME_MAGIC[4] = { 'R', 'S', 'V', 'H' };
+const uint32_t VOLUME_VERSION = 1;
+
+const size_t BLOCK_BYTES = sizeof(VoxelHashVolume::Block);
+const size_t SAVE_CHUNK_BLOCKS = 4096;
+
+} // namespace
+
+bool voxel_hash_file::save(const QString& filename, const VoxelHashVolume& volume, const int& compression_level)
+{
+    const size_t count = volume.blocksCount();
+
+    //Paged out blocks are read serially, a chunk at a time, then the chunk is compressed in parallel
+    std::vector<QByteArray> payloads(compression_level > 0 ? count : 0);
+    std::vector<VoxelHashVolume::Block> chunk(std::min(count, SAVE_CHUNK_BLOCKS));
+    for (size_t begin = 0; begin < payloads.size(); begin += chunk.size()) {
+        const size_t end = std::min(payloads.size(), begin + chunk.size());
+        for (size_t i = begin; i < end; ++i) {
+            volume.readBlock(uint32_t(i), chunk[i - begin]);
+        }
+        ThreadPool::instance().parallel_for(begin, end, [&](size_t i) {
+            payloads[i] = qCompress(reinterpret_cast<const uchar*>(&chunk[i - begin]), int(BLOCK_BYTES),
+                std::min(9, compression_level));
+        });
+    }
+
+    Header header;
+    std::memcpy(header.magic, VOLUME_MAGIC, sizeof(header.magic));
+    header.version = VOLUME_VERSION;
+    header.voxel_size = volume.voxelSize();
+    header.truncation_distance = volume.truncationDistance();
+    header.max_weight = uint32_t(volume.maxWeight());
+    header.compressed = compression_level > 0;
+    header.blocks_count = count;
+
+    std::vector<IndexEntry> index(count);
+    uint64_t offset = sizeof(Header) + count * sizeof(IndexEntry);
+    for (size_t i = 0; i < count; ++i) {
+        const Eigen::Vector3i& coordinates = volume.blockCoordinates(uint32_t(i));
+        index[i].x = coordinates.x();
+        index[i].y = coordinates.y();
+        index[i].z = coordinates.z();
+        index[i].size = uint32_t(header.compressed ? payloads[i].size() : BLOCK_BYTES);
+        index[i].offset = offset;
+        offset += index[i].size;
+    }
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    bool written = file.write(reinterpret_cast<const char*>(&header), sizeof(Header)) == qint64(sizeof(Header))
+        && file.write(reinterpret_cast<const char*>(index.data()), qint64(count * sizeof(IndexEntry)))
+            == qint64(count * sizeof(IndexEntry));
+    VoxelHashVolume::Block block;
+    for (size_t i = 0; i < count && written; ++i) {
+        if (header.compressed) {
+            written = file.write(payloads[i]) == qint64(payloads[i].size());
+        } else {
+            volume.readBlock(uint32_t(i), block);
+            written = file.write(reinterpret_cast<const char*>(&block), qint64(BLOCK_BYTES)) == qint64(BLOCK_BYTES);
+        }
+    }
+
+    return written && file.commit();
+}
+
+VoxelHashVolume::Ptr voxel_hash_file::load(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || size_t(file.size()) < sizeof(Header)) {
+        return nullptr;
+    }
+
+    const uchar* data = file.map(0, file.size());
+    if (!data) {
+        return nullptr;
+    }
+    const uint64_t file_size = uint64_t(file.size());
+
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, VOLUME_MAGIC, sizeof(header.magic)) != 0
+        || header.version != VOLUME_VERSION
+        || header.blocks_count > (file_size - sizeof(Header)) / sizeof(IndexEntry)) {
+        return nullptr;
+    }
+
+    std::vector<IndexEntry> index(header.blocks_count);
+    std::memcpy(index.data(), data + sizeof(Header), index.size() * sizeof(IndexEntry));
+
+    //Payloads are decoded in parallel, then the blocks are inserted in their saved order
+    std::vector<VoxelHashVolume::Block> blocks(index.size());
+    std::atomic<bool> valid(true);
+    ThreadPool::instance().parallel_for(0, index.size(), [&](size_t i) {
+        const IndexEntry& entry = index[i];
+        if (entry.offset > file_size || entry.size > file_size - entry.offset) {
+            valid = false;
+            return;
+        }
+
+        if (!header.compressed) {
+            if (entry.size != BLOCK_BYTES) {
+                valid = false;
+                return;
+            }
+            std::memcpy(&blocks[i], data + entry.offset, BLOCK_BYTES);
+            return;
+        }
+
+        const QByteArray block = qUncompress(data + entry.offset, int(entry.size));
+        if (size_t(block.size()) != BLOCK_BYTES) {
+            valid = false;
+            return;
+        }
+        std::memcpy(&blocks[i], block.constData(), BLOCK_BYTES);
+    });
+    if (!valid) {
+        return nullptr;
+    }
+
+    VoxelHashVolume::Ptr volume;
+    try {
+        volume = std::make_shared<VoxelHashVolume>(header.voxel_size, header.truncation_distance, int(header.max_weight));
+    } catch (const std::invalid_argument&) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < index.size(); ++i) {
+        volume->setBlock(Eigen::Vector3i(index[i].x, index[i].y, index[i].z), blocks[i]);
+    }
+
+    return volume;
+}
@@ -0,0 +1,38 @@
+#ifndef KEYPOINTS_SERIALIZATION_H
+#define KEYPOINTS_SERIALIZATION_H
+
+#include <QByteArray>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Compact binary form of a keypoints frame for the files under io: both keypoint clouds as
+  * packed points and the correspondences between them. The normal clouds are not stored.
+  */
+namespace keypoints_serialization
+{
+
+#pragma pack(push, 1)
+struct PackedPoint
+{
+    float x;
+    float y;
+    float z;
+    uint32_t rgba;
+};
+
+struct PackedCorrespondence
+{
+    int32_t index_query;
+    int32_t index_match;
+    float distance;
+};
+#pragma pack(pop)
+
+void append(QByteArray& buffer, const KeypointsFrame& keypoints);
+
+/** \brief Reads the frame at offset and moves offset past it, fails on truncated data. */
+bool read(const QByteArray& buffer, size_t& offset, KeypointsFrame& keypoints);
+
+} // namespace keypoints_serialization
+
+#endif // KEYPOINTS_SERIALIZATION_H
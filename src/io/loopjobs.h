@@ -0,0 +1,56 @@
+#ifndef LOOP_JOBS_H
+#define LOOP_JOBS_H
+
+#include <QString>
+
+#include "core/base/projectsettings.h"
+#include "core/base/scannerconfig.h"
+#include "io/reconstructioncheckpoint.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/** \brief Loops of a reconstruction handed to worker processes through a folder on shared storage,
+  * configs.ini DISTRIBUTED_SETTINGS. Jobs and results are checkpoint files holding the record of one loop
+  * and the parameters hash of the coordinator, so a worker with other registration settings never takes
+  * a job. A worker claims a job by renaming it, only one rename of a file succeeds, and returns the
+  * completed record, optionally with the loop's TSDF sub-volume written before it.
+  */
+namespace loop_jobs
+{
+
+/** \brief Empty when distribution is disabled, relative folders are next to the project. */
+QString jobs_folder(const ProjectSettings& project, const ScannerConfig& configs);
+
+/** \brief Removes the jobs, claims, results and sub-volumes of an earlier run. */
+void clear(const QString& folder);
+
+bool write_job(const QString& folder, const size_t& index, const uint64_t& parameters_hash,
+    const reconstruction_checkpoint::LoopRecord& record);
+
+/** \brief Claims the job of the lowest index written with parameters_hash, false when none is left. */
+bool claim_job(const QString& folder, const uint64_t& parameters_hash, size_t& index,
+    reconstruction_checkpoint::LoopRecord& record);
+
+/** \brief Marks the claimed job failed, for the coordinator to process the loop itself. */
+void fail_job(const QString& folder, const size_t& index);
+
+/** \brief Removes the failed mark of the job, false when it is not marked failed. */
+bool take_failed_job(const QString& folder, const size_t& index);
+
+/** \brief Replaces the claim of the job, so the result is the only file left of the loop. */
+bool write_result(const QString& folder, const size_t& index, const uint64_t& parameters_hash,
+    const reconstruction_checkpoint::LoopRecord& record);
+
+/** \brief Fails while the loop is not completed. */
+bool load_result(const QString& folder, const size_t& index, const uint64_t& parameters_hash,
+    reconstruction_checkpoint::LoopRecord& record);
+
+QString volume_filename(const QString& folder, const size_t& index);
+
+/** \brief Claims older than timeout_seconds go back to the jobs, for workers that died. Returns their count. */
+size_t requeue_stale_claims(const QString& folder, const int& timeout_seconds);
+
+} // namespace loop_jobs
+
+#endif // LOOP_JOBS_H
@@ -2,6 +2,7 @@
 #define OPENNIINTERFACE_H
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QObject>
 #include <QSettings>
@@ -9,22 +10,55 @@
 
 #include <OpenNI.h>
 
+#include "core/base/cameraintrinsics.h"
 #include "core/base/scannertypes.h"
-#include "core/keypoints/arucokeypointdetector.h"
+#include "core/keypoints/arucostreamdetector.h"
+#include "io/capturering.h"
+#include "io/capturetelemetry.h"
+#include "io/depthaccumulator.h"
+#include "io/depthrays.h"
+#include "io/framecontainer.h"
+#include "io/framepool.h"
+#include "io/framewriter.h"
+#include "io/rawsession.h"
+#include "io/undistortiontable.h"
 #include "io/pclio.h"
+#include "utility/depthguidedfilter.h"
+#include "utility/depthplane.h"
 #include "utility/tools.h"
 
+class StreamingOdometry;
+
 class OpenNiInterface : public ScannerBase 
 {
     Q_OBJECT
 
 public:
+    /** \brief Raw sensor data of one depth and color frame pair. */
+    struct CaptureSlot
+    {
+        std::vector<openni::DepthPixel> depth;
+        std::vector<openni::RGB888Pixel> color;
+        //Sensor clocks, microseconds
+        uint64_t timestamp;
+        uint64_t color_timestamp;
+        CaptureTelemetry::Clock::time_point arrival;
+
+        explicit CaptureSlot(const size_t& pixels_count = size_t(resolution::DEFAULT_WIDTH) * resolution::DEFAULT_HEIGHT)
+            : depth(pixels_count)
+            , color(pixels_count)
+            , timestamp(0)
+            , color_timestamp(0)
+        {
+        }
+    };
+
     struct Frame 
     {
         typedef boost::shared_ptr<Frame> Ptr;
 
         QSettings* settings;
-        QSettings* configs;
+        const ScannerConfig* configs;
 
         openni::VideoFrameRef color_frame;
         openni::VideoFrameRef depth_frame;
@@ -34,33 +68,125 @@ public:
         std::vector<cv::Vec3f> world_coords;
 
         Pcd::Ptr point_cloud;
-
-        Frame(openni::VideoStream& colorStream, openni::VideoStream& depthStream, QSettings* settings_, QSettings* configs_)
+        CameraIntrinsics intrinsics;
+        /** \brief The depth stream's video mode, the color stream has the same. */
+        int width;
+        int height;
+        uint64_t depth_timestamp;
+        uint64_t color_timestamp;
+        CaptureTelemetry::Clock::time_point arrival;
+
+        /** \brief Frames come from the pool of the interface and are filled by read(), their buffers are
+          * kept from one read to the next.
+          */
+        Frame(QSettings* settings_, const ScannerConfig* configs_)
             : settings(settings_)
             , configs(configs_)
+            , width(0)
+            , height(0)
+            , depth_timestamp(0)
+            , color_timestamp(0)
+        {
+        }
+
+        void read(openni::VideoStream& colorStream, openni::VideoStream& depthStream)
         {
             colorStream.readFrame(&color_frame);
-            const openni::RGB888Pixel* color_buffer = (const openni::RGB888Pixel*)color_frame.getData();
+            depthStream.readFrame(&depth_frame);
+            arrival = CaptureTelemetry::Clock::now();
+            depth_timestamp = depth_frame.getTimestamp();
+            color_timestamp = color_frame.getTimestamp();
 
-            color_frame_mat.create(color_frame.getHeight(), color_frame.getWidth(), CV_8UC3);
-            memcpy(color_frame_mat.data, color_buffer, 3 * color_frame.getHeight() * color_frame.getWidth() * sizeof(uint8_t));
-            cv::cvtColor(color_frame_mat, color_frame_mat, CV_BGR2RGB);
+            const openni::VideoMode mode = depthStream.getVideoMode();
+            initialize((const openni::RGB888Pixel*)color_frame.getData(), (const openni::DepthPixel*)depth_frame.getData(),
+                mode.getResolutionX(), mode.getResolutionY(), depthStream.getHorizontalFieldOfView(), depthStream.getVerticalFieldOfView());
 
-            depthStream.readFrame(&depth_frame);
-            world_coords = depthpixels2world((openni::DepthPixel*)depth_frame.getData(), depthStream);
-            depth_frame_mat = world2mat(world_coords);
+            //Pooled frames must not hold on to the driver's buffers
+            color_frame.release();
+            depth_frame.release();
+        }
 
-            point_cloud = make_xyzrgb_pcd(world_coords, color_frame_mat);
+        /** \brief The slot in the mode and the fields of view of the depth stream, or of a replayed session. */
+        void read(const CaptureSlot& slot, const int& width_, const int& height_, const float& horizontal_fov, const float& vertical_fov)
+        {
+            arrival = slot.arrival;
+            depth_timestamp = slot.timestamp;
+            color_timestamp = slot.color_timestamp;
+            initialize(slot.color.data(), slot.depth.data(), width_, height_, horizontal_fov, vertical_fov);
         }
 
+        void initialize(const openni::RGB888Pixel* color_buffer, const openni::DepthPixel* depth_buffer,
+            const int& width_, const int& height_, const float& horizontal_fov, const float& vertical_fov)
+        {
+            width = width_;
+            height = height_;
+
+            color_frame_mat.create(height, width, CV_8UC3);
+            memcpy(color_frame_mat.data, color_buffer, 3 * size_t(height) * width * sizeof(uint8_t));
+            cv::cvtColor(color_frame_mat, color_frame_mat, CV_BGR2RGB);
+
+            intrinsics = CameraIntrinsics::fromFieldOfView(width, height, horizontal_fov, vertical_fov);
+            depthpixels2world(depth_buffer, horizontal_fov, vertical_fov, width, height, world_coords);
+        }
+
+        /** \brief Builds the cloud and the depth preview from world_coords and the color image, once the
+          * filters are done with them. The buffers are reused unless the cloud is shared already.
+          */
         void update_world_coords()
         {
-            depth_frame_mat = world2mat(world_coords);
-            point_cloud = make_xyzrgb_pcd(world_coords, color_frame_mat);
+            if (!point_cloud || !point_cloud.unique()) {
+                point_cloud.reset(new Pcd);
+            }
+            point_cloud->width = width;
+            point_cloud->height = height;
+            point_cloud->resize(size_t(width) * height);
+            depth_frame_mat.create(height, width, CV_8UC3);
+
+            //The cloud and the depth range in one pass, the preview needs the range before its colours
+            int min_depth = INT_MAX;
+            int max_depth = INT_MIN;
+            for (int y = 0; y < height; y++) {
+                const cv::Vec3f* coords_row = &world_coords[size_t(y) * width];
+                const cv::Vec3b* color_row = color_frame_mat.ptr<cv::Vec3b>(y);
+                PointType* points_row = &point_cloud->points[size_t(y) * width];
+                for (int x = 0; x < width; x++) {
+                    const cv::Vec3f& coords = coords_row[x];
+                    const int depth = int(coords[2]);
+                    min_depth = std::min(min_depth, depth);
+                    max_depth = std::max(max_depth, depth);
+
+                    PointType& point = points_row[x];
+                    point.x = coords[0];
+                    point.y = coords[1];
+                    point.z = coords[2] == 0 ? NAN : coords[2];
+                    point.r = color_row[x][2];
+                    point.g = color_row[x][1];
+                    point.b = color_row[x][0];
+                }
+            }
+
+            const float depth_range = float(max_depth - min_depth);
+            for (int y = 0; y < height; y++) {
+                const cv::Vec3f* coords_row = &world_coords[size_t(y) * width];
+                cv::Vec3b* preview_row = depth_frame_mat.ptr<cv::Vec3b>(y);
+                for (int x = 0; x < width; x++) {
+                    const uchar color = uchar(static_cast<int>(float(int(coords_row[x][2]) - min_depth) / depth_range * 255.f));
+                    preview_row[x] = cv::Vec3b(color, color, color);
+                }
+            }
         }
 
         void save(const uint& index)
         {
+            if (configs->value("OPENNI_SETTINGS/SAVE_FRAME_CONTAINER").toBool()) {
+                QString container_filename_pattern = QFileInfo(settings->fileName()).absolutePath() + "/"
+                    + settings->value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/"
+                    + configs->value("READING_PATTERNS_SETTINGS/FRAME_CONTAINER_NAME").toString();
+                frame_container::save(container_filename_pattern.arg(index), world2depth(world_coords, width, height),
+                    color_frame_mat, intrinsics, configs->value("OPENNI_SETTINGS/FRAME_CONTAINER_JPEG_QUALITY").toInt());
+                return;
+            }
+
             QString pcd_image_filename_pattern = QFileInfo(settings->fileName()).absolutePath() + "/"
                 + settings->value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/"
                 + configs->value("READING_PATTERNS_SETTINGS/POINT_CLOUD_IMAGE_NAME").toString();
@@ -72,86 +198,38 @@ public:
             pcl_io::save_one_point_cloud(pcd_filename_pattern.arg(index), point_cloud);
         }
 
-        static std::vector<cv::Vec3f> depthpixels2world(
+        /** \brief Into world_coords, resized to the mode and reused by the next call. */
+        static void depthpixels2world(
             const openni::DepthPixel* depthpixels,
-            const openni::VideoStream& depthStream)
-        {
-            std::vector<cv::Vec3f> world_coords;
-
-            for (int y = 0; y < HEIGHT; y++) {
-                for (int x = 0; x < WIDTH; x++) {
-                    cv::Vec3f world_coord;
-                    openni::CoordinateConverter::convertDepthToWorld(
-                        depthStream, x, y, depthpixels[x + y * WIDTH], &world_coord[0], &world_coord[1], &world_coord[2]);
-                    world_coords.push_back(world_coord);
-                }
-            }
-
-            return world_coords;
-        }
-
-        static cv::Mat world2mat(const std::vector<cv::Vec3f>& world_coords)
+            const float& horizontal_fov,
+            const float& vertical_fov,
+            const int& width,
+            const int& height,
+            std::vector<cv::Vec3f>& world_coords)
         {
-            cv::Mat depthFrameMat(cv::Size(WIDTH, HEIGHT), CV_8UC3);
-
-            int min_depth = INT_MAX;
-            int max_depth = INT_MIN;
-
-            for (int y = 0; y < HEIGHT; y++) 
-            {
-                for (int x = 0; x < WIDTH; x++) 
-                {
-                    int const val = world_coords[x + y * WIDTH][2];
-                    min_depth = std::min(min_depth, val);
-                    max_depth = std::max(max_depth, val);
-                }
-            }            
-            
-            for (int y = 0; y < HEIGHT; y++) 
-            {
-                for (int x = 0; x < WIDTH; x++) 
-                {
-                    int val = world_coords[x + y * WIDTH][2];
-                    
-                    int r = 0, g = 0, b = 0;
-                    int color = static_cast<int>(float(val - min_depth) / float(max_depth - min_depth) * 255.f);
-                    r = g = b = color;
-
-                    depthFrameMat.at<cv::Vec3b>(y, x)[0] = b;
-                    depthFrameMat.at<cv::Vec3b>(y, x)[1] = g;
-                    depthFrameMat.at<cv::Vec3b>(y, x)[2] = r;
-                }
-            }
+            static_assert(sizeof(cv::Vec3f) == 3 * sizeof(float), "depthpixels2world cv::Vec3f is not packed");
 
-            return depthFrameMat;
+            const DepthRays::ConstPtr rays = DepthRays::forMode(width, height, horizontal_fov, vertical_fov);
+            world_coords.resize(size_t(width) * height);
+            rays->apply(depthpixels, &world_coords[0][0]);
         }
 
-        static Pcd::Ptr make_xyzrgb_pcd(
-            const std::vector<cv::Vec3f>& world_coords,
-            const cv::Mat& color_frame_mat)
+        static cv::Mat world2depth(const std::vector<cv::Vec3f>& world_coords, const int& width, const int& height)
         {
-            Pcd::Ptr point_cloud(new Pcd);
-
-            point_cloud->width = WIDTH;
-            point_cloud->height = HEIGHT;
-            point_cloud->resize(WIDTH * HEIGHT);
-
-            for (int y = 0; y < HEIGHT; y++) {
-                for (int x = 0; x < WIDTH; x++) {
-                    const uint index = x + y * WIDTH;
-                    const double z_val = world_coords[index][2];
-
-                    point_cloud->at(x, y).z = z_val == 0 ? NAN : z_val;
-                    point_cloud->at(x, y).x = world_coords[index][0];
-                    point_cloud->at(x, y).y = world_coords[index][1];
-
-                    point_cloud->at(x, y).r = color_frame_mat.at<cv::Vec3b>(y, x)[2];
-                    point_cloud->at(x, y).g = color_frame_mat.at<cv::Vec3b>(y, x)[1];
-                    point_cloud->at(x, y).b = color_frame_mat.at<cv::Vec3b>(y, x)[0];
+            cv::Mat depth_mm(height, width, CV_16UC1);
+
+            resolution::dispatch(width, height, [&](const auto frame_width, const auto frame_height) {
+                for (int y = 0; y < int(frame_height); y++) {
+                    ushort* depth_row = depth_mm.ptr<ushort>(y);
+                    const cv::Vec3f* coords_row = &world_coords[size_t(y) * int(frame_width)];
+                    for (int x = 0; x < int(frame_width); x++) {
+                        const float z = coords_row[x][2];
+                        depth_row[x] = std::isnan(z) ? 0 : cv::saturate_cast<ushort>(z);
+                    }
                 }
-            }
+            });
 
-            return point_cloud;
+            return depth_mm;
         }
     };
     typedef std::deque<Frame::Ptr> Frames;
@@ -171,7 +249,28 @@ public:
 
     bool isInit();
 
+signals:
+    /** \brief The capture figures of the last report interval, see CaptureTelemetry. */
+    void signal_capture_telemetry(const QString& text);
+
 private:
+    /** \brief Runs on the OpenNI thread and only copies the sensor data into the capture ring. */
+    class CaptureListener : public openni::VideoStream::NewFrameListener
+    {
+    public:
+        /** \brief recorder, when given, gets every pair the sensor delivers, the ones the ring drops too. */
+        CaptureListener(openni::VideoStream& colorStream, CaptureRing<CaptureSlot>& ring, RawSessionWriter* recorder);
+
+        void onNewFrame(openni::VideoStream& depthStream) override;
+
+    private:
+        openni::VideoStream& colorStream;
+        CaptureRing<CaptureSlot>& ring;
+        RawSessionWriter* recorder;
+        openni::VideoFrameRef color_frame;
+        openni::VideoFrameRef depth_frame;
+    };
+
     bool stream_from_record;
     bool record_stream;
     bool stream_undistortion;
@@ -179,10 +278,13 @@ private:
     bool record_to_pcd_data;
 
     QSerialPort* serial;
+    //Started at the last command sent to the controller
+    QElapsedTimer rotation_timer;
     bool device_inited;
 
     cv::Mat calib_matrix;
     cv::Mat dist_coeffs;
+    UndistortionTable::ConstPtr depth_correction;
 
     openni::Device device;
     openni::Status rc;
@@ -193,23 +295,88 @@ private:
 
     Frames frames;
     uint max_frames_size;
+    /** \brief OPENNI_SETTINGS WIDTH x HEIGHT until the streams start, then the mode they run in. */
+    int width;
+    int height;
+    float horizontal_fov;
+    float vertical_fov;
+    std::unique_ptr<FrameWriter> writer;
+    std::unique_ptr<CaptureRing<CaptureSlot> > capture_ring;
+    std::unique_ptr<CaptureListener> capture_listener;
+    std::unique_ptr<FramePool<Frame> > frame_pool;
+    std::unique_ptr<CaptureTelemetry> telemetry;
+    QString telemetry_text;
+    //The newest processed frame not shown yet, the capture loop runs at the sensor rate between previews
+    Frame::Ptr preview_frame;
+    CaptureTelemetry::Clock::time_point last_preview;
+    std::unique_ptr<ArUcoStreamDetector> aruco_stream_detector;
+    std::unique_ptr<StreamingOdometry> odometry;
+
+    std::unique_ptr<DepthAccumulator> depth_accumulator;
+    CaptureSlot long_image_slot;
+
+    //OPENNI_SETTINGS/RAW_SESSION_FILE_NAME, recorded instead of the ONI file or replayed instead of the device
+    std::unique_ptr<RawSessionWriter> raw_recorder;
+    std::unique_ptr<RawSessionReader> raw_replay;
+    CaptureSlot stream_slot;
+
+    DepthPlane depth_plane;
+    DepthPlane filtered_depth_plane;
+    DepthGuidedFilter depth_guided_filter;
 
     void clearDataFolder();
 
+    /** \brief Switches the stream to the width x height mode of its pixel format, if the sensor has one. */
+    void select_video_mode(openni::VideoStream& stream) const;
+
     void load_calibration_data();
 
+    /** \brief nullptr at the end of a replay. */
     Frame::Ptr take_one_frame(const uint& frame_index);
 
+    void process_frame(const Frame::Ptr& frame, const uint& frame_index);
+
+    /** \brief The slots and the frame pool for the mode in width x height. */
+    void create_frame_buffers();
+
+    /** \brief The next pair of the raw session replayed, else of the streams, recorded to the raw session.
+      * False at the end of a replay that does not repeat.
+      */
+    bool read_stream_slot(CaptureSlot& slot);
+
+    static void copy_to_slot(const openni::VideoFrameRef& depth_frame, const openni::VideoFrameRef& color_frame, CaptureSlot& slot);
+
+    void update_telemetry(const Frame& frame);
+
+    /** \brief Shows the newest processed frame once the preview interval passed, else returns right away. */
+    void show_preview();
+
     Frame::Ptr take_one_optimized_image(const uint& number);
 
+    /** \brief Accumulates number depth frames, the sensor has to stand still only during this part. */
+    void expose_long_image(const uint& number);
+
+    /** \brief The average of the last exposure as a frame. */
+    Frame::Ptr finish_long_image();
+
     void initialize_rotation();
 
     void shutdown_rotation();
 
+    /** \brief Sends the command and returns, wait_for_rotation() waits for the motion to end. */
     void rotate(int angle);
 
+    /** \brief Waits for OPENNI_SETTINGS/ROTATION_ACK, or INIT_PAUSE_TIME from the command without acknowledgements. */
+    void wait_for_rotation();
+
+    /** \brief True once the controller sent the expected line, any line for an empty one, within timeout_ms of rotation_timer. */
+    bool wait_for_controller(const QByteArray& expected, const qint64& timeout_ms);
+
     void apply_undistortion(std::vector<cv::Vec3f>& world_coords);
 
+    /** \brief The calibration model depth correction PcdFilters applies, on the millimeter depths. */
+    void apply_depth_correction(std::vector<cv::Vec3f>& world_coords);
+
     void apply_bilateral_filter(std::vector<cv::Vec3f>& world_coords);
 };
 
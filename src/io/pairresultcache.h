@@ -0,0 +1,65 @@
+#ifndef PAIR_RESULT_CACHE_H
+#define PAIR_RESULT_CACHE_H
+
+#include <QString>
+
+#include "core/base/projectsettings.h"
+#include "core/base/scannerconfig.h"
+#include "core/base/scannertypes.h"
+#include "core/keypoints/keypointbudget.h"
+
+/** \brief Results of the pair stages kept on disk across runs, one file per result named by its key.
+  * Keys are content addressed: hashes of the frames, the stage settings and the initial transformation,
+  * so a rerun with other settings only recomputes the stages those settings reach.
+  */
+namespace pair_result_cache
+{
+
+#pragma pack(push, 1)
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+};
+
+/** \brief Keypoint budget counts of the pair, after its keypoints. */
+struct PackedBudgetReport
+{
+    uint64_t budgeted;
+    uint64_t inliers;
+};
+
+struct PackedRegistration
+{
+    float transformation[16];
+    float fitness_score;
+};
+#pragma pack(pop)
+
+/** \brief Empty when the cache is disabled. */
+QString cache_folder(const ProjectSettings& project, const ScannerConfig& configs);
+
+/** \brief Hash of the cloud, the image and the pose of the frame. */
+uint64_t frame_hash(const Frame& frame, const uint64_t& seed);
+
+uint64_t keypoints_hash(const KeypointsFrame& keypoints, const uint64_t& seed);
+
+uint64_t transformation_hash(const Eigen::Matrix4f& transformation, const uint64_t& seed);
+
+/** \brief The keypoints with what the pair reported to its keypoint budget, so a replayed pair reports it again. */
+bool save_keypoints(const QString& folder, const uint64_t& key, const KeypointsFrame& keypoints,
+    const keypoint_budget::Report& budget_report);
+
+bool load_keypoints(const QString& folder, const uint64_t& key, KeypointsFrame& keypoints,
+    keypoint_budget::Report& budget_report);
+
+bool save_registration(
+    const QString& folder, const uint64_t& key, const Eigen::Matrix4f& transformation, const float& fitness_score);
+
+bool load_registration(
+    const QString& folder, const uint64_t& key, Eigen::Matrix4f& transformation, float& fitness_score);
+
+} // namespace pair_result_cache
+
+#endif // PAIR_RESULT_CACHE_H
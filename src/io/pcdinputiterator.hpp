@@ -1,69 +1,293 @@
 #ifndef PCD_INPUT_ITERATOR_H
 #define PCD_INPUT_ITERATOR_H
 
-#define BOOST_FILESYSTEM_VERSION 3
-#define BOOST_FILESYSTEM_NO_DEPRECATED
 #include <QDebug>
 #include <QFileInfo>
-#include <QSettings>
 #include <QDir>
-#include <boost/filesystem.hpp>
-#include <boost/regex.hpp>
+#include <algorithm>
 #include <iterator>
+#include <memory>
 
+#include "core/base/projectsettings.h"
+#include "core/base/scannerconfig.h"
 #include "core/base/scannertypes.h"
+#include "io/framecache.h"
+#include "utility/log.h"
+#include "utility/pcdfilters.h"
+#include "io/frameindex.h"
+#include "io/frameprefetcher.h"
+#include "io/sessionarchive.h"
+#include "utility/profiler.h"
+
+class PcdInputIterator;
+
+/** \brief Frame numbers of a reading range, resolved once against the session archive or the frame index.
+  * Copies and slices share the numbers, the frame source and the prefetcher, so size(), operator[] and
+  * slice() are O(1) and a range can be split between the workers of the thread pool. Every slice
+  * prefetches within itself, through a window of its own.
+  */
+class PcdFrameRange {
+    /** \brief Loads frames from the session archive when it exists, otherwise from
+      * frame containers or PCD and BMP pairs, through the shared frame cache.
+      * With READING_SETTING/DOWNSAMPLE the frames are read at 1 / DOWNSAMPLE of the resolution
+      * and cached apart from the full resolution ones.
+      */
+    struct FrameSource {
+        QString cloud_pattern;
+        QString image_pattern;
+        QString container_pattern;
+        SessionArchive::ConstPtr archive;
+        int downsample = 1;
+
+        QString source_id() const
+        {
+            return downsample > 1 ? cloud_pattern + QString("@%1").arg(downsample) : cloud_pattern;
+        }
+
+        Frame load(const uint& frame_index) const
+        {
+            return FrameCache::instance().get(source_id(), frame_index, [this](uint index) {
+                PROFILE_ZONE_INDEX("load_frame", int(index));
+                Frame frame;
+                const bool success = (archive && archive->load(index, frame))
+                    || frame.load(container_pattern.arg(index))
+                    || frame.load(cloud_pattern.arg(index), image_pattern.arg(index));
+                if (success) {
+                    LOG_DEBUG("io") << "Loading frame #" << index << ": Success";
+                    PcdFilters::downsample_frame(frame, downsample);
+                    frame.sourceId = source_id();
+                    frame.frameIndex = int(index);
+                    frame.track();
+                } else {
+                    LOG_WARNING("io") << "Loading frame #" << index << ": Error";
+                }
+
+                return frame;
+            });
+        }
+    };
 
-class PcdInputIterator : public std::iterator<std::bidirectional_iterator_tag, const Frame> {
 public:
-    PcdInputIterator()
-        : index(-1)
-        , configs(new QSettings("configs.ini", QSettings::IniFormat))
+    PcdFrameRange()
+        : first(0)
+        , last(0)
     {
     }
 
     //Note range is [from; to]
-    PcdInputIterator(QSettings* settings_, const uint& from_, const uint& to_, const uint& step_)
-        : settings(settings_)
-        , configs(new QSettings("configs.ini", QSettings::IniFormat))
-        , index(-1)
-        , from(from_)
-        , to(to_)
-        , step(step_)
+    PcdFrameRange(const ProjectSettings& project_, const uint& from_, const uint& to_, const uint& step_)
+        : first(0)
+        , last(0)
     {
-        if (to <= from || step > to - from) {
-            throw std::invalid_argument("PcdInputIterator (to <= from || step > to - from)");
+        if (to_ <= from_ || step_ > to_ - from_) {
+            throw std::invalid_argument("PcdFrameRange (to <= from || step > to - from)");
         }
 
-        if (settings == nullptr) {
-            throw std::invalid_argument("PcdInputIterator settings == nullptr");
+        std::shared_ptr<State> new_state = std::make_shared<State>();
+        new_state->project = project_;
+        new_state->from = from_;
+        new_state->to = to_;
+        new_state->step = step_;
+
+        initialize_range(*new_state);
+        initialize_filename_patterns(*new_state);
+        initialize_prefetcher(*new_state);
+
+        last = new_state->indexes.size();
+        state = new_state;
+        if (state->prefetcher) {
+            prefetch_reader = FramePrefetcher::addReader(state->prefetcher);
         }
+    }
+
+    size_t size() const
+    {
+        return last - first;
+    }
 
-        initialize_range();
-        initialize_filename_patterns();
+    bool empty() const
+    {
+        return first == last;
+    }
 
-        ++(*this);
+    /** \brief Frame at position of this range, taken from the prefetcher when there is one. */
+    Frame operator[](const size_t& position) const
+    {
+        if (position >= size()) {
+            throw std::out_of_range("PcdFrameRange::operator[]");
+        }
+
+        if (state->prefetcher) {
+            return state->prefetcher->get(prefetch_reader, uint(first + position), uint(last));
+        }
+
+        return state->source.load(state->indexes[first + position]);
+    }
+
+    /** \brief Frame number at position, without loading the frame. */
+    uint frameIndex(const size_t& position) const
+    {
+        if (position >= size()) {
+            throw std::out_of_range("PcdFrameRange::frameIndex");
+        }
+
+        return state->indexes[first + position];
+    }
+
+    /** \brief count frames from position, clamped to the end of this range. */
+    PcdFrameRange slice(const size_t& position, const size_t& count) const
+    {
+        if (position > size()) {
+            throw std::out_of_range("PcdFrameRange::slice");
+        }
+
+        PcdFrameRange range(*this);
+        range.first = first + position;
+        range.last = first + position + std::min(count, size() - position);
+        if (state->prefetcher) {
+            range.prefetch_reader = FramePrefetcher::addReader(state->prefetcher);
+        }
+        return range;
+    }
+
+    uint getUpperBound() const
+    {
+        return state ? state->to : 0;
     }
 
-    uint getUpperBound()
+    uint getLowerBound() const
     {
-        return to;
+        return state ? state->from : 0;
+    }
+
+    PcdInputIterator begin() const;
+    PcdInputIterator end() const;
+
+private:
+    struct State {
+        ProjectSettings project;
+        ScannerConfig configs;
+        FrameSource source;
+        std::shared_ptr<FramePrefetcher> prefetcher;
+
+        std::vector<uint> indexes;
+
+        uint from;
+        uint to;
+        uint step;
+    };
+
+    std::shared_ptr<const State> state;
+    size_t first;
+    size_t last;
+    /** \brief Shared by the copies of a range, a slice reads through a new one. */
+    FramePrefetcher::Reader prefetch_reader;
+
+    friend class PcdInputIterator;
+
+    static void initialize_filename_patterns(State& state)
+    {
+        const QString data_folder_path = QFileInfo(state.project.fileName()).absolutePath() + "/"
+            + state.project.value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/";
+
+        state.source.cloud_pattern = data_folder_path + state.configs.value("READING_PATTERNS_SETTINGS/POINT_CLOUD_NAME").toString();
+        state.source.image_pattern = data_folder_path + state.configs.value("READING_PATTERNS_SETTINGS/POINT_CLOUD_IMAGE_NAME").toString();
+        state.source.container_pattern = data_folder_path + state.configs.value("READING_PATTERNS_SETTINGS/FRAME_CONTAINER_NAME").toString();
+        state.source.downsample = std::max(1, state.project.value("READING_SETTING/DOWNSAMPLE", 1).toInt());
+    }
+
+    static void initialize_prefetcher(State& state)
+    {
+        const uint prefetch_size = state.project.value("READING_SETTING/PREFETCH_SIZE").toUInt();
+        if (prefetch_size == 0 || state.indexes.empty()) {
+            return;
+        }
+
+        const FrameSource frame_source = state.source;
+        state.prefetcher = std::make_shared<FramePrefetcher>(
+            [frame_source](uint frame_index) {
+                return frame_source.load(frame_index);
+            },
+            state.indexes, prefetch_size);
     }
 
-    uint getLowerBound()
+    static void initialize_range(State& state)
     {
-        return from;
+        const QString data_folder_path = QFileInfo(state.project.fileName()).absolutePath() + "/"
+            + state.project.value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString();
+
+        state.source.archive = SessionArchive::open(SessionArchive::archive_filename(state.project, &state.configs));
+
+        const FrameIndex::ConstPtr frame_index = state.source.archive ? nullptr : FrameIndex::get(data_folder_path);
+        const std::vector<uint>& tmp_range = state.source.archive ? state.source.archive->getIndexes() : frame_index->getIndexes();
+
+        if (!tmp_range.empty()) {
+            if (state.from < tmp_range.front()) {
+                state.from = tmp_range.front();
+            }
+            if (state.to > tmp_range.back()) {
+                state.to = state.from;
+                while (state.to + state.step <= tmp_range.back()) {
+                    state.to += state.step;
+                }
+            }
+
+            //First index >= from and last index <= to
+            auto from_it = std::lower_bound(tmp_range.begin(), tmp_range.end(), state.from);
+            auto to_end = std::upper_bound(tmp_range.begin(), tmp_range.end(), state.to);
+
+            if (from_it < to_end) {
+                const auto to_it = to_end - 1;
+                for (; int(from_it - tmp_range.begin()) + state.step <= to_it - tmp_range.begin(); from_it += state.step) {
+                    state.indexes.push_back(*from_it);
+                }
+                state.indexes.push_back(*from_it);
+
+                state.from = state.indexes.front();
+                state.to = state.indexes.back();
+            }
+        }
+    }
+};
+
+/** \brief Random access iterator over a PcdFrameRange. A default constructed iterator is the end of any range. */
+class PcdInputIterator : public std::iterator<std::random_access_iterator_tag, const Frame, std::ptrdiff_t, const Frame*, Frame> {
+public:
+    PcdInputIterator()
+        : position(0)
+    {
+    }
+
+    //Note range is [from; to]
+    PcdInputIterator(const ProjectSettings& project_, const uint& from_, const uint& to_, const uint& step_)
+        : range(project_, from_, to_, step_)
+        , position(range.first)
+    {
+    }
+
+    PcdInputIterator(const PcdFrameRange& range_, const size_t& position_)
+        : range(range_)
+        , position(range_.first + std::min(position_, range_.size()))
+    {
+    }
+
+    uint getUpperBound() const
+    {
+        return range.getUpperBound();
+    }
+
+    uint getLowerBound() const
+    {
+        return range.getLowerBound();
     }
 
     bool operator==(const PcdInputIterator& it) const
     {
-        if ((range.size() != it.range.size()) && (!range.empty() && !it.range.empty())) {
+        if (range.state && it.range.state && range.state != it.range.state) {
             throw std::runtime_error("PcdInputIterator::operator== comparing different ranges!");
         }
 
-        const bool equal_indexes = index == it.index;
-        const bool both_end = (index == -1 && it.index == it.range.size()) || (it.index == -1 && index == range.size());
-
-        return both_end || equal_indexes;
+        return (*this - it) == 0;
     }
 
     bool operator!=(const PcdInputIterator& it) const
@@ -71,23 +295,44 @@ public:
         return !(*this == it);
     }
 
+    bool operator<(const PcdInputIterator& it) const
+    {
+        return (*this - it) < 0;
+    }
+
+    bool operator>(const PcdInputIterator& it) const
+    {
+        return it < *this;
+    }
+
+    bool operator<=(const PcdInputIterator& it) const
+    {
+        return !(it < *this);
+    }
+
+    bool operator>=(const PcdInputIterator& it) const
+    {
+        return !(*this < it);
+    }
+
     Frame operator*() const
     {
-        if (index == range.size()) {
+        if (is_end()) {
             throw std::range_error("PcdInputIterator::operator*()");
         }
 
-        Frame frame;
-        const bool success = frame.load(cloud_filename_pattern.arg(range[index]), image_filename_pattern.arg(range[index]));
-        qDebug() << "Loading frame #" << range[index] << (success ? ": Success" : ": Error");
+        return range[position - range.first];
+    }
 
-        return frame;
+    Frame operator[](const difference_type& offset) const
+    {
+        return *(*this + offset);
     }
 
     PcdInputIterator& operator++()
     {
-        if (index < int(range.size())) {
-            ++index;
+        if (!is_end()) {
+            ++position;
             return *this;
         }
 
@@ -97,14 +342,14 @@ public:
     PcdInputIterator operator++(int)
     {
         PcdInputIterator tmp(*this);
-        ++tmp;
+        ++(*this);
         return tmp;
     }
 
     PcdInputIterator& operator--()
     {
-        if (index > 0) {
-            --index;
+        if (range.state && position > range.first) {
+            --position;
             return *this;
         }
 
@@ -114,114 +359,69 @@ public:
     PcdInputIterator operator--(int)
     {
         PcdInputIterator tmp(*this);
-        ++tmp;
+        --(*this);
         return tmp;
     }
 
-private:
-    QSettings* settings;
-    QSettings* configs;
-    QString image_filename_pattern;
-    QString cloud_filename_pattern;
-
-    std::vector<uint> range;
-    int index;
-
-    uint from;
-    uint to;
-    uint step;
-
-    void initialize_filename_patterns()
+    PcdInputIterator& operator+=(const difference_type& offset)
     {
-        cloud_filename_pattern = QFileInfo(settings->fileName()).absolutePath() + "/"
-            + settings->value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/"
-            + configs->value("READING_PATTERNS_SETTINGS/POINT_CLOUD_NAME").toString();
+        const difference_type moved = difference_type(position) + offset;
+        if (!range.state || moved < difference_type(range.first) || moved > difference_type(range.last)) {
+            throw std::out_of_range("PcdInputIterator::operator+=");
+        }
 
-        image_filename_pattern = QFileInfo(settings->fileName()).absolutePath() + "/"
-            + settings->value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString() + "/"
-            + configs->value("READING_PATTERNS_SETTINGS/POINT_CLOUD_IMAGE_NAME").toString();
+        position = size_t(moved);
+        return *this;
     }
 
-    void get_all(
-        const boost::filesystem::path& root,
-        const string& ext,
-        vector<boost::filesystem::path>& ret)
+    PcdInputIterator& operator-=(const difference_type& offset)
     {
-        if (!boost::filesystem::exists(root) || !boost::filesystem::is_directory(root))
-            return;
-
-        for (auto& p : boost::filesystem::directory_iterator(root))
-        {
-            const bool is_regular_file = boost::filesystem::is_regular_file(p.path());
-            const bool same_extension = p.path().extension() == ext;
-            if (is_regular_file && same_extension)
-            {
-                ret.push_back(p.path().filename());
-            }
-        }
+        return *this += -offset;
     }
 
-    void initialize_range()
-    {        
-        std::vector<boost::filesystem::path> pcd_pathes, img_pathes;
-        boost::filesystem::path data_folder_path = QDir::toNativeSeparators(QFileInfo(settings->fileName()).absoluteDir().path()).toStdString();
-        const std::string pcd_folder_path = settings->value("PROJECT_SETTINGS/PCD_DATA_FOLDER").toString().toStdString();
-        data_folder_path /= pcd_folder_path;
+    PcdInputIterator operator+(const difference_type& offset) const
+    {
+        PcdInputIterator it(*this);
+        return it += offset;
+    }
 
-        get_all(data_folder_path, ".pcd", pcd_pathes);
-        get_all(data_folder_path, ".bmp", img_pathes);
+    PcdInputIterator operator-(const difference_type& offset) const
+    {
+        PcdInputIterator it(*this);
+        return it -= offset;
+    }
 
-        std::vector<uint> pcd_indexes, img_indexes;
-        boost::regex exp("(\\d+)");
-        for (uint i = 0; i < pcd_pathes.size(); ++i) {
-            boost::smatch match;
-            std::string filename = pcd_pathes[i].stem().string();
-            if (boost::regex_search(filename, match, exp)) {
-                std::string str(match[1]);
-                pcd_indexes.push_back(std::atoi(str.c_str()));
-            }
-        }
-        for (uint i = 0; i < img_pathes.size(); ++i) {
-            boost::smatch match;
-            std::string filename = img_pathes[i].stem().string();
-            if (boost::regex_search(filename, match, exp)) {
-                std::string str(match[1]);
-                img_indexes.push_back(std::atoi(str.c_str()));
-            }
-        }
+    /** \brief The default constructed end stands for the end of the other iterator's range. */
+    difference_type operator-(const PcdInputIterator& it) const
+    {
+        const size_t this_position = range.state ? position : it.range.last;
+        const size_t it_position = it.range.state ? it.position : range.last;
+        return difference_type(this_position) - difference_type(it_position);
+    }
 
-        std::vector<uint> tmp_range;
-        std::sort(pcd_indexes.begin(), pcd_indexes.end());
-        std::sort(img_indexes.begin(), img_indexes.end());
-        for (auto it = pcd_indexes.begin(); it != pcd_indexes.end(); ++it) {
-            if (std::find(img_indexes.begin(), img_indexes.end(), *it) != img_indexes.end()) {
-                tmp_range.push_back(*it);
-            }
-        }
+private:
+    PcdFrameRange range;
+    size_t position;
 
-        if (!tmp_range.empty()) {
-            if (from < tmp_range.front()) {
-                from = tmp_range.front();
-            }
-            if (to > tmp_range.back()) {
-                to = from;
-                while (to + step <= tmp_range.back()) {
-                    to += step;
-                }
-            }
+    bool is_end() const
+    {
+        return !range.state || position == range.last;
+    }
+};
 
-            auto from_it = std::find(tmp_range.begin(), tmp_range.end(), from);
-            auto to_it = std::find(tmp_range.begin(), tmp_range.end(), to);
+inline PcdInputIterator operator+(const PcdInputIterator::difference_type& offset, const PcdInputIterator& it)
+{
+    return it + offset;
+}
 
-            for (; int(from_it - tmp_range.begin()) + step <= to_it - tmp_range.begin(); from_it += step) {
-                range.push_back(*from_it);
-            }
-            range.push_back(*from_it);
+inline PcdInputIterator PcdFrameRange::begin() const
+{
+    return PcdInputIterator(*this, 0);
+}
 
-            from = range.front();
-            to = range.back();
-        }
-    }
-};
+inline PcdInputIterator PcdFrameRange::end() const
+{
+    return PcdInputIterator(*this, size());
+}
 
 #endif // PCD_INPUT_ITERATOR_H
@@ -7,40 +7,69 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/io/ply_io.h>
 
+#include "io/framewriter.h"
+
 namespace pcl_io 
 {
 
+/** \brief format is "ascii", "binary" or "binary_compressed", the last one falls back to binary for ply. */
 inline void save_one_point_cloud(
     const QString& filename,
-    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & point_cloud_ptr)
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & point_cloud_ptr,
+    const QString& format = "binary")
 {
     if (!filename.isEmpty()) {
         if (filename.contains(".pcd")) {
-            pcl::io::savePCDFileBinary(filename.toStdString(), *point_cloud_ptr);
+            if (format == "ascii") {
+                pcl::io::savePCDFileASCII(filename.toStdString(), *point_cloud_ptr);
+            } else if (format == "binary_compressed") {
+                pcl::io::savePCDFileBinaryCompressed(filename.toStdString(), *point_cloud_ptr);
+            } else {
+                pcl::io::savePCDFileBinary(filename.toStdString(), *point_cloud_ptr);
+            }
         }
         else if (filename.contains(".ply")) {
-            pcl::io::savePLYFileASCII(filename.toStdString(), *point_cloud_ptr);
+            if (format == "ascii") {
+                pcl::io::savePLYFileASCII(filename.toStdString(), *point_cloud_ptr);
+            } else {
+                pcl::io::savePLYFileBinary(filename.toStdString(), *point_cloud_ptr);
+            }
         }
     }
 }
 
 inline void save_one_polygon_mesh(
     const QString& filename,
-    const pcl::PolygonMesh& mesh)
+    const pcl::PolygonMesh& mesh,
+    const bool& binary = false)
 {
     if (!filename.isEmpty() && filename.contains(".ply")) {
-        pcl::io::savePLYFile(filename.toStdString(), mesh);
+        if (binary) {
+            pcl::io::savePLYFileBinary(filename.toStdString(), mesh);
+        } else {
+            pcl::io::savePLYFile(filename.toStdString(), mesh);
+        }
     }
 }
 
+/** \brief Saves the clouds through the caller's writer, built once from its settings, and waits for them.
+  * Blocks for space in the queue instead of dropping a cloud.
+  */
 inline void save_point_cloud_vector(
     const QString& filename_pattern,
-    const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr>& point_cloud_vector)
+    const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr>& point_cloud_vector,
+    FrameWriter& writer,
+    const QString& format = "binary")
 {
     if (!point_cloud_vector.empty() && !filename_pattern.isEmpty()) {
         for (int i = 0; i < point_cloud_vector.size(); i++) {
-            pcl_io::save_one_point_cloud((filename_pattern.arg(i)), (point_cloud_vector[i]));
+            const QString filename = filename_pattern.arg(i);
+            const pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_ptr = point_cloud_vector[i];
+            writer.enqueue([filename, point_cloud_ptr, format]() {
+                pcl_io::save_one_point_cloud(filename, point_cloud_ptr, format);
+            });
         }
+        writer.wait();
     }
 }
 
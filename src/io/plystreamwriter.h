@@ -0,0 +1,51 @@
+#ifndef PLY_STREAM_WRITER_H
+#define PLY_STREAM_WRITER_H
+
+#include <QFile>
+#include <QString>
+
+#include <pcl/Vertices.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+
+/** \brief Writes a binary little endian PLY mesh chunk by chunk.
+  * Vertices go straight to the file, faces are spooled to a side file and
+  * appended on close, when the element counts in the header are patched.
+  */
+class PlyStreamWriter {
+public:
+    explicit PlyStreamWriter(const QString& filename);
+    ~PlyStreamWriter();
+
+    PlyStreamWriter(const PlyStreamWriter&) = delete;
+    PlyStreamWriter& operator=(const PlyStreamWriter&) = delete;
+
+    bool isOpen() const;
+
+    /** \brief Returns the index of the first appended vertex. */
+    uint32_t appendVertices(const pcl::PointCloud<pcl::PointXYZRGB>& vertices);
+
+    void appendFaces(const std::vector<pcl::Vertices>& faces);
+
+    /** \brief Appends vertices where every consecutive triplet is one triangle. */
+    void appendTriangles(const pcl::PointCloud<pcl::PointXYZRGB>& vertices);
+
+    bool close();
+
+    uint32_t getVerticesCount() const;
+
+    uint32_t getFacesCount() const;
+
+private:
+    QFile file;
+    QFile faces_file;
+    uint32_t vertices_count;
+    uint32_t faces_count;
+    qint64 vertex_count_position;
+    qint64 face_count_position;
+    std::vector<char> buffer;
+};
+
+#endif // PLY_STREAM_WRITER_H
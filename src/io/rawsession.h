@@ -0,0 +1,103 @@
+#ifndef RAW_SESSION_H
+#define RAW_SESSION_H
+
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "io/framewriter.h"
+
+/** \brief Raw capture session file: a header with the sensor mode, then a record per depth and colour pair
+  * of zlib compressed uint16 depth, JPEG colour and the sensor timestamps. Nothing is converted at
+  * record time and a file cut short replays up to its last whole record.
+  */
+namespace raw_session
+{
+
+#pragma pack(push, 1)
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    float horizontal_fov;
+    float vertical_fov;
+    uint32_t fps;
+    uint32_t reserved;
+};
+
+struct Record {
+    uint32_t depth_size;
+    uint32_t color_size;
+    uint64_t depth_timestamp;
+    uint64_t color_timestamp;
+};
+#pragma pack(pop)
+
+} // namespace raw_session
+
+/** \brief Appends frame pairs at the sensor rate. append() only copies the pair, a writer thread of its own
+  * compresses and writes them in order, pairs are dropped and counted while its queue is full.
+  */
+class RawSessionWriter {
+public:
+    RawSessionWriter(const QString& filename, const raw_session::Header& mode, const int& jpeg_quality,
+        const int& compression_level, const size_t& max_queue_size);
+    ~RawSessionWriter();
+
+    RawSessionWriter(const RawSessionWriter&) = delete;
+    RawSessionWriter& operator=(const RawSessionWriter&) = delete;
+
+    bool isOpen() const;
+
+    /** \brief depth and rgb of pixels_count pixels, rgb in the RGB888 order of the sensor. False for fewer
+      * pixels than the mode has and for pairs dropped.
+      */
+    bool append(const uint16_t* depth, const uint8_t* rgb, const size_t& pixels_count,
+        const uint64_t& depth_timestamp, const uint64_t& color_timestamp);
+
+    /** \brief Waits for the queued pairs to be written. */
+    void flush();
+
+    size_t getWrittenCount() const;
+
+    size_t getDroppedCount() const;
+
+private:
+    QFile file;
+    const raw_session::Header mode;
+    const int jpeg_quality;
+    const int compression_level;
+    //Destroyed first, its last jobs still write to the file
+    std::unique_ptr<FrameWriter> writer;
+
+    void write(const std::vector<uint16_t>& depth, const std::vector<uint8_t>& rgb,
+        const uint64_t& depth_timestamp, const uint64_t& color_timestamp);
+};
+
+/** \brief Reads a session back as fast as it is asked for, with no pacing to the recorded rate. */
+class RawSessionReader {
+public:
+    explicit RawSessionReader(const QString& filename);
+
+    bool isOpen() const;
+
+    const raw_session::Header& getMode() const;
+
+    /** \brief The next pair into depth and rgb of width * height pixels, false at the end of the session. */
+    bool next(uint16_t* depth, uint8_t* rgb, uint64_t& depth_timestamp, uint64_t& color_timestamp);
+
+    /** \brief Back to the first pair. */
+    void rewind();
+
+private:
+    QFile file;
+    raw_session::Header mode;
+    QByteArray depth_data;
+    std::vector<uchar> color_data;
+};
+
+#endif // RAW_SESSION_H
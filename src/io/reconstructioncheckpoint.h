@@ -0,0 +1,84 @@
+#ifndef RECONSTRUCTION_CHECKPOINT_H
+#define RECONSTRUCTION_CHECKPOINT_H
+
+#include <QString>
+
+#include "core/base/projectsettings.h"
+#include "core/base/scannerconfig.h"
+#include "core/base/scannertypes.h"
+
+#include <vector>
+
+/** \brief Reconstruction state saved after the loops are prepared and after every completed loop,
+  * so an interrupted run resumes from the last completed loop. Stored with the hash of every setting
+  * the registration depends on, TSDF and visualization settings are left out so that they can be
+  * changed without registering the frames again.
+  */
+namespace reconstruction_checkpoint
+{
+
+#pragma pack(push, 1)
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t parameters_hash;
+    uint64_t append_hash;
+    uint32_t loops_count;
+};
+#pragma pack(pop)
+
+struct LoopRecord
+{
+    /** \brief State the algorithm prepared the loop with, its meaning is up to the algorithm. */
+    std::vector<uint> indexes;
+    Matrix4fVector transformations;
+    std::vector<KeypointsFrame> keypoints;
+
+    /** \brief Results, valid once the loop is completed. */
+    bool completed;
+    std::vector<int> frame_indexes;
+    Matrix4fVector inner_transformations;
+    std::vector<float> fitness_scores;
+
+    LoopRecord()
+        : completed(false)
+    {
+    }
+};
+
+/** \brief Loops appended with CHECKPOINT_SETTINGS/APPEND have no prepared indexes, a run resuming
+  * the prepared loops leaves them out.
+  */
+struct Checkpoint
+{
+    uint64_t parameters_hash;
+    uint64_t append_hash;
+    std::vector<LoopRecord> loops;
+
+    Checkpoint()
+        : parameters_hash(0)
+        , append_hash(0)
+    {
+    }
+};
+
+/** \brief Hash of the project and configs settings the registered poses depend on. */
+uint64_t parameters_hash(const ProjectSettings& project, const ScannerConfig& configs);
+
+/** \brief parameters_hash without READING_SETTING/TO, frames captured later may be appended to the run. */
+uint64_t append_hash(const ProjectSettings& project, const ScannerConfig& configs);
+
+/** \brief Empty when checkpoints are disabled. */
+QString checkpoint_filename(const ProjectSettings& project, const ScannerConfig& configs);
+
+bool save(const QString& filename, const Checkpoint& checkpoint);
+
+/** \brief Fails when the file is missing, damaged or written with other parameters.
+  * With append the hash is compared with the append_hash of the file.
+  */
+bool load(const QString& filename, const uint64_t& parameters_hash, Checkpoint& checkpoint, const bool& append = false);
+
+} // namespace reconstruction_checkpoint
+
+#endif // RECONSTRUCTION_CHECKPOINT_H
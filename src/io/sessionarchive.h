@@ -0,0 +1,96 @@
+#ifndef SESSION_ARCHIVE_H
+#define SESSION_ARCHIVE_H
+
+#include <QFile>
+#include <QString>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "core/base/projectsettings.h"
+#include "core/base/scannerconfig.h"
+#include "core/base/scannertypes.h"
+
+/** \brief Single file archive of frame containers with an offset table at the end.
+  * The file is memory mapped and frames are decoded straight from the mapping.
+  */
+class SessionArchive {
+public:
+    typedef std::shared_ptr<const SessionArchive> ConstPtr;
+
+    struct Entry {
+        uint32_t frame_index;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+        int64_t timestamp;
+    };
+
+    ~SessionArchive();
+
+    /** \brief Returns nullptr when the archive does not exist or is not valid. */
+    static ConstPtr open(const QString& filename);
+
+    static QString archive_filename(const ProjectSettings& project, const ScannerConfig* configs);
+
+    /** \brief Packs all frames of the project data folder into a temporary file next to the project session
+      * archive. The archive is replaced at once when no range reads it, otherwise on the first open after the
+      * last reader is closed. The temporary file is removed when packing fails.
+      */
+    static bool pack(const ProjectSettings& project, const ScannerConfig* configs);
+
+    const std::vector<uint>& getIndexes() const;
+
+    bool contains(const uint& frame_index) const;
+
+    bool load(const uint& frame_index, Frame& frame) const;
+
+    const Entry* entry(const uint& frame_index) const;
+
+    const char* data(const Entry& entry) const;
+
+private:
+    explicit SessionArchive(const QString& filename);
+
+    mutable QFile file;
+    const uchar* mapping;
+    qint64 mapping_size;
+    qint64 timestamp;
+
+    std::vector<Entry> entries;
+    std::vector<uint> indexes;
+    std::unordered_map<uint, size_t> entries_map;
+
+    static std::mutex mutex;
+    static std::map<QString, ConstPtr> archives_map;
+    /** \brief Archives packed into their temporary file and not swapped in yet. */
+    static std::set<QString> pending_swaps;
+
+    bool map_file();
+
+    /** \brief Replaces a pending archive by its temporary file when only archives_map holds it, under mutex. */
+    static bool swap_pending(const QString& filename);
+};
+
+/** \brief Appends encoded frame containers and writes the offset table on close. */
+class SessionArchiveWriter {
+public:
+    explicit SessionArchiveWriter(const QString& filename);
+    ~SessionArchiveWriter();
+
+    bool isOpen() const;
+
+    bool append(const uint& frame_index, const std::vector<char>& container, const int64_t& timestamp = 0);
+
+    bool close();
+
+private:
+    QFile file;
+    std::vector<SessionArchive::Entry> entries;
+};
+
+#endif // SESSION_ARCHIVE_H
@@ -0,0 +1,32 @@
+#ifndef SETTINGS_OVERLAY_H
+#define SETTINGS_OVERLAY_H
+
+#include <QMap>
+#include <QSettings>
+#include <QString>
+#include <QVariant>
+
+#include "core/base/scannerconfig.h"
+
+/** \brief Copies of configs.ini and project.ini with some values replaced, so a run with other parameters
+  * goes through the same code paths. A project copy belongs next to the project, so its folders are found
+  * as they are, and a configs.ini copy is published to new objects with ScannerConfig::reload().
+  */
+namespace settings_overlay
+{
+
+typedef QMap<QString, QVariant> Values;
+
+/** \brief Every key of source with values replaced by those of the same key. False when target_filename
+  * can't be written.
+  */
+bool write(QSettings& source, const QString& target_filename, const Values& values);
+
+/** \brief Keys of a configs.ini section written SECTION\KEY=value, as the SECTION/KEY they replace.
+  * Those configs.ini has go to configs_values, the others to project_values.
+  */
+void section(const ScannerConfig& configs, const QString& section, Values& configs_values, Values& project_values);
+
+} // namespace settings_overlay
+
+#endif // SETTINGS_OVERLAY_H
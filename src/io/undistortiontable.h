@@ -0,0 +1,42 @@
+#ifndef UNDISTORTION_TABLE_H
+#define UNDISTORTION_TABLE_H
+
+#include "io/calibrationmodel.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/** \brief Per pixel piecewise linear depth correction precomputed from a calibration model.
+  * Every pixel has one slot per calibration plane with the depth its segment starts at, the shift
+  * there and the slope to the next plane, sorted by depth and stored slot after slot over all pixels.
+  * Applying it takes one compare and select per slot and pixel, with no search and no branches.
+  */
+class UndistortionTable {
+public:
+    typedef std::shared_ptr<const UndistortionTable> ConstPtr;
+
+    UndistortionTable(const CalibrationModel& model, const int& pixels_count);
+
+    bool empty() const;
+
+    /** \brief Pixels of the sensor resolution the table was built for. */
+    int pixelsCount() const;
+
+    /** \brief Corrects count depths starting at pixel first_pixel, the depth of each next pixel is stride
+      * bytes further. Depths are in units of scale meters, NaN and missing, non positive, depths are left.
+      * The slots are applied with AVX2 when the CPU has it.
+      */
+    void apply(float* depths, const size_t& stride, const int& first_pixel, const int& count,
+        const float& scale = 1.0f) const;
+
+private:
+    int slots_count;
+    int pixels_count;
+    //Slot * pixels_count + pixel, unused slots start at infinity
+    std::vector<float> starts;
+    std::vector<float> shifts;
+    std::vector<float> slopes;
+};
+
+#endif // UNDISTORTION_TABLE_H
@@ -0,0 +1,47 @@
+#ifndef VOXEL_HASH_FILE_H
+#define VOXEL_HASH_FILE_H
+
+#include <QString>
+
+#include <cstdint>
+
+#include "core/reconstruction/voxelhashvolume.h"
+
+/** \brief Binary VoxelHashVolume file: a header, an index of the block coordinates with the offset
+  * and size of every block payload, then the payloads, each optionally compressed on its own.
+  * Loading maps the file and decodes the payloads in parallel straight from the mapping.
+  */
+namespace voxel_hash_file
+{
+
+#pragma pack(push, 1)
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    float voxel_size;
+    float truncation_distance;
+    uint32_t max_weight;
+    uint32_t compressed;
+    uint64_t blocks_count;
+};
+
+struct IndexEntry
+{
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    uint32_t size;
+    uint64_t offset;
+};
+#pragma pack(pop)
+
+/** \brief compression_level in [1, 9] compresses every block payload with qCompress, 0 stores them as is. */
+bool save(const QString& filename, const VoxelHashVolume& volume, const int& compression_level = 0);
+
+/** \brief nullptr when the file is missing or damaged. */
+VoxelHashVolume::Ptr load(const QString& filename);
+
+} // namespace voxel_hash_file
+
+#endif // VOXEL_HASH_FILE_H
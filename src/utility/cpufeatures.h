@@ -0,0 +1,21 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/** \brief Instruction sets of the running CPU, detected once and supported by the OS. */
+namespace cpu_features
+{
+
+bool hasAvx2();
+
+bool hasAvx512();
+
+} // namespace cpu_features
+
+/** \brief Lets a function use the instruction set without building the whole unit for it. */
+#if defined(_MSC_VER)
+#define CPU_TARGET(instruction_set)
+#else
+#define CPU_TARGET(instruction_set) __attribute__((target(instruction_set)))
+#endif
+
+#endif // CPU_FEATURES_H
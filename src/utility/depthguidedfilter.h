@@ -0,0 +1,32 @@
+#ifndef DEPTHGUIDEDFILTER_H
+#define DEPTHGUIDEDFILTER_H
+
+#include <opencv2/core/core.hpp>
+
+/** \brief Guided filter of a depth image guided by itself, edge preserving like cv::bilateralFilter but
+  * built from box filters, so the cost per pixel does not depend on the radius. Every mean is taken over
+  * the valid pixels of the window only, missing depth neither bleeds into its neighbours nor gets filled.
+  */
+class DepthGuidedFilter {
+public:
+    /** \brief depth is CV_32FC1 with NaN or 0 for missing pixels, filtered gets 0 there. radius in pixels,
+      * epsilon in squared depth units, the variance at which a window is smoothed to half, steps much
+      * deeper than its root are kept. Scratch images are members, reallocated only when the size changes.
+      */
+    void apply(const cv::Mat& depth, cv::Mat& filtered, const int& radius, const double& epsilon);
+
+private:
+    cv::Mat guide;
+    cv::Mat valid;
+    cv::Mat invalid;
+    cv::Mat weight;
+    cv::Mat mean;
+    cv::Mat mean_square;
+    cv::Mat a;
+    cv::Mat b;
+
+    /** \brief Box mean of source over the valid pixels of each window. */
+    void valid_mean(const cv::Mat& source, cv::Mat& target, const cv::Size& window) const;
+};
+
+#endif // DEPTHGUIDEDFILTER_H
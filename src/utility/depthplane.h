@@ -0,0 +1,46 @@
+#ifndef DEPTHPLANE_H
+#define DEPTHPLANE_H
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "core/base/scannertypes.h"
+
+/** \brief Contiguous single channel float image of the depth of an organized cloud or of stream
+  * world coordinates. The source points are wrapped as a multi channel cv::Mat header without
+  * copying, so the depth channel moves in and out with one vectorized mixChannels per direction.
+  */
+class DepthPlane {
+public:
+    /** \brief Header over the points, one channel per float of PointType. */
+    static cv::Mat view(Pcd& cloud);
+
+    /** \brief Header over the world coordinates, one channel per coordinate. */
+    static cv::Mat view(std::vector<cv::Vec3f>& world_coords, const int& width, const int& height);
+
+    void read(const Pcd& cloud);
+    void write(Pcd& cloud) const;
+
+    void read(const std::vector<cv::Vec3f>& world_coords, const int& width, const int& height);
+    void write(std::vector<cv::Vec3f>& world_coords) const;
+
+    /** \brief CV_32FC1, reallocated only when the size changes. */
+    inline cv::Mat& mat()
+    {
+        return plane;
+    }
+
+    inline const cv::Mat& mat() const
+    {
+        return plane;
+    }
+
+private:
+    cv::Mat plane;
+
+    void read_channel(const cv::Mat& source, const int& channel);
+    void write_channel(cv::Mat& target, const int& channel) const;
+};
+
+#endif // DEPTHPLANE_H
@@ -0,0 +1,66 @@
+#ifndef HALF_FLOAT_H
+#define HALF_FLOAT_H
+
+#include <cstdint>
+#include <cstring>
+
+/** \brief IEEE 754 binary16 conversions, round to nearest even. Subnormal halves flush to zero,
+  * which is far below the resolution of the values stored in them.
+  */
+namespace half_float
+{
+
+inline uint16_t fromFloat(const float& value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) {
+        return uint16_t(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    }
+
+    const int half_exponent = int(exponent) - 127 + 15;
+    if (half_exponent >= 0x1F) {
+        return uint16_t(sign | 0x7C00);
+    }
+    if (half_exponent <= 0) {
+        return uint16_t(sign);
+    }
+
+    //Round to nearest even on the 13 dropped bits, a carry into the exponent is still correct
+    uint32_t half = sign | (uint32_t(half_exponent) << 10) | (mantissa >> 13);
+    const uint32_t dropped = mantissa & 0x1FFF;
+    if (dropped > 0x1000 || (dropped == 0x1000 && (half & 1))) {
+        ++half;
+    }
+
+    return uint16_t(half);
+}
+
+inline float toFloat(const uint16_t& value)
+{
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        bits = sign;
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+} // namespace half_float
+
+#endif // HALF_FLOAT_H
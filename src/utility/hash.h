@@ -0,0 +1,33 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/** \brief 64 bit FNV-1a, stable across runs and platforms, good enough for cache keys. */
+namespace hash
+{
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+inline uint64_t fnv1a(const void* data, const size_t& size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        seed ^= bytes[i];
+        seed *= FNV_PRIME;
+    }
+
+    return seed;
+}
+
+template <typename T>
+inline uint64_t fnv1a_value(const T& value, const uint64_t& seed = FNV_OFFSET_BASIS)
+{
+    return fnv1a(&value, sizeof(T), seed);
+}
+
+} // namespace hash
+
+#endif // HASH_H
@@ -0,0 +1,72 @@
+#include "utility/cpufeatures.h"
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+
+struct Features {
+    bool avx2;
+    bool avx512;
+};
+
+#if defined(_MSC_VER)
+
+Features detect_features()
+{
+    Features features = { false, false };
+
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return features;
+    }
+
+    __cpuid(info, 1);
+    const bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28))
+        && (_xgetbv(0) & 0x6) == 0x6;
+    const bool os_saves_zmm = os_saves_ymm && (_xgetbv(0) & 0xe6) == 0xe6;
+
+    __cpuidex(info, 7, 0);
+    features.avx2 = os_saves_ymm && (info[1] & (1 << 5));
+    features.avx512 = os_saves_zmm && (info[1] & (1 << 16));
+
+    return features;
+}
+
+#else
+
+Features detect_features()
+{
+    __builtin_cpu_init();
+
+    Features features;
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512 = __builtin_cpu_supports("avx512f");
+
+    return features;
+}
+
+#endif
+
+const Features& features()
+{
+    static const Features detected = detect_features();
+    return detected;
+}
+
+} // namespace
+
+bool cpu_features::hasAvx2()
+{
+    return features().avx2;
+}
+
+bool cpu_features::hasAvx512()
+{
+    return features().avx512;
+}
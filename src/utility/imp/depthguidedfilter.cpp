@@ -0,0 +1,50 @@
+#include "utility/depthguidedfilter.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+void DepthGuidedFilter::apply(const cv::Mat& depth, cv::Mat& filtered, const int& radius, const double& epsilon)
+{
+    const cv::Size window(2 * std::max(1, radius) + 1, 2 * std::max(1, radius) + 1);
+
+    //NaN compares false, so both kinds of missing depth drop out of the mask
+    depth.copyTo(guide);
+    cv::patchNaNs(guide, 0);
+    cv::compare(guide, 0, valid, cv::CMP_GT);
+    cv::bitwise_not(valid, invalid);
+    guide.setTo(0, invalid);
+    valid.convertTo(weight, CV_32F, 1.0 / 255.0);
+
+    //Fraction of valid pixels per window, the normalisation of every following mean
+    cv::boxFilter(weight, weight, CV_32F, window);
+    cv::max(weight, 1e-6, weight);
+
+    valid_mean(guide, mean, window);
+    cv::multiply(guide, guide, mean_square);
+    valid_mean(mean_square, mean_square, window);
+
+    //Per window linear model, a = var / (var + epsilon) and b = (1 - a) * mean
+    cv::subtract(mean_square, mean.mul(mean), a);
+    cv::max(a, 0.0, a);
+    cv::add(a, std::max(epsilon, 1e-12), b);
+    cv::divide(a, b, a);
+    cv::subtract(mean, a.mul(mean), b);
+
+    //Models of the windows covering a pixel are averaged, the windows centred on missing depth carry none
+    a.setTo(0, invalid);
+    b.setTo(0, invalid);
+    valid_mean(a, a, window);
+    valid_mean(b, b, window);
+
+    filtered.create(depth.size(), CV_32FC1);
+    cv::multiply(a, guide, filtered);
+    cv::add(filtered, b, filtered);
+    filtered.setTo(0, invalid);
+}
+
+void DepthGuidedFilter::valid_mean(const cv::Mat& source, cv::Mat& target, const cv::Size& window) const
+{
+    cv::boxFilter(source, target, CV_32F, window);
+    cv::divide(target, weight, target);
+}
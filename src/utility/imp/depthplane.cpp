@@ -0,0 +1,73 @@
+#include "utility/depthplane.h"
+
+#include <cstddef>
+#include <stdexcept>
+
+namespace {
+
+const int POINT_CHANNELS = int(sizeof(PointType) / sizeof(float));
+const int POINT_Z_CHANNEL = int(offsetof(PointType, z) / sizeof(float));
+const int WORLD_Z_CHANNEL = 2;
+
+static_assert(sizeof(PointType) % sizeof(float) == 0, "PointType is not a whole number of floats");
+
+} // namespace
+
+cv::Mat DepthPlane::view(Pcd& cloud)
+{
+    if (!cloud.isOrganized()) {
+        throw std::invalid_argument("DepthPlane::view cloud is not organized");
+    }
+
+    return cv::Mat(int(cloud.height), int(cloud.width), CV_32FC(POINT_CHANNELS), cloud.points.data());
+}
+
+cv::Mat DepthPlane::view(std::vector<cv::Vec3f>& world_coords, const int& width, const int& height)
+{
+    if (world_coords.size() != size_t(width) * height) {
+        throw std::invalid_argument("DepthPlane::view world_coords.size() != width * height");
+    }
+
+    return cv::Mat(height, width, CV_32FC3, world_coords.data());
+}
+
+void DepthPlane::read(const Pcd& cloud)
+{
+    read_channel(view(const_cast<Pcd&>(cloud)), POINT_Z_CHANNEL);
+}
+
+void DepthPlane::write(Pcd& cloud) const
+{
+    cv::Mat target = view(cloud);
+    write_channel(target, POINT_Z_CHANNEL);
+}
+
+void DepthPlane::read(const std::vector<cv::Vec3f>& world_coords, const int& width, const int& height)
+{
+    read_channel(view(const_cast<std::vector<cv::Vec3f>&>(world_coords), width, height), WORLD_Z_CHANNEL);
+}
+
+void DepthPlane::write(std::vector<cv::Vec3f>& world_coords) const
+{
+    cv::Mat target = view(world_coords, plane.cols, plane.rows);
+    write_channel(target, WORLD_Z_CHANNEL);
+}
+
+//----------------------------------------------------
+
+void DepthPlane::read_channel(const cv::Mat& source, const int& channel)
+{
+    plane.create(source.rows, source.cols, CV_32FC1);
+    const int from_to[] = { channel, 0 };
+    cv::mixChannels(&source, 1, &plane, 1, from_to, 1);
+}
+
+void DepthPlane::write_channel(cv::Mat& target, const int& channel) const
+{
+    if (target.rows != plane.rows || target.cols != plane.cols) {
+        throw std::invalid_argument("DepthPlane::write_channel target size != plane size");
+    }
+
+    const int from_to[] = { 0, channel };
+    cv::mixChannels(&plane, 1, &target, 1, from_to, 1);
+}
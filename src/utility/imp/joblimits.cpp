@@ -0,0 +1,28 @@
+#include "utility/joblimits.h"
+
+namespace {
+
+thread_local job_limits::Limits thread_limits;
+
+} // namespace
+
+namespace job_limits
+{
+
+const Limits& current()
+{
+    return thread_limits;
+}
+
+Scope::Scope(const Limits& limits)
+    : previous(thread_limits)
+{
+    thread_limits = limits;
+}
+
+Scope::~Scope()
+{
+    thread_limits = previous;
+}
+
+} // namespace job_limits
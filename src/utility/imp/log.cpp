@@ -0,0 +1,311 @@
+#include "utility/log.h"
+
+#include <QtGlobal>
+#include <QStringList>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "core/base/scannerconfig.h"
+
+namespace {
+
+const char LEVEL_LETTERS[] = { 'T', 'D', 'I', 'W', 'E', 'O' };
+
+logging::Level parse_level(const QString& name, const logging::Level& default_level)
+{
+    static const char* NAMES[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "OFF" };
+    for (int level = logging::LEVEL_TRACE; level <= logging::LEVEL_OFF; ++level) {
+        if (name.trimmed().toUpper() == NAMES[level]) {
+            return logging::Level(level);
+        }
+    }
+
+    return default_level;
+}
+
+/** \brief Bounded multi producer queue of formatted records, a cell is claimed by an atomic increment
+  * and published by its sequence number, so producers never wait for each other or for the writer.
+  */
+class Sink {
+public:
+    Sink()
+        : async(configs().value("LOGGING/ASYNC").toBool())
+        , file(nullptr)
+        , cells_count(0)
+        , enqueue_position(0)
+        , dequeue_position(0)
+        , submitted(0)
+        , written(0)
+        , dropped(0)
+        , sleeping(false)
+        , stopping(false)
+    {
+        const QString filename = configs().value("LOGGING/FILENAME").toString();
+        if (!filename.isEmpty()) {
+            file = std::fopen(filename.toLocal8Bit().constData(), "ab");
+        }
+
+        if (async) {
+            size_t capacity = 1;
+            while (capacity < size_t(std::max(2, configs().value("LOGGING/QUEUE_SIZE").toInt()))) {
+                capacity <<= 1;
+            }
+            cells_count = capacity;
+            cells.reset(new Cell[capacity]);
+            for (size_t i = 0; i < capacity; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            writer = std::thread([this]() { write_records(); });
+        }
+    }
+
+    ~Sink()
+    {
+        if (writer.joinable()) {
+            stopping.store(true);
+            wake();
+            writer.join();
+        }
+        if (file) {
+            std::fclose(file);
+        }
+    }
+
+    static const ScannerConfig& configs()
+    {
+        static const ScannerConfig config;
+        return config;
+    }
+
+    void submit(QString&& text)
+    {
+        if (!async) {
+            std::lock_guard<std::mutex> lock(write_mutex);
+            write(text);
+            return;
+        }
+
+        const size_t mask = cells_count - 1;
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.text = std::move(text);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    submitted.fetch_add(1, std::memory_order_release);
+                    if (sleeping.load(std::memory_order_acquire)) {
+                        wake();
+                    }
+                    return;
+                }
+            } else if (sequence < position) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void flush()
+    {
+        if (!async) {
+            return;
+        }
+
+        const size_t target = submitted.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < target) {
+            wake();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        QString text;
+    };
+
+    const bool async;
+    FILE* file;
+    std::mutex write_mutex;
+
+    std::unique_ptr<Cell[]> cells;
+    size_t cells_count;
+    std::atomic<size_t> enqueue_position;
+    size_t dequeue_position;
+    std::atomic<size_t> submitted;
+    std::atomic<size_t> written;
+    std::atomic<size_t> dropped;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_condition;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stopping;
+    std::thread writer;
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_condition.notify_one();
+    }
+
+    bool pop(QString& text)
+    {
+        Cell& cell = cells[dequeue_position & (cells_count - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+            return false;
+        }
+
+        text = std::move(cell.text);
+        cell.text = QString();
+        cell.sequence.store(dequeue_position + cells_count, std::memory_order_release);
+        ++dequeue_position;
+        return true;
+    }
+
+    void write_records()
+    {
+        QString text;
+        for (;;) {
+            while (pop(text)) {
+                write(text);
+                written.fetch_add(1, std::memory_order_release);
+            }
+
+            const size_t dropped_count = dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped_count > 0) {
+                write(QString("W log: %1 messages dropped, the queue was full").arg(dropped_count));
+            }
+
+            //Stopping with the queue drained, a record published meanwhile is written first
+            if (stopping.load()) {
+                if (!pop(text)) {
+                    return;
+                }
+                write(text);
+                written.fetch_add(1, std::memory_order_release);
+                continue;
+            }
+
+            //The timeout covers a record published between the last pop and the sleeping flag
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            sleeping.store(true, std::memory_order_release);
+            wake_condition.wait_for(lock, std::chrono::milliseconds(10));
+            sleeping.store(false, std::memory_order_release);
+        }
+    }
+
+    void write(const QString& text)
+    {
+        const QByteArray bytes = text.toLocal8Bit();
+        if (file) {
+            std::fwrite(bytes.constData(), 1, size_t(bytes.size()), file);
+            std::fputc('\n', file);
+            std::fflush(file);
+        } else {
+            qDebug("%s", bytes.constData());
+        }
+    }
+};
+
+Sink& sink()
+{
+    static Sink instance;
+    return instance;
+}
+
+} // namespace
+
+namespace logging
+{
+
+Module::Module(const std::string& name, const Level& level)
+    : module_name(name)
+    , threshold(int(level))
+{
+}
+
+const std::string& Module::name() const
+{
+    return module_name;
+}
+
+void Module::setLevel(const Level& level)
+{
+    threshold.store(int(level), std::memory_order_relaxed);
+}
+
+Module& module(const char* name)
+{
+    static std::mutex modules_mutex;
+    static std::map<std::string, std::unique_ptr<Module> > modules;
+
+    std::lock_guard<std::mutex> lock(modules_mutex);
+    std::unique_ptr<Module>& result = modules[name];
+    if (!result) {
+        const ScannerConfig& configs = Sink::configs();
+        Level level = parse_level(configs.value("LOGGING/LEVEL").toString(), LEVEL_INFO);
+
+        //Entries as module:LEVEL
+        for (const QString& entry : configs.value("LOGGING/MODULES").toStringList()) {
+            const QStringList parts = entry.split(':');
+            if (parts.size() == 2 && parts[0].trimmed() == name) {
+                level = parse_level(parts[1], level);
+            }
+        }
+        result.reset(new Module(name, level));
+    }
+
+    return *result;
+}
+
+void flush()
+{
+    sink().flush();
+}
+
+Message::Message(const Level& level_, const Module& module_)
+    : level(level_)
+    , message_module(module_)
+    , stream(&text)
+{
+    stream << LEVEL_LETTERS[level] << ' ' << message_module.name().c_str() << ':';
+}
+
+Message::~Message()
+{
+    stream.flush();
+    sink().submit(std::move(text));
+}
+
+Message& Message::operator<<(const std::string& value)
+{
+    separate();
+    stream << value.c_str();
+    return *this;
+}
+
+Message& Message::operator<<(const bool& value)
+{
+    separate();
+    stream << (value ? "true" : "false");
+    return *this;
+}
+
+void Message::separate()
+{
+    //The module prefix ends with a colon, the first value is separated from it too
+    stream << ' ';
+}
+
+} // namespace logging
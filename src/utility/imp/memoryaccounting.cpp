@@ -0,0 +1,124 @@
+#include "utility/memoryaccounting.h"
+
+#include <atomic>
+#include <cstdio>
+
+#include "core/base/scannerconfig.h"
+
+namespace {
+
+const char* CATEGORY_NAMES[memory_accounting::CATEGORIES_COUNT] = {
+    "frames",
+    "keypoints_frames",
+    "frame_cache",
+    "loops",
+    "tsdf",
+};
+
+std::atomic<size_t> current_bytes[memory_accounting::CATEGORIES_COUNT];
+std::atomic<size_t> peak_bytes[memory_accounting::CATEGORIES_COUNT];
+std::atomic<size_t> peak_total_bytes(0);
+
+void raise_peak(std::atomic<size_t>& peak, const size_t& value)
+{
+    size_t previous = peak.load(std::memory_order_relaxed);
+    while (previous < value && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+    }
+}
+
+void update_peaks(const memory_accounting::Category& category, const size_t& value)
+{
+    raise_peak(peak_bytes[category], value);
+    raise_peak(peak_total_bytes, memory_accounting::total());
+}
+
+double megabytes(const size_t& bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+namespace memory_accounting
+{
+
+void add(const Category& category, const size_t& bytes)
+{
+    update_peaks(category, current_bytes[category].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void remove(const Category& category, const size_t& bytes)
+{
+    current_bytes[category].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void set(const Category& category, const size_t& bytes)
+{
+    current_bytes[category].store(bytes, std::memory_order_relaxed);
+    update_peaks(category, bytes);
+}
+
+size_t current(const Category& category)
+{
+    return current_bytes[category].load(std::memory_order_relaxed);
+}
+
+size_t peak(const Category& category)
+{
+    return peak_bytes[category].load(std::memory_order_relaxed);
+}
+
+size_t total()
+{
+    size_t result = 0;
+    for (int category = 0; category < CATEGORIES_COUNT; ++category) {
+        if (category != FRAME_CACHE) {
+            result += current_bytes[category].load(std::memory_order_relaxed);
+        }
+    }
+
+    return result;
+}
+
+size_t peakTotal()
+{
+    return peak_total_bytes.load(std::memory_order_relaxed);
+}
+
+void resetPeaks()
+{
+    for (int category = 0; category < CATEGORIES_COUNT; ++category) {
+        peak_bytes[category].store(current_bytes[category].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    peak_total_bytes.store(total(), std::memory_order_relaxed);
+}
+
+size_t budget()
+{
+    static const size_t bytes = size_t(ScannerConfig().value("MEMORY_SETTINGS/BUDGET_MB").toULongLong()) << 20;
+    return bytes;
+}
+
+size_t excess()
+{
+    const size_t limit = budget();
+    const size_t used = total();
+    return limit > 0 && used > limit ? used - limit : 0;
+}
+
+std::string jsonReport()
+{
+    std::string result = "[";
+    char line[256];
+    for (int category = 0; category < CATEGORIES_COUNT; ++category) {
+        std::snprintf(line, sizeof(line), "\n    { \"category\": \"%s\", \"mb\": %.2f, \"peak_mb\": %.2f },",
+            CATEGORY_NAMES[category], megabytes(current(Category(category))), megabytes(peak(Category(category))));
+        result += line;
+    }
+    std::snprintf(line, sizeof(line), "\n    { \"category\": \"total\", \"mb\": %.2f, \"peak_mb\": %.2f, \"budget_mb\": %.2f }",
+        megabytes(total()), megabytes(peakTotal()), megabytes(budget()));
+
+    return result + line + "\n  ]";
+}
+
+} // namespace memory_accounting
@@ -1,40 +1,50 @@
 #include "utility/pcdfilters.h"
 
-#include <pcl/filters/approximate_voxel_grid.h>
 #include <pcl/filters/statistical_outlier_removal.h>
-#include <pcl/filters/voxel_grid.h>
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/surface/mls.h>
 #include <pcl/search/kdtree.h>
 
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "core/base/framenormals.h"
 #include "io/calibrationinterface.h"
+#include "utility/log.h"
+#include "utility/profiler.h"
+#include "utility/threadpool.h"
 
 PcdFilters::PcdFilters(QObject* parent, QSettings* parent_settings)
     : ScannerBase(parent, parent_settings)
-    , undistortion(settings->value("PIPELINE_SETTINGS/UNDISTORTION").toBool())
-    , bilateral(settings->value("PIPELINE_SETTINGS/OPENCV_BILATERAL_FILTER").toBool())
-    , statistical(settings->value("PIPELINE_SETTINGS/STATISTICAL_OUTLIER_REMOVAL_FILTER").toBool())
-    , mls(settings->value("PIPELINE_SETTINGS/MOVING_LEAST_SQUARES_FILTER").toBool())
-    , voxel_grid(settings->value("PIPELINE_SETTINGS/VOXEL_GRID_REDUCTION").toBool())
+    , undistortion(project.value("PIPELINE_SETTINGS/UNDISTORTION").toBool())
+    , bilateral(project.value("PIPELINE_SETTINGS/OPENCV_BILATERAL_FILTER").toBool())
+    , guided(configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/METHOD").toString() == "GUIDED")
+    , statistical(project.value("PIPELINE_SETTINGS/STATISTICAL_OUTLIER_REMOVAL_FILTER").toBool())
+    , organized_statistical(project.value("PIPELINE_SETTINGS/ORGANIZED_OUTLIER_REMOVAL_FILTER").toBool())
+    , mls(project.value("PIPELINE_SETTINGS/MOVING_LEAST_SQUARES_FILTER").toBool())
+    , normals(project.value("PIPELINE_SETTINGS/NORMAL_ESTIMATION").toBool())
+    , voxel_grid(project.value("PIPELINE_SETTINGS/VOXEL_GRID_REDUCTION").toBool())
 {
 }
 
-void PcdFilters::setInput(const Frames& input_frames)
+void PcdFilters::setInput(Frames input_frames)
 {
-    frames = input_frames;
+    frames = std::move(input_frames);
 }
 
 void PcdFilters::filter(Frames& filtered_frames)
 {
     if (undistortion) {
         CalibrationInterface calibrationInterface(this, settings);
-        calibrationInterface.loadCalibrationData();
-        calibrationInterface.calibrate();
         calibrationInterface.undistort(frames);
     }
 
     filter_all_frames(frames);
-    reorganize_all_frames(frames);
 
     filtered_frames = frames;
 }
@@ -46,28 +56,31 @@ Frames PcdFilters::getFilteredFrames()
 
 void PcdFilters::filter_all_frames(Frames& frames)
 {
-    for (uint i = 0; i < frames.size(); ++i) {
+    reorganize_all_frames(frames);
+
+    ThreadPool::instance().parallel_for(0, frames.size(), [&](size_t i) {
         filter_one_frame(frames[i]);
-    }
+    });
 }
 
 void PcdFilters::reorganize_all_frames(Frames& frames)
 {
-    qDebug() << "Reorganization all point clouds";
+    LOG_INFO("filters") << "Reorganization all point clouds";
     for (uint i = 0; i < frames.size(); ++i) {
-        if (frames[i].pointCloudPtr->height == HEIGHT) {
+        const int width = frames[i].width;
+        const int height = frames[i].height;
+        if (int(frames[i].pointCloudPtr->height) == height) {
             continue;
         }
+        frames[i].detach();
 
         PcdPtr tmp_pcd_ptr(new Pcd);
-        tmp_pcd_ptr->width = WIDTH;
-        tmp_pcd_ptr->height = HEIGHT;
-        tmp_pcd_ptr->resize(HEIGHT * WIDTH);
+        tmp_pcd_ptr->width = width;
+        tmp_pcd_ptr->height = height;
+        tmp_pcd_ptr->resize(frames[i].pixelsCount());
 
-        for (int y = 0; y < HEIGHT; y++) {
-            for (int x = 0; x < WIDTH; x++) {
-                tmp_pcd_ptr->at(x, y).z = NAN;
-            }
+        for (auto& point : tmp_pcd_ptr->points) {
+            point.z = NAN;
         }
 
         for (int j = 0; j < frames[i].pointCloudPtr->size(); j++) {
@@ -77,122 +90,449 @@ void PcdFilters::reorganize_all_frames(Frames& frames)
         pcl::copyPointCloud(*tmp_pcd_ptr, *frames[i].pointCloudPtr);
         frames[i].pointCloudPtr->is_dense = false;
     }
-    qDebug() << "Done!";
+    LOG_INFO("filters") << "Done!";
 }
 
+/** \brief A block of factor x factor points keeps its first valid point, so no point is blended across
+  * depth edges, the image is area averaged to the same size.
+  */
+void PcdFilters::downsample_frame(Frame& frame, const int& factor)
+{
+    if (factor <= 1) {
+        return;
+    }
+
+    const Pcd& cloud = *frame.pointCloudPtr;
+    if (int(cloud.width) != frame.width || int(cloud.height) != frame.height) {
+        throw std::invalid_argument("PcdFilters::downsample_frame cloud is not organized");
+    }
+
+    const int width = frame.width / factor;
+    const int height = frame.height / factor;
+    if (width == 0 || height == 0) {
+        throw std::invalid_argument("PcdFilters::downsample_frame factor is larger than the frame");
+    }
+
+    PcdPtr downsampled(new Pcd);
+    downsampled->width = width;
+    downsampled->height = height;
+    downsampled->resize(size_t(width) * size_t(height));
+    downsampled->is_dense = false;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            PointType& point = downsampled->at(x, y);
+            point = cloud.at(x * factor, y * factor);
+            for (int i = 0; i < factor * factor && !std::isfinite(point.z); ++i) {
+                point = cloud.at(x * factor + i % factor, y * factor + i / factor);
+            }
+        }
+    }
+
+    if (!frame.pointCloudImage.empty()) {
+        cv::Mat image;
+        cv::resize(frame.pointCloudImage, image, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        frame.pointCloudImage = image;
+    }
+
+    frame.pointCloudPtr = downsampled;
+    frame.pointCloudIndexes.clear();
+    frame.pointCloudNormalPcdPtr = std::make_shared<NormalPcd>();
+    frame.derivedDataPtr = std::make_shared<FrameDerivedData>();
+    frame.width = width;
+    frame.height = height;
+}
+
+/** \brief Every filter works in place on the organized cloud, removed points become NaN, so the
+  * cloud never has to be compacted and reorganized. pointCloudIndexes lists the remaining points.
+  */
 void PcdFilters::filter_one_frame(Frame& frame)
 {
-    PcdPtr dest_point_cloud_ptr(new Pcd);
+    PROFILE_ZONE_INDEX("filter", frame.frameIndex);
+    frame.detach();
+    Pcd& cloud = *frame.pointCloudPtr;
+    if (int(cloud.width) != frame.width || int(cloud.height) != frame.height) {
+        throw std::invalid_argument("PcdFilters::filter_one_frame cloud is not organized");
+    }
+
+    const std::shared_ptr<FilterBuffers> buffers_lease = filter_buffers();
+    FilterBuffers& buffers = *buffers_lease;
 
     //Bilateral
-    if (bilateral) {
+    if (bilateral && guided) {
+        PROFILE_ZONE("guided");
+        const int radius = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/GUIDED_RADIUS").toInt();
+        const double epsilon = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/GUIDED_EPSILON").toDouble();
+        apply_guided_filter(cloud, buffers, radius, epsilon);
+    } else if (bilateral) {
+        PROFILE_ZONE("bilateral");
         const int d = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/D").toInt();
         const double sigma_color = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/SIGMA_COLOR").toDouble();
         const double sigma_space = configs.value("OPENCV_BILATERAL_FILTER_SETTINGS/SIGMA_SPACE").toDouble();
-        apply_bilateral_filter(frame.pointCloudPtr, d, sigma_color, sigma_space);
+        apply_bilateral_filter(cloud, buffers, d, sigma_color, sigma_space);
     }
 
-    pcl::removeNaNFromPointCloud(*frame.pointCloudPtr, *dest_point_cloud_ptr, frame.pointCloudIndexes);
+    collect_valid_indices(cloud, *buffers.valid_indices);
 
     //Statistic reduction
     if (statistical) {
+        PROFILE_ZONE("statistical_outlier_removal");
         const int meanK = configs.value("STATISTICAL_OUTLIER_REMOVAL_FILTER_SETTINGS/MEAN_K").toInt();
         const float stddevMulThresh = configs.value("STATISTICAL_OUTLIER_REMOVAL_FILTER_SETTINGS/MUL_THRESH").toFloat();
-        apply_statistical_outlier_removal_filter(dest_point_cloud_ptr, frame.pointCloudPtr, meanK, stddevMulThresh);
+        const size_t valid_count = buffers.valid_indices->size();
+        apply_statistical_outlier_removal_filter(frame.pointCloudPtr, buffers, meanK, stddevMulThresh);
 
         if (configs.value("STATISTICAL_OUTLIER_REMOVAL_FILTER_SETTINGS/ENABLE_LOG").toBool()) {
-            qDebug() << "Statistical removal: from" << dest_point_cloud_ptr->size() << "to" << frame.pointCloudPtr->size();
+            LOG_DEBUG("filters") << "Statistical removal: from" << valid_count << "to" << buffers.valid_indices->size();
         }
+    }
+
+    if (organized_statistical) {
+        PROFILE_ZONE("organized_outlier_removal");
+        const int window_radius = configs.value("ORGANIZED_OUTLIER_REMOVAL_FILTER_SETTINGS/WINDOW_RADIUS").toInt();
+        const int meanK = configs.value("ORGANIZED_OUTLIER_REMOVAL_FILTER_SETTINGS/MEAN_K").toInt();
+        const float stddevMulThresh = configs.value("ORGANIZED_OUTLIER_REMOVAL_FILTER_SETTINGS/MUL_THRESH").toFloat();
+        const size_t valid_count = buffers.valid_indices->size();
+        apply_organized_outlier_removal_filter(cloud, buffers, window_radius, meanK, stddevMulThresh);
 
-        pcl::copyPointCloud(*frame.pointCloudPtr, *dest_point_cloud_ptr);
+        if (configs.value("ORGANIZED_OUTLIER_REMOVAL_FILTER_SETTINGS/ENABLE_LOG").toBool()) {
+            LOG_DEBUG("filters") << "Organized statistical removal: from" << valid_count << "to" << buffers.valid_indices->size();
+        }
     }
 
     //Smooth
     if (mls) {
+        PROFILE_ZONE("moving_least_squares");
         const double sqrGaussParam = configs.value("MOVING_LEAST_SQUARES_FILTER_SETTINGS/SQR_GAUSS_PARAM").toDouble();
         const double searchRadius = configs.value("MOVING_LEAST_SQUARES_FILTER_SETTINGS/SEARCH_RADIUS").toDouble();
-        NormalPcdPtr smoothed_cloud(new NormalPcd);
-        apply_moving_least_squares_filter(dest_point_cloud_ptr, smoothed_cloud, sqrGaussParam, searchRadius);
-        pcl::copyPointCloud(*smoothed_cloud, *dest_point_cloud_ptr);
+        apply_moving_least_squares_filter(frame.pointCloudPtr, buffers, sqrGaussParam, searchRadius);
     }
 
-    pcl::copyPointCloud(*dest_point_cloud_ptr, *frame.pointCloudPtr);
+    //Normals, before the reduction thins the neighbourhoods out
+    if (normals) {
+        PROFILE_ZONE("normals");
+        const FrameNormals::Parameters parameters = FrameNormals::Parameters::fromConfigs(configs);
+        frame.pointCloudNormalPcdPtr = FrameNormals::build(frame.pointCloudPtr, parameters);
+    } else {
+        frame.pointCloudNormalPcdPtr = std::make_shared<NormalPcd>();
+    }
+
+    //Reduction
+    if (voxel_grid) {
+        PROFILE_ZONE("voxel_grid");
+        const float leaf_x = configs.value("VOXEL_GRID_REDUCTION_SETTINGS/LEAF_X").toFloat();
+        const float leaf_y = configs.value("VOXEL_GRID_REDUCTION_SETTINGS/LEAF_Y").toFloat();
+        const float leaf_z = configs.value("VOXEL_GRID_REDUCTION_SETTINGS/LEAF_Z").toFloat();
+        apply_voxel_grid_reduction(cloud, buffers, leaf_x, leaf_y, leaf_z);
+
+        if (normals) {
+            FrameNormals::syncPoints(*frame.pointCloudNormalPcdPtr, cloud);
+        }
+    }
+
+    frame.pointCloudIndexes.assign(buffers.valid_indices->begin(), buffers.valid_indices->end());
+    cloud.is_dense = false;
+    //Filtered in place, data derived from the old points no longer holds
+    frame.derivedDataPtr = std::make_shared<FrameDerivedData>();
 }
 
-void PcdFilters::apply_bilateral_filter(
-    PcdPtr& src_point_cloud_ptr,
-    const int& d,
-    const double& sigma_color,
-    const double& sigma_space)
+std::shared_ptr<PcdFilters::FilterBuffers> PcdFilters::filter_buffers()
 {
-    cv::Mat img, img_res;
-    img_res.create(HEIGHT, WIDTH, CV_32FC1);
-    img.create(HEIGHT, WIDTH, CV_32FC1);
+    static std::mutex mutex;
+    static std::vector<std::unique_ptr<FilterBuffers> > free_buffers;
 
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            img.at<float>(y, x)
-                = std::isnan((*src_point_cloud_ptr)[x + y * WIDTH].z) ? 0 : (*src_point_cloud_ptr)[x + y * WIDTH].z;
+    std::unique_ptr<FilterBuffers> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_buffers.empty()) {
+            buffers = std::move(free_buffers.back());
+            free_buffers.pop_back();
         }
     }
+    if (!buffers) {
+        buffers.reset(new FilterBuffers);
+    }
 
-    cv::bilateralFilter(img, img_res, d, sigma_color, sigma_space);
+    return std::shared_ptr<FilterBuffers>(buffers.release(), [](FilterBuffers* released) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_buffers.emplace_back(released);
+    });
+}
 
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            (*src_point_cloud_ptr)[x + y * WIDTH].z = img_res.at<float>(y, x) == 0 ? NAN : img_res.at<float>(y, x);
+void PcdFilters::collect_valid_indices(const Pcd& cloud, std::vector<int>& indices)
+{
+    indices.clear();
+    for (int i = 0; i < int(cloud.size()); ++i) {
+        if (pcl::isFinite(cloud[i])) {
+            indices.push_back(i);
         }
     }
 }
 
+void PcdFilters::invalidate(PointType& point)
+{
+    point.x = point.y = point.z = NAN;
+}
+
+void PcdFilters::apply_bilateral_filter(
+    Pcd& cloud,
+    FilterBuffers& buffers,
+    const int& d,
+    const double& sigma_color,
+    const double& sigma_space)
+{
+    //Missing depth is 0 for the filter and NaN for the cloud
+    buffers.depth.read(cloud);
+    cv::patchNaNs(buffers.depth.mat(), 0);
+
+    cv::bilateralFilter(buffers.depth.mat(), buffers.filtered_depth.mat(), d, sigma_color, sigma_space);
+
+    buffers.filtered_depth.mat().setTo(NAN, buffers.filtered_depth.mat() == 0);
+    buffers.filtered_depth.write(cloud);
+}
+
+void PcdFilters::apply_guided_filter(
+    Pcd& cloud,
+    FilterBuffers& buffers,
+    const int& radius,
+    const double& epsilon)
+{
+    buffers.depth.read(cloud);
+    buffers.guided.apply(buffers.depth.mat(), buffers.filtered_depth.mat(), radius, epsilon);
+
+    buffers.filtered_depth.mat().setTo(NAN, buffers.filtered_depth.mat() == 0);
+    buffers.filtered_depth.write(cloud);
+}
+
+/** \brief Only the valid points are searched, the outliers are invalidated in place. */
 void PcdFilters::apply_statistical_outlier_removal_filter(
-    PcdPtr& in_point_cloud_ptr,
-    PcdPtr& out_point_cloud_ptr,
+    const PcdPtr& point_cloud_ptr,
+    FilterBuffers& buffers,
     const int& meanK,
     const float& stddevMulThresh)
 {
     pcl::StatisticalOutlierRemoval<PointType> sor;
-    sor.setInputCloud(in_point_cloud_ptr);
-    sor.setKeepOrganized(true);
+    sor.setInputCloud(point_cloud_ptr);
+    sor.setIndices(buffers.valid_indices);
     sor.setMeanK(meanK);
     sor.setStddevMulThresh(stddevMulThresh);
-    sor.filter(*out_point_cloud_ptr);
+    sor.setNegative(true);
+    sor.filter(buffers.removed_indices);
+
+    for (const int& index : buffers.removed_indices) {
+        invalidate((*point_cloud_ptr)[index]);
+    }
+    collect_valid_indices(*point_cloud_ptr, *buffers.valid_indices);
 }
 
+/** \brief The mean distance to the meanK closest valid window neighbours is computed for every point,
+  * points above mean + stddevMulThresh * stddev of those are invalidated, as are points without neighbours.
+  */
+void PcdFilters::apply_organized_outlier_removal_filter(
+    Pcd& cloud,
+    FilterBuffers& buffers,
+    const int& window_radius,
+    const int& meanK,
+    const float& stddevMulThresh)
+{
+    const int radius = std::max(1, window_radius);
+    const int k = std::max(1, meanK);
+
+    //NaN marks points without valid neighbours
+    buffers.mean_distances.assign(cloud.size(), NAN);
+    std::vector<float>& mean_distances = buffers.mean_distances;
+
+    //Constant bounds for the common sensor modes
+    resolution::dispatch(int(cloud.width), int(cloud.height), [&](const auto width, const auto height) {
+        ThreadPool::instance().parallel_for(0, size_t(height), [&](size_t row) {
+            thread_local std::vector<float> distances;
+            const int y = int(row);
+
+            for (int x = 0; x < int(width); ++x) {
+                const PointType& point = cloud.points[x + y * int(width)];
+                if (!pcl::isFinite(point)) {
+                    continue;
+                }
+
+                distances.clear();
+                for (int ny = std::max(0, y - radius); ny <= std::min(int(height) - 1, y + radius); ++ny) {
+                    for (int nx = std::max(0, x - radius); nx <= std::min(int(width) - 1, x + radius); ++nx) {
+                        const PointType& neighbour = cloud.points[nx + ny * int(width)];
+                        if ((nx == x && ny == y) || !pcl::isFinite(neighbour)) {
+                            continue;
+                        }
+                        distances.push_back((neighbour.getVector3fMap() - point.getVector3fMap()).norm());
+                    }
+                }
+                if (distances.empty()) {
+                    continue;
+                }
+
+                const size_t count = std::min(distances.size(), size_t(k));
+                std::nth_element(distances.begin(), distances.begin() + (count - 1), distances.end());
+                double sum = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    sum += distances[i];
+                }
+                mean_distances[x + y * int(width)] = float(sum / count);
+            }
+        });
+    });
+
+    double sum = 0;
+    double sq_sum = 0;
+    int count = 0;
+    for (const float& distance : mean_distances) {
+        if (!std::isnan(distance)) {
+            sum += distance;
+            sq_sum += double(distance) * distance;
+            ++count;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+
+    const double mean = sum / count;
+    const double variance = count > 1 ? (sq_sum - sum * sum / count) / (count - 1) : 0;
+    const double threshold = mean + stddevMulThresh * std::sqrt(std::max(0.0, variance));
+
+    for (const int& index : *buffers.valid_indices) {
+        if (std::isnan(mean_distances[index]) || mean_distances[index] > threshold) {
+            invalidate(cloud[index]);
+        }
+    }
+    collect_valid_indices(cloud, *buffers.valid_indices);
+}
+
+/** \brief Smoothed points are written back to the pixels they came from, points the fit skipped are invalidated. */
 void PcdFilters::apply_moving_least_squares_filter(
-    PcdPtr& point_cloud_ptr_in,
-    pcl::PointCloud<pcl::PointNormal>::Ptr& point_cloud_ptr_out,
+    const PcdPtr& point_cloud_ptr,
+    FilterBuffers& buffers,
     const double& sqrGaussParam,
     const double& searchRadius)
 {
-    //ToDo: Test. It might not work due to absence of normal in input cloud!
     pcl::search::KdTree<PointType>::Ptr tree(new pcl::search::KdTree<PointType>);
-    pcl::PointCloud<pcl::PointNormal> mls_points;
 
     pcl::MovingLeastSquares<PointType, pcl::PointNormal> mls;
     mls.setComputeNormals(true);
-    mls.setInputCloud(point_cloud_ptr_in);
-    //mls.setPolynomialFit(true);
+    mls.setInputCloud(point_cloud_ptr);
+    mls.setIndices(buffers.valid_indices);
     mls.setSqrGaussParam(sqrGaussParam);
     mls.setSearchMethod(tree);
     mls.setSearchRadius(searchRadius);
-    mls.process(*point_cloud_ptr_out);
+    mls.process(buffers.smoothed);
+
+    const pcl::PointIndicesPtr corresponding_indices = mls.getCorrespondingIndices();
+    if (!corresponding_indices || corresponding_indices->indices.size() != buffers.smoothed.size()) {
+        throw std::runtime_error("PcdFilters::apply_moving_least_squares_filter smoothed points have no pixels");
+    }
+
+    for (const int& index : *buffers.valid_indices) {
+        invalidate((*point_cloud_ptr)[index]);
+    }
+    for (size_t i = 0; i < buffers.smoothed.size(); ++i) {
+        PointType& point = (*point_cloud_ptr)[corresponding_indices->indices[i]];
+        point.x = buffers.smoothed[i].x;
+        point.y = buffers.smoothed[i].y;
+        point.z = buffers.smoothed[i].z;
+    }
+    collect_valid_indices(*point_cloud_ptr, *buffers.valid_indices);
 }
 
 void PcdFilters::apply_voxel_grid_reduction(
-    PcdPtr& in_point_cloud_ptr,
-    PcdPtr& out_point_cloud_ptr,
+    Pcd& cloud,
+    FilterBuffers& buffers,
     const float& leaf_x,
     const float& leaf_y,
     const float& leaf_z)
 {
-    pcl::VoxelGrid<PointType> vg;
-    vg.setInputCloud(in_point_cloud_ptr);
-    vg.setLeafSize(leaf_x, leaf_y, leaf_z);
-    vg.filter(*out_point_cloud_ptr);
+    if (leaf_x <= 0 || leaf_y <= 0 || leaf_z <= 0) {
+        throw std::invalid_argument("PcdFilters::apply_voxel_grid_reduction leaf size <= 0");
+    }
+
+    //21 bits per voxel coordinate, about 20 km of range at 1 cm leafs
+    const std::vector<int>& valid_indices = *buffers.valid_indices;
+    std::vector<uint64_t>& keys = buffers.voxel_keys;
+    keys.resize(valid_indices.size());
+    ThreadPool::instance().parallel_for(0, valid_indices.size(), [&](size_t i) {
+        const PointType& point = cloud[valid_indices[i]];
+        const uint64_t x = uint64_t(int64_t(std::floor(point.x / leaf_x)) + (1 << 20)) & 0x1FFFFF;
+        const uint64_t y = uint64_t(int64_t(std::floor(point.y / leaf_y)) + (1 << 20)) & 0x1FFFFF;
+        const uint64_t z = uint64_t(int64_t(std::floor(point.z / leaf_z)) + (1 << 20)) & 0x1FFFFF;
+        keys[i] = x | (y << 21) | (z << 42);
+    });
+
+    struct Voxel {
+        double x, y, z;
+        uint32_t r, g, b;
+        uint32_t count;
+        int pixel;
+    };
+
+    //Every shard owns the voxels with its key remainder so the shards write disjoint pixels,
+    //the points of a shard keep their order so a voxel stays at its first pixel
+    const size_t shards_count = std::max<size_t>(1, ThreadPool::instance().size());
+    const auto shard_of = [shards_count](const uint64_t& key) {
+        return size_t((key * 0x9E3779B97F4A7C15ULL >> 32) % shards_count);
+    };
+    std::vector<size_t>& offsets = buffers.shard_offsets;
+    std::vector<size_t>& order = buffers.shard_order;
+    offsets.assign(shards_count + 1, 0);
+    for (const uint64_t& key : keys) {
+        ++offsets[shard_of(key) + 1];
+    }
+    for (size_t shard = 0; shard < shards_count; ++shard) {
+        offsets[shard + 1] += offsets[shard];
+    }
+    order.resize(keys.size());
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        order[next[shard_of(keys[i])]++] = i;
+    }
+
+    ThreadPool::instance().parallel_for(0, shards_count, [&](size_t shard) {
+        thread_local std::unordered_map<uint64_t, Voxel> voxels;
+        voxels.clear();
+
+        for (size_t j = offsets[shard]; j < offsets[shard + 1]; ++j) {
+            const size_t i = order[j];
+            const int pixel = valid_indices[i];
+            const PointType& point = cloud[pixel];
+
+            auto it = voxels.find(keys[i]);
+            if (it == voxels.end()) {
+                it = voxels.insert(std::make_pair(keys[i], Voxel { 0, 0, 0, 0, 0, 0, 0, pixel })).first;
+            }
+            Voxel& voxel = it->second;
+            voxel.x += point.x;
+            voxel.y += point.y;
+            voxel.z += point.z;
+            voxel.r += point.r;
+            voxel.g += point.g;
+            voxel.b += point.b;
+            ++voxel.count;
+            if (voxel.pixel != pixel) {
+                invalidate(cloud[pixel]);
+            }
+        }
+
+        for (const auto& entry : voxels) {
+            const Voxel& voxel = entry.second;
+            PointType& point = cloud[voxel.pixel];
+            point.x = float(voxel.x / voxel.count);
+            point.y = float(voxel.y / voxel.count);
+            point.z = float(voxel.z / voxel.count);
+            point.r = uint8_t(voxel.r / voxel.count);
+            point.g = uint8_t(voxel.g / voxel.count);
+            point.b = uint8_t(voxel.b / voxel.count);
+        }
+    });
+
+    const size_t valid_count = valid_indices.size();
+    collect_valid_indices(cloud, *buffers.valid_indices);
 
-    qDebug() << "Reduced from"
-             << in_point_cloud_ptr.get()->points.size()
-             << "to"
-             << out_point_cloud_ptr.get()->points.size();
+    LOG_DEBUG("filters") << "Reduced from"
+                         << valid_count
+                         << "to"
+                         << buffers.valid_indices->size();
 }
@@ -0,0 +1,85 @@
+#include "utility/pipeline.h"
+
+#include <atomic>
+#include <stdexcept>
+
+namespace pipeline
+{
+
+Graph::Graph()
+{
+}
+
+Graph::~Graph()
+{
+    //A graph that is not run to the end still stops its threads
+    for (const auto& queue : queues) {
+        queue->cancel();
+    }
+    join();
+}
+
+void Graph::run()
+{
+    if (!threads.empty()) {
+        throw std::logic_error("Graph::run !threads.empty()");
+    }
+
+    for (Stage& stage : stages) {
+        std::shared_ptr<std::atomic<size_t> > running = std::make_shared<std::atomic<size_t> >(stage.threads_count);
+        for (size_t i = 0; i < stage.threads_count; ++i) {
+            threads.emplace_back([this, &stage, running]() {
+                try {
+                    stage.work(stage.name);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+
+                if (running->fetch_sub(1) == 1) {
+                    stage.finish();
+                }
+            });
+        }
+    }
+
+    join();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void Graph::add_stage(const char* name, const size_t& threads_count, std::function<void(const char*)> work,
+    std::function<void()> finish)
+{
+    if (!threads.empty()) {
+        throw std::logic_error("Graph::add_stage !threads.empty()");
+    }
+
+    stages.push_back(Stage{ name, threads_count, std::move(work), std::move(finish) });
+}
+
+void Graph::fail(const std::exception_ptr& stage_error)
+{
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+            error = stage_error;
+        }
+    }
+
+    for (const auto& queue : queues) {
+        queue->cancel();
+    }
+}
+
+void Graph::join()
+{
+    for (std::thread& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+} // namespace pipeline
@@ -0,0 +1,101 @@
+#include "utility/pointtransform.h"
+
+#include "utility/cpufeatures.h"
+
+#include <immintrin.h>
+
+namespace {
+
+typedef void (*TransformFunction)(const float*, float*, size_t, size_t);
+
+/** \brief Column major rotation and translation, the fourth float of every column is zero. */
+struct Columns {
+    alignas(16) float c[16];
+
+    explicit Columns(const Eigen::Matrix4f& transformation)
+    {
+        for (int col = 0; col < 4; ++col) {
+            for (int row = 0; row < 3; ++row) {
+                c[col * 4 + row] = transformation(row, col);
+            }
+            c[col * 4 + 3] = 0.f;
+        }
+    }
+};
+
+//SSE2 is a part of x86-64, a point per step
+void transform_sse(const float* c, float* data, size_t count, size_t stride)
+{
+    const __m128 c0 = _mm_load_ps(c);
+    const __m128 c1 = _mm_load_ps(c + 4);
+    const __m128 c2 = _mm_load_ps(c + 8);
+    const __m128 c3 = _mm_load_ps(c + 12);
+    const __m128 w_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+    for (size_t i = 0; i < count; ++i, data += stride) {
+        const __m128 p = _mm_loadu_ps(data);
+        const __m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0));
+        const __m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+        const __m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+
+        const __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, x), _mm_mul_ps(c1, y)), _mm_mul_ps(c2, z)), c3);
+        _mm_storeu_ps(data, _mm_add_ps(r, _mm_and_ps(p, w_mask)));
+    }
+}
+
+CPU_TARGET("avx2")
+void transform_avx2(const float* c, float* data, size_t count, size_t stride)
+{
+    const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(c));
+    const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(c + 4));
+    const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(c + 8));
+    const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(c + 12));
+    const __m256 w_mask = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+
+    //Two points per step, one in each 128 bit lane
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, data += 2 * stride) {
+        const __m256 p = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(data)), _mm_loadu_ps(data + stride), 1);
+        const __m256 x = _mm256_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0));
+        const __m256 y = _mm256_permute_ps(p, _MM_SHUFFLE(1, 1, 1, 1));
+        const __m256 z = _mm256_permute_ps(p, _MM_SHUFFLE(2, 2, 2, 2));
+
+        __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, x), _mm256_mul_ps(c1, y)), _mm256_mul_ps(c2, z)), c3);
+        r = _mm256_add_ps(r, _mm256_and_ps(p, w_mask));
+        _mm_storeu_ps(data, _mm256_castps256_ps128(r));
+        _mm_storeu_ps(data + stride, _mm256_extractf128_ps(r, 1));
+    }
+
+    transform_sse(c, data, count - i, stride);
+}
+
+struct Implementation {
+    TransformFunction transform;
+    const char* name;
+};
+
+const Implementation& selected_implementation()
+{
+    static const Implementation selected = cpu_features::hasAvx2()
+        ? Implementation{ transform_avx2, "avx2" }
+        : Implementation{ transform_sse, "sse" };
+    return selected;
+}
+
+} // namespace
+
+void point_transform::apply(const Eigen::Matrix4f& transformation, const Points* clouds, const size_t& clouds_count)
+{
+    const Columns columns(transformation);
+    const TransformFunction transform = selected_implementation().transform;
+    for (size_t i = 0; i < clouds_count; ++i) {
+        if (clouds[i].count > 0) {
+            transform(columns.c, clouds[i].data, clouds[i].count, clouds[i].stride);
+        }
+    }
+}
+
+const char* point_transform::implementation()
+{
+    return selected_implementation().name;
+}
@@ -0,0 +1,241 @@
+#include "utility/profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    int index;
+    double begin_us;
+    double duration_us;
+};
+
+struct ThreadSamples {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<double> > samples;
+    std::vector<TraceEvent> events;
+    //Small numbers read better in the trace than native thread ids
+    size_t thread_id;
+};
+
+std::atomic<bool> profiling_enabled(false);
+std::atomic<bool> trace_enabled(false);
+
+std::mutex threads_mutex;
+std::vector<std::shared_ptr<ThreadSamples> > threads_samples;
+int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+//Atomic as closing zones read it while reset() may move it
+std::atomic<int64_t> trace_epoch_ns(now_ns());
+
+//Owned by the thread, the registry keeps the samples of threads that have finished
+thread_local std::string current_path;
+thread_local std::shared_ptr<ThreadSamples> thread_samples;
+
+ThreadSamples& this_thread_samples()
+{
+    if (!thread_samples) {
+        thread_samples = std::make_shared<ThreadSamples>();
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        thread_samples->thread_id = threads_samples.size();
+        threads_samples.push_back(thread_samples);
+    }
+
+    return *thread_samples;
+}
+
+double microseconds_since(const std::chrono::steady_clock::time_point& from,
+    const std::chrono::steady_clock::time_point& to)
+{
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+double percentile(std::vector<double>& samples, const double& fraction)
+{
+    const size_t index = std::min(samples.size() - 1, size_t(fraction * (samples.size() - 1) + 0.5));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+std::string json_string(const std::string& value)
+{
+    std::string result = "\"";
+    for (const char& c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+
+    return result + "\"";
+}
+
+} // namespace
+
+namespace profiler
+{
+
+void setEnabled(const bool& enabled)
+{
+    profiling_enabled = enabled;
+}
+
+bool enabled()
+{
+    return profiling_enabled;
+}
+
+void setTraceEnabled(const bool& enabled)
+{
+    trace_enabled = enabled;
+}
+
+void reset()
+{
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (const auto& samples : threads_samples) {
+        std::lock_guard<std::mutex> samples_lock(samples->mutex);
+        samples->samples.clear();
+        samples->events.clear();
+    }
+    trace_epoch_ns = now_ns();
+}
+
+std::string jsonReport()
+{
+    std::map<std::string, std::vector<double> > zones;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto& samples : threads_samples) {
+            std::lock_guard<std::mutex> samples_lock(samples->mutex);
+            for (const auto& zone : samples->samples) {
+                std::vector<double>& merged = zones[zone.first];
+                merged.insert(merged.end(), zone.second.begin(), zone.second.end());
+            }
+        }
+    }
+
+    std::string result = "{\n  \"zones\": [";
+    bool first = true;
+    for (auto& zone : zones) {
+        double total = 0;
+        for (const double& sample : zone.second) {
+            total += sample;
+        }
+        const size_t count = zone.second.size();
+        const double p50 = percentile(zone.second, 0.5);
+        const double p99 = percentile(zone.second, 0.99);
+
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "\"count\": %zu, \"total_ms\": %.3f, \"p50_ms\": %.3f, \"p99_ms\": %.3f }", count, total, p50, p99);
+        result += std::string(first ? "\n" : ",\n") + "    { \"zone\": " + json_string(zone.first) + ", " + line;
+        first = false;
+    }
+
+    return result + "\n  ]\n}";
+}
+
+bool writeChromeTrace(const std::string& filename)
+{
+    FILE* file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    std::fputs("{\"traceEvents\":[", file);
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto& samples : threads_samples) {
+            std::lock_guard<std::mutex> samples_lock(samples->mutex);
+            if (samples->events.empty()) {
+                continue;
+            }
+
+            std::fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,"
+                               "\"args\":{\"name\":\"thread %zu\"}}",
+                first ? "" : ",", samples->thread_id, samples->thread_id);
+            first = false;
+
+            for (const TraceEvent& event : samples->events) {
+                std::fprintf(file, ",\n{\"name\":%s,\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.1f,\"dur\":%.1f",
+                    json_string(event.name).c_str(), samples->thread_id, event.begin_us, event.duration_us);
+                if (event.index >= 0) {
+                    std::fprintf(file, ",\"args\":{\"index\":%d}", event.index);
+                }
+                std::fputs("}", file);
+            }
+        }
+    }
+    std::fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+
+    return std::fclose(file) == 0;
+}
+
+Zone::Zone(const char* name_, const int& index_)
+    : active(profiling_enabled)
+    , traced(false)
+    , name(name_)
+    , index(index_)
+    , parent_length(0)
+{
+    if (!active) {
+        return;
+    }
+
+    parent_length = current_path.size();
+    if (!current_path.empty()) {
+        current_path += '/';
+    }
+    current_path += name;
+    traced = trace_enabled;
+    start = std::chrono::steady_clock::now();
+}
+
+Zone::~Zone()
+{
+    if (!active) {
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    const double microseconds = microseconds_since(start, end);
+    ThreadSamples& samples = this_thread_samples();
+    {
+        std::lock_guard<std::mutex> lock(samples.mutex);
+        samples.samples[current_path].push_back(microseconds / 1000.0);
+        if (traced) {
+            const double begin_us = (std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count()
+                                        - trace_epoch_ns)
+                / 1000.0;
+            samples.events.push_back({ name, index, begin_us, microseconds });
+        }
+    }
+    current_path.resize(parent_length);
+}
+
+DetachedScope::DetachedScope()
+{
+    parent_path.swap(current_path);
+}
+
+DetachedScope::~DetachedScope()
+{
+    current_path.swap(parent_path);
+}
+
+} // namespace profiler
@@ -0,0 +1,206 @@
+#include "utility/threadpool.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "core/base/scannerconfig.h"
+
+namespace {
+
+//The pool and the queue index of a worker thread, so its submits go to its own queue
+thread_local ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+const ScannerConfig& pool_configs()
+{
+    static const ScannerConfig config;
+    return config;
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads_count)
+    : pending_tasks(0)
+    , active_tasks(0)
+    , stopping(false)
+{
+    if (threads_count == 0) {
+        threads_count = 1;
+    }
+
+    for (size_t i = 0; i < threads_count; ++i) {
+        queues.emplace_back(new Worker);
+    }
+    for (size_t i = 0; i < threads_count; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::instance()
+{
+    //0 - a thread per core
+    static ThreadPool pool(pool_configs().value("THREAD_POOL_SETTINGS/THREADS").toUInt() > 0
+            ? pool_configs().value("THREAD_POOL_SETTINGS/THREADS").toUInt()
+            : std::thread::hardware_concurrency());
+    return pool;
+}
+
+size_t ThreadPool::size() const
+{
+    return workers.size();
+}
+
+bool ThreadPool::run_pending_task()
+{
+    Task task;
+    if (!take_task(task)) {
+        return false;
+    }
+
+    run_task(task);
+    return true;
+}
+
+size_t ThreadPool::activeTasks() const
+{
+    return active_tasks.load(std::memory_order_relaxed);
+}
+
+int ThreadPool::openMPThreadsLimit()
+{
+    static const int limit = std::max(0, pool_configs().value("THREAD_POOL_SETTINGS/OPENMP_THREADS").toInt());
+    return limit;
+}
+
+void ThreadPool::push_task(Task task)
+{
+    //Counted before it is queued, so the count never falls below the tasks in the queues
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        pending_tasks.fetch_add(1);
+    }
+
+    if (current_pool == this) {
+        Worker& worker = *queues[current_index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_tasks.push_back(std::move(task));
+    }
+    condition.notify_one();
+}
+
+bool ThreadPool::take_task(Task& task)
+{
+    if (pending_tasks.load() == 0) {
+        return false;
+    }
+
+    const bool is_worker = current_pool == this;
+    if (is_worker) {
+        Worker& worker = *queues[current_index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            pending_tasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (!shared_tasks.empty()) {
+            task = std::move(shared_tasks.front());
+            shared_tasks.pop_front();
+            pending_tasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    //Victims from the next worker on, so thieves spread over the queues
+    const size_t first = is_worker ? current_index + 1 : 0;
+    for (size_t i = 0; i < queues.size(); ++i) {
+        Worker& victim = *queues[(first + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending_tasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run_task(Task& task)
+{
+    active_tasks.fetch_add(1, std::memory_order_relaxed);
+    task();
+    active_tasks.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ThreadPool::work(const size_t& index)
+{
+    current_pool = this;
+    current_index = index;
+
+#ifdef _OPENMP
+    //OpenMP regions inside tasks would run on top of a pool using every core already
+    if (openMPThreadsLimit() > 0) {
+        omp_set_num_threads(openMPThreadsLimit());
+    }
+#endif
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            condition.wait(lock, [this]() { return stopping || pending_tasks.load() > 0; });
+            if (stopping && pending_tasks.load() == 0) {
+                return;
+            }
+        }
+
+        //Another thread may take the task first, the worker then waits again
+        Task task;
+        if (take_task(task)) {
+            run_task(task);
+        }
+    }
+}
+
+OpenMPLimit::OpenMPLimit()
+    : previous_threads(0)
+{
+#ifdef _OPENMP
+    if (ThreadPool::openMPThreadsLimit() > 0 && ThreadPool::instance().activeTasks() > 0) {
+        previous_threads = omp_get_max_threads();
+        omp_set_num_threads(ThreadPool::openMPThreadsLimit());
+    }
+#endif
+}
+
+OpenMPLimit::~OpenMPLimit()
+{
+#ifdef _OPENMP
+    if (previous_threads > 0) {
+        omp_set_num_threads(previous_threads);
+    }
+#endif
+}
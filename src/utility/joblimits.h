@@ -0,0 +1,43 @@
+#ifndef JOB_LIMITS_H
+#define JOB_LIMITS_H
+
+#include <cstddef>
+
+/** \brief Resource limits of the job the calling thread runs, for several projects reconstructed by one
+  * process at a time. They only narrow the process wide limits, 0 leaves a limit to them.
+  */
+namespace job_limits
+{
+
+struct Limits {
+    /** \brief Loops processed at once. */
+    size_t loop_lanes;
+    /** \brief Bytes the loops of the job may hold at once. */
+    size_t loops_memory;
+
+    Limits()
+        : loop_lanes(0)
+        , loops_memory(0)
+    {
+    }
+};
+
+/** \brief The limits of the calling thread, none outside a Scope. */
+const Limits& current();
+
+/** \brief Sets the limits of the calling thread for its lifetime, scopes nest. */
+class Scope {
+public:
+    explicit Scope(const Limits& limits);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const Limits previous;
+};
+
+} // namespace job_limits
+
+#endif // JOB_LIMITS_H
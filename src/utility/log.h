@@ -0,0 +1,101 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <QString>
+#include <QTextStream>
+
+#include <atomic>
+#include <string>
+
+/** \brief Leveled log with a level per module, configs.ini LOGGING. A message below the level of its
+  * module costs one relaxed load and is never formatted. Enabled messages are formatted on the calling
+  * thread and handed to a writer thread through a bounded lock-free queue, a message finding the
+  * queue full is dropped and the drops are reported by the writer.
+  *
+  *     LOG_DEBUG("io") << "Loading frame #" << index;
+  *
+  * As with qDebug() the values are separated by spaces.
+  */
+namespace logging
+{
+
+enum Level {
+    LEVEL_TRACE,
+    LEVEL_DEBUG,
+    LEVEL_INFO,
+    LEVEL_WARNING,
+    LEVEL_ERROR,
+    LEVEL_OFF
+};
+
+class Module {
+public:
+    Module(const std::string& name, const Level& level);
+
+    const std::string& name() const;
+
+    inline bool enabled(const Level& level) const
+    {
+        return int(level) >= threshold.load(std::memory_order_relaxed);
+    }
+
+    void setLevel(const Level& level);
+
+private:
+    const std::string module_name;
+    std::atomic<int> threshold;
+};
+
+/** \brief The module of the name, created on first use at its LOGGING/MODULES level, else at LOGGING/LEVEL. */
+Module& module(const char* name);
+
+/** \brief Returns once every message logged so far is written. */
+void flush();
+
+class Message {
+public:
+    Message(const Level& level, const Module& module);
+    ~Message();
+
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+
+    template <typename T>
+    Message& operator<<(const T& value)
+    {
+        separate();
+        stream << value;
+        return *this;
+    }
+
+    Message& operator<<(const std::string& value);
+
+    Message& operator<<(const bool& value);
+
+private:
+    const Level level;
+    const Module& message_module;
+    QString text;
+    QTextStream stream;
+
+    void separate();
+};
+
+} // namespace logging
+
+/** \brief The module is looked up once per call site, name must be a literal. */
+#define LOG_MESSAGE(level, name)                                                                          \
+    for (logging::Module* log_module_ = &([]() -> logging::Module& {                                       \
+             static logging::Module& call_site_module = logging::module(name);                             \
+             return call_site_module;                                                                      \
+         }());                                                                                              \
+         log_module_ != nullptr && log_module_->enabled(level); log_module_ = nullptr)                      \
+    logging::Message(level, *log_module_)
+
+#define LOG_TRACE(name) LOG_MESSAGE(logging::LEVEL_TRACE, name)
+#define LOG_DEBUG(name) LOG_MESSAGE(logging::LEVEL_DEBUG, name)
+#define LOG_INFO(name) LOG_MESSAGE(logging::LEVEL_INFO, name)
+#define LOG_WARNING(name) LOG_MESSAGE(logging::LEVEL_WARNING, name)
+#define LOG_ERROR(name) LOG_MESSAGE(logging::LEVEL_ERROR, name)
+
+#endif // LOG_H
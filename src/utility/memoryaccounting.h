@@ -0,0 +1,91 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/** \brief Process wide byte counters of the subsystems holding most of the memory, with their
+  * high-water marks. Objects are counted from the size they were tracked with until the last
+  * copy of their pointer drops them, gauges are set by the subsystem owning them.
+  * MEMORY_SETTINGS/BUDGET_MB bounds the total, the frame cache and the loop schedulers back off past it.
+  */
+namespace memory_accounting
+{
+
+enum Category {
+    FRAMES,
+    KEYPOINTS_FRAMES,
+    /** \brief Gauge of the frames held by the frame cache, they are counted in FRAMES too. */
+    FRAME_CACHE,
+    /** \brief Gauge of the loop structures of the running algorithm. */
+    LOOPS,
+    /** \brief Gauge of the TSDF volume. */
+    TSDF,
+    CATEGORIES_COUNT
+};
+
+void add(const Category& category, const size_t& bytes);
+
+void remove(const Category& category, const size_t& bytes);
+
+void set(const Category& category, const size_t& bytes);
+
+size_t current(const Category& category);
+
+size_t peak(const Category& category);
+
+/** \brief Every category but FRAME_CACHE, whose frames are already counted. */
+size_t total();
+
+size_t peakTotal();
+
+/** \brief High-water marks start again from the current figures. */
+void resetPeaks();
+
+/** \brief Bytes, 0 without a budget. */
+size_t budget();
+
+/** \brief Bytes the total is over the budget, 0 under it. */
+size_t excess();
+
+/** \brief Current and peak bytes of every category and of the total. */
+std::string jsonReport();
+
+template <typename T>
+struct Tracked {
+    std::shared_ptr<T> object;
+    Category category;
+    size_t bytes;
+
+    Tracked(const std::shared_ptr<T>& object_, const Category& category_, const size_t& bytes_)
+        : object(object_)
+        , category(category_)
+        , bytes(bytes_)
+    {
+        add(category, bytes);
+    }
+
+    ~Tracked()
+    {
+        remove(category, bytes);
+    }
+};
+
+/** \brief Pointer sharing the object, counted in the category until its last copy is released.
+  * Copies of the result share one count, use_count() of the result is that of its copies.
+  */
+template <typename T>
+std::shared_ptr<T> track(const std::shared_ptr<T>& object, const Category& category, const size_t& bytes)
+{
+    if (!object) {
+        return object;
+    }
+
+    auto tracked = std::make_shared<Tracked<T> >(object, category, bytes);
+    return std::shared_ptr<T>(tracked, tracked->object.get());
+}
+
+} // namespace memory_accounting
+
+#endif // MEMORY_ACCOUNTING_H
@@ -6,6 +6,8 @@
 
 #include "core/base/scannerbase.h"
 #include "core/base/scannertypes.h"
+#include "utility/depthguidedfilter.h"
+#include "utility/depthplane.h"
 
 class PcdFilters : public ScannerBase {
     Q_OBJECT
@@ -13,47 +15,103 @@ class PcdFilters : public ScannerBase {
 public:
     PcdFilters(QObject* parent, QSettings* parent_settings);
 
-    void setInput(const Frames& input_frames);
+    void setInput(Frames input_frames);
 
     void filter(Frames& filtered_frames);
 
     static void reorganize_all_frames(Frames& frames);
 
+    /** \brief Organized cloud and image of a frame just read at 1 / factor of the resolution. */
+    static void downsample_frame(Frame& frame, const int& factor);
+
     Frames getFilteredFrames();
 
 private:
     const bool undistortion;
     const bool bilateral;
+    const bool guided;
     const bool statistical;
+    const bool organized_statistical;
     const bool mls;
+    const bool normals;
     const bool voxel_grid;
     Frames frames;
 
+    /** \brief Scratch of the filters of one frame, reused by the frames filtered after it. */
+    struct FilterBuffers {
+        DepthPlane depth;
+        DepthPlane filtered_depth;
+        DepthGuidedFilter guided;
+        pcl::IndicesPtr valid_indices;
+        std::vector<int> removed_indices;
+        std::vector<float> mean_distances;
+        std::vector<uint64_t> voxel_keys;
+        std::vector<size_t> shard_offsets;
+        std::vector<size_t> shard_order;
+        NormalPcd smoothed;
+
+        FilterBuffers()
+            : valid_indices(new std::vector<int>())
+        {
+        }
+    };
+
     void filter_all_frames(Frames& frames);
 
     void filter_one_frame(Frame& frame);
 
+    /** \brief Free buffers of an earlier frame or new ones, given back when released. Frames are filtered
+      * in pool tasks whose waits run other frames' tasks on the same thread, so the buffers can't be per thread.
+      */
+    static std::shared_ptr<FilterBuffers> filter_buffers();
+
+    static void collect_valid_indices(const Pcd& cloud, std::vector<int>& indices);
+
+    static void invalidate(PointType& point);
+
     void apply_bilateral_filter(
-        PcdPtr& src_point_cloud_ptr,
+        Pcd& cloud,
+        FilterBuffers& buffers,
         const int& d,
         const double& sigma_color,
         const double& sigma_space);
 
+    /** \brief OPENCV_BILATERAL_FILTER_SETTINGS/METHOD=GUIDED, the same smoothing in constant time per pixel. */
+    void apply_guided_filter(
+        Pcd& cloud,
+        FilterBuffers& buffers,
+        const int& radius,
+        const double& epsilon);
+
     void apply_statistical_outlier_removal_filter(
-        PcdPtr& in_point_cloud_ptr,
-        PcdPtr& out_point_cloud_ptr,
+        const PcdPtr& point_cloud_ptr,
+        FilterBuffers& buffers,
+        const int& meanK,
+        const float& stddevMulThresh);
+
+    /** \brief StatisticalOutlierRemoval semantics with the neighbours taken from a pixel window around
+      * every point instead of a KD-tree search, rows are spread over the thread pool.
+      */
+    void apply_organized_outlier_removal_filter(
+        Pcd& cloud,
+        FilterBuffers& buffers,
+        const int& window_radius,
         const int& meanK,
         const float& stddevMulThresh);
 
     void apply_moving_least_squares_filter(
-        PcdPtr& point_cloud_ptr_in,
-        pcl::PointCloud<pcl::PointNormal>::Ptr& point_cloud_ptr_out,
+        const PcdPtr& point_cloud_ptr,
+        FilterBuffers& buffers,
         const double& sqrGaussParam,
         const double& searchRadius);
 
+    /** \brief Every voxel's points are replaced by their centroid and mean colour, kept at the voxel's
+      * first pixel so the cloud stays organized. The points are partitioned once by voxel key into
+      * shards, one per task of the thread pool, each accumulating its voxels in a hash map of its own.
+      */
     void apply_voxel_grid_reduction(
-        PcdPtr& in_point_cloud_ptr,
-        PcdPtr& out_point_cloud_ptr,
+        Pcd& cloud,
+        FilterBuffers& buffers,
         const float& leaf_x,
         const float& leaf_y,
         const float& leaf_z);
@@ -0,0 +1,264 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utility/profiler.h"
+#include "utility/ticketgate.h"
+
+/** \brief Graph of concurrent stages connected by bounded queues. Items carry the sequence number their
+  * source gave them and every stage emits them in that order, so a stage with several workers still feeds
+  * the next one in order. A full queue blocks its producers, a failed stage cancels every queue of the
+  * graph and run() rethrows the first error once all the stages have stopped.
+  *
+  *     pipeline::Graph graph;
+  *     auto frames = graph.queue<Frame>(4);
+  *     graph.source<Frame>("load", frames, [&](pipeline::Emitter<Frame>& emit) { ... emit(frame); });
+  *     graph.sink<Frame>("integrate", frames, [&](Frame& frame) { ... });
+  *     graph.run();
+  */
+namespace pipeline
+{
+
+class Closable {
+public:
+    virtual ~Closable() {}
+
+    /** \brief Pops still drain the queue, pushes fail. */
+    virtual void close() = 0;
+
+    /** \brief Pushes and pops fail right away. */
+    virtual void cancel() = 0;
+};
+
+template <typename T>
+class BoundedQueue : public Closable {
+public:
+    struct Item {
+        size_t sequence;
+        T value;
+    };
+
+    explicit BoundedQueue(const size_t& capacity_)
+        : capacity(std::max<size_t>(1, capacity_))
+        , peak_size(0)
+        , closed(false)
+        , cancelled(false)
+    {
+    }
+
+    /** \brief Blocks while the queue is full, false once it is closed. */
+    bool push(const size_t& sequence, T value)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        space_available.wait(lock, [this]() { return items.size() < capacity || closed || cancelled; });
+        if (closed || cancelled) {
+            return false;
+        }
+
+        items.push_back(Item{ sequence, std::move(value) });
+        peak_size = std::max(peak_size, items.size());
+        item_available.notify_one();
+        return true;
+    }
+
+    /** \brief Blocks while the queue is empty, false once it is closed and drained. */
+    bool pop(Item& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        item_available.wait(lock, [this]() { return !items.empty() || closed || cancelled; });
+        if (cancelled || items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        space_available.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        item_available.notify_all();
+        space_available.notify_all();
+    }
+
+    void cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+        items.clear();
+        item_available.notify_all();
+        space_available.notify_all();
+    }
+
+    /** \brief Most items the queue held at once, equal to the capacity when the consumer was the bottleneck. */
+    size_t peakSize()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return peak_size;
+    }
+
+private:
+    const size_t capacity;
+
+    std::mutex mutex;
+    std::condition_variable item_available;
+    std::condition_variable space_available;
+    std::deque<Item> items;
+    size_t peak_size;
+    bool closed;
+    bool cancelled;
+};
+
+/** \brief Numbers the items of a source or of a serial stage, from 0 in emission order. */
+template <typename T>
+class Emitter {
+public:
+    explicit Emitter(const std::shared_ptr<BoundedQueue<T> >& output_)
+        : output(output_)
+        , next_sequence(0)
+    {
+    }
+
+    /** \brief Blocks while the output is full, false once the graph is cancelled. */
+    bool operator()(T value)
+    {
+        return output->push(next_sequence++, std::move(value));
+    }
+
+private:
+    const std::shared_ptr<BoundedQueue<T> > output;
+    size_t next_sequence;
+};
+
+class Graph {
+public:
+    Graph();
+    ~Graph();
+
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    template <typename T>
+    std::shared_ptr<BoundedQueue<T> > queue(const size_t& capacity)
+    {
+        std::shared_ptr<BoundedQueue<T> > result = std::make_shared<BoundedQueue<T> >(capacity);
+        queues.push_back(result);
+        return result;
+    }
+
+    /** \brief One thread calling function(Emitter<Out>&) once, the output is closed when it returns.
+      * Unlike the other stages the source is not profiled as a whole, it would include the time blocked.
+      */
+    template <typename Out, typename Function>
+    void source(const char* name, const std::shared_ptr<BoundedQueue<Out> >& output, Function function)
+    {
+        add_stage(name, 1, [output, function](const char*) mutable {
+            Emitter<Out> emit(output);
+            function(emit);
+        }, [output]() { output->close(); });
+    }
+
+    /** \brief threads_count workers mapping every input item to Out function(In&), the results are pushed
+      * in the order of the inputs. So function must be safe to call concurrently.
+      */
+    template <typename In, typename Out, typename Function>
+    void stage(const char* name, const size_t& threads_count, const std::shared_ptr<BoundedQueue<In> >& input,
+        const std::shared_ptr<BoundedQueue<Out> >& output, Function function)
+    {
+        std::shared_ptr<TicketGate> order = std::make_shared<TicketGate>();
+        add_stage(name, std::max<size_t>(1, threads_count), [input, output, function, order](const char* zone) {
+            typename BoundedQueue<In>::Item item;
+            while (input->pop(item)) {
+                std::unique_ptr<Out> result;
+                try {
+                    PROFILE_ZONE_INDEX(zone, int(item.sequence));
+                    result.reset(new Out(function(item.value)));
+                } catch (...) {
+                    order->pass(item.sequence);
+                    throw;
+                }
+
+                bool pushed = false;
+                order->run(item.sequence, [&]() { pushed = output->push(item.sequence, std::move(*result)); });
+                if (!pushed) {
+                    return;
+                }
+            }
+        }, [output]() { output->close(); });
+    }
+
+    /** \brief One thread calling function(In&, Emitter<Out>&) for every input item in order, for stateful
+      * steps that emit any number of items per input.
+      */
+    template <typename In, typename Out, typename Function>
+    void serial(const char* name, const std::shared_ptr<BoundedQueue<In> >& input,
+        const std::shared_ptr<BoundedQueue<Out> >& output, Function function)
+    {
+        add_stage(name, 1, [input, output, function](const char* zone) mutable {
+            Emitter<Out> emit(output);
+            typename BoundedQueue<In>::Item item;
+            while (input->pop(item)) {
+                PROFILE_ZONE_INDEX(zone, int(item.sequence));
+                function(item.value, emit);
+            }
+        }, [output]() { output->close(); });
+    }
+
+    /** \brief One thread calling function(In&) for every input item in order. */
+    template <typename In, typename Function>
+    void sink(const char* name, const std::shared_ptr<BoundedQueue<In> >& input, Function function)
+    {
+        add_stage(name, 1, [input, function](const char* zone) mutable {
+            typename BoundedQueue<In>::Item item;
+            while (input->pop(item)) {
+                PROFILE_ZONE_INDEX(zone, int(item.sequence));
+                function(item.value);
+            }
+        }, []() {});
+    }
+
+    /** \brief Starts every stage and returns once all of them stopped, rethrows the first error. */
+    void run();
+
+private:
+    struct Stage {
+        const char* name;
+        size_t threads_count;
+        std::function<void(const char*)> work;
+        //Called by the last worker of the stage to stop
+        std::function<void()> finish;
+    };
+
+    std::vector<Stage> stages;
+    std::vector<std::shared_ptr<Closable> > queues;
+    std::vector<std::thread> threads;
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    void add_stage(const char* name, const size_t& threads_count, std::function<void(const char*)> work,
+        std::function<void()> finish);
+
+    void fail(const std::exception_ptr& stage_error);
+
+    void join();
+};
+
+} // namespace pipeline
+
+#endif // PIPELINE_H
@@ -0,0 +1,49 @@
+#ifndef POINT_TRANSFORM_H
+#define POINT_TRANSFORM_H
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+
+#include <cstddef>
+
+/** \brief Rigid transform of point clouds in place. The x, y, z of a PCL point are the first floats of
+  * its 16 byte aligned data[4], so an SSE register holds a point and AVX2 two, the implementation is
+  * picked once for the running CPU. Every cloud given to one call is transformed in a single pass with
+  * no allocation, data[3] and the other fields are kept, as pcl::transformPointCloud does.
+  *
+  *     point_transform::transform_in_place(pose, *cloud, *normal_cloud);
+  */
+namespace point_transform
+{
+
+/** \brief count points xyz, the first one at data and the next one stride floats further. */
+struct Points {
+    float* data;
+    size_t count;
+    size_t stride;
+};
+
+template <typename PointT>
+inline Points points(pcl::PointCloud<PointT>& cloud)
+{
+    static_assert(sizeof(PointT) % 16 == 0, "point_transform::points the point is not 16 byte aligned");
+
+    return Points{ cloud.empty() ? nullptr : &cloud.points[0].x, cloud.size(), sizeof(PointT) / sizeof(float) };
+}
+
+/** \brief Transforms the xyz of clouds [clouds; clouds + clouds_count). */
+void apply(const Eigen::Matrix4f& transformation, const Points* clouds, const size_t& clouds_count);
+
+template <typename... Clouds>
+inline void transform_in_place(const Eigen::Matrix4f& transformation, Clouds&... clouds)
+{
+    const Points all[] = { points(clouds)... };
+    apply(transformation, all, sizeof...(Clouds));
+}
+
+const char* implementation();
+
+} // namespace point_transform
+
+#endif // POINT_TRANSFORM_H
@@ -0,0 +1,17 @@
+#ifndef PROCESS_MEMORY_H
+#define PROCESS_MEMORY_H
+
+#include <cstddef>
+
+/** \brief Resident memory of the running process as the OS reports it, 0 where it can't be read. */
+namespace process_memory
+{
+
+size_t residentBytes();
+
+/** \brief High-water mark since the process started. */
+size_t peakResidentBytes();
+
+} // namespace process_memory
+
+#endif // PROCESS_MEMORY_H
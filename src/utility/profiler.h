@@ -0,0 +1,73 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/** \brief Scoped timers of nested zones. A zone is named by the path of the zones open on its thread,
+  * "reconstruct/loop/icp", and every thread accumulates its samples on its own, so zones cost one
+  * uncontended lock when they close. Disabled zones cost a flag check.
+  * With the trace enabled every zone also records a timeline event with its thread and an optional
+  * frame or loop index, written as Chrome trace JSON for chrome://tracing and Perfetto.
+  */
+namespace profiler
+{
+
+void setEnabled(const bool& enabled);
+
+bool enabled();
+
+/** \brief Zones record timeline events too, only zones opened while profiling is enabled. */
+void setTraceEnabled(const bool& enabled);
+
+/** \brief Drops the samples and events of every thread, event times start from here. */
+void reset();
+
+/** \brief Every zone with its sample count, total, median and 99th percentile in milliseconds. */
+std::string jsonReport();
+
+/** \brief Complete events of every thread in Chrome trace format, false when the file can't be written. */
+bool writeChromeTrace(const std::string& filename);
+
+class Zone {
+public:
+    /** \brief name must outlive the trace, a literal. index, a frame or loop number, is shown in the
+      * trace when it is not negative.
+      */
+    explicit Zone(const char* name, const int& index = -1);
+    ~Zone();
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    bool active;
+    bool traced;
+    const char* name;
+    int index;
+    size_t parent_length;
+    std::chrono::steady_clock::time_point start;
+};
+
+/** \brief Zones opened in its scope start a new path, for pool tasks run by a thread waiting in a zone. */
+class DetachedScope {
+public:
+    DetachedScope();
+    ~DetachedScope();
+
+    DetachedScope(const DetachedScope&) = delete;
+    DetachedScope& operator=(const DetachedScope&) = delete;
+
+private:
+    std::string parent_path;
+};
+
+} // namespace profiler
+
+#define PROFILE_ZONE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) profiler::Zone PROFILE_ZONE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_ZONE_INDEX(name, index) profiler::Zone PROFILE_ZONE_CONCAT(profile_zone_, __LINE__)(name, index)
+
+#endif // PROFILER_H
@@ -0,0 +1,150 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "utility/profiler.h"
+
+/** \brief Fixed size pool of worker threads shared by the whole process, configs.ini THREAD_POOL_SETTINGS.
+  * Every worker has its own queue: tasks submitted by a worker go to its queue and are taken back newest
+  * first, tasks submitted by other threads go to a shared queue, and an idle worker steals the oldest task
+  * of another worker. Threads that wait for results help to execute queued tasks, so tasks may safely
+  * submit and wait for other tasks.
+  */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& instance();
+
+    size_t size() const;
+
+    template <typename Function>
+    std::future<typename std::result_of<Function()>::type> submit(Function&& function)
+    {
+        typedef typename std::result_of<Function()>::type Result;
+
+        auto task = std::make_shared<std::packaged_task<Result()> >(std::forward<Function>(function));
+        std::future<Result> result = task->get_future();
+        //A waiting thread may run the task inside its own zones, the task's zones start a path of their own
+        push_task([task]() {
+            profiler::DetachedScope detached;
+            (*task)();
+        });
+
+        return result;
+    }
+
+    template <typename Future>
+    void wait(const Future& future)
+    {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!run_pending_task()) {
+                future.wait_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    /** \brief Calls function(i) for every i in [from; to) and returns when all calls are done. */
+    template <typename Function>
+    void parallel_for(size_t from, size_t to, const Function& function)
+    {
+        if (to <= from) {
+            return;
+        }
+
+        const size_t count = to - from;
+        const size_t chunks_count = std::min(count, size() + 1);
+        const size_t chunk_size = (count + chunks_count - 1) / chunks_count;
+
+        std::vector<std::future<void> > futures;
+        for (size_t begin = from; begin < to; begin += chunk_size) {
+            const size_t end = std::min(to, begin + chunk_size);
+            futures.push_back(submit([begin, end, &function]() {
+                for (size_t i = begin; i < end; ++i) {
+                    function(i);
+                }
+            }));
+        }
+
+        for (auto& future : futures) {
+            wait(future);
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    }
+
+    bool run_pending_task();
+
+    /** \brief Tasks being executed right now by the workers or by waiting threads. */
+    size_t activeTasks() const;
+
+    /** \brief THREAD_POOL_SETTINGS/OPENMP_THREADS, the OpenMP threads of a region started by a pool task or,
+      * through OpenMPLimit, while the pool is active. 0 when OpenMP is left alone.
+      */
+    static int openMPThreadsLimit();
+
+private:
+    typedef std::function<void()> Task;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker> > queues;
+    std::vector<std::thread> workers;
+    std::mutex shared_mutex;
+    std::deque<Task> shared_tasks;
+
+    //Queued tasks of every queue, changed under sleep_mutex when it grows so sleeping workers are woken
+    std::atomic<size_t> pending_tasks;
+    std::atomic<size_t> active_tasks;
+    std::mutex sleep_mutex;
+    std::condition_variable condition;
+    bool stopping;
+
+    void push_task(Task task);
+
+    /** \brief Own queue newest first, then the shared queue, then the oldest task of another worker. */
+    bool take_task(Task& task);
+
+    void run_task(Task& task);
+
+    void work(const size_t& index);
+};
+
+/** \brief Caps the OpenMP regions started on the calling thread within its scope to
+  * ThreadPool::openMPThreadsLimit() while the pool is active, for third party OpenMP loops
+  * (cpu_tsdf, aruco) run next to the pool. Workers of the pool are capped for their whole life.
+  * Does nothing without OpenMP.
+  */
+class OpenMPLimit {
+public:
+    OpenMPLimit();
+    ~OpenMPLimit();
+
+    OpenMPLimit(const OpenMPLimit&) = delete;
+    OpenMPLimit& operator=(const OpenMPLimit&) = delete;
+
+private:
+    int previous_threads;
+};
+
+#endif // THREADPOOL_H
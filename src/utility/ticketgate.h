@@ -0,0 +1,67 @@
+#ifndef TICKET_GATE_H
+#define TICKET_GATE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/** \brief Lets tasks that finish out of order run a section strictly in ticket order.
+  * Every ticket from the first one on must get through, a failed task still has to pass() its ticket.
+  */
+class TicketGate {
+public:
+    explicit TicketGate(const size_t& first_ticket = 0)
+        : current_ticket(first_ticket)
+    {
+    }
+
+    TicketGate(const TicketGate&) = delete;
+    TicketGate& operator=(const TicketGate&) = delete;
+
+    /** \brief Waits for the ticket's turn, runs function and lets the next ticket in. Only the ticket
+      * holder can be in its turn, so function runs without the lock and may wait for other work itself.
+      */
+    template <typename Function>
+    void run(const size_t& ticket, const Function& function)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            turn.wait(lock, [this, ticket]() { return current_ticket == ticket; });
+        }
+
+        try {
+            function();
+        } catch (...) {
+            next();
+            throw;
+        }
+
+        next();
+    }
+
+    /** \brief Skips the ticket's section, does nothing if the ticket has passed already. */
+    void pass(const size_t& ticket)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        turn.wait(lock, [this, ticket]() { return current_ticket >= ticket; });
+
+        if (current_ticket == ticket) {
+            ++current_ticket;
+            turn.notify_all();
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable turn;
+    size_t current_ticket;
+
+    void next()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++current_ticket;
+        turn.notify_all();
+    }
+};
+
+#endif // TICKET_GATE_H